@@ -53,6 +53,17 @@
 #include "rgy_resource.h"
 #include "rgy_env.h"
 #include "rgy_opencl.h"
+#include "rgy_check.h"
+#include "rgy_convert_csp_check.h"
+#include "rgy_queue_check.h"
+#include "qsv_feature_cache_check.h"
+#include "rgy_bitstream_check.h"
+#include "rgy_read_ahead_check.h"
+#include "rgy_input_raw_check.h"
+#include "rgy_mux_interleaver_check.h"
+#include "rgy_frame_pos_check.h"
+#include "rgy_filter_ssim_cpu_check.h"
+#include "rgy_filter_colorspace_check.h"
 
 #if ENABLE_AVSW_READER
 extern "C" {
@@ -616,6 +627,28 @@ int parse_print_options(const TCHAR *option_name, const TCHAR *arg1, const QSVDe
         _ftprintf(stdout, _T("%s\n"), str.c_str());
         return 1;
     }
+    //GPUを使用しない動作確認・速度計測
+    static const RGYCheckEntry checkList[] = {
+        { _T("check-csp-conv"),       [](const tstring& arg) { return check_convert_csp(arg); } },
+        { _T("check-queue"),          [](const tstring&) { return check_queue(); } },
+        { _T("check-feature-cache"),  [](const tstring&) { return check_feature_cache(); } },
+        { _T("check-dovi-rpu"),       [](const tstring&) { return check_dovi_rpu(); } },
+        { _T("check-nal-parse"),      [](const tstring&) { return check_nal_parse(); } },
+        { _T("check-read-ahead"),     [](const tstring&) { return check_read_ahead(); } },
+        { _T("check-ssim-cpu"),       [](const tstring&) { return check_ssim_cpu(); } },
+        { _T("check-lut3d-parse"),    [](const tstring&) { return check_lut3d_cube_parse(); } },
+#if ENABLE_RAW_READER
+        { _T("check-raw-read"),       [](const tstring&) { return check_raw_read(); } },
+#endif
+#if ENABLE_AVSW_READER
+        { _T("check-mux-interleave"), [](const tstring&) { return check_mux_interleave(); } },
+        { _T("check-frame-pos"),      [](const tstring&) { return check_frame_pos_list(); } },
+#endif
+    };
+    const int checkRet = rgy_check_run(checkList, _countof(checkList), option_name, arg1);
+    if (checkRet != 0) {
+        return checkRet;
+    }
     if (0 == _tcscmp(option_name, _T("check-device"))) {
         auto devs = getDeviceNameList();
         if (devs.size() > 0) {
@@ -158,6 +158,30 @@ void convert_yuv444_09_to_yuv444_16_sse2(void **dst, const void **src, int width
 void convert_yuv444_to_yuv444_16_avx2(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop);
 void convert_yuv444_to_yuv444_16_sse2(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop);
 
+#if defined(_M_X64) || defined(__x86_64)
+void convert_yv12_16_to_p010_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop);
+void convert_yv12_14_to_p010_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop);
+void convert_yv12_12_to_p010_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop);
+void convert_yv12_10_to_p010_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop);
+void convert_yv12_09_to_p010_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop);
+void convert_yuv444_16_to_yuv444_16_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop);
+void convert_yuv444_14_to_yuv444_16_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop);
+void convert_yuv444_12_to_yuv444_16_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop);
+void convert_yuv444_10_to_yuv444_16_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop);
+void convert_yuv444_09_to_yuv444_16_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop);
+void convert_yuv422_to_p010_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop);
+void convert_yuv422_16_to_p010_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop);
+void convert_yuv422_14_to_p010_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop);
+void convert_yuv422_12_to_p010_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop);
+void convert_yuv422_10_to_p010_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop);
+void convert_yuv422_to_p210_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop);
+void convert_yuv422_16_to_p210_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop);
+void convert_yuv422_14_to_p210_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop);
+void convert_yuv422_12_to_p210_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop);
+void convert_yuv422_10_to_p210_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop);
+void convert_yuv422_09_to_p210_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop);
+#endif
+
 void convert_yuv444_16_to_yuv444_avx2(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop);
 void convert_yuv444_16_to_yuv444_sse2(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop);
 void convert_yuv444_14_to_yuv444_avx2(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop);
@@ -292,10 +316,10 @@ void convert_yuy2_to_nv12_i(void **dst_array, const void **src_array, int width,
             dstY[2*dst_y_pitch_byte   + 1] = srcP[2*src_y_pitch_byte + 2];
             dstY[3*dst_y_pitch_byte   + 0] = srcP[3*src_y_pitch_byte + 0];
             dstY[3*dst_y_pitch_byte   + 1] = srcP[3*src_y_pitch_byte + 2];
-            dstC[0*dst_y_pitch_byte/2 + 0] =(srcP[0*src_y_pitch_byte + 1] * 3 + srcP[2*src_y_pitch_byte + 1] * 1 + 2)>>2;
-            dstC[0*dst_y_pitch_byte/2 + 1] =(srcP[0*src_y_pitch_byte + 3] * 3 + srcP[2*src_y_pitch_byte + 3] * 1 + 2)>>2;
-            dstC[1*dst_y_pitch_byte/2 + 0] =(srcP[1*src_y_pitch_byte + 1] * 1 + srcP[3*src_y_pitch_byte + 1] * 3 + 2)>>2;
-            dstC[1*dst_y_pitch_byte/2 + 1] =(srcP[1*src_y_pitch_byte + 3] * 1 + srcP[3*src_y_pitch_byte + 3] * 3 + 2)>>2;
+            dstC[0*dst_y_pitch_byte   + 0] =(srcP[0*src_y_pitch_byte + 1] * 3 + srcP[2*src_y_pitch_byte + 1] * 1 + 2)>>2;
+            dstC[0*dst_y_pitch_byte   + 1] =(srcP[0*src_y_pitch_byte + 3] * 3 + srcP[2*src_y_pitch_byte + 3] * 1 + 2)>>2;
+            dstC[1*dst_y_pitch_byte   + 0] =(srcP[1*src_y_pitch_byte + 1] * 1 + srcP[3*src_y_pitch_byte + 1] * 3 + 2)>>2;
+            dstC[1*dst_y_pitch_byte   + 1] =(srcP[1*src_y_pitch_byte + 3] * 1 + srcP[3*src_y_pitch_byte + 3] * 3 + 2)>>2;
         }
     }
 }
@@ -680,16 +704,16 @@ static void RGY_FORCEINLINE convert_nv24_to_yuv444_c(void **dst, const void **sr
     //UV成分のコピー
     const int src_uv_pitch = src_uv_pitch_byte / sizeof(Tin);
     Tin *srcLine  = (Tin *)src[1] + ((src_uv_pitch * y_range.start_src) + crop_left * 2);
-    Tout *dstULine = (Tout *)dst[1] + (dst_y_pitch >> 1) * y_range.start_dst;
-    Tout *dstVLine = (Tout *)dst[2] + (dst_y_pitch >> 1) * y_range.start_dst;
-    for (int y = 0; y < y_range.len; y++, srcLine += src_uv_pitch * 2, dstULine += dst_y_pitch, dstVLine += dst_y_pitch) {
+    Tout *dstULine = (Tout *)dst[1] + dst_y_pitch * y_range.start_dst;
+    Tout *dstVLine = (Tout *)dst[2] + dst_y_pitch * y_range.start_dst;
+    for (int y = 0; y < y_range.len; y++, srcLine += src_uv_pitch, dstULine += dst_y_pitch, dstVLine += dst_y_pitch) {
         Tout *dstU = dstULine;
         Tout *dstV = dstVLine;
         Tin *srcC = srcLine;
         const int x_fin = width - crop_right - crop_left;
         for (int x = 0; x < x_fin; x++, srcC += 2, dstU++, dstV++) {
             dstU[0] = (Tout)CHANGE_BIT_DEPTH_1(srcC[0], 0);
-            dstV[1] = (Tout)CHANGE_BIT_DEPTH_1(srcC[1], 0);
+            dstV[0] = (Tout)CHANGE_BIT_DEPTH_1(srcC[1], 0);
         }
     }
 }
@@ -1246,7 +1270,7 @@ static void RGY_FORCEINLINE convert_yuv444_high_to_yuv444_16_c_base(void **dst,
             } else {
                 const uint16_t *src_ptr = srcYLine;
                 uint16_t *dst_ptr = dstLine;
-                for (int x = 0; x < y_width; x += 16, dst_ptr += 16, src_ptr += 16) {
+                for (int x = 0; x < y_width; x++) {
                     dst_ptr[x] = (uint16_t)conv_bit_depth<in_bit_depth, 16, 0>(src_ptr[x]);
                 }
             }
@@ -1903,10 +1927,16 @@ void convert_bgr32_to_bgr24_c(void **dst, const void **src, int width, int src_y
 #pragma warning (pop)
 
 #if defined(_M_IX86) || defined(_M_X64) || defined(__x86_64)
+#if defined(_M_X64) || defined(__x86_64)
+#define FUNC_AVX512(from, to, uv_only, funcp, funci, simd) { from, to, uv_only, { funcp, funci }, simd },
+#else
+#define FUNC_AVX512(from, to, uv_only, funcp, funci, simd)
+#endif
 #define FUNC_AVX2(from, to, uv_only, funcp, funci, simd) { from, to, uv_only, { funcp, funci }, simd },
 #define FUNC_AVX(from, to, uv_only, funcp, funci, simd) { from, to, uv_only, { funcp, funci }, simd },
 #define FUNC_SSE(from, to, uv_only, funcp, funci, simd) { from, to, uv_only, { funcp, funci }, simd },
 #else
+#define FUNC_AVX512(from, to, uv_only, funcp, funci, simd)
 #define FUNC_AVX2(from, to, uv_only, funcp, funci, simd)
 #define FUNC_AVX(from, to, uv_only, funcp, funci, simd)
 #define FUNC_SSE(from, to, uv_only, funcp, funci, simd)
@@ -1914,6 +1944,7 @@ void convert_bgr32_to_bgr24_c(void **dst, const void **src, int width, int src_y
 #define FUNC__C_(from, to, uv_only, funcp, funci, simd) { from, to, uv_only, { funcp, funci }, simd },
 
 // テーブル作成の簡略化のため
+#define AVX512BW (RGY_SIMD::AVX512BW|RGY_SIMD::AVX512F)
 #define AVX2  (RGY_SIMD::AVX2)
 #define AVX   (RGY_SIMD::AVX)
 #define SSE42 (RGY_SIMD::SSE42)
@@ -1936,7 +1967,7 @@ static const ConvertCSP funcList[] = {
     FUNC_AVX(  RGY_CSP_YUY2,      RGY_CSP_NV12,      false,  convert_yuy2_to_nv12_avx,            convert_yuy2_to_nv12_i_avx,          AVX )
     FUNC_SSE(  RGY_CSP_YUY2,      RGY_CSP_NV12,      false,  convert_yuy2_to_nv12_sse2,           convert_yuy2_to_nv12_i_ssse3,        SSSE3|SSE2 )
     FUNC_SSE(  RGY_CSP_YUY2,      RGY_CSP_NV12,      false,  convert_yuy2_to_nv12_sse2,           convert_yuy2_to_nv12_i_sse2,         SSE2 )
-    FUNC__C_(  RGY_CSP_YUY2,      RGY_CSP_NV12,      false,  convert_yuy2_to_nv12,                convert_yuy2_to_nv12,                NONE )
+    FUNC__C_(  RGY_CSP_YUY2,      RGY_CSP_NV12,      false,  convert_yuy2_to_nv12,                convert_yuy2_to_nv12_i,              NONE )
     FUNC__C_(  RGY_CSP_YUY2,      RGY_CSP_YUV444,    false,  convert_yuy2_to_yuv444,              convert_yuy2_to_yuv444,              NONE )
 #endif
 #if FOR_AUO && !CLFILTERS_AUF
@@ -2046,19 +2077,24 @@ static const ConvertCSP funcList[] = {
     FUNC__C_(  RGY_CSP_YV12_10,   RGY_CSP_NV12,      false, convert_yv12_10_to_nv12_c,           convert_yv12_10_to_nv12_c,    NONE )
     FUNC_AVX2( RGY_CSP_YV12_09,   RGY_CSP_NV12,      false, convert_yv12_09_to_nv12_avx2,        convert_yv12_09_to_nv12_avx2, AVX2|AVX )
     FUNC_SSE(  RGY_CSP_YV12_09,   RGY_CSP_NV12,      false, convert_yv12_09_to_nv12_sse2,        convert_yv12_09_to_nv12_sse2, SSE2 )
-    FUNC__C_(  RGY_CSP_YV12_10,   RGY_CSP_NV12,      false, convert_yv12_09_to_nv12_c,           convert_yv12_09_to_nv12_c,    NONE )
+    FUNC__C_(  RGY_CSP_YV12_09,   RGY_CSP_NV12,      false, convert_yv12_09_to_nv12_c,           convert_yv12_09_to_nv12_c,    NONE )
+    FUNC_AVX512(RGY_CSP_YV12_16, RGY_CSP_P010,      false, convert_yv12_16_to_p010_avx512bw,    convert_yv12_16_to_p010_avx512bw, AVX512BW )
     FUNC_AVX2( RGY_CSP_YV12_16,   RGY_CSP_P010,      false, convert_yv12_16_to_p010_avx2,        convert_yv12_16_to_p010_avx2, AVX2|AVX )
     FUNC_SSE(  RGY_CSP_YV12_16,   RGY_CSP_P010,      false, convert_yv12_16_to_p010_sse2,        convert_yv12_16_to_p010_sse2, SSE2 )
     FUNC__C_(  RGY_CSP_YV12_16,   RGY_CSP_P010,      false, convert_yv12_16_to_p010_c,           convert_yv12_16_to_p010_c,    NONE )
+    FUNC_AVX512(RGY_CSP_YV12_14, RGY_CSP_P010,      false, convert_yv12_14_to_p010_avx512bw,    convert_yv12_14_to_p010_avx512bw, AVX512BW )
     FUNC_AVX2( RGY_CSP_YV12_14,   RGY_CSP_P010,      false, convert_yv12_14_to_p010_avx2,        convert_yv12_14_to_p010_avx2, AVX2|AVX )
     FUNC_SSE(  RGY_CSP_YV12_14,   RGY_CSP_P010,      false, convert_yv12_14_to_p010_sse2,        convert_yv12_14_to_p010_sse2, SSE2 )
     FUNC__C_(  RGY_CSP_YV12_14,   RGY_CSP_P010,      false, convert_yv12_14_to_p010_c,           convert_yv12_14_to_p010_c,    NONE )
+    FUNC_AVX512(RGY_CSP_YV12_12, RGY_CSP_P010,      false, convert_yv12_12_to_p010_avx512bw,    convert_yv12_12_to_p010_avx512bw, AVX512BW )
     FUNC_AVX2( RGY_CSP_YV12_12,   RGY_CSP_P010,      false, convert_yv12_12_to_p010_avx2,        convert_yv12_12_to_p010_avx2, AVX2|AVX )
     FUNC_SSE(  RGY_CSP_YV12_12,   RGY_CSP_P010,      false, convert_yv12_12_to_p010_sse2,        convert_yv12_12_to_p010_sse2, SSE2 )
     FUNC__C_(  RGY_CSP_YV12_12,   RGY_CSP_P010,      false, convert_yv12_12_to_p010_c,           convert_yv12_12_to_p010_c,    NONE )
+    FUNC_AVX512(RGY_CSP_YV12_10, RGY_CSP_P010,      false, convert_yv12_10_to_p010_avx512bw,    convert_yv12_10_to_p010_avx512bw, AVX512BW )
     FUNC_AVX2( RGY_CSP_YV12_10,   RGY_CSP_P010,      false, convert_yv12_10_to_p010_avx2,        convert_yv12_10_to_p010_avx2, AVX2|AVX )
     FUNC_SSE(  RGY_CSP_YV12_10,   RGY_CSP_P010,      false, convert_yv12_10_to_p010_sse2,        convert_yv12_10_to_p010_sse2, SSE2 )
     FUNC__C_(  RGY_CSP_YV12_10,   RGY_CSP_P010,      false, convert_yv12_10_to_p010_c,           convert_yv12_10_to_p010_c,    NONE )
+    FUNC_AVX512(RGY_CSP_YV12_09, RGY_CSP_P010,      false, convert_yv12_09_to_p010_avx512bw,    convert_yv12_09_to_p010_avx512bw, AVX512BW )
     FUNC_AVX2( RGY_CSP_YV12_09,   RGY_CSP_P010,      false, convert_yv12_09_to_p010_avx2,        convert_yv12_09_to_p010_avx2, AVX2|AVX )
     FUNC_SSE(  RGY_CSP_YV12_09,   RGY_CSP_P010,      false, convert_yv12_09_to_p010_sse2,        convert_yv12_09_to_p010_sse2, SSE2 )
     FUNC__C_(  RGY_CSP_YV12_09,   RGY_CSP_P010,      false, convert_yv12_09_to_p010_c,           convert_yv12_09_to_p010_c,    NONE )
@@ -2073,14 +2109,19 @@ static const ConvertCSP funcList[] = {
     FUNC__C_(  RGY_CSP_YV12_10,   RGY_CSP_YUV444_16, false, convert_yv12_10_p_to_yuv444_16bit,   convert_yv12_10_i_to_yuv444_16bit, NONE )
     FUNC__C_(  RGY_CSP_YV12_09,   RGY_CSP_YUV444_16, false, convert_yv12_09_p_to_yuv444_16bit,   convert_yv12_09_i_to_yuv444_16bit, NONE )
     FUNC__C_(  RGY_CSP_YUV422,    RGY_CSP_NV12,      false, convert_yuv422_to_nv12,              convert_yuv422_i_to_nv12,       NONE )
+    FUNC_AVX512(RGY_CSP_YUV422,    RGY_CSP_P010,      false, convert_yuv422_to_p010_avx512bw,  convert_yuv422_i_to_p010,    AVX512BW )
     FUNC__C_(  RGY_CSP_YUV422,    RGY_CSP_P010,      false, convert_yuv422_to_p010,              convert_yuv422_i_to_p010,       NONE )
     FUNC__C_(  RGY_CSP_YUV422_16, RGY_CSP_NV12,      false, convert_yuv422_16_to_nv12,           convert_yuv422_16_i_to_nv12,    NONE )
+    FUNC_AVX512(RGY_CSP_YUV422_16, RGY_CSP_P010,      false, convert_yuv422_16_to_p010_avx512bw,  convert_yuv422_16_i_to_p010,    AVX512BW )
     FUNC__C_(  RGY_CSP_YUV422_16, RGY_CSP_P010,      false, convert_yuv422_16_to_p010,           convert_yuv422_16_i_to_p010,    NONE )
     FUNC__C_(  RGY_CSP_YUV422_14, RGY_CSP_NV12,      false, convert_yuv422_14_to_nv12,           convert_yuv422_14_i_to_nv12,    NONE )
+    FUNC_AVX512(RGY_CSP_YUV422_14, RGY_CSP_P010,      false, convert_yuv422_14_to_p010_avx512bw,  convert_yuv422_14_i_to_p010,    AVX512BW )
     FUNC__C_(  RGY_CSP_YUV422_14, RGY_CSP_P010,      false, convert_yuv422_14_to_p010,           convert_yuv422_14_i_to_p010,    NONE )
     FUNC__C_(  RGY_CSP_YUV422_12, RGY_CSP_NV12,      false, convert_yuv422_12_to_nv12,           convert_yuv422_12_i_to_nv12,    NONE )
+    FUNC_AVX512(RGY_CSP_YUV422_12, RGY_CSP_P010,      false, convert_yuv422_12_to_p010_avx512bw,  convert_yuv422_12_i_to_p010,    AVX512BW )
     FUNC__C_(  RGY_CSP_YUV422_12, RGY_CSP_P010,      false, convert_yuv422_12_to_p010,           convert_yuv422_12_i_to_p010,    NONE )
     FUNC__C_(  RGY_CSP_YUV422_10, RGY_CSP_NV12,      false, convert_yuv422_10_to_nv12,           convert_yuv422_10_i_to_nv12,    NONE )
+    FUNC_AVX512(RGY_CSP_YUV422_10, RGY_CSP_P010,      false, convert_yuv422_10_to_p010_avx512bw,  convert_yuv422_10_i_to_p010,    AVX512BW )
     FUNC__C_(  RGY_CSP_YUV422_10, RGY_CSP_P010,      false, convert_yuv422_10_to_p010,           convert_yuv422_10_i_to_p010,    NONE )
     FUNC__C_(  RGY_CSP_YUV422,    RGY_CSP_YUV444,    false, convert_yuv422_to_yuv444,            convert_yuv422_to_yuv444,       NONE )
     FUNC__C_(  RGY_CSP_YUV422,    RGY_CSP_YUV444_16, false, convert_yuv422_to_yuv444_16,         convert_yuv422_to_yuv444_16,    NONE )
@@ -2094,16 +2135,22 @@ static const ConvertCSP funcList[] = {
     FUNC__C_(  RGY_CSP_YUV422_10, RGY_CSP_YUV444_16, false, convert_yuv422_10_to_yuv444_16,      convert_yuv422_10_to_yuv444_16, NONE )
     FUNC_SSE(  RGY_CSP_YUV422,    RGY_CSP_NV16,      false, convert_yuv422_to_nv16_sse2,         convert_yuv422_to_nv16_sse2,    SSE2)
     FUNC__C_(  RGY_CSP_YUV422,    RGY_CSP_NV16,      false, convert_yuv422_to_nv16_c,            convert_yuv422_to_nv16_c,       NONE)
+    FUNC_AVX512(RGY_CSP_YUV422,    RGY_CSP_P210,      false, convert_yuv422_to_p210_avx512bw,  convert_yuv422_to_p210_avx512bw, AVX512BW)
     FUNC_SSE(  RGY_CSP_YUV422,    RGY_CSP_P210,      false, convert_yuv422_to_p210_sse2,         convert_yuv422_to_p210_sse2,    SSE2)
     FUNC__C_(  RGY_CSP_YUV422,    RGY_CSP_P210,      false, convert_yuv422_to_p210_c,            convert_yuv422_to_p210_c,       NONE)
+    FUNC_AVX512(RGY_CSP_YUV422_16, RGY_CSP_P210,      false, convert_yuv422_16_to_p210_avx512bw,  convert_yuv422_16_to_p210_avx512bw, AVX512BW)
     FUNC_SSE(  RGY_CSP_YUV422_16, RGY_CSP_P210,      false, convert_yuv422_16_to_p210_sse2,      convert_yuv422_16_to_p210_sse2, SSE2)
     FUNC__C_(  RGY_CSP_YUV422_16, RGY_CSP_P210,      false, convert_yuv422_16_to_p210_c,         convert_yuv422_16_to_p210_c,    NONE)
+    FUNC_AVX512(RGY_CSP_YUV422_14, RGY_CSP_P210,      false, convert_yuv422_14_to_p210_avx512bw,  convert_yuv422_14_to_p210_avx512bw, AVX512BW)
     FUNC_SSE(  RGY_CSP_YUV422_14, RGY_CSP_P210,      false, convert_yuv422_14_to_p210_sse2,      convert_yuv422_14_to_p210_sse2, SSE2)
     FUNC__C_(  RGY_CSP_YUV422_14, RGY_CSP_P210,      false, convert_yuv422_14_to_p210_c,         convert_yuv422_14_to_p210_c,    NONE)
+    FUNC_AVX512(RGY_CSP_YUV422_12, RGY_CSP_P210,      false, convert_yuv422_12_to_p210_avx512bw,  convert_yuv422_12_to_p210_avx512bw, AVX512BW)
     FUNC_SSE(  RGY_CSP_YUV422_12, RGY_CSP_P210,      false, convert_yuv422_12_to_p210_sse2,      convert_yuv422_12_to_p210_sse2, SSE2)
     FUNC__C_(  RGY_CSP_YUV422_12, RGY_CSP_P210,      false, convert_yuv422_12_to_p210_c,         convert_yuv422_12_to_p210_c,    NONE)
+    FUNC_AVX512(RGY_CSP_YUV422_10, RGY_CSP_P210,      false, convert_yuv422_10_to_p210_avx512bw,  convert_yuv422_10_to_p210_avx512bw, AVX512BW)
     FUNC_SSE(  RGY_CSP_YUV422_10, RGY_CSP_P210,      false, convert_yuv422_10_to_p210_sse2,      convert_yuv422_10_to_p210_sse2, SSE2)
     FUNC__C_(  RGY_CSP_YUV422_10, RGY_CSP_P210,      false, convert_yuv422_10_to_p210_c,         convert_yuv422_10_to_p210_c,    NONE)
+    FUNC_AVX512(RGY_CSP_YUV422_09, RGY_CSP_P210,      false, convert_yuv422_09_to_p210_avx512bw,  convert_yuv422_09_to_p210_avx512bw, AVX512BW)
     FUNC_SSE(  RGY_CSP_YUV422_09, RGY_CSP_P210,      false, convert_yuv422_09_to_p210_sse2,      convert_yuv422_09_to_p210_sse2, SSE2)
     FUNC__C_(  RGY_CSP_YUV422_09, RGY_CSP_P210,      false, convert_yuv422_09_to_p210_c,         convert_yuv422_09_to_p210_c,    NONE)
     FUNC_AVX2( RGY_CSP_YUV444,    RGY_CSP_YUV444,    false, copy_yuv444_to_yuv444_avx2,          copy_yuv444_to_yuv444_avx2,      AVX2|AVX )
@@ -2172,18 +2219,23 @@ static const ConvertCSP funcList[] = {
     FUNC__C_(  RGY_CSP_YUV444_10, RGY_CSP_P010,      false, convert_yuv444_10_to_p010_p,         convert_yuv444_10_to_p010_i, NONE )
     FUNC_AVX2( RGY_CSP_YUV444_09, RGY_CSP_P010,      false, convert_yuv444_09_to_p010_p_avx2,    convert_yuv444_09_to_p010_i, AVX2|AVX )
     FUNC__C_(  RGY_CSP_YUV444_09, RGY_CSP_P010,      false, convert_yuv444_09_to_p010_p,         convert_yuv444_09_to_p010_i, NONE )
+    FUNC_AVX512(RGY_CSP_YUV444_16, RGY_CSP_YUV444_16, false, convert_yuv444_16_to_yuv444_16_avx512bw, convert_yuv444_16_to_yuv444_16_avx512bw, AVX512BW )
     FUNC_AVX2( RGY_CSP_YUV444_16, RGY_CSP_YUV444_16, false, convert_yuv444_16_to_yuv444_16_avx2, convert_yuv444_16_to_yuv444_16_avx2, AVX2|AVX )
     FUNC_SSE(  RGY_CSP_YUV444_16, RGY_CSP_YUV444_16, false, convert_yuv444_16_to_yuv444_16_sse2, convert_yuv444_16_to_yuv444_16_sse2, SSE2 )
     FUNC__C_(  RGY_CSP_YUV444_16, RGY_CSP_YUV444_16, false, convert_yuv444_16_to_yuv444_16_c,    convert_yuv444_16_to_yuv444_16_c,    NONE )
+    FUNC_AVX512(RGY_CSP_YUV444_14, RGY_CSP_YUV444_16, false, convert_yuv444_14_to_yuv444_16_avx512bw, convert_yuv444_14_to_yuv444_16_avx512bw, AVX512BW )
     FUNC_AVX2( RGY_CSP_YUV444_14, RGY_CSP_YUV444_16, false, convert_yuv444_14_to_yuv444_16_avx2, convert_yuv444_14_to_yuv444_16_avx2, AVX2|AVX )
     FUNC_SSE(  RGY_CSP_YUV444_14, RGY_CSP_YUV444_16, false, convert_yuv444_14_to_yuv444_16_sse2, convert_yuv444_14_to_yuv444_16_sse2, SSE2 )
     FUNC__C_(  RGY_CSP_YUV444_14, RGY_CSP_YUV444_16, false, convert_yuv444_14_to_yuv444_16_c,    convert_yuv444_14_to_yuv444_16_c,    NONE )
+    FUNC_AVX512(RGY_CSP_YUV444_12, RGY_CSP_YUV444_16, false, convert_yuv444_12_to_yuv444_16_avx512bw, convert_yuv444_12_to_yuv444_16_avx512bw, AVX512BW )
     FUNC_AVX2( RGY_CSP_YUV444_12, RGY_CSP_YUV444_16, false, convert_yuv444_12_to_yuv444_16_avx2, convert_yuv444_12_to_yuv444_16_avx2, AVX2|AVX )
     FUNC_SSE(  RGY_CSP_YUV444_12, RGY_CSP_YUV444_16, false, convert_yuv444_12_to_yuv444_16_sse2, convert_yuv444_12_to_yuv444_16_sse2, SSE2 )
     FUNC__C_(  RGY_CSP_YUV444_12, RGY_CSP_YUV444_16, false, convert_yuv444_12_to_yuv444_16_c,    convert_yuv444_12_to_yuv444_16_c,    NONE )
+    FUNC_AVX512(RGY_CSP_YUV444_10, RGY_CSP_YUV444_16, false, convert_yuv444_10_to_yuv444_16_avx512bw, convert_yuv444_10_to_yuv444_16_avx512bw, AVX512BW )
     FUNC_AVX2( RGY_CSP_YUV444_10, RGY_CSP_YUV444_16, false, convert_yuv444_10_to_yuv444_16_avx2, convert_yuv444_10_to_yuv444_16_avx2, AVX2|AVX )
     FUNC_SSE(  RGY_CSP_YUV444_10, RGY_CSP_YUV444_16, false, convert_yuv444_10_to_yuv444_16_sse2, convert_yuv444_10_to_yuv444_16_sse2, SSE2 )
     FUNC__C_(  RGY_CSP_YUV444_10, RGY_CSP_YUV444_16, false, convert_yuv444_10_to_yuv444_16_c,    convert_yuv444_10_to_yuv444_16_c,    NONE )
+    FUNC_AVX512(RGY_CSP_YUV444_09, RGY_CSP_YUV444_16, false, convert_yuv444_09_to_yuv444_16_avx512bw, convert_yuv444_09_to_yuv444_16_avx512bw, AVX512BW )
     FUNC_AVX2( RGY_CSP_YUV444_09, RGY_CSP_YUV444_16, false, convert_yuv444_09_to_yuv444_16_avx2, convert_yuv444_09_to_yuv444_16_avx2, AVX2|AVX )
     FUNC_SSE(  RGY_CSP_YUV444_09, RGY_CSP_YUV444_16, false, convert_yuv444_09_to_yuv444_16_sse2, convert_yuv444_09_to_yuv444_16_sse2, SSE2 )
     FUNC__C_(  RGY_CSP_YUV444_09, RGY_CSP_YUV444_16, false, convert_yuv444_09_to_yuv444_16_c,    convert_yuv444_09_to_yuv444_16_c,    NONE )
@@ -2256,6 +2308,15 @@ const ConvertCSP *get_convert_csp_func(RGY_CSP csp_from, RGY_CSP csp_to, bool uv
     return convert;
 }
 
+//テーブルに登録されているすべての変換関数 (実行環境で利用可能かどうかは問わない)
+std::vector<const ConvertCSP *> get_convert_csp_func_list() {
+    std::vector<const ConvertCSP *> list;
+    for (int i = 0; i < _countof(funcList); i++) {
+        list.push_back(&funcList[i]);
+    }
+    return list;
+}
+
 std::basic_string<TCHAR> RGYFrameInfo::print() const {
     TCHAR buf[1024];
 #if ENCODER_NVENC
@@ -2272,6 +2333,7 @@ std::basic_string<TCHAR> RGYFrameInfo::print() const {
 
 const TCHAR *get_simd_str(RGY_SIMD simd) {
     static std::vector<std::pair<RGY_SIMD, const TCHAR*>> simd_str_list = {
+        { AVX512BW, _T("AVX512BW") },
         { AVX2,  _T("AVX2")   },
         { AVX,   _T("AVX")    },
         { SSE42, _T("SSE4.2") },
@@ -388,7 +388,7 @@ void convert_rgb24r_to_rgb32_avx2(void **dst, const void **src, int width, int s
     const int crop_bottom = crop[3];
     const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
     uint8_t *srcLine = (uint8_t *)src[0] + src_y_pitch_byte * ((y_range.start_src + y_range.len) - 1) + crop_left * 3;
-    uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * (height - (y_range.start_dst + y_range.len));
+    uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * ((height - crop_up - crop_bottom) - (y_range.start_dst + y_range.len));
     alignas(32) const char MASK_RGB3_TO_RGB4[] = {
         0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
         0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1
@@ -445,7 +445,7 @@ void convert_rgb32r_to_rgb32_avx2(void **dst, const void **src, int width, int s
     const int crop_bottom = crop[3];
     const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
     uint8_t *srcLine = (uint8_t *)src[0] + src_y_pitch_byte * ((y_range.start_src + y_range.len) - 1) + crop_left * 4;
-    uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * (height - (y_range.start_dst + y_range.len));
+    uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * ((height - crop_up - crop_bottom) - (y_range.start_dst + y_range.len));
     const int y_width = width - crop_right - crop_left;
     for (int y = 0; y < y_range.len; y++, dstLine += dst_y_pitch_byte, srcLine -= src_y_pitch_byte) {
         avx2_memcpy<false>(dstLine, srcLine, y_width * 4);
@@ -475,7 +475,7 @@ void convert_rgb24r_to_rgb24_avx2(void **dst, const void **src, int width, int s
     const int crop_bottom = crop[3];
     const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
     uint8_t *srcLine = (uint8_t *)src[0] + src_y_pitch_byte * ((y_range.start_src + y_range.len) - 1) + crop_left * 3;
-    uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * (height - (y_range.start_dst + y_range.len));
+    uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * ((height - crop_up - crop_bottom) - (y_range.start_dst + y_range.len));
     const int y_width = width - crop_right - crop_left;
     for (int y = 0; y < y_range.len; y++, dstLine += dst_y_pitch_byte, srcLine -= src_y_pitch_byte) {
         avx2_memcpy<false>(dstLine, srcLine, y_width * 3);
@@ -585,8 +585,9 @@ static void convert_yv12_high_to_nv12_avx2_base(void **dst, const void **src, in
                 y0 = _mm256_set_m128i(_mm_loadu_si128((__m128i*)(src_ptr + 16)), _mm_loadu_si128((__m128i*)(src_ptr +  0)));
                 y1 = _mm256_set_m128i(_mm_loadu_si128((__m128i*)(src_ptr + 24)), _mm_loadu_si128((__m128i*)(src_ptr +  8)));
 
-                y0 = _mm256_adds_epi16(y0, yrsftAdd);
-                y1 = _mm256_adds_epi16(y1, yrsftAdd);
+                //16bitの入力で加算があふれないよう、符号なしの飽和加算を使う
+                y0 = _mm256_adds_epu16(y0, yrsftAdd);
+                y1 = _mm256_adds_epu16(y1, yrsftAdd);
 
                 y0 = _mm256_srli_epi16(y0, in_bit_depth - 8);
                 y1 = _mm256_srli_epi16(y1, in_bit_depth - 8);
@@ -604,7 +605,7 @@ static void convert_yv12_high_to_nv12_avx2_base(void **dst, const void **src, in
     uint16_t *srcVLine = (uint16_t *)src[2] + ((src_uv_pitch * uv_range.start_src) + (crop_left >> 1));
     uint8_t *dstLine  = (uint8_t *)dst[1] + dst_y_pitch_byte * uv_range.start_dst;
     for (int y = 0; y < uv_range.len; y++, srcULine += src_uv_pitch, srcVLine += src_uv_pitch, dstLine += dst_y_pitch_byte) {
-        const int x_fin = width - crop_right;
+        const int x_fin = width - crop_right - crop_left;
         uint16_t *src_u_ptr = srcULine;
         uint16_t *src_v_ptr = srcVLine;
         uint8_t *dst_ptr = dstLine;
@@ -614,15 +615,15 @@ static void convert_yv12_high_to_nv12_avx2_base(void **dst, const void **src, in
             y0 = _mm256_loadu_si256((const __m256i *)src_u_ptr);
             y1 = _mm256_loadu_si256((const __m256i *)src_v_ptr);
 
-            y0 = _mm256_adds_epi16(y0, yrsftAdd);
-            y1 = _mm256_adds_epi16(y1, yrsftAdd);
+            y0 = _mm256_adds_epu16(y0, yrsftAdd);
+            y1 = _mm256_adds_epu16(y1, yrsftAdd);
 
             y0 = _mm256_srli_epi16(y0, in_bit_depth - 8);
-            y1 = _mm256_slli_epi16(y1, 16 - in_bit_depth);
-            const __m256i xMaskHighByte = _mm256_slli_epi16(_mm256_cmpeq_epi8(_mm256_setzero_si256(), _mm256_setzero_si256()), 8);
-            y1 = _mm256_and_si256(y1, xMaskHighByte);
+            y1 = _mm256_srli_epi16(y1, in_bit_depth - 8);
 
-            y0 = _mm256_or_si256(y0, y1);
+            //丸めで256になった場合もあるので、飽和させてからインタリーブする
+            y0 = _mm256_packus_epi16(y0, y1); //128bitレーンごとに u0-u7, v0-v7
+            y0 = _mm256_unpacklo_epi8(y0, _mm256_srli_si256(y0, 8));
 
             _mm256_storeu_si256((__m256i *)(dst_ptr +  0), y0);
         }
@@ -673,8 +674,8 @@ void RGY_FORCEINLINE copy_y_plane(void *dst, int dst_y_pitch_byte, const void*sr
                 y0 = _mm256_set_m128i(_mm_loadu_si128((__m128i*)(src_ptr + 16)), _mm_loadu_si128((__m128i*)(src_ptr + 0)));
                 y1 = _mm256_set_m128i(_mm_loadu_si128((__m128i*)(src_ptr + 24)), _mm_loadu_si128((__m128i*)(src_ptr + 8)));
 
-                y0 = _mm256_adds_epi16(y0, yrsftAdd);
-                y1 = _mm256_adds_epi16(y1, yrsftAdd);
+                y0 = _mm256_adds_epu16(y0, yrsftAdd);
+                y1 = _mm256_adds_epu16(y1, yrsftAdd);
 
                 y0 = _mm256_srli_epi16(y0, conv_bit_depth_rsft<in_bit_depth, out_bit_depth, 0>());
                 y1 = _mm256_srli_epi16(y1, conv_bit_depth_rsft<in_bit_depth, out_bit_depth, 0>());
@@ -784,6 +785,9 @@ void RGY_FORCEINLINE convert_yuv444_to_nv12_p_avx2_base(void** dst, const void**
                     v01 = _mm256_srli_epi32(v01, conv_bit_depth_rsft<in_bit_depth, out_bit_depth, shift_offset>());
                     u00 = _mm256_packus_epi32(u00, u01); // 30 - 24 | 14 -  8 | 22 - 16 | 6 - 0
                     v00 = _mm256_packus_epi32(v00, v01); // 30 - 24 | 14 -  8 | 22 - 16 | 6 - 0
+                    //丸めで256になる場合があるので、255に飽和させる
+                    u00 = _mm256_min_epu16(u00, _mm256_set1_epi16(0xff));
+                    v00 = _mm256_min_epu16(v00, _mm256_set1_epi16(0xff));
                     u0 = _mm256_permute4x64_epi64(u00, _MM_SHUFFLE(3, 1, 2, 0));
                     v0 = _mm256_permute4x64_epi64(v00, _MM_SHUFFLE(3, 1, 2, 0));
                     v0 = _mm256_slli_epi16(v0, 8);
@@ -799,7 +803,7 @@ void RGY_FORCEINLINE convert_yuv444_to_nv12_p_avx2_base(void** dst, const void**
                     v0 = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(srcV + 0)), mask00ff);
                     u1 = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(srcU + src_uv_pitch + 0)), mask00ff);
                     v1 = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(srcV + src_uv_pitch + 0)), mask00ff);
-#if 0
+                    //C版と同じく2行の和をそのままシフトする (avgで丸めると下位ビットが変わる)
                     const int shift_offset = 1;
                     if (out_bit_depth > in_bit_depth + shift_offset) {
                         u0 = _mm256_slli_epi16(u0, conv_bit_depth_lsft<in_bit_depth, out_bit_depth, shift_offset>());
@@ -809,12 +813,6 @@ void RGY_FORCEINLINE convert_yuv444_to_nv12_p_avx2_base(void** dst, const void**
                     }
                     u0 = _mm256_adds_epu16(u0, u1); // 30 - 0
                     v0 = _mm256_adds_epu16(v0, v1); // 30 - 0
-#else
-                    u0 = _mm256_avg_epu8(u0, u1); // 30 - 0
-                    v0 = _mm256_avg_epu8(v0, v1); // 30 - 0
-                    u0 = _mm256_slli_epi16(u0, conv_bit_depth_lsft<in_bit_depth, out_bit_depth, 0>());
-                    v0 = _mm256_slli_epi16(v0, conv_bit_depth_lsft<in_bit_depth, out_bit_depth, 0>());
-#endif
                 } else {
                     const auto mask0000ffff = _mm256_set1_epi32(0x0000ffff);
                     __m256i u00 = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(srcU +  0)), mask0000ffff); // 14 -  0
@@ -1048,15 +1046,15 @@ static void RGY_FORCEINLINE copy_yuv444_high_to_ayuv444_avx2(void **dst, const v
             __m256i pixY0 = _mm256_loadu_si256((const __m256i *)(src_y_ptr + 0)); // 15 -  0
             __m256i pixU0 = _mm256_loadu_si256((const __m256i *)(src_u_ptr + 0)); // 15 -  0
             __m256i pixV0 = _mm256_loadu_si256((const __m256i *)(src_v_ptr + 0)); // 15 -  0
-            __m256i pixY1 = _mm256_loadu_si256((const __m256i *)(src_y_ptr + 8)); // 31 - 16
-            __m256i pixU1 = _mm256_loadu_si256((const __m256i *)(src_u_ptr + 8)); // 31 - 16
-            __m256i pixV1 = _mm256_loadu_si256((const __m256i *)(src_v_ptr + 8)); // 31 - 16
-            pixY0 = _mm256_adds_epi16(pixY0, xrsftAdd);
-            pixU0 = _mm256_adds_epi16(pixU0, xrsftAdd);
-            pixV0 = _mm256_adds_epi16(pixV0, xrsftAdd);
-            pixY1 = _mm256_adds_epi16(pixY1, xrsftAdd);
-            pixU1 = _mm256_adds_epi16(pixU1, xrsftAdd);
-            pixV1 = _mm256_adds_epi16(pixV1, xrsftAdd);
+            __m256i pixY1 = _mm256_loadu_si256((const __m256i *)(src_y_ptr + 16)); // 31 - 16
+            __m256i pixU1 = _mm256_loadu_si256((const __m256i *)(src_u_ptr + 16)); // 31 - 16
+            __m256i pixV1 = _mm256_loadu_si256((const __m256i *)(src_v_ptr + 16)); // 31 - 16
+            pixY0 = _mm256_adds_epu16(pixY0, xrsftAdd);
+            pixU0 = _mm256_adds_epu16(pixU0, xrsftAdd);
+            pixV0 = _mm256_adds_epu16(pixV0, xrsftAdd);
+            pixY1 = _mm256_adds_epu16(pixY1, xrsftAdd);
+            pixU1 = _mm256_adds_epu16(pixU1, xrsftAdd);
+            pixV1 = _mm256_adds_epu16(pixV1, xrsftAdd);
             pixY0 = _mm256_srli_epi16(pixY0, in_bit_depth - 8);
             pixU0 = _mm256_srli_epi16(pixU0, in_bit_depth - 8);
             pixV0 = _mm256_srli_epi16(pixV0, in_bit_depth - 8);
@@ -1127,7 +1125,7 @@ void convert_yuv444_to_y410_avx2(void** dst, const void** src, int width, int sr
         uint8_t* src_u_ptr = srcULine;
         uint8_t* src_v_ptr = srcVLine;
         uint32_t* dst_ptr = dstLine;
-        for (int x = 0; x < y_width; x++, src_y_ptr += 32, src_u_ptr += 32, src_v_ptr += 32, dst_ptr += 32) {
+        for (int x = 0; x < y_width; x += 32, src_y_ptr += 32, src_u_ptr += 32, src_v_ptr += 32, dst_ptr += 32) {
             __m256i pixY = _mm256_loadu_si256((const __m256i*)(src_y_ptr + 0));
             __m256i pixU = _mm256_loadu_si256((const __m256i*)(src_u_ptr + 0));
             __m256i pixV = _mm256_loadu_si256((const __m256i*)(src_v_ptr + 0));
@@ -1183,21 +1181,21 @@ void convert_yuv444_high_to_y410_avx2(void** dst, const void** src, int width, i
         uint16_t* src_u_ptr = srcULine;
         uint16_t* src_v_ptr = srcVLine;
         uint32_t* dst_ptr = dstLine;
-        for (int x = 0; x < y_width; x++, src_y_ptr += 32, src_u_ptr += 32, src_v_ptr += 32, dst_ptr += 32) {
+        for (int x = 0; x < y_width; x += 32, src_y_ptr += 32, src_u_ptr += 32, src_v_ptr += 32, dst_ptr += 32) {
             __m256i pixY0 = _mm256_loadu_si256((const __m256i*)(src_y_ptr + 0)); // 15 -  0
-            __m256i pixY1 = _mm256_loadu_si256((const __m256i*)(src_y_ptr + 8)); // 31 - 16
+            __m256i pixY1 = _mm256_loadu_si256((const __m256i*)(src_y_ptr + 16)); // 31 - 16
             __m256i pixU0 = _mm256_loadu_si256((const __m256i*)(src_u_ptr + 0)); // 15 -  0
-            __m256i pixU1 = _mm256_loadu_si256((const __m256i*)(src_u_ptr + 8)); // 31 - 16
+            __m256i pixU1 = _mm256_loadu_si256((const __m256i*)(src_u_ptr + 16)); // 31 - 16
             __m256i pixV0 = _mm256_loadu_si256((const __m256i*)(src_v_ptr + 0)); // 15 -  0
-            __m256i pixV1 = _mm256_loadu_si256((const __m256i*)(src_v_ptr + 8)); // 31 - 16
+            __m256i pixV1 = _mm256_loadu_si256((const __m256i*)(src_v_ptr + 16)); // 31 - 16
 
             if (in_bit_depth > out_bit_depth) {
-                pixY0 = _mm256_srli_epi16(_mm256_add_epi16(pixY0, xrsftAdd), in_bit_depth - out_bit_depth);
-                pixY1 = _mm256_srli_epi16(_mm256_add_epi16(pixY1, xrsftAdd), in_bit_depth - out_bit_depth);
-                pixU0 = _mm256_srli_epi16(_mm256_add_epi16(pixU0, xrsftAdd), in_bit_depth - out_bit_depth);
-                pixU1 = _mm256_srli_epi16(_mm256_add_epi16(pixU1, xrsftAdd), in_bit_depth - out_bit_depth);
-                pixV0 = _mm256_srli_epi16(_mm256_add_epi16(pixV0, xrsftAdd), in_bit_depth - out_bit_depth);
-                pixV1 = _mm256_srli_epi16(_mm256_add_epi16(pixV1, xrsftAdd), in_bit_depth - out_bit_depth);
+                pixY0 = _mm256_srli_epi16(_mm256_adds_epu16(pixY0, xrsftAdd), in_bit_depth - out_bit_depth);
+                pixY1 = _mm256_srli_epi16(_mm256_adds_epu16(pixY1, xrsftAdd), in_bit_depth - out_bit_depth);
+                pixU0 = _mm256_srli_epi16(_mm256_adds_epu16(pixU0, xrsftAdd), in_bit_depth - out_bit_depth);
+                pixU1 = _mm256_srli_epi16(_mm256_adds_epu16(pixU1, xrsftAdd), in_bit_depth - out_bit_depth);
+                pixV0 = _mm256_srli_epi16(_mm256_adds_epu16(pixV0, xrsftAdd), in_bit_depth - out_bit_depth);
+                pixV1 = _mm256_srli_epi16(_mm256_adds_epu16(pixV1, xrsftAdd), in_bit_depth - out_bit_depth);
             }
             pixY0 = _mm256_min_epu16(pixY0, _mm256_set1_epi16((1<<out_bit_depth)-1));
             pixY1 = _mm256_min_epu16(pixY1, _mm256_set1_epi16((1<<out_bit_depth)-1));
@@ -1365,8 +1363,8 @@ static void RGY_FORCEINLINE convert_yuv444_high_to_yuv444_avx2_base(void **dst,
             for (int x = 0; x < y_width; x += 32, dst_ptr += 32, src_ptr += 32) {
                 __m256i y0 = _mm256_loadu2_m128i((const __m128i *)(src_ptr + 16), (const __m128i *)(src_ptr +  0));
                 __m256i y1 = _mm256_loadu2_m128i((const __m128i *)(src_ptr + 24), (const __m128i *)(src_ptr +  8));
-                y0 = _mm256_adds_epi16(y0, yrsftAdd);
-                y1 = _mm256_adds_epi16(y1, yrsftAdd);
+                y0 = _mm256_adds_epu16(y0, yrsftAdd);
+                y1 = _mm256_adds_epu16(y1, yrsftAdd);
                 y0 = _mm256_srli_epi16(y0, in_bit_depth - 8);
                 y1 = _mm256_srli_epi16(y1, in_bit_depth - 8);
                 y0 = _mm256_packus_epi16(y0, y1);
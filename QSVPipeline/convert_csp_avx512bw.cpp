@@ -0,0 +1,322 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2011-2016 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+#if defined(_M_X64) || defined(__x86_64)
+#include <immintrin.h>
+#include "rgy_simd.h"
+#include <stdint.h>
+#include <string.h>
+#include "convert_csp.h"
+
+#if _MSC_VER >= 1800 && !defined(__AVX512BW__) && !defined(_DEBUG)
+static_assert(false, "do not forget to set /arch:AVX512 for this file.");
+#endif
+
+#if defined(_MSC_VER) || defined(__AVX512BW__)
+
+// AVX512では端数をマスク付きのload/storeで処理するため、
+// cropした範囲の外(左右の余白やpitchの余り)には読み書きしない
+
+// 残りの要素数(16bit単位)から、load/store用のマスクを作成する
+static RGY_FORCEINLINE __mmask32 mask_epi16(const int n) {
+    return (n >= 32) ? (__mmask32)0xffffffffu : ((n <= 0) ? (__mmask32)0 : (__mmask32)((1u << n) - 1));
+}
+
+// 8bitなら16bitに拡張して、16bit単位で32要素を読み込む
+// _mm512_castsi512_si256/_mm512_extracti64x4_epi64/_mm512_permutexvar_epi64は
+// GCC12で-Wmaybe-uninitializedの警告が出る(内部で未定義値を使う)うえ、_mm256_maskz_loadu_epi8はAVX512VLが必要なので、
+// マスク付き(maskz)の64bit単位の並べ替え + unpackで拡張する
+template<typename Tin>
+static RGY_FORCEINLINE __m512i load_epi16_mask(const Tin *ptr, const __mmask32 mask) {
+    if (sizeof(Tin) == 1) {
+        const __m512i z0 = _mm512_maskz_loadu_epi8((__mmask64)mask, ptr);
+        const __m512i z1 = _mm512_maskz_permutexvar_epi64((__mmask8)0xff, _mm512_set_epi64(3, 3, 2, 2, 1, 1, 0, 0), z0);
+        return _mm512_unpacklo_epi8(z1, _mm512_setzero_si512());
+    }
+    return _mm512_maskz_loadu_epi16(mask, ptr);
+}
+
+// in_bit_depth -> 16bit
+template<int in_bit_depth>
+static RGY_FORCEINLINE __m512i shift_to_16bit(const __m512i z0) {
+    return (in_bit_depth < 16) ? _mm512_slli_epi16(z0, 16 - in_bit_depth) : z0;
+}
+
+alignas(64) static const uint16_t Array_INTERLEAVE_EPI16_LO[32] = {
+     0, 32,  1, 33,  2, 34,  3, 35,  4, 36,  5, 37,  6, 38,  7, 39,
+     8, 40,  9, 41, 10, 42, 11, 43, 12, 44, 13, 45, 14, 46, 15, 47
+};
+alignas(64) static const uint16_t Array_INTERLEAVE_EPI16_HI[32] = {
+    16, 48, 17, 49, 18, 50, 19, 51, 20, 52, 21, 53, 22, 54, 23, 55,
+    24, 56, 25, 57, 26, 58, 27, 59, 28, 60, 29, 61, 30, 62, 31, 63
+};
+
+// u, v (各32要素) をuvuv...に並べて、dst_ptrの2*n要素に書き込む
+static RGY_FORCEINLINE void store_uv_interleave(uint16_t *dst_ptr, const __m512i u, const __m512i v, const int n) {
+    const __m512i zIdxLo = _mm512_load_si512((const __m512i *)Array_INTERLEAVE_EPI16_LO);
+    const __m512i zIdxHi = _mm512_load_si512((const __m512i *)Array_INTERLEAVE_EPI16_HI);
+    _mm512_mask_storeu_epi16(dst_ptr +  0, mask_epi16(2 * n),      _mm512_permutex2var_epi16(u, zIdxLo, v));
+    _mm512_mask_storeu_epi16(dst_ptr + 32, mask_epi16(2 * n - 32), _mm512_permutex2var_epi16(u, zIdxHi, v));
+}
+
+// 1ライン分のbit深度の変換 (in_bit_depth -> 16bit)
+template<typename Tin, int in_bit_depth>
+static RGY_FORCEINLINE void convert_line_to_16bit_avx512bw(uint16_t *dst_ptr, const Tin *src_ptr, const int width) {
+    for (int x = 0; x < width; x += 32) {
+        const __mmask32 mask = mask_epi16(width - x);
+        const __m512i z0 = shift_to_16bit<in_bit_depth>(load_epi16_mask(src_ptr + x, mask));
+        _mm512_mask_storeu_epi16(dst_ptr + x, mask, z0);
+    }
+}
+
+#pragma warning (push)
+#pragma warning (disable: 4100)
+#pragma warning (disable: 4127)
+template<int in_bit_depth>
+static void RGY_FORCEINLINE convert_yv12_high_to_p010_avx512bw_base(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    static_assert(8 < in_bit_depth && in_bit_depth <= 16, "in_bit_depth must be 9-16.");
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const int src_y_pitch = src_y_pitch_byte >> 1;
+    const int dst_y_pitch = dst_y_pitch_byte >> 1;
+    //Y成分のコピー
+    {
+        const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+        const uint16_t *srcYLine = (const uint16_t *)src[0] + src_y_pitch * y_range.start_src + crop_left;
+        uint16_t *dstLine = (uint16_t *)dst[0] + dst_y_pitch * y_range.start_dst;
+        const int y_width = width - crop_right - crop_left;
+        for (int y = 0; y < y_range.len; y++, srcYLine += src_y_pitch, dstLine += dst_y_pitch) {
+            convert_line_to_16bit_avx512bw<uint16_t, in_bit_depth>(dstLine, srcYLine, y_width);
+        }
+    }
+    //UV成分のコピー
+    const auto uv_range = thread_y_range(crop_up >> 1, (height - crop_bottom) >> 1, thread_id, thread_n);
+    const int src_uv_pitch = src_uv_pitch_byte >> 1;
+    const uint16_t *srcULine = (const uint16_t *)src[1] + ((src_uv_pitch * uv_range.start_src) + (crop_left >> 1));
+    const uint16_t *srcVLine = (const uint16_t *)src[2] + ((src_uv_pitch * uv_range.start_src) + (crop_left >> 1));
+    uint16_t *dstLine = (uint16_t *)dst[1] + dst_y_pitch * uv_range.start_dst;
+    const int x_fin = (width - crop_right - crop_left) >> 1;
+    for (int y = 0; y < uv_range.len; y++, srcULine += src_uv_pitch, srcVLine += src_uv_pitch, dstLine += dst_y_pitch) {
+        for (int x = 0; x < x_fin; x += 32) {
+            const __mmask32 mask = mask_epi16(x_fin - x);
+            const __m512i zU = shift_to_16bit<in_bit_depth>(load_epi16_mask(srcULine + x, mask));
+            const __m512i zV = shift_to_16bit<in_bit_depth>(load_epi16_mask(srcVLine + x, mask));
+            store_uv_interleave(dstLine + 2 * x, zU, zV, x_fin - x);
+        }
+    }
+}
+
+template<int in_bit_depth>
+static void RGY_FORCEINLINE convert_yuv444_high_to_yuv444_16_avx512bw_base(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    static_assert(8 < in_bit_depth && in_bit_depth <= 16, "in_bit_depth must be 9-16.");
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const int src_y_pitch = src_y_pitch_byte >> 1;
+    const int dst_y_pitch = dst_y_pitch_byte >> 1;
+    const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+    for (int i = 0; i < 3; i++) {
+        const uint16_t *srcYLine = (const uint16_t *)src[i] + src_y_pitch * y_range.start_src + crop_left;
+        uint16_t *dstLine = (uint16_t *)dst[i] + dst_y_pitch * y_range.start_dst;
+        const int y_width = width - crop_right - crop_left;
+        for (int y = 0; y < y_range.len; y++, srcYLine += src_y_pitch, dstLine += dst_y_pitch) {
+            convert_line_to_16bit_avx512bw<uint16_t, in_bit_depth>(dstLine, srcYLine, y_width);
+        }
+    }
+}
+
+// yuv422 -> p010 (progressive)
+// 色差は縦方向の2ラインの平均をとる (Cの実装と同じく、16bitの場合は切り上げの平均)
+template<typename Tin, int in_bit_depth>
+static void RGY_FORCEINLINE convert_yuv422_to_p010_avx512bw_base(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    static_assert((sizeof(Tin) == 1 && in_bit_depth == 8) || (sizeof(Tin) == 2 && 8 < in_bit_depth && in_bit_depth <= 16), "invalid input bit depth.");
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+    //Y成分のコピー
+    {
+        const uint8_t *srcYLine = (const uint8_t *)src[0] + src_y_pitch_byte * y_range.start_src + crop_left * sizeof(Tin);
+        uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * y_range.start_dst;
+        const int y_width = width - crop_right - crop_left;
+        for (int y = 0; y < y_range.len; y++, srcYLine += src_y_pitch_byte, dstLine += dst_y_pitch_byte) {
+            convert_line_to_16bit_avx512bw<Tin, in_bit_depth>((uint16_t *)dstLine, (const Tin *)srcYLine, y_width);
+        }
+    }
+    //UV成分のコピー
+    const uint8_t *srcULine = (const uint8_t *)src[1] + src_uv_pitch_byte * y_range.start_src + (crop_left >> 1) * sizeof(Tin);
+    const uint8_t *srcVLine = (const uint8_t *)src[2] + src_uv_pitch_byte * y_range.start_src + (crop_left >> 1) * sizeof(Tin);
+    uint8_t *dstLine = (uint8_t *)dst[1] + dst_y_pitch_byte * (y_range.start_dst >> 1);
+    const int x_fin = (width - crop_right - crop_left) >> 1;
+    for (int y = 0; y < y_range.len; y += 2, srcULine += src_uv_pitch_byte * 2, srcVLine += src_uv_pitch_byte * 2, dstLine += dst_y_pitch_byte) {
+        const Tin *srcUY0 = (const Tin *)(srcULine + src_uv_pitch_byte * 0);
+        const Tin *srcUY1 = (const Tin *)(srcULine + src_uv_pitch_byte * 1);
+        const Tin *srcVY0 = (const Tin *)(srcVLine + src_uv_pitch_byte * 0);
+        const Tin *srcVY1 = (const Tin *)(srcVLine + src_uv_pitch_byte * 1);
+        for (int x = 0; x < x_fin; x += 32) {
+            const __mmask32 mask = mask_epi16(x_fin - x);
+            const __m512i zU0 = load_epi16_mask(srcUY0 + x, mask);
+            const __m512i zU1 = load_epi16_mask(srcUY1 + x, mask);
+            const __m512i zV0 = load_epi16_mask(srcVY0 + x, mask);
+            const __m512i zV1 = load_epi16_mask(srcVY1 + x, mask);
+            __m512i zU, zV;
+            if (in_bit_depth == 16) {
+                // (a + b + 1) >> 1 (17bitの中間値を経由しない)
+                zU = _mm512_avg_epu16(zU0, zU1);
+                zV = _mm512_avg_epu16(zV0, zV1);
+            } else {
+                // a + b は (in_bit_depth + 1) bitに収まるので、そのまま16bitにシフトできる
+                zU = _mm512_slli_epi16(_mm512_add_epi16(zU0, zU1), 15 - in_bit_depth);
+                zV = _mm512_slli_epi16(_mm512_add_epi16(zV0, zV1), 15 - in_bit_depth);
+            }
+            store_uv_interleave((uint16_t *)dstLine + 2 * x, zU, zV, x_fin - x);
+        }
+    }
+}
+
+template<typename Tin, int in_bit_depth>
+static void RGY_FORCEINLINE convert_yuv422_to_p210_avx512bw_base(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    static_assert((sizeof(Tin) == 1 && in_bit_depth == 8) || (sizeof(Tin) == 2 && 8 < in_bit_depth && in_bit_depth <= 16), "invalid input bit depth.");
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+    //Y成分のコピー
+    {
+        const uint8_t *srcYLine = (const uint8_t *)src[0] + src_y_pitch_byte * y_range.start_src + crop_left * sizeof(Tin);
+        uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * y_range.start_dst;
+        const int y_width = width - crop_right - crop_left;
+        for (int y = 0; y < y_range.len; y++, srcYLine += src_y_pitch_byte, dstLine += dst_y_pitch_byte) {
+            convert_line_to_16bit_avx512bw<Tin, in_bit_depth>((uint16_t *)dstLine, (const Tin *)srcYLine, y_width);
+        }
+    }
+    //UV成分のコピー
+    const uint8_t *srcULine = (const uint8_t *)src[1] + src_uv_pitch_byte * y_range.start_src + (crop_left >> 1) * sizeof(Tin);
+    const uint8_t *srcVLine = (const uint8_t *)src[2] + src_uv_pitch_byte * y_range.start_src + (crop_left >> 1) * sizeof(Tin);
+    uint8_t *dstLine = (uint8_t *)dst[1] + dst_y_pitch_byte * y_range.start_dst;
+    const int x_fin = (width - crop_right - crop_left) >> 1;
+    for (int y = 0; y < y_range.len; y++, srcULine += src_uv_pitch_byte, srcVLine += src_uv_pitch_byte, dstLine += dst_y_pitch_byte) {
+        for (int x = 0; x < x_fin; x += 32) {
+            const __mmask32 mask = mask_epi16(x_fin - x);
+            const __m512i zU = shift_to_16bit<in_bit_depth>(load_epi16_mask((const Tin *)srcULine + x, mask));
+            const __m512i zV = shift_to_16bit<in_bit_depth>(load_epi16_mask((const Tin *)srcVLine + x, mask));
+            store_uv_interleave((uint16_t *)dstLine + 2 * x, zU, zV, x_fin - x);
+        }
+    }
+}
+#pragma warning (pop)
+
+void convert_yv12_16_to_p010_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_p010_avx512bw_base<16>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yv12_14_to_p010_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_p010_avx512bw_base<14>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yv12_12_to_p010_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_p010_avx512bw_base<12>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yv12_10_to_p010_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_p010_avx512bw_base<10>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yv12_09_to_p010_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_p010_avx512bw_base<9>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv444_16_to_yuv444_16_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv444_high_to_yuv444_16_avx512bw_base<16>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv444_14_to_yuv444_16_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv444_high_to_yuv444_16_avx512bw_base<14>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv444_12_to_yuv444_16_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv444_high_to_yuv444_16_avx512bw_base<12>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv444_10_to_yuv444_16_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv444_high_to_yuv444_16_avx512bw_base<10>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv444_09_to_yuv444_16_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv444_high_to_yuv444_16_avx512bw_base<9>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv422_to_p010_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv422_to_p010_avx512bw_base<uint8_t, 8>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv422_16_to_p010_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv422_to_p010_avx512bw_base<uint16_t, 16>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv422_14_to_p010_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv422_to_p010_avx512bw_base<uint16_t, 14>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv422_12_to_p010_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv422_to_p010_avx512bw_base<uint16_t, 12>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv422_10_to_p010_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv422_to_p010_avx512bw_base<uint16_t, 10>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv422_to_p210_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv422_to_p210_avx512bw_base<uint8_t, 8>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv422_16_to_p210_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv422_to_p210_avx512bw_base<uint16_t, 16>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv422_14_to_p210_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv422_to_p210_avx512bw_base<uint16_t, 14>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv422_12_to_p210_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv422_to_p210_avx512bw_base<uint16_t, 12>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv422_10_to_p210_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv422_to_p210_avx512bw_base<uint16_t, 10>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv422_09_to_p210_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv422_to_p210_avx512bw_base<uint16_t, 9>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+#endif //#if defined(_MSC_VER) || defined(__AVX512BW__)
+#endif //#if defined(_M_X64) || defined(__x86_64)
@@ -445,7 +445,7 @@ static void RGY_FORCEINLINE convert_rgb24r_to_rgb32_simd(void **dst, const void
     const int crop_bottom = crop[3];
     const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
     uint8_t *srcLine = (uint8_t *)src[0] + (src_y_pitch_byte * ((y_range.start_src + y_range.len) - 1)) + crop_left * 3;;
-    uint8_t *dstLine = (uint8_t *)dst[0] + (dst_y_pitch_byte * y_range.start_dst);
+    uint8_t *dstLine = (uint8_t *)dst[0] + (dst_y_pitch_byte * ((height - crop_up - crop_bottom) - (y_range.start_dst + y_range.len)));
     alignas(16) const char MASK_RGB3_TO_RGB4[] = { 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1 };
     __m128i xMask = _mm_load_si128((__m128i*)MASK_RGB3_TO_RGB4);
     for (int y = 0; y  < y_range.len; y++, srcLine -= src_y_pitch_byte, dstLine += dst_y_pitch_byte) {
@@ -486,7 +486,7 @@ static void RGY_FORCEINLINE convert_rgb24_to_rgb_simd(void **dst, const void **s
     uint8_t *dst0Line = (uint8_t *)dst[(plane_from >>  0) & 0xff] + dst_y_pitch_byte * y_range.start_dst;
     uint8_t *dst1Line = (uint8_t *)dst[(plane_from >>  8) & 0xff] + dst_y_pitch_byte * y_range.start_dst;
     uint8_t *dst2Line = (uint8_t *)dst[(plane_from >> 16) & 0xff] + dst_y_pitch_byte * y_range.start_dst;
-    uint8_t *srcLine  = (uint8_t *)src[0] + src_y_pitch_byte * ((source_reverse) ? (height - crop_bottom - y_range.start_src - 1) : y_range.start_src) + crop_left * 3;
+    uint8_t *srcLine  = (uint8_t *)src[0] + src_y_pitch_byte * ((source_reverse) ? (height - crop_bottom - y_range.start_dst - 1) : y_range.start_src) + crop_left * 3;
     alignas(16) const char MASK_RGB_TO_RGB24[] = {
         0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
         1,  4,  7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
@@ -522,8 +522,8 @@ static void RGY_FORCEINLINE convert_rgb24_to_rgb_simd(void **dst, const void **s
             _mm_storeu_si128((__m128i *)ptr_dst1, x1);
             _mm_storeu_si128((__m128i *)ptr_dst2, x2);
         }
-        if (width & 15) {
-            int x_offset = (16 - (width & 15));
+        if ((width - crop_left - crop_right) & 15) {
+            int x_offset = (16 - ((width - crop_left - crop_right) & 15));
             ptr_src -= x_offset * 3;
             ptr_dst0 -= x_offset;
             ptr_dst1 -= x_offset;
@@ -625,7 +625,7 @@ static void RGY_FORCEINLINE convert_rgb32_to_rgb_simd(void **dst, const void **s
     uint8_t *dst0Line = (uint8_t *)dst[(plane_from >>  0) & 0xff] + dst_y_pitch_byte * y_range.start_dst;
     uint8_t *dst1Line = (uint8_t *)dst[(plane_from >>  8) & 0xff] + dst_y_pitch_byte * y_range.start_dst;
     uint8_t *dst2Line = (uint8_t *)dst[(plane_from >> 16) & 0xff] + dst_y_pitch_byte * y_range.start_dst;
-    uint8_t *srcLine  = (uint8_t *)src[0] + src_y_pitch_byte * ((source_reverse) ? (height - crop_bottom - y_range.start_src - 1) : y_range.start_src) + crop_left * 4;
+    uint8_t *srcLine  = (uint8_t *)src[0] + src_y_pitch_byte * ((source_reverse) ? (height - crop_bottom - y_range.start_dst - 1) : y_range.start_src) + crop_left * 4;
     __m128i xMask = _mm_set1_epi16(0xff);
     if (source_reverse) {
         src_y_pitch_byte = -1 * src_y_pitch_byte;
@@ -656,9 +656,9 @@ static void RGY_FORCEINLINE convert_rgb32_to_rgb_simd(void **dst, const void **s
             _mm_storeu_si128((__m128i *)ptr_dst1, x1);
             _mm_storeu_si128((__m128i *)ptr_dst2, x2);
         }
-        if (width & 15) {
-            int x_offset = (16 - (width & 15));
-            ptr_src -= x_offset * 3;
+        if ((width - crop_left - crop_right) & 15) {
+            int x_offset = (16 - ((width - crop_left - crop_right) & 15));
+            ptr_src -= x_offset * 4;
             ptr_dst0 -= x_offset;
             ptr_dst1 -= x_offset;
             ptr_dst2 -= x_offset;
@@ -830,7 +830,7 @@ static void RGY_FORCEINLINE convert_rgb24r_to_rgb24_simd(void **dst, const void
     const int crop_bottom = crop[3];
     const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
     uint8_t *srcLine = (uint8_t *)src[0] + src_y_pitch_byte * (y_range.start_src + y_range.len - 1) + crop_left * 3;
-    uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * (height - (y_range.start_dst + y_range.len));
+    uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * ((height - crop_up - crop_bottom) - (y_range.start_dst + y_range.len));
     const int y_width = width - crop_right - crop_left;
     for (int y = 0; y < y_range.len; y++, dstLine += dst_y_pitch_byte, srcLine -= src_y_pitch_byte) {
         memcpy_sse(dstLine, srcLine, y_width * 3);
@@ -847,10 +847,10 @@ void convert_rgb32_to_rgb32_simd(void **dst, const void **src, int width, int sr
     uint8_t *srcLine = (uint8_t *)src[0] + src_y_pitch_byte * y_range.start_src + crop_left * 4;
     uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * y_range.start_dst;
     const int x_width = width - crop_right - crop_left;
-    if (csp_from == RGY_CSP_RGB24) {
-    for (int y = 0; y < y_range.len; y++, dstLine += dst_y_pitch_byte, srcLine += src_y_pitch_byte) {
-        memcpy_sse(dstLine, srcLine, x_width * 4);
-    }
+    if (csp_from == RGY_CSP_RGB32) {
+        for (int y = 0; y < y_range.len; y++, dstLine += dst_y_pitch_byte, srcLine += src_y_pitch_byte) {
+            memcpy_sse(dstLine, srcLine, x_width * 4);
+        }
     } else {
 #if USE_SSSE3
         static_assert(csp_from == RGY_CSP_BGR32 || csp_from == RGY_CSP_RGB32, "invalid csp");
@@ -892,7 +892,7 @@ static void RGY_FORCEINLINE convert_rgb32r_to_rgb32_simd(void **dst, const void
     const int crop_bottom = crop[3];
     const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
     uint8_t *srcLine = (uint8_t *)src[0] + src_y_pitch_byte * (y_range.start_src + y_range.len - 1) + crop_left * 4;
-    uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * (height - (y_range.start_dst + y_range.len));
+    uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * ((height - crop_up - crop_bottom) - (y_range.start_dst + y_range.len));
     const int y_width = width - crop_right - crop_left;
     for (int y = 0; y < y_range.len; y++, dstLine += dst_y_pitch_byte, srcLine -= src_y_pitch_byte) {
         memcpy_sse(dstLine, srcLine, y_width * 4);
@@ -1004,8 +1004,9 @@ static void convert_yv12_high_to_nv12_simd(void **dst, const void **src, int wid
                 x0 = _mm_loadu_si128((const __m128i *)(src_ptr + 0));
                 x1 = _mm_loadu_si128((const __m128i *)(src_ptr + 8));
 
-                x0 = _mm_adds_epi16(x0, xrsftAdd);
-                x1 = _mm_adds_epi16(x1, xrsftAdd);
+                //16bitの入力で加算があふれないよう、符号なしの飽和加算を使う
+                x0 = _mm_adds_epu16(x0, xrsftAdd);
+                x1 = _mm_adds_epu16(x1, xrsftAdd);
 
                 x0 = _mm_srli_epi16(x0, in_bit_depth - 8);
                 x1 = _mm_srli_epi16(x1, in_bit_depth - 8);
@@ -1023,7 +1024,7 @@ static void convert_yv12_high_to_nv12_simd(void **dst, const void **src, int wid
     uint16_t *srcVLine = (uint16_t *)src[2] + ((src_uv_pitch * uv_range.start_src) + (crop_left >> 1));
     uint8_t *dstLine  = (uint8_t *)dst[1] + dst_y_pitch_byte * uv_range.start_dst;
     for (int y = 0; y < uv_range.len; y++, srcULine += src_uv_pitch, srcVLine += src_uv_pitch, dstLine += dst_y_pitch_byte) {
-        const int x_fin = width - crop_right;
+        const int x_fin = width - crop_right - crop_left;
         uint16_t *src_u_ptr = srcULine;
         uint16_t *src_v_ptr = srcVLine;
         uint8_t *dst_ptr = dstLine;
@@ -1033,15 +1034,15 @@ static void convert_yv12_high_to_nv12_simd(void **dst, const void **src, int wid
             x0 = _mm_loadu_si128((const __m128i *)src_u_ptr);
             x1 = _mm_loadu_si128((const __m128i *)src_v_ptr);
 
-            x0 = _mm_adds_epi16(x0, xrsftAdd);
-            x1 = _mm_adds_epi16(x1, xrsftAdd);
+            x0 = _mm_adds_epu16(x0, xrsftAdd);
+            x1 = _mm_adds_epu16(x1, xrsftAdd);
 
             x0 = _mm_srli_epi16(x0, in_bit_depth - 8);
-            x1 = _mm_slli_epi16(x1, 16 - in_bit_depth);
-            const __m128i xMaskHighByte = _mm_slli_epi16(_mm_cmpeq_epi8(_mm_setzero_si128(), _mm_setzero_si128()), 8);
-            x1 = _mm_and_si128(x1, xMaskHighByte);
+            x1 = _mm_srli_epi16(x1, in_bit_depth - 8);
 
-            x0 = _mm_or_si128(x0, x1);
+            //丸めで256になった場合もあるので、飽和させてからインタリーブする
+            x0 = _mm_packus_epi16(x0, x1); //u0-u7, v0-v7
+            x0 = _mm_unpacklo_epi8(x0, _mm_srli_si128(x0, 8));
 
             _mm_storeu_si128((__m128i *)(dst_ptr +  0), x0);
         }
@@ -1145,7 +1146,7 @@ static void RGY_FORCEINLINE convert_yuv422_to_p210_simd(void **dst, const void *
         uint8_t *src_v_ptr = srcVLine;
         uint16_t *dst_ptr = dstLine;
         __m128i x0, x1, x2, x3, x4;
-        for (int x = crop_left; x < x_fin; x += 16, src_u_ptr += 16, src_v_ptr += 16, dst_ptr += 32) {
+        for (int x = crop_left; x < x_fin; x += 32, src_u_ptr += 16, src_v_ptr += 16, dst_ptr += 32) {
             x0 = _mm_loadu_si128((const __m128i *)src_u_ptr);
             x1 = _mm_loadu_si128((const __m128i *)src_v_ptr);
             x2 = _mm_unpackhi_epi8(_mm_setzero_si128(), x0);
@@ -1289,12 +1290,12 @@ static void RGY_FORCEINLINE copy_yuv444_high_to_ayuv444(void **dst, const void *
             __m128i pixY1 = _mm_loadu_si128((const __m128i *)(src_y_ptr + 8));
             __m128i pixU1 = _mm_loadu_si128((const __m128i *)(src_u_ptr + 8));
             __m128i pixV1 = _mm_loadu_si128((const __m128i *)(src_v_ptr + 8));
-            pixY0 = _mm_adds_epi16(pixY0, xrsftAdd);
-            pixU0 = _mm_adds_epi16(pixU0, xrsftAdd);
-            pixV0 = _mm_adds_epi16(pixV0, xrsftAdd);
-            pixY1 = _mm_adds_epi16(pixY1, xrsftAdd);
-            pixU1 = _mm_adds_epi16(pixU1, xrsftAdd);
-            pixV1 = _mm_adds_epi16(pixV1, xrsftAdd);
+            pixY0 = _mm_adds_epu16(pixY0, xrsftAdd);
+            pixU0 = _mm_adds_epu16(pixU0, xrsftAdd);
+            pixV0 = _mm_adds_epu16(pixV0, xrsftAdd);
+            pixY1 = _mm_adds_epu16(pixY1, xrsftAdd);
+            pixU1 = _mm_adds_epu16(pixU1, xrsftAdd);
+            pixV1 = _mm_adds_epu16(pixV1, xrsftAdd);
             pixY0 = _mm_srli_epi16(pixY0, in_bit_depth - 8);
             pixU0 = _mm_srli_epi16(pixU0, in_bit_depth - 8);
             pixV0 = _mm_srli_epi16(pixV0, in_bit_depth - 8);
@@ -1342,7 +1343,7 @@ static void RGY_FORCEINLINE convert_yuv444_to_y410_simd(void** dst, const void**
         uint8_t* src_u_ptr = srcULine;
         uint8_t* src_v_ptr = srcVLine;
         uint32_t* dst_ptr = dstLine;
-        for (int x = 0; x < y_width; x++, src_y_ptr += 16, src_u_ptr += 16, src_v_ptr += 16, dst_ptr += 16) {
+        for (int x = 0; x < y_width; x += 16, src_y_ptr += 16, src_u_ptr += 16, src_v_ptr += 16, dst_ptr += 16) {
             __m128i pixY = _mm_loadu_si128((const __m128i*)(src_y_ptr + 0));
             __m128i pixU = _mm_loadu_si128((const __m128i*)(src_u_ptr + 0));
             __m128i pixV = _mm_loadu_si128((const __m128i*)(src_v_ptr + 0));
@@ -1398,7 +1399,7 @@ void convert_yuv444_high_to_y410_simd(void** dst, const void** src, int width, i
         uint16_t* src_u_ptr = srcULine;
         uint16_t* src_v_ptr = srcVLine;
         uint32_t* dst_ptr = dstLine;
-        for (int x = 0; x < y_width; x++, src_y_ptr += 16, src_u_ptr += 16, src_v_ptr += 16, dst_ptr += 16) {
+        for (int x = 0; x < y_width; x += 16, src_y_ptr += 16, src_u_ptr += 16, src_v_ptr += 16, dst_ptr += 16) {
             __m128i pixY0 = _mm_loadu_si128((const __m128i*)(src_y_ptr + 0));
             __m128i pixY1 = _mm_loadu_si128((const __m128i*)(src_y_ptr + 8));
             __m128i pixU0 = _mm_loadu_si128((const __m128i*)(src_u_ptr + 0));
@@ -1407,12 +1408,12 @@ void convert_yuv444_high_to_y410_simd(void** dst, const void** src, int width, i
             __m128i pixV1 = _mm_loadu_si128((const __m128i*)(src_v_ptr + 8));
 
             if (in_bit_depth > out_bit_depth) {
-                pixY0 = _mm_srli_epi16(_mm_add_epi16(pixY0, xrsftAdd), in_bit_depth - out_bit_depth);
-                pixY1 = _mm_srli_epi16(_mm_add_epi16(pixY1, xrsftAdd), in_bit_depth - out_bit_depth);
-                pixU0 = _mm_srli_epi16(_mm_add_epi16(pixU0, xrsftAdd), in_bit_depth - out_bit_depth);
-                pixU1 = _mm_srli_epi16(_mm_add_epi16(pixU1, xrsftAdd), in_bit_depth - out_bit_depth);
-                pixV0 = _mm_srli_epi16(_mm_add_epi16(pixV0, xrsftAdd), in_bit_depth - out_bit_depth);
-                pixV1 = _mm_srli_epi16(_mm_add_epi16(pixV1, xrsftAdd), in_bit_depth - out_bit_depth);
+                pixY0 = _mm_srli_epi16(_mm_adds_epu16(pixY0, xrsftAdd), in_bit_depth - out_bit_depth);
+                pixY1 = _mm_srli_epi16(_mm_adds_epu16(pixY1, xrsftAdd), in_bit_depth - out_bit_depth);
+                pixU0 = _mm_srli_epi16(_mm_adds_epu16(pixU0, xrsftAdd), in_bit_depth - out_bit_depth);
+                pixU1 = _mm_srli_epi16(_mm_adds_epu16(pixU1, xrsftAdd), in_bit_depth - out_bit_depth);
+                pixV0 = _mm_srli_epi16(_mm_adds_epu16(pixV0, xrsftAdd), in_bit_depth - out_bit_depth);
+                pixV1 = _mm_srli_epi16(_mm_adds_epu16(pixV1, xrsftAdd), in_bit_depth - out_bit_depth);
             }
             pixY0 = _mm_min_epu16_simd(pixY0, _mm_set1_epi16((1<<out_bit_depth)-1));
             pixY1 = _mm_min_epu16_simd(pixY1, _mm_set1_epi16((1<<out_bit_depth)-1));
@@ -1536,8 +1537,8 @@ static void RGY_FORCEINLINE convert_yuv444_high_to_yuv444_simd(void **dst, const
             for (int x = 0; x < y_width; x += 16, dst_ptr += 16, src_ptr += 16) {
                 __m128i x0 = _mm_loadu_si128((const __m128i *)(src_ptr + 0));
                 __m128i x1 = _mm_loadu_si128((const __m128i *)(src_ptr + 8));
-                x0 = _mm_adds_epi16(x0, xrsftAdd);
-                x1 = _mm_adds_epi16(x1, xrsftAdd);
+                x0 = _mm_adds_epu16(x0, xrsftAdd);
+                x1 = _mm_adds_epu16(x1, xrsftAdd);
                 x0 = _mm_srli_epi16(x0, in_bit_depth - 8);
                 x1 = _mm_srli_epi16(x1, in_bit_depth - 8);
                 x0 = _mm_packus_epi16(x0, x1);
@@ -205,7 +205,20 @@ tstring encoder_help() {
         _T("   --check-environment          check environment info\n")
         _T("   --check-device               check device available\n")
         _T("   --check-clinfo               check OpenCL info\n")
+        _T("   --check-csp-conv [<string>]  check colorspace conversion functions against\n")
+        _T("                                 C implementation and measure their speed.\n")
+        _T("                                 conversions can be filtered by colorspace name.\n")
+        _T("   --check-queue                check packet queues and measure their throughput.\n")
+        _T("   --check-feature-cache        check the on-disk cache of feature queries.\n")
+        _T("   --check-dovi-rpu             check reading of Dolby Vision RPU files and measure its speed.\n")
+        _T("   --check-nal-parse            check splitting of NAL units/OBUs and measure its speed.\n")
+        _T("   --check-read-ahead           check input read-ahead and measure its throughput.\n")
+        _T("   --check-raw-read             check raw/y4m reading and measure its throughput.\n")
+        _T("   --check-ssim-cpu             check ssim/psnr calculation on the cpu and measure its speed.\n")
+        _T("   --check-lut3d-parse          check reading of values in lut3d cube files and measure its speed.\n")
 #if ENABLE_AVSW_READER
+        _T("   --check-mux-interleave       check the order of packets written by the muxer.\n")
+        _T("   --check-frame-pos            check pts lookups of the input frame list and measure their speed.\n")
         _T("   --check-avversion            show dll version\n")
         _T("   --check-codecs               show codecs available\n")
         _T("   --check-encoders             show audio encoders available\n")
@@ -440,6 +453,12 @@ tstring encoder_help() {
         _T("                                 note that mfx thread cannot be less than 2.\n")
 #endif
         _T("   --gpu-copy                   Enables gpu accelerated copying between device and host.\n")
+        _T("   --thread-pipeline <int>      run pipeline stages in separate threads.\n")
+        _T("                                  0: disable (default)\n")
+        _T("                                  1: run input, filters and encode in separate threads\n")
+        _T("   --surface-pool-auto          grow/shrink OpenCL work surface pools by wait time.\n")
+        _T("   --feature-cache <string>     cache hw encode/decode/vpp feature queries on disk.\n")
+        _T("                                  auto (default), off, refresh\n")
         _T("   --min-memory                 minimize memory usage of QSVEncC.\n")
         _T("                                 same as --output-thread 0 --audio-thread 0\n")
         _T("                                   --mfx-thread 2 -a 1 --input-buf 1 --output-buf 0\n")
@@ -1594,6 +1613,34 @@ int ParseOneOption(const TCHAR *option_name, const TCHAR* strInput[], int& i, in
         pParams->gpuCopy = true;
         return 0;
     }
+    if (0 == _tcscmp(option_name, _T("thread-pipeline"))) {
+        i++;
+        int value = 0;
+        if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
+            print_cmd_error_invalid_value(option_name, strInput[i]);
+            return 1;
+        }
+        if (value < 0 || value >= 2) {
+            print_cmd_error_invalid_value(option_name, strInput[i], _T("should be 0 or 1"));
+            return 1;
+        }
+        pParams->threadPipeline = value;
+        return 0;
+    }
+    if (0 == _tcscmp(option_name, _T("surface-pool-auto"))) {
+        pParams->surfacePoolAuto = true;
+        return 0;
+    }
+    if (0 == _tcscmp(option_name, _T("feature-cache"))) {
+        i++;
+        int value = get_value_from_chr(list_feature_cache, strInput[i]);
+        if (PARSE_ERROR_FLAG == value) {
+            print_cmd_error_invalid_value(option_name, strInput[i], list_feature_cache);
+            return 1;
+        }
+        pParams->featureCache = value;
+        return 0;
+    }
     if (0 == _tcscmp(option_name, _T("min-memory"))) {
         pParams->ctrl.threadOutput = 0;
         pParams->ctrl.threadAudio = 0;
@@ -2261,6 +2308,9 @@ tstring gen_cmd(const sInputParams *pParams, bool save_disabled_prm) {
     OPT_NUM(_T("--mfx-thread"), nSessionThreads);
 #endif //#if defined(_WIN32) || defined(_WIN64)
     OPT_BOOL(_T("--gpu-copy"), _T(""), gpuCopy);
+    OPT_NUM(_T("--thread-pipeline"), threadPipeline);
+    OPT_BOOL(_T("--surface-pool-auto"), _T(""), surfacePoolAuto);
+    OPT_LST(_T("--feature-cache"), featureCache, list_feature_cache);
     OPT_NUM(_T("--input-buf"), nInputBufSize);
 
     cmd << gen_cmd(&pParams->ctrl, &encPrmDefault.ctrl, save_disabled_prm);
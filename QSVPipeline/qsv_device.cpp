@@ -25,9 +25,13 @@
 //
 // --------------------------------------------------------------------------------------------
 
+#include <filesystem>
 #include "qsv_util.h"
 #include "qsv_session.h"
 #include "qsv_device.h"
+#if LIBVA_SUPPORT
+#include <va/va.h>
+#endif
 
 QSVDevice::QSVDevice() :
     m_devNum(QSVDeviceNum::AUTO),
@@ -39,6 +43,8 @@ QSVDevice::QSVDevice() :
     m_externalAlloc(false),
     m_memType(HW_MEMORY),
     m_featureData(),
+    m_vppFeature(),
+    m_featureCache(),
     m_log() {
     m_log = std::make_shared<RGYLog>(nullptr, RGY_LOG_QUIET);
 }
@@ -49,6 +55,10 @@ QSVDevice::~QSVDevice() {
 
 void QSVDevice::close() {
     PrintMes(RGY_LOG_DEBUG, _T("Close device %d...\n"), (int)m_devNum);
+    if (m_featureCache) {
+        m_featureCache->save();
+        m_featureCache.reset();
+    }
     PrintMes(RGY_LOG_DEBUG, _T("Closing session...\n"));
     m_session.Close();
     PrintMes(RGY_LOG_DEBUG, _T("Closing device...\n"));
@@ -57,6 +67,7 @@ void QSVDevice::close() {
     PrintMes(RGY_LOG_DEBUG, _T("Closing allocator...\n"));
     m_allocator.reset();
     m_featureData.clear();
+    m_vppFeature.reset();
     m_devInfo.reset();
     PrintMes(RGY_LOG_DEBUG, _T("Device %d closed.\n"), (int)m_devNum);
     m_log.reset();
@@ -145,7 +156,80 @@ LUID QSVDevice::luid() {
     return (m_hwdev) ? m_hwdev->GetLUID() : LUID();
 }
 
+std::string QSVDevice::featureCacheKey() {
+    std::string key = strsprintf("%s %s|dev=%d|mem=%s", ENCODER_NAME, VER_STR_FILEVERSION, (int)m_devNum, tchar_to_string(MemTypeToStr(m_memType)).c_str());
+    mfxVersion ver = MFX_LIB_VERSION_0_0;
+    mfxIMPL impl = 0;
+    m_session.QueryVersion(&ver);
+    m_session.QueryIMPL(&impl);
+    key += strsprintf("|impl=0x%x|api=%d.%d", impl, ver.Major, ver.Minor);
+    for (const auto& desc : m_session.getImplList()) {
+        key += strsprintf("|desc=%s:%s:%d.%d:%d", desc.ImplName, desc.Dev.DeviceID, desc.ApiVersion.Major, desc.ApiVersion.Minor, (int)desc.AccelerationMode);
+    }
+    // ドライバの更新を検出できるよう、ランタイムのパス・サイズ・更新日時、ドライバのバージョンをキーに含める
+    bool driverIdentified = false;
+    for (const auto& path : m_session.getImplPathList()) {
+        std::error_code ec;
+        const auto filesize = std::filesystem::file_size(path, ec);
+        if (ec) continue;
+        const auto filetime = std::filesystem::last_write_time(path, ec);
+        if (ec) continue;
+        key += strsprintf("|lib=%s:%llu:%lld", tchar_to_string(path).c_str(), (unsigned long long)filesize, (long long)filetime.time_since_epoch().count());
+        driverIdentified = true;
+    }
+#if LIBVA_SUPPORT
+    mfxHDL hdl = nullptr;
+    if (m_hwdev && m_hwdev->GetHandle(MFX_HANDLE_VA_DISPLAY, &hdl) == MFX_ERR_NONE && hdl != nullptr) {
+        if (const char *vendor = vaQueryVendorString((VADisplay)hdl); vendor != nullptr) {
+            key += std::string("|va=") + vendor;
+            driverIdentified = true;
+        }
+    }
+#endif
+    if (m_devInfo && m_devInfo->driver_version.length() > 0) {
+        key += "|cl=" + m_devInfo->name + ":" + m_devInfo->driver_version;
+        driverIdentified = true;
+    }
+    return (driverIdentified) ? key : std::string();
+}
+
+RGY_ERR QSVDevice::initFeatureCache(const int mode) {
+    return initFeatureCache(mode, QSVFeatureCache::defaultDir());
+}
+
+RGY_ERR QSVDevice::initFeatureCache(const int mode, const tstring& dir) {
+    m_featureCache.reset();
+    if (mode == QSV_FEATURE_CACHE_OFF) {
+        return RGY_ERR_NONE;
+    }
+    const auto key = featureCacheKey();
+    if (key.length() == 0) {
+        PrintMes(RGY_LOG_DEBUG, _T("QSVDevice::initFeatureCache: failed to identify driver of device %d, feature cache disabled.\n"), (int)m_devNum);
+        return RGY_ERR_UNSUPPORTED;
+    }
+    if (dir.length() == 0) {
+        PrintMes(RGY_LOG_DEBUG, _T("QSVDevice::initFeatureCache: failed to get cache dir, feature cache disabled.\n"));
+        return RGY_ERR_UNSUPPORTED;
+    }
+    m_featureCache = std::make_unique<QSVFeatureCache>(dir, key, mode == QSV_FEATURE_CACHE_REFRESH, m_log);
+    m_featureCache->load();
+    return RGY_ERR_NONE;
+}
+
 CodecCsp QSVDevice::getDecodeCodecCsp(const bool skipHWDecodeCheck) {
+    CodecCsp codecCsp;
+    //skipHWDecodeCheckの場合はチェックを行わないので、キャッシュの必要はない
+    if (!skipHWDecodeCheck && m_featureCache && m_featureCache->getDecodeCodecCsp(codecCsp)) {
+        return codecCsp;
+    }
+    codecCsp = queryDecodeCodecCsp(skipHWDecodeCheck);
+    if (!skipHWDecodeCheck && m_featureCache) {
+        m_featureCache->setDecodeCodecCsp(codecCsp);
+    }
+    return codecCsp;
+}
+
+CodecCsp QSVDevice::queryDecodeCodecCsp(const bool skipHWDecodeCheck) {
     vector<RGY_CODEC> codecLists;
     for (int i = 0; i < _countof(HW_DECODE_LIST); i++) {
         codecLists.push_back(HW_DECODE_LIST[i].rgy_codec);
@@ -160,9 +244,15 @@ QSVEncFeatures QSVDevice::getEncodeFeature(const int ratecontrol, const RGY_CODE
     if (target != m_featureData.end() && target->feature.count(ratecontrol) > 0) {
         return target->feature[ratecontrol];
     }
-    //チェックする際は専用のsessionを作成するようにしないと異常終了することがある
-    auto resultData = MakeFeatureList(m_devNum, { ratecontrol }, codec, lowpower, m_log);
-    QSVEncFeatures& result = resultData.feature[ratecontrol];
+    QSVEncFeatures result;
+    if (!m_featureCache || !m_featureCache->getEncodeFeature(result, ratecontrol, codec, lowpower)) {
+        auto resultData = queryEncodeFeature(ratecontrol, codec, lowpower);
+        //sessionの作成に失敗した場合は結果がないので、キャッシュしない
+        if (m_featureCache && resultData.feature.count(ratecontrol) > 0) {
+            m_featureCache->setEncodeFeature(resultData.feature[ratecontrol], ratecontrol, codec, lowpower);
+        }
+        result = resultData.feature[ratecontrol];
+    }
     if (target != m_featureData.end()) {
         target->feature[ratecontrol] = result;
     } else {
@@ -176,6 +266,30 @@ QSVEncFeatures QSVDevice::getEncodeFeature(const int ratecontrol, const RGY_CODE
     return result;
 }
 
+uint64_t QSVDevice::getVppFeature() {
+    if (m_vppFeature.has_value()) {
+        return m_vppFeature.value();
+    }
+    uint64_t result = 0;
+    if (!m_featureCache || !m_featureCache->getVppFeature(result)) {
+        result = queryVppFeature();
+        if (m_featureCache) {
+            m_featureCache->setVppFeature(result);
+        }
+    }
+    m_vppFeature = result;
+    return result;
+}
+
+QSVEncFeatureData QSVDevice::queryEncodeFeature(const int ratecontrol, const RGY_CODEC codec, const bool lowpower) {
+    //チェックする際は専用のsessionを作成するようにしないと異常終了することがある
+    return MakeFeatureList(m_devNum, { ratecontrol }, codec, lowpower, m_log);
+}
+
+uint64_t QSVDevice::queryVppFeature() {
+    return CheckVppFeatures(m_session);
+}
+
 std::optional<RGYOpenCLDeviceInfo> getDeviceCLInfoQSV(const QSVDeviceNum deviceNum) {
     auto dev = std::make_unique<QSVDevice>();
     if (dev->init(deviceNum, true, true) == RGY_ERR_NONE && dev->devInfo()) {
@@ -184,7 +298,7 @@ std::optional<RGYOpenCLDeviceInfo> getDeviceCLInfoQSV(const QSVDeviceNum deviceN
     return std::optional<RGYOpenCLDeviceInfo>();
 }
 
-std::vector<std::unique_ptr<QSVDevice>> getDeviceList(const QSVDeviceNum deviceNum, const bool enableOpenCL, const MemType memType, const MFXVideoSession2Params& params, std::shared_ptr<RGYLog> log) {
+std::vector<std::unique_ptr<QSVDevice>> getDeviceList(const QSVDeviceNum deviceNum, const bool enableOpenCL, const MemType memType, const MFXVideoSession2Params& params, const int featureCache, std::shared_ptr<RGYLog> log) {
     auto openCLAvail = enableOpenCL;
     if (enableOpenCL) {
         RGYOpenCL cl(std::make_shared<RGYLog>(nullptr, RGY_LOG_QUIET));
@@ -201,6 +315,7 @@ std::vector<std::unique_ptr<QSVDevice>> getDeviceList(const QSVDeviceNum deviceN
         if (dev->init((QSVDeviceNum)idev, enableOpenCL && openCLAvail, memType, params, log, idev != idevstart) != RGY_ERR_NONE) {
             break;
         }
+        dev->initFeatureCache(featureCache);
         devList.push_back(std::move(dev));
     }
     return devList;
@@ -32,6 +32,7 @@
 #include "qsv_util.h"
 #include "qsv_session.h"
 #include "qsv_query.h"
+#include "qsv_feature_cache.h"
 
 class QSVDevice {
 public:
@@ -43,6 +44,11 @@ public:
 
     CodecCsp getDecodeCodecCsp(const bool skipHWDecodeCheck);
     QSVEncFeatures getEncodeFeature(const int ratecontrol, const RGY_CODEC codec, const bool lowpower);
+    // VPPの機能 (VPP_FEATURE_xxx) 初回のみ問い合わせ、以降は保持している結果を返す
+    uint64_t getVppFeature();
+    // 問い合わせ結果のディスクキャッシュを有効にする (mode: QSVFeatureCacheMode)
+    RGY_ERR initFeatureCache(const int mode);
+    RGY_ERR initFeatureCache(const int mode, const tstring& dir);
 
     void close();
 
@@ -58,6 +64,12 @@ public:
     const RGYOpenCLDeviceInfo *devInfo() const { return m_devInfo.get(); }
     MFXVideoSession2& mfxSession() { return m_session; };
 protected:
+    // デバイス・ランタイム・ドライバを識別するキャッシュのキー (識別できなければ空)
+    virtual std::string featureCacheKey();
+    // キャッシュになかった場合に、sessionを使ってデバイスに問い合わせる
+    virtual CodecCsp queryDecodeCodecCsp(const bool skipHWDecodeCheck);
+    virtual QSVEncFeatureData queryEncodeFeature(const int ratecontrol, const RGY_CODEC codec, const bool lowpower);
+    virtual uint64_t queryVppFeature();
 
     void PrintMes(RGYLogLevel log_level, const TCHAR *format, ...) {
         if (m_log.get() == nullptr) {
@@ -91,9 +103,11 @@ protected:
     bool m_externalAlloc;
     MemType m_memType;
     std::vector<QSVEncFeatureData> m_featureData;
+    std::optional<uint64_t> m_vppFeature;
+    std::unique_ptr<QSVFeatureCache> m_featureCache;
     std::shared_ptr<RGYLog> m_log;
 };
 
-std::vector<std::unique_ptr<QSVDevice>> getDeviceList(const QSVDeviceNum dev, const bool enableOpenCL, const MemType memType, const MFXVideoSession2Params& params, std::shared_ptr<RGYLog> log);
+std::vector<std::unique_ptr<QSVDevice>> getDeviceList(const QSVDeviceNum dev, const bool enableOpenCL, const MemType memType, const MFXVideoSession2Params& params, const int featureCache, std::shared_ptr<RGYLog> log);
 
 #endif //_QSV_DEVICE_H_
@@ -0,0 +1,273 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#include <cstdio>
+#include <fstream>
+#include <atomic>
+#include <filesystem>
+#include "qsv_feature_cache.h"
+#include "rgy_osdep.h"
+#include "rgy_util.h"
+#include "rgy_filesystem.h"
+
+static const char *QSV_FEATURE_CACHE_HEADER = "QSVFeatureCache v1";
+
+static uint64_t feature_cache_hash(const std::string& str) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const auto c : str) {
+        hash ^= (uint8_t)c;
+        hash *= 0x100000001b3ull; //FNV-1a
+    }
+    return hash;
+}
+
+QSVFeatureCache::QSVFeatureCache(const tstring& dir, const std::string& key, const bool refresh, std::shared_ptr<RGYLog> log) :
+    m_dir(dir),
+    m_filepath(),
+    m_key(str_replace(key, "\n", " ")),
+    m_enc(),
+    m_dec(),
+    m_vpp(),
+    m_refresh(refresh),
+    m_modified(false),
+    m_mtx(),
+    m_log(log) {
+    if (m_dir.length() > 0) {
+        const auto filename = strsprintf(_T("%016llx.txt"), (unsigned long long)feature_cache_hash(m_key));
+#if defined(_WIN32) || defined(_WIN64)
+        m_filepath = PathCombineS(m_dir, filename);
+#else
+        m_filepath = (std::filesystem::path(m_dir) / filename).string();
+#endif
+    }
+}
+
+QSVFeatureCache::~QSVFeatureCache() {
+}
+
+tstring QSVFeatureCache::defaultDir() {
+    return getCacheDir(_T("featurecache"));
+}
+
+RGY_ERR QSVFeatureCache::read(std::map<EncFeatureKey, QSVEncFeatures>& enc, std::unique_ptr<CodecCsp>& dec, std::optional<uint64_t>& vpp) const {
+    std::ifstream ifs(m_filepath);
+    if (!ifs) {
+        return RGY_ERR_FILE_OPEN;
+    }
+    std::string line;
+    if (!std::getline(ifs, line) || line != QSV_FEATURE_CACHE_HEADER) {
+        return RGY_ERR_INVALID_FORMAT;
+    }
+    if (!std::getline(ifs, line) || line != "key=" + m_key) {
+        return RGY_ERR_INVALID_VERSION;
+    }
+    while (std::getline(ifs, line)) {
+        if (line == "end") {
+            return RGY_ERR_NONE;
+        } else if (line.substr(0, 4) == "enc=") {
+            // enc=<codec>,<lowpower>,<ratecontrol>,<rc_ext>,<feature>
+            int codec = 0, lowpower = 0, ratecontrol = 0;
+            unsigned long long rcext = 0, feature = 0;
+            if (sscanf_s(line.c_str() + 4, "%d,%d,%d,%llx,%llx", &codec, &lowpower, &ratecontrol, &rcext, &feature) != 5) {
+                return RGY_ERR_INVALID_FORMAT;
+            }
+            enc[std::make_tuple(codec, lowpower, ratecontrol)] = QSVEncFeatures((QSVEncFeatureRCExt)rcext, (QSVEncFeatureParams)feature);
+        } else if (line.substr(0, 4) == "dec=") {
+            // dec=<codec>:<csp>,<csp>,...;<codec>:...
+            dec = std::make_unique<CodecCsp>();
+            for (const auto& codecStr : split(line.substr(4), ";", true)) {
+                const auto pos = codecStr.find(':');
+                if (pos == std::string::npos) {
+                    return RGY_ERR_INVALID_FORMAT;
+                }
+                auto& csps = (*dec)[(RGY_CODEC)std::stoi(codecStr.substr(0, pos))];
+                for (const auto& csp : split(codecStr.substr(pos + 1), ",", true)) {
+                    csps.push_back((RGY_CSP)std::stoi(csp));
+                }
+            }
+        } else if (line.substr(0, 4) == "vpp=") {
+            // vpp=<feature>
+            unsigned long long feature = 0;
+            if (sscanf_s(line.c_str() + 4, "%llx", &feature) != 1) {
+                return RGY_ERR_INVALID_FORMAT;
+            }
+            vpp = (uint64_t)feature;
+        }
+    }
+    // endがなければ途中で途切れている
+    return RGY_ERR_INVALID_FORMAT;
+}
+
+RGY_ERR QSVFeatureCache::load() {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (m_filepath.length() == 0) {
+        return RGY_ERR_INVALID_CALL;
+    }
+    if (m_refresh) {
+        m_log->write(RGY_LOG_DEBUG, RGY_LOGT_DEV, _T("QSVFeatureCache: refresh %s.\n"), m_filepath.c_str());
+        return RGY_ERR_NONE;
+    }
+    std::map<EncFeatureKey, QSVEncFeatures> enc;
+    std::unique_ptr<CodecCsp> dec;
+    std::optional<uint64_t> vpp;
+    RGY_ERR err = RGY_ERR_NONE;
+    try {
+        err = read(enc, dec, vpp);
+    } catch (...) {
+        err = RGY_ERR_INVALID_FORMAT;
+    }
+    if (err != RGY_ERR_NONE) {
+        // 見つからない、古い、あるいは壊れたキャッシュは使用せず、次回の保存で上書きする
+        m_log->write(RGY_LOG_DEBUG, RGY_LOGT_DEV, _T("QSVFeatureCache: cache not available %s: %s.\n"), m_filepath.c_str(), get_err_mes(err));
+        return err;
+    }
+    m_enc = std::move(enc);
+    m_dec = std::move(dec);
+    m_vpp = vpp;
+    m_log->write(RGY_LOG_DEBUG, RGY_LOGT_DEV, _T("QSVFeatureCache: loaded %d encode features%s%s from %s.\n"),
+        (int)m_enc.size(), (m_dec) ? _T(", decode features") : _T(""), (m_vpp.has_value()) ? _T(", vpp features") : _T(""), m_filepath.c_str());
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR QSVFeatureCache::save() {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (!m_modified || m_filepath.length() == 0) {
+        return RGY_ERR_NONE;
+    }
+    if (!m_refresh) {
+        // 他のプロセスが保存した問い合わせ結果を失わないよう、保存済みの内容とマージする
+        std::map<EncFeatureKey, QSVEncFeatures> enc;
+        std::unique_ptr<CodecCsp> dec;
+        std::optional<uint64_t> vpp;
+        try {
+            if (read(enc, dec, vpp) == RGY_ERR_NONE) {
+                m_enc.insert(enc.begin(), enc.end());
+                if (!m_dec) {
+                    m_dec = std::move(dec);
+                }
+                if (!m_vpp.has_value()) {
+                    m_vpp = vpp;
+                }
+            }
+        } catch (...) {
+        }
+    }
+    if (!CreateDirectoryRecursive(m_dir.c_str())) {
+        m_log->write(RGY_LOG_DEBUG, RGY_LOGT_DEV, _T("QSVFeatureCache: failed to create dir %s.\n"), m_dir.c_str());
+        return RGY_ERR_INVALID_CALL;
+    }
+    std::string str = std::string(QSV_FEATURE_CACHE_HEADER) + "\n";
+    str += "key=" + m_key + "\n";
+    for (const auto& [key, feature] : m_enc) {
+        str += strsprintf("enc=%d,%d,%d,%llx,%llx\n", std::get<0>(key), std::get<1>(key), std::get<2>(key),
+            (unsigned long long)(feature & (QSVEncFeatureRCExt)UINT64_MAX), (unsigned long long)(feature & (QSVEncFeatureParams)UINT64_MAX));
+    }
+    if (m_dec) {
+        std::string decStr;
+        for (const auto& [codec, csps] : *m_dec) {
+            if (decStr.length() > 0) decStr += ";";
+            decStr += strsprintf("%d:", (int)codec);
+            for (size_t i = 0; i < csps.size(); i++) {
+                decStr += strsprintf((i) ? ",%d" : "%d", (int)csps[i]);
+            }
+        }
+        str += "dec=" + decStr + "\n";
+    }
+    if (m_vpp.has_value()) {
+        str += strsprintf("vpp=%llx\n", (unsigned long long)m_vpp.value());
+    }
+    str += "end\n";
+
+    // 同じファイルに複数のプロセスが書き込んでも壊れないよう、一時ファイルに書き出してから置き換える
+    static std::atomic<uint32_t> tmpCount(0);
+    const auto tmppath = m_filepath + strsprintf(_T(".%u_%u.tmp"), GetCurrentProcessId(), tmpCount++);
+    FILE *fp = nullptr;
+    if (_tfopen_s(&fp, tmppath.c_str(), _T("wb")) != 0 || fp == nullptr) {
+        m_log->write(RGY_LOG_DEBUG, RGY_LOGT_DEV, _T("QSVFeatureCache: failed to open %s.\n"), tmppath.c_str());
+        return RGY_ERR_FILE_OPEN;
+    }
+    bool ok = fwrite(str.data(), 1, str.size(), fp) == str.size();
+    ok = (fclose(fp) == 0) && ok;
+    std::error_code ec;
+    if (ok) {
+        std::filesystem::rename(tmppath, m_filepath, ec);
+    }
+    if (!ok || ec) {
+        std::filesystem::remove(tmppath, ec);
+        m_log->write(RGY_LOG_DEBUG, RGY_LOGT_DEV, _T("QSVFeatureCache: failed to write %s.\n"), m_filepath.c_str());
+        return RGY_ERR_UNDEFINED_BEHAVIOR;
+    }
+    m_modified = false;
+    m_log->write(RGY_LOG_DEBUG, RGY_LOGT_DEV, _T("QSVFeatureCache: saved %s.\n"), m_filepath.c_str());
+    return RGY_ERR_NONE;
+}
+
+bool QSVFeatureCache::getEncodeFeature(QSVEncFeatures& feature, const int ratecontrol, const RGY_CODEC codec, const bool lowpower) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    auto it = m_enc.find(std::make_tuple((int)codec, (int)lowpower, ratecontrol));
+    if (it == m_enc.end()) {
+        return false;
+    }
+    feature = it->second;
+    return true;
+}
+
+void QSVFeatureCache::setEncodeFeature(const QSVEncFeatures& feature, const int ratecontrol, const RGY_CODEC codec, const bool lowpower) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_enc[std::make_tuple((int)codec, (int)lowpower, ratecontrol)] = feature;
+    m_modified = true;
+}
+
+bool QSVFeatureCache::getDecodeCodecCsp(CodecCsp& codecCsp) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (!m_dec) {
+        return false;
+    }
+    codecCsp = *m_dec;
+    return true;
+}
+
+void QSVFeatureCache::setDecodeCodecCsp(const CodecCsp& codecCsp) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_dec = std::make_unique<CodecCsp>(codecCsp);
+    m_modified = true;
+}
+
+bool QSVFeatureCache::getVppFeature(uint64_t& feature) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (!m_vpp.has_value()) {
+        return false;
+    }
+    feature = m_vpp.value();
+    return true;
+}
+
+void QSVFeatureCache::setVppFeature(const uint64_t feature) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_vpp = feature;
+    m_modified = true;
+}
@@ -0,0 +1,87 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __QSV_FEATURE_CACHE_H__
+#define __QSV_FEATURE_CACHE_H__
+
+#include <map>
+#include <tuple>
+#include <optional>
+#include <mutex>
+#include <memory>
+#include <string>
+#include "rgy_tchar.h"
+#include "rgy_err.h"
+#include "rgy_log.h"
+#include "qsv_query.h"
+
+// エンコード/デコード/VPP機能の問い合わせ結果のディスクキャッシュ
+// MakeFeatureList等による問い合わせはセッションの作成を伴い時間がかかるので、結果をファイルに保存して次回以降の起動で再利用する
+// デバイス・ランタイム・ドライバのバージョンなどから作成したキーをファイルに保存しておき、
+// キーが一致しない場合(ドライバの更新など)は読み込んだ内容を破棄して、問い合わせをやり直した結果で上書きする
+// 書き込みは一時ファイルに出力してからrenameで置き換えるので、複数のプロセスから同時に使用できる
+class QSVFeatureCache {
+public:
+    // refresh ... 保存済みの内容を使用せず、問い合わせ結果で上書きする
+    QSVFeatureCache(const tstring& dir, const std::string& key, const bool refresh, std::shared_ptr<RGYLog> log);
+    ~QSVFeatureCache();
+
+    // 既定のキャッシュの保存先 (getCacheDir(_T("featurecache")))
+    static tstring defaultDir();
+
+    // キャッシュを読み込む
+    RGY_ERR load();
+    // 追加された問い合わせ結果があれば、キャッシュを保存する
+    RGY_ERR save();
+
+    bool getEncodeFeature(QSVEncFeatures& feature, const int ratecontrol, const RGY_CODEC codec, const bool lowpower);
+    void setEncodeFeature(const QSVEncFeatures& feature, const int ratecontrol, const RGY_CODEC codec, const bool lowpower);
+    bool getDecodeCodecCsp(CodecCsp& codecCsp);
+    void setDecodeCodecCsp(const CodecCsp& codecCsp);
+    bool getVppFeature(uint64_t& feature);
+    void setVppFeature(const uint64_t feature);
+
+    const tstring& filepath() const { return m_filepath; }
+protected:
+    typedef std::tuple<int, int, int> EncFeatureKey; // codec, lowpower, ratecontrol
+    // ファイルの内容を読み込む (キーが一致しなければエラー)
+    RGY_ERR read(std::map<EncFeatureKey, QSVEncFeatures>& enc, std::unique_ptr<CodecCsp>& dec, std::optional<uint64_t>& vpp) const;
+
+    tstring m_dir;
+    tstring m_filepath;
+    std::string m_key;
+    std::map<EncFeatureKey, QSVEncFeatures> m_enc;
+    std::unique_ptr<CodecCsp> m_dec;
+    std::optional<uint64_t> m_vpp; // VPP_FEATURE_xxx
+    bool m_refresh;
+    bool m_modified;
+    std::mutex m_mtx;
+    std::shared_ptr<RGYLog> m_log;
+};
+
+#endif //__QSV_FEATURE_CACHE_H__
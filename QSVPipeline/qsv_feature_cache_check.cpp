@@ -0,0 +1,188 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#include <cstdio>
+#include <fstream>
+#include <filesystem>
+#include "qsv_feature_cache_check.h"
+#include "qsv_device.h"
+#include "rgy_check.h"
+#include "rgy_filesystem.h"
+#include "rgy_osdep.h"
+#include "rgy_util.h"
+
+// GPUの代わりに決まった結果を返すQSVDevice
+// キャッシュの処理はQSVDeviceのものをそのまま使い、sessionを使った問い合わせだけを置き換える
+class QSVDeviceFeatureCacheCheck : public QSVDevice {
+public:
+    int queries;            // 問い合わせの回数
+    std::string key;        // キャッシュのキー
+    uint64_t vpp;           // 問い合わせで返すVPPの機能
+    QSVEncFeatures enc;     // 問い合わせで返すエンコードの機能
+    CodecCsp dec;           // 問い合わせで返すデコードの機能
+
+    QSVDeviceFeatureCacheCheck(const std::string& key_) : QSVDevice(), queries(0), key(key_), vpp(VPP_FEATURE_RESIZE | VPP_FEATURE_DENOISE2 | VPP_FEATURE_PERC_ENC_PRE),
+        enc((QSVEncFeatureRCExt)0x123, (QSVEncFeatureParams)0xffffffff00000001ull), dec() {
+        dec[RGY_CODEC_HEVC] = { RGY_CSP_NV12, RGY_CSP_P010 };
+        dec[RGY_CODEC_AV1] = {};
+    }
+    virtual ~QSVDeviceFeatureCacheCheck() {};
+    const tstring cacheFilepath() const { return (m_featureCache) ? m_featureCache->filepath() : tstring(); }
+    // すべての機能を取得し、問い合わせた結果と一致するか確認する
+    bool getAll() {
+        const auto resultVpp = getVppFeature();
+        const auto resultEnc = getEncodeFeature(1, RGY_CODEC_H264, true);
+        const auto resultDec = getDecodeCodecCsp(false);
+        return resultVpp == vpp
+            && (resultEnc & (QSVEncFeatureRCExt)UINT64_MAX) == (enc & (QSVEncFeatureRCExt)UINT64_MAX)
+            && (resultEnc & (QSVEncFeatureParams)UINT64_MAX) == (enc & (QSVEncFeatureParams)UINT64_MAX)
+            && resultDec == dec;
+    }
+protected:
+    virtual std::string featureCacheKey() override { return key; }
+    virtual CodecCsp queryDecodeCodecCsp([[maybe_unused]] const bool skipHWDecodeCheck) override {
+        queries++;
+        return dec;
+    }
+    virtual QSVEncFeatureData queryEncodeFeature(const int ratecontrol, const RGY_CODEC codec, const bool lowpower) override {
+        queries++;
+        QSVEncFeatureData data;
+        data.dev = m_devNum;
+        data.codec = codec;
+        data.lowPwer = lowpower;
+        data.feature[ratecontrol] = enc;
+        return data;
+    }
+    virtual uint64_t queryVppFeature() override {
+        queries++;
+        return vpp;
+    }
+};
+
+bool check_feature_cache() {
+    const auto dirPath = std::filesystem::temp_directory_path() / ("qsvencc_feature_cache_check_" + std::to_string(GetCurrentProcessId()));
+#if defined(_WIN32) || defined(_WIN64)
+    const tstring dir = wstring_to_tstring(dirPath.wstring());
+#else
+    const tstring dir = dirPath.string();
+#endif
+    std::error_code ec;
+    std::filesystem::remove_all(dirPath, ec);
+
+    const std::string key = "check|dev=1|lib=libmfx-gen.so.1.2:1000:2000";
+    bool ok = true;
+    {
+        // キャッシュがないので問い合わせ、closeで保存する
+        QSVDeviceFeatureCacheCheck dev(key);
+        bool result = dev.initFeatureCache(QSV_FEATURE_CACHE_AUTO, dir) == RGY_ERR_NONE;
+        result &= dev.getAll() && dev.getAll(); // 2回目はデバイスの保持している結果を返す
+        const auto filepath = dev.cacheFilepath();
+        dev.close();
+        ok &= rgy_check_print(_T("first run"), result && dev.queries == 3 && filepath.length() > 0 && rgy_file_exists(filepath), _T(""));
+    }
+    {
+        // 保存した結果を使用し、問い合わせない
+        QSVDeviceFeatureCacheCheck dev(key);
+        bool result = dev.initFeatureCache(QSV_FEATURE_CACHE_AUTO, dir) == RGY_ERR_NONE;
+        result &= dev.getAll();
+        ok &= rgy_check_print(_T("cached"), result && dev.queries == 0, _T(""));
+    }
+    {
+        // 別のプロセスが追加で保存しても、保存済みの内容は失われない
+        QSVDeviceFeatureCacheCheck dev(key);
+        QSVDeviceFeatureCacheCheck devOther(key);
+        bool result = dev.initFeatureCache(QSV_FEATURE_CACHE_AUTO, dir) == RGY_ERR_NONE;
+        result &= devOther.initFeatureCache(QSV_FEATURE_CACHE_AUTO, dir) == RGY_ERR_NONE;
+        devOther.getEncodeFeature(3, RGY_CODEC_HEVC, false);
+        devOther.close();
+        dev.getEncodeFeature(2, RGY_CODEC_AV1, true);
+        dev.close();
+        QSVDeviceFeatureCacheCheck devCheck(key);
+        result &= devCheck.initFeatureCache(QSV_FEATURE_CACHE_AUTO, dir) == RGY_ERR_NONE;
+        result &= devCheck.getAll();
+        devCheck.getEncodeFeature(3, RGY_CODEC_HEVC, false);
+        devCheck.getEncodeFeature(2, RGY_CODEC_AV1, true);
+        ok &= rgy_check_print(_T("merge"), result && devOther.queries == 1 && dev.queries == 1 && devCheck.queries == 0, _T(""));
+    }
+    {
+        // refreshでは保存済みの内容を使用せず、問い合わせる
+        QSVDeviceFeatureCacheCheck dev(key);
+        bool result = dev.initFeatureCache(QSV_FEATURE_CACHE_REFRESH, dir) == RGY_ERR_NONE;
+        result &= dev.getAll();
+        ok &= rgy_check_print(_T("refresh"), result && dev.queries == 3, _T(""));
+    }
+    {
+        // offではキャッシュを使用しない
+        QSVDeviceFeatureCacheCheck dev(key);
+        bool result = dev.initFeatureCache(QSV_FEATURE_CACHE_OFF, dir) == RGY_ERR_NONE;
+        result &= dev.getAll();
+        ok &= rgy_check_print(_T("off"), result && dev.queries == 3 && dev.cacheFilepath().length() == 0, _T(""));
+    }
+    {
+        // ドライバが更新されるとキーが変わるので、保存済みの内容は使用しない
+        QSVDeviceFeatureCacheCheck dev(key + "|cl=driver2");
+        dev.vpp |= VPP_FEATURE_MCTF;
+        bool result = dev.initFeatureCache(QSV_FEATURE_CACHE_AUTO, dir) == RGY_ERR_NONE;
+        result &= dev.getAll();
+        ok &= rgy_check_print(_T("driver update"), result && dev.queries == 3, _T(""));
+    }
+    {
+        // ドライバを識別できなければ、キャッシュを使用しない
+        QSVDeviceFeatureCacheCheck dev("");
+        bool result = dev.initFeatureCache(QSV_FEATURE_CACHE_AUTO, dir) == RGY_ERR_UNSUPPORTED;
+        result &= dev.getAll();
+        ok &= rgy_check_print(_T("unidentified driver"), result && dev.queries == 3 && dev.cacheFilepath().length() == 0, _T(""));
+    }
+    {
+        // 途中で途切れたファイルは使用しない
+        tstring filepath;
+        {
+            QSVDeviceFeatureCacheCheck dev(key);
+            dev.initFeatureCache(QSV_FEATURE_CACHE_AUTO, dir);
+            filepath = dev.cacheFilepath();
+        }
+        std::string str;
+        {
+            std::ifstream ifs(filepath);
+            std::string line;
+            while (std::getline(ifs, line) && line != "end") {
+                str += line + "\n";
+            }
+        }
+        {
+            std::ofstream ofs(filepath, std::ios::binary | std::ios::trunc);
+            ofs << str;
+        }
+        QSVDeviceFeatureCacheCheck dev(key);
+        bool result = filepath.length() > 0 && str.length() > 0;
+        result &= dev.initFeatureCache(QSV_FEATURE_CACHE_AUTO, dir) == RGY_ERR_NONE;
+        result &= dev.getAll();
+        ok &= rgy_check_print(_T("truncated file"), result && dev.queries == 3, _T(""));
+    }
+    std::filesystem::remove_all(dirPath, ec);
+    return rgy_check_print_total(ok);
+}
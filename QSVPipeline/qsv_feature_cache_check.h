@@ -0,0 +1,39 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __QSV_FEATURE_CACHE_CHECK_H__
+#define __QSV_FEATURE_CACHE_CHECK_H__
+
+// 機能の問い合わせ結果のディスクキャッシュ(QSVFeatureCache)の動作確認
+// GPUの代わりに問い合わせ回数を数える疑似的な問い合わせ先を使い、一時フォルダにキャッシュを作成して、
+// 初回の問い合わせ・キャッシュの再利用・他プロセスの保存内容とのマージ・refresh・キーの不一致(ドライバの更新)・壊れたファイルの各場合について、
+// 取得した結果と問い合わせの有無を確認する
+//   戻り値  ... すべての場合で期待どおりならtrue
+bool check_feature_cache();
+
+#endif //__QSV_FEATURE_CACHE_CHECK_H__
@@ -38,6 +38,8 @@
 #include <climits>
 #include <deque>
 #include <mutex>
+#include <thread>
+#include <functional>
 #include "rgy_osdep.h"
 #include "rgy_util.h"
 #pragma warning(push)
@@ -51,6 +53,7 @@ RGY_DISABLE_WARNING_POP
 #pragma warning(pop)
 #include "qsv_pipeline.h"
 #include "qsv_pipeline_ctrl.h"
+#include "rgy_opencl_cache.h"
 #include "qsv_session.h"
 #include "qsv_query.h"
 #include "rgy_def.h"
@@ -94,6 +97,7 @@ RGY_DISABLE_WARNING_POP
 #include "rgy_avlog.h"
 #include "rgy_chapter.h"
 #include "rgy_timecode.h"
+#include "rgy_trace.h"
 #include "rgy_aspect_ratio.h"
 #include "rgy_codepage.h"
 #if defined(_WIN32) || defined(_WIN64)
@@ -1335,7 +1339,7 @@ bool CQSVPipeline::CPUGenOpenCLSupported(const QSV_CPU_GEN cpu_gen) {
     return cpu_gen != CPU_GEN_SANDYBRIDGE;
 }
 
-RGY_ERR CQSVPipeline::InitOpenCL(const bool enableOpenCL, const bool checkVppPerformance) {
+RGY_ERR CQSVPipeline::InitOpenCL(const bool enableOpenCL, const bool checkVppPerformance, const tstring& programCache) {
     if (!enableOpenCL) {
         PrintMes(RGY_LOG_DEBUG, _T("OpenCL disabled.\n"));
         return RGY_ERR_NONE;
@@ -1416,6 +1420,12 @@ RGY_ERR CQSVPipeline::InitOpenCL(const bool enableOpenCL, const bool checkVppPer
         m_cl.reset();
         return RGY_ERR_NONE;
     }
+    if (programCache != RGY_CL_PROGRAM_CACHE_OFF) {
+        const auto cacheDir = (programCache.length() > 0) ? programCache : RGYOpenCLProgramCache::defaultDir();
+        if (cacheDir.length() > 0) {
+            m_cl->setProgramCache(std::make_shared<RGYOpenCLProgramCache>(cacheDir));
+        }
+    }
     return RGY_ERR_NONE;
 }
 
@@ -1435,7 +1445,11 @@ RGY_ERR CQSVPipeline::AllocFrames() {
 
     PrintMes(RGY_LOG_DEBUG, _T("allocFrames: m_nAsyncDepth - %d frames\n"), m_nAsyncDepth);
 
+    // --thread-pipeline使用時は、ステージ間のキューに滞留する分のフレームも確保する
+    const auto stages = pipelineStages();
+
     PipelineTask *t0 = m_pipelineTasks[0].get();
+    size_t it0 = 0;
     for (size_t ip = 1; ip < m_pipelineTasks.size(); ip++) {
         if (t0->isPassThrough()) {
             PrintMes(RGY_LOG_ERROR, _T("allocFrames: t0 cannot be path through task!\n"));
@@ -1492,16 +1506,25 @@ RGY_ERR CQSVPipeline::AllocFrames() {
             PrintMes(RGY_LOG_ERROR, _T("AllocFrames: invalid pipeline: cannot get request from either t0 or t1!\n"));
             return RGY_ERR_UNSUPPORTED;
         }
-        const int requestNumFrames = std::max(1, t0RequestNumFrame + t1RequestNumFrame + m_nAsyncDepth + 1);
+        int stageQueueFrames = 0;
+        for (const auto& stage : stages) {
+            if (it0 < stage.first && stage.first <= ip) { // t0とt1の間がステージの境界となっている
+                stageQueueFrames = pipelineStageQueueSize(m_pipelineTasks[stage.first - 1].get());
+            }
+        }
+        const int requestNumFrames = std::max(1, t0RequestNumFrame + t1RequestNumFrame + m_nAsyncDepth + 1 + stageQueueFrames);
         if (allocateOpenCLFrame) { // OpenCLフレームを介してやり取りする場合
             const RGYFrameInfo frame(allocRequest.Info.CropW, allocRequest.Info.CropH,
                 csp_enc_to_rgy(allocRequest.Info.FourCC),
                 (allocRequest.Info.BitDepthLuma > 0) ? allocRequest.Info.BitDepthLuma : 8,
                 picstruct_enc_to_rgy(allocRequest.Info.PicStruct));
+            // --surface-pool-auto では、async depthとステージ間のキューの分は確保せずに始め、待ちが発生した場合に追加する
+            const int allocNumFrames = (m_surfacePoolAuto) ? std::max(2, t0RequestNumFrame + t1RequestNumFrame + 1) : requestNumFrames;
+            const int allocNumFramesMax = (m_surfacePoolAuto) ? requestNumFrames * 2 : 0;
             PrintMes(RGY_LOG_DEBUG, _T("AllocFrames: %s-%s, type: CL, %s %dx%d, request %d frames\n"),
                 t0->print().c_str(), t1->print().c_str(), RGY_CSP_NAMES[frame.csp],
-                frame.width, frame.height, requestNumFrames);
-            auto sts = t0->workSurfacesAllocCL(requestNumFrames, frame, m_cl.get());
+                frame.width, frame.height, allocNumFrames);
+            auto sts = t0->workSurfacesAllocCL(allocNumFrames, frame, m_cl.get(), allocNumFramesMax);
             if (sts != RGY_ERR_NONE) {
                 PrintMes(RGY_LOG_ERROR, _T("AllocFrames:   Failed to allocate frames for %s-%s: %s."), t0->print().c_str(), t1->print().c_str(), get_err_mes(sts));
                 return sts;
@@ -1539,6 +1562,7 @@ RGY_ERR CQSVPipeline::AllocFrames() {
             }
         }
         t0 = t1;
+        it0 = ip;
     }
     return RGY_ERR_NONE;
 }
@@ -1596,6 +1620,9 @@ CQSVPipeline::CQSVPipeline() :
     m_encTimestamp(),
     m_sessionParams(),
     m_nProcSpeedLimit(0),
+    m_threadPipeline(0),
+    m_threadParamPipeline(),
+    m_surfacePoolAuto(false),
     m_pAbortByUser(nullptr),
     m_heAbort(),
     m_DecInputBitstream(),
@@ -2184,7 +2211,7 @@ std::pair<RGY_ERR, std::unique_ptr<QSVVppMfx>> CQSVPipeline::AddFilterMFX(
 
     mfxIMPL impl;
     m_device->mfxSession().QueryIMPL(&impl);
-    auto mfxvpp = std::make_unique<QSVVppMfx>(m_device->hwdev(), m_device->allocator(), m_mfxVer, impl, m_device->memType(), m_sessionParams, m_device->deviceNum(), m_nAsyncDepth, m_pQSVLog);
+    auto mfxvpp = std::make_unique<QSVVppMfx>(m_device->hwdev(), m_device->allocator(), m_mfxVer, impl, m_device->memType(), m_sessionParams, m_device->deviceNum(), m_device->getVppFeature(), m_nAsyncDepth, m_pQSVLog);
     auto err = mfxvpp->SetParam(vppParams, frameInfo, frameIn, (vppType == VppType::MFX_CROP) ? crop : nullptr,
         fps, rgy_rational<int>(1,1), blockSize);
     if (err != RGY_ERR_NONE) {
@@ -3257,6 +3284,11 @@ RGY_ERR CQSVPipeline::InitPowerThrottoling(sInputParams *pParams) {
 RGY_ERR CQSVPipeline::InitLog(sInputParams *pParams) {
     //ログの初期化
     m_pQSVLog.reset(new RGYLog(pParams->ctrl.logfile.c_str(), pParams->ctrl.loglevel, pParams->ctrl.logAddTime));
+    if (pParams->ctrl.logAsync || pParams->ctrl.logJsonFile.length() > 0) {
+        if (!m_pQSVLog->startAsync(pParams->ctrl.logAsyncDrop, pParams->ctrl.logJsonFile)) {
+            return RGY_ERR_FILE_OPEN;
+        }
+    }
     if ((pParams->ctrl.logfile.length() > 0 || pParams->common.outputFilename.length() > 0) && pParams->input.type != RGY_INPUT_FMT_SM) {
         m_pQSVLog->writeFileHeader(pParams->common.outputFilename.c_str());
     }
@@ -3285,13 +3317,15 @@ RGY_ERR CQSVPipeline::InitPerfMonitor(const sInputParams *inputParam) {
     return RGY_ERR_NONE;
 }
 
-RGY_ERR CQSVPipeline::SetPerfMonitorThreadHandles() {
-#if ENABLE_AVSW_READER
+RGY_ERR CQSVPipeline::SetPerfMonitorThreadHandles(HANDLE thEncode) {
     if (m_pPerfMonitor) {
         HANDLE thOutput = NULL;
         HANDLE thInput = NULL;
+        //音声処理・音声エンコードはスレッドプールで共有しており、処理ごとのスレッドがないので渡さない
+        //(タスクごとの処理時間はPerfQueueInfo::aud_track_proc_usに記録される)
         HANDLE thAudProc = NULL;
         HANDLE thAudEnc = NULL;
+#if ENABLE_AVSW_READER
         auto pAVCodecReader = std::dynamic_pointer_cast<RGYInputAvcodec>(m_pFileReader);
         if (pAVCodecReader != nullptr) {
             thInput = pAVCodecReader->getThreadHandleInput();
@@ -3299,12 +3333,11 @@ RGY_ERR CQSVPipeline::SetPerfMonitorThreadHandles() {
         auto pAVCodecWriter = std::dynamic_pointer_cast<RGYOutputAvcodec>(m_pFileWriter);
         if (pAVCodecWriter != nullptr) {
             thOutput = pAVCodecWriter->getThreadHandleOutput();
-            thAudProc = pAVCodecWriter->getThreadHandleAudProcess();
-            thAudEnc = pAVCodecWriter->getThreadHandleAudEncode();
         }
-        m_pPerfMonitor->SetThreadHandles((HANDLE)NULL, thInput, thOutput, thAudProc, thAudEnc);
-    }
 #endif //#if ENABLE_AVSW_READER
+        //--thread-pipeline使用時は、エンコーダを含むステージのスレッドをエンコードスレッドとして渡す
+        m_pPerfMonitor->SetThreadHandles(thEncode, thInput, thOutput, thAudProc, thAudEnc);
+    }
     return RGY_ERR_NONE;
 }
 
@@ -3313,9 +3346,17 @@ RGY_ERR CQSVPipeline::Init(sInputParams *pParams) {
         return RGY_ERR_NULL_PTR;
     }
 
-    InitLog(pParams);
+    RGY_ERR sts = InitLog(pParams);
+    if (sts != RGY_ERR_NONE) {
+        return sts;
+    }
 
-    RGY_ERR sts = RGY_ERR_NONE;
+    if (pParams->ctrl.traceFile.length() > 0) {
+        // 読み込みスレッド等の起動前に有効にしておく
+        RGYTrace::get().init(pParams->ctrl.traceFile);
+        RGYTrace::get().setThreadName(_T("main"));
+        PrintMes(RGY_LOG_DEBUG, _T("Enabled pipeline trace: %s.\n"), pParams->ctrl.traceFile.c_str());
+    }
 
     pParams->applyDOVIProfile();
 
@@ -3360,7 +3401,7 @@ RGY_ERR CQSVPipeline::Init(sInputParams *pParams) {
     m_sessionParams.deviceCopy = pParams->gpuCopy;
     m_nAVSyncMode = pParams->common.AVSyncMode;
 
-    auto deviceList = getDeviceList(pParams->device, pParams->ctrl.enableOpenCL, pParams->memType, m_sessionParams, m_pQSVLog);
+    auto deviceList = getDeviceList(pParams->device, pParams->ctrl.enableOpenCL, pParams->memType, m_sessionParams, pParams->featureCache, m_pQSVLog);
     if (deviceList.size() == 0) {
         PrintMes(RGY_LOG_DEBUG, _T("No device found for QSV encoding!\n"));
         return RGY_ERR_DEVICE_NOT_FOUND;
@@ -3374,7 +3415,7 @@ RGY_ERR CQSVPipeline::Init(sInputParams *pParams) {
     RGY_ERR(sts, _T("Failed to initialize encode session."));
     PrintMes(RGY_LOG_DEBUG, _T("InitSession: Success.\n"));
 
-    sts = InitOpenCL(pParams->ctrl.enableOpenCL, pParams->vpp.checkPerformance);
+    sts = InitOpenCL(pParams->ctrl.enableOpenCL, pParams->vpp.checkPerformance, pParams->ctrl.clProgramCache);
     if (sts < RGY_ERR_NONE) return sts;
 
     sts = CheckParam(pParams);
@@ -3407,6 +3448,9 @@ RGY_ERR CQSVPipeline::Init(sInputParams *pParams) {
     if (sts < RGY_ERR_NONE) return sts;
 
     m_nProcSpeedLimit = pParams->ctrl.procSpeedLimit;
+    m_threadPipeline = pParams->threadPipeline;
+    m_threadParamPipeline = pParams->ctrl.threadParams.get(RGYThreadType::MAIN); // ステージスレッドはメインスレッドの処理を分担するので、同じ設定とする
+    m_surfacePoolAuto = pParams->surfacePoolAuto;
     m_nAsyncDepth = clamp_param_int((pParams->ctrl.lowLatency) ? 1 : pParams->nAsyncDepth, 0, QSV_ASYNC_DEPTH_MAX, _T("async-depth"));
     if (m_nAsyncDepth == 0) {
         m_nAsyncDepth = QSV_DEFAULT_ASYNC_DEPTH;
@@ -3542,6 +3586,15 @@ void CQSVPipeline::Close() {
 
     m_timecode.reset();
 
+    if (RGYTrace::enabled()) {
+        // 各スレッドの終了後に出力する
+        const auto traceFile = RGYTrace::get().filename();
+        PrintMes(RGY_LOG_DEBUG, _T("Writing pipeline trace: %s...\n"), traceFile.c_str());
+        if (RGYTrace::get().close() != RGY_ERR_NONE) {
+            PrintMes(RGY_LOG_ERROR, _T("Failed to write pipeline trace: %s.\n"), traceFile.c_str());
+        }
+    }
+
     PrintMes(RGY_LOG_DEBUG, _T("Closing perf monitor...\n"));
     m_pPerfMonitor.reset();
 
@@ -3556,6 +3609,8 @@ void CQSVPipeline::Close() {
     m_pAbortByUser = nullptr;
     m_nAVSyncMode = RGY_AVSYNC_ASSUME_CFR;
     m_nProcSpeedLimit = 0;
+    m_threadPipeline = 0;
+    m_surfacePoolAuto = false;
 #if ENABLE_AVSW_READER
     av_qsv_log_free();
 #endif //#if ENABLE_AVSW_READER
@@ -3845,23 +3900,7 @@ RGY_ERR CQSVPipeline::RunEncode2() {
     CProcSpeedControl speedCtrl(m_nProcSpeedLimit);
 
     auto requireSync = [this](const size_t itask) {
-        if (itask + 1 >= m_pipelineTasks.size()) return true; // 次が最後のタスクの時
-
-        size_t srctask = itask;
-        if (m_pipelineTasks[srctask]->isPassThrough()) {
-            for (size_t prevtask = srctask-1; prevtask >= 0; prevtask--) {
-                if (!m_pipelineTasks[prevtask]->isPassThrough()) {
-                    srctask = prevtask;
-                    break;
-                }
-            }
-        }
-        for (size_t nexttask = itask+1; nexttask < m_pipelineTasks.size(); nexttask++) {
-            if (!m_pipelineTasks[nexttask]->isPassThrough()) {
-                return m_pipelineTasks[srctask]->requireSync(m_pipelineTasks[nexttask]->taskType());
-            }
-        }
-        return true;
+        return pipelineTaskRequireSync(itask);
     };
     auto time_prev = std::chrono::high_resolution_clock::now();
 
@@ -3871,14 +3910,11 @@ RGY_ERR CQSVPipeline::RunEncode2() {
         if (err > RGY_ERR_NONE) return RGY_LOG_WARN;
         return RGY_LOG_ERROR;
     };
-    struct PipelineTaskData {
-        size_t task;
-        std::unique_ptr<PipelineTaskOutput> data;
-        PipelineTaskData(size_t t) : task(t), data() {};
-        PipelineTaskData(size_t t, std::unique_ptr<PipelineTaskOutput>& d) : task(t), data(std::move(d)) {};
-    };
     std::deque<PipelineTaskData> dataqueue;
-    {
+    const bool runStageThreads = pipelineStages().size() > 1;
+    if (runStageThreads) { // 各ステージを別スレッドで処理 (flushも各ステージで実施)
+        err = RunEncode2Stages(checkAbort, requireSync, speedCtrl);
+    } else {
         auto checkContinue = [&checkAbort](RGY_ERR& err) {
             if (checkAbort() || stdInAbort()) { err = RGY_ERR_ABORTED; return false; }
             return err >= RGY_ERR_NONE || err == RGY_ERR_MORE_DATA || err == RGY_ERR_MORE_SURFACE;
@@ -3894,13 +3930,13 @@ RGY_ERR CQSVPipeline::RunEncode2() {
                 if (d.task < m_pipelineTasks.size()) {
                     err = RGY_ERR_NONE;
                     auto& task = m_pipelineTasks[d.task];
-                    err = task->sendFrame(d.data);
+                    err = task->sendFrameTrace(d.data);
                     if (!checkContinue(err)) {
                         PrintMes(setloglevel(err), _T("Break in task %s: %s.\n"), task->print().c_str(), get_err_mes(err));
                         break;
                     }
                     if (err == RGY_ERR_NONE) {
-                        auto output = task->getOutput(requireSync(d.task));
+                        auto output = task->getOutputTrace(requireSync(d.task));
                         if (output.size() == 0) break;
                         //出てきたものは先頭に追加していく
                         std::for_each(output.rbegin(), output.rend(), [itask = d.task, &dataqueue](auto&& o) {
@@ -3908,6 +3944,7 @@ RGY_ERR CQSVPipeline::RunEncode2() {
                         });
                     }
                 } else { // pipelineの最終的なデータを出力
+                    RGYTraceScope trace(RGYTraceCat::OUTPUT, _T("write"));
                     if ((err = d.data->write(m_pFileWriter.get(), m_device->allocator(), (m_cl) ? &m_cl->queue() : nullptr, m_videoQualityMetric.get())) != RGY_ERR_NONE) {
                         PrintMes(RGY_LOG_ERROR, _T("failed to write output: %s.\n"), get_err_mes(err));
                         break;
@@ -3918,7 +3955,7 @@ RGY_ERR CQSVPipeline::RunEncode2() {
                 // taskを前方からひとつづつ出力が残っていないかチェック(主にcheckptsの処理のため)
                 for (size_t itask = 0; itask < m_pipelineTasks.size(); itask++) {
                     auto& task = m_pipelineTasks[itask];
-                    auto output = task->getOutput(requireSync(itask));
+                    auto output = task->getOutputTrace(requireSync(itask));
                     if (output.size() > 0) {
                         //出てきたものは先頭に追加していく
                         std::for_each(output.rbegin(), output.rend(), [itask, &dataqueue](auto&& o) {
@@ -3932,7 +3969,7 @@ RGY_ERR CQSVPipeline::RunEncode2() {
         }
     }
     // flush
-    if (err == RGY_ERR_MORE_BITSTREAM) { // 読み込みの完了を示すフラグ
+    if (err == RGY_ERR_MORE_BITSTREAM && !runStageThreads) { // 読み込みの完了を示すフラグ
         err = RGY_ERR_NONE;
         for (auto& task : m_pipelineTasks) {
             task->setOutputMaxQueueSize(0); //flushのため
@@ -3952,12 +3989,12 @@ RGY_ERR CQSVPipeline::RunEncode2() {
                 if (d.task < m_pipelineTasks.size()) {
                     err = RGY_ERR_NONE;
                     auto& task = m_pipelineTasks[d.task];
-                    err = task->sendFrame(d.data);
+                    err = task->sendFrameTrace(d.data);
                     if (!checkContinue(err)) {
                         if (d.task == flushedTaskSend) flushedTaskSend++;
                         break;
                     }
-                    auto output = task->getOutput(requireSync(d.task));
+                    auto output = task->getOutputTrace(requireSync(d.task));
                     if (output.size() == 0) break;
                     //出てきたものは先頭に追加していく
                     std::for_each(output.rbegin(), output.rend(), [itask = d.task, &dataqueue](auto&& o) {
@@ -3965,6 +4002,7 @@ RGY_ERR CQSVPipeline::RunEncode2() {
                     });
                     RGY_IGNORE_STS(err, RGY_ERR_MORE_DATA); //VPPなどでsendFrameがRGY_ERR_MORE_DATAだったが、フレームが出てくる場合がある
                 } else { // pipelineの最終的なデータを出力
+                    RGYTraceScope trace(RGYTraceCat::OUTPUT, _T("write"));
                     if ((err = d.data->write(m_pFileWriter.get(), m_device->allocator(), (m_cl) ? &m_cl->queue() : nullptr, m_videoQualityMetric.get())) != RGY_ERR_NONE) {
                         PrintMes(RGY_LOG_ERROR, _T("failed to write output: %s.\n"), get_err_mes(err));
                         break;
@@ -3975,7 +4013,7 @@ RGY_ERR CQSVPipeline::RunEncode2() {
                 // taskを前方からひとつづつ出力が残っていないかチェック(主にcheckptsの処理のため)
                 for (size_t itask = flushedTaskGet; itask < m_pipelineTasks.size(); itask++) {
                     auto& task = m_pipelineTasks[itask];
-                    auto output = task->getOutput(requireSync(itask));
+                    auto output = task->getOutputTrace(requireSync(itask));
                     if (output.size() > 0) {
                         //出てきたものは先頭に追加していく
                         std::for_each(output.rbegin(), output.rend(), [itask, &dataqueue](auto&& o) {
@@ -4019,7 +4057,11 @@ RGY_ERR CQSVPipeline::RunEncode2() {
     PrintMes(RGY_LOG_DEBUG, _T("Clear pipeline tasks and allocated frames...\n"));
     m_pipelineTasks.clear();
     PrintMes(RGY_LOG_DEBUG, _T("Waiting for writer to finish...\n"));
-    m_pFileWriter->WaitFin();
+    auto errWriter = m_pFileWriter->WaitFin();
+    if (errWriter != RGY_ERR_NONE) {
+        PrintMes(RGY_LOG_ERROR, _T("Error in writer: %s.\n"), get_err_mes(errWriter));
+        err = errWriter;
+    }
     PrintMes(RGY_LOG_DEBUG, _T("Write results...\n"));
     if (m_videoQualityMetric) {
         PrintMes(RGY_LOG_DEBUG, _T("Write video quality metric results...\n"));
@@ -4043,6 +4085,283 @@ RGY_ERR CQSVPipeline::RunEncode2() {
     return (err == RGY_ERR_NONE || err == RGY_ERR_MORE_DATA || err == RGY_ERR_MORE_SURFACE || err == RGY_ERR_MORE_BITSTREAM || err > RGY_ERR_NONE) ? RGY_ERR_NONE : err;
 }
 
+bool CQSVPipeline::pipelineTaskRequireSync(const size_t itask) const {
+    if (itask + 1 >= m_pipelineTasks.size()) return true; // 次が最後のタスクの時
+
+    size_t srctask = itask;
+    if (m_pipelineTasks[srctask]->isPassThrough()) {
+        for (size_t prevtask = srctask-1; prevtask >= 0; prevtask--) {
+            if (!m_pipelineTasks[prevtask]->isPassThrough()) {
+                srctask = prevtask;
+                break;
+            }
+        }
+    }
+    for (size_t nexttask = itask+1; nexttask < m_pipelineTasks.size(); nexttask++) {
+        if (!m_pipelineTasks[nexttask]->isPassThrough()) {
+            return m_pipelineTasks[srctask]->requireSync(m_pipelineTasks[nexttask]->taskType());
+        }
+    }
+    return true;
+}
+
+// --thread-pipeline 使用時に、m_pipelineTasksをスレッドごとのステージ [begin, end) に分割する
+//  - 入力(デコード)～CheckPTSまでは入力側(m_pFileReader)とやり取りするため、同じステージで処理する
+//  - それ以降は、requireSyncの必要な箇所(mfxとそれ以外のタスクの境界)でステージを分割する
+//    ステージの境界では前段でwaitsyncを行ってから後段に渡すことになり、同期待ちが後段の処理を止めなくなる
+// --thread-pipeline を使用しない場合は、全体が1つのステージとなる
+std::vector<std::pair<size_t, size_t>> CQSVPipeline::pipelineStages() const {
+    std::vector<std::pair<size_t, size_t>> stages;
+    size_t stageBegin = 0;
+    if (m_threadPipeline > 0) {
+        bool readerStage = true;
+        for (size_t itask = 0; itask + 1 < m_pipelineTasks.size(); itask++) {
+            bool split = false;
+            if (readerStage) {
+                if (m_pipelineTasks[itask]->taskType() == PipelineTaskType::CHECKPTS) {
+                    readerStage = false;
+                    split = true;
+                }
+            } else if (!m_pipelineTasks[itask + 1]->isPassThrough()) {
+                split = pipelineTaskRequireSync(itask);
+            }
+            if (split) {
+                stages.push_back(std::make_pair(stageBegin, itask + 1));
+                stageBegin = itask + 1;
+            }
+        }
+    }
+    stages.push_back(std::make_pair(stageBegin, m_pipelineTasks.size()));
+    return stages;
+}
+
+RGY_ERR CQSVPipeline::RunEncode2Stages(std::function<bool()> checkAbort, std::function<bool(size_t)> requireSync, CProcSpeedControl& speedCtrl) {
+    const auto stages = pipelineStages();
+    // stageQueues[i] は i番目のステージへの入力 (0番目のステージは入力を自ら読み込むので使用しない)
+    std::vector<std::unique_ptr<PipelineStageQueue>> stageQueues(stages.size());
+    for (size_t istage = 0; istage < stages.size(); istage++) {
+        if (istage > 0) {
+            stageQueues[istage] = std::make_unique<PipelineStageQueue>(pipelineStageQueueSize(m_pipelineTasks[stages[istage].first - 1].get()));
+        }
+        tstring tasks;
+        for (size_t itask = stages[istage].first; itask < stages[istage].second; itask++) {
+            tasks += ((tasks.length() > 0) ? _T(", ") : _T("")) + m_pipelineTasks[itask]->print();
+        }
+        PrintMes(RGY_LOG_DEBUG, _T("RunEncode2Stages: stage %d: %s, queue %d.\n"), (int)istage, tasks.c_str(), (stageQueues[istage]) ? (int)stageQueues[istage]->capacity() : 0);
+    }
+    auto setloglevel = [](RGY_ERR err) {
+        if (err == RGY_ERR_NONE || err == RGY_ERR_MORE_DATA || err == RGY_ERR_MORE_SURFACE || err == RGY_ERR_MORE_BITSTREAM) return RGY_LOG_DEBUG;
+        if (err > RGY_ERR_NONE) return RGY_LOG_WARN;
+        return RGY_LOG_ERROR;
+    };
+    auto isStageError = [](const RGY_ERR err) {
+        return err < RGY_ERR_NONE && err != RGY_ERR_MORE_DATA && err != RGY_ERR_MORE_SURFACE && err != RGY_ERR_MORE_BITSTREAM;
+    };
+    // いずれかのステージでエラーが発生したら、すべてのキューを中断して他のステージを終了させる
+    auto abortStages = [&stageQueues]() {
+        for (auto& q : stageQueues) {
+            if (q) q->abort();
+        }
+    };
+    // 音声の書き出し(ステージ0のPipelineTaskAudio)と映像の書き出し(最終ステージ)は別スレッドとなる
+    // 出力スレッドを使用しない場合(--output-thread 0)はどちらもwriterの内部処理を直接呼ぶので、writerへのアクセスを排他する
+    std::mutex writerMutex;
+    auto sendFrameToTask = [&writerMutex](PipelineTask *task, std::unique_ptr<PipelineTaskOutput>& data) {
+        std::unique_lock<std::mutex> lock(writerMutex, std::defer_lock);
+        if (task->taskType() == PipelineTaskType::AUDIO) {
+            lock.lock();
+        }
+        return task->sendFrameTrace(data);
+    };
+
+    auto runStage = [&](const size_t istage) {
+        const size_t taskBegin = stages[istage].first;
+        const size_t taskEnd = stages[istage].second;
+        PipelineStageQueue *queueIn = stageQueues[istage].get();
+        RGYTrace::get().setThreadName(strsprintf(_T("stage %d"), (int)istage).c_str());
+        PipelineStageQueue *queueOut = (istage + 1 < stages.size()) ? stageQueues[istage + 1].get() : nullptr;
+        std::deque<PipelineTaskData> dataqueue;
+        // ステージの最後のタスクの出力は後段のステージに渡す (最終ステージなら出力する)
+        auto sendNextStage = [&](PipelineTaskData& d) {
+            if (queueOut) {
+                RGYTraceScope trace(RGYTraceCat::WAIT, _T("stage queue"), _T("push"));
+                return queueOut->push(std::move(d)) ? RGY_ERR_NONE : RGY_ERR_ABORTED;
+            }
+            RGYTraceScope trace(RGYTraceCat::OUTPUT, _T("write"));
+            std::lock_guard<std::mutex> lock(writerMutex);
+            auto err = d.data->write(m_pFileWriter.get(), m_device->allocator(), (m_cl) ? &m_cl->queue() : nullptr, m_videoQualityMetric.get());
+            if (err != RGY_ERR_NONE) {
+                PrintMes(RGY_LOG_ERROR, _T("failed to write output: %s.\n"), get_err_mes(err));
+            }
+            return err;
+        };
+        //出てきたものは先頭に追加していく
+        auto addOutput = [&dataqueue](const size_t itask, std::vector<std::unique_ptr<PipelineTaskOutput>>& output) {
+            std::for_each(output.rbegin(), output.rend(), [itask, &dataqueue](auto&& o) {
+                dataqueue.push_front(PipelineTaskData(itask + 1, o));
+            });
+        };
+        RGY_ERR err = RGY_ERR_NONE;
+        {
+            auto checkContinue = [&checkAbort, istage](RGY_ERR& err) {
+                if (checkAbort() || (istage == 0 && stdInAbort())) { err = RGY_ERR_ABORTED; return false; }
+                return err >= RGY_ERR_NONE || err == RGY_ERR_MORE_DATA || err == RGY_ERR_MORE_SURFACE;
+            };
+            while (checkContinue(err)) {
+                if (dataqueue.empty()) {
+                    if (queueIn == nullptr) {
+                        speedCtrl.wait(m_pipelineTasks.front()->outputFrames());
+                        dataqueue.push_back(PipelineTaskData(taskBegin)); // デコード実行用
+                    } else {
+                        PipelineTaskData d(taskBegin);
+                        RGYTraceScope trace(RGYTraceCat::WAIT, _T("stage queue"), _T("pop"));
+                        if (!queueIn->pop(d)) {
+                            // 前段が終了した場合は、このステージのflushに移る
+                            err = (queueIn->aborted()) ? RGY_ERR_ABORTED : RGY_ERR_MORE_BITSTREAM;
+                            break;
+                        }
+                        dataqueue.push_back(std::move(d));
+                    }
+                }
+                while (!dataqueue.empty()) {
+                    auto d = std::move(dataqueue.front());
+                    dataqueue.pop_front();
+                    if (d.task < taskEnd) {
+                        err = RGY_ERR_NONE;
+                        auto& task = m_pipelineTasks[d.task];
+                        err = sendFrameToTask(task.get(), d.data);
+                        if (!checkContinue(err)) {
+                            PrintMes(setloglevel(err), _T("Break in task %s: %s.\n"), task->print().c_str(), get_err_mes(err));
+                            break;
+                        }
+                        if (err == RGY_ERR_NONE) {
+                            auto output = task->getOutputTrace(requireSync(d.task));
+                            if (output.size() == 0) break;
+                            addOutput(d.task, output);
+                        }
+                    } else if ((err = sendNextStage(d)) != RGY_ERR_NONE) {
+                        break;
+                    }
+                }
+                if (dataqueue.empty()) {
+                    // taskを前方からひとつづつ出力が残っていないかチェック(主にcheckptsの処理のため)
+                    for (size_t itask = taskBegin; itask < taskEnd; itask++) {
+                        auto output = m_pipelineTasks[itask]->getOutputTrace(requireSync(itask));
+                        if (output.size() > 0) {
+                            addOutput(itask, output);
+                            //checkptsの処理上、でてきたフレームはすぐに後続処理に渡したいのでbreak
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+        // flush
+        if (err == RGY_ERR_MORE_BITSTREAM) { // 読み込み(前段)の完了を示すフラグ
+            err = RGY_ERR_NONE;
+            for (size_t itask = taskBegin; itask < taskEnd; itask++) {
+                m_pipelineTasks[itask]->setOutputMaxQueueSize(0); //flushのため
+            }
+            auto checkContinue = [&checkAbort](RGY_ERR& err) {
+                if (checkAbort()) { err = RGY_ERR_ABORTED; return false; }
+                return err >= RGY_ERR_NONE || err == RGY_ERR_MORE_SURFACE;
+            };
+            for (size_t flushedTaskSend = taskBegin, flushedTaskGet = taskBegin; flushedTaskGet < taskEnd; ) { // taskを前方からひとつづつflushしていく
+                err = RGY_ERR_NONE;
+                if (flushedTaskSend == flushedTaskGet) {
+                    dataqueue.push_back(PipelineTaskData(flushedTaskSend)); //flush用
+                }
+                while (!dataqueue.empty() && checkContinue(err)) {
+                    auto d = std::move(dataqueue.front());
+                    dataqueue.pop_front();
+                    if (d.task < taskEnd) {
+                        err = RGY_ERR_NONE;
+                        auto& task = m_pipelineTasks[d.task];
+                        err = sendFrameToTask(task.get(), d.data);
+                        if (!checkContinue(err)) {
+                            if (d.task == flushedTaskSend) flushedTaskSend++;
+                            break;
+                        }
+                        auto output = task->getOutputTrace(requireSync(d.task));
+                        if (output.size() == 0) break;
+                        addOutput(d.task, output);
+                        RGY_IGNORE_STS(err, RGY_ERR_MORE_DATA); //VPPなどでsendFrameがRGY_ERR_MORE_DATAだったが、フレームが出てくる場合がある
+                    } else if ((err = sendNextStage(d)) != RGY_ERR_NONE) {
+                        break;
+                    }
+                }
+                if (isStageError(err)) {
+                    break;
+                }
+                if (dataqueue.empty()) {
+                    // taskを前方からひとつづつ出力が残っていないかチェック(主にcheckptsの処理のため)
+                    for (size_t itask = flushedTaskGet; itask < taskEnd; itask++) {
+                        auto output = m_pipelineTasks[itask]->getOutputTrace(requireSync(itask));
+                        if (output.size() > 0) {
+                            addOutput(itask, output);
+                            //checkptsの処理上、でてきたフレームはすぐに後続処理に渡したいのでbreak
+                            break;
+                        } else if (itask == flushedTaskGet && flushedTaskGet < flushedTaskSend) {
+                            flushedTaskGet++;
+                        }
+                    }
+                }
+            }
+        }
+        if (isStageError(err)) {
+            PrintMes(setloglevel(err), _T("RunEncode2Stages: stage %d finished with error: %s.\n"), (int)istage, get_err_mes(err));
+            abortStages();
+        } else if (queueOut) {
+            queueOut->finish(); // 後段にこのステージの終了(flush完了)を通知
+        }
+        dataqueue.clear();
+        return err;
+    };
+
+    // ステージ0は呼び出し元のスレッドで、それ以降は新たに作成したスレッドで処理する
+    std::vector<RGY_ERR> stageErr(stages.size(), RGY_ERR_NONE);
+    std::vector<std::thread> stageThreads;
+    // エンコーダを含むステージのスレッドは、perf monitorにエンコードスレッドとして登録する
+    size_t encodeStage = 0;
+    for (size_t istage = 0; istage < stages.size(); istage++) {
+        for (size_t itask = stages[istage].first; itask < stages[istage].second; itask++) {
+            if (m_pipelineTasks[itask]->taskType() == PipelineTaskType::MFXENCODE) {
+                encodeStage = istage;
+            }
+        }
+    }
+    std::vector<std::unique_ptr<void, handle_deleter>> stageThreadHandles(stages.size());
+    for (size_t istage = 1; istage < stages.size(); istage++) {
+        stageThreads.push_back(std::thread([this, &runStage, &stageErr, &stageThreadHandles, encodeStage, istage]() {
+            m_threadParamPipeline.apply(GetCurrentThread());
+            PrintMes(RGY_LOG_DEBUG, _T("Set stage %d thread param: %s.\n"), (int)istage, m_threadParamPipeline.desc().c_str());
+#if defined(_WIN32) || defined(_WIN64)
+            stageThreadHandles[istage] = std::unique_ptr<void, handle_deleter>(OpenThread(SYNCHRONIZE | THREAD_QUERY_INFORMATION, false, GetCurrentThreadId()), handle_deleter());
+#endif
+            if (istage == encodeStage) {
+                SetPerfMonitorThreadHandles(stageThreadHandles[istage].get());
+            }
+            stageErr[istage] = runStage(istage);
+        }));
+    }
+    stageErr[0] = runStage(0);
+    for (auto& th : stageThreads) {
+        th.join();
+    }
+    if (encodeStage > 0) {
+        SetPerfMonitorThreadHandles(); // stageThreadHandlesを破棄する前に登録を解除する
+    }
+    // 最初に発生したエラーを返す (中断により後段で生じたRGY_ERR_ABORTEDより、原因となったエラーを優先する)
+    RGY_ERR err = RGY_ERR_NONE;
+    for (const auto stageSts : stageErr) {
+        if (isStageError(stageSts) && (err == RGY_ERR_NONE || err == RGY_ERR_ABORTED)) {
+            err = stageSts;
+        }
+    }
+    PrintMes(RGY_LOG_DEBUG, _T("RunEncode2Stages: finished: %s.\n"), get_err_mes(err));
+    return err;
+}
+
 void CQSVPipeline::PrintMes(RGYLogLevel log_level, const TCHAR *format, ...) {
     if (m_pQSVLog.get() == nullptr) {
         if (log_level <= RGY_LOG_INFO) {
@@ -64,6 +64,7 @@
 #include <memory>
 #include <string>
 #include <iostream>
+#include <functional>
 
 struct AVChapter;
 class RGYTimecode;
@@ -120,6 +121,7 @@ public:
     shared_ptr<RGYLog> m_pQSVLog;
 
     virtual RGY_ERR RunEncode2();
+    RGY_ERR RunEncode2Stages(std::function<bool()> checkAbort, std::function<bool(size_t)> requireSync, CProcSpeedControl& speedCtrl);
     bool CompareParam(const mfxParamSet& prmA, const mfxParamSet& prmB);
 protected:
     mfxVersion m_mfxVer;
@@ -185,6 +187,9 @@ protected:
 
     MFXVideoSession2Params m_sessionParams;
     uint32_t m_nProcSpeedLimit;
+    int m_threadPipeline;
+    RGYParamThread m_threadParamPipeline;
+    bool m_surfacePoolAuto;
 
     bool *m_pAbortByUser;
     unique_ptr<std::remove_pointer<HANDLE>::type, handle_deleter> m_heAbort;
@@ -229,14 +234,16 @@ protected:
     virtual RGY_ERR readChapterFile(tstring chapfile);
 
     virtual bool CPUGenOpenCLSupported(const QSV_CPU_GEN cpu_gen);
-    virtual RGY_ERR InitOpenCL(const bool enableOpenCL, const bool checkVppPerformance);
+    virtual RGY_ERR InitOpenCL(const bool enableOpenCL, const bool checkVppPerformance, const tstring& programCache);
 
     virtual RGY_ERR AllocFrames();
 
     virtual RGY_ERR AllocateSufficientBuffer(mfxBitstream* pBS);
 
-    RGY_ERR SetPerfMonitorThreadHandles();
+    RGY_ERR SetPerfMonitorThreadHandles(HANDLE thEncode = NULL);
     RGY_ERR CreatePipeline();
+    bool pipelineTaskRequireSync(const size_t itask) const;
+    std::vector<std::pair<size_t, size_t>> pipelineStages() const;
     std::pair<RGY_ERR, std::unique_ptr<QSVVideoParam>> GetOutputVideoInfo();
 
     RGY_ERR CheckParamList(int value, const CX_DESC *list, const char *param_name);
@@ -35,6 +35,8 @@
 #include "qsv_prm.h"
 #include <deque>
 #include <set>
+#include <mutex>
+#include <condition_variable>
 #include <optional>
 #include "qsv_hw_device.h"
 #include "rgy_opencl.h"
@@ -44,12 +46,14 @@
 #include "rgy_util.h"
 #include "rgy_thread.h"
 #include "rgy_timecode.h"
+#include "rgy_trace.h"
 #include "rgy_input.h"
 #include "rgy_input_sm.h"
 #include "rgy_filter.h"
 #include "rgy_filter_ssim.h"
 #include "rgy_output.h"
 #include "rgy_output_avcodec.h"
+#include "rgy_bitstream_pool.h"
 #include "qsv_util.h"
 #include "qsv_mfx_dec.h"
 #include "qsv_vpp_mfx.h"
@@ -60,6 +64,11 @@ const uint32_t MSDK_VPP_WAIT_INTERVAL = 60000;
 const uint32_t MSDK_WAIT_INTERVAL = MSDK_DEC_WAIT_INTERVAL + 3 * MSDK_VPP_WAIT_INTERVAL + MSDK_ENC_WAIT_INTERVAL; // an estimate for the longest pipeline we have in samples
 
 const uint32_t MSDK_INVALID_SURF_IDX = 0xFFFF;
+// 空きフレームの返却を待つ時間の上限
+// 以前はMSDK_WAIT_INTERVAL回のsleep_hybrid()(ほぼyieldのみ、1msのsleepは65536回に1回)で打ち切っており、
+// 待ち時間はスケジューラ次第(おおむね数百ms～数秒)だった。
+// 空きフレームは後段の同期完了で返却されるので、エンコーダの同期待ちと同じ時間を上限とする。
+const uint32_t PIPELINE_SURF_WAIT_TIMEOUT_MS = MSDK_ENC_WAIT_INTERVAL;
 
 static void copy_crop_info(mfxFrameSurface1 *dst, const mfxFrameInfo *src) {
     if (dst != nullptr) {
@@ -92,24 +101,128 @@ enum class PipelineTaskSurfaceType {
     MFX
 };
 
+// PipelineTaskSurfacesの空きフレームのインデックスを管理するロックフリーのスタック
+// 登録(push)は参照を解放した任意のスレッドから行われるが、取り出し(pop)はタスクを処理するスレッドからのみ行う
+class PipelineTaskSurfaceFreeList {
+public:
+    static const uint32_t INVALID_IDX = std::numeric_limits<uint32_t>::max();
+private:
+    std::unique_ptr<std::atomic<uint32_t>[]> m_next; // 各インデックスの次の要素
+    uint32_t m_capacity;
+    std::atomic<uint64_t> m_head;  // 上位32bit: ABA対策のタグ, 下位32bit: 先頭のインデックス
+    std::atomic<int> m_count;      // 登録されているインデックスの数
+    std::atomic<int> m_waiting;    // wait()で待機中のスレッドの数
+    std::mutex m_mtx;
+    std::condition_variable m_cv;
+public:
+    PipelineTaskSurfaceFreeList() : m_next(), m_capacity(0), m_head(INVALID_IDX), m_count(0), m_waiting(0), m_mtx(), m_cv() {};
+    ~PipelineTaskSurfaceFreeList() {};
+    void init(uint32_t capacity) {
+        m_next = std::make_unique<std::atomic<uint32_t>[]>(capacity);
+        for (uint32_t i = 0; i < capacity; i++) {
+            m_next[i] = INVALID_IDX;
+        }
+        m_capacity = capacity;
+        m_head = INVALID_IDX;
+        m_count = 0;
+    }
+    uint32_t capacity() const { return m_capacity; }
+    int count() const { return m_count.load(std::memory_order_relaxed); }
+    bool empty() const { return (uint32_t)m_head.load(std::memory_order_acquire) == INVALID_IDX; }
+    void push(uint32_t idx) {
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        uint64_t next = 0;
+        do {
+            m_next[idx].store((uint32_t)head, std::memory_order_relaxed);
+            next = ((((head >> 32) + 1) & 0xffffffffu) << 32) | idx;
+        } while (!m_head.compare_exchange_weak(head, next));
+        m_count++;
+        // 待機中のスレッドがある場合のみ起こす
+        if (m_waiting > 0) {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_cv.notify_one();
+        }
+    }
+    uint32_t pop() {
+        uint64_t head = m_head.load(std::memory_order_acquire);
+        for (;;) {
+            const uint32_t idx = (uint32_t)head;
+            if (idx == INVALID_IDX) {
+                return INVALID_IDX;
+            }
+            const uint64_t next = ((((head >> 32) + 1) & 0xffffffffu) << 32) | m_next[idx].load(std::memory_order_relaxed);
+            if (m_head.compare_exchange_weak(head, next, std::memory_order_acquire, std::memory_order_acquire)) {
+                m_count--;
+                return idx;
+            }
+        }
+    }
+    // 空きフレームが登録されるか、timeoutを経過するまで待機する
+    void wait(std::chrono::microseconds timeout) {
+        m_waiting++;
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            m_cv.wait_for(lock, timeout, [this]() { return !empty(); });
+        }
+        m_waiting--;
+    }
+};
+
+// アプリ側の参照カウンタ
+// 参照がなくなった時点で、フレームのインデックスを空きリストに登録する
+class PipelineTaskSurfaceRef {
+private:
+    std::atomic<int> m_ref;
+    std::atomic<bool> m_listed; // 空きリスト(または取り出し後のロック解除待ち)に登録済みか
+    uint32_t m_idx;
+    PipelineTaskSurfaceFreeList *m_freeList;
+public:
+    PipelineTaskSurfaceRef(uint32_t idx, PipelineTaskSurfaceFreeList *freeList) : m_ref(0), m_listed(false), m_idx(idx), m_freeList(freeList) {};
+    int count() const { return m_ref; }
+    uint32_t idx() const { return m_idx; }
+    void addRef() { m_ref++; }
+    void release() {
+        if (--m_ref == 0) {
+            relist();
+        }
+    }
+    // 空きリストに未登録なら登録する (登録済みの場合は何もしない)
+    bool relist() {
+        bool expected = false;
+        if (m_listed.compare_exchange_strong(expected, true)) {
+            m_freeList->push(m_idx);
+            return true;
+        }
+        return false;
+    }
+    // 空きリストから取り出したフレームについて、リストへの登録状態を解除する
+    void unlist() { m_listed = false; }
+    // unlist()後に参照が解放されていた場合に、再度登録状態に戻す (push自体は呼び出し側で管理する)
+    bool tryKeepListed() {
+        bool expected = false;
+        return m_ref == 0 && m_listed.compare_exchange_strong(expected, true);
+    }
+};
+
 class PipelineTaskSurface {
 private:
     RGYFrame *surf;
-    std::atomic<int> *ref;
+    PipelineTaskSurfaceRef *ref;
 public:
     PipelineTaskSurface() : surf(nullptr), ref(nullptr) {};
-    PipelineTaskSurface(RGYFrame *surf_, std::atomic<int> *ref_) : surf(surf_), ref(ref_) { if (surf) (*ref)++; };
-    PipelineTaskSurface(const PipelineTaskSurface& obj) : surf(obj.surf), ref(obj.ref) { if (surf) (*ref)++; }
+    PipelineTaskSurface(RGYFrame *surf_, PipelineTaskSurfaceRef *ref_) : surf(surf_), ref(ref_) { if (surf) ref->addRef(); };
+    PipelineTaskSurface(const PipelineTaskSurface& obj) : surf(obj.surf), ref(obj.ref) { if (surf) ref->addRef(); }
     PipelineTaskSurface &operator=(const PipelineTaskSurface &obj) {
         if (this != &obj) { // 自身の代入チェック
+            if (obj.surf) obj.ref->addRef(); // 先に加算しておき、同じフレームの場合に空きリストに登録されないようにする
+            reset();
             surf = obj.surf;
             ref = obj.ref;
-            if (surf) (*ref)++;
         }
         return *this;
     }
     ~PipelineTaskSurface() { reset(); }
-    void reset() { if (surf) (*ref)--; surf = nullptr; ref = nullptr; }
+    void reset() { if (surf) ref->release(); surf = nullptr; ref = nullptr; }
     bool operator !() const {
         return frame() == nullptr;
     }
@@ -126,27 +239,33 @@ public:
 };
 
 // アプリ用の独自参照カウンタと組み合わせたクラス
+// 空きフレームはPipelineTaskSurfaceFreeListで管理し、参照の解放時に登録されたものから取り出す
 class PipelineTaskSurfaces {
 private:
     class PipelineTaskSurfacesPair {
     private:
         std::unique_ptr<RGYFrame> surf_;
-        std::atomic<int> ref;
+        PipelineTaskSurfaceRef ref_;
     public:
-        PipelineTaskSurfacesPair(std::unique_ptr<RGYFrame> s) : surf_(std::move(s)), ref(0) {};
+        PipelineTaskSurfacesPair(uint32_t idx, PipelineTaskSurfaceFreeList *freeList) : surf_(), ref_(idx, freeList) {};
 
         // 使用されていないフレームかを返す
         // mfxの参照カウンタと独自参照カウンタの両方をチェック
         bool isFree() const {
-            if (ref != 0) return false;
+            if (ref_.count() != 0) return false;
+            return !mfxLocked();
+        }
+        bool mfxLocked() const {
             if (auto mfxsurf = dynamic_cast<const RGYFrameMFXSurf*>(surf_.get()); mfxsurf != nullptr) {
-                return mfxsurf->locked() == 0;
+                return mfxsurf->locked() != 0;
             }
-            return true;
+            return false;
         }
-        PipelineTaskSurface getRef() { return PipelineTaskSurface(surf_.get(), &ref); };
+        PipelineTaskSurface getRef() { return PipelineTaskSurface(surf_.get(), &ref_); };
+        PipelineTaskSurfaceRef *ref() { return &ref_; }
         const RGYFrame *surf() const { return surf_.get(); }
         RGYFrame *surf() { return surf_.get(); }
+        void setSurf(std::unique_ptr<RGYFrame> s) { surf_ = std::move(s); }
         PipelineTaskSurfaceType type() const {
             if (!surf_) return PipelineTaskSurfaceType::UNKNOWN;
             if (dynamic_cast<const RGYCLFrame*>(surf_.get())) return PipelineTaskSurfaceType::CL;
@@ -154,36 +273,131 @@ private:
             return PipelineTaskSurfaceType::UNKNOWN;
         }
     };
-    std::vector<std::unique_ptr<PipelineTaskSurfacesPair>> m_surfaces; // フレームと参照カウンタ
+    std::vector<std::unique_ptr<PipelineTaskSurfacesPair>> m_surfaces; // フレームと参照カウンタ (未使用のスロットはフレームがnullptr)
+    PipelineTaskSurfaceFreeList m_freeList; // 空きフレームのインデックス
+    std::vector<uint32_t> m_pending; // 空きリストから取り出したが、mfx側でまだロックされているフレーム
+    size_t m_count; // フレームが確保されているスロットの数
+
+    void initSlots(size_t count, size_t capacity) {
+        clear();
+        capacity = std::max(count, capacity);
+        m_freeList.init((uint32_t)capacity);
+        m_surfaces.resize(capacity);
+        for (size_t i = 0; i < m_surfaces.size(); i++) {
+            m_surfaces[i] = std::make_unique<PipelineTaskSurfacesPair>((uint32_t)i, &m_freeList);
+        }
+    }
+    void addSlot(size_t idx, std::unique_ptr<RGYFrame> surf) {
+        m_surfaces[idx]->setSurf(std::move(surf));
+        m_surfaces[idx]->ref()->relist();
+        m_count++;
+    }
+    // 空きリストから取り出したフレームの状態を確認し、使用可能ならtrueを返す
+    // mfx側でロック中のものはm_pendingに移し、使用中のものは参照の解放時に再登録されるのでリストから外す
+    bool checkListed(uint32_t idx) {
+        auto s = m_surfaces[idx].get();
+        if (s->isFree()) {
+            return true;
+        }
+        if (s->ref()->count() == 0) { // mfx側でロック中
+            m_pending.push_back(idx);
+            return false;
+        }
+        s->ref()->unlist();
+        if (s->ref()->tryKeepListed()) { // unlistする間に参照が解放されていた
+            m_pending.push_back(idx);
+        }
+        return false;
+    }
+    // 空きフレームのインデックスを取り出す (なければINVALID_IDX)
+    uint32_t popFree() {
+        // mfx側のロック解除待ちのフレームを先に確認する
+        for (size_t i = 0; i < m_pending.size(); i++) {
+            const auto idx = m_pending[i];
+            auto s = m_surfaces[idx].get();
+            if (s->isFree()) {
+                m_pending.erase(m_pending.begin() + i);
+                return idx;
+            }
+            if (s->ref()->count() != 0) {
+                m_pending.erase(m_pending.begin() + i);
+                i--;
+                s->ref()->unlist();
+                if (s->ref()->tryKeepListed()) {
+                    m_pending.push_back(idx);
+                }
+            }
+        }
+        for (;;) {
+            const auto idx = m_freeList.pop();
+            if (idx == PipelineTaskSurfaceFreeList::INVALID_IDX) {
+                return idx;
+            }
+            if (checkListed(idx)) {
+                return idx;
+            }
+        }
+    }
 public:
-    PipelineTaskSurfaces() : m_surfaces() {};
+    PipelineTaskSurfaces() : m_surfaces(), m_freeList(), m_pending(), m_count(0) {};
     ~PipelineTaskSurfaces() { }
 
     void clear() {
         m_surfaces.clear();
+        m_pending.clear();
+        m_count = 0;
     }
     void setSurfaces(std::vector<mfxFrameSurface1>& surfs) {
-        clear();
-        m_surfaces.resize(surfs.size());
-        for (size_t i = 0; i < m_surfaces.size(); i++) {
-            m_surfaces[i] = std::make_unique<PipelineTaskSurfacesPair>(std::move(std::make_unique<RGYFrameMFXSurf>(surfs[i])));
+        initSlots(surfs.size(), surfs.size());
+        for (size_t i = 0; i < surfs.size(); i++) {
+            addSlot(i, std::make_unique<RGYFrameMFXSurf>(surfs[i]));
         }
     }
-    void setSurfaces(std::vector<std::unique_ptr<RGYCLFrame>>& surfs) {
-        clear();
-        m_surfaces.resize(surfs.size());
+    // capacityまではaddSurfaceで後からフレームを追加できる
+    void setSurfaces(std::vector<std::unique_ptr<RGYCLFrame>>& surfs, size_t capacity = 0) {
+        initSlots(surfs.size(), capacity);
+        for (size_t i = 0; i < surfs.size(); i++) {
+            addSlot(i, std::move(surfs[i]));
+        }
+    }
+    // 未使用のスロットにフレームを追加する
+    bool addSurface(std::unique_ptr<RGYCLFrame> surf) {
         for (size_t i = 0; i < m_surfaces.size(); i++) {
-            m_surfaces[i] = std::make_unique<PipelineTaskSurfacesPair>(std::move(surfs[i]));
+            if (m_surfaces[i]->surf() == nullptr) {
+                addSlot(i, std::move(surf));
+                return true;
+            }
         }
+        return false;
+    }
+    // 空きフレームを1つ取り出して破棄する
+    bool removeFreeSurface() {
+        const auto idx = popFree();
+        if (idx == PipelineTaskSurfaceFreeList::INVALID_IDX) {
+            return false;
+        }
+        m_surfaces[idx]->ref()->unlist();
+        m_surfaces[idx]->setSurf(nullptr);
+        m_count--;
+        return true;
     }
 
     PipelineTaskSurface getFreeSurf() {
-        for (auto& s : m_surfaces) {
-            if (s->isFree()) {
-                return s->getRef();
-            }
+        const auto idx = popFree();
+        if (idx == PipelineTaskSurfaceFreeList::INVALID_IDX) {
+            return PipelineTaskSurface();
         }
-        return PipelineTaskSurface();
+        auto s = m_surfaces[idx].get();
+        s->ref()->unlist();
+        return s->getRef();
+    }
+    // 空きフレームが返却されるか、timeoutを経過するまで待機する
+    // mfx側のロックの解除は通知されないため、ロック解除待ちのフレームがある場合は短い間隔で確認する
+    void waitFreeSurf(std::chrono::microseconds timeout) {
+        if (m_pending.size() > 0) {
+            timeout = std::min(timeout, std::chrono::microseconds(1000));
+        }
+        m_freeList.wait(timeout);
     }
     PipelineTaskSurface get(mfxFrameSurface1 *surf) {
         for (auto& s : m_surfaces) {
@@ -195,11 +409,13 @@ public:
         }
         return PipelineTaskSurface();
     }
-    size_t bufCount() const { return m_surfaces.size(); }
+    size_t bufCount() const { return m_count; }
+    size_t bufCapacity() const { return m_surfaces.size(); }
+    int freeCount() const { return m_freeList.count(); }
 
     bool isAllFree() const {
         for (const auto& s : m_surfaces) {
-            if (!s->isFree()) {
+            if (s->surf() != nullptr && !s->isFree()) {
                 return false;
             }
         }
@@ -247,6 +463,7 @@ public:
         if (m_syncpoint == nullptr) {
             return RGY_ERR_NONE;
         }
+        RGYTraceScope trace(RGYTraceCat::WAIT, _T("waitsync"));
         auto err = m_mfxSession->SyncOperation(m_syncpoint, wait);
         m_syncpoint = nullptr;
         return err_to_rgy(err);
@@ -415,11 +632,31 @@ static const int getPipelineTaskAllocPriority(PipelineTaskType type) {
     }
 }
 
+// --surface-pool-auto 使用時の、ワークフレーム数の自動調整の状態
+struct PipelineTaskSurfaceTune {
+    static constexpr int WINDOW = 256; // 縮小を判定する区間 (フレームの取得回数)
+    static constexpr std::chrono::microseconds GROW_WAIT = std::chrono::microseconds(2000); // これ以上待たされたらフレームを追加する
+
+    int numMin; // 縮小時の下限 (0なら自動調整しない)
+    int numMax; // 拡大時の上限
+    RGYFrameInfo frameInfo;
+    RGYOpenCLContext *cl;
+    int windowCount;   // 現在の区間でのフレームの取得回数
+    int windowFreeMin; // 現在の区間でのフレーム取得後の空きフレーム数の最小値
+    std::chrono::microseconds windowStall; // 現在の区間でフレームの取得を待った時間の合計
+    int growCount;
+    int shrinkCount;
+
+    PipelineTaskSurfaceTune() : numMin(0), numMax(0), frameInfo(), cl(nullptr), windowCount(0), windowFreeMin(std::numeric_limits<int>::max()), windowStall(0), growCount(0), shrinkCount(0) {};
+    bool enabled() const { return numMin > 0; }
+};
+
 class PipelineTask {
 protected:
     PipelineTaskType m_type;
     std::deque<std::unique_ptr<PipelineTaskOutput>> m_outQeueue;
     PipelineTaskSurfaces m_workSurfs;
+    PipelineTaskSurfaceTune m_workSurfsTune;
     MFXVideoSession *m_mfxSession;
     QSVAllocator *m_allocator;
     mfxFrameAllocResponse m_allocResponse;
@@ -429,9 +666,9 @@ protected:
     mfxVersion m_mfxVer;
     std::shared_ptr<RGYLog> m_log;
 public:
-    PipelineTask() : m_type(PipelineTaskType::UNKNOWN), m_outQeueue(), m_workSurfs(), m_mfxSession(nullptr), m_allocator(nullptr), m_allocResponse({ 0 }), m_inFrames(0), m_outFrames(0), m_outMaxQueueSize(0), m_mfxVer({ 0 }), m_log() {};
+    PipelineTask() : m_type(PipelineTaskType::UNKNOWN), m_outQeueue(), m_workSurfs(), m_workSurfsTune(), m_mfxSession(nullptr), m_allocator(nullptr), m_allocResponse({ 0 }), m_inFrames(0), m_outFrames(0), m_outMaxQueueSize(0), m_mfxVer({ 0 }), m_log() {};
     PipelineTask(PipelineTaskType type, int outMaxQueueSize, MFXVideoSession *mfxSession, mfxVersion mfxVer, std::shared_ptr<RGYLog> log) :
-        m_type(type), m_outQeueue(), m_workSurfs(), m_mfxSession(mfxSession), m_allocator(nullptr), m_allocResponse({ 0 }), m_inFrames(0), m_outFrames(0), m_outMaxQueueSize(outMaxQueueSize), m_mfxVer(mfxVer), m_log(log) {
+        m_type(type), m_outQeueue(), m_workSurfs(), m_workSurfsTune(), m_mfxSession(mfxSession), m_allocator(nullptr), m_allocResponse({ 0 }), m_inFrames(0), m_outFrames(0), m_outMaxQueueSize(outMaxQueueSize), m_mfxVer(mfxVer), m_log(log) {
     };
     virtual ~PipelineTask() {
         if (m_allocator) {
@@ -459,6 +696,19 @@ public:
         }
         return output;
     }
+    // --trace-file用に、処理時間を記録しながらsendFrame/getOutputを呼ぶ
+    RGY_ERR sendFrameTrace(std::unique_ptr<PipelineTaskOutput>& frame) {
+        RGYTraceScope trace(RGYTraceCat::TASK, getPipelineTaskTypeName(m_type), _T("sendFrame"), m_inFrames);
+        return sendFrame(frame);
+    }
+    std::vector<std::unique_ptr<PipelineTaskOutput>> getOutputTrace(const bool sync) {
+        RGYTraceScope trace(RGYTraceCat::TASK, getPipelineTaskTypeName(m_type), _T("getOutput"), m_outFrames);
+        auto output = getOutput(sync);
+        if (output.size() == 0) {
+            trace.cancel(); // 出力がない場合のポーリングは記録しない
+        }
+        return output;
+    }
     bool isMFXTask(const PipelineTaskType task) const {
         return task == PipelineTaskType::MFXDEC
             || task == PipelineTaskType::MFXVPP
@@ -553,7 +803,8 @@ public:
         m_workSurfs.setSurfaces(workSurfs);
         return RGY_ERR_NONE;
     }
-    RGY_ERR workSurfacesAllocCL(const int numFrames, const RGYFrameInfo &frame, RGYOpenCLContext *cl) {
+    // numFramesMaxを指定した場合は、getWorkSurfでの待ち時間に応じてnumFrames～numFramesMaxの間でフレーム数を自動調整する
+    RGY_ERR workSurfacesAllocCL(const int numFrames, const RGYFrameInfo &frame, RGYOpenCLContext *cl, const int numFramesMax = 0) {
         auto sts = workSurfacesClear();
         if (sts != RGY_ERR_NONE) {
             PrintMes(RGY_LOG_ERROR, _T("allocWorkSurfaces:   Failed to clear old surfaces: %s.\n"), get_err_mes(sts));
@@ -568,9 +819,53 @@ public:
             //これでmap/unmapで可能な場合コピーが発生しない
             frames[i] = cl->createFrameBuffer(frame, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR);
         }
-        m_workSurfs.setSurfaces(frames);
+        m_workSurfsTune = PipelineTaskSurfaceTune();
+        if (numFramesMax > numFrames) {
+            m_workSurfsTune.numMin = numFrames;
+            m_workSurfsTune.numMax = numFramesMax;
+            m_workSurfsTune.frameInfo = frame;
+            m_workSurfsTune.cl = cl;
+            PrintMes(RGY_LOG_DEBUG, _T("allocWorkSurfaces:   auto tune work surfaces: %d - %d frames.\n"), numFrames, numFramesMax);
+        }
+        m_workSurfs.setSurfaces(frames, std::max(numFrames, numFramesMax));
         return RGY_ERR_NONE;
     }
+    bool workSurfacesCanGrow() const {
+        return m_workSurfsTune.enabled() && (int)m_workSurfs.bufCount() < m_workSurfsTune.numMax;
+    }
+    // ワークフレームを1枚追加する
+    RGY_ERR workSurfacesGrow() {
+        auto frame = m_workSurfsTune.cl->createFrameBuffer(m_workSurfsTune.frameInfo, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR);
+        if (!frame || !m_workSurfs.addSurface(std::move(frame))) {
+            PrintMes(RGY_LOG_WARN, _T("getWorkSurf:   Failed to add work surface, stop auto tuning at %d frames.\n"), (int)m_workSurfs.bufCount());
+            m_workSurfsTune.numMax = (int)m_workSurfs.bufCount();
+            return RGY_ERR_NULL_PTR;
+        }
+        m_workSurfsTune.growCount++;
+        PrintMes(RGY_LOG_DEBUG, _T("getWorkSurf:   added work surface: %d frames.\n"), (int)m_workSurfs.bufCount());
+        return RGY_ERR_NONE;
+    }
+    // 取得時の待ち時間と空きフレーム数を記録し、一定区間で待ちが発生せず余裕があればワークフレームを1枚減らす
+    void workSurfacesTune(const std::chrono::microseconds stall) {
+        auto& tune = m_workSurfsTune;
+        if (!tune.enabled()) {
+            return;
+        }
+        tune.windowStall += stall;
+        tune.windowFreeMin = std::min(tune.windowFreeMin, m_workSurfs.freeCount());
+        if (++tune.windowCount < PipelineTaskSurfaceTune::WINDOW) {
+            return;
+        }
+        if (tune.windowStall.count() == 0 && tune.windowFreeMin >= 2 && (int)m_workSurfs.bufCount() > tune.numMin) {
+            if (m_workSurfs.removeFreeSurface()) {
+                tune.shrinkCount++;
+                PrintMes(RGY_LOG_DEBUG, _T("getWorkSurf:   removed work surface: %d frames.\n"), (int)m_workSurfs.bufCount());
+            }
+        }
+        tune.windowCount = 0;
+        tune.windowFreeMin = std::numeric_limits<int>::max();
+        tune.windowStall = std::chrono::microseconds(0);
+    }
 
     // surfの対応するPipelineTaskSurfaceを見つけ、これから使用するために参照を増やす
     // 破棄時にアプリ側の参照カウンタを減算するようにshared_ptrで設定してある
@@ -584,12 +879,34 @@ public:
             PrintMes(RGY_LOG_ERROR, _T("getWorkSurf:   No buffer allocated!\n"));
             return PipelineTaskSurface();
         }
-        for (uint32_t i = 0; i < MSDK_WAIT_INTERVAL; i++) {
-            PipelineTaskSurface s = m_workSurfs.getFreeSurf();
+        PipelineTaskSurface s = m_workSurfs.getFreeSurf();
+        if (s != nullptr) {
+            workSurfacesTune(std::chrono::microseconds(0));
+            return s;
+        }
+        // 空きフレームがない場合は、参照の解放による通知を待つ (待機が発生した場合のみ記録する)
+        RGYTraceScope trace(RGYTraceCat::WAIT, getPipelineTaskTypeName(m_type), _T("getWorkSurf"), m_inFrames);
+        const auto start = std::chrono::steady_clock::now();
+        const auto timeout = std::chrono::microseconds(PIPELINE_SURF_WAIT_TIMEOUT_MS * 1000);
+        for (auto elapsed = std::chrono::microseconds(0); elapsed < timeout; ) {
+            auto waitTime = timeout - elapsed;
+            if (workSurfacesCanGrow()) {
+                if (elapsed >= PipelineTaskSurfaceTune::GROW_WAIT) {
+                    workSurfacesGrow();
+                    waitTime = std::chrono::microseconds(0);
+                } else {
+                    waitTime = std::min(waitTime, PipelineTaskSurfaceTune::GROW_WAIT - elapsed);
+                }
+            }
+            if (waitTime.count() > 0) {
+                m_workSurfs.waitFreeSurf(waitTime);
+            }
+            s = m_workSurfs.getFreeSurf();
+            elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
             if (s != nullptr) {
+                workSurfacesTune(elapsed);
                 return s;
             }
-            sleep_hybrid(i);
         }
         PrintMes(RGY_LOG_ERROR, _T("getWorkSurf:   Failed to get work surface, all %d frames used.\n"), m_workSurfs.bufCount());
         return PipelineTaskSurface();
@@ -1530,7 +1847,8 @@ protected:
     RGYTimestamp *m_encTimestamp;
     mfxVideoParam& m_mfxEncParams;
     rgy_rational<int> m_outputTimebase;
-    RGYListRef<RGYBitstream> m_bitStreamOut;
+    std::shared_ptr<RGYBitstreamPool> m_bitstreamPool; //出力ビットストリームのバッファ
+    size_t m_bitstreamBufSize; //エンコーダが必要とする出力バッファのサイズ
     RGYHDR10Plus *m_hdr10plus;
     bool m_hdr10plusMetadataCopy;
     encCtrlData m_encCtrlData;
@@ -1539,9 +1857,9 @@ public:
         MFXVideoSession *mfxSession, int outMaxQueueSize, MFXVideoENCODE *mfxencode, mfxVersion mfxVer, mfxVideoParam& encParams,
         RGYTimecode *timecode, RGYTimestamp *encTimestamp, rgy_rational<int> outputTimebase, RGYHDR10Plus *hdr10plus, bool hdr10plusMetadataCopy, std::shared_ptr<RGYLog> log)
         : PipelineTask(PipelineTaskType::MFXENCODE, outMaxQueueSize, mfxSession, mfxVer, log),
-        m_encode(mfxencode), m_timecode(timecode), m_encTimestamp(encTimestamp), m_mfxEncParams(encParams), m_outputTimebase(outputTimebase), m_bitStreamOut(), m_hdr10plus(hdr10plus), m_hdr10plusMetadataCopy(hdr10plusMetadataCopy), m_encCtrlData() {};
+        m_encode(mfxencode), m_timecode(timecode), m_encTimestamp(encTimestamp), m_mfxEncParams(encParams), m_outputTimebase(outputTimebase), m_bitstreamPool(RGYBitstreamPool::get()), m_bitstreamBufSize(0), m_hdr10plus(hdr10plus), m_hdr10plusMetadataCopy(hdr10plusMetadataCopy), m_encCtrlData() {};
     virtual ~PipelineTaskMFXEncode() {
-        m_outQeueue.clear(); // m_bitStreamOutが解放されるよう前にこちらを解放する
+        m_outQeueue.clear(); // 出力ビットストリームがm_bitstreamPoolに返却されるよう前にこちらを解放する
     };
     void setEnc(MFXVideoENCODE *mfxencode) { m_encode = mfxencode; };
 
@@ -1567,24 +1885,19 @@ public:
             return RGY_ERR_UNSUPPORTED;
         }
 
-        auto bsOut = m_bitStreamOut.get([enc = m_encode, log = m_log](RGYBitstream *bs) {
+        if (m_bitstreamBufSize == 0) {
             mfxVideoParam par = { 0 };
-            mfxStatus sts = enc->GetVideoParam(&par);
+            mfxStatus sts = m_encode->GetVideoParam(&par);
             if (sts != MFX_ERR_NONE) {
-                log->write(RGY_LOG_ERROR, RGY_LOGT_CORE, _T("Failed to get required output buffer size from encoder: %s\n"), get_err_mes(sts));
-                mfxBitstreamClear(bs->bsptr());
-                return 1;
-            }
-
-            sts = mfxBitstreamInit(bs->bsptr(), par.mfx.BufferSizeInKB * 1000 * (std::max)(1, (int)par.mfx.BRCParamMultiplier));
-            if (sts != MFX_ERR_NONE) {
-                log->write(RGY_LOG_ERROR, RGY_LOGT_CORE, _T("Failed to allocate memory for output bufffer: %s\n"), get_err_mes(sts));
-                mfxBitstreamClear(bs->bsptr());
-                return 1;
+                PrintMes(RGY_LOG_ERROR, _T("Failed to get required output buffer size from encoder: %s\n"), get_err_mes(sts));
+                return RGY_ERR_NULL_PTR;
             }
-            return 0;
-        });
+            m_bitstreamBufSize = (size_t)par.mfx.BufferSizeInKB * 1000 * (std::max)(1, (int)par.mfx.BRCParamMultiplier);
+        }
+        //出力先のバッファはプールから取得し、書き込みが終わって参照がなくなるとプールに返却される
+        auto bsOut = m_bitstreamPool->getBitstream(m_bitstreamBufSize);
         if (!bsOut) {
+            PrintMes(RGY_LOG_ERROR, _T("Failed to allocate memory for output bufffer.\n"));
             return RGY_ERR_NULL_PTR;
         }
 
@@ -1648,8 +1961,9 @@ public:
                 enc_sts = MFX_ERR_NONE;
                 break;
             } else if (enc_sts == MFX_ERR_NOT_ENOUGH_BUFFER) {
-                enc_sts = mfxBitstreamExtend(bsOut->bsptr(), (uint32_t)bsOut->bufsize() * 3 / 2);
-                if (enc_sts < MFX_ERR_NONE) return err_to_rgy(enc_sts);
+                const auto newBufSize = bsOut->bufsize() * 3 / 2;
+                if (auto err = m_bitstreamPool->extend(bsOut.get(), newBufSize); err != RGY_ERR_NONE) return err;
+                m_bitstreamBufSize = (std::max)(m_bitstreamBufSize, newBufSize);
             } else if (enc_sts < MFX_ERR_NONE && (enc_sts != MFX_ERR_MORE_DATA && enc_sts != MFX_ERR_MORE_SURFACE)) {
                 PrintMes(RGY_LOG_ERROR, _T("EncodeFrameAsync error: %s.\n"), get_err_mes(enc_sts));
                 break;
@@ -1941,4 +2255,82 @@ public:
         return RGY_ERR_NONE;
     }
 };
+struct PipelineTaskData {
+    size_t task;
+    std::unique_ptr<PipelineTaskOutput> data;
+    PipelineTaskData(size_t t) : task(t), data() {};
+    PipelineTaskData(size_t t, std::unique_ptr<PipelineTaskOutput>& d) : task(t), data(std::move(d)) {};
+};
+
+// --thread-pipeline使用時に、各ステージ(スレッド)間でPipelineTaskDataを受け渡すキュー
+// 容量に上限を設け、後段が詰まっている場合には前段の処理を待機させる
+class PipelineStageQueue {
+private:
+    std::mutex m_mtx;
+    std::condition_variable m_cvPushed; // データが追加された/終了した
+    std::condition_variable m_cvPopped; // データが取り出された/中断された
+    std::deque<PipelineTaskData> m_queue;
+    size_t m_capacity;
+    bool m_fin;   // 前段の処理(flushを含む)がすべて終了した
+    bool m_abort; // エラー等で中断された
+public:
+    PipelineStageQueue(size_t capacity) : m_mtx(), m_cvPushed(), m_cvPopped(), m_queue(), m_capacity(std::max<size_t>(capacity, 1)), m_fin(false), m_abort(false) {};
+    ~PipelineStageQueue() {};
+
+    // キューに空きができるまで待機してから追加する
+    // 中断された場合はfalseを返す
+    bool push(PipelineTaskData&& d) {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        m_cvPopped.wait(lock, [this]() { return m_abort || m_queue.size() < m_capacity; });
+        if (m_abort) {
+            return false;
+        }
+        m_queue.push_back(std::move(d));
+        m_cvPushed.notify_one();
+        return true;
+    }
+    // データが追加されるまで待機してから取り出す
+    // 前段が終了した(かつキューが空)、あるいは中断された場合はfalseを返す
+    bool pop(PipelineTaskData& d) {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        m_cvPushed.wait(lock, [this]() { return m_abort || m_fin || !m_queue.empty(); });
+        if (m_abort || m_queue.empty()) {
+            return false;
+        }
+        d = std::move(m_queue.front());
+        m_queue.pop_front();
+        m_cvPopped.notify_one();
+        return true;
+    }
+    // 前段の処理の終了を通知する
+    void finish() {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_fin = true;
+        m_cvPushed.notify_all();
+    }
+    // 処理を中断し、待機中のスレッドをすべて起こす
+    // キュー内のフレームは破棄し、前段のサーフェスを解放する
+    void abort() {
+        std::deque<PipelineTaskData> queue;
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_abort = true;
+            queue.swap(m_queue);
+            m_cvPushed.notify_all();
+            m_cvPopped.notify_all();
+        }
+        queue.clear();
+    }
+    bool aborted() {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        return m_abort;
+    }
+    size_t capacity() const { return m_capacity; }
+};
+
+// ステージ間のキューの容量
+// 前段の最終タスクの出力キューサイズに、スレッド間の受け渡しのための1フレームを加える
+static inline int pipelineStageQueueSize(const PipelineTask *lastTaskOfStage) {
+    return std::max(1, lastTaskOfStage->outputMaxQueueSize()) + 1;
+}
 #endif // __QSV_PIPELINE_CTRL_H__
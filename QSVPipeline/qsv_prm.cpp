@@ -177,6 +177,9 @@ sInputParams::sInputParams() :
     gpuCopy(false),
     nSessionThreads(0),
     nSessionThreadPriority(get_value_from_chr(list_priority, _T("normal"))),
+    threadPipeline(0),
+    surfacePoolAuto(false),
+    featureCache(QSV_FEATURE_CACHE_AUTO),
     nVP8Sharpness(0),
     nWeightP(0),
     nWeightB(0),
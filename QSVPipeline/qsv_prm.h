@@ -358,6 +358,9 @@ struct sInputParams {
 
     int        nSessionThreads;
     int        nSessionThreadPriority;
+    int        threadPipeline; //パイプラインの各ステージを別スレッドで処理する (0: 無効, 1: 有効)
+    bool       surfacePoolAuto; //OpenCLのワークフレーム数を待ち時間に応じて自動調整する
+    int        featureCache; //エンコード/デコード機能の問い合わせ結果のキャッシュ (QSVFeatureCacheMode)
 
     int        nVP8Sharpness;
 
@@ -861,6 +864,19 @@ const CX_DESC list_vpp_mfx_denoise_mode[] = {
     { NULL, 0 }
 };
 
+enum QSVFeatureCacheMode {
+    QSV_FEATURE_CACHE_OFF = 0,
+    QSV_FEATURE_CACHE_AUTO,
+    QSV_FEATURE_CACHE_REFRESH,
+};
+
+const CX_DESC list_feature_cache[] = {
+    { _T("off"),     QSV_FEATURE_CACHE_OFF     },
+    { _T("auto"),    QSV_FEATURE_CACHE_AUTO    },
+    { _T("refresh"), QSV_FEATURE_CACHE_REFRESH },
+    { NULL, 0 }
+};
+
 /*
 const CX_DESC list_vpp_scaling_quality[] = {
     { _T("auto"),   MFX_SCALING_MODE_DEFAULT  },
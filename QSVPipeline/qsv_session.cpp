@@ -189,6 +189,25 @@ std::vector<mfxImplDescription> MFXVideoSession2::getImplList() {
     return implList;
 }
 
+std::vector<tstring> MFXVideoSession2::getImplPathList() {
+    std::vector<tstring> pathList;
+#if (MFX_VERSION >= 2004)
+    auto loader = MFXLoaderProvider::getLoader();
+    for (int impl_idx = 0; ; impl_idx++) {
+        mfxChar *impl_path = nullptr;
+        auto sts = MFXEnumImplementations(loader, impl_idx, MFX_IMPLCAPS_IMPLPATH, (mfxHDL *)&impl_path);
+        if (sts == MFX_ERR_NOT_FOUND || sts == MFX_ERR_UNSUPPORTED) {
+            break;
+        } else if (sts != MFX_ERR_NONE) {
+            continue;
+        }
+        pathList.push_back(char_to_tstring(impl_path));
+        MFXDispReleaseImplDescription(loader, impl_path);
+    }
+#endif
+    return pathList;
+}
+
 mfxStatus MFXVideoSession2::initHW(mfxIMPL& impl, const QSVDeviceNum dev) {
     mfxVersion verRequired = MFX_LIB_VERSION_1_1;
 #if defined(_WIN32) || defined(_WIN64)
@@ -54,6 +54,7 @@ public:
     mfxStatus initVA(const QSVDeviceNum dev, const bool suppressErrorMessage);
     mfxStatus initSW(const bool suppressErrorMessage);
     std::vector<mfxImplDescription> getImplList();
+    std::vector<tstring> getImplPathList();
 
     mfxSession get() { return m_session; }
 protected:
@@ -304,6 +304,25 @@ public:
         memset(&m_bitstream, 0, sizeof(m_bitstream));
     }
 
+    //_aligned_mallocで確保したバッファを設定する (既存のバッファは解放する)
+    void attach(uint8_t *buf, size_t bufsize) {
+        free_mem();
+        m_bitstream.Data = buf;
+        m_bitstream.MaxLength = (uint32_t)bufsize;
+        m_bitstream.DataOffset = 0;
+        m_bitstream.DataLength = 0;
+    }
+
+    //バッファの所有権を手放す (呼び出し側で解放すること)
+    uint8_t *detach() {
+        auto ptr = m_bitstream.Data;
+        m_bitstream.Data = nullptr;
+        m_bitstream.MaxLength = 0;
+        m_bitstream.DataOffset = 0;
+        m_bitstream.DataLength = 0;
+        return ptr;
+    }
+
     RGY_ERR init(size_t nSize) {
         free_mem();
 
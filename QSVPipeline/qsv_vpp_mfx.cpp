@@ -49,7 +49,7 @@ static const auto MFX_EXTBUFF_VPP_TO_VPPTYPE = make_array<std::pair<uint32_t, Vp
 MAP_PAIR_0_1(vpp, extbuff, uint32_t, rgy, VppType, MFX_EXTBUFF_VPP_TO_VPPTYPE, 0, VppType::VPP_NONE);
 
 QSVVppMfx::QSVVppMfx(CQSVHWDevice *hwdev, QSVAllocator *allocator,
-    mfxVersion mfxVer, mfxIMPL impl, MemType memType, const MFXVideoSession2Params& sessionParams, QSVDeviceNum deviceNum, int asyncDepth, std::shared_ptr<RGYLog> log) :
+    mfxVersion mfxVer, mfxIMPL impl, MemType memType, const MFXVideoSession2Params& sessionParams, QSVDeviceNum deviceNum, uint64_t vppFeatures, int asyncDepth, std::shared_ptr<RGYLog> log) :
     m_mfxSession(),
     m_mfxVer(mfxVer),
     m_hwdev(hwdev),
@@ -58,6 +58,7 @@ QSVVppMfx::QSVVppMfx(CQSVHWDevice *hwdev, QSVAllocator *allocator,
     m_memType(memType),
     m_sessionParams(sessionParams),
     m_deviceNum(deviceNum),
+    m_vppFeatures(vppFeatures),
     m_asyncDepth(asyncDepth),
     m_crop(),
     m_mfxVPP(),
@@ -254,7 +255,7 @@ RGY_ERR QSVVppMfx::InitMFXSession() {
 }
 
 RGY_ERR QSVVppMfx::checkVppParams(sVppParams& params, const bool inputInterlaced) {
-    const auto availableFeaures = CheckVppFeatures(m_mfxSession);
+    const auto availableFeaures = m_vppFeatures;
 #if ENABLE_FPS_CONVERSION
     if (FPS_CONVERT_NONE != params.nFPSConversion && !(availableFeaures & VPP_FEATURE_FPS_CONVERSION_ADV)) {
         PrintMes(RGY_LOG_WARN, _T("FPS Conversion not supported on this platform, disabled.\n"));
@@ -38,7 +38,7 @@
 
 class QSVVppMfx {
 public:
-    QSVVppMfx(CQSVHWDevice *hwdev, QSVAllocator *allocator, mfxVersion mfxVer, mfxIMPL impl, MemType memType, const MFXVideoSession2Params& sessionParams, QSVDeviceNum deviceNum, int asyncDepth, std::shared_ptr<RGYLog> log);
+    QSVVppMfx(CQSVHWDevice *hwdev, QSVAllocator *allocator, mfxVersion mfxVer, mfxIMPL impl, MemType memType, const MFXVideoSession2Params& sessionParams, QSVDeviceNum deviceNum, uint64_t vppFeatures, int asyncDepth, std::shared_ptr<RGYLog> log);
     virtual ~QSVVppMfx();
 
     RGY_ERR SetParam(sVppParams& params,
@@ -82,6 +82,7 @@ protected:
     MemType m_memType;             //パイプラインのSurfaceのメモリType;
     MFXVideoSession2Params m_sessionParams;
     QSVDeviceNum m_deviceNum;
+    uint64_t m_vppFeatures; // QSVDeviceで確認済みのVPP機能 (VPP_FEATURE_xxx)
     int m_asyncDepth;
 
     sInputCrop m_crop;
@@ -26,9 +26,13 @@
 // --------------------------------------------------------------------------------------------
 
 #include <regex>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "rgy_util.h"
 #include "rgy_bitstream.h"
 #include "rgy_memmem.h"
+#include "rgy_filesystem.h"
 
 std::vector<uint8_t> unnal(const uint8_t *ptr, size_t len) {
     std::vector<uint8_t> data;
@@ -426,8 +430,90 @@ std::vector<uint8_t> RGYHDRMetadata::gen_obu() const {
     return data;
 }
 
-DOVIRpu::DOVIRpu() : m_find_header(get_find_header_func()), m_filepath(), m_fp(nullptr, fclose), m_buffer(), m_datasize(0), m_dataoffset(0), m_count(0), m_rpus() {};
-DOVIRpu::~DOVIRpu() { m_fp.reset(); };
+static const size_t DOVI_RPU_INDEX_PUBLISH_COUNT = 1024;
+
+//RPUファイルをメモリマップし、各RPUの範囲の索引を作成する
+//索引の作成はバックグラウンドで行い、DOVI_RPU_INDEX_PUBLISH_COUNTごとに参照できるようにする
+struct DOVIRpuIndex {
+    RGYFileMap map;
+    std::vector<std::pair<uint64_t, uint64_t>> ranges; //各RPUの範囲 (rpu_headerの直後, 次のrpu_headerの位置)
+    size_t published;              //rangesのうち参照可能な数
+    bool done;
+    bool abort;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::thread thread;
+
+    DOVIRpuIndex() : map(), ranges(), published(0), done(false), abort(false), mtx(), cv(), thread() {};
+    ~DOVIRpuIndex() {
+        if (thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                abort = true;
+            }
+            thread.join();
+        }
+    }
+    void build(decltype(find_header_c)* find_header) {
+        const uint8_t *data = map.data();
+        const size_t size = map.size();
+        std::vector<std::pair<uint64_t, uint64_t>> found;
+        found.reserve(DOVI_RPU_INDEX_PUBLISH_COUNT);
+        auto publish = [&](bool fin) {
+            std::lock_guard<std::mutex> lock(mtx);
+            ranges.insert(ranges.end(), found.begin(), found.end());
+            published = ranges.size();
+            done = fin;
+            found.clear();
+            cv.notify_all();
+            return !abort;
+        };
+        //先頭はrpu_headerでなければならない
+        if (size > sizeof(DOVIRpu::rpu_header) && memcmp(data, DOVIRpu::rpu_header, sizeof(DOVIRpu::rpu_header)) == 0) {
+            size_t start = sizeof(DOVIRpu::rpu_header);
+            for (;;) {
+                const auto pos = find_header(data + start, size - start);
+                if (pos == RGY_MEMMEM_NOT_FOUND) {
+                    found.push_back(std::make_pair(start, size));
+                    break;
+                }
+                //rpu_headerが連続している(空のRPU)場合も1つのRPUとして索引に加え、以降のidがずれないようにする
+                //空のRPUはget()で取得できず、そのフレームにはRPUを付加しない
+                found.push_back(std::make_pair(start, start + pos));
+                start += pos + sizeof(DOVIRpu::rpu_header);
+                if (found.size() >= DOVI_RPU_INDEX_PUBLISH_COUNT && !publish(false)) {
+                    return;
+                }
+            }
+        }
+        publish(true);
+    }
+    // idのRPUの範囲を返す (索引の作成が追い付いていなければ待機する)
+    bool get(const uint8_t **rpu, size_t *rpuSize, const int64_t id) {
+        if (id < 0) {
+            return false;
+        }
+        uint64_t start = 0, end = 0;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [&]() { return done || published > (size_t)id; });
+            if ((size_t)id >= published) {
+                return false;
+            }
+            start = ranges[id].first;
+            end = ranges[id].second;
+        }
+        if (end <= start) {
+            return false;
+        }
+        *rpu = map.data() + start;
+        *rpuSize = (size_t)(end - start);
+        return true;
+    }
+};
+
+DOVIRpu::DOVIRpu() : m_find_header(get_find_header_func()), m_filepath(), m_fp(nullptr, fclose), m_buffer(), m_datasize(0), m_dataoffset(0), m_count(0), m_rpus(), m_index() {};
+DOVIRpu::~DOVIRpu() { m_index.reset(); m_fp.reset(); };
 
 const uint8_t DOVIRpu::rpu_header[4] = { 0, 0, 0, 1 };
 
@@ -436,7 +522,33 @@ const tstring& DOVIRpu::get_filepath() const {
 }
 
 int DOVIRpu::init(const TCHAR *rpu_file) {
+    //メモリマップできる場合は、索引を作成してフレーム番号から直接参照する
+    if (initMap(rpu_file) == 0) {
+        return 0;
+    }
+    return initRead(rpu_file);
+}
+
+int DOVIRpu::initMap(const TCHAR *rpu_file) {
+    m_filepath.clear();
+    m_index.reset();
+    m_fp.reset();
+    auto index = std::make_unique<DOVIRpuIndex>();
+    if (!index->map.open(rpu_file) || !index->map.mapped()) {
+        return 1;
+    }
+    auto indexPtr = index.get();
+    auto find_header = m_find_header;
+    index->thread = std::thread([indexPtr, find_header]() { indexPtr->build(find_header); });
+    m_index = std::move(index);
+    m_filepath = rpu_file;
+    return 0;
+}
+
+int DOVIRpu::initRead(const TCHAR *rpu_file) {
     m_filepath.clear();
+    m_index.reset();
+    m_fp.reset();
     FILE *fp = NULL;
     if (_tfopen_s(&fp, rpu_file, _T("rb")) != 0) {
         return 1;
@@ -445,6 +557,10 @@ int DOVIRpu::init(const TCHAR *rpu_file) {
     m_filepath = rpu_file;
 
     m_buffer.resize(256 * 1024);
+    m_datasize = 0;
+    m_dataoffset = 0;
+    m_count = 0;
+    m_rpus.clear();
     return 0;
 }
 
@@ -465,6 +581,7 @@ int DOVIRpu::fillBuffer() {
 }
 
 int DOVIRpu::get_next_rpu(std::vector<uint8_t>& bytes) {
+    bytes.clear();
     if (m_datasize <= 4) {
         if (fillBuffer() == 0) {
             return 1; //EOF
@@ -490,8 +607,9 @@ int DOVIRpu::get_next_rpu(std::vector<uint8_t>& bytes) {
             break;
         }
     }
+    //rpu_headerが連続している(空のRPU)場合は、空のbytesを返す (索引を作成する場合と同じく1つのRPUとして数える)
     if (next_size <= 0) {
-        return 1;
+        return 0;
     }
 
     bytes.resize(next_size);
@@ -509,7 +627,10 @@ int DOVIRpu::get_next_rpu(std::vector<uint8_t>& bytes, const int64_t id) {
         if (int ret = get_next_rpu(rpu); ret != 0) {
             return ret;
         }
-        m_rpus[m_count] = rpu;
+        //空のRPUは登録せず、そのフレームはRPUなしとする
+        if (rpu.size() > 0) {
+            m_rpus[m_count] = std::move(rpu);
+        }
     }
     if (auto it = m_rpus.find(id); it != m_rpus.end()) {
         bytes = std::move(it->second);
@@ -520,23 +641,42 @@ int DOVIRpu::get_next_rpu(std::vector<uint8_t>& bytes, const int64_t id) {
     return 0;
 }
 
-int DOVIRpu::get_next_rpu_nal(std::vector<uint8_t>& bytes, const int64_t id) {
-    std::vector<uint8_t> rpu;
-    if (int ret = get_next_rpu(rpu, id); ret != 0) {
-        return ret;
-    }
-    //to_nal(rpu); // NALU_HEVC_UNSPECIFIEDの場合は不要
-    if (rpu.back() == 0x00) { // 最後が0x00の場合
-        rpu.push_back(0x03);
+int DOVIRpu::get_rpu(const uint8_t **rpu, size_t *size, const int64_t id) {
+    if (!m_index || !m_index->get(rpu, size, id)) {
+        return 1;
     }
+    return 0;
+}
 
+int DOVIRpu::get_next_rpu_nal(std::vector<uint8_t>& bytes, const int64_t id) {
+    std::vector<uint8_t> rpuBuf;
+    const uint8_t *rpu = nullptr;
+    size_t rpuSize = 0;
+    if (m_index) {
+        //マップしたファイルから直接NALを作成する
+        if (int ret = get_rpu(&rpu, &rpuSize, id); ret != 0) {
+            return ret;
+        }
+    } else {
+        if (int ret = get_next_rpu(rpuBuf, id); ret != 0) {
+            return ret;
+        }
+        rpu = rpuBuf.data();
+        rpuSize = rpuBuf.size();
+    }
+    bytes.clear();
+    bytes.reserve(sizeof(DOVIRpu::rpu_header) + sizeof(uint16_t) + rpuSize + 1);
     bytes.resize(sizeof(DOVIRpu::rpu_header));
     memcpy(bytes.data(), &DOVIRpu::rpu_header, sizeof(DOVIRpu::rpu_header));
 
     uint16_t u16 = 0x00;
     u16 |= (NALU_HEVC_UNSPECIFIED << 9) | 1;
     add_u16(bytes, u16);
-    vector_cat(bytes, rpu);
+    bytes.insert(bytes.end(), rpu, rpu + rpuSize);
+    //to_nal(rpu); // NALU_HEVC_UNSPECIFIEDの場合は不要
+    if (bytes.back() == 0x00) { // 最後が0x00の場合
+        bytes.push_back(0x03);
+    }
     return 0;
 }
 
@@ -555,8 +695,8 @@ const DOVIProfile *getDOVIProfile(const int id) {
     return nullptr;
 }
 
-std::vector<nal_info> parse_nal_unit_h264_c(const uint8_t *data, size_t size) {
-    std::vector<nal_info> nal_list;
+void parse_nal_unit_h264_c(std::vector<nal_info>& nal_list, const uint8_t *data, size_t size) {
+    nal_list.clear();
     if (size >= 3) {
         static const uint8_t header[3] = { 0, 0, 1 };
         nal_info nal_start = { nullptr, 0, 0 };
@@ -582,11 +722,10 @@ std::vector<nal_info> parse_nal_unit_h264_c(const uint8_t *data, size_t size) {
             nal_list.push_back(nal_start);
         }
     }
-    return nal_list;
 }
 
-std::vector<nal_info> parse_nal_unit_hevc_c(const uint8_t *data, size_t size) {
-    std::vector<nal_info> nal_list;
+void parse_nal_unit_hevc_c(std::vector<nal_info>& nal_list, const uint8_t *data, size_t size) {
+    nal_list.clear();
     if (size >= 3) {
         static const uint8_t header[3] = { 0, 0, 1 };
         nal_info nal_start = { nullptr, 0, 0 };
@@ -612,7 +751,6 @@ std::vector<nal_info> parse_nal_unit_hevc_c(const uint8_t *data, size_t size) {
             nal_list.push_back(nal_start);
         }
     }
-    return nal_list;
 }
 
 size_t find_header_c(const uint8_t *data, size_t size) {
@@ -653,38 +791,41 @@ decltype(find_header_c)* get_find_header_func() {
     return find_header_c;
 }
 
-static std::unique_ptr<unit_info> get_unit(const uint8_t *data, const size_t size) {
-    std::unique_ptr<unit_info> unit;
+//OBUの種類とヘッダを含むサイズを取得する
+static size_t get_unit_size(const uint8_t *data, const size_t size, uint8_t *type) {
     if (size <= 1) {
-        return unit;
+        return 0;
     }
     const uint8_t *const start_pos = data;
     const uint8_t firstbyte = *data++;
-    const uint8_t type = (firstbyte & (0x78)) >> 3;
     const uint8_t extension_flag = (firstbyte & 0x04) >> 2;
     const uint8_t has_size_flag = (firstbyte & 0x02) >> 1;
-
-    unit = std::make_unique<unit_info>();
-    unit->type = type;
+    *type = (firstbyte & (0x78)) >> 3;
 
     if (extension_flag) {
         data++;
     }
     if (!has_size_flag) {
-        size_t ret = size - 1 - extension_flag;
-        unit->unit_data.resize(ret);
-    } else {
-        size_t obu_size = 0;
-        for (int i = 0; i < 8; i++) {
-            uint8_t byte = *data++;
-            obu_size |= (int64_t)(byte & 0x7f) << (i * 7);
-            if (!(byte & 0x80))
-                break;
-        }
+        return size - 1 - extension_flag;
+    }
+    size_t obu_size = 0;
+    for (int i = 0; i < 8 && data < start_pos + size; i++) {
+        uint8_t byte = *data++;
+        obu_size |= (int64_t)(byte & 0x7f) << (i * 7);
+        if (!(byte & 0x80))
+            break;
+    }
+    return obu_size + (data - start_pos);
+}
 
-        const size_t ret = obu_size + (data - start_pos);
-        unit->unit_data.resize(ret);
+static std::unique_ptr<unit_info> get_unit(const uint8_t *data, const size_t size) {
+    std::unique_ptr<unit_info> unit;
+    if (size <= 1) {
+        return unit;
     }
+    unit = std::make_unique<unit_info>();
+    unit->unit_data.resize(get_unit_size(data, size, &unit->type));
+    const uint8_t *const start_pos = data;
     if (unit->unit_data.size() > 0) {
         memcpy(unit->unit_data.data(), start_pos, unit->unit_data.size());
     }
@@ -705,4 +846,18 @@ std::deque<std::unique_ptr<unit_info>> parse_unit_av1(const uint8_t *data, const
         size_remain -= unit_size;
     }
     return list;
+}
+
+void parse_unit_av1(std::vector<nal_info>& unit_list, const uint8_t *data, const size_t size) {
+    unit_list.clear();
+    size_t offset = 0;
+    while (offset < size) {
+        nal_info unit = { data + offset, 0, 0 };
+        unit.size = get_unit_size(data + offset, size - offset, &unit.type);
+        if (unit.size == 0 || unit.size > size - offset) {
+            break;
+        }
+        unit_list.push_back(unit);
+        offset += unit.size;
+    }
 }
\ No newline at end of file
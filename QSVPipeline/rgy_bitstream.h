@@ -151,12 +151,14 @@ void to_nal(std::vector<uint8_t>& data);
 void add_u16(std::vector<uint8_t>& data, uint16_t u16);
 void add_u32(std::vector<uint8_t>& data, uint32_t u32);
 
-std::vector<nal_info> parse_nal_unit_h264_c(const uint8_t *data, size_t size);
-std::vector<nal_info> parse_nal_unit_hevc_c(const uint8_t *data, size_t size);
-std::vector<nal_info> parse_nal_unit_h264_avx2(const uint8_t *data, size_t size);
-std::vector<nal_info> parse_nal_unit_hevc_avx2(const uint8_t *data, size_t size);
-std::vector<nal_info> parse_nal_unit_h264_avx512bw(const uint8_t *data, size_t size);
-std::vector<nal_info> parse_nal_unit_hevc_avx512bw(const uint8_t *data, size_t size);
+//nal_listに各NALの位置 (dataを指す) を格納する
+//nal_listは呼び出し側で使いまわすことで、フレームごとのメモリ確保を避けられる
+void parse_nal_unit_h264_c(std::vector<nal_info>& nal_list, const uint8_t *data, size_t size);
+void parse_nal_unit_hevc_c(std::vector<nal_info>& nal_list, const uint8_t *data, size_t size);
+void parse_nal_unit_h264_avx2(std::vector<nal_info>& nal_list, const uint8_t *data, size_t size);
+void parse_nal_unit_hevc_avx2(std::vector<nal_info>& nal_list, const uint8_t *data, size_t size);
+void parse_nal_unit_h264_avx512bw(std::vector<nal_info>& nal_list, const uint8_t *data, size_t size);
+void parse_nal_unit_hevc_avx512bw(std::vector<nal_info>& nal_list, const uint8_t *data, size_t size);
 
 decltype(parse_nal_unit_h264_c)* get_parse_nal_unit_h264_func();
 decltype(parse_nal_unit_hevc_c)* get_parse_nal_unit_hevc_func();
@@ -168,6 +170,8 @@ size_t find_header_avx512bw(const uint8_t *data, size_t size);
 decltype(find_header_c)* get_find_header_func();
 
 std::deque<std::unique_ptr<unit_info>> parse_unit_av1(const uint8_t *data, const size_t size);
+//unit_listに各OBUの位置 (dataを指す) を格納する (コピーしない)
+void parse_unit_av1(std::vector<nal_info>& unit_list, const uint8_t *data, const size_t size);
 
 uint8_t gen_obu_header(const uint8_t obu_type);
 size_t get_av1_uleb_size_bytes(uint64_t value);
@@ -231,6 +235,8 @@ struct DOVIProfile {
 
 const DOVIProfile *getDOVIProfile(const int id);
 
+struct DOVIRpuIndex;
+
 class DOVIRpu {
 public:
     static const uint8_t rpu_header[4];
@@ -242,9 +248,15 @@ public:
     const tstring& get_filepath() const;
 
 protected:
+    //メモリマップして索引を作成する (マップできなければ1を返す)
+    int initMap(const TCHAR *rpu_file);
+    //ファイルを先頭から順に読み込む
+    int initRead(const TCHAR *rpu_file);
     int fillBuffer();
     int get_next_rpu(std::vector<uint8_t>& bytes);
     int get_next_rpu(std::vector<uint8_t>& bytes, const int64_t id);
+    //メモリマップしたファイル上のRPUの位置を返す (コピーしない)
+    int get_rpu(const uint8_t **rpu, size_t *size, const int64_t id);
 
     decltype(find_header_c)* m_find_header;
     tstring m_filepath;
@@ -255,6 +267,7 @@ protected:
     int64_t m_count;
 
     std::unordered_map<int64_t, std::vector<uint8_t>> m_rpus;
+    std::unique_ptr<DOVIRpuIndex> m_index; //メモリマップ時のRPUの索引
 };
 
 #endif //__RGY_BITSTREAM_H__
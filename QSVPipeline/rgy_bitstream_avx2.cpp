@@ -31,8 +31,8 @@
 
 #if defined(_M_IX86) || defined(_M_X64) || defined(__x86_64)
 
-std::vector<nal_info> parse_nal_unit_h264_avx2(const uint8_t * data, size_t size) {
-    std::vector<nal_info> nal_list;
+void parse_nal_unit_h264_avx2(std::vector<nal_info>& nal_list, const uint8_t *data, size_t size) {
+    nal_list.clear();
     if (size >= 3) {
         static const uint8_t header[3] = { 0, 0, 1 };
         nal_info nal_start = { nullptr, 0, 0 };
@@ -59,11 +59,10 @@ std::vector<nal_info> parse_nal_unit_h264_avx2(const uint8_t * data, size_t size
         }
     }
     _mm256_zeroupper();
-    return nal_list;
 }
 
-std::vector<nal_info> parse_nal_unit_hevc_avx2(const uint8_t *data, size_t size) {
-    std::vector<nal_info> nal_list;
+void parse_nal_unit_hevc_avx2(std::vector<nal_info>& nal_list, const uint8_t *data, size_t size) {
+    nal_list.clear();
     if (size >= 3) {
         static const uint8_t header[3] = { 0, 0, 1 };
         nal_info nal_start = { nullptr, 0, 0 };
@@ -90,7 +89,6 @@ std::vector<nal_info> parse_nal_unit_hevc_avx2(const uint8_t *data, size_t size)
         }
     }
     _mm256_zeroupper();
-    return nal_list;
 }
 
 size_t find_header_avx2(const uint8_t *data, size_t size) {
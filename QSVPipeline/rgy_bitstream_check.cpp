@@ -0,0 +1,386 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#include <cstdio>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include "rgy_osdep.h"
+#include "rgy_util.h"
+#include "rgy_simd.h"
+#include "rgy_bitstream.h"
+#include "rgy_bitstream_check.h"
+#include "rgy_check.h"
+
+static const int CHECK_DOVI_RPU_COUNT = 200000;
+static const int CHECK_DOVI_RPU_EMPTY_INTERVAL = 97; // この間隔で空のRPUを挟む
+
+// 読み込み方法を選んで初期化するため、protectedの関数を公開する
+class DOVIRpuCheck : public DOVIRpu {
+public:
+    using DOVIRpu::initMap;
+    using DOVIRpu::initRead;
+    using DOVIRpu::get_next_rpu;
+    using DOVIRpu::get_rpu;
+};
+
+// 期待するRPUの列 (空のRPUを含む) を作成する
+static std::vector<std::vector<uint8_t>> check_dovi_rpu_gen() {
+    std::mt19937 mt(1234);
+    std::uniform_int_distribution<int> sizeDist(40, 600);
+    std::uniform_int_distribution<int> byteDist(1, 255); // rpu_headerが現れないよう0は使わない
+    std::vector<std::vector<uint8_t>> rpus;
+    rpus.push_back({}); // 先頭の空のRPU
+    for (int i = 0; i < CHECK_DOVI_RPU_COUNT; i++) {
+        if (i % CHECK_DOVI_RPU_EMPTY_INTERVAL == 1) {
+            rpus.push_back({});
+            rpus.push_back({}); // 連続する空のRPU
+        }
+        std::vector<uint8_t> rpu(sizeDist(mt));
+        for (auto& b : rpu) {
+            b = (uint8_t)byteDist(mt);
+        }
+        rpus.push_back(std::move(rpu));
+    }
+    return rpus;
+}
+
+// RPUの列を書き出したファイルの中身を作成する (空のRPUはrpu_headerのみとなる)
+static std::vector<uint8_t> check_dovi_rpu_file(const std::vector<std::vector<uint8_t>>& rpus) {
+    std::vector<uint8_t> file;
+    auto addHeader = [&file]() { file.insert(file.end(), DOVIRpu::rpu_header, DOVIRpu::rpu_header + sizeof(DOVIRpu::rpu_header)); };
+    for (const auto& rpu : rpus) {
+        addHeader();
+        file.insert(file.end(), rpu.begin(), rpu.end());
+    }
+    addHeader(); // 末尾の空のRPU
+    return file;
+}
+
+// idのRPUを取得し、期待する内容と一致するか確認する
+// 空のRPUのフレームは取得できず (RPUなし)、idはずれないこと
+static bool check_dovi_rpu_match(DOVIRpuCheck& rpu, const bool map, const int64_t id, const std::vector<uint8_t>& expected, std::vector<uint8_t>& buf) {
+    const uint8_t *ptr = nullptr;
+    size_t size = 0;
+    int ret = 0;
+    if (map) {
+        ret = rpu.get_rpu(&ptr, &size, id);
+    } else {
+        ret = rpu.get_next_rpu(buf, id);
+        ptr = buf.data();
+        size = buf.size();
+    }
+    if (expected.size() == 0) {
+        return ret != 0;
+    }
+    return ret == 0 && size == expected.size() && memcmp(ptr, expected.data(), size) == 0;
+}
+
+// 先頭から順にすべて取得し、一致しないRPUの数を返す
+// endOkには、最後のRPUの次のidを取得できないことを確認した結果を返す
+static int check_dovi_rpu_sequential(DOVIRpuCheck& rpu, const bool map, const std::vector<std::vector<uint8_t>>& rpus, bool& endOk) {
+    std::vector<uint8_t> buf;
+    int mismatch = 0;
+    for (size_t i = 0; i < rpus.size(); i++) {
+        if (!check_dovi_rpu_match(rpu, map, i, rpus[i], buf)) {
+            mismatch++;
+        }
+    }
+    endOk = check_dovi_rpu_match(rpu, map, rpus.size(), {}, buf);
+    return mismatch;
+}
+
+static bool check_dovi_rpu_print(const TCHAR *name, const int mismatch, const bool endOk, const double elapsedSec, const size_t frames) {
+    return rgy_check_print(name, mismatch == 0 && endOk,
+        strsprintf(_T("mismatch %d, %s, %8.3f us/frame"), mismatch, (endOk) ? _T("end ok") : _T("end NG"), elapsedSec * 1e6 / frames));
+}
+
+// ファイルを作成し、メモリマップ・先頭から順の読み込みのそれぞれで確認する
+static bool check_dovi_rpu_run(const TCHAR *name, const std::vector<std::vector<uint8_t>>& rpus, const bool random) {
+    const auto file = check_dovi_rpu_file(rpus);
+    RGYCheckTempFile tmpFile("dovi_rpu_check");
+    if (!tmpFile.create([&file](FILE *fp) { return fwrite(file.data(), 1, file.size(), fp) == file.size(); })) {
+        return false;
+    }
+    const tstring& path = tmpFile.path();
+    const int empty = (int)std::count_if(rpus.begin(), rpus.end(), [](const std::vector<uint8_t>& rpu) { return rpu.size() == 0; });
+    _ftprintf(stdout, _T("%s: %d RPUs (%d empty), %.1f MB\n"), name, (int)rpus.size(), empty, file.size() / (1024.0 * 1024.0));
+
+    bool ok = true;
+    {
+        // メモリマップ: 初期化から順にすべて取得するまで (索引の作成を含む)
+        DOVIRpuCheck rpu;
+        RGYCheckTimer timer;
+        if (rpu.initMap(path.c_str()) != 0) {
+            rgy_check_print_info(_T("map, sequential"), _T("skipped (file mapping not available)"));
+        } else {
+            bool endOk = false;
+            const int mismatch = check_dovi_rpu_sequential(rpu, true, rpus, endOk);
+            ok &= check_dovi_rpu_print(_T("map, sequential"), mismatch, endOk, timer.sec(), rpus.size());
+
+            if (random) {
+                // メモリマップ: 索引の作成後のランダムアクセス
+                std::mt19937 mt(5678);
+                std::uniform_int_distribution<int> idDist(0, (int)rpus.size() - 1);
+                std::vector<uint8_t> buf;
+                int mismatchRandom = 0;
+                timer.restart();
+                for (size_t i = 0; i < rpus.size(); i++) {
+                    const int id = idDist(mt);
+                    if (!check_dovi_rpu_match(rpu, true, id, rpus[id], buf)) {
+                        mismatchRandom++;
+                    }
+                }
+                ok &= check_dovi_rpu_print(_T("map, random"), mismatchRandom, true, timer.sec(), rpus.size());
+            }
+        }
+    }
+    {
+        // 先頭から順に読み込み
+        DOVIRpuCheck rpu;
+        RGYCheckTimer timer;
+        if (rpu.initRead(path.c_str()) != 0) {
+            _ftprintf(stderr, _T("Failed to open %s.\n"), path.c_str());
+            ok = false;
+        } else {
+            bool endOk = false;
+            const int mismatch = check_dovi_rpu_sequential(rpu, false, rpus, endOk);
+            ok &= check_dovi_rpu_print(_T("read, sequential"), mismatch, endOk, timer.sec(), rpus.size());
+        }
+    }
+    return ok;
+}
+
+bool check_dovi_rpu() {
+    bool ok = true;
+    // 空のRPUの位置合わせ: 空のRPUも1フレーム分として数え、そのフレームはRPUなしとし、以降のフレームのRPUがずれないこと
+    const std::vector<std::vector<uint8_t>> alignment = {
+        {}, { 0x01, 0x02, 0x03 }, {}, {}, { 0x04, 0x05 }, { 0x06 }, {}, { 0x07, 0x08, 0x09, 0x0a },
+    };
+    ok &= check_dovi_rpu_run(_T("empty rpu alignment"), alignment, false);
+    ok &= check_dovi_rpu_run(_T("random rpus"), check_dovi_rpu_gen(), true);
+    return rgy_check_print_total(ok);
+}
+
+static const int CHECK_NAL_PACKET_COUNT = 2000;
+static const int CHECK_NAL_REPEAT = 20;
+static const uint8_t CHECK_NAL_HEVC_TRAIL_R = 1;
+static const uint8_t CHECK_NAL_HEVC_IDR_W_RADL = 19;
+
+struct RGYNalCheckPacket {
+    std::vector<uint8_t> data;
+    std::vector<std::pair<size_t, size_t>> units; // 作成した各NAL/OBUの位置とサイズ
+    std::vector<uint8_t> types;                   // 作成した各NAL/OBUの種類
+};
+
+// H.264/HEVCのパケットを作成する
+// 先頭のNALとIDRの前は4byte、それ以外は3byteと4byteの開始コードを混在させる
+static std::vector<RGYNalCheckPacket> check_nal_gen(const bool hevc) {
+    std::mt19937 mt(hevc ? 2345 : 3456);
+    std::uniform_int_distribution<int> sizeDist(16, 4096);
+    std::uniform_int_distribution<int> byteDist(1, 255); // 開始コードが現れないよう0は使わない
+    std::uniform_int_distribution<int> sliceDist(1, 4);
+    std::vector<RGYNalCheckPacket> packets(CHECK_NAL_PACKET_COUNT);
+    for (int ipkt = 0; ipkt < CHECK_NAL_PACKET_COUNT; ipkt++) {
+        auto& pkt = packets[ipkt];
+        const bool idr = ipkt % 60 == 0;
+        std::vector<uint8_t> types;
+        if (hevc) {
+            types.push_back(NALU_HEVC_AUD);
+            if (idr) {
+                types.insert(types.end(), { NALU_HEVC_VPS, NALU_HEVC_SPS, NALU_HEVC_PPS, NALU_HEVC_PREFIX_SEI });
+            }
+            types.insert(types.end(), sliceDist(mt), (idr) ? CHECK_NAL_HEVC_IDR_W_RADL : CHECK_NAL_HEVC_TRAIL_R);
+        } else {
+            types.push_back(NALU_H264_AUD);
+            if (idr) {
+                types.insert(types.end(), { NALU_H264_SPS, NALU_H264_PPS, NALU_H264_SEI });
+            }
+            types.insert(types.end(), sliceDist(mt), (uint8_t)((idr) ? NALU_H264_IDR : NALU_H264_NONIDR));
+        }
+        for (size_t i = 0; i < types.size(); i++) {
+            const size_t start = pkt.data.size();
+            if (i == 0 || (i & 1) || idr) {
+                pkt.data.push_back(0);
+            }
+            pkt.data.insert(pkt.data.end(), { 0, 0, 1 });
+            if (hevc) {
+                pkt.data.push_back((uint8_t)(types[i] << 1));
+                pkt.data.push_back(1);
+            } else {
+                pkt.data.push_back((uint8_t)(0x60 | types[i]));
+            }
+            const int payload = (i == 0) ? 1 : sizeDist(mt); // 先頭はAUD
+            for (int j = 0; j < payload; j++) {
+                pkt.data.push_back((uint8_t)byteDist(mt));
+            }
+            pkt.units.push_back(std::make_pair(start, pkt.data.size() - start));
+            pkt.types.push_back(types[i]);
+        }
+    }
+    return packets;
+}
+
+// AV1のOBU列を作成する (サイズフィールドの長さと拡張ヘッダの有無を混在させる)
+static std::vector<RGYNalCheckPacket> check_obu_gen() {
+    std::mt19937 mt(4567);
+    std::uniform_int_distribution<int> sizeDist(16, 20000);
+    std::uniform_int_distribution<int> byteDist(0, 255);
+    std::uniform_int_distribution<int> tileDist(1, 4);
+    std::vector<RGYNalCheckPacket> packets(CHECK_NAL_PACKET_COUNT);
+    for (int ipkt = 0; ipkt < CHECK_NAL_PACKET_COUNT; ipkt++) {
+        auto& pkt = packets[ipkt];
+        std::vector<uint8_t> types = { OBU_TEMPORAL_DELIMITER };
+        if (ipkt % 60 == 0) {
+            types.insert(types.end(), { OBU_SEQUENCE_HEADER, OBU_METADATA });
+        }
+        types.push_back(OBU_FRAME_HEADER);
+        types.insert(types.end(), tileDist(mt), (uint8_t)OBU_TILE_GROUP);
+        for (size_t i = 0; i < types.size(); i++) {
+            const size_t start = pkt.data.size();
+            const bool extension = (i & 1) != 0;
+            pkt.data.push_back((uint8_t)((types[i] << 3) | ((extension) ? 0x04 : 0x00) | 0x02));
+            if (extension) {
+                pkt.data.push_back(0x08);
+            }
+            const int payload = (types[i] == OBU_TEMPORAL_DELIMITER) ? 0 : sizeDist(mt);
+            const auto sizeData = get_av1_uleb_size_data(payload);
+            pkt.data.insert(pkt.data.end(), sizeData.begin(), sizeData.end());
+            for (int j = 0; j < payload; j++) {
+                pkt.data.push_back((uint8_t)byteDist(mt));
+            }
+            pkt.units.push_back(std::make_pair(start, pkt.data.size() - start));
+            pkt.types.push_back(types[i]);
+        }
+    }
+    return packets;
+}
+
+static bool check_nal_match(const RGYNalCheckPacket& pkt, const std::vector<nal_info>& list) {
+    if (list.size() != pkt.units.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < list.size(); i++) {
+        if (list[i].ptr != pkt.data.data() + pkt.units[i].first
+            || list[i].size != pkt.units[i].second
+            || list[i].type != pkt.types[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 結果のvectorを使いまわしながら全パケットを繰り返し分割し、一致しないパケット数と再確保の回数を数える
+template<typename Func>
+static bool check_nal_parse_print(const TCHAR *name, const std::vector<RGYNalCheckPacket>& packets, Func parse) {
+    std::vector<nal_info> list;
+    int mismatch = 0;
+    int realloc = 0;
+    RGYCheckTimer timer;
+    for (int irepeat = 0; irepeat < CHECK_NAL_REPEAT; irepeat++) {
+        for (const auto& pkt : packets) {
+            const auto prevData = list.data();
+            const auto prevCapacity = list.capacity();
+            parse(list, pkt.data.data(), pkt.data.size());
+            // 1周目で必要な容量は確保されているはず
+            if (irepeat > 0 && (list.data() != prevData || list.capacity() != prevCapacity)) {
+                realloc++;
+            }
+            if (irepeat == 0 && !check_nal_match(pkt, list)) {
+                mismatch++;
+            }
+        }
+    }
+    const double elapsed = timer.sec();
+    return rgy_check_print(name, mismatch == 0 && realloc == 0,
+        strsprintf(_T("mismatch %d, realloc %d, %8.3f us/packet"), mismatch, realloc, elapsed * 1e6 / (CHECK_NAL_REPEAT * packets.size())));
+}
+
+bool check_nal_parse() {
+    bool ok = true;
+#if defined(_M_IX86) || defined(_M_X64) || defined(__x86_64)
+    const auto simd = get_availableSIMD();
+#endif
+    {
+        const auto packets = check_nal_gen(false);
+        ok &= check_nal_parse_print(_T("h264 c"), packets, parse_nal_unit_h264_c);
+#if defined(_M_IX86) || defined(_M_X64) || defined(__x86_64)
+        if ((simd & RGY_SIMD::AVX2) == RGY_SIMD::AVX2) {
+            ok &= check_nal_parse_print(_T("h264 avx2"), packets, parse_nal_unit_h264_avx2);
+        }
+#if defined(_M_X64) || defined(__x86_64)
+        if ((simd & RGY_SIMD::AVX512BW) == RGY_SIMD::AVX512BW) {
+            ok &= check_nal_parse_print(_T("h264 avx512bw"), packets, parse_nal_unit_h264_avx512bw);
+        }
+#endif
+#endif
+    }
+    {
+        const auto packets = check_nal_gen(true);
+        ok &= check_nal_parse_print(_T("hevc c"), packets, parse_nal_unit_hevc_c);
+#if defined(_M_IX86) || defined(_M_X64) || defined(__x86_64)
+        if ((simd & RGY_SIMD::AVX2) == RGY_SIMD::AVX2) {
+            ok &= check_nal_parse_print(_T("hevc avx2"), packets, parse_nal_unit_hevc_avx2);
+        }
+#if defined(_M_X64) || defined(__x86_64)
+        if ((simd & RGY_SIMD::AVX512BW) == RGY_SIMD::AVX512BW) {
+            ok &= check_nal_parse_print(_T("hevc avx512bw"), packets, parse_nal_unit_hevc_avx512bw);
+        }
+#endif
+#endif
+    }
+    {
+        const auto packets = check_obu_gen();
+        ok &= check_nal_parse_print(_T("av1 obu"), packets, [](std::vector<nal_info>& list, const uint8_t *data, const size_t size) {
+            parse_unit_av1(list, data, size);
+        });
+        // OBUごとにコピーする版 (AV1の再mux用) と比較する
+        int mismatch = 0;
+        RGYCheckTimer timer;
+        for (int irepeat = 0; irepeat < CHECK_NAL_REPEAT; irepeat++) {
+            for (const auto& pkt : packets) {
+                const auto units = parse_unit_av1(pkt.data.data(), pkt.data.size());
+                if (irepeat > 0) {
+                    continue;
+                }
+                bool match = units.size() == pkt.units.size();
+                for (size_t i = 0; match && i < units.size(); i++) {
+                    match = units[i]->type == pkt.types[i]
+                        && units[i]->unit_data.size() == pkt.units[i].second
+                        && memcmp(units[i]->unit_data.data(), pkt.data.data() + pkt.units[i].first, pkt.units[i].second) == 0;
+                }
+                if (!match) {
+                    mismatch++;
+                }
+            }
+        }
+        const double elapsed = timer.sec();
+        ok &= rgy_check_print(_T("av1 obu (copy)"), mismatch == 0,
+            strsprintf(_T("mismatch %d, %8.3f us/packet"), mismatch, elapsed * 1e6 / (CHECK_NAL_REPEAT * packets.size())));
+    }
+    return rgy_check_print_total(ok);
+}
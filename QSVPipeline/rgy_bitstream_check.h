@@ -0,0 +1,50 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __RGY_BITSTREAM_CHECK_H__
+#define __RGY_BITSTREAM_CHECK_H__
+
+#include "rgy_tchar.h"
+
+// Dolby Vision RPUファイルの読み込みの確認と速度計測
+// 空のRPUを含むRPUファイルを一時フォルダに作成し、メモリマップして索引を作成する場合と
+// 先頭から順に読み込む場合のそれぞれで、各フレームのRPUが一致すること
+// (空のRPUのフレームはRPUなしとなり、以降のフレームのRPUがずれないこと) を確認したうえで、
+// 1フレームあたりの取得時間を表示する
+//   戻り値  ... すべてのRPUが一致すればtrue
+bool check_dovi_rpu();
+
+// NAL/OBUの分割の確認と速度計測
+// 開始コードの長さやスライス数を変えたH.264/HEVCのパケットとAV1のOBU列を作成し、
+// C/AVX2/AVX512BW版の分割結果が作成時の位置・種類と一致すること、
+// 結果を格納するvectorを使いまわす場合に2回目以降メモリ確保が発生しないことを確認したうえで、
+// 1パケットあたりの処理時間を表示する
+//   戻り値  ... すべての分割結果が一致すればtrue
+bool check_nal_parse();
+
+#endif //__RGY_BITSTREAM_CHECK_H__
@@ -0,0 +1,262 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#include <algorithm>
+#if !(defined(_WIN32) || defined(_WIN64))
+#include <sys/mman.h>
+#endif
+#include "rgy_bitstream_pool.h"
+#include "rgy_util.h"
+
+static const size_t POOL_BUFFER_ALIGN         = 32;                //RGYBitstream::initと同じアライメント
+static const size_t POOL_HUGE_PAGE_SIZE       = 2 * 1024 * 1024;   //これ以上のバッファはhuge pageでの確保を試みる (Linuxのみ)
+static const size_t POOL_KEEP_BYTES_PER_CLASS = 256 * 1024 * 1024; //サイズクラスごとにプールに保持するサイズの上限
+static const size_t POOL_KEEP_MIN_PER_CLASS   = 8;                 //サイズクラスごとにプールに保持する数の下限
+static const size_t POOL_KEEP_BITSTREAM_MAX   = 256;               //getBitstreamで使いまわすRGYBitstreamの保持数の上限
+static const size_t POOL_KEEP_BITSTREAM_BYTES = 256 * 1024 * 1024; //getBitstreamで使いまわすRGYBitstreamのバッファの合計サイズの上限
+
+//size以上のバッファを格納する最小のサイズクラス (該当なしなら-1)
+static int pool_class_for_alloc(size_t size) {
+    int shift = RGYBitstreamPool::POOL_CLASS_MIN_SHIFT;
+    while (shift < RGYBitstreamPool::POOL_CLASS_MAX_SHIFT && ((size_t)1 << shift) < size) {
+        shift++;
+    }
+    return (((size_t)1 << shift) < size) ? -1 : shift - RGYBitstreamPool::POOL_CLASS_MIN_SHIFT;
+}
+
+//bufsizeのバッファを格納するサイズクラス (bufsize以下の最大のクラス、該当なしなら-1)
+static int pool_class_for_release(size_t bufsize) {
+    if (bufsize < ((size_t)1 << RGYBitstreamPool::POOL_CLASS_MIN_SHIFT)) {
+        return -1;
+    }
+    int shift = RGYBitstreamPool::POOL_CLASS_MIN_SHIFT;
+    while (shift < RGYBitstreamPool::POOL_CLASS_MAX_SHIFT && ((size_t)1 << (shift + 1)) <= bufsize) {
+        shift++;
+    }
+    return shift - RGYBitstreamPool::POOL_CLASS_MIN_SHIFT;
+}
+
+RGYBitstreamPool::RGYBitstreamPool() :
+    m_mtx(),
+    m_free(),
+    m_freeBitstream(),
+    m_freeBitstreamBytes(0),
+    m_allocCount(0),
+    m_reuseCount(0),
+    m_releaseCount(0),
+    m_dropCount(0),
+    m_bitstreamDropCount(0),
+    m_pooledBytes(0),
+    m_pooledBytesPeak(0),
+    m_hugePageBytes(0) {
+}
+
+RGYBitstreamPool::~RGYBitstreamPool() {
+    for (auto& bs : m_freeBitstream) {
+        bs->clear();
+        delete bs;
+    }
+    m_freeBitstream.clear();
+    m_freeBitstreamBytes = 0;
+    for (auto& list : m_free) {
+        for (auto& buf : list) {
+            _aligned_free(buf.first);
+        }
+        list.clear();
+    }
+}
+
+std::shared_ptr<RGYBitstreamPool> RGYBitstreamPool::get() {
+    static std::mutex mtxPool;
+    static std::weak_ptr<RGYBitstreamPool> poolShared;
+    std::lock_guard<std::mutex> lock(mtxPool);
+    auto pool = poolShared.lock();
+    if (!pool) {
+        pool = std::make_shared<RGYBitstreamPool>();
+        poolShared = pool;
+    }
+    return pool;
+}
+
+uint8_t *RGYBitstreamPool::allocBuffer(size_t size, size_t *bufsize) {
+    const int cls = pool_class_for_alloc(size);
+    if (cls >= 0) {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        if (m_free[cls].size() > 0) {
+            auto buf = m_free[cls].back();
+            m_free[cls].pop_back();
+            m_pooledBytes -= buf.second;
+            m_reuseCount++;
+            *bufsize = buf.second;
+            return buf.first;
+        }
+    }
+    //プールに空きがなければ新たに確保する
+    const size_t allocSize = (cls >= 0) ? (size_t)1 << (cls + POOL_CLASS_MIN_SHIFT) : size;
+#if defined(MADV_HUGEPAGE)
+    const bool useHugePage = allocSize >= POOL_HUGE_PAGE_SIZE;
+#else
+    //Windowsでlarge pageを使うにはVirtualAllocと特権が必要で、RGYBitstream側の_aligned_freeと混在できないので、
+    //通常のアライメントで確保する
+    const bool useHugePage = false;
+#endif
+    auto ptr = (uint8_t *)_aligned_malloc(allocSize, (useHugePage) ? POOL_HUGE_PAGE_SIZE : POOL_BUFFER_ALIGN);
+    if (ptr == nullptr) {
+        return nullptr;
+    }
+    bool hugePage = false;
+#if defined(MADV_HUGEPAGE)
+    //transparent huge pageを使用するよう指示する (使用できない環境では失敗するだけ)
+    if (useHugePage) {
+        hugePage = madvise(ptr, allocSize, MADV_HUGEPAGE) == 0;
+    }
+#endif
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_allocCount++;
+    if (hugePage) {
+        m_hugePageBytes += allocSize;
+    }
+    *bufsize = allocSize;
+    return ptr;
+}
+
+void RGYBitstreamPool::releaseBuffer(uint8_t *ptr, size_t bufsize) {
+    if (ptr == nullptr) {
+        return;
+    }
+    const int cls = pool_class_for_release(bufsize);
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_releaseCount++;
+        if (cls >= 0) {
+            const size_t keepCount = std::max(POOL_KEEP_MIN_PER_CLASS, POOL_KEEP_BYTES_PER_CLASS >> (cls + POOL_CLASS_MIN_SHIFT));
+            if (m_free[cls].size() < keepCount) {
+                m_free[cls].push_back(std::make_pair(ptr, bufsize));
+                m_pooledBytes += bufsize;
+                m_pooledBytesPeak = std::max(m_pooledBytesPeak, m_pooledBytes);
+                return;
+            }
+        }
+        //あまり多すぎると無駄にメモリを使用するので解放する
+        m_dropCount++;
+    }
+    _aligned_free(ptr);
+}
+
+RGY_ERR RGYBitstreamPool::alloc(RGYBitstream *bs, size_t size) {
+    if (bs->bufptr() && bs->bufsize() >= size) {
+        //既存のバッファで足りる場合はそのまま使う
+        bs->setSize(0);
+        bs->setOffset(0);
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_reuseCount++;
+        return RGY_ERR_NONE;
+    }
+    release(bs);
+    size_t bufsize = 0;
+    auto ptr = allocBuffer(size, &bufsize);
+    if (ptr == nullptr) {
+        return RGY_ERR_NULL_PTR;
+    }
+    bs->attach(ptr, bufsize);
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR RGYBitstreamPool::extend(RGYBitstream *bs, size_t size) {
+    if (bs->bufptr() && bs->bufsize() >= size) {
+        return RGY_ERR_NONE;
+    }
+    size_t bufsize = 0;
+    auto ptr = allocBuffer(size, &bufsize);
+    if (ptr == nullptr) {
+        return RGY_ERR_NULL_PTR;
+    }
+    const auto dataLength = std::min(bs->size(), bufsize);
+    if (dataLength > 0) {
+        memcpy(ptr, bs->data(), dataLength);
+    }
+    release(bs);
+    bs->attach(ptr, bufsize);
+    bs->setSize(dataLength);
+    return RGY_ERR_NONE;
+}
+
+void RGYBitstreamPool::release(RGYBitstream *bs) {
+    const auto bufsize = bs->bufsize();
+    releaseBuffer(bs->detach(), bufsize);
+}
+
+std::shared_ptr<RGYBitstream> RGYBitstreamPool::getBitstream(size_t size) {
+    RGYBitstream *bs = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        if (m_freeBitstream.size() > 0) {
+            bs = m_freeBitstream.back();
+            m_freeBitstream.pop_back();
+            m_freeBitstreamBytes -= bs->bufsize();
+        }
+    }
+    if (bs == nullptr) {
+        bs = new RGYBitstream(RGYBitstreamInit());
+    }
+    if (alloc(bs, size) != RGY_ERR_NONE) {
+        bs->clear();
+        delete bs;
+        return std::shared_ptr<RGYBitstream>();
+    }
+    //返却時はバッファを付けたまま保持し、次回のgetBitstreamで再利用する
+    return std::shared_ptr<RGYBitstream>(bs, [pool = shared_from_this()](RGYBitstream *ptr) {
+        {
+            std::lock_guard<std::mutex> lock(pool->m_mtx);
+            if (pool->m_freeBitstream.size() < POOL_KEEP_BITSTREAM_MAX
+                && pool->m_freeBitstreamBytes + ptr->bufsize() <= POOL_KEEP_BITSTREAM_BYTES) {
+                pool->m_freeBitstream.push_back(ptr);
+                pool->m_freeBitstreamBytes += ptr->bufsize();
+                return;
+            }
+            pool->m_bitstreamDropCount++;
+        }
+        //保持数の上限を超えたら、バッファはサイズクラスごとのプールに返却し、RGYBitstreamは破棄する
+        pool->release(ptr);
+        delete ptr;
+    });
+}
+
+tstring RGYBitstreamPool::stats() {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    size_t pooledCount = 0;
+    for (const auto& list : m_free) {
+        pooledCount += list.size();
+    }
+    //getBitstreamで保持しているRGYBitstreamのバッファも合わせて表示する
+    return strsprintf(_T("alloc %lld, reuse %lld, release %lld, drop %lld, pooled %d buffers %.1f MB (peak %.1f MB), ")
+        _T("bitstream %d/%d %.1f MB (drop %lld), huge page %.1f MB"),
+        (long long)m_allocCount, (long long)m_reuseCount, (long long)m_releaseCount, (long long)m_dropCount,
+        (int)pooledCount, m_pooledBytes / (double)(1024 * 1024), m_pooledBytesPeak / (double)(1024 * 1024),
+        (int)m_freeBitstream.size(), (int)POOL_KEEP_BITSTREAM_MAX, m_freeBitstreamBytes / (double)(1024 * 1024), (long long)m_bitstreamDropCount,
+        m_hugePageBytes / (double)(1024 * 1024));
+}
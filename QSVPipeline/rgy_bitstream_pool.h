@@ -0,0 +1,98 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __RGY_BITSTREAM_POOL_H__
+#define __RGY_BITSTREAM_POOL_H__
+
+#include <cstdint>
+#include <array>
+#include <utility>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include "rgy_osdep.h"
+#include "rgy_tchar.h"
+#include "rgy_err.h"
+#include "rgy_version.h"
+#if ENCODER_NVENC
+#include "NVEncUtil.h"
+#endif //#if ENCODER_NVENC
+#if ENCODER_QSV
+#include "qsv_util.h"
+#endif //#if ENCODER_QSV
+#if ENCODER_VCEENC
+#include "vce_util.h"
+#endif //#if ENCODER_VCEENC
+
+// RGYBitstreamのバッファを使いまわすためのプール
+// バッファは2のべき乗のサイズクラスごとに管理し、エンコーダの出力・muxスレッド・raw出力で共有する
+// バッファは_aligned_mallocで確保するので、RGYBitstream側で拡張・解放されても問題ない
+// 2MB以上のバッファは、Linuxでは2MBアライメントで確保してtransparent huge pageの使用を指示する (Windowsは通常のアライメント)
+class RGYBitstreamPool : public std::enable_shared_from_this<RGYBitstreamPool> {
+public:
+    static const int POOL_CLASS_MIN_SHIFT = 12; //最小のサイズクラス (4KB)
+    static const int POOL_CLASS_MAX_SHIFT = 31; //最大のサイズクラス (2GB)
+    static const int POOL_CLASS_NUM = POOL_CLASS_MAX_SHIFT - POOL_CLASS_MIN_SHIFT + 1;
+
+    RGYBitstreamPool();
+    ~RGYBitstreamPool();
+
+    //プロセス内で共有されるプールを取得する
+    static std::shared_ptr<RGYBitstreamPool> get();
+
+    //bsにsize以上のバッファを割り当てる (bsの既存のバッファはプールに返却し、データは破棄する)
+    RGY_ERR alloc(RGYBitstream *bs, size_t size);
+    //bsのバッファをsize以上に拡張する (データは保持する)
+    RGY_ERR extend(RGYBitstream *bs, size_t size);
+    //bsのバッファをプールに返却し、bsを空にする
+    void release(RGYBitstream *bs);
+    //size以上のバッファを持つRGYBitstreamを取得する
+    //参照がなくなると、自動的にバッファとRGYBitstreamがプールに返却される
+    std::shared_ptr<RGYBitstream> getBitstream(size_t size);
+
+    //統計情報 (デバッグログ用)
+    tstring stats();
+protected:
+    uint8_t *allocBuffer(size_t size, size_t *bufsize);
+    void releaseBuffer(uint8_t *ptr, size_t bufsize);
+
+    std::mutex m_mtx;
+    std::array<std::vector<std::pair<uint8_t *, size_t>>, POOL_CLASS_NUM> m_free; //サイズクラスごとの空きバッファとそのサイズ
+    std::vector<RGYBitstream *> m_freeBitstream;              //getBitstreamで使いまわすRGYBitstream (バッファ付き、保持数・サイズに上限あり)
+    size_t m_freeBitstreamBytes;                              //m_freeBitstreamのバッファの合計サイズ
+    int64_t m_allocCount;     //新たに確保した回数
+    int64_t m_reuseCount;     //プールのバッファを再利用した回数
+    int64_t m_releaseCount;   //プールに返却された回数
+    int64_t m_dropCount;      //プールが一杯で解放した回数
+    int64_t m_bitstreamDropCount; //m_freeBitstreamが一杯でRGYBitstreamを破棄した回数
+    size_t m_pooledBytes;     //プールにある空きバッファの合計サイズ
+    size_t m_pooledBytesPeak; //プールにある空きバッファの合計サイズの最大値
+    size_t m_hugePageBytes;   //huge pageを使用して確保したサイズの合計
+};
+
+#endif //__RGY_BITSTREAM_POOL_H__
@@ -0,0 +1,87 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#include "rgy_check.h"
+#include "rgy_osdep.h"
+#include "rgy_util.h"
+
+int rgy_check_run(const RGYCheckEntry *list, const size_t count, const TCHAR *option_name, const TCHAR *arg) {
+    for (size_t i = 0; i < count; i++) {
+        if (0 == _tcscmp(option_name, list[i].option)) {
+            const tstring value = (arg != nullptr && arg[0] != _T('-')) ? arg : _T("");
+            return list[i].func(value) ? 1 : -1;
+        }
+    }
+    return 0;
+}
+
+RGYCheckTempFile::RGYCheckTempFile(const char *name) :
+    m_filePath(std::filesystem::temp_directory_path() / (std::string("qsvencc_") + name + "_" + std::to_string(GetCurrentProcessId()) + ".bin")),
+    m_path() {
+#if defined(_WIN32) || defined(_WIN64)
+    m_path = wstring_to_tstring(m_filePath.wstring());
+#else
+    m_path = m_filePath.string();
+#endif
+}
+
+RGYCheckTempFile::~RGYCheckTempFile() {
+    std::error_code ec;
+    std::filesystem::remove(m_filePath, ec);
+}
+
+bool RGYCheckTempFile::create(const std::function<bool(FILE *fp)>& writer) {
+    FILE *fp = nullptr;
+    if (_tfopen_s(&fp, m_path.c_str(), _T("wb")) != 0 || fp == nullptr) {
+        _ftprintf(stderr, _T("Failed to create %s.\n"), m_path.c_str());
+        return false;
+    }
+    const bool written = writer(fp);
+    fclose(fp);
+    if (!written) {
+        _ftprintf(stderr, _T("Failed to write %s.\n"), m_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool rgy_check_print(const TCHAR *name, const bool ok, const tstring& info) {
+    _ftprintf(stdout, _T("%-28s %s %s\n"), name, (ok) ? _T("ok") : _T("NG"), info.c_str());
+    fflush(stdout);
+    return ok;
+}
+
+void rgy_check_print_info(const TCHAR *name, const tstring& info) {
+    _ftprintf(stdout, _T("%-28s    %s\n"), name, info.c_str());
+    fflush(stdout);
+}
+
+bool rgy_check_print_total(const bool ok) {
+    _ftprintf(stdout, _T("%s\n"), (ok) ? _T("OK") : _T("NG"));
+    fflush(stdout);
+    return ok;
+}
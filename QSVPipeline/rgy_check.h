@@ -0,0 +1,92 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __RGY_CHECK_H__
+#define __RGY_CHECK_H__
+
+#include <cstdio>
+#include <chrono>
+#include <functional>
+#include <filesystem>
+#include "rgy_tchar.h"
+
+// --check-xxx の動作確認・速度計測で共通に使用する処理
+
+// --check-xxx の一覧の各項目
+//   option  ... オプション名 ("check-xxx")
+//   func    ... 動作確認の本体、引数はオプションに続く値 (値がなければ空文字列)
+//               すべての確認が成功すればtrueを返す
+struct RGYCheckEntry {
+    const TCHAR *option;
+    bool (*func)(const tstring& arg);
+};
+
+// option_nameに該当する項目を一覧から探して実行する
+//   戻り値  ... 成功 1 / 失敗 -1 / 該当する項目なし 0
+int rgy_check_run(const RGYCheckEntry *list, const size_t count, const TCHAR *option_name, const TCHAR *arg);
+
+// 経過時間の計測
+class RGYCheckTimer {
+public:
+    RGYCheckTimer() : m_start(std::chrono::steady_clock::now()) {};
+    void restart() {
+        m_start = std::chrono::steady_clock::now();
+    }
+    // 開始からの経過時間 (秒)
+    double sec() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    }
+private:
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// 確認用の一時ファイル、デストラクタで削除する
+class RGYCheckTempFile {
+public:
+    // 一時フォルダに "qsvencc_<name>_<プロセスID>.bin" を作成する
+    RGYCheckTempFile(const char *name);
+    ~RGYCheckTempFile();
+    // ファイルを作成し、writerで内容を書き込む
+    //   戻り値  ... 作成と書き込みに成功すればtrue
+    bool create(const std::function<bool(FILE *fp)>& writer);
+    const tstring& path() const { return m_path; }
+protected:
+    std::filesystem::path m_filePath;
+    tstring m_path;
+};
+
+// 各項目の結果を "項目名 ok/NG 詳細" の形式で表示する
+//   戻り値  ... okをそのまま返す
+bool rgy_check_print(const TCHAR *name, const bool ok, const tstring& info);
+// 成否のない項目 (速度の比較対象など) を "項目名 詳細" の形式で表示する
+void rgy_check_print_info(const TCHAR *name, const tstring& info);
+// 全体の結果 OK/NG を表示する
+//   戻り値  ... okをそのまま返す
+bool rgy_check_print_total(const bool ok);
+
+#endif //__RGY_CHECK_H__
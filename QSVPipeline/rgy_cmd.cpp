@@ -447,7 +447,7 @@ int parse_one_vpp_option(const TCHAR *option_name, const TCHAR *strInput[], int
         const auto paramList = std::vector<std::string>{
             "matrix", "colormatrix", "colorprim", "transfer", "range", "colorrange", "source_peak", "approx_gamma",
             "hdr2sdr", "ldr_nits", "a", "b", "c", "d", "e", "f", "contrast", "peak",
-            "desat_base", "desat_strength", "desat_exp", "lut3d", "lut3d_interp" };
+            "desat_base", "desat_strength", "desat_exp", "lut3d", "lut3d_interp", "fuse_lut" };
 
         for (const auto &param : param_list) {
             auto pos = param.find_first_of(_T("="));
@@ -695,6 +695,26 @@ int parse_one_vpp_option(const TCHAR *option_name, const TCHAR *strInput[], int
                     }
                     continue;
                 }
+                if (param_arg == _T("fuse_lut")) {
+                    bool b = false;
+                    if (!cmd_string_to_bool(&b, param_val)) {
+                        vpp->colorspace.fuse_lut = (b) ? FILTER_DEFAULT_COLORSPACE_FUSE_LUT_SIZE : 0;
+                        continue;
+                    }
+                    try {
+                        const int size = std::stoi(param_val);
+                        if (size != 0 && (size < 2 || size > FILTER_COLORSPACE_FUSE_LUT_SIZE_MAX)) {
+                            print_cmd_error_invalid_value(tstring(option_name) + _T(" ") + param_arg + _T("="), param_val,
+                                strsprintf(_T("fuse_lut should be 0 or in range of 2 - %d.\n"), FILTER_COLORSPACE_FUSE_LUT_SIZE_MAX));
+                            return 1;
+                        }
+                        vpp->colorspace.fuse_lut = size;
+                    } catch (...) {
+                        print_cmd_error_invalid_value(tstring(option_name) + _T(" ") + param_arg + _T("="), param_val);
+                        return 1;
+                    }
+                    continue;
+                }
                 print_cmd_error_unknown_opt_param(option_name, param_arg, paramList);
                 return 1;
             } else {
@@ -702,6 +722,10 @@ int parse_one_vpp_option(const TCHAR *option_name, const TCHAR *strInput[], int
                     vpp->colorspace.hdr2sdr.tonemap = HDR2SDR_HABLE;
                     continue;
                 }
+                if (param == _T("fuse_lut")) {
+                    vpp->colorspace.fuse_lut = FILTER_DEFAULT_COLORSPACE_FUSE_LUT_SIZE;
+                    continue;
+                }
                 print_cmd_error_unknown_opt_param(option_name, param, paramList);
                 return 1;
             }
@@ -4926,6 +4950,31 @@ int parse_one_common_option(const TCHAR *option_name, const TCHAR *strInput[], i
         common->metric.psnr = false;
         return 0;
     }
+    if (IS_OPTION("metric-device")) {
+        i++;
+        int value = 0;
+        if (get_list_value(list_metric_device, strInput[i], &value)) {
+            common->metric.device = (RGYMetricDevice)value;
+        } else {
+            print_cmd_error_invalid_value(option_name, strInput[i], list_metric_device);
+            return 1;
+        }
+        return 0;
+    }
+    if (IS_OPTION("metric-threads")) {
+        i++;
+        int value = 0;
+        if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
+            print_cmd_error_invalid_value(option_name, strInput[i]);
+            return 1;
+        }
+        if (value < 0) {
+            print_cmd_error_invalid_value(option_name, strInput[i], _T("--metric-threads should be set in positive value."));
+            return 1;
+        }
+        common->metric.cpuThreads = value;
+        return 0;
+    }
 #endif
 #if ENABLE_VMAF
     if (IS_OPTION("no-vmaf")) {
@@ -5057,7 +5106,7 @@ int parse_one_ctrl_option(const TCHAR *option_name, const TCHAR *strInput[], int
             return 1;
         }
         i++;
-        const auto paramList = std::vector<std::string>{ "addtime", "framelist", "packets" };
+        const auto paramList = std::vector<std::string>{ "addtime", "framelist", "packets", "async", "drop", "json" };
 
         for (const auto &param : split(strInput[i], _T(","))) {
             auto pos = param.find_first_of(_T("="));
@@ -5095,6 +5144,30 @@ int parse_one_ctrl_option(const TCHAR *option_name, const TCHAR *strInput[], int
                     }
                     continue;
                 }
+                if (param_arg == _T("async")) {
+                    bool b = false;
+                    if (!cmd_string_to_bool(&b, param_val)) {
+                        ctrl->logAsync = b;
+                    } else {
+                        print_cmd_error_invalid_value(tstring(option_name) + _T(" ") + param_arg + _T("="), param_val);
+                        return 1;
+                    }
+                    continue;
+                }
+                if (param_arg == _T("drop")) {
+                    bool b = false;
+                    if (!cmd_string_to_bool(&b, param_val)) {
+                        ctrl->logAsyncDrop = b;
+                    } else {
+                        print_cmd_error_invalid_value(tstring(option_name) + _T(" ") + param_arg + _T("="), param_val);
+                        return 1;
+                    }
+                    continue;
+                }
+                if (param_arg == _T("json")) {
+                    ctrl->logJsonFile = param_val;
+                    continue;
+                }
                 print_cmd_error_unknown_opt_param(option_name, param_arg, paramList);
                 return 1;
             } else {
@@ -5107,6 +5180,12 @@ int parse_one_ctrl_option(const TCHAR *option_name, const TCHAR *strInput[], int
                 } else if (param == _T("packets")) {
                     ctrl->logPacketsList = true;
                     continue;
+                } else if (param == _T("async")) {
+                    ctrl->logAsync = true;
+                    continue;
+                } else if (param == _T("drop")) {
+                    ctrl->logAsyncDrop = true;
+                    continue;
                 } else {
                     print_cmd_error_unknown_opt_param(option_name, param, paramList);
                     return 1;
@@ -5416,6 +5495,20 @@ int parse_one_ctrl_option(const TCHAR *option_name, const TCHAR *strInput[], int
         ctrl->outputBufSizeMB = (std::min)(value, RGY_OUTPUT_BUF_MB_MAX);
         return 0;
     }
+    if (IS_OPTION("input-read-ahead")) {
+        i++;
+        int value = 0;
+        if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
+            print_cmd_error_invalid_value(option_name, strInput[i]);
+            return 1;
+        }
+        if (value < 0) {
+            print_cmd_error_invalid_value(option_name, strInput[i], _T("--input-read-ahead should be set in positive value."));
+            return 1;
+        }
+        ctrl->inputReadAheadMB = (std::min)(value, RGY_INPUT_READ_AHEAD_MB_MAX);
+        return 0;
+    }
     if (IS_OPTION("thread-csp")) {
         i++;
         int value = 0;
@@ -5473,6 +5566,11 @@ int parse_one_ctrl_option(const TCHAR *option_name, const TCHAR *strInput[], int
         ctrl->perfMonitorInterval = std::max(50, v);
         return 0;
     }
+    if (IS_OPTION("trace-file")) {
+        i++;
+        ctrl->traceFile = strInput[i];
+        return 0;
+    }
     if (IS_OPTION("parent-pid")) {
         i++;
         try {
@@ -5577,6 +5675,17 @@ int parse_one_ctrl_option(const TCHAR *option_name, const TCHAR *strInput[], int
         ctrl->enableOpenCL = true;
         return 0;
     }
+    if (IS_OPTION("opencl-cache")) {
+        i++;
+        if (_tcsicmp(strInput[i], _T("auto")) == 0) {
+            ctrl->clProgramCache.clear();
+        } else if (_tcsicmp(strInput[i], _T("off")) == 0 || _tcsicmp(strInput[i], _T("none")) == 0) {
+            ctrl->clProgramCache = RGY_CL_PROGRAM_CACHE_OFF;
+        } else {
+            ctrl->clProgramCache = strInput[i];
+        }
+        return 0;
+    }
 #endif
     return -10;
 }
@@ -5706,6 +5815,7 @@ tstring gen_cmd(const RGYParamVpp *param, const RGYParamVpp *defaultPrm, bool sa
                 ADD_BOOL(_T("scene_ref"), colorspace.convs[i].scene_ref);
                 ADD_PATH(_T("lut3d"), colorspace.lut3d.table_file.c_str());
                 ADD_LST(_T("lut3d_interp"), colorspace.lut3d.interp, list_vpp_colorspace_lut3d_interp);
+                ADD_NUM(_T("fuse_lut"), colorspace.fuse_lut);
                 ADD_LST(_T("hdr2sdr"), colorspace.hdr2sdr.tonemap, list_vpp_hdr2sdr);
                 ADD_FLOAT(_T("ldr_nits"), colorspace.hdr2sdr.ldr_nits, 1);
                 ADD_FLOAT(_T("source_peak"), colorspace.hdr2sdr.hdr_source_peak, 1);
@@ -6544,6 +6654,8 @@ tstring gen_cmd(const RGYParamCommon *param, const RGYParamCommon *defaultPrm, b
 
     OPT_BOOL(_T("--ssim"), _T("--no-ssim"), metric.ssim);
     OPT_BOOL(_T("--psnr"), _T("--no-psnr"), metric.psnr);
+    OPT_LST(_T("--metric-device"), metric.device, list_metric_device);
+    OPT_NUM(_T("--metric-threads"), metric.cpuThreads);
 
     if (param->metric.vmaf != defaultPrm->metric.vmaf) {
         tmp.str(tstring());
@@ -6570,6 +6682,7 @@ tstring gen_cmd(const RGYParamCommon *param, const RGYParamCommon *defaultPrm, b
 tstring gen_cmd(const RGYParamControl *param, const RGYParamControl *defaultPrm, bool save_disabled_prm) {
     std::basic_stringstream<TCHAR> cmd;
     OPT_NUM(_T("--output-buf"), outputBufSizeMB);
+    OPT_NUM(_T("--input-read-ahead"), inputReadAheadMB);
     OPT_NUM(_T("--thread-output"), threadOutput);
     OPT_NUM(_T("--thread-input"), threadInput);
     OPT_NUM(_T("--thread-audio"), threadAudio);
@@ -6587,12 +6700,24 @@ tstring gen_cmd(const RGYParamControl *param, const RGYParamControl *defaultPrm,
         cmd << _T(" --log-level ") << param->loglevel.to_string();
     }
 
-    if (param->logAddTime != defaultPrm->logAddTime) {
+    if (param->logAddTime != defaultPrm->logAddTime
+        || param->logAsync != defaultPrm->logAsync
+        || param->logAsyncDrop != defaultPrm->logAsyncDrop
+        || param->logJsonFile != defaultPrm->logJsonFile) {
         std::basic_stringstream<TCHAR> tmp;
         tmp.str(tstring());
         if (param->logAddTime != defaultPrm->logAddTime) {
             tmp << _T(",addtime");
         }
+        if (param->logAsync != defaultPrm->logAsync) {
+            tmp << _T(",async");
+        }
+        if (param->logAsyncDrop != defaultPrm->logAsyncDrop) {
+            tmp << _T(",drop");
+        }
+        if (param->logJsonFile != defaultPrm->logJsonFile) {
+            tmp << _T(",json=") << param->logJsonFile;
+        }
         if (!tmp.str().empty()) {
             cmd << _T(" --log-opt ") << tmp.str().substr(1);
         }
@@ -6621,6 +6746,7 @@ tstring gen_cmd(const RGYParamControl *param, const RGYParamControl *defaultPrm,
         }
     }
     OPT_NUM(_T("--perf-monitor-interval"), perfMonitorInterval);
+    OPT_STR_PATH(_T("--trace-file"), traceFile);
     OPT_NUM(_T("--parent-pid"), parentProcessID);
     if (param->gpuSelect != defaultPrm->gpuSelect) {
         std::basic_stringstream<TCHAR> tmp;
@@ -6635,6 +6761,7 @@ tstring gen_cmd(const RGYParamControl *param, const RGYParamControl *defaultPrm,
     }
 #if ENCODER_QSV || ENCODER_VCEENC || ENCODER_MPP
     OPT_BOOL(_T("--enable-opencl"), _T("--disable-opencl"), enableOpenCL);
+    OPT_STR_PATH(_T("--opencl-cache"), clProgramCache);
 #endif
     return cmd.str();
 }
@@ -6930,6 +7057,10 @@ tstring gen_cmd_help_common() {
     str += _T("\n")
         _T("   --ssim                       calc ssim\n")
         _T("   --psnr                       calc psnr\n")
+        _T("   --metric-device <string>     device used to calc ssim/psnr\n")
+        _T("                                  - gpu (default), cpu\n")
+        _T("   --metric-threads <int>       threads used to calc ssim/psnr\n")
+        _T("                                  when --metric-device cpu (0 = auto)\n")
         _T("\n");
 #endif //#if !ENCODER_MPP
 #if ENABLE_VMAF
@@ -6975,12 +7106,16 @@ tstring gen_cmd_help_vpp() {
         _T("      ldr_nits=<float>        (default: %.1f)\n")
         _T("      desat_base=<float>      (default: %.2f)\n")
         _T("      desat_strength=<float>  (default: %.2f)\n")
-        _T("      desat_exp=<float>       (default: %.2f)\n"),
+        _T("      desat_exp=<float>       (default: %.2f)\n")
+        _T("      fuse_lut=<int>          (default: off, %d when enabled without size)\n")
+        _T("        run the whole conversion through a single 3D LUT of <int>^3,\n")
+        _T("        sampled from the analytic conversion and cached on disk.\n"),
         FILTER_DEFAULT_COLORSPACE_HDR_SOURCE_PEAK,
         FILTER_DEFAULT_COLORSPACE_LDRNITS,
         FILTER_DEFAULT_HDR2SDR_DESAT_BASE,
         FILTER_DEFAULT_HDR2SDR_DESAT_STRENGTH,
-        FILTER_DEFAULT_HDR2SDR_DESAT_EXP
+        FILTER_DEFAULT_HDR2SDR_DESAT_EXP,
+        FILTER_DEFAULT_COLORSPACE_FUSE_LUT_SIZE
     );
 #endif
     str += strsprintf(_T("")
@@ -7401,6 +7536,10 @@ tstring gen_cmd_help_ctrl() {
         _T("     additional options for log output.\n")
         _T("    params\n")
         _T("      addtime                   add time to log lines.\n")
+        _T("      async                     write log from a background thread.\n")
+        _T("      drop                      when async log buffer overflows, drop\n")
+        _T("                                 debug/trace messages instead of waiting.\n")
+        _T("      json=<string>             also write log as JSON lines (enables async).\n")
         _T("   --log-framelist              output debug info for avsw/avhw reader.\n")
         _T("   --log-packets                output debug info for avsw/avhw reader.\n"));
 
@@ -7415,6 +7554,14 @@ tstring gen_cmd_help_ctrl() {
         _T("                                 default %d MB (0-%d)\n"),
         RGY_OUTPUT_BUF_MB_DEFAULT, RGY_OUTPUT_BUF_MB_MAX
     );
+#if ENABLE_AVSW_READER
+    str += strsprintf(_T("")
+        _T("   --input-read-ahead <int>     read ahead input file in a separate thread\n")
+        _T("                                 with the buffer size in MByte (avhw/avsw reader)\n")
+        _T("                                 default 0 (off) (0-%d)\n"),
+        RGY_INPUT_READ_AHEAD_MB_MAX
+    );
+#endif //#if ENABLE_AVSW_READER
 #if ENABLE_AVCODEC_OUT_THREAD
     str += strsprintf(_T("")
         _T("   --output-thread <int>        set output thread num\n")
@@ -7500,7 +7647,10 @@ tstring gen_cmd_help_ctrl() {
 #endif //#if defined(_WIN32) || defined(_WIN64)
 #if ENCODER_QSV || ENCODER_VCEENC || ENCODER_MPP
     str += strsprintf(_T("\n")
-        _T("   --disable-opencl             disable opencl features.\n"));
+        _T("   --disable-opencl             disable opencl features.\n")
+        _T("   --opencl-cache <string>      set cache directory of OpenCL program binaries.\n")
+        _T("                                 auto ... use default directory (default)\n")
+        _T("                                 off  ... disable cache\n"));
 #endif
     str += strsprintf(_T("\n")
         _T("   --perf-monitor [<string>][,<string>]...\n")
@@ -7529,6 +7679,9 @@ tstring gen_cmd_help_ctrl() {
 #endif
         _T("                                 gpu         ... monitor all gpu info\n")
         _T("                                 queue       ... queue usage\n")
+        _T("                                 write_latency ... output write latency (ms)\n")
+        _T("                                 read_ahead  ... input read-ahead buffer usage (%%)\n")
+        _T("                                 aud_track   ... audio processing time per track (%%)\n")
         _T("                                 mem_private ... private memory (MB)\n")
         _T("                                 mem_virtual ... virtual memory (MB)\n")
         _T("                                 mem         ... monitor all memory info\n")
@@ -7542,6 +7695,8 @@ tstring gen_cmd_help_ctrl() {
         _T("                                 frame_out   ... written_frames\n")
         _T("                                 \n")
         _T("   --perf-monitor-interval <int> set perf monitor check interval (millisec)\n")
-        _T("                                 default 500, must be 50 or more\n"));
+        _T("                                 default 500, must be 50 or more\n")
+        _T("   --trace-file <string>        output per frame pipeline trace (Chrome trace json)\n")
+        _T("                                 which can be opened by Perfetto or chrome://tracing\n"));
     return str;
 }
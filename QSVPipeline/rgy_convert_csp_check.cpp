@@ -0,0 +1,357 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <random>
+#include <tuple>
+#include <algorithm>
+#include "rgy_convert_csp_check.h"
+#include "rgy_check.h"
+#include "rgy_osdep.h"
+#include "rgy_util.h"
+#include "rgy_simd.h"
+#include "cpu_info.h"
+#include "convert_csp.h"
+#include "rgy_input.h"
+
+// 確認するSIMDのレベル (下位の命令セットを含む)
+static const RGY_SIMD CHECK_CSP_SIMD_LEVELS[] = {
+    RGY_SIMD::NONE,
+    RGY_SIMD::SSE2,
+    RGY_SIMD::SSE2 | RGY_SIMD::SSE3 | RGY_SIMD::SSSE3,
+    RGY_SIMD::SSE2 | RGY_SIMD::SSE3 | RGY_SIMD::SSSE3 | RGY_SIMD::SSE41,
+    RGY_SIMD::SSE2 | RGY_SIMD::SSE3 | RGY_SIMD::SSSE3 | RGY_SIMD::SSE41 | RGY_SIMD::SSE42 | RGY_SIMD::AVX,
+    RGY_SIMD::SSE2 | RGY_SIMD::SSE3 | RGY_SIMD::SSSE3 | RGY_SIMD::SSE41 | RGY_SIMD::SSE42 | RGY_SIMD::AVX | RGY_SIMD::AVX2,
+    RGY_SIMD::SSE2 | RGY_SIMD::SSE3 | RGY_SIMD::SSSE3 | RGY_SIMD::SSE41 | RGY_SIMD::SSE42 | RGY_SIMD::AVX | RGY_SIMD::AVX2 | RGY_SIMD::AVX512F | RGY_SIMD::AVX512BW,
+};
+
+// 一致確認の試行回数 (progressive/interlacedそれぞれ)
+static const int CHECK_CSP_EXACT_TRIALS = 16;
+// 速度計測の1回あたりの最低計測時間
+static const double CHECK_CSP_BENCH_SEC = 0.05;
+// SIMD関数は行末を超えて読み書きすることがあるので、フレームの後ろに余白をとる
+static const int CHECK_CSP_FRAME_MARGIN = 256;
+
+// 1画素あたりのバイト数 (packedの場合は全成分、planarの場合は1成分)
+static int check_csp_pixel_size(const RGY_CSP csp) {
+    int pixsize = (RGY_CSP_BIT_DEPTH[csp] + 7) / 8;
+    switch (csp) {
+    case RGY_CSP_RGB24R:
+    case RGY_CSP_RGB24:
+    case RGY_CSP_BGR24:
+    case RGY_CSP_YC48:
+        pixsize *= 3;
+        break;
+    case RGY_CSP_RGB32R:
+    case RGY_CSP_RGB32:
+    case RGY_CSP_BGR32:
+    case RGY_CSP_AYUV:
+    case RGY_CSP_AYUV_16:
+    case RGY_CSP_Y416:
+        pixsize *= 4;
+        break;
+    case RGY_CSP_YUY2:
+    case RGY_CSP_Y210:
+    case RGY_CSP_Y216:
+    case RGY_CSP_Y410:
+        pixsize *= 2;
+        break;
+    default:
+        break;
+    }
+    return pixsize;
+}
+
+// SIMDの上下関係 (RGY_SIMDは上位の命令セットほど大きいビットに割り当てられている)
+static uint64_t check_csp_simd_rank(const RGY_SIMD simd) {
+    return (uint64_t)simd;
+}
+
+// 色差の間引きがあり、幅を偶数にする必要があるか
+static bool check_csp_need_even_width(const RGY_CSP csp) {
+    return RGY_CSP_CHROMA_FORMAT[csp] == RGY_CHROMAFMT_YUV420
+        || RGY_CSP_CHROMA_FORMAT[csp] == RGY_CHROMAFMT_YUV422;
+}
+
+// 変換の入出力用のフレーム
+// 変換関数には出力先の色差planeを輝度planeの直後にあるものとして扱うものがあるので、
+// 各planeはエンコーダのsurfaceと同様に連続した領域に配置する
+class RGYConvertCSPCheckFrame {
+public:
+    RGYConvertCSPCheckFrame() : m_csp(RGY_CSP_NA), m_planes(0), m_rowBytes(), m_rows(), m_pitch(), m_ptr(), m_size(0), m_buf() {};
+    ~RGYConvertCSPCheckFrame() {};
+
+    // pitchExtra ... pitchに追加する余白 (pitchの扱いの確認用)
+    void alloc(const RGY_CSP csp, const int width, const int height, const int pitchExtra) {
+        m_csp = csp;
+        m_planes = RGY_CSP_PLANES[csp];
+        const int pixsize = check_csp_pixel_size(csp);
+        RGYFrameInfo frame(width, height, csp, RGY_CSP_BIT_DEPTH[csp]);
+        size_t offset[RGY_MAX_PLANES] = { 0 };
+        m_size = 0;
+        for (int i = 0; i < m_planes; i++) {
+            const auto plane = getPlane(&frame, (RGY_PLANE)i);
+            m_rowBytes[i] = plane.width * pixsize;
+            if (i > 0 && csp == RGY_CSP_NV24) {
+                m_rowBytes[i] *= 2; // uvがインタリーブされている
+            }
+            m_rows[i] = plane.height;
+            m_pitch[i] = ALIGN(m_rowBytes[i], 64) + pitchExtra;
+            offset[i] = m_size;
+            m_size += (size_t)m_pitch[i] * m_rows[i];
+        }
+        m_size += CHECK_CSP_FRAME_MARGIN;
+        m_buf = std::unique_ptr<uint8_t, aligned_malloc_deleter>((uint8_t *)_aligned_malloc(m_size, 64), aligned_malloc_deleter());
+        memset(m_buf.get(), 0, m_size);
+        for (int i = 0; i < m_planes; i++) {
+            m_ptr[i] = m_buf.get() + offset[i];
+        }
+    }
+    // 色空間のbit深度に合わせた乱数で埋める
+    void fillRandom(std::mt19937& rng) {
+        const int bitdepth = RGY_CSP_BIT_DEPTH[m_csp];
+        for (int i = 0; i < m_planes; i++) {
+            for (int y = 0; y < m_rows[i]; y++) {
+                uint8_t *line = (uint8_t *)m_ptr[i] + (size_t)m_pitch[i] * y;
+                if (m_csp == RGY_CSP_YC48) {
+                    // Y: 0 - 4096, Cb/Cr: -2048 - 2048 を少しはみ出す範囲
+                    int16_t *ptr = (int16_t *)line;
+                    for (int x = 0; x < m_rowBytes[i] / 2; x++) {
+                        ptr[x] = (int16_t)((x % 3 == 0) ? (int)(rng() % 4400) - 200 : (int)(rng() % 4400) - 2200);
+                    }
+                } else if (bitdepth > 8) {
+                    const int shift = (cspShiftUsed(m_csp)) ? 16 - bitdepth : 0;
+                    uint16_t *ptr = (uint16_t *)line;
+                    for (int x = 0; x < m_rowBytes[i] / 2; x++) {
+                        ptr[x] = (uint16_t)((rng() & ((1 << bitdepth) - 1)) << shift);
+                    }
+                } else {
+                    for (int x = 0; x < m_rowBytes[i]; x++) {
+                        line[x] = (uint8_t)rng();
+                    }
+                }
+            }
+        }
+    }
+    // 有効な領域だけを比較し、一致しない画素値の最大の差を返す (一致していれば0)
+    int maxDiff(const RGYConvertCSPCheckFrame& other) const {
+        const bool is16 = RGY_CSP_BIT_DEPTH[m_csp] > 8;
+        int diff = 0;
+        for (int i = 0; i < m_planes; i++) {
+            for (int y = 0; y < m_rows[i]; y++) {
+                const uint8_t *a = (const uint8_t *)m_ptr[i] + (size_t)m_pitch[i] * y;
+                const uint8_t *b = (const uint8_t *)other.m_ptr[i] + (size_t)other.m_pitch[i] * y;
+                if (memcmp(a, b, m_rowBytes[i]) == 0) {
+                    continue;
+                }
+                if (is16) {
+                    for (int x = 0; x < m_rowBytes[i] / 2; x++) {
+                        diff = std::max(diff, std::abs((int)((const uint16_t *)a)[x] - (int)((const uint16_t *)b)[x]));
+                    }
+                } else {
+                    for (int x = 0; x < m_rowBytes[i]; x++) {
+                        diff = std::max(diff, std::abs((int)a[x] - (int)b[x]));
+                    }
+                }
+            }
+        }
+        return diff;
+    }
+    void **ptr() { return m_ptr; }
+    int pitch(int i) const { return m_pitch[std::min(i, m_planes - 1)]; }
+    size_t dataBytes() const {
+        size_t bytes = 0;
+        for (int i = 0; i < m_planes; i++) {
+            bytes += (size_t)m_rowBytes[i] * m_rows[i];
+        }
+        return bytes;
+    }
+protected:
+    RGY_CSP m_csp;
+    int m_planes;
+    int m_rowBytes[RGY_MAX_PLANES];
+    int m_rows[RGY_MAX_PLANES];
+    int m_pitch[RGY_MAX_PLANES];
+    void *m_ptr[RGY_MAX_PLANES];
+    size_t m_size;
+    std::unique_ptr<uint8_t, aligned_malloc_deleter> m_buf;
+};
+
+// ランダムな幅・crop・スレッド分割で、C実装との最大の差を返す
+static int check_convert_csp_exact(const ConvertCSP *func, const ConvertCSP *funcC, std::mt19937& rng) {
+    const bool evenWidth = check_csp_need_even_width(func->csp_from) || check_csp_need_even_width(func->csp_to);
+    int diff = 0;
+    for (int interlaced = 0; interlaced < 2; interlaced++) {
+        for (int itrial = 0; itrial < CHECK_CSP_EXACT_TRIALS; itrial++) {
+            // 幅はSIMDの処理単位の端数が出るように、高さはインタレースでも色差が割り切れるように
+            const int width  = (evenWidth) ? 2 * (32 + (int)(rng() % 200)) : 64 + (int)(rng() % 400);
+            const int height = 8 * (2 + (int)(rng() % 8));
+            const int cropAlignX = (evenWidth) ? 2 : 1;
+            const int cropAlignY = (interlaced) ? 4 : 2;
+            int crop[4] = {
+                cropAlignX * (int)(rng() % 8), cropAlignY * (int)(rng() % 2),
+                cropAlignX * (int)(rng() % 8), cropAlignY * (int)(rng() % 2)
+            };
+            const int dstWidth  = width  - crop[0] - crop[2];
+            const int dstHeight = height - crop[1] - crop[3];
+            RGYConvertCSPCheckFrame src, dst, dstC;
+            src.alloc(func->csp_from, width, height, 4 * (int)(rng() % 4));
+            dst.alloc(func->csp_to, dstWidth, dstHeight, 0);
+            dstC.alloc(func->csp_to, dstWidth, dstHeight, 0);
+            src.fillRandom(rng);
+            const void **srcPtr = (const void **)src.ptr();
+            funcC->func[interlaced](dstC.ptr(), srcPtr, width, src.pitch(0), src.pitch(1), dstC.pitch(0), height, dstHeight, 0, 1, crop);
+            const int threads = 1 + (int)(rng() % 3);
+            for (int ith = 0; ith < threads; ith++) {
+                func->func[interlaced](dst.ptr(), srcPtr, width, src.pitch(0), src.pitch(1), dst.pitch(0), height, dstHeight, ith, threads, crop);
+            }
+            diff = std::max(diff, dstC.maxDiff(dst));
+        }
+    }
+    return diff;
+}
+
+// RGYConvertCSPで変換を繰り返し、1秒あたりのフレーム数を返す
+static double check_convert_csp_bench(const ConvertCSP *func, RGYConvertCSPCheckFrame& src, RGYConvertCSPCheckFrame& dst, int width, int height, int threads) {
+    RGYConvertCSP convert(threads, RGYParamThread());
+    convert.getFunc(func->csp_from, func->csp_to, func->uv_only, func->simd);
+    int crop[4] = { 0 };
+    const void **srcPtr = (const void **)src.ptr();
+    void **dstPtr = dst.ptr();
+    convert.run(0, dstPtr, srcPtr, width, src.pitch(0), src.pitch(1), dst.pitch(0), height, height, crop); // ウォームアップ
+    int frames = 0;
+    RGYCheckTimer timer;
+    double elapsed = 0.0;
+    do {
+        convert.run(0, dstPtr, srcPtr, width, src.pitch(0), src.pitch(1), dst.pitch(0), height, height, crop);
+        frames++;
+        elapsed = timer.sec();
+    } while (elapsed < CHECK_CSP_BENCH_SEC || frames < 3);
+    return frames / elapsed;
+}
+
+bool check_convert_csp(const tstring& filter) {
+    const int maxThreads = std::max(1, (int)get_cpu_info().logical_cores);
+    std::vector<int> threadList;
+    for (int i = 1; i < maxThreads; i *= 2) {
+        threadList.push_back(i);
+    }
+    threadList.push_back(maxThreads);
+
+    const std::pair<int, int> resolutions[] = { { 1920, 1080 }, { 3840, 2160 } };
+    std::mt19937 rng(0x5eed);
+    bool allExact = true;
+    int checkedFuncs = 0, ngFuncs = 0;
+    const auto funcList = get_convert_csp_func_list();
+    // 各変換の組み合わせについて、テーブルに登録されている (実行環境で利用可能な) 関数をすべて確認する
+    std::vector<std::tuple<RGY_CSP, RGY_CSP, bool>> checked;
+    for (const auto entry : funcList) {
+        const auto key = std::make_tuple(entry->csp_from, entry->csp_to, entry->uv_only);
+        if (std::find(checked.begin(), checked.end(), key) != checked.end()) {
+            continue;
+        }
+        checked.push_back(key);
+        const tstring name = strsprintf(_T("%s -> %s%s"), RGY_CSP_NAMES[entry->csp_from], RGY_CSP_NAMES[entry->csp_to], (entry->uv_only) ? _T(" (uv)") : _T(""));
+        if (filter.length() > 0
+            && _tcsstr(RGY_CSP_NAMES[entry->csp_from], filter.c_str()) == nullptr
+            && _tcsstr(RGY_CSP_NAMES[entry->csp_to], filter.c_str()) == nullptr) {
+            continue;
+        }
+        // get_convert_csp_funcはテーブルの先頭から探すので、前にある関数に隠れて選ばれない関数もある
+        // 選ばれない関数も含めて確認し、選ばれない関数には"unused"と表示する
+        std::vector<const ConvertCSP *> selected;
+        for (const auto simd : CHECK_CSP_SIMD_LEVELS) {
+            if ((get_availableSIMD() & simd) != simd) {
+                continue;
+            }
+            const auto func = get_convert_csp_func(entry->csp_from, entry->csp_to, entry->uv_only, simd);
+            if (func != nullptr) {
+                selected.push_back(func);
+            }
+        }
+        std::vector<const ConvertCSP *> funcs;
+        for (const auto func : funcList) {
+            if (std::make_tuple(func->csp_from, func->csp_to, func->uv_only) == key
+                && (get_availableSIMD() & func->simd) == func->simd) {
+                funcs.push_back(func);
+            }
+        }
+        // 基準はC実装、C実装がなければ最も下位のSIMD実装とする
+        const ConvertCSP *funcRef = nullptr;
+        for (const auto func : funcs) {
+            if (funcRef == nullptr || check_csp_simd_rank(func->simd) < check_csp_simd_rank(funcRef->simd)) {
+                funcRef = func;
+            }
+        }
+        // 下位のSIMDから順に確認する
+        std::stable_sort(funcs.begin(), funcs.end(), [](const ConvertCSP *a, const ConvertCSP *b) {
+            return check_csp_simd_rank(a->simd) < check_csp_simd_rank(b->simd);
+        });
+        const ConvertCSP *funcDefault = (selected.size() > 0) ? selected.back() : nullptr;
+        for (const auto func : funcs) {
+            const bool used = std::find(selected.begin(), selected.end(), func) != selected.end();
+            tstring result = strsprintf(_T("%-24s %-8s%s "), name.c_str(), get_simd_str(func->simd), (used) ? _T("       ") : _T("(unused)"));
+            if (func == funcRef) {
+                result += (funcRef->simd == RGY_SIMD::NONE) ? _T("ref   ") : _T("ref(*)");
+            } else {
+                checkedFuncs++;
+                const int diff = check_convert_csp_exact(func, funcRef, rng);
+                if (diff == 0) {
+                    result += _T("ok    ");
+                } else {
+                    result += strsprintf(_T("NG(max diff %d) "), diff);
+                    allExact = false;
+                    ngFuncs++;
+                }
+            }
+            // 速度の計測 (スレッド数を変えるのは既定で選ばれる関数のみ)
+            const bool scaleThreads = func == funcDefault;
+            for (const auto& res : resolutions) {
+                RGYConvertCSPCheckFrame src, dst;
+                src.alloc(func->csp_from, res.first, res.second, 0);
+                dst.alloc(func->csp_to, res.first, res.second, 0);
+                src.fillRandom(rng);
+                const double bytes = (double)(src.dataBytes() + dst.dataBytes());
+                result += strsprintf(_T(" %s:"), (res.second >= 2160) ? _T("4K") : _T("1080p"));
+                for (const auto threads : threadList) {
+                    if (threads > 1 && !scaleThreads) {
+                        break;
+                    }
+                    const double fps = check_convert_csp_bench(func, src, dst, res.first, res.second, threads);
+                    result += strsprintf(_T(" %dt %.2fGB/s %.1ffps"), threads, fps * bytes * 1e-9, fps);
+                }
+            }
+            _ftprintf(stdout, _T("%s\n"), result.c_str());
+            fflush(stdout);
+        }
+    }
+    _ftprintf(stdout, _T("%d/%d functions do not match the reference.\n"), ngFuncs, checkedFuncs);
+    return rgy_check_print_total(allExact);
+}
@@ -0,0 +1,42 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __RGY_CONVERT_CSP_CHECK_H__
+#define __RGY_CONVERT_CSP_CHECK_H__
+
+#include "rgy_tchar.h"
+
+// 色空間変換関数の確認
+// 各SIMDレベルでget_convert_csp_funcが返す変換関数について、
+// ランダムな幅・crop・インタレースでC実装との一致を確認し、
+// 1080p/4Kでの処理速度をRGYConvertCSPを使って1..Nスレッドで計測する
+//   filter  ... 変換元/変換先の色空間名にこの文字列を含むものだけを確認する (空なら全て)
+//   戻り値  ... すべての変換関数がC実装と一致すればtrue
+bool check_convert_csp(const tstring& filter);
+
+#endif //__RGY_CONVERT_CSP_CHECK_H__
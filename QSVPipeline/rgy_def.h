@@ -54,6 +54,7 @@ static const int MAX_SPLIT_CHANNELS = 32;
 static const std::string RGY_CHANNEL_AUTO = "RGY_CHANNEL_AUTO";
 static const int RGY_OUTPUT_BUF_MB_DEFAULT = 8;
 static const int RGY_OUTPUT_BUF_MB_MAX = 128;
+static const int RGY_INPUT_READ_AHEAD_MB_MAX = 1024;
 
 typedef struct {
     int start, fin;
@@ -28,9 +28,14 @@
 #include <filesystem>
 #include <cstdint>
 #include "rgy_util.h"
+#include "rgy_version.h"
 #include "rgy_env.h"
 #include "rgy_codepage.h"
 #include "rgy_filesystem.h"
+#if !(defined(_WIN32) || defined(_WIN64))
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
 
 std::string GetFullPathFrom(const char *path, const char *baseDir) {
     if (auto p = std::filesystem::path(path); p.is_absolute()) {
@@ -286,6 +291,26 @@ tstring getExeDir() {
     return PathRemoveFileSpecFixed(getExePath()).second;
 }
 
+tstring getCacheDir(const TCHAR *subdir) {
+#if defined(_WIN32) || defined(_WIN64)
+    const wchar_t *base = _wgetenv(L"LOCALAPPDATA");
+    if (base == nullptr || base[0] == L'\0') {
+        return tstring();
+    }
+    return wstring_to_tstring((std::filesystem::path(base) / ENCODER_NAME / subdir).wstring());
+#else
+    std::filesystem::path base;
+    if (const char *xdg = getenv("XDG_CACHE_HOME"); xdg != nullptr && xdg[0] != '\0') {
+        base = xdg;
+    } else if (const char *home = getenv("HOME"); home != nullptr && home[0] != '\0') {
+        base = std::filesystem::path(home) / ".cache";
+    } else {
+        return tstring();
+    }
+    return (base / tolowercase(std::string(ENCODER_NAME)) / subdir).string();
+#endif
+}
+
 bool rgy_path_is_same(const TCHAR *path1, const TCHAR *path2) {
     try {
         const auto p1 = std::filesystem::path(path1);
@@ -329,3 +354,101 @@ std::vector<std::basic_string<TCHAR>> createProcessOpenedFileList(const std::vec
     return list_file;
 }
 #endif //#if defined(_WIN32) || defined(_WIN64)
+
+RGYFileMap::RGYFileMap() :
+    m_ptr(nullptr),
+    m_size(0),
+    m_mapped(false),
+    m_buffer()
+#if defined(_WIN32) || defined(_WIN64)
+    , m_mapHandle(NULL)
+#endif //#if defined(_WIN32) || defined(_WIN64)
+{
+}
+
+RGYFileMap::~RGYFileMap() {
+    close();
+}
+
+bool RGYFileMap::open(const tstring& filename) {
+    close();
+#if defined(_WIN32) || defined(_WIN64)
+    HANDLE hFile = CreateFile(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER fileSize = { 0 };
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    if (!GetFileSizeEx(hFile, &fileSize)) {
+        CloseHandle(hFile);
+        return false;
+    }
+    const uint64_t filesize = fileSize.QuadPart;
+    //アドレス空間の足りない32bit環境では、マップせずに読み込む
+    if (sizeof(void *) >= 8 && filesize > 0) {
+        //マップしたビューはファイルのハンドルを閉じても有効
+        m_mapHandle = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (m_mapHandle != NULL) {
+            m_ptr = (const uint8_t *)MapViewOfFile(m_mapHandle, FILE_MAP_READ, 0, 0, 0);
+            if (m_ptr == nullptr) {
+                CloseHandle(m_mapHandle);
+                m_mapHandle = NULL;
+            }
+        }
+    }
+    CloseHandle(hFile);
+#else
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0) {
+        return false;
+    }
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        return false;
+    }
+    const uint64_t filesize = st.st_size;
+    //アドレス空間の足りない32bit環境では、マップせずに読み込む
+    if (sizeof(void *) >= 8 && filesize > 0) {
+        void *ptr = mmap(nullptr, (size_t)filesize, PROT_READ, MAP_SHARED, fd, 0);
+        if (ptr != MAP_FAILED) {
+            m_ptr = (const uint8_t *)ptr;
+        }
+    }
+    ::close(fd);
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    if (m_ptr) {
+        m_size = (size_t)filesize;
+        m_mapped = true;
+        return true;
+    }
+    if (filesize == 0) {
+        return true;
+    }
+    FILE *fp = NULL;
+    if (_tfopen_s(&fp, filename.c_str(), _T("rb")) || fp == NULL) {
+        return false;
+    }
+    m_buffer.resize((size_t)filesize);
+    const auto readSize = fread(m_buffer.data(), 1, m_buffer.size(), fp);
+    fclose(fp);
+    m_buffer.resize(readSize);
+    m_ptr = m_buffer.data();
+    m_size = m_buffer.size();
+    return true;
+}
+
+void RGYFileMap::close() {
+    if (m_mapped && m_ptr) {
+#if defined(_WIN32) || defined(_WIN64)
+        UnmapViewOfFile(m_ptr);
+        CloseHandle(m_mapHandle);
+        m_mapHandle = NULL;
+#else
+        munmap((void *)m_ptr, m_size);
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    }
+    m_ptr = nullptr;
+    m_size = 0;
+    m_mapped = false;
+    m_buffer.clear();
+}
@@ -29,6 +29,7 @@
 #ifndef __RGY_FILESYSTEM_H__
 #define __RGY_FILESYSTEM_H__
 
+#include <cstdint>
 #include <vector>
 #include "rgy_tchar.h"
 
@@ -47,6 +48,8 @@ tstring getModulePath(void *module);
 #endif //#if defined(_WIN32) || defined(_WIN64)
 tstring getExePath();
 tstring getExeDir();
+// キャッシュの保存先 (%LOCALAPPDATA%\<ENCODER_NAME>\<subdir>, $XDG_CACHE_HOME/<encoder_name>/<subdir>)
+tstring getCacheDir(const TCHAR *subdir);
 std::vector<tstring> get_file_list_with_filter(const tstring& dir, const tstring& filter_filename);
 
 std::string GetFullPathFrom(const char *path, const char *baseDir = nullptr);
@@ -72,4 +75,28 @@ bool rgy_path_is_same(const tstring& path1, const tstring& path2);
 std::vector<std::basic_string<TCHAR>> createProcessOpenedFileList(const std::vector<size_t>& list_pid);
 #endif //#if defined(_WIN32) || defined(_WIN64)
 
+//ファイル全体を読み取り専用でメモリにマップする
+//マップできない場合 (32bit環境など) はファイル全体をメモリに読み込む
+class RGYFileMap {
+public:
+    RGYFileMap();
+    ~RGYFileMap();
+    RGYFileMap(const RGYFileMap&) = delete;
+    RGYFileMap &operator=(const RGYFileMap&) = delete;
+
+    bool open(const tstring& filename);
+    void close();
+    const uint8_t *data() const { return m_ptr; }
+    size_t size() const { return m_size; }
+    bool mapped() const { return m_mapped; }
+protected:
+    const uint8_t *m_ptr;
+    size_t m_size;
+    bool m_mapped;
+    std::vector<uint8_t> m_buffer; //マップできなかった場合の読み込み先
+#if defined(_WIN32) || defined(_WIN64)
+    void *m_mapHandle;
+#endif //#if defined(_WIN32) || defined(_WIN64)
+};
+
 #endif //__RGY_FILESYSTEM_H__
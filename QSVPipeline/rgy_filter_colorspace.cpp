@@ -29,17 +29,27 @@
 #define _USE_MATH_DEFINES
 #include <cmath>
 #include <vector>
+#include <algorithm>
 #include <map>
 #include <deque>
 #include <unordered_set>
 #include <unordered_map>
+#include <thread>
+#include <random>
+#include <chrono>
+#include <filesystem>
 #include "rgy_filter_colorspace.h"
 #include "rgy_filter_colorspace_func.h"
 #include "rgy_resource.h"
 #include "rgy_filesystem.h"
+#include "rgy_opencl_cache.h"
 
 static const int COLORSPACE_BLOCK_X = 64;
 static const int COLORSPACE_BLOCK_Y = 4;
+//fuse_lutのキャッシュの形式とcalc()の計算のバージョン
+//キャッシュのキーに含めるprintOpAll()はrgy_filter_colorspace_func.hの関数の中身を含まないので、
+//それらの計算やLUTの格納形式を変更した場合はこの値を更新し、古いキャッシュを使わないようにする
+static const int FUSE_LUT_CACHE_VERSION = 2;
 
 using std::pair;
 using std::make_pair;
@@ -309,12 +319,21 @@ TransferFunc getTrasferFunc(CspTransfer transfer, double peak_luminance, bool sc
     return func;
 }
 
+static float3 toFloat3(const vec3f& v) {
+    return make_float3(v(0), v(1), v(2));
+}
+
+static vec3f toVec3f(const float3& v) {
+    return vec3f(v.x, v.y, v.z);
+}
+
 class ColorspaceOpNone : public ColorspaceOp {
 public:
     ColorspaceOpNone() { m_type = COLORSPACE_OP_TYPE_NONE; };
     virtual ~ColorspaceOpNone() {};
     virtual std::string print() { return ""; }
     virtual bool add(const ColorspaceOp* op) { UNREFERENCED_PARAMETER(op); return false; }
+    virtual vec3f calc(const vec3f& x) const override { return x; }
 protected:
 };
 
@@ -327,6 +346,7 @@ public:
         return m;
     }
     virtual std::string print();
+    virtual vec3f calc(const vec3f& x) const override;
     virtual bool add(const ColorspaceOp *op);
 protected:
     mat3x3 m;
@@ -338,6 +358,7 @@ public:
     ColorspaceOpGammaFunc(const TransferFunc &transferfunc) : func(transferfunc) { m_type = COLORSPACE_OP_TYPE_FUNC; };
     virtual ~ColorspaceOpGammaFunc() {};
     virtual std::string print();
+    virtual vec3f calc(const vec3f& x) const override;
     virtual bool add(const ColorspaceOp *op) { UNREFERENCED_PARAMETER(op); return false; }
 protected:
     TransferFunc func;
@@ -349,6 +370,7 @@ public:
     ColorspaceOpInvGammaFunc(const TransferFunc &transferfunc) : func(transferfunc) { m_type = COLORSPACE_OP_TYPE_FUNC; };
     virtual ~ColorspaceOpInvGammaFunc() {};
     virtual std::string print();
+    virtual vec3f calc(const vec3f& x) const override;
     virtual bool add(const ColorspaceOp *op) { UNREFERENCED_PARAMETER(op); return false; }
 protected:
     TransferFunc func;
@@ -360,6 +382,7 @@ public:
     ColorspaceOpAribB67(double kr, double kg, double kb, double scale) : m_kr(kr), m_kg(kg), m_kb(kb), m_scale(scale) { m_type = COLORSPACE_OP_TYPE_FUNC; };
     virtual ~ColorspaceOpAribB67() {};
     virtual std::string print();
+    virtual vec3f calc(const vec3f& x) const override;
     virtual bool add(const ColorspaceOp *op) { UNREFERENCED_PARAMETER(op); return false; }
 protected:
     double m_kr, m_kg, m_kb, m_scale;
@@ -371,6 +394,7 @@ public:
     ColorspaceOpInvAribB67(double kr, double kg, double kb, double scale) : m_kr(kr), m_kg(kg), m_kb(kb), m_scale(scale) { m_type = COLORSPACE_OP_TYPE_FUNC; };
     virtual ~ColorspaceOpInvAribB67() {};
     virtual std::string print();
+    virtual vec3f calc(const vec3f& x) const override;
     virtual bool add(const ColorspaceOp *op) { UNREFERENCED_PARAMETER(op); return false; }
 protected:
     double m_kr, m_kg, m_kb, m_scale;
@@ -388,6 +412,7 @@ public:
     };
     virtual ~ColorspaceOpCL2RGB() {};
     virtual std::string print();
+    virtual vec3f calc(const vec3f& x) const override;
     virtual bool add(const ColorspaceOp *op) { UNREFERENCED_PARAMETER(op); return false; }
 protected:
     double m_kr, m_kg, m_kb, m_scale;
@@ -407,6 +432,7 @@ public:
     };
     virtual ~ColorspaceOpCL2YUV() {};
     virtual std::string print();
+    virtual vec3f calc(const vec3f& x) const override;
     virtual bool add(const ColorspaceOp *op) { UNREFERENCED_PARAMETER(op); return false; }
 protected:
     double m_kr, m_kg, m_kb, m_scale;
@@ -431,7 +457,6 @@ public:
         m_type = COLORSPACE_OP_TYPE_HDR2SDR;
     };
     virtual ~ColorspaceOpHDR2SDR() {};
-    virtual std::string printDesat(double desat_scale);
     virtual std::string printDesatInfo();
     virtual bool add(const ColorspaceOp *op) override { UNREFERENCED_PARAMETER(op); return false; }
     double source_peak() const { return m_source_peak; }
@@ -464,6 +489,7 @@ public:
     virtual ~ColorspaceOpHDR2SDRHable() {};
     virtual std::string print() override;
     virtual std::string printInfo() override;
+    virtual vec3f calc(const vec3f& x) const override;
     virtual bool add(const ColorspaceOp *op) override { UNREFERENCED_PARAMETER(op); return false; }
 protected:
     double m_A, m_B, m_C, m_D, m_E, m_F;
@@ -484,6 +510,7 @@ public:
     virtual ~ColorspaceOpHDR2SDRMobius() {};
     virtual std::string print() override;
     virtual std::string printInfo() override;
+    virtual vec3f calc(const vec3f& x) const override;
     virtual bool add(const ColorspaceOp *op) override { UNREFERENCED_PARAMETER(op); return false; }
 protected:
     double m_transition, m_peak;
@@ -504,6 +531,7 @@ public:
     virtual ~ColorspaceOpHDR2SDRReinhard() {};
     virtual std::string print() override;
     virtual std::string printInfo() override;
+    virtual vec3f calc(const vec3f& x) const override;
     virtual bool add(const ColorspaceOp *op) override { UNREFERENCED_PARAMETER(op); return false; }
 protected:
     double m_contrast, m_peak;
@@ -520,6 +548,7 @@ public:
     virtual ~ColorspaceOpHDR2SDRBT2390() {};
     virtual std::string print() override;
     virtual std::string printInfo() override;
+    virtual vec3f calc(const vec3f& x) const override;
     virtual bool add(const ColorspaceOp *op) override { UNREFERENCED_PARAMETER(op); return false; }
 protected:
 };
@@ -557,6 +586,7 @@ public:
     };
     virtual ~ColorspaceOpRange() {};
     virtual std::string print();
+    virtual vec3f calc(const vec3f& x) const override;
     virtual bool add(const ColorspaceOp *op) { UNREFERENCED_PARAMETER(op); return false; }
 protected:
     double m_scale_y, m_offset_y;
@@ -577,19 +607,23 @@ struct ColorspaceOpLUT3DPreLUT {
 
 class ColorspaceOpLUT3D : public ColorspaceOp {
 public:
-    ColorspaceOpLUT3D() : m_table_file(), m_interp(LUT3DInterp::Nearest), m_rgbscale(), m_tableSize0(0), m_tableSize01(0), m_preLUT() { m_type = COLORSPACE_OP_TYPE_LUT3D; };
-    ColorspaceOpLUT3D(const tstring& table_file, LUT3DInterp interp, std::shared_ptr<RGYLog> log) : m_table_file(table_file), m_interp(interp), m_rgbscale(), m_tableSize0(0), m_tableSize01(0), m_preLUT(), m_log(log) {
+    ColorspaceOpLUT3D() : m_table_file(), m_interp(LUT3DInterp::Nearest), m_rgbscale(), m_tableSize0(0), m_tableSize01(0), m_preLUT(), m_table() { m_type = COLORSPACE_OP_TYPE_LUT3D; };
+    ColorspaceOpLUT3D(const tstring& table_file, LUT3DInterp interp, std::shared_ptr<RGYLog> log) : m_table_file(table_file), m_interp(interp), m_rgbscale(), m_tableSize0(0), m_tableSize01(0), m_preLUT(), m_table(), m_log(log) {
         m_type = COLORSPACE_OP_TYPE_LUT3D;
     };
     virtual ~ColorspaceOpLUT3D() {};
     virtual std::string print() override;
     virtual std::string printInfo() override;
+    virtual vec3f calc(const vec3f& x) const override;
     virtual bool add(const ColorspaceOp *op) { UNREFERENCED_PARAMETER(op); return false; }
     virtual RGY_ERR init(std::vector<uint8_t>& devParams);
 protected:
     void setAdditionalParams(std::vector<uint8_t>& additionalParams, const std::vector<LUTVEC>& luttable);
     RGY_ERR parseTable(std::vector<uint8_t>& additionalParams);
     RGY_ERR parseCube(std::vector<uint8_t>& additionalParams);
+    RGY_ERR parseCubeText(const char *data, const size_t size, std::vector<LUTVEC>& luttable);
+    bool loadCubeCache(const tstring& cachefile, const std::string& srcpath, const uint64_t srcsize, const int64_t srctime, std::vector<LUTVEC>& luttable);
+    void storeCubeCache(const tstring& cachefile, const std::string& srcpath, const uint64_t srcsize, const int64_t srctime, const std::vector<LUTVEC>& luttable);
     void clearTable();
     tstring m_table_file;
     LUT3DInterp m_interp;
@@ -597,6 +631,7 @@ protected:
     int m_tableSize0;
     int m_tableSize01;
     ColorspaceOpLUT3DPreLUT m_preLUT;
+    std::vector<LUTVEC> m_table; //calc用
     std::shared_ptr<RGYLog> m_log;
 };
 
@@ -640,6 +675,25 @@ std::string ColorspaceOpLUT3D::print() {
     return str;
 }
 
+vec3f ColorspaceOpLUT3D::calc(const vec3f& in) const {
+    //prelutはparseCubeでは設定されないので、ここでは考慮しない
+    const vec3f scale_to_table = m_rgbscale * (float)(m_tableSize0 - 1);
+    const float lut_max_idx = (float)(m_tableSize0 - 1) + 1e-6f;
+    float3 x = toFloat3(in);
+    x.x = clamp(x.x * scale_to_table((int)LUT3DIDX::r), 0.0f, lut_max_idx);
+    x.y = clamp(x.y * scale_to_table((int)LUT3DIDX::b), 0.0f, lut_max_idx);
+    x.z = clamp(x.z * scale_to_table((int)LUT3DIDX::b), 0.0f, lut_max_idx);
+    switch (m_interp) {
+    case LUT3DInterp::Nearest:     x = lut3d_interp_nearest(x, m_table.data(), m_tableSize0, m_tableSize01); break;
+    case LUT3DInterp::Trilinear:   x = lut3d_interp_trilinear(x, m_table.data(), m_tableSize0, m_tableSize01); break;
+    case LUT3DInterp::Pyramid:     x = lut3d_interp_pyramid(x, m_table.data(), m_tableSize0, m_tableSize01); break;
+    case LUT3DInterp::Prism:       x = lut3d_interp_prism(x, m_table.data(), m_tableSize0, m_tableSize01); break;
+    case LUT3DInterp::Tetrahedral:
+    default:                       x = lut3d_interp_tetrahedral(x, m_table.data(), m_tableSize0, m_tableSize01); break;
+    }
+    return toVec3f(x);
+}
+
 std::string ColorspaceOpLUT3D::printInfo() {
     return strsprintf("lut3d: table=%s\n"
         "                                  size=%d, interp=%s",
@@ -665,72 +719,390 @@ RGY_ERR ColorspaceOpLUT3D::parseTable(std::vector<uint8_t>& additionalParams) {
     return RGY_ERR_UNSUPPORTED;
 }
 
-RGY_ERR ColorspaceOpLUT3D::parseCube(std::vector<uint8_t>& additionalParams) {
-    clearTable();
+// .cubeのデータ部分を並列に解析する際の、1スレッドあたりの最小のサイズ
+static const size_t LUT3D_CUBE_PARSE_CHUNK_MIN = 256 * 1024;
+
+// .cubeの解析結果のキャッシュ
+//   キャッシュのディレクトリに元ファイルのフルパスのハッシュをファイル名として保存し、
+//   元ファイルのパス・サイズ・更新時刻がすべて一致する場合のみ使用する
+//   テーブルはLUTVECのアライメントで格納し、ファイルをマップしてそのまま読み込めるようにする
+static const char RGY_LUT3D_CACHE_MAGIC[8] = { 'R', 'G', 'Y', 'L', 'U', 'T', '3', 'D' };
+static const uint32_t RGY_LUT3D_CACHE_VERSION = 1;
+static const int RGY_LUT3D_CACHE_SIZE_MAX = 1024;
+
+struct RGYLUT3DCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t pathLength;  // 元ファイルのフルパスの長さ (ヘッダの直後に格納)
+    uint64_t srcSize;     // 元ファイルのサイズ
+    int64_t srcTime;      // 元ファイルの更新時刻
+    int32_t tableSize0;
+    float rgbscale[3];
+    uint64_t tableOffset; // ファイル先頭からテーブルまでのオフセット
+};
 
-    FILE *fptmp = nullptr;
-    if (_tfopen_s(&fptmp, m_table_file.c_str(), _T("r")) != 0) {
-        m_log->write(RGY_LOG_ERROR, RGY_LOGT_VPP, _T("Failed to open lut3d cube file: %s\n"), m_table_file.c_str());
-        return RGY_ERR_FILE_OPEN;
+static tstring lut3d_path_to_tstring(const std::filesystem::path& path) {
+#if defined(_WIN32) || defined(_WIN64)
+    return wstring_to_tstring(path.wstring());
+#else
+    return path.string();
+#endif
+}
+
+static const char *lut3d_cube_eol(const char *ptr, const char *fin) {
+    const char *eol = (const char *)memchr(ptr, '\n', fin - ptr);
+    return (eol) ? eol : fin;
+}
+
+static const char *lut3d_cube_skip_space(const char *ptr, const char *fin) {
+    while (ptr < fin && (*ptr == ' ' || *ptr == '\t' || *ptr == '\r')) ptr++;
+    return ptr;
+}
+
+// 10進の小数を読み取る
+// 仮数が2^24以下 (末尾の0は指数に移す) かつ10の指数の絶対値が10以下なら、どちらもfloatで正確に表せるので、
+// float上での1回の乗除算で正しく丸められた値が求まる。それ以外 (inf, nan, 16進表記を含む) はstrtofで読み取る
+bool lut3d_cube_parse_float(const char **pptr, const char *fin, float *value) {
+    static const float pow10[] = {
+        1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+    };
+    const char *ptr = lut3d_cube_skip_space(*pptr, fin);
+    const char *start = ptr;
+    const char *end = ptr; // 値の終端 (空白または行末)
+    while (end < fin && *end != ' ' && *end != '\t' && *end != '\r' && *end != '\n') end++;
+    if (start == end) {
+        return false;
+    }
+    bool neg = false;
+    if (ptr < end && (*ptr == '-' || *ptr == '+')) {
+        neg = *ptr == '-';
+        ptr++;
+    }
+    uint64_t mantissa = 0;
+    int digits = 0; // 有効桁数
+    int exp10 = 0;
+    bool found = false;
+    bool truncated = false; // 19桁を超えて切り捨てた桁がある
+    for (; ptr < end && '0' <= *ptr && *ptr <= '9'; ptr++, found = true) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*ptr - '0');
+            if (mantissa) digits++;
+        } else {
+            truncated |= *ptr != '0';
+            exp10++;
+        }
     }
-    m_log->write(RGY_LOG_DEBUG, RGY_LOGT_VPP, _T("Opened lut3d cube file: %s\n"), m_table_file.c_str());
-    std::unique_ptr<FILE, fp_deleter> fp(fptmp, fp_deleter());
-    char buffer[512];
+    if (ptr < end && *ptr == '.') {
+        for (ptr++; ptr < end && '0' <= *ptr && *ptr <= '9'; ptr++, found = true) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*ptr - '0');
+                if (mantissa) digits++;
+                exp10--;
+            } else {
+                truncated |= *ptr != '0';
+            }
+        }
+    }
+    if (found && ptr < end && (*ptr == 'e' || *ptr == 'E')) {
+        const char *ptrExp = ptr + 1;
+        bool expNeg = false;
+        if (ptrExp < end && (*ptrExp == '-' || *ptrExp == '+')) {
+            expNeg = *ptrExp == '-';
+            ptrExp++;
+        }
+        if (ptrExp < end && '0' <= *ptrExp && *ptrExp <= '9') {
+            int e = 0;
+            for (; ptrExp < end && '0' <= *ptrExp && *ptrExp <= '9'; ptrExp++) {
+                if (e < 100000) e = e * 10 + (*ptrExp - '0');
+            }
+            exp10 += (expNeg) ? -e : e;
+            ptr = ptrExp;
+        }
+    }
+    //末尾の0は指数に移す (0.500000 -> 5e-1)
+    while (mantissa != 0 && mantissa % 10 == 0) {
+        mantissa /= 10;
+        exp10++;
+    }
+    if (found && ptr == end && !truncated
+        && mantissa <= ((uint64_t)1 << 24) && std::abs(exp10) < (int)_countof(pow10)) {
+        float v = (float)mantissa;
+        v = (exp10 < 0) ? v / pow10[-exp10] : v * pow10[exp10];
+        *value = (neg) ? -v : v;
+    } else {
+        //ファイル末尾で終端されていない可能性があるので、コピーしてから読み取る
+        char buf[128];
+        std::string str;
+        const size_t len = end - start;
+        const char *src = buf;
+        if (len < sizeof(buf)) {
+            memcpy(buf, start, len);
+            buf[len] = '\0';
+        } else {
+            str.assign(start, len);
+            src = str.c_str();
+        }
+        char *srcEnd = nullptr;
+        *value = strtof(src, &srcEnd);
+        if (srcEnd != src + len) {
+            return false;
+        }
+    }
+    *pptr = end;
+    return true;
+}
+
+// 1行から3つの値を読み取る
+static bool lut3d_cube_parse_entry(const char *ptr, const char *eol, LUTVEC *value) {
+    return lut3d_cube_parse_float(&ptr, eol, &value->x)
+        && lut3d_cube_parse_float(&ptr, eol, &value->y)
+        && lut3d_cube_parse_float(&ptr, eol, &value->z);
+}
+
+RGY_ERR ColorspaceOpLUT3D::parseCubeText(const char *data, const size_t size, std::vector<LUTVEC>& luttable) {
     float lutmin[3] = { 0.0f, 0.0f, 0.0f };
     float lutmax[3] = { 1.0f, 1.0f, 1.0f };
-    LUTVEC value;
-    memset(&value, 0, sizeof(value));
-
-    std::vector<LUTVEC> luttable;
-    size_t tableidx = 0;
-    while (fgets(buffer, _countof(buffer), fp.get()) != nullptr) {
-        if (buffer[0] == '#') continue;
-        if (buffer[0] == '\n') continue;
-        if (m_tableSize01 > 0
-            && sscanf_s(buffer, "%f %f %f", &value.x, &value.y, &value.z) == 3) {
-            const auto b = tableidx / m_tableSize01;
-            const auto g = (tableidx - m_tableSize01 * b) / m_tableSize0;
-            const auto r = tableidx - m_tableSize01 * b - m_tableSize0 * g;
-            if (b >= (size_t)m_tableSize0 || g >= (size_t)m_tableSize0 || r >= (size_t)m_tableSize0) {
-                return RGY_ERR_INVALID_DATA_TYPE;
-            }
-            luttable[r * m_tableSize01 + g * m_tableSize0 + b] = value;
-            tableidx++;
-        } else if (sscanf_s(buffer, "LUT_3D_SIZE %d", &m_tableSize0) == 1) {
+    const char *fin = data + size;
+    const char *dataStart = fin;
+    //ヘッダ部分 (最初のデータの行の手前まで) は1行ずつ読み取る
+    for (const char *ptr = data; ptr < fin; ) {
+        const char *eol = lut3d_cube_eol(ptr, fin);
+        const char *next = (eol < fin) ? eol + 1 : fin;
+        LUTVEC value;
+        if (ptr[0] == '#' || ptr[0] == '\n') {
+            ptr = next;
+            continue;
+        }
+        if (m_tableSize01 > 0 && lut3d_cube_parse_entry(ptr, eol, &value)) {
+            dataStart = ptr;
+            break;
+        }
+        char buffer[512];
+        const size_t len = std::min((size_t)(eol - ptr), sizeof(buffer) - 1);
+        memcpy(buffer, ptr, len);
+        buffer[len] = '\0';
+        if (sscanf_s(buffer, "LUT_3D_SIZE %d", &m_tableSize0) == 1) {
             m_tableSize01 = m_tableSize0 * m_tableSize0;
             if (m_tableSize01 <= 0) {
                 m_log->write(RGY_LOG_ERROR, RGY_LOGT_VPP, _T("Invalid lut3d cube file: size %d\n"), m_tableSize01);
                 return RGY_ERR_INVALID_DATA_TYPE;
             }
             m_log->write(RGY_LOG_DEBUG, RGY_LOGT_VPP, _T("lut3d cube file: size %d\n"), m_tableSize01);
-            luttable.resize(m_tableSize0 * m_tableSize0 * m_tableSize0);
         } else if (sscanf_s(buffer, "DOMAIN_MIN %f %f %f", &lutmin[0], &lutmin[1], &lutmin[2]) == 3
                 || sscanf_s(buffer, "DOMAIN_MAX %f %f %f", &lutmax[0], &lutmax[1], &lutmax[2]) == 3) {
             // なにもしない
-        } 
+        }
+        ptr = next;
+    }
+    luttable.resize((size_t)m_tableSize01 * m_tableSize0);
+
+    //データ部分は行の境界で分割し、スレッドごとに読み取る
+    const size_t dataSize = fin - dataStart;
+    const int chunks = clamp((int)(dataSize / LUT3D_CUBE_PARSE_CHUNK_MIN) + 1, 1, std::max((int)std::thread::hardware_concurrency(), 1));
+    std::vector<const char *> chunkStart(chunks + 1, fin);
+    chunkStart[0] = dataStart;
+    for (int i = 1; i < chunks; i++) {
+        const char *ptr = std::max(dataStart + dataSize * i / chunks, chunkStart[i - 1]);
+        if (ptr > dataStart && ptr < fin && ptr[-1] != '\n') {
+            ptr = lut3d_cube_eol(ptr, fin);
+            ptr = (ptr < fin) ? ptr + 1 : fin;
+        }
+        chunkStart[i] = ptr;
+    }
+    auto run_chunks = [chunks](std::function<void(int)> func) {
+        std::vector<std::thread> th;
+        for (int i = 1; i < chunks; i++) {
+            th.push_back(std::thread(func, i));
+        }
+        func(0);
+        for (auto& t : th) {
+            t.join();
+        }
+    };
+    //まずファイルの順に読み取り、各チャンクのエントリ数が確定してからテーブルの位置に並べ替える
+    std::vector<std::vector<LUTVEC>> chunkValues(chunks);
+    run_chunks([&](const int ichunk) {
+        auto& values = chunkValues[ichunk];
+        values.reserve((chunkStart[ichunk + 1] - chunkStart[ichunk]) / 16);
+        for (const char *ptr = chunkStart[ichunk]; ptr < chunkStart[ichunk + 1]; ) {
+            const char *eol = lut3d_cube_eol(ptr, fin);
+            LUTVEC value;
+            memset(&value, 0, sizeof(value));
+            if (ptr[0] != '#' && lut3d_cube_parse_entry(ptr, eol, &value)) {
+                values.push_back(value);
+            }
+            ptr = (eol < fin) ? eol + 1 : fin;
+        }
+    });
+    std::vector<size_t> chunkOffset(chunks + 1, 0);
+    for (int i = 0; i < chunks; i++) {
+        chunkOffset[i + 1] = chunkOffset[i] + chunkValues[i].size();
     }
+    const size_t tableidx = chunkOffset[chunks];
     if (tableidx != luttable.size()) {
         m_log->write(RGY_LOG_ERROR, RGY_LOGT_VPP, _T("Invalid lut3d cube file: found %llu entry, which should be %llu\n"), (uint64_t)tableidx, (uint64_t)luttable.size());
         return RGY_ERR_INVALID_DATA_TYPE;
     }
+    run_chunks([&](const int ichunk) {
+        const auto& values = chunkValues[ichunk];
+        for (size_t i = 0; i < values.size(); i++) {
+            const size_t idx = chunkOffset[ichunk] + i;
+            const auto b = idx / m_tableSize01;
+            const auto g = (idx - m_tableSize01 * b) / m_tableSize0;
+            const auto r = idx - m_tableSize01 * b - m_tableSize0 * g;
+            luttable[r * m_tableSize01 + g * m_tableSize0 + b] = values[i];
+        }
+    });
     for (int i = 0; i < 3; i++) {
         m_rgbscale(i) = clamp(1.0f / (lutmax[i] - lutmin[i]), 0.0f, 1.0f);
         m_log->write(RGY_LOG_DEBUG, RGY_LOGT_VPP, _T("lut3d cube file: rgbscale(%d): %f\n"), i, m_rgbscale(i));
     }
+    return RGY_ERR_NONE;
+}
+
+bool ColorspaceOpLUT3D::loadCubeCache(const tstring& cachefile, const std::string& srcpath, const uint64_t srcsize, const int64_t srctime, std::vector<LUTVEC>& luttable) {
+    RGYFileMap map;
+    if (!map.open(cachefile) || map.size() < sizeof(RGYLUT3DCacheHeader)) {
+        return false;
+    }
+    RGYLUT3DCacheHeader header;
+    memcpy(&header, map.data(), sizeof(header));
+    if (memcmp(header.magic, RGY_LUT3D_CACHE_MAGIC, sizeof(header.magic)) != 0
+        || header.version != RGY_LUT3D_CACHE_VERSION
+        || header.srcSize != srcsize
+        || header.srcTime != srctime
+        || header.pathLength != srcpath.length()
+        || header.tableSize0 <= 0 || header.tableSize0 > RGY_LUT3D_CACHE_SIZE_MAX
+        || header.tableOffset % sizeof(LUTVEC) != 0
+        || header.tableOffset < sizeof(header) + header.pathLength
+        || memcmp(map.data() + sizeof(header), srcpath.data(), srcpath.length()) != 0) {
+        return false;
+    }
+    const size_t count = (size_t)header.tableSize0 * header.tableSize0 * header.tableSize0;
+    if (header.tableOffset + count * sizeof(LUTVEC) != map.size()) {
+        return false;
+    }
+    m_tableSize0 = header.tableSize0;
+    m_tableSize01 = header.tableSize0 * header.tableSize0;
+    for (int i = 0; i < 3; i++) {
+        m_rgbscale(i) = header.rgbscale[i];
+    }
+    luttable.resize(count);
+    memcpy(luttable.data(), map.data() + header.tableOffset, count * sizeof(LUTVEC));
+    return true;
+}
+
+void ColorspaceOpLUT3D::storeCubeCache(const tstring& cachefile, const std::string& srcpath, const uint64_t srcsize, const int64_t srctime, const std::vector<LUTVEC>& luttable) {
+    RGYLUT3DCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RGY_LUT3D_CACHE_MAGIC, sizeof(header.magic));
+    header.version = RGY_LUT3D_CACHE_VERSION;
+    header.pathLength = (uint32_t)srcpath.length();
+    header.srcSize = srcsize;
+    header.srcTime = srctime;
+    header.tableSize0 = m_tableSize0;
+    for (int i = 0; i < 3; i++) {
+        header.rgbscale[i] = m_rgbscale(i);
+    }
+    header.tableOffset = rgy_ceil_int(sizeof(header) + srcpath.length(), sizeof(LUTVEC));
+
+    std::vector<uint8_t> buffer(header.tableOffset + luttable.size() * sizeof(LUTVEC), 0);
+    memcpy(buffer.data(), &header, sizeof(header));
+    memcpy(buffer.data() + sizeof(header), srcpath.data(), srcpath.length());
+    memcpy(buffer.data() + header.tableOffset, luttable.data(), luttable.size() * sizeof(LUTVEC));
+
+    //一時ファイルに書き出してからrenameで置き換え、読み込み中のプロセスに書きかけのファイルが見えないようにする
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(cachefile).parent_path(), ec);
+    const auto tmpfile = cachefile + strsprintf(_T(".%u.tmp"), GetCurrentProcessId());
+    FILE *fp = nullptr;
+    if (_tfopen_s(&fp, tmpfile.c_str(), _T("wb")) != 0 || fp == nullptr) {
+        m_log->write(RGY_LOG_DEBUG, RGY_LOGT_VPP, _T("Failed to create lut3d cache: %s\n"), tmpfile.c_str());
+        return;
+    }
+    const bool ok = fwrite(buffer.data(), 1, buffer.size(), fp) == buffer.size();
+    fclose(fp);
+    if (ok) {
+        std::filesystem::rename(tmpfile, cachefile, ec);
+    }
+    if (!ok || ec) {
+        std::filesystem::remove(tmpfile, ec);
+        m_log->write(RGY_LOG_DEBUG, RGY_LOGT_VPP, _T("Failed to write lut3d cache: %s\n"), cachefile.c_str());
+        return;
+    }
+    m_log->write(RGY_LOG_DEBUG, RGY_LOGT_VPP, _T("Stored lut3d cache: %s\n"), cachefile.c_str());
+}
+
+RGY_ERR ColorspaceOpLUT3D::parseCube(std::vector<uint8_t>& additionalParams) {
+    clearTable();
+
+    //キャッシュの照合用に、元ファイルのフルパス・サイズ・更新時刻を取得する
+    std::string srcpath;
+    uint64_t srcsize = 0;
+    int64_t srctime = 0;
+    tstring cachefile;
+    {
+        std::error_code ec;
+        const auto fullpath = std::filesystem::absolute(std::filesystem::path(m_table_file), ec);
+        if (!ec) srcsize = (uint64_t)std::filesystem::file_size(fullpath, ec);
+        if (!ec) srctime = (int64_t)std::filesystem::last_write_time(fullpath, ec).time_since_epoch().count();
+        const auto cachedir = getCacheDir(_T("lutcache"));
+        if (!ec && cachedir.length() > 0) {
+#if defined(_WIN32) || defined(_WIN64)
+            srcpath = wstring_to_string(fullpath.wstring(), CP_UTF8);
+#else
+            srcpath = fullpath.string();
+#endif
+            uint64_t hash = 0xcbf29ce484222325ull;
+            for (const auto c : srcpath) {
+                hash ^= (uint8_t)c;
+                hash *= 0x100000001b3ull; //FNV-1a
+            }
+            cachefile = lut3d_path_to_tstring(std::filesystem::path(cachedir) / strsprintf("%016llx.cube.bin", (unsigned long long)hash));
+        }
+    }
+
+    std::vector<LUTVEC> luttable;
+    if (cachefile.length() > 0 && loadCubeCache(cachefile, srcpath, srcsize, srctime, luttable)) {
+        m_log->write(RGY_LOG_DEBUG, RGY_LOGT_VPP, _T("Loaded lut3d cube file from cache: %s\n"), cachefile.c_str());
+        setAdditionalParams(additionalParams, luttable);
+        return RGY_ERR_NONE;
+    }
+
+    RGYFileMap map;
+    if (!map.open(m_table_file)) {
+        m_log->write(RGY_LOG_ERROR, RGY_LOGT_VPP, _T("Failed to open lut3d cube file: %s\n"), m_table_file.c_str());
+        return RGY_ERR_FILE_OPEN;
+    }
+    m_log->write(RGY_LOG_DEBUG, RGY_LOGT_VPP, _T("Opened lut3d cube file: %s\n"), m_table_file.c_str());
+    auto err = parseCubeText((const char *)map.data(), map.size(), luttable);
+    if (err != RGY_ERR_NONE) {
+        return err;
+    }
+    map.close();
+    if (cachefile.length() > 0) {
+        storeCubeCache(cachefile, srcpath, srcsize, srctime, luttable);
+    }
     setAdditionalParams(additionalParams, luttable);
     return RGY_ERR_NONE;
 }
 
-void ColorspaceOpLUT3D::setAdditionalParams(std::vector<uint8_t>& additionalParams, const std::vector<LUTVEC>& luttable) {
+static void setAdditionalParamsLUT(std::vector<uint8_t>& additionalParams, const std::vector<LUTVEC>& luttable) {
     RGYColorspaceDevParams *addPrmPtr = (RGYColorspaceDevParams *)additionalParams.data();
     // LUTVECのアライメントをとるため、最初の位置を調整する
     addPrmPtr->lut_offset = (int)rgy_ceil_int(additionalParams.size(), sizeof(LUTVEC));
-    m_log->write(RGY_LOG_DEBUG, RGY_LOGT_VPP, _T("lut3d table: lut_offset: %d, luttable size %llu\n"), addPrmPtr->lut_offset, sizeof(luttable[0]) * luttable.size());
     additionalParams.resize(addPrmPtr->lut_offset + sizeof(luttable[0]) * luttable.size());
     addPrmPtr = nullptr; // resizeで失効
     memcpy(getDevParamsLut(additionalParams.data()), luttable.data(), sizeof(luttable[0]) * luttable.size());
 }
 
+void ColorspaceOpLUT3D::setAdditionalParams(std::vector<uint8_t>& additionalParams, const std::vector<LUTVEC>& luttable) {
+    setAdditionalParamsLUT(additionalParams, luttable);
+    m_log->write(RGY_LOG_DEBUG, RGY_LOGT_VPP, _T("lut3d table: lut_offset: %d, luttable size %llu\n"),
+        ((const RGYColorspaceDevParams *)additionalParams.data())->lut_offset, sizeof(luttable[0]) * luttable.size());
+    m_table = luttable;
+}
+
 bool ColorspaceOpMatrix::add(const ColorspaceOp *op) {
     if (op->getType() != m_type) return false;
     const auto opMatrix = dynamic_cast<const ColorspaceOpMatrix *>(op);
@@ -794,190 +1166,75 @@ std::string ColorspaceOpInvAribB67::print() {
 std::string ColorspaceOpCL2RGB::print() {
     return strsprintf(R"(
     { //CL2RGB
-        const float nb = %.16ef;
-        const float pb = %.16ef;
-        const float nr = %.16ef;
-        const float pr = %.16ef;
-        float y = x.x;
-        float u = x.y;
-        float v = x.z;
-
-        const float b_minus_y = u * 2.0f * ((u < 0) ? nb : pb);
-        const float r_minus_y = v * 2.0f * ((v < 0) ? nr : pr);
-
-        float b = %s(b_minus_y + y);
-        float r = %s(r_minus_y + y);
-
-        y = %s(y);
-
-        const float kr = %.16ef;
-        const float kb = %.16ef;
-        const float kg = %.16ef;
-        const float g = (y - kr * r - kb * b) / kg;
-
-        const float scale = %.16ef;
-        x.x = r * scale;
-        x.y = g * scale;
-        x.z = b * scale;
+        x = cl2rgb_pre_ops( x, %.16ef, %.16ef, %.16ef, %.16ef );
+        x.x = %s( x.x );
+        x.y = %s( x.y );
+        x.z = %s( x.z );
+        x = cl2rgb_post_ops( x, %.16ef, %.16ef, %.16ef, %.16ef );
     })",
         m_nb, m_pb, m_nr, m_pr,
         m_func.to_linear_str.c_str(), m_func.to_linear_str.c_str(), m_func.to_linear_str.c_str(),
-        m_kr, m_kb, m_kg,
-        m_scale);
+        m_kr, m_kb, m_kg, m_scale);
 }
 
 std::string ColorspaceOpCL2YUV::print() {
     return strsprintf(R"(
     { //CL2YUV
-        const float scale = %.16ef;
-        float r = x.x * scale;
-        float g = x.y * scale;
-        float b = x.z * scale;
-
-        const float kr = %.16ef;
-        const float kb = %.16ef;
-        const float kg = %.16ef;
-        const float y = %s(kr * r + kg * g + kb * b);
-        b = %s(b);
-        r = %s(r);
-
-        const float nb = %.16ef;
-        const float pb = %.16ef;
-        const float nr = %.16ef;
-        const float pr = %.16ef;
-        const float u = (b - y) / (2.0f * ((b - y < 0.0f) ? nb : pb));
-        const float v = (r - y) / (2.0f * ((r - y < 0.0f) ? nr : pr));
-
-        x.x = y;
-        x.y = u;
-        x.z = v;
+        x = cl2yuv_pre_ops( x, %.16ef, %.16ef, %.16ef, %.16ef );
+        x.x = %s( x.x );
+        x.y = %s( x.y );
+        x.z = %s( x.z );
+        x = cl2yuv_post_ops( x, %.16ef, %.16ef, %.16ef, %.16ef );
     })",
-        m_scale,
-        m_kr, m_kb, m_kg,
+        m_scale, m_kr, m_kb, m_kg,
         m_func.to_gamma_str.c_str(), m_func.to_gamma_str.c_str(), m_func.to_gamma_str.c_str(),
         m_nb, m_pb, m_nr, m_pr);
 }
 
-// https://mpv.io/manual/master/#options-tone-mapping-desaturate あたりがベース
-// https://github.com/mpv-player/mpv/blob/master/video/out/gpu/video_shaders.c あたりを参考にして実装しなおしたもの
-std::string ColorspaceOpHDR2SDR::printDesat(double desat_scale) {
-    return strsprintf(R"(
-        const float in_max  = fmaxf( fmaxf(x.x, x.y), fmaxf(x.z, 1e-6f) );
-        const float out_max = fmaxf( fmaxf(y.x, y.y), fmaxf(y.z, 1e-6f) );
-        const float mul = out_max / in_max;
-
-        const float desat_scale = %.16ef;
-        const float desat_base = %.16ef;
-        const float desat_strength = %.16ef;
-        const float desat_exp = %.16ef;
-        // in coeff calculation, "out_max" should be in normalized scale
-        const float coeff = fmaxf(out_max * desat_scale - desat_base, 1e-6f) / fmaxf(out_max * desat_scale, 1.0f);
-        const float mixcoeff = desat_strength * powf(coeff, desat_exp);
-        x.x = colorspace_mix(x.x * mul, y.x, mixcoeff);
-        x.y = colorspace_mix(x.y * mul, y.y, mixcoeff);
-        x.z = colorspace_mix(x.z * mul, y.z, mixcoeff);
-    )",
-        desat_scale, m_desat_base, m_desat_strength, m_desat_exp);
-}
-
 std::string ColorspaceOpHDR2SDRHable::print() {
-    auto str = strsprintf(R"(
+    return strsprintf(R"(
     { //hdr2sdr hable
-        const float source_peak = %.16ef;
-        const float ldr_nits = %.16ef;
-        const float A = %.16ef;
-        const float B = %.16ef;
-        const float C = %.16ef;
-        const float D = %.16ef;
-        const float E = %.16ef;
-        const float F = %.16ef;
-
-        float3 y;
-        y.x = hdr2sdr_hable( x.x, source_peak, ldr_nits, A, B, C, D, E, F );
-        y.y = hdr2sdr_hable( x.y, source_peak, ldr_nits, A, B, C, D, E, F );
-        y.z = hdr2sdr_hable( x.z, source_peak, ldr_nits, A, B, C, D, E, F );
-    )", m_source_peak, m_ldr_nits, m_A, m_B, m_C, m_D, m_E, m_F);
-    str += printDesat(1.0f);
-    str += "}";
-    return str;
+        x = hdr2sdr_hable_ops( x, %.16ef, %.16ef,
+            %.16ef, %.16ef, %.16ef, %.16ef, %.16ef, %.16ef,
+            %.16ef, %.16ef, %.16ef );
+    })",
+        m_source_peak, m_ldr_nits,
+        m_A, m_B, m_C, m_D, m_E, m_F,
+        m_desat_base, m_desat_strength, m_desat_exp);
 }
 
 std::string ColorspaceOpHDR2SDRMobius::print() {
-    auto str = strsprintf(R"(
+    return strsprintf(R"(
     { //hdr2sdr mobius
-        const float source_peak = %.16ef;
-        const float ldr_nits = %.16ef;
-        const float transition = %.16ef;
-        const float peak = %.16ef;
-        const float in = fmaxf( fmaxf(x.x, x.y), fmaxf(x.z, 1e-6f) );
-
-        float3 y;
-        y.x = hdr2sdr_mobius( x.x, source_peak, ldr_nits, transition, peak );
-        y.y = hdr2sdr_mobius( x.y, source_peak, ldr_nits, transition, peak );
-        y.z = hdr2sdr_mobius( x.z, source_peak, ldr_nits, transition, peak );
-    )", m_source_peak, m_ldr_nits, m_transition, m_peak);
-    str += printDesat(1.0f);
-    str += "}";
-    return str;
+        x = hdr2sdr_mobius_ops( x, %.16ef, %.16ef,
+            %.16ef, %.16ef,
+            %.16ef, %.16ef, %.16ef );
+    })",
+        m_source_peak, m_ldr_nits,
+        m_transition, m_peak,
+        m_desat_base, m_desat_strength, m_desat_exp);
 }
 
 std::string ColorspaceOpHDR2SDRReinhard::print() {
-    auto str = strsprintf(R"(
+    return strsprintf(R"(
     { //hdr2sdr reinhard
-        const float source_peak = %.16ef;
-        const float ldr_nits = %.16ef;
-        const float contrast = %.16ef;
-        const float peak = %.16ef;
-        const float offset = (1.0f - contrast) / contrast;
-        float3 y;
-        y.x = hdr2sdr_reinhard( x.x, source_peak, ldr_nits, offset, peak );
-        y.y = hdr2sdr_reinhard( x.y, source_peak, ldr_nits, offset, peak );
-        y.z = hdr2sdr_reinhard( x.z, source_peak, ldr_nits, offset, peak );
-    )", m_source_peak, m_ldr_nits, m_contrast, m_peak);
-    str += printDesat(1.0f);
-    str += "}";
-    return str;
+        x = hdr2sdr_reinhard_ops( x, %.16ef, %.16ef,
+            %.16ef, %.16ef,
+            %.16ef, %.16ef, %.16ef );
+    })",
+        m_source_peak, m_ldr_nits,
+        m_contrast, m_peak,
+        m_desat_base, m_desat_strength, m_desat_exp);
 }
 
-// https://mpv.io/manual/master/#options-tone-mapping ベースの実装
-// https://github.com/mpv-player/mpv/blob/master/video/out/gpu/video_shaders.c あたりを参考にして実装しなおしたもの
 std::string ColorspaceOpHDR2SDRBT2390::print() {
-    auto str = strsprintf(R"(
+    return strsprintf(R"(
     { //hdr2sdr bt.2390
-        float sig_peak = %.16ef;
-        const float dst_peak = %.16ef;
-        const float inv_dst_peak = 1.0f / dst_peak;
-
-        // use non-normalized value
-        x.x *= dst_peak;
-        x.y *= dst_peak;
-        x.z *= dst_peak;
-
-        const float sig_peak_pq = linear_to_pq_space(sig_peak);
-        const float scale = 1.0 / sig_peak_pq;
-
-        float3 y;
-        y.x = linear_to_pq_space(x.x) * scale;
-        y.y = linear_to_pq_space(x.y) * scale;
-        y.z = linear_to_pq_space(x.z) * scale;
-        const float maxLum = linear_to_pq_space(dst_peak) * scale;
-
-        y.x = apply_bt2390(y.x, maxLum) * sig_peak_pq;
-        y.y = apply_bt2390(y.y, maxLum) * sig_peak_pq;
-        y.z = apply_bt2390(y.z, maxLum) * sig_peak_pq;
-
-        y.x = pq_space_to_linear(y.x);
-        y.y = pq_space_to_linear(y.y);
-        y.z = pq_space_to_linear(y.z);
-    )", m_source_peak, m_ldr_nits);
-    str += printDesat(1.0f / m_ldr_nits);
-    str += R"(
-        // back to normalized value
-        x.x *= inv_dst_peak;
-        x.y *= inv_dst_peak;
-        x.z *= inv_dst_peak;
-    })";
-    return str;
+        x = hdr2sdr_bt2390_ops( x, %.16ef, %.16ef,
+            %.16ef, %.16ef, %.16ef );
+    })",
+        m_source_peak, m_ldr_nits,
+        m_desat_base, m_desat_strength, m_desat_exp);
 }
 
 std::string ColorspaceOpHDR2SDR::printDesatInfo() {
@@ -1020,19 +1277,159 @@ std::string ColorspaceOpHDR2SDRBT2390::printInfo() {
 std::string ColorspaceOpRange::print() {
     return strsprintf(R"(
     { //range %s
-        const float range_y   = %.16ef;
-        const float offset_y  = %.16ef;
-        const float range_uv  = %.16ef;
-        const float offset_uv = %.16ef;
-        x.x = x.x * range_y  + offset_y;
-        x.y = x.y * range_uv + offset_uv;
-        x.z = x.z * range_uv + offset_uv;
+        x = colorspace_range_ops( x, %.16ef, %.16ef, %.16ef, %.16ef );
     })",
         m_int2float ? "int->float" : "float->int",
         m_scale_y,  m_offset_y,
         m_scale_uv, m_offset_uv);
 }
 
+// 以下のcalcは、それぞれのprint()が出力するコードと同じ計算を行う
+// 計算の本体はprint()と同じくrgy_filter_colorspace_func.hの関数を呼び、print()で定数をfloatとして出力しているので、ここでもfloatに変換して渡す
+vec3f ColorspaceOpMatrix::calc(const vec3f& in) const {
+    float mat[3][3];
+    for (int j = 0; j < 3; j++) {
+        for (int i = 0; i < 3; i++) {
+            mat[j][i] = (float)m(j, i);
+        }
+    }
+    return toVec3f(matrix_mul(mat, toFloat3(in)));
+}
+
+vec3f ColorspaceOpGammaFunc::calc(const vec3f& in) const {
+    const float pre_scaler = (float)func.to_gamma_scale;
+    const float post_scaler = 1.0f;
+    return vec3f(
+        post_scaler * func.to_gamma(in(0) * pre_scaler),
+        post_scaler * func.to_gamma(in(1) * pre_scaler),
+        post_scaler * func.to_gamma(in(2) * pre_scaler));
+}
+
+vec3f ColorspaceOpInvGammaFunc::calc(const vec3f& in) const {
+    const float pre_scaler = 1.0f;
+    const float post_scaler = (float)func.to_linear_scale;
+    return vec3f(
+        post_scaler * func.to_linear(in(0) * pre_scaler),
+        post_scaler * func.to_linear(in(1) * pre_scaler),
+        post_scaler * func.to_linear(in(2) * pre_scaler));
+}
+
+vec3f ColorspaceOpAribB67::calc(const vec3f& in) const {
+    return toVec3f(aribB67Ops(toFloat3(in), (float)m_kr, (float)m_kg, (float)m_kb, (float)m_scale));
+}
+
+vec3f ColorspaceOpInvAribB67::calc(const vec3f& in) const {
+    return toVec3f(aribB67InvOps(toFloat3(in), (float)m_kr, (float)m_kg, (float)m_kb, (float)m_scale));
+}
+
+vec3f ColorspaceOpCL2RGB::calc(const vec3f& in) const {
+    float3 x = cl2rgb_pre_ops(toFloat3(in), (float)m_nb, (float)m_pb, (float)m_nr, (float)m_pr);
+    x.x = m_func.to_linear(x.x);
+    x.y = m_func.to_linear(x.y);
+    x.z = m_func.to_linear(x.z);
+    return toVec3f(cl2rgb_post_ops(x, (float)m_kr, (float)m_kb, (float)m_kg, (float)m_scale));
+}
+
+vec3f ColorspaceOpCL2YUV::calc(const vec3f& in) const {
+    float3 x = cl2yuv_pre_ops(toFloat3(in), (float)m_scale, (float)m_kr, (float)m_kb, (float)m_kg);
+    x.x = m_func.to_gamma(x.x);
+    x.y = m_func.to_gamma(x.y);
+    x.z = m_func.to_gamma(x.z);
+    return toVec3f(cl2yuv_post_ops(x, (float)m_nb, (float)m_pb, (float)m_nr, (float)m_pr));
+}
+
+vec3f ColorspaceOpHDR2SDRHable::calc(const vec3f& in) const {
+    return toVec3f(hdr2sdr_hable_ops(toFloat3(in), (float)m_source_peak, (float)m_ldr_nits,
+        (float)m_A, (float)m_B, (float)m_C, (float)m_D, (float)m_E, (float)m_F,
+        (float)m_desat_base, (float)m_desat_strength, (float)m_desat_exp));
+}
+
+vec3f ColorspaceOpHDR2SDRMobius::calc(const vec3f& in) const {
+    return toVec3f(hdr2sdr_mobius_ops(toFloat3(in), (float)m_source_peak, (float)m_ldr_nits,
+        (float)m_transition, (float)m_peak,
+        (float)m_desat_base, (float)m_desat_strength, (float)m_desat_exp));
+}
+
+vec3f ColorspaceOpHDR2SDRReinhard::calc(const vec3f& in) const {
+    return toVec3f(hdr2sdr_reinhard_ops(toFloat3(in), (float)m_source_peak, (float)m_ldr_nits,
+        (float)m_contrast, (float)m_peak,
+        (float)m_desat_base, (float)m_desat_strength, (float)m_desat_exp));
+}
+
+vec3f ColorspaceOpHDR2SDRBT2390::calc(const vec3f& in) const {
+    return toVec3f(hdr2sdr_bt2390_ops(toFloat3(in), (float)m_source_peak, (float)m_ldr_nits,
+        (float)m_desat_base, (float)m_desat_strength, (float)m_desat_exp));
+}
+
+vec3f ColorspaceOpRange::calc(const vec3f& in) const {
+    return toVec3f(colorspace_range_ops(toFloat3(in), (float)m_scale_y, (float)m_offset_y, (float)m_scale_uv, (float)m_offset_uv));
+}
+
+// 変換全体を1つの3D LUTにまとめたもの
+// 入力はint->floatの前の画素値、出力はfloat->intの後の画素値で、補間はtetrahedralで行う
+class ColorspaceOpFusedLUT3D : public ColorspaceOp {
+public:
+    ColorspaceOpFusedLUT3D(int lutSize, int bitdepthIn, int bitdepthOut) :
+        m_tableSize0(lutSize), m_tableSize01(lutSize * lutSize),
+        m_scale((float)(lutSize - 1) / (float)((1 << bitdepthIn) - 1)),
+        m_bitdepthOut(bitdepthOut), m_table(), m_avgErr(0.0), m_p99Err(0.0), m_maxErr(0.0), m_cached(false) {
+        m_type = COLORSPACE_OP_TYPE_LUT3D;
+        m_table.resize(m_tableSize01 * m_tableSize0);
+    };
+    virtual ~ColorspaceOpFusedLUT3D() {};
+    virtual std::string print() override;
+    virtual std::string printInfo() override;
+    virtual vec3f calc(const vec3f& x) const override;
+    virtual bool add(const ColorspaceOp *op) override { UNREFERENCED_PARAMETER(op); return false; }
+    int size() const { return m_tableSize0; }
+    //i番目の格子点の入力値 (画素値)
+    float gridValue(int i) const { return (float)i / m_scale; }
+    std::vector<LUTVEC>& table() { return m_table; }
+    void setAccuracy(double avgErr, double p99Err, double maxErr, bool cached) { m_avgErr = avgErr; m_p99Err = p99Err; m_maxErr = maxErr; m_cached = cached; }
+protected:
+    int m_tableSize0;
+    int m_tableSize01;
+    float m_scale;        //画素値 -> LUTのindex
+    int m_bitdepthOut;
+    std::vector<LUTVEC> m_table;
+    //元の変換との差 (出力の画素値単位) の平均、99パーセンタイル、最大値
+    double m_avgErr;
+    double m_p99Err;
+    double m_maxErr;
+    bool m_cached;        //キャッシュから読み込んだか
+};
+
+std::string ColorspaceOpFusedLUT3D::print() {
+    return strsprintf(R"(
+    { // fused lut3d
+        const int lutSize0  = %d;
+        const int lutSize01 = %d;
+        const float lut_max_idx = (float)(lutSize0 - 1) + 1e-6f;
+        const float scale = %.16ef;
+        x.x = clamp(x.x * scale, 0.0f, lut_max_idx);
+        x.y = clamp(x.y * scale, 0.0f, lut_max_idx);
+        x.z = clamp(x.z * scale, 0.0f, lut_max_idx);
+        x = lut3d_interp_tetrahedral(x, getDevParamsLutC(params), lutSize0, lutSize01);
+    })",
+        m_tableSize0, m_tableSize01, m_scale);
+}
+
+std::string ColorspaceOpFusedLUT3D::printInfo() {
+    return strsprintf("fused lut3d: size=%d, interp=tetrahedral%s\n"
+        "                                  error vs analytic (%dbit): avg %.2f, 99%% %.2f, max %.2f",
+        m_tableSize0, (m_cached) ? ", cached" : "",
+        m_bitdepthOut, m_avgErr, m_p99Err, m_maxErr);
+}
+
+vec3f ColorspaceOpFusedLUT3D::calc(const vec3f& in) const {
+    const float lut_max_idx = (float)(m_tableSize0 - 1) + 1e-6f;
+    float3 x = toFloat3(in);
+    x.x = clamp(x.x * m_scale, 0.0f, lut_max_idx);
+    x.y = clamp(x.y * m_scale, 0.0f, lut_max_idx);
+    x.z = clamp(x.z * m_scale, 0.0f, lut_max_idx);
+    return toVec3f(lut3d_interp_tetrahedral(x, m_table.data(), m_tableSize0, m_tableSize01));
+}
+
 void ColorspaceOpCtrl::addOperation(ColorspaceOpInfo& op) {
     if (operations.size() == 0
         || !operations.back().ops->add(op.ops.get())) {
@@ -1042,7 +1439,126 @@ void ColorspaceOpCtrl::addOperation(ColorspaceOpInfo& op) {
     }
 }
 
+vec3f ColorspaceOpCtrl::calc(const vec3f& x) const {
+    vec3f y = x;
+    for (const auto &op : operations) {
+        y = op.ops->calc(y);
+    }
+    return y;
+}
+
+// 出力の画素値への丸め (kernel_colorspaceのtoPixの直前まで)
+static float fuse_lut_clamp_output(float x, float max_value) {
+    return (std::isnan(x)) ? 0.0f : clamp(x, 0.0f, max_value);
+}
+
+RGY_ERR ColorspaceOpCtrl::fuseLUT(int lutSize, RGY_CSP csp_in, RGY_CSP csp_out, std::vector<uint8_t>& additionalParams) {
+    if (operations.size() == 0) {
+        return RGY_ERR_NONE;
+    }
+    if (lutSize < 2) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid lut size for fuse_lut: %d.\n"), lutSize);
+        return RGY_ERR_INVALID_PARAM;
+    }
+    const auto timeStart = std::chrono::system_clock::now();
+    const int bitdepthIn = RGY_CSP_BIT_DEPTH[csp_in];
+    const int bitdepthOut = RGY_CSP_BIT_DEPTH[csp_out];
+    const float maxIn = (float)((1 << bitdepthIn) - 1);
+    const float maxOut = (float)((1 << bitdepthOut) - 1);
+    auto fused = std::make_unique<ColorspaceOpFusedLUT3D>(lutSize, bitdepthIn, bitdepthOut);
+    auto& table = fused->table();
+
+    //キャッシュのキーには、変換のコード全体と、lut3dのテーブルなどの追加のパラメータ、計算のバージョンを含める
+    std::string chain = printOpAll();
+    chain.append((const char *)additionalParams.data(), additionalParams.size());
+    const auto key = RGYOpenCLProgramCache::key(chain, strsprintf("fuse_lut=%d,in=%d,out=%d,ver=%d", lutSize, bitdepthIn, bitdepthOut, FUSE_LUT_CACHE_VERSION), "cpu");
+    RGYOpenCLProgramCache cache(getCacheDir(_T("lutcache")));
+    bool cached = false;
+    if (cache.dir().length() > 0) {
+        const auto binary = cache.load(key);
+        if (binary.size() == table.size() * sizeof(table[0])) {
+            memcpy(table.data(), binary.data(), binary.size());
+            cached = true;
+        }
+    }
+    if (!cached) {
+        //格子点ごとに変換全体を計算する (i0の面ごとにスレッドに割り振る)
+        const int threads = clamp((int)std::thread::hardware_concurrency(), 1, lutSize);
+        auto bake = [&](const int thread_id) {
+            for (int i0 = thread_id; i0 < lutSize; i0 += threads) {
+                for (int i1 = 0; i1 < lutSize; i1++) {
+                    for (int i2 = 0; i2 < lutSize; i2++) {
+                        const auto y = calc(vec3f(fused->gridValue(i0), fused->gridValue(i1), fused->gridValue(i2)));
+                        auto& val = table[(i0 * lutSize + i1) * lutSize + i2];
+                        val.x = fuse_lut_clamp_output(y(0), maxOut);
+                        val.y = fuse_lut_clamp_output(y(1), maxOut);
+                        val.z = fuse_lut_clamp_output(y(2), maxOut);
+                        val.w = 0.0f;
+                    }
+                }
+            }
+        };
+        std::vector<std::thread> th;
+        for (int i = 1; i < threads; i++) {
+            th.push_back(std::thread(bake, i));
+        }
+        bake(0);
+        for (auto& t : th) {
+            t.join();
+        }
+        if (cache.dir().length() > 0) {
+            std::vector<uint8_t> binary(table.size() * sizeof(table[0]));
+            memcpy(binary.data(), table.data(), binary.size());
+            if (cache.store(key, binary) != RGY_ERR_NONE) {
+                AddMessage(RGY_LOG_DEBUG, _T("Failed to store fused lut to cache: %s.\n"), cache.dir().c_str());
+            }
+        }
+    }
+
+    //元の変換との誤差を、ランダムな画素値で評価する (乱数のシードは固定)
+    //色域外となる入力の組み合わせも含むため、最大値は色域の境界付近の誤差で大きくなりやすい
+    const int FUSE_LUT_ACCURACY_SAMPLES = 65536;
+    std::mt19937 mt(0x5eed);
+    std::uniform_int_distribution<int> dist(0, (1 << bitdepthIn) - 1);
+    std::vector<float> errList(FUSE_LUT_ACCURACY_SAMPLES);
+    double sumErr = 0.0;
+    for (int i = 0; i < FUSE_LUT_ACCURACY_SAMPLES; i++) {
+        const vec3f x((float)dist(mt), (float)dist(mt), (float)dist(mt));
+        const auto ref = calc(x);
+        const auto lut = fused->calc(x);
+        float err = 0.0f;
+        for (int j = 0; j < 3; j++) {
+            err = std::max(err, std::abs(fuse_lut_clamp_output(ref(j), maxOut) - fuse_lut_clamp_output(lut(j), maxOut)));
+        }
+        errList[i] = err;
+        sumErr += err;
+    }
+    std::sort(errList.begin(), errList.end());
+    const double avgErr = sumErr / FUSE_LUT_ACCURACY_SAMPLES;
+    const double p99Err = errList[FUSE_LUT_ACCURACY_SAMPLES * 99 / 100];
+    const double maxErr = errList.back();
+    fused->setAccuracy(avgErr, p99Err, maxErr, cached);
+
+    //追加のパラメータは、まとめたLUTのみにする
+    additionalParams.resize(sizeof(RGYColorspaceDevParams));
+    RGYColorspaceDevParams *addPrmPtr = (RGYColorspaceDevParams *)additionalParams.data();
+    addPrmPtr->lut_offset = 0;
+    addPrmPtr->prelut_offset = 0;
+    setAdditionalParamsLUT(additionalParams, table);
+
+    const auto timeFin = std::chrono::system_clock::now();
+    AddMessage(RGY_LOG_DEBUG, _T("fused lut: size %d, %s in %.1f ms, error avg %.2f, 99%% %.2f, max %.2f, cache %s.\n"),
+        lutSize, (cached) ? _T("loaded") : _T("baked"),
+        std::chrono::duration_cast<std::chrono::microseconds>(timeFin - timeStart).count() / 1000.0,
+        avgErr, p99Err, maxErr, cache.stats().c_str());
+    m_fused = std::move(fused);
+    return RGY_ERR_NONE;
+}
+
 std::string ColorspaceOpCtrl::printOpAll() const {
+    if (m_fused) {
+        return m_fused->print() + "\n";
+    }
     std::string str;
     for (const auto &op : operations) {
         str += op.ops->print() + "\n";
@@ -1080,6 +1596,12 @@ tstring ColorspaceOpCtrl::printInfoAll() const {
             }
         }
     }
+    if (m_fused) {
+        if (str.length() > 0) {
+            str += _T("\n                           ");
+        }
+        str += char_to_tstring(m_fused->printInfo());
+    }
     return str;
 }
 
@@ -1790,6 +2312,11 @@ RGY_ERR RGYFilterColorspace::init(shared_ptr<RGYFilterParam> pParam, shared_ptr<
             }
         }
         opCtrl->setOperation(filterInCsp, filterInCsp);
+        if (prm->colorspace.fuse_lut > 0) {
+            if ((sts = opCtrl->fuseLUT(prm->colorspace.fuse_lut, filterInCsp, filterInCsp, additionalParams)) != RGY_ERR_NONE) {
+                return sts;
+            }
+        }
         if (additionalParams.size() > 0) {
             AddMessage(RGY_LOG_DEBUG, _T("additional param size: %llu.\n"), (uint64_t)additionalParams.size());
             additionalParamsDev = m_cl->copyDataToBuffer(additionalParams.data(), additionalParams.size(), CL_MEM_READ_ONLY, m_cl->queue().get());
@@ -49,6 +49,8 @@ public:
     virtual std::string print() = 0;
     virtual std::string printInfo() { return ""; }
     virtual bool add(const ColorspaceOp *op) = 0;
+    //print()の出力するコードと同じ計算をCPUで行う
+    virtual vec3f calc(const vec3f& x) const = 0;
 protected:
     ColorspaceOpType m_type;
 };
@@ -64,17 +66,22 @@ struct ColorspaceOpInfo {
 
 class ColorspaceOpCtrl {
 public:
-    ColorspaceOpCtrl(shared_ptr<RGYLog> log) : operations(), m_log(log), m_path() {};
+    ColorspaceOpCtrl(shared_ptr<RGYLog> log) : operations(), m_log(log), m_path(), m_fused() {};
     ~ColorspaceOpCtrl() {};
 
     void addOperation(ColorspaceOpInfo &op);
     void clearOperation() {
         operations.clear();
+        m_fused.reset();
     }
     RGY_ERR setLUT3D(const VideoVUIInfo& in, const VideoVUIInfo& out, double sdr_source_peak, bool approx_gamma, bool scene_ref, const LUT3DParams& prm, std::vector<uint8_t>& additionalParams, int height);
     RGY_ERR setHDR2SDR(const VideoVUIInfo &in, const VideoVUIInfo &out, double source_peak, bool approx_gamma, bool scene_ref, const HDR2SDRParams &prm, int height);
     RGY_ERR setPath(const VideoVUIInfo &in, const VideoVUIInfo &out, double source_peak, bool approx_gamma, bool scene_ref, int height);
     RGY_ERR setOperation(RGY_CSP csp_in, RGY_CSP csp_out);
+    //setOperationで作成した変換全体をlutSize^3の3D LUTにまとめ、以降のprintOpAll()ではこれを使用する
+    RGY_ERR fuseLUT(int lutSize, RGY_CSP csp_in, RGY_CSP csp_out, std::vector<uint8_t>& additionalParams);
+    //変換全体をCPUで計算する (3D LUTにまとめる前の変換を使用する)
+    vec3f calc(const vec3f& x) const;
     std::string printOpAll() const;
     tstring printInfoAll() const;
     VideoVUIInfo VuiOut() const;
@@ -120,6 +127,7 @@ private:
     vector<ColorspaceOpInfo> operations;
     shared_ptr<RGYLog> m_log;  //ログ出力
     vector<ColorspaceOpInfo> m_path;
+    unique_ptr<ColorspaceOp> m_fused; //fuseLUTで作成した3D LUT
 };
 
 class RGYFilterParamColorspace : public RGYFilterParam {
@@ -133,6 +141,12 @@ public:
     virtual tstring print() const override;
 };
 
+//.cubeファイルの値を1つ読み取る (--check-lut3d-parseでの確認にも使用する)
+//  pptr    ... 読み取り開始位置、読み取れた場合は値の直後に更新される
+//  fin     ... 行末 (終端されていなくてよい)
+//  戻り値  ... 値として読み取れればtrue
+bool lut3d_cube_parse_float(const char **pptr, const char *fin, float *value);
+
 class RGYFilterColorspace : public RGYFilter {
 public:
     RGYFilterColorspace(shared_ptr<RGYOpenCLContext> context);
@@ -0,0 +1,160 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <random>
+#include "rgy_osdep.h"
+#include "rgy_util.h"
+#include "rgy_filter_colorspace_check.h"
+#include "rgy_check.h"
+#include "rgy_filter_colorspace.h"
+
+static const int CHECK_LUT3D_PARSE_RANDOM_COUNT = 2000000;
+static const int CHECK_LUT3D_PARSE_BENCH_SIZE = 65; // 65x65x65の.cubeファイル相当の値を読み取る
+
+// strtofでの読み取り結果 (値全体を読み取れた場合のみtrue)
+static bool check_lut3d_parse_ref(const std::string& str, float *value) {
+    if (str.length() == 0) {
+        return false;
+    }
+    char *end = nullptr;
+    *value = strtof(str.c_str(), &end);
+    return end == str.c_str() + str.length();
+}
+
+// strを終端なしのバッファに置いて読み取り、strtofと比較する (一致すればtrue)
+static bool check_lut3d_parse_one(const std::string& str) {
+    const std::vector<char> buf(str.begin(), str.end());
+    const char *ptr = buf.data();
+    float value = 0.0f;
+    const bool ret = lut3d_cube_parse_float(&ptr, buf.data() + buf.size(), &value);
+    float valueRef = 0.0f;
+    const bool retRef = check_lut3d_parse_ref(str, &valueRef);
+    if (ret != retRef) {
+        return false;
+    }
+    if (!ret) {
+        return true;
+    }
+    if (ptr != buf.data() + buf.size()) {
+        return false;
+    }
+    if (std::isnan(valueRef)) {
+        return std::isnan(value);
+    }
+    return memcmp(&value, &valueRef, sizeof(value)) == 0;
+}
+
+bool check_lut3d_cube_parse() {
+    bool ok = true;
+    //各種の表記
+    const char *fixedList[] = {
+        "0", "1", "-0", "+0.5", "0.000000", "1.000000", "0.123456", "-0.1234567", ".5", "5.", "000123.4560000",
+        "16777215", "16777216", "16777217", "123456789", "0.16777217", "1e10", "1e-10", "1e11", "1e-11", "2.5E+3", "7e-0",
+        "0.30000001192092896", "0.12345678901234567890123", "10000000000000000000000001", "1000000000000000000000000.5",
+        "3.4028235e38", "3.5e38", "1e39", "1.17549435e-38", "1.4e-45", "1e-46", "0e99999", "1e-99999",
+        "inf", "-inf", "+INF", "Infinity", "nan", "-NaN", "NAN", "0x1.8p1", "0X10",
+        "", "-", ".", "+.", "e5", "1e", "1e+", "1.0x", "1.0.0", "--1", "abc", "INFO", "nanx", "LUT_3D_SIZE",
+    };
+    int mismatch = 0;
+    for (const auto str : fixedList) {
+        if (!check_lut3d_parse_one(str)) {
+            _ftprintf(stdout, _T("  mismatch: \"%s\"\n"), char_to_tstring(str).c_str());
+            mismatch++;
+        }
+    }
+    ok &= rgy_check_print(_T("fixed values"), mismatch == 0, strsprintf(_T("mismatch %d / %d"), mismatch, (int)_countof(fixedList)));
+
+    //乱数で生成した値
+    std::mt19937 mt(1234);
+    std::uniform_real_distribution<float> distValue(-1.0f, 1.0f);
+    std::uniform_int_distribution<int> distExp(-40, 40);
+    std::uniform_int_distribution<int> distFormat(0, 7);
+    std::uniform_int_distribution<int> distDigit(0, 9);
+    std::uniform_int_distribution<int> distLength(1, 24);
+    const char *formats[] = { "%.6f", "%.9f", "%.3f", "%.4e", "%.9g", "%.17g", "%a" };
+    mismatch = 0;
+    for (int i = 0; i < CHECK_LUT3D_PARSE_RANDOM_COUNT; i++) {
+        std::string str;
+        const int format = distFormat(mt);
+        if (format < (int)_countof(formats)) {
+            const double v = (i & 1) ? distValue(mt) : distValue(mt) * std::pow(10.0, distExp(mt));
+            str = strsprintf(formats[format], v);
+        } else {
+            //ランダムな桁の並び (小数点の位置と桁数を変える)
+            const int length = distLength(mt);
+            const int point = std::uniform_int_distribution<int>(0, length)(mt);
+            for (int j = 0; j < length; j++) {
+                if (j == point) str += '.';
+                str += (char)('0' + distDigit(mt));
+            }
+        }
+        if (!check_lut3d_parse_one(str)) {
+            if (mismatch < 10) {
+                _ftprintf(stdout, _T("  mismatch: \"%s\"\n"), char_to_tstring(str).c_str());
+            }
+            mismatch++;
+        }
+    }
+    ok &= rgy_check_print(_T("random values"), mismatch == 0, strsprintf(_T("mismatch %d / %d"), mismatch, CHECK_LUT3D_PARSE_RANDOM_COUNT));
+
+    //.cubeファイルのデータ部分と同じ形式の文字列で、1つあたりの読み取り時間を比較する
+    const int count = CHECK_LUT3D_PARSE_BENCH_SIZE * CHECK_LUT3D_PARSE_BENCH_SIZE * CHECK_LUT3D_PARSE_BENCH_SIZE * 3;
+    std::string text;
+    std::uniform_real_distribution<float> dist01(0.0f, 1.0f);
+    for (int i = 0; i < count; i += 3) {
+        text += strsprintf("%.6f %.6f %.6f\n", dist01(mt), dist01(mt), dist01(mt));
+    }
+    const char *fin = text.c_str() + text.length();
+    double sum = 0.0, sumRef = 0.0;
+    int parsed = 0;
+    RGYCheckTimer timer;
+    for (const char *ptr = text.c_str(); ptr < fin; ptr++) {
+        float value = 0.0f;
+        if (!lut3d_cube_parse_float(&ptr, fin, &value)) {
+            break;
+        }
+        sum += value;
+        parsed++;
+    }
+    const double nsParse = timer.sec() * 1e9 / count;
+    timer.restart();
+    for (const char *ptr = text.c_str(); ptr < fin; ) {
+        char *end = nullptr;
+        sumRef += strtof(ptr, &end);
+        ptr = end + 1;
+    }
+    const double nsRef = timer.sec() * 1e9 / count;
+    ok &= rgy_check_print(_T("lut3d_cube_parse_float"), parsed == count && sum == sumRef, strsprintf(_T("%d values, %8.2f ns/value"), parsed, nsParse));
+    rgy_check_print_info(_T("strtof"), strsprintf(_T("%d values, %8.2f ns/value"), count, nsRef));
+
+    return rgy_check_print_total(ok);
+}
@@ -0,0 +1,40 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __RGY_FILTER_COLORSPACE_CHECK_H__
+#define __RGY_FILTER_COLORSPACE_CHECK_H__
+
+#include "rgy_tchar.h"
+
+// .cubeファイル (--vpp-colorspace lut3d) の値の読み取りの確認と速度計測
+// 各種の表記 (有効桁数の多いもの、指数表記、inf/nan、16進表記、値として読めないものを含む) と乱数で生成した値について、
+// lut3d_cube_parse_floatの結果がstrtofと一致することを確認したうえで、1つあたりの読み取り時間をstrtofと比較して表示する
+//   戻り値  ... すべての結果が一致すればtrue
+bool check_lut3d_cube_parse();
+
+#endif //__RGY_FILTER_COLORSPACE_CHECK_H__
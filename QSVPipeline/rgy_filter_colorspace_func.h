@@ -404,6 +404,137 @@ COLORSPACE_FUNC float colorspace_mix(float x, float y, float a) {
     return (x) * (1.0f - (a)) + (y) * (a);
 }
 
+//以下の*_opsは、ColorspaceOpのprint()が出力するカーネルのコードと、CPUでの同じ計算(calc())の両方から呼ぶ
+//計算を変更した場合は、rgy_filter_colorspace.cppのFUSE_LUT_CACHE_VERSIONを更新すること
+
+//CL2RGB: (y, u, v) -> 逆ガンマ補正前の(r, y, b)
+COLORSPACE_FUNC float3 cl2rgb_pre_ops(float3 x, float nb, float pb, float nr, float pr) {
+    const float y = x.x;
+    const float u = x.y;
+    const float v = x.z;
+    const float b_minus_y = u * 2.0f * ((u < 0) ? nb : pb);
+    const float r_minus_y = v * 2.0f * ((v < 0) ? nr : pr);
+    return make_float3(r_minus_y + y, y, b_minus_y + y);
+}
+
+//CL2RGB: 逆ガンマ補正後の(r, y, b) -> (r, g, b)
+COLORSPACE_FUNC float3 cl2rgb_post_ops(float3 x, float kr, float kb, float kg, float scale) {
+    const float r = x.x;
+    const float y = x.y;
+    const float b = x.z;
+    const float g = (y - kr * r - kb * b) / kg;
+    return make_float3(r * scale, g * scale, b * scale);
+}
+
+//CL2YUV: (r, g, b) -> ガンマ補正前の(r, y, b)
+COLORSPACE_FUNC float3 cl2yuv_pre_ops(float3 x, float scale, float kr, float kb, float kg) {
+    const float r = x.x * scale;
+    const float g = x.y * scale;
+    const float b = x.z * scale;
+    return make_float3(r, kr * r + kg * g + kb * b, b);
+}
+
+//CL2YUV: ガンマ補正後の(r, y, b) -> (y, u, v)
+COLORSPACE_FUNC float3 cl2yuv_post_ops(float3 x, float nb, float pb, float nr, float pr) {
+    const float r = x.x;
+    const float y = x.y;
+    const float b = x.z;
+    const float u = (b - y) / (2.0f * ((b - y < 0.0f) ? nb : pb));
+    const float v = (r - y) / (2.0f * ((r - y < 0.0f) ? nr : pr));
+    return make_float3(y, u, v);
+}
+
+// https://mpv.io/manual/master/#options-tone-mapping-desaturate あたりがベース
+// https://github.com/mpv-player/mpv/blob/master/video/out/gpu/video_shaders.c あたりを参考にして実装しなおしたもの
+COLORSPACE_FUNC float3 hdr2sdr_desat(float3 x, float3 y, float desat_scale, float desat_base, float desat_strength, float desat_exp) {
+    const float in_max  = fmaxf( fmaxf(x.x, x.y), fmaxf(x.z, 1e-6f) );
+    const float out_max = fmaxf( fmaxf(y.x, y.y), fmaxf(y.z, 1e-6f) );
+    const float mul = out_max / in_max;
+
+    // in coeff calculation, "out_max" should be in normalized scale
+    const float coeff = fmaxf(out_max * desat_scale - desat_base, 1e-6f) / fmaxf(out_max * desat_scale, 1.0f);
+    const float mixcoeff = desat_strength * powf(coeff, desat_exp);
+    x.x = colorspace_mix(x.x * mul, y.x, mixcoeff);
+    x.y = colorspace_mix(x.y * mul, y.y, mixcoeff);
+    x.z = colorspace_mix(x.z * mul, y.z, mixcoeff);
+    return x;
+}
+
+COLORSPACE_FUNC float3 hdr2sdr_hable_ops(float3 x, float source_peak, float ldr_nits,
+    float A, float B, float C, float D, float E, float F,
+    float desat_base, float desat_strength, float desat_exp) {
+    float3 y;
+    y.x = hdr2sdr_hable( x.x, source_peak, ldr_nits, A, B, C, D, E, F );
+    y.y = hdr2sdr_hable( x.y, source_peak, ldr_nits, A, B, C, D, E, F );
+    y.z = hdr2sdr_hable( x.z, source_peak, ldr_nits, A, B, C, D, E, F );
+    return hdr2sdr_desat(x, y, 1.0f, desat_base, desat_strength, desat_exp);
+}
+
+COLORSPACE_FUNC float3 hdr2sdr_mobius_ops(float3 x, float source_peak, float ldr_nits,
+    float transition, float peak,
+    float desat_base, float desat_strength, float desat_exp) {
+    float3 y;
+    y.x = hdr2sdr_mobius( x.x, source_peak, ldr_nits, transition, peak );
+    y.y = hdr2sdr_mobius( x.y, source_peak, ldr_nits, transition, peak );
+    y.z = hdr2sdr_mobius( x.z, source_peak, ldr_nits, transition, peak );
+    return hdr2sdr_desat(x, y, 1.0f, desat_base, desat_strength, desat_exp);
+}
+
+COLORSPACE_FUNC float3 hdr2sdr_reinhard_ops(float3 x, float source_peak, float ldr_nits,
+    float contrast, float peak,
+    float desat_base, float desat_strength, float desat_exp) {
+    const float offset = (1.0f - contrast) / contrast;
+    float3 y;
+    y.x = hdr2sdr_reinhard( x.x, source_peak, ldr_nits, offset, peak );
+    y.y = hdr2sdr_reinhard( x.y, source_peak, ldr_nits, offset, peak );
+    y.z = hdr2sdr_reinhard( x.z, source_peak, ldr_nits, offset, peak );
+    return hdr2sdr_desat(x, y, 1.0f, desat_base, desat_strength, desat_exp);
+}
+
+// https://mpv.io/manual/master/#options-tone-mapping ベースの実装
+// https://github.com/mpv-player/mpv/blob/master/video/out/gpu/video_shaders.c あたりを参考にして実装しなおしたもの
+COLORSPACE_FUNC float3 hdr2sdr_bt2390_ops(float3 x, float sig_peak, float dst_peak,
+    float desat_base, float desat_strength, float desat_exp) {
+    const float inv_dst_peak = 1.0f / dst_peak;
+
+    // use non-normalized value
+    x.x *= dst_peak;
+    x.y *= dst_peak;
+    x.z *= dst_peak;
+
+    const float sig_peak_pq = linear_to_pq_space(sig_peak);
+    const float scale = 1.0f / sig_peak_pq;
+
+    float3 y;
+    y.x = linear_to_pq_space(x.x) * scale;
+    y.y = linear_to_pq_space(x.y) * scale;
+    y.z = linear_to_pq_space(x.z) * scale;
+    const float maxLum = linear_to_pq_space(dst_peak) * scale;
+
+    y.x = apply_bt2390(y.x, maxLum) * sig_peak_pq;
+    y.y = apply_bt2390(y.y, maxLum) * sig_peak_pq;
+    y.z = apply_bt2390(y.z, maxLum) * sig_peak_pq;
+
+    y.x = pq_space_to_linear(y.x);
+    y.y = pq_space_to_linear(y.y);
+    y.z = pq_space_to_linear(y.z);
+
+    x = hdr2sdr_desat(x, y, inv_dst_peak, desat_base, desat_strength, desat_exp);
+
+    // back to normalized value
+    x.x *= inv_dst_peak;
+    x.y *= inv_dst_peak;
+    x.z *= inv_dst_peak;
+    return x;
+}
+
+COLORSPACE_FUNC float3 colorspace_range_ops(float3 x, float range_y, float offset_y, float range_uv, float offset_uv) {
+    x.x = x.x * range_y  + offset_y;
+    x.y = x.y * range_uv + offset_uv;
+    x.z = x.z * range_uv + offset_uv;
+    return x;
+}
+
 COLORSPACE_FUNC float lut3d_linear_interp(float v0, float v1, float a) {
     return v0 + (v1 - v0) * a;
 }
@@ -32,6 +32,8 @@
 #include <fstream>
 #include <algorithm>
 #include <numeric>
+#include <mutex>
+#include <filesystem>
 #define _USE_MATH_DEFINES
 #include <cmath>
 #include "rgy_filter_nnedi.h"
@@ -59,6 +61,10 @@ static const int NNEDI_BLOCK_Y = 8;
 static const int weight0size = 49 * 4 + 5 * 4 + 9 * 4;
 static const int weight0sizenew = 4 * 65 + 4 * 5;
 
+//変換済みの重みのキャッシュ
+static std::mutex g_nnediWeightsCacheMtx;
+static std::map<std::string, shared_ptr<const RGYFilterNnediWeights>> g_nnediWeightsCache; //プロセス内の各インスタンスで共有する
+
 RGY_ERR nnedi_compute_network_0(RGYFrameInfo *pOutputPlane,
     const RGYFrameInfo *pInputPlane,
     const RGYCLBuf *weight0,
@@ -293,42 +299,52 @@ shared_ptr<const float> RGYFilterNnedi::readWeights(const tstring& weightFile, H
             weights = shared_ptr<const float>((const float *)pDataPtr, [](const float *x) { UNREFERENCED_PARAMETER(x); return; /*何もしない*/ });
         }
     } else {
+        //ファイルはコピーせずにマップし、参照がなくなったら閉じる
+        auto map = std::make_shared<RGYFileMap>();
         if (!rgy_file_exists(weightFile.c_str())) {
             AddMessage(RGY_LOG_ERROR, _T("weight file \"%s\" does not exist.\n"), weightFile.c_str());
-        } else if (!rgy_get_filesize(weightFile.c_str(), &weightFileSize)) {
-            AddMessage(RGY_LOG_ERROR, _T("Failed to get filesize of weight file \"%s\".\n"), weightFile.c_str());
-        } else if (weightFileSize != expectedFileSize) {
+        } else if (!map->open(weightFile)) {
+            AddMessage(RGY_LOG_ERROR, _T("Failed to open weights file \"%s\".\n"), weightFile.c_str());
+        } else if ((weightFileSize = map->size()) != expectedFileSize) {
             AddMessage(RGY_LOG_ERROR, _T("Weights file \"%s\" has unexpected file size %lld [expected: %u].\n"),
                 weightFile.c_str(), (long long int)weightFileSize, expectedFileSize);
         } else {
-            std::ifstream fin(weightFile, std::ios::in | std::ios::binary);
-            if (!fin.good()) {
-                AddMessage(RGY_LOG_ERROR, _T("Failed to open weights file \"%s\".\n"), weightFile.c_str());
-            } else {
-                float *buffer = new float[weightFileSize / sizeof(float)];
-                if (!buffer) {
-                    AddMessage(RGY_LOG_ERROR, _T("Failed to allocate buffer memory for \"%s\".\n"), weightFile.c_str());
-                } else {
-                    weights = shared_ptr<float>(buffer, std::default_delete<float[]>());
-                    if (fin.read((char *)weights.get(), weightFileSize).gcount() != (int64_t)weightFileSize) {
-                        AddMessage(RGY_LOG_ERROR, _T("Failed to read weights file \"%s\".\n"), weightFile.c_str());
-                        weights.reset();
-                    }
-                }
-                fin.close();
-            }
+            weights = shared_ptr<const float>(map, (const float *)map->data());
         }
     }
     return weights;
 }
 
-RGY_ERR RGYFilterNnedi::initParams(const std::shared_ptr<RGYFilterParamNnedi> prm) {
+std::string RGYFilterNnedi::weightsCacheKey(const std::shared_ptr<RGYFilterParamNnedi> prm) {
+    std::string source;
+    if (prm->nnedi.weightfile.length() == 0) {
+        void *pDataPtr = nullptr;
+        const auto size = getEmbeddedResource(&pDataPtr, _T("NNEDI_WEIGHTBIN"), _T("EXE_DATA"), prm->hModule);
+        source = strsprintf("embedded,size=%llu", (unsigned long long)size);
+    } else {
+        //重みファイルはフルパス・サイズ・更新時刻で識別する
+        std::error_code ec;
+        const auto fullpath = std::filesystem::absolute(std::filesystem::path(prm->nnedi.weightfile), ec);
+        if (ec) return std::string();
+        const auto size = std::filesystem::file_size(fullpath, ec);
+        if (ec) return std::string();
+        const auto time = std::filesystem::last_write_time(fullpath, ec);
+        if (ec) return std::string();
+#if defined(_WIN32) || defined(_WIN64)
+        const auto path = wstring_to_string(fullpath.wstring(), CP_UTF8);
+#else
+        const auto path = fullpath.string();
+#endif
+        source = strsprintf("file=%s,size=%llu,time=%lld", path.c_str(), (unsigned long long)size, (long long)time.time_since_epoch().count());
+    }
+    return strsprintf("%s,nns=%d,nsize=%d,errortype=%d,prescreen=%d,prec=%d",
+        source.c_str(), prm->nnedi.nns, prm->nnedi.nsize, prm->nnedi.errortype, prm->nnedi.pre_screen & VPP_NNEDI_PRE_SCREEN_MODE, prm->nnedi.precision);
+}
+
+shared_ptr<const RGYFilterNnediWeights> RGYFilterNnedi::prepareWeights(const std::shared_ptr<RGYFilterParamNnedi> prm) {
     auto weights = readWeights(prm->nnedi.weightfile, prm->hModule);
     if (!weights) {
-        return RGY_ERR_INVALID_PARAM;
-    }
-    if (prm->nnedi.precision == VPP_FP_PRECISION_AUTO) {
-        prm->nnedi.precision = VPP_FP_PRECISION_FP32;
+        return nullptr;
     }
 
     const int weight1size = prm->nnedi.nns * 2 * (sizeNX[prm->nnedi.nsize] * sizeNY[prm->nnedi.nsize] + 1);
@@ -345,7 +361,8 @@ RGY_ERR RGYFilterNnedi::initParams(const std::shared_ptr<RGYFilterParamNnedi> pr
         }
     }
 
-    std::vector<char> weight0f;
+    auto prepared = std::make_shared<RGYFilterNnediWeights>();
+    auto& weight0f = prepared->weight0;
     weight0f.resize((((prm->nnedi.pre_screen & VPP_NNEDI_PRE_SCREEN_MODE) >= VPP_NNEDI_PRE_SCREEN_NEW) ? weight0sizenew : weight0size) * sizeofweight);
     if (prm->nnedi.precision == VPP_FP_PRECISION_FP32) {
         setWeight0<float>((float *)weight0f.data(), weights.get(), prm);
@@ -353,7 +370,7 @@ RGY_ERR RGYFilterNnedi::initParams(const std::shared_ptr<RGYFilterParamNnedi> pr
         setWeight0<cl_half>((cl_half *)weight0f.data(), weights.get(), prm);
     }
 
-    std::array<std::vector<char>, 2> weight1;
+    auto& weight1 = prepared->weight1;
     for (int i = 0; i < 2; i++) {
         weight1[i].resize(weight1size * sizeofweight, 0);
         const float *ptrW = weights.get() + weight0size + weight0sizenew * 3 + weight1size_tsize * prm->nnedi.errortype + weight1size_offset + i * weight1size;
@@ -363,9 +380,39 @@ RGY_ERR RGYFilterNnedi::initParams(const std::shared_ptr<RGYFilterParamNnedi> pr
             setWeight1<cl_half>((cl_half *)weight1[i].data(), ptrW, prm);
         }
     }
-    m_weight0 = m_cl->copyDataToBuffer(weight0f.data(), weight0f.size());
-    for (size_t i = 0; i < weight1.size(); i++) {
-        m_weight1[i] = m_cl->copyDataToBuffer(weight1[i].data(), weight1[i].size());
+    return prepared;
+}
+
+RGY_ERR RGYFilterNnedi::initParams(const std::shared_ptr<RGYFilterParamNnedi> prm) {
+    if (prm->nnedi.precision == VPP_FP_PRECISION_AUTO) {
+        prm->nnedi.precision = VPP_FP_PRECISION_FP32;
+    }
+
+    //変換済みの重みは、プロセス内の各インスタンスで共有する
+    //(重みファイルはマップして必要な部分のみ参照するので、変換自体は軽く、ディスクへのキャッシュは行わない)
+    const auto key = weightsCacheKey(prm);
+    shared_ptr<const RGYFilterNnediWeights> prepared;
+    if (key.length() > 0) {
+        std::lock_guard<std::mutex> lock(g_nnediWeightsCacheMtx);
+        if (auto it = g_nnediWeightsCache.find(key); it != g_nnediWeightsCache.end()) {
+            prepared = it->second;
+            AddMessage(RGY_LOG_DEBUG, _T("Use prepared weights from cache.\n"));
+        }
+    }
+    if (!prepared) {
+        prepared = prepareWeights(prm);
+        if (!prepared) {
+            return RGY_ERR_INVALID_PARAM;
+        }
+        if (key.length() > 0) {
+            std::lock_guard<std::mutex> lock(g_nnediWeightsCacheMtx);
+            g_nnediWeightsCache[key] = prepared;
+        }
+    }
+
+    m_weight0 = m_cl->copyDataToBuffer(prepared->weight0.data(), prepared->weight0.size());
+    for (size_t i = 0; i < prepared->weight1.size(); i++) {
+        m_weight1[i] = m_cl->copyDataToBuffer(prepared->weight1[i].data(), prepared->weight1[i].size());
     }
     return RGY_ERR_NONE;
 }
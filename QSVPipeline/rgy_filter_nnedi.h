@@ -36,6 +36,12 @@ enum NnediTargetField {
     NNEDI_GEN_FIELD_BOTTOM
 };
 
+//デバイスに転送する形式に変換済みの重み
+struct RGYFilterNnediWeights {
+    std::vector<char> weight0;
+    std::array<std::vector<char>, 2> weight1;
+};
+
 class RGYFilterParamNnedi : public RGYFilterParam {
 public:
     VppNnedi nnedi;
@@ -70,6 +76,9 @@ protected:
     template<typename TypeWeight>
     void setWeight1(TypeWeight *ptrDst, const float *ptrW, const std::shared_ptr<RGYFilterParamNnedi> pNnediParam);
     virtual shared_ptr<const float> readWeights(const tstring &weightFile, HMODULE hModule);
+    //重みの読み込み元と変換に使用するパラメータから、変換済みの重みのキャッシュのキーを作成する
+    std::string weightsCacheKey(const std::shared_ptr<RGYFilterParamNnedi> pNnediParam);
+    shared_ptr<const RGYFilterNnediWeights> prepareWeights(const std::shared_ptr<RGYFilterParamNnedi> pNnediParam);
 
     virtual RGY_ERR procPlane(RGYFrameInfo *pOutputPlane, const RGYFrameInfo *pInputPlane, const NnediTargetField targetField, RGYOpenCLQueue &queue, const std::vector<RGYOpenCLEvent> &wait_events, RGYOpenCLEvent *event);
     virtual RGY_ERR procFrame(RGYFrameInfo *pOutputFrame, const RGYFrameInfo *pInputFrame, const NnediTargetField targetField, RGYOpenCLQueue &queue, const std::vector<RGYOpenCLEvent> &wait_events, RGYOpenCLEvent *event);
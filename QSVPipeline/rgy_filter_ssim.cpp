@@ -108,6 +108,7 @@ RGYFilterSsim::RGYFilterSsim(shared_ptr<RGYOpenCLContext> context) :
     m_queueCrop(),
     m_queueCalcSsim(),
     m_queueCalcPsnr(),
+    m_cpu(),
     m_planeCoef(),
     m_ssimTotalPlane(),
     m_ssimTotal(0.0),
@@ -212,7 +213,22 @@ RGY_ERR RGYFilterSsim::init(shared_ptr<RGYFilterParam> pParam, shared_ptr<RGYLog
     m_encBitstreamUnused.init(256);
 #endif //#if ENCODER_QSV
 
-    setFilterInfo(pParam->print() + _T("(") + RGY_CSP_NAMES[pParam->frameOut.csp] + _T(")"));
+    tstring cpuInfo;
+    m_cpu.reset();
+    if (prm->metric.device == RGYMetricDevice::CPU && (prm->metric.ssim || prm->metric.psnr)) {
+        m_cpu = std::make_unique<RGYFilterSsimCpu>();
+        if ((sts = m_cpu->init(RGY_CSP_BIT_DEPTH[pParam->frameOut.csp], prm->metric.cpuThreads, prm->threadParam)) != RGY_ERR_NONE) {
+            AddMessage(RGY_LOG_ERROR, _T("Failed to init ssim/psnr calculation on cpu: %s.\n"), get_err_mes(sts));
+            return sts;
+        }
+        const auto simd = m_cpu->simd();
+        cpuInfo = strsprintf(_T(" [cpu %s, %d threads]"),
+            ((simd & RGY_SIMD::AVX512BW) == RGY_SIMD::AVX512BW) ? _T("avx512bw") : (((simd & RGY_SIMD::AVX2) == RGY_SIMD::AVX2) ? _T("avx2") : _T("c")),
+            m_cpu->threads());
+        AddMessage(RGY_LOG_DEBUG, _T("calc ssim/psnr on cpu%s.\n"), cpuInfo.c_str());
+    }
+
+    setFilterInfo(pParam->print() + _T("(") + RGY_CSP_NAMES[pParam->frameOut.csp] + _T(")") + cpuInfo);
     m_param = pParam;
     return sts;
 }
@@ -326,18 +342,21 @@ RGY_ERR RGYFilterSsim::init_cl_resources() {
     }
     VCEAMF(amf::AMFContext::AMFOpenCLLocker locker(m_context));
     m_queueCrop = m_cl->createQueue(m_cl->queue().devid(), m_cl->queue().getProperties());
-    if (prm->metric.ssim) {
-        for (auto& q : m_queueCalcSsim) {
-            q = m_cl->createQueue(m_cl->queue().devid(), m_cl->queue().getProperties());
+    //CPUで計算する場合は、計算用のqueueとkernelは不要
+    if (!m_cpu) {
+        if (prm->metric.ssim) {
+            for (auto& q : m_queueCalcSsim) {
+                q = m_cl->createQueue(m_cl->queue().devid(), m_cl->queue().getProperties());
+            }
         }
-    }
-    if (prm->metric.psnr) {
-        for (auto &q : m_queueCalcPsnr) {
-            q = m_cl->createQueue(m_cl->queue().devid(), m_cl->queue().getProperties());
+        if (prm->metric.psnr) {
+            for (auto &q : m_queueCalcPsnr) {
+                q = m_cl->createQueue(m_cl->queue().devid(), m_cl->queue().getProperties());
+            }
+        }
+        if (auto err = build_kernel(m_param->frameOut.csp); err != RGY_ERR_NONE) {
+            return err;
         }
-    }
-    if (auto err = build_kernel(m_param->frameOut.csp); err != RGY_ERR_NONE) {
-        return err;
     }
 #if ENCODER_VCEENC
     auto codec_uvd_name = codec_rgy_to_dec(prm->input.codec);
@@ -709,7 +728,8 @@ RGY_ERR RGYFilterSsim::compare_frames() {
         //比較用のキューの先頭に積まれているものから順次比較していく
         std::lock_guard<std::mutex> lock(m_mtx); //ロックを忘れないこと
         auto &originalFrame = m_input.front();
-        sts_filter = calc_ssim_psnr(&originalFrame->frame, &m_decFrameCopy->frame);
+        sts_filter = (m_cpu) ? calc_ssim_psnr_cpu(originalFrame.get(), m_decFrameCopy.get())
+                             : calc_ssim_psnr(&originalFrame->frame, &m_decFrameCopy->frame);
         if (sts_filter != RGY_ERR_NONE) {
             return sts_filter;
         }
@@ -815,7 +835,8 @@ RGY_ERR RGYFilterSsim::compare_frames() {
         //比較用のキューの先頭に積まれているものから順次比較していく
         std::lock_guard<std::mutex> lock(m_mtx); //ロックを忘れないこと
         auto &originalFrame = m_input.front();
-        sts_filter = calc_ssim_psnr(&originalFrame->frame, &m_decFrameCopy->frame);
+        sts_filter = (m_cpu) ? calc_ssim_psnr_cpu(originalFrame.get(), m_decFrameCopy.get())
+                             : calc_ssim_psnr(&originalFrame->frame, &m_decFrameCopy->frame);
         if (sts_filter != RGY_ERR_NONE) {
             return sts_filter;
         }
@@ -950,53 +971,117 @@ RGY_ERR RGYFilterSsim::calc_ssim_psnr(const RGYFrameInfo *p0, const RGYFrameInfo
         }
     }
 
+    const int planes = std::min((int)RGY_CSP_PLANES[p0->csp], (int)m_ssimTotalPlane.size());
+    std::array<double, 3> ssimPlane = { 0.0 };
+    std::array<double, 3> msePlane = { 0.0 };
     if (prm->metric.ssim) {
-        double ssimv = 0.0;
-        for (int i = 0; i < RGY_CSP_PLANES[p0->csp]; i++) {
+        for (int i = 0; i < planes; i++) {
             VCEAMF(amf::AMFContext::AMFOpenCLLocker locker(m_context));
             m_tmpSsim[i]->mapEvent().wait();
 
             const int count = (int)m_tmpSsim[i]->size() / sizeof(float);
             float *ptrHost = (float *)m_tmpSsim[i]->mappedPtr();
             std::sort(ptrHost, ptrHost + count);
-            double ssimPlane = 0.0;
+            double ssimSum = 0.0;
             for (int j = 0; j < count; j++) {
-                ssimPlane += (double)ptrHost[j];
+                ssimSum += (double)ptrHost[j];
             }
             const auto plane0 = getPlane(p0, (RGY_PLANE)i);
-            ssimPlane /= (double)(((plane0.width >> 2) - 1) *((plane0.height >> 2) - 1));
-            m_ssimTotalPlane[i] += ssimPlane;
-            ssimv += ssimPlane * m_planeCoef[i];
-            AddMessage(RGY_LOG_TRACE, _T("ssimPlane = %.16e, m_ssimTotalPlane[i] = %.16e"), ssimPlane, m_ssimTotalPlane[i]);
+            const int windows = ssim_window_count(plane0.width, plane0.height);
+            ssimPlane[i] = (windows > 0) ? ssimSum / (double)windows : 0.0;
             m_tmpSsim[i]->unmapBuffer();
         }
-        m_ssimTotal += ssimv;
     }
 
     if (prm->metric.psnr) {
-        double psnrv = 0.0;
-        for (int i = 0; i < RGY_CSP_PLANES[p0->csp]; i++) {
+        for (int i = 0; i < planes; i++) {
             VCEAMF(amf::AMFContext::AMFOpenCLLocker locker(m_context));
             m_tmpPsnr[i]->mapEvent().wait();
 
             const int count = (int)m_tmpPsnr[i]->size() / sizeof(int);
             int *ptrHost = (int *)m_tmpPsnr[i]->mappedPtr();
-            int64_t psnrPlane = 0;
+            int64_t sse = 0;
             for (int j = 0; j < count; j++) {
-                psnrPlane += ptrHost[j];
+                sse += ptrHost[j];
             }
             const auto plane0 = getPlane(p0, (RGY_PLANE)i);
-            double psnrPlaneF = psnrPlane / (double)(plane0.width * plane0.height);
-            m_psnrTotalPlane[i] += psnrPlaneF;
-            psnrv += psnrPlaneF * m_planeCoef[i];
-            AddMessage(RGY_LOG_TRACE, _T("psnrPlane = %.16e, m_psnrTotalPlane[i] = %.16e"), psnrPlane, m_psnrTotalPlane[i]);
+            msePlane[i] = sse / (double)(plane0.width * plane0.height);
             m_tmpPsnr[i]->unmapBuffer();
         }
-        m_psnrTotal += psnrv;
     }
+    addFrameResult(planes, prm->metric.ssim, prm->metric.psnr, ssimPlane, msePlane);
     return RGY_ERR_NONE;
 }
 
+void RGYFilterSsim::addFrameResult(const int planes, const bool ssim, const bool psnr, const std::array<double, 3>& ssimPlane, const std::array<double, 3>& msePlane) {
+    if (ssim) {
+        double ssimv = 0.0;
+        for (int i = 0; i < planes; i++) {
+            m_ssimTotalPlane[i] += ssimPlane[i];
+            ssimv += ssimPlane[i] * m_planeCoef[i];
+            AddMessage(RGY_LOG_TRACE, _T("ssimPlane = %.16e, m_ssimTotalPlane[i] = %.16e"), ssimPlane[i], m_ssimTotalPlane[i]);
+        }
+        m_ssimTotal += ssimv;
+    }
+    if (psnr) {
+        double psnrv = 0.0;
+        for (int i = 0; i < planes; i++) {
+            m_psnrTotalPlane[i] += msePlane[i];
+            psnrv += msePlane[i] * m_planeCoef[i];
+            AddMessage(RGY_LOG_TRACE, _T("psnrPlane = %.16e, m_psnrTotalPlane[i] = %.16e"), msePlane[i], m_psnrTotalPlane[i]);
+        }
+        m_psnrTotal += psnrv;
+    }
+}
+
+RGY_ERR RGYFilterSsim::calc_ssim_psnr_cpu(RGYCLFrame *p0, RGYCLFrame *p1) {
+    auto prm = std::dynamic_pointer_cast<RGYFilterParamSsim>(m_param);
+    if (!prm) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid parameter type.\n"));
+        return RGY_ERR_INVALID_PARAM;
+    }
+    //crop(NV12->YV12変換)の終了を待って、両フレームをCPUから参照できるようにする
+    VCEAMF(amf::AMFContext::AMFOpenCLLocker locker(m_context));
+    //途中で失敗して戻る場合も、mapしたバッファは必ずunmapする (unmap済みなら何もしない)
+    struct RGYSsimMapGuard {
+        std::array<RGYCLFrame *, 2> frames;
+        ~RGYSsimMapGuard() {
+            for (auto frame : frames) {
+                frame->unmapBuffer();
+            }
+        }
+    } mapGuard = { { p0, p1 } };
+    for (auto frame : { p0, p1 }) {
+        auto err = frame->queueMapBuffer(m_queueCrop, CL_MAP_READ, { m_cropEvent });
+        if (err != RGY_ERR_NONE) {
+            AddMessage(RGY_LOG_ERROR, _T("Failed to map buffer for ssim/psnr: %s.\n"), get_err_mes(err));
+            return err;
+        }
+    }
+    for (auto frame : { p0, p1 }) {
+        auto err = frame->mapWait();
+        if (err != RGY_ERR_NONE) {
+            AddMessage(RGY_LOG_ERROR, _T("Failed to wait map buffer for ssim/psnr: %s.\n"), get_err_mes(err));
+            return err;
+        }
+    }
+    const auto frameHost0 = p0->mappedHost()->frameInfo();
+    const auto frameHost1 = p1->mappedHost()->frameInfo();
+    std::array<double, 3> ssimPlane = { 0.0 };
+    std::array<double, 3> msePlane = { 0.0 };
+    m_cpu->calc(&frameHost0, &frameHost1, prm->metric.ssim, prm->metric.psnr, ssimPlane, msePlane);
+    for (auto frame : { p0, p1 }) {
+        auto err = frame->unmapBuffer();
+        if (err != RGY_ERR_NONE) {
+            AddMessage(RGY_LOG_ERROR, _T("Failed to unmap buffer for ssim/psnr: %s.\n"), get_err_mes(err));
+            return err;
+        }
+    }
+
+    const int planes = std::min((int)RGY_CSP_PLANES[frameHost0.csp], (int)m_ssimTotalPlane.size());
+    addFrameResult(planes, prm->metric.ssim, prm->metric.psnr, ssimPlane, msePlane);
+    return RGY_ERR_NONE;
+}
 
 void RGYFilterSsim::close() {
     if (m_thread.joinable()) {
@@ -1005,6 +1090,7 @@ void RGYFilterSsim::close() {
         m_thread.join();
     }
     close_cl_resources();
+    m_cpu.reset();
     m_cropOrg.reset();
     m_cropDec.reset();
     AddMessage(RGY_LOG_DEBUG, _T("closed ssim/psnr filter.\n"));
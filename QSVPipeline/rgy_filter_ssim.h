@@ -29,6 +29,7 @@
 #pragma once
 
 #include "rgy_filter.h"
+#include "rgy_filter_ssim_cpu.h"
 #if ENCODER_VCEENC
 #include "vce_util.h"
 #include "Factory.h"
@@ -96,6 +97,9 @@ protected:
     RGY_ERR calc_psnr_plane(const RGYFrameInfo *p0, const RGYFrameInfo *p1, std::unique_ptr<RGYCLBuf> &tmp, RGYOpenCLQueue& queue, const std::vector<RGYOpenCLEvent> &wait_events);
     RGY_ERR calc_psnr_frame(const RGYFrameInfo *p0, const RGYFrameInfo *p1);
     RGY_ERR calc_ssim_psnr(const RGYFrameInfo *p0, const RGYFrameInfo *p1);
+    RGY_ERR calc_ssim_psnr_cpu(RGYCLFrame *p0, RGYCLFrame *p1);
+    //1フレーム分のプレーンごとのSSIM/MSEを累積する (GPU/CPUで計算した場合で共通)
+    void addFrameResult(const int planes, const bool ssim, const bool psnr, const std::array<double, 3>& ssimPlane, const std::array<double, 3>& msePlane);
 
     bool m_decodeStarted; //デコードが開始したか
     int m_deviceId;       //SSIM計算で使用するCUDA device ID
@@ -133,6 +137,7 @@ protected:
     RGYOpenCLQueue m_queueCrop; //デコードしたフレームをcrop(NV12->YV12変換)するstream
     std::array<RGYOpenCLQueue, 3> m_queueCalcSsim; //評価計算を行うstream
     std::array<RGYOpenCLQueue, 3> m_queueCalcPsnr; //評価計算を行うstream
+    std::unique_ptr<RGYFilterSsimCpu> m_cpu; //CPUで評価計算を行う場合に使用 (--metric-device cpu)
     std::array<double, 3> m_planeCoef;      // 評価結果に関する YUVの重み
     std::array<double, 3> m_ssimTotalPlane; // 評価結果の累積値 YUV
     double m_ssimTotal;                     // 評価結果の累積値 All
@@ -0,0 +1,270 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include "rgy_osdep.h"
+#include "rgy_util.h"
+#include "rgy_filter_ssim_cpu.h"
+
+//タイル1つあたりの行数
+static const int SSIM_TILE_BLOCK_ROWS = 16; //4x4ブロック単位
+static const int PSNR_TILE_ROWS = 64;       //画素単位
+
+RGYSsimCpuFuncs get_ssim_cpu_funcs_c(const int bitDepth) {
+    RGYSsimCpuFuncs func;
+    if (bitDepth > 8) {
+        func.ssimBlockRow = ssim_block_row_c<uint16_t>;
+        func.ssimBlockEdge = ssim_block_row_edge_c<uint16_t>;
+        func.psnrRow = psnr_row_c<uint16_t>;
+    } else {
+        func.ssimBlockRow = ssim_block_row_c<uint8_t>;
+        func.ssimBlockEdge = ssim_block_row_edge_c<uint8_t>;
+        func.psnrRow = psnr_row_c<uint8_t>;
+    }
+    func.ssimEndRow = ssim_end_row_c;
+    func.simd = RGY_SIMD::NONE;
+    return func;
+}
+
+RGYSsimCpuFuncs get_ssim_cpu_funcs(const int bitDepth, const RGY_SIMD simd) {
+#if defined(_M_IX86) || defined(_M_X64) || defined(__x86_64)
+    const auto avail = get_availableSIMD() & simd;
+#if defined(_M_X64) || defined(__x86_64)
+    if ((avail & RGY_SIMD::AVX512BW) == RGY_SIMD::AVX512BW) return get_ssim_cpu_funcs_avx512bw(bitDepth);
+#endif
+    if ((avail & RGY_SIMD::AVX2) == RGY_SIMD::AVX2) return get_ssim_cpu_funcs_avx2(bitDepth);
+#endif
+    return get_ssim_cpu_funcs_c(bitDepth);
+}
+
+RGYFilterSsimCpu::RGYFilterSsimCpu() :
+    m_bitDepth(0),
+    m_threads(0),
+    m_func(get_ssim_cpu_funcs_c(8)),
+    m_threadParam(),
+    m_th(),
+    m_work(),
+    m_plane0(),
+    m_plane1(),
+    m_tiles(),
+    m_tileNext(0),
+    m_tileRemain(0),
+    m_mtx(),
+    m_cvJob(),
+    m_cvFin(),
+    m_abort(false) {
+}
+
+RGYFilterSsimCpu::~RGYFilterSsimCpu() {
+    close();
+}
+
+RGY_ERR RGYFilterSsimCpu::init(const int bitDepth, const int threads, const RGYParamThread& threadParam, const RGY_SIMD simd) {
+    close();
+    if (bitDepth < 8 || bitDepth > 16) {
+        return RGY_ERR_UNSUPPORTED;
+    }
+    m_bitDepth = bitDepth;
+    m_func = get_ssim_cpu_funcs(bitDepth, simd);
+    m_threadParam = threadParam;
+    m_threads = threads;
+    if (m_threads <= 0) {
+        m_threads = std::min((int)std::thread::hardware_concurrency(), RGY_SSIM_CPU_THREADS_MAX);
+    }
+    m_threads = clamp(m_threads, 1, RGY_SSIM_CPU_THREADS_MAX);
+    m_work.resize(m_threads);
+    m_abort = false;
+    //呼び出し元のスレッドもタイルの処理に参加するので、ワーカーはthreads-1個
+    for (int i = 1; i < m_threads; i++) {
+        m_th.push_back(std::thread(&RGYFilterSsimCpu::threadFunc, this, i));
+    }
+    return RGY_ERR_NONE;
+}
+
+void RGYFilterSsimCpu::close() {
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_abort = true;
+    }
+    m_cvJob.notify_all();
+    for (auto& th : m_th) {
+        th.join();
+    }
+    m_th.clear();
+    m_work.clear();
+    m_tiles.clear();
+    m_tileNext = 0;
+    m_tileRemain = 0;
+}
+
+void RGYFilterSsimCpu::ssimBlockRow(RGYSsimBlockSum *sum, const RGYFrameInfo *plane0, const RGYFrameInfo *plane1, const int by) {
+    const uint8_t *ptr0 = plane0->ptr[0] + by * 4 * plane0->pitch[0];
+    const uint8_t *ptr1 = plane1->ptr[0] + by * 4 * plane1->pitch[0];
+    const int rows = std::min(4, plane0->height - by * 4);
+    if (rows < 4) {
+        //最下段が4行に満たない場合
+        m_func.ssimBlockEdge(sum, ptr0, plane0->pitch[0], ptr1, plane1->pitch[0], plane0->width, rows);
+        return;
+    }
+    const int blocks = plane0->width >> 2;
+    m_func.ssimBlockRow(sum, ptr0, plane0->pitch[0], ptr1, plane1->pitch[0], blocks);
+    if ((plane0->width & 3) != 0) {
+        //右端が4画素に満たない場合
+        const int offset = blocks * 4 * ((m_bitDepth > 8) ? 2 : 1);
+        m_func.ssimBlockEdge(sum + blocks, ptr0 + offset, plane0->pitch[0], ptr1 + offset, plane1->pitch[0], plane0->width & 3, 4);
+    }
+}
+
+void RGYFilterSsimCpu::runTile(Tile *tile, std::vector<RGYSsimBlockSum>& work) {
+    const auto plane0 = tile->plane0;
+    const auto plane1 = tile->plane1;
+    if (tile->ssim) {
+        const int64_t max = (1 << m_bitDepth) - 1;
+        const int64_t ssim_c1 = (int64_t)(0.01 * 0.01 * max * max * 64.0 + 0.5);
+        const int64_t ssim_c2 = (int64_t)(0.03 * 0.03 * max * max * 64.0 * 63.0 + 0.5);
+        const int blocks = (plane0->width + 3) >> 2;
+        RGYSsimBlockSum *sum0 = work.data();
+        RGYSsimBlockSum *sum1 = work.data() + blocks;
+        //窓の行yには、4x4ブロックの行yとy+1を使用する
+        ssimBlockRow(sum0, plane0, plane1, tile->y0);
+        double ssim = 0.0;
+        for (int y = tile->y0; y < tile->y1; y++) {
+            ssimBlockRow(sum1, plane0, plane1, y + 1);
+            ssim += m_func.ssimEndRow(sum0, sum1, blocks - 1, ssim_c1, ssim_c2);
+            std::swap(sum0, sum1);
+        }
+        tile->ssimSum = ssim;
+    } else {
+        int64_t sse = 0;
+        for (int y = tile->y0; y < tile->y1; y++) {
+            sse += m_func.psnrRow(
+                plane0->ptr[0] + y * plane0->pitch[0],
+                plane1->ptr[0] + y * plane1->pitch[0], plane0->width);
+        }
+        tile->sse = sse;
+    }
+}
+
+bool RGYFilterSsimCpu::takeTile(int *tile) {
+    if (m_tileNext >= (int)m_tiles.size()) {
+        return false;
+    }
+    *tile = m_tileNext++;
+    return true;
+}
+
+void RGYFilterSsimCpu::finTile() {
+    if (--m_tileRemain == 0) {
+        m_cvFin.notify_all();
+    }
+}
+
+void RGYFilterSsimCpu::threadFunc(int id) {
+    m_threadParam.apply(GetCurrentThread());
+    std::unique_lock<std::mutex> lock(m_mtx);
+    for (;;) {
+        m_cvJob.wait(lock, [this]() { return m_abort || m_tileNext < (int)m_tiles.size(); });
+        if (m_abort) {
+            break;
+        }
+        int tile = 0;
+        if (!takeTile(&tile)) {
+            continue;
+        }
+        lock.unlock();
+        runTile(&m_tiles[tile], m_work[id]);
+        lock.lock();
+        finTile();
+    }
+}
+
+void RGYFilterSsimCpu::calc(const RGYFrameInfo *p0, const RGYFrameInfo *p1, const bool ssim, const bool psnr, std::array<double, 3>& ssimPlane, std::array<double, 3>& msePlane) {
+    const int planes = std::min((int)RGY_CSP_PLANES[p0->csp], (int)m_plane0.size());
+    std::unique_lock<std::mutex> lock(m_mtx);
+    //タイルの作成 (ワーカーはすべてのタイルの処理が終わるまで待機しているので、ここで変更してよい)
+    m_tiles.clear();
+    int maxBlocks = 0;
+    for (int i = 0; i < planes; i++) {
+        m_plane0[i] = getPlane(p0, (RGY_PLANE)i);
+        m_plane1[i] = getPlane(p1, (RGY_PLANE)i);
+        Tile tile = { &m_plane0[i], &m_plane1[i], false, 0, 0, 0.0, 0 };
+        if (ssim) {
+            const int windowRows = ((m_plane0[i].height + 3) >> 2) - 1;
+            tile.ssim = true;
+            for (int y = 0; y < windowRows; y += SSIM_TILE_BLOCK_ROWS) {
+                tile.y0 = y;
+                tile.y1 = std::min(y + SSIM_TILE_BLOCK_ROWS, windowRows);
+                m_tiles.push_back(tile);
+            }
+            maxBlocks = std::max(maxBlocks, (m_plane0[i].width + 3) >> 2);
+        }
+        if (psnr) {
+            tile.ssim = false;
+            for (int y = 0; y < m_plane0[i].height; y += PSNR_TILE_ROWS) {
+                tile.y0 = y;
+                tile.y1 = std::min(y + PSNR_TILE_ROWS, m_plane0[i].height);
+                m_tiles.push_back(tile);
+            }
+        }
+    }
+    for (auto& work : m_work) {
+        if ((int)work.size() < maxBlocks * 2) {
+            work.resize(maxBlocks * 2);
+        }
+    }
+    m_tileNext = 0;
+    m_tileRemain = (int)m_tiles.size();
+    if (m_tileRemain > 1) {
+        m_cvJob.notify_all();
+    }
+    //呼び出し元のスレッドもタイルを処理する
+    int tileIdx = 0;
+    while (takeTile(&tileIdx)) {
+        lock.unlock();
+        runTile(&m_tiles[tileIdx], m_work[0]);
+        lock.lock();
+        finTile();
+    }
+    m_cvFin.wait(lock, [this]() { return m_tileRemain == 0; });
+
+    //スレッド数によらず、タイルの順に合算する
+    std::array<double, 3> ssimSum = { 0.0 };
+    std::array<int64_t, 3> sseSum = { 0 };
+    for (const auto& tile : m_tiles) {
+        const int i = (int)(tile.plane0 - m_plane0.data());
+        if (tile.ssim) {
+            ssimSum[i] += tile.ssimSum;
+        } else {
+            sseSum[i] += tile.sse;
+        }
+    }
+    for (int i = 0; i < planes; i++) {
+        const int windows = ssim_window_count(m_plane0[i].width, m_plane0[i].height);
+        ssimPlane[i] = (windows > 0) ? ssimSum[i] / (double)windows : 0.0;
+        msePlane[i] = sseSum[i] / (double)(m_plane0[i].width * m_plane0[i].height);
+    }
+}
@@ -0,0 +1,219 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __RGY_FILTER_SSIM_CPU_H__
+#define __RGY_FILTER_SSIM_CPU_H__
+
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "rgy_err.h"
+#include "rgy_simd.h"
+#include "rgy_thread_affinity.h"
+#include "convert_csp.h"
+
+static const int RGY_SSIM_CPU_THREADS_MAX = 16;
+
+//4x4ブロックごとの画素値の和、二乗和、積和
+struct RGYSsimBlockSum {
+    int64_t s1;  //p0の和
+    int64_t s2;  //p1の和
+    int64_t ss;  //p0,p1の二乗和
+    int64_t s12; //p0*p1の和
+};
+
+//4x4ブロックの1行分 (blocks個) の和を計算する
+typedef void (*funcSsimBlockRow)(RGYSsimBlockSum *sum, const uint8_t *p0, const int pitch0, const uint8_t *p1, const int pitch1, const int blocks);
+//画面端の4x4に満たないブロックを含む1行分 (幅width画素、高さrows行) の和を計算する
+typedef void (*funcSsimBlockEdge)(RGYSsimBlockSum *sum, const uint8_t *p0, const int pitch0, const uint8_t *p1, const int pitch1, const int width, const int rows);
+//4x4ブロック2行分の和から、windows個の窓のSSIMの合計を計算する
+typedef double (*funcSsimEndRow)(const RGYSsimBlockSum *sum0, const RGYSsimBlockSum *sum1, const int windows, const int64_t ssim_c1, const int64_t ssim_c2);
+//1行分 (width画素) の差の二乗和を計算する
+typedef int64_t (*funcPsnrRow)(const uint8_t *p0, const uint8_t *p1, const int width);
+
+struct RGYSsimCpuFuncs {
+    funcSsimBlockRow ssimBlockRow;
+    funcSsimBlockEdge ssimBlockEdge;
+    funcSsimEndRow ssimEndRow;
+    funcPsnrRow psnrRow;
+    RGY_SIMD simd;
+};
+
+//SIMD版の端数処理にも使用するので、static (各翻訳単位ごとに別の実体) にしておくこと
+template<typename Type>
+static void ssim_block_row_c(RGYSsimBlockSum *sum, const uint8_t *p0, const int pitch0, const uint8_t *p1, const int pitch1, const int blocks) {
+    for (int x = 0; x < blocks; x++) {
+        int64_t s1 = 0, s2 = 0, ss = 0, s12 = 0;
+        for (int y = 0; y < 4; y++) {
+            const Type *ptr0 = (const Type *)(p0 + y * pitch0) + x * 4;
+            const Type *ptr1 = (const Type *)(p1 + y * pitch1) + x * 4;
+            for (int i = 0; i < 4; i++) {
+                const int64_t a = ptr0[i];
+                const int64_t b = ptr1[i];
+                s1  += a;
+                s2  += b;
+                ss  += a * a + b * b;
+                s12 += a * b;
+            }
+        }
+        sum[x].s1  = s1;
+        sum[x].s2  = s2;
+        sum[x].ss  = ss;
+        sum[x].s12 = s12;
+    }
+}
+
+//rgy_filter_ssim.clと同じく画面端の4x4に満たないブロックも窓の評価に使用するので、
+//画面内 (幅width画素、高さrows行) の画素のみを加算する (画面外の画素は0として扱う)
+template<typename Type>
+static void ssim_block_row_edge_c(RGYSsimBlockSum *sum, const uint8_t *p0, const int pitch0, const uint8_t *p1, const int pitch1, const int width, const int rows) {
+    const int blocks = (width + 3) >> 2;
+    for (int x = 0; x < blocks; x++) {
+        const int cols = std::min(4, width - x * 4);
+        int64_t s1 = 0, s2 = 0, ss = 0, s12 = 0;
+        for (int y = 0; y < rows; y++) {
+            const Type *ptr0 = (const Type *)(p0 + y * pitch0) + x * 4;
+            const Type *ptr1 = (const Type *)(p1 + y * pitch1) + x * 4;
+            for (int i = 0; i < cols; i++) {
+                const int64_t a = ptr0[i];
+                const int64_t b = ptr1[i];
+                s1  += a;
+                s2  += b;
+                ss  += a * a + b * b;
+                s12 += a * b;
+            }
+        }
+        sum[x].s1  = s1;
+        sum[x].s2  = s2;
+        sum[x].ss  = ss;
+        sum[x].s12 = s12;
+    }
+}
+
+//rgy_filter_ssim.clのssim_end1xと同じ計算を行う
+static float ssim_end1x(const int64_t s1, const int64_t s2, const int64_t ss, const int64_t s12, const int64_t ssim_c1, const int64_t ssim_c2) {
+    const int64_t vars = ss * 64 - s1 * s1 - s2 * s2;
+    const int64_t covar = s12 * 64 - s1 * s2;
+    return ((float)(2 * s1 * s2 + ssim_c1) * (float)(2 * covar + ssim_c2))
+        / ((float)(s1 * s1 + s2 * s2 + ssim_c1) * (float)(vars + ssim_c2));
+}
+
+static double ssim_end_row_c(const RGYSsimBlockSum *sum0, const RGYSsimBlockSum *sum1, const int windows, const int64_t ssim_c1, const int64_t ssim_c2) {
+    double ssim = 0.0;
+    for (int x = 0; x < windows; x++) {
+        ssim += ssim_end1x(
+            sum0[x].s1  + sum0[x+1].s1  + sum1[x].s1  + sum1[x+1].s1,
+            sum0[x].s2  + sum0[x+1].s2  + sum1[x].s2  + sum1[x+1].s2,
+            sum0[x].ss  + sum0[x+1].ss  + sum1[x].ss  + sum1[x+1].ss,
+            sum0[x].s12 + sum0[x+1].s12 + sum1[x].s12 + sum1[x+1].s12,
+            ssim_c1, ssim_c2);
+    }
+    return ssim;
+}
+
+template<typename Type>
+static int64_t psnr_row_c(const uint8_t *p0, const uint8_t *p1, const int width) {
+    const Type *ptr0 = (const Type *)p0;
+    const Type *ptr1 = (const Type *)p1;
+    int64_t sse = 0;
+    for (int x = 0; x < width; x++) {
+        const int64_t diff = (int64_t)ptr0[x] - (int64_t)ptr1[x];
+        sse += diff * diff;
+    }
+    return sse;
+}
+
+//width x heightのプレーンで評価する窓の数
+//rgy_filter_ssim.clと同じく、画面端の4x4に満たないブロックを含む窓も数える
+static inline int ssim_window_count(const int width, const int height) {
+    return std::max(((width + 3) >> 2) - 1, 0) * std::max(((height + 3) >> 2) - 1, 0);
+}
+
+RGYSsimCpuFuncs get_ssim_cpu_funcs_c(const int bitDepth);
+RGYSsimCpuFuncs get_ssim_cpu_funcs_avx2(const int bitDepth);
+RGYSsimCpuFuncs get_ssim_cpu_funcs_avx512bw(const int bitDepth);
+RGYSsimCpuFuncs get_ssim_cpu_funcs(const int bitDepth, const RGY_SIMD simd);
+
+//SSIM/PSNRをCPUで計算する
+//各プレーンを横長のタイルに分割してスレッドプールで処理し、タイルの結果は常に同じ順序で合算する
+//(スレッド数によって結果が変わらないようにする)
+//SSIMはOpenCL版(rgy_filter_ssim.cl)と同じく、4x4ブロックの和を2x2個まとめた8x8の窓を4画素ずつずらして評価する
+//(画面端の4x4に満たないブロックを含む窓も評価する)
+class RGYFilterSsimCpu {
+public:
+    RGYFilterSsimCpu();
+    ~RGYFilterSsimCpu();
+    RGYFilterSsimCpu(const RGYFilterSsimCpu&) = delete;
+    RGYFilterSsimCpu &operator=(const RGYFilterSsimCpu&) = delete;
+
+    //threads ... 0なら自動
+    RGY_ERR init(const int bitDepth, const int threads, const RGYParamThread& threadParam, const RGY_SIMD simd = RGY_SIMD::SIMD_ALL);
+    void close();
+    //p0, p1 (CPUから参照可能なフレーム) の各プレーンのSSIMとMSEを計算する
+    void calc(const RGYFrameInfo *p0, const RGYFrameInfo *p1, const bool ssim, const bool psnr, std::array<double, 3>& ssimPlane, std::array<double, 3>& msePlane);
+    int threads() const { return m_threads; }
+    RGY_SIMD simd() const { return m_func.simd; }
+protected:
+    struct Tile {
+        const RGYFrameInfo *plane0;
+        const RGYFrameInfo *plane1;
+        bool ssim;     //SSIM/PSNRのどちらを計算するか
+        int y0, y1;    //処理する範囲 (SSIMなら4x4ブロック単位、PSNRなら画素単位)
+        double ssimSum;
+        int64_t sse;
+    };
+    void runTile(Tile *tile, std::vector<RGYSsimBlockSum>& work);
+    //4x4ブロックの行byの和を計算する
+    void ssimBlockRow(RGYSsimBlockSum *sum, const RGYFrameInfo *plane0, const RGYFrameInfo *plane1, const int by);
+    //mutexを取得した状態で呼ぶこと
+    bool takeTile(int *tile);
+    void finTile();
+    void threadFunc(int id);
+
+    int m_bitDepth;
+    int m_threads;
+    RGYSsimCpuFuncs m_func;
+    RGYParamThread m_threadParam;
+    std::vector<std::thread> m_th;
+    std::vector<std::vector<RGYSsimBlockSum>> m_work; //スレッドごとの作業領域
+    std::array<RGYFrameInfo, 3> m_plane0;
+    std::array<RGYFrameInfo, 3> m_plane1;
+    std::vector<Tile> m_tiles;
+    int m_tileNext;   //次に処理するタイル
+    int m_tileRemain; //処理が終了していないタイル数
+    std::mutex m_mtx;
+    std::condition_variable m_cvJob; //タイルが投入された
+    std::condition_variable m_cvFin; //すべてのタイルの処理が終了した
+    bool m_abort;
+};
+
+#endif //__RGY_FILTER_SSIM_CPU_H__
@@ -0,0 +1,122 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#define RGY_FILTER_SSIM_CPU_AVX2
+#include "rgy_filter_ssim_cpu_simd.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__x86_64)
+
+//16画素 (4x4ブロック4個) ずつ処理する
+template<typename Type>
+static void ssim_block_row_avx2(RGYSsimBlockSum *sum, const uint8_t *p0, const int pitch0, const uint8_t *p1, const int pitch1, const int blocks) {
+    int x = 0;
+    for (; x + 4 <= blocks; x += 4, sum += 4) {
+        __m256i y0, y1, y2, y3;
+        ssim_4x4x4_sum_avx2<Type>(y0, y1, y2, y3,
+            p0 + x * 4 * sizeof(Type), pitch0,
+            p1 + x * 4 * sizeof(Type), pitch1);
+        ssim_4x4x4_store_avx2(sum, y0, y1, y2, y3);
+    }
+    ssim_block_row_c<Type>(sum, p0 + x * 4 * sizeof(Type), pitch0, p1 + x * 4 * sizeof(Type), pitch1, blocks - x);
+}
+
+//8画素 (4x4ブロック2個) ずつ処理する
+static void ssim_block_row_wide_avx2(RGYSsimBlockSum *sum, const uint8_t *p0, const int pitch0, const uint8_t *p1, const int pitch1, const int blocks) {
+    int x = 0;
+    for (; x + 2 <= blocks; x += 2, sum += 2) {
+        __m256i yS1 = _mm256_setzero_si256();
+        __m256i yS2 = _mm256_setzero_si256();
+        __m256i ySS = _mm256_setzero_si256();
+        __m256i yS12 = _mm256_setzero_si256();
+        for (int y = 0; y < 4; y++) {
+            const __m256i ya = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(p0 + y * pitch0 + x * 4 * sizeof(uint16_t))));
+            const __m256i yb = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(p1 + y * pitch1 + x * 4 * sizeof(uint16_t))));
+            const __m256i yaOdd = _mm256_srli_epi64(ya, 32);
+            const __m256i ybOdd = _mm256_srli_epi64(yb, 32);
+            yS1 = _mm256_add_epi32(yS1, ya);
+            yS2 = _mm256_add_epi32(yS2, yb);
+            ySS = _mm256_add_epi64(ySS, _mm256_add_epi64(_mm256_mul_epu32(ya, ya), _mm256_mul_epu32(yb, yb)));
+            ySS = _mm256_add_epi64(ySS, _mm256_add_epi64(_mm256_mul_epu32(yaOdd, yaOdd), _mm256_mul_epu32(ybOdd, ybOdd)));
+            yS12 = _mm256_add_epi64(yS12, _mm256_add_epi64(_mm256_mul_epu32(ya, yb), _mm256_mul_epu32(yaOdd, ybOdd)));
+        }
+        ssim_4x4x2_wide_store_avx2(sum, yS1, yS2, ySS, yS12);
+    }
+    ssim_block_row_c<uint16_t>(sum, p0 + x * 4 * sizeof(uint16_t), pitch0, p1 + x * 4 * sizeof(uint16_t), pitch1, blocks - x);
+}
+
+//16画素ずつ処理する (差が16bit符号付きに収まり、2画素分の差の二乗和が32bitに収まる場合)
+template<typename Type>
+static int64_t psnr_row_avx2(const uint8_t *p0, const uint8_t *p1, const int width) {
+    __m256i ySum = _mm256_setzero_si256();
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const __m256i ya = load_16px_avx2<Type>(p0 + x * sizeof(Type));
+        const __m256i yb = load_16px_avx2<Type>(p1 + x * sizeof(Type));
+        const __m256i yDiff = _mm256_sub_epi16(ya, yb);
+        ySum = add_epu32_to_epi64_avx2(ySum, _mm256_madd_epi16(yDiff, yDiff));
+    }
+    return hsum_epi64_avx2(ySum) + psnr_row_c<Type>(p0 + x * sizeof(Type), p1 + x * sizeof(Type), width - x);
+}
+
+//8画素ずつ処理する
+static int64_t psnr_row_wide_avx2(const uint8_t *p0, const uint8_t *p1, const int width) {
+    __m256i ySum = _mm256_setzero_si256();
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        const __m256i ya = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(p0 + x * sizeof(uint16_t))));
+        const __m256i yb = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(p1 + x * sizeof(uint16_t))));
+        const __m256i yDiff = _mm256_sub_epi32(ya, yb);
+        const __m256i yDiffOdd = _mm256_srli_epi64(yDiff, 32);
+        ySum = _mm256_add_epi64(ySum, _mm256_add_epi64(_mm256_mul_epi32(yDiff, yDiff), _mm256_mul_epi32(yDiffOdd, yDiffOdd)));
+    }
+    return hsum_epi64_avx2(ySum) + psnr_row_c<uint16_t>(p0 + x * sizeof(uint16_t), p1 + x * sizeof(uint16_t), width - x);
+}
+
+RGYSsimCpuFuncs get_ssim_cpu_funcs_avx2(const int bitDepth) {
+    RGYSsimCpuFuncs func;
+    if (bitDepth > SSIM_CPU_NARROW_MAX_BIT_DEPTH) {
+        func.ssimBlockRow = ssim_block_row_wide_avx2;
+    } else if (bitDepth > 8) {
+        func.ssimBlockRow = ssim_block_row_avx2<uint16_t>;
+    } else {
+        func.ssimBlockRow = ssim_block_row_avx2<uint8_t>;
+    }
+    if (bitDepth > PSNR_CPU_NARROW_MAX_BIT_DEPTH) {
+        func.psnrRow = psnr_row_wide_avx2;
+    } else if (bitDepth > 8) {
+        func.psnrRow = psnr_row_avx2<uint16_t>;
+    } else {
+        func.psnrRow = psnr_row_avx2<uint8_t>;
+    }
+    //端数のブロックはまれなので、C版を使用する
+    func.ssimBlockEdge = (bitDepth > 8) ? ssim_block_row_edge_c<uint16_t> : ssim_block_row_edge_c<uint8_t>;
+    func.ssimEndRow = ssim_end_row_avx2;
+    func.simd = RGY_SIMD::AVX2;
+    return func;
+}
+
+#endif //#if defined(_M_IX86) || defined(_M_X64) || defined(__x86_64)
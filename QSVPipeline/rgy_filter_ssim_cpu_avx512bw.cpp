@@ -0,0 +1,193 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#define RGY_FILTER_SSIM_CPU_AVX512BW
+#include "rgy_filter_ssim_cpu_simd.h"
+
+#if defined(_M_X64) || defined(__x86_64)
+
+//GCC12では非mask版の_mm512_castsi512_si256, _mm512_extracti64x4_epi64, _mm512_cvtepu*, _mm512_srli_epi64, _mm512_mul_ep*32等が
+//内部で_mm512_undefined_*を使用しており、-Wmaybe-uninitializedの警告が出るので、全要素を有効にしたmaskz版を使う
+static RGY_FORCEINLINE __m256i zext_lo256_avx512(const __m512i z) {
+    return _mm512_maskz_extracti64x4_epi64(0x0f, z, 0);
+}
+static RGY_FORCEINLINE __m256i zext_hi256_avx512(const __m512i z) {
+    return _mm512_maskz_extracti64x4_epi64(0x0f, z, 1);
+}
+static RGY_FORCEINLINE __m512i cvtepu8_epi16_avx512(const __m256i y) {
+    return _mm512_maskz_cvtepu8_epi16(0xffffffffu, y);
+}
+static RGY_FORCEINLINE __m512i cvtepu16_epi32_avx512(const __m256i y) {
+    return _mm512_maskz_cvtepu16_epi32(0xffff, y);
+}
+static RGY_FORCEINLINE __m512i srli32_epi64_avx512(const __m512i z) {
+    return _mm512_maskz_srli_epi64(0xff, z, 32);
+}
+static RGY_FORCEINLINE __m512i mul_epu32_avx512(const __m512i a, const __m512i b) {
+    return _mm512_maskz_mul_epu32(0xff, a, b);
+}
+static RGY_FORCEINLINE __m512i mul_epi32_avx512(const __m512i a, const __m512i b) {
+    return _mm512_maskz_mul_epi32(0xff, a, b);
+}
+static RGY_FORCEINLINE int64_t reduce_add_epi64_avx512(const __m512i z) {
+    const __m256i y = _mm256_add_epi64(zext_lo256_avx512(z), zext_hi256_avx512(z));
+    const __m128i x = _mm_add_epi64(_mm256_castsi256_si128(y), _mm256_extracti128_si256(y, 1));
+    return _mm_cvtsi128_si64(x) + _mm_extract_epi64(x, 1);
+}
+
+//32画素を16bitに拡張して読み込む
+template<typename Type>
+static RGY_FORCEINLINE __m512i load_32px_avx512(const uint8_t *ptr) {
+    if (sizeof(Type) == 1) {
+        return cvtepu8_epi16_avx512(_mm256_loadu_si256((const __m256i *)ptr));
+    } else {
+        return _mm512_loadu_si512((const __m512i *)ptr);
+    }
+}
+
+//32画素 (4x4ブロック8個) ずつ処理する
+template<typename Type>
+static void ssim_block_row_avx512bw(RGYSsimBlockSum *sum, const uint8_t *p0, const int pitch0, const uint8_t *p1, const int pitch1, const int blocks) {
+    int x = 0;
+    for (; x + 8 <= blocks; x += 8, sum += 8) {
+        __m512i zColS1 = _mm512_setzero_si512();
+        __m512i zColS2 = _mm512_setzero_si512();
+        __m512i zSS = _mm512_setzero_si512();
+        __m512i zS12 = _mm512_setzero_si512();
+        for (int y = 0; y < 4; y++) {
+            const __m512i za = load_32px_avx512<Type>(p0 + y * pitch0 + x * 4 * sizeof(Type));
+            const __m512i zb = load_32px_avx512<Type>(p1 + y * pitch1 + x * 4 * sizeof(Type));
+            zColS1 = _mm512_add_epi16(zColS1, za);
+            zColS2 = _mm512_add_epi16(zColS2, zb);
+            zSS = _mm512_add_epi32(zSS, _mm512_add_epi32(_mm512_madd_epi16(za, za), _mm512_madd_epi16(zb, zb)));
+            zS12 = _mm512_add_epi32(zS12, _mm512_madd_epi16(za, zb));
+        }
+        const __m512i zOne = _mm512_set1_epi16(1);
+        const __m512i zS1 = _mm512_madd_epi16(zColS1, zOne);
+        const __m512i zS2 = _mm512_madd_epi16(zColS2, zOne);
+        //ブロックごとの並べ替えは256bitずつ行う
+        ssim_4x4x4_store_avx2(sum + 0,
+            zext_lo256_avx512(zS1), zext_lo256_avx512(zS2),
+            zext_lo256_avx512(zSS), zext_lo256_avx512(zS12));
+        ssim_4x4x4_store_avx2(sum + 4,
+            zext_hi256_avx512(zS1), zext_hi256_avx512(zS2),
+            zext_hi256_avx512(zSS), zext_hi256_avx512(zS12));
+    }
+    if (x + 4 <= blocks) {
+        __m256i yS1, yS2, ySS, yS12;
+        ssim_4x4x4_sum_avx2<Type>(yS1, yS2, ySS, yS12,
+            p0 + x * 4 * sizeof(Type), pitch0,
+            p1 + x * 4 * sizeof(Type), pitch1);
+        ssim_4x4x4_store_avx2(sum, yS1, yS2, ySS, yS12);
+        x += 4, sum += 4;
+    }
+    ssim_block_row_c<Type>(sum, p0 + x * 4 * sizeof(Type), pitch0, p1 + x * 4 * sizeof(Type), pitch1, blocks - x);
+}
+
+//16画素 (4x4ブロック4個) ずつ処理する
+static void ssim_block_row_wide_avx512bw(RGYSsimBlockSum *sum, const uint8_t *p0, const int pitch0, const uint8_t *p1, const int pitch1, const int blocks) {
+    int x = 0;
+    for (; x + 4 <= blocks; x += 4, sum += 4) {
+        __m512i zS1 = _mm512_setzero_si512();
+        __m512i zS2 = _mm512_setzero_si512();
+        __m512i zSS = _mm512_setzero_si512();
+        __m512i zS12 = _mm512_setzero_si512();
+        for (int y = 0; y < 4; y++) {
+            const __m512i za = cvtepu16_epi32_avx512(_mm256_loadu_si256((const __m256i *)(p0 + y * pitch0 + x * 4 * sizeof(uint16_t))));
+            const __m512i zb = cvtepu16_epi32_avx512(_mm256_loadu_si256((const __m256i *)(p1 + y * pitch1 + x * 4 * sizeof(uint16_t))));
+            const __m512i zaOdd = srli32_epi64_avx512(za);
+            const __m512i zbOdd = srli32_epi64_avx512(zb);
+            zS1 = _mm512_add_epi32(zS1, za);
+            zS2 = _mm512_add_epi32(zS2, zb);
+            zSS = _mm512_add_epi64(zSS, _mm512_add_epi64(mul_epu32_avx512(za, za), mul_epu32_avx512(zb, zb)));
+            zSS = _mm512_add_epi64(zSS, _mm512_add_epi64(mul_epu32_avx512(zaOdd, zaOdd), mul_epu32_avx512(zbOdd, zbOdd)));
+            zS12 = _mm512_add_epi64(zS12, _mm512_add_epi64(mul_epu32_avx512(za, zb), mul_epu32_avx512(zaOdd, zbOdd)));
+        }
+        ssim_4x4x2_wide_store_avx2(sum + 0,
+            zext_lo256_avx512(zS1), zext_lo256_avx512(zS2),
+            zext_lo256_avx512(zSS), zext_lo256_avx512(zS12));
+        ssim_4x4x2_wide_store_avx2(sum + 2,
+            zext_hi256_avx512(zS1), zext_hi256_avx512(zS2),
+            zext_hi256_avx512(zSS), zext_hi256_avx512(zS12));
+    }
+    ssim_block_row_c<uint16_t>(sum, p0 + x * 4 * sizeof(uint16_t), pitch0, p1 + x * 4 * sizeof(uint16_t), pitch1, blocks - x);
+}
+
+//32画素ずつ処理する (差が16bit符号付きに収まり、2画素分の差の二乗和が32bitに収まる場合)
+template<typename Type>
+static int64_t psnr_row_avx512bw(const uint8_t *p0, const uint8_t *p1, const int width) {
+    const __m512i zMaskLo = _mm512_set1_epi64(0xffffffff);
+    __m512i zSum = _mm512_setzero_si512();
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        const __m512i za = load_32px_avx512<Type>(p0 + x * sizeof(Type));
+        const __m512i zb = load_32px_avx512<Type>(p1 + x * sizeof(Type));
+        const __m512i zDiff = _mm512_sub_epi16(za, zb);
+        const __m512i zSq = _mm512_madd_epi16(zDiff, zDiff);
+        zSum = _mm512_add_epi64(zSum, _mm512_add_epi64(_mm512_and_si512(zSq, zMaskLo), srli32_epi64_avx512(zSq)));
+    }
+    return reduce_add_epi64_avx512(zSum) + psnr_row_c<Type>(p0 + x * sizeof(Type), p1 + x * sizeof(Type), width - x);
+}
+
+//16画素ずつ処理する
+static int64_t psnr_row_wide_avx512bw(const uint8_t *p0, const uint8_t *p1, const int width) {
+    __m512i zSum = _mm512_setzero_si512();
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const __m512i za = cvtepu16_epi32_avx512(_mm256_loadu_si256((const __m256i *)(p0 + x * sizeof(uint16_t))));
+        const __m512i zb = cvtepu16_epi32_avx512(_mm256_loadu_si256((const __m256i *)(p1 + x * sizeof(uint16_t))));
+        const __m512i zDiff = _mm512_sub_epi32(za, zb);
+        const __m512i zDiffOdd = srli32_epi64_avx512(zDiff);
+        zSum = _mm512_add_epi64(zSum, _mm512_add_epi64(mul_epi32_avx512(zDiff, zDiff), mul_epi32_avx512(zDiffOdd, zDiffOdd)));
+    }
+    return reduce_add_epi64_avx512(zSum) + psnr_row_c<uint16_t>(p0 + x * sizeof(uint16_t), p1 + x * sizeof(uint16_t), width - x);
+}
+
+RGYSsimCpuFuncs get_ssim_cpu_funcs_avx512bw(const int bitDepth) {
+    RGYSsimCpuFuncs func;
+    if (bitDepth > SSIM_CPU_NARROW_MAX_BIT_DEPTH) {
+        func.ssimBlockRow = ssim_block_row_wide_avx512bw;
+    } else if (bitDepth > 8) {
+        func.ssimBlockRow = ssim_block_row_avx512bw<uint16_t>;
+    } else {
+        func.ssimBlockRow = ssim_block_row_avx512bw<uint8_t>;
+    }
+    if (bitDepth > PSNR_CPU_NARROW_MAX_BIT_DEPTH) {
+        func.psnrRow = psnr_row_wide_avx512bw;
+    } else if (bitDepth > 8) {
+        func.psnrRow = psnr_row_avx512bw<uint16_t>;
+    } else {
+        func.psnrRow = psnr_row_avx512bw<uint8_t>;
+    }
+    //端数のブロックはまれなので、C版を使用する
+    func.ssimBlockEdge = (bitDepth > 8) ? ssim_block_row_edge_c<uint16_t> : ssim_block_row_edge_c<uint8_t>;
+    func.ssimEndRow = ssim_end_row_avx2;
+    func.simd = RGY_SIMD::AVX512BW;
+    return func;
+}
+
+#endif //#if defined(_M_X64) || defined(__x86_64)
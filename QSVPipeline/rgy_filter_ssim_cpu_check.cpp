@@ -0,0 +1,243 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include "rgy_osdep.h"
+#include "rgy_util.h"
+#include "rgy_filter_ssim_cpu_check.h"
+#include "rgy_check.h"
+#include "rgy_filter_ssim_cpu.h"
+
+static const int CHECK_SSIM_CPU_BENCH_FRAMES = 20;
+static const double CHECK_SSIM_CPU_SSIM_TOLERANCE = 1e-6; // SIMD版は窓の合計の順序と中間値の精度が異なるので、その分の誤差を許容する
+
+// 1フレーム分のバッファ (画面外のpitchの余白にも値を入れておき、読まれていないことを確認する)
+struct RGYSsimCpuCheckFrame {
+    std::vector<uint8_t> buf[3];
+    RGYFrameInfo frame;
+};
+
+static void check_ssim_cpu_alloc(RGYSsimCpuCheckFrame& dst, const RGY_CSP csp, const int width, const int height) {
+    dst.frame = RGYFrameInfo();
+    dst.frame.csp = csp;
+    dst.frame.width = width;
+    dst.frame.height = height;
+    const int pixelSize = (RGY_CSP_BIT_DEPTH[csp] > 8) ? 2 : 1;
+    for (int i = 0; i < 3; i++) {
+        const int planeWidth  = (i == 0) ? width  : (width  >> 1);
+        const int planeHeight = (i == 0) ? height : (height >> 1);
+        dst.frame.pitch[i] = ALIGN(planeWidth * pixelSize + 8, 64);
+        // 最下段が4行に満たない場合にも読み込まれないよう、4行分の余白を付けておく
+        dst.buf[i].resize(dst.frame.pitch[i] * (planeHeight + 4));
+        dst.frame.ptr[i] = dst.buf[i].data();
+    }
+}
+
+// 画面内の画素を設定し、余白には大きな値を入れる
+static void check_ssim_cpu_fill(RGYSsimCpuCheckFrame& f0, RGYSsimCpuCheckFrame& f1, const int bitDepth, std::mt19937& mt) {
+    const int maxValue = (1 << bitDepth) - 1;
+    std::uniform_int_distribution<int> distPix(0, maxValue);
+    std::uniform_int_distribution<int> distNoise(-(maxValue >> 4), maxValue >> 4);
+    for (int i = 0; i < 3; i++) {
+        const auto plane0 = getPlane(&f0.frame, (RGY_PLANE)i);
+        const int rows = (int)(f0.buf[i].size() / plane0.pitch[0]);
+        for (int y = 0; y < rows; y++) {
+            const int pixels = plane0.pitch[0] / ((bitDepth > 8) ? 2 : 1);
+            for (int x = 0; x < pixels; x++) {
+                const bool inside = x < plane0.width && y < plane0.height;
+                // なめらかな値に雑音を加えたものにして、SSIMが極端な値にならないようにする
+                const int noise = distNoise(mt);
+                const int v0 = (inside) ? (((x + y) * 7 + distPix(mt) / 8) & maxValue) : maxValue;
+                const int v1 = (inside) ? clamp(v0 + noise, 0, maxValue) : 0;
+                if (bitDepth > 8) {
+                    ((uint16_t *)(f0.buf[i].data() + y * plane0.pitch[0]))[x] = (uint16_t)v0;
+                    ((uint16_t *)(f1.buf[i].data() + y * plane0.pitch[0]))[x] = (uint16_t)v1;
+                } else {
+                    f0.buf[i][y * plane0.pitch[0] + x] = (uint8_t)v0;
+                    f1.buf[i][y * plane0.pitch[0] + x] = (uint8_t)v1;
+                }
+            }
+        }
+    }
+}
+
+// 画素ごとに単純に計算したSSIMとMSE
+// 窓は4画素ずつずらした8x8で、rgy_filter_ssim.clと同じく画面端の4x4に満たないブロックを含む窓も評価し、画面外の画素は0として扱う
+template<typename Type>
+static void check_ssim_cpu_ref_plane(double *ssim, double *mse, const RGYFrameInfo *plane0, const RGYFrameInfo *plane1, const int bitDepth) {
+    const int width = plane0->width;
+    const int height = plane0->height;
+    auto pix = [](const RGYFrameInfo *plane, const int x, const int y) {
+        return (int64_t)((const Type *)(plane->ptr[0] + y * plane->pitch[0]))[x];
+    };
+    const int64_t max = (1 << bitDepth) - 1;
+    const int64_t ssim_c1 = (int64_t)(0.01 * 0.01 * max * max * 64.0 + 0.5);
+    const int64_t ssim_c2 = (int64_t)(0.03 * 0.03 * max * max * 64.0 * 63.0 + 0.5);
+    const int windowsX = ((width + 3) >> 2) - 1;
+    const int windowsY = ((height + 3) >> 2) - 1;
+    double ssimSum = 0.0;
+    for (int wy = 0; wy < windowsY; wy++) {
+        for (int wx = 0; wx < windowsX; wx++) {
+            int64_t s1 = 0, s2 = 0, ss = 0, s12 = 0;
+            for (int y = wy * 4; y < std::min(wy * 4 + 8, height); y++) {
+                for (int x = wx * 4; x < std::min(wx * 4 + 8, width); x++) {
+                    const int64_t a = pix(plane0, x, y);
+                    const int64_t b = pix(plane1, x, y);
+                    s1  += a;
+                    s2  += b;
+                    ss  += a * a + b * b;
+                    s12 += a * b;
+                }
+            }
+            ssimSum += ssim_end1x(s1, s2, ss, s12, ssim_c1, ssim_c2);
+        }
+    }
+    const int windows = windowsX * windowsY;
+    *ssim = (windows > 0) ? ssimSum / (double)windows : 0.0;
+
+    int64_t sse = 0;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const int64_t diff = pix(plane0, x, y) - pix(plane1, x, y);
+            sse += diff * diff;
+        }
+    }
+    *mse = sse / (double)(width * height);
+}
+
+struct RGYSsimCpuCheckSimd {
+    const TCHAR *name;
+    RGY_SIMD simd; // init()に指定する使用可能なSIMD
+    RGY_SIMD used; // 実際に使用されるSIMD (これと異なる場合はそのCPUでは使用できない)
+};
+
+bool check_ssim_cpu() {
+    const RGYSsimCpuCheckSimd simdList[] = {
+        { _T("c"),        RGY_SIMD::NONE,     RGY_SIMD::NONE },
+        { _T("avx2"),     RGY_SIMD::AVX2,     RGY_SIMD::AVX2 },
+        { _T("avx512bw"), RGY_SIMD::AVX512BW, RGY_SIMD::AVX512BW },
+    };
+    const std::pair<int, int> sizeList[] = {
+        { 1920, 1080 }, { 720, 480 }, { 33, 17 }, { 30, 22 }, { 61, 45 }, { 17, 9 }, { 10, 10 }, { 7, 5 }, { 4, 4 },
+    };
+    const int bitDepthList[] = { 8, 10, 12, 16 };
+    const int threadList[] = { 1, 3 };
+    std::mt19937 mt(1234);
+    bool ok = true;
+
+    // 結果の確認
+    for (const auto bitDepth : bitDepthList) {
+        const RGY_CSP csp = (bitDepth > 8) ? RGY_CSP_YV12_16 : RGY_CSP_YV12;
+        int mismatch[_countof(simdList)] = { 0 };
+        int tested[_countof(simdList)] = { 0 };
+        for (const auto& size : sizeList) {
+            RGYSsimCpuCheckFrame f0, f1;
+            check_ssim_cpu_alloc(f0, csp, size.first, size.second);
+            check_ssim_cpu_alloc(f1, csp, size.first, size.second);
+            check_ssim_cpu_fill(f0, f1, bitDepth, mt);
+            std::array<double, 3> ssimRef = { 0.0 }, mseRef = { 0.0 };
+            for (int i = 0; i < 3; i++) {
+                const auto plane0 = getPlane(&f0.frame, (RGY_PLANE)i);
+                const auto plane1 = getPlane(&f1.frame, (RGY_PLANE)i);
+                if (bitDepth > 8) {
+                    check_ssim_cpu_ref_plane<uint16_t>(&ssimRef[i], &mseRef[i], &plane0, &plane1, bitDepth);
+                } else {
+                    check_ssim_cpu_ref_plane<uint8_t>(&ssimRef[i], &mseRef[i], &plane0, &plane1, bitDepth);
+                }
+            }
+            for (int isimd = 0; isimd < (int)_countof(simdList); isimd++) {
+                std::array<double, 3> ssimFirst = { 0.0 }, mseFirst = { 0.0 };
+                for (int ith = 0; ith < (int)_countof(threadList); ith++) {
+                    RGYFilterSsimCpu cpu;
+                    if (cpu.init(bitDepth, threadList[ith], RGYParamThread(), simdList[isimd].simd) != RGY_ERR_NONE) {
+                        _ftprintf(stderr, _T("Failed to init RGYFilterSsimCpu.\n"));
+                        return false;
+                    }
+                    // そのCPUで使用できないSIMDは飛ばす
+                    if (cpu.simd() != simdList[isimd].used) {
+                        break;
+                    }
+                    std::array<double, 3> ssimPlane = { 0.0 }, msePlane = { 0.0 };
+                    cpu.calc(&f0.frame, &f1.frame, true, true, ssimPlane, msePlane);
+                    for (int i = 0; i < 3; i++) {
+                        if (std::abs(ssimPlane[i] - ssimRef[i]) > CHECK_SSIM_CPU_SSIM_TOLERANCE || msePlane[i] != mseRef[i]) {
+                            mismatch[isimd]++;
+                        }
+                        // スレッド数によって結果が変わらないこと
+                        if (ith > 0 && (ssimPlane[i] != ssimFirst[i] || msePlane[i] != mseFirst[i])) {
+                            mismatch[isimd]++;
+                        }
+                    }
+                    if (ith == 0) {
+                        ssimFirst = ssimPlane;
+                        mseFirst = msePlane;
+                    }
+                    tested[isimd]++;
+                }
+            }
+        }
+        for (int isimd = 0; isimd < (int)_countof(simdList); isimd++) {
+            const tstring name = strsprintf(_T("%-8s %2dbit"), simdList[isimd].name, bitDepth);
+            if (tested[isimd] == 0) {
+                rgy_check_print_info(name.c_str(), _T("skipped (not supported on this cpu)"));
+                continue;
+            }
+            ok &= rgy_check_print(name.c_str(), mismatch[isimd] == 0, strsprintf(_T("mismatch %d"), mismatch[isimd]));
+        }
+    }
+
+    // 1920x1080の1フレームあたりの処理時間 (1スレッド)
+    for (const auto bitDepth : { 8, 10 }) {
+        const RGY_CSP csp = (bitDepth > 8) ? RGY_CSP_YV12_16 : RGY_CSP_YV12;
+        RGYSsimCpuCheckFrame f0, f1;
+        check_ssim_cpu_alloc(f0, csp, 1920, 1080);
+        check_ssim_cpu_alloc(f1, csp, 1920, 1080);
+        check_ssim_cpu_fill(f0, f1, bitDepth, mt);
+        for (int isimd = 0; isimd < (int)_countof(simdList); isimd++) {
+            RGYFilterSsimCpu cpu;
+            if (cpu.init(bitDepth, 1, RGYParamThread(), simdList[isimd].simd) != RGY_ERR_NONE) {
+                return false;
+            }
+            if (cpu.simd() != simdList[isimd].used) {
+                continue;
+            }
+            std::array<double, 3> ssimPlane = { 0.0 }, msePlane = { 0.0 };
+            cpu.calc(&f0.frame, &f1.frame, true, true, ssimPlane, msePlane);
+            RGYCheckTimer timer;
+            for (int i = 0; i < CHECK_SSIM_CPU_BENCH_FRAMES; i++) {
+                cpu.calc(&f0.frame, &f1.frame, true, true, ssimPlane, msePlane);
+            }
+            const double us = timer.sec() * 1e6 / CHECK_SSIM_CPU_BENCH_FRAMES;
+            rgy_check_print_info(strsprintf(_T("%-8s %2dbit 1920x1080"), simdList[isimd].name, bitDepth).c_str(), strsprintf(_T("%10.1f us/frame"), us));
+        }
+    }
+    return rgy_check_print_total(ok);
+}
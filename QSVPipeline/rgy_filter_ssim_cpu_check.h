@@ -0,0 +1,41 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __RGY_FILTER_SSIM_CPU_CHECK_H__
+#define __RGY_FILTER_SSIM_CPU_CHECK_H__
+
+#include "rgy_tchar.h"
+
+// SSIM/PSNRのCPU計算 (--metric-device cpu) の確認と速度計測
+// 4x4で割り切れない大きさを含む各種のフレームについて、C/AVX2/AVX512BW版とスレッド数ごとの結果が
+// 画素ごとに単純に計算した結果 (画面端の4x4に満たないブロックを含む窓もrgy_filter_ssim.clと同じく評価する) と
+// 一致することを確認したうえで、1920x1080の1フレームあたりの処理時間を表示する
+//   戻り値  ... すべての結果が一致すればtrue
+bool check_ssim_cpu();
+
+#endif //__RGY_FILTER_SSIM_CPU_CHECK_H__
@@ -0,0 +1,186 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __RGY_FILTER_SSIM_CPU_SIMD_H__
+#define __RGY_FILTER_SSIM_CPU_SIMD_H__
+
+#include "rgy_osdep.h"
+#include "rgy_filter_ssim_cpu.h"
+
+//この bit深度までは、16bit単位の演算 (_mm256_madd_epi16) で計算する
+//SSIM: 1ブロックの二乗和 (32画素分) が32bit符号付きに収まる範囲
+static const int SSIM_CPU_NARROW_MAX_BIT_DEPTH = 12;
+//PSNR: 差が16bit符号付きに収まり、2画素分の差の二乗和が32bit符号付きに収まる範囲
+static const int PSNR_CPU_NARROW_MAX_BIT_DEPTH = 14;
+
+#if defined(RGY_FILTER_SSIM_CPU_AVX2) || defined(RGY_FILTER_SSIM_CPU_AVX512BW)
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__x86_64)
+
+#include <immintrin.h>
+
+#if _MSC_VER >= 1800 && !defined(__AVX__) && !defined(_DEBUG)
+static_assert(false, "do not forget to set /arch:AVX or /arch:AVX2 for this file.");
+#endif
+
+//16画素を16bitに拡張して読み込む
+template<typename Type>
+static RGY_FORCEINLINE __m256i load_16px_avx2(const uint8_t *ptr) {
+    if (sizeof(Type) == 1) {
+        return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)ptr));
+    } else {
+        return _mm256_loadu_si256((const __m256i *)ptr);
+    }
+}
+
+//4x4ブロック4個分 (16x4画素) の和を計算する
+//各32bitの要素には、水平方向に隣接する2列分の和が入る (ブロックkは要素2k,2k+1)
+template<typename Type>
+static RGY_FORCEINLINE void ssim_4x4x4_sum_avx2(__m256i& yS1, __m256i& yS2, __m256i& ySS, __m256i& yS12,
+    const uint8_t *p0, const int pitch0, const uint8_t *p1, const int pitch1) {
+    __m256i yColS1 = _mm256_setzero_si256();
+    __m256i yColS2 = _mm256_setzero_si256();
+    ySS = _mm256_setzero_si256();
+    yS12 = _mm256_setzero_si256();
+    for (int y = 0; y < 4; y++) {
+        const __m256i ya = load_16px_avx2<Type>(p0 + y * pitch0);
+        const __m256i yb = load_16px_avx2<Type>(p1 + y * pitch1);
+        yColS1 = _mm256_add_epi16(yColS1, ya);
+        yColS2 = _mm256_add_epi16(yColS2, yb);
+        ySS = _mm256_add_epi32(ySS, _mm256_add_epi32(_mm256_madd_epi16(ya, ya), _mm256_madd_epi16(yb, yb)));
+        yS12 = _mm256_add_epi32(yS12, _mm256_madd_epi16(ya, yb));
+    }
+    const __m256i yOne = _mm256_set1_epi16(1);
+    yS1 = _mm256_madd_epi16(yColS1, yOne);
+    yS2 = _mm256_madd_epi16(yColS2, yOne);
+}
+
+//ssim_4x4x4_sum_avx2の結果をブロックごとにまとめて、RGYSsimBlockSum 4個として格納する
+static RGY_FORCEINLINE void ssim_4x4x4_store_avx2(RGYSsimBlockSum *sum, const __m256i& yS1, const __m256i& yS2, const __m256i& ySS, const __m256i& yS12) {
+    // x = [s1_0, s1_1, s2_0, s2_1 | s1_2, s1_3, s2_2, s2_3]
+    // y = [ss_0, ss_1, s12_0, s12_1 | ss_2, ss_3, s12_2, s12_3]
+    const __m256i x = _mm256_hadd_epi32(yS1, yS2);
+    const __m256i y = _mm256_hadd_epi32(ySS, yS12);
+    const __m256i u = _mm256_unpacklo_epi32(x, y);
+    const __m256i v = _mm256_unpackhi_epi32(x, y);
+    // P = [s1_0, s2_0, ss_0, s12_0 | s1_2, s2_2, ss_2, s12_2]
+    // Q = [s1_1, s2_1, ss_1, s12_1 | s1_3, s2_3, ss_3, s12_3]
+    const __m256i P = _mm256_unpacklo_epi32(u, v);
+    const __m256i Q = _mm256_unpackhi_epi32(u, v);
+    _mm256_storeu_si256((__m256i *)(sum + 0), _mm256_cvtepi32_epi64(_mm256_castsi256_si128(P)));
+    _mm256_storeu_si256((__m256i *)(sum + 1), _mm256_cvtepi32_epi64(_mm256_castsi256_si128(Q)));
+    _mm256_storeu_si256((__m256i *)(sum + 2), _mm256_cvtepi32_epi64(_mm256_extracti128_si256(P, 1)));
+    _mm256_storeu_si256((__m256i *)(sum + 3), _mm256_cvtepi32_epi64(_mm256_extracti128_si256(Q, 1)));
+}
+
+//4x4ブロック2個分を、RGYSsimBlockSum 2個として格納する
+//yS1, yS2 ... 32bit x 8 (ブロックkは要素4k～4k+3)
+//ySS, yS12 ... 64bit x 4 (ブロックkは要素2k,2k+1)
+static RGY_FORCEINLINE void ssim_4x4x2_wide_store_avx2(RGYSsimBlockSum *sum, const __m256i& yS1, const __m256i& yS2, const __m256i& ySS, const __m256i& yS12) {
+    // x = [s1_0, s2_0, s1_0, s2_0 | s1_1, s2_1, s1_1, s2_1]
+    const __m256i x = _mm256_hadd_epi32(_mm256_hadd_epi32(yS1, yS2), _mm256_hadd_epi32(yS1, yS2));
+    // y = [ss_0, s12_0 | ss_1, s12_1]
+    const __m256i y = _mm256_add_epi64(_mm256_unpacklo_epi64(ySS, yS12), _mm256_unpackhi_epi64(ySS, yS12));
+    _mm_storeu_si128((__m128i *)&sum[0].s1, _mm_cvtepi32_epi64(_mm256_castsi256_si128(x)));
+    _mm_storeu_si128((__m128i *)&sum[0].ss, _mm256_castsi256_si128(y));
+    _mm_storeu_si128((__m128i *)&sum[1].s1, _mm_cvtepi32_epi64(_mm256_extracti128_si256(x, 1)));
+    _mm_storeu_si128((__m128i *)&sum[1].ss, _mm256_extracti128_si256(y, 1));
+}
+
+//符号なし32bit x 8 を64bit x 4 の累積値に加算する
+static RGY_FORCEINLINE __m256i add_epu32_to_epi64_avx2(const __m256i& ySum, const __m256i& y) {
+    const __m256i yLo = _mm256_and_si256(y, _mm256_set1_epi64x(0xffffffff));
+    const __m256i yHi = _mm256_srli_epi64(y, 32);
+    return _mm256_add_epi64(ySum, _mm256_add_epi64(yLo, yHi));
+}
+
+static RGY_FORCEINLINE int64_t hsum_epi64_avx2(const __m256i& y) {
+    alignas(16) int64_t tmp[2];
+    _mm_store_si128((__m128i *)tmp, _mm_add_epi64(_mm256_castsi256_si128(y), _mm256_extracti128_si256(y, 1)));
+    return tmp[0] + tmp[1];
+}
+
+//0以上2^52未満の64bit整数 x 4 をdoubleに変換する
+static RGY_FORCEINLINE __m256d cvt_epu52_pd_avx2(const __m256i& y) {
+    const __m256d yMagic = _mm256_set1_pd(4503599627370496.0); // 2^52
+    return _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(y, _mm256_castpd_si256(yMagic))), yMagic);
+}
+
+//ssim_end_row_cと同じ計算を窓4個ずつ行う
+//整数部分の演算はすべて2^53未満に収まるのでdoubleで誤差なく行え、
+//floatへの変換(丸め)が1回になるため、窓ごとのSSIMはssim_end1xと一致する
+static double ssim_end_row_avx2(const RGYSsimBlockSum *sum0, const RGYSsimBlockSum *sum1, const int windows, const int64_t ssim_c1, const int64_t ssim_c2) {
+    const __m256d yC1 = _mm256_set1_pd((double)ssim_c1);
+    const __m256d yC2 = _mm256_set1_pd((double)ssim_c2);
+    const __m256d y64 = _mm256_set1_pd(64.0);
+    __m256d ySsim = _mm256_setzero_pd();
+    int x = 0;
+    if (windows >= 4) {
+        //縦方向に2ブロック分加算したもの [s1, s2, ss, s12]
+        __m256i yB0 = _mm256_add_epi64(_mm256_loadu_si256((const __m256i *)(sum0 + 0)), _mm256_loadu_si256((const __m256i *)(sum1 + 0)));
+        for (; x + 4 <= windows; x += 4) {
+            const __m256i yB1 = _mm256_add_epi64(_mm256_loadu_si256((const __m256i *)(sum0 + x + 1)), _mm256_loadu_si256((const __m256i *)(sum1 + x + 1)));
+            const __m256i yB2 = _mm256_add_epi64(_mm256_loadu_si256((const __m256i *)(sum0 + x + 2)), _mm256_loadu_si256((const __m256i *)(sum1 + x + 2)));
+            const __m256i yB3 = _mm256_add_epi64(_mm256_loadu_si256((const __m256i *)(sum0 + x + 3)), _mm256_loadu_si256((const __m256i *)(sum1 + x + 3)));
+            const __m256i yB4 = _mm256_add_epi64(_mm256_loadu_si256((const __m256i *)(sum0 + x + 4)), _mm256_loadu_si256((const __m256i *)(sum1 + x + 4)));
+            const __m256i yW0 = _mm256_add_epi64(yB0, yB1);
+            const __m256i yW1 = _mm256_add_epi64(yB1, yB2);
+            const __m256i yW2 = _mm256_add_epi64(yB2, yB3);
+            const __m256i yW3 = _mm256_add_epi64(yB3, yB4);
+            yB0 = yB4;
+            //転置して窓4個分の s1, s2, ss, s12 をそれぞれまとめる
+            const __m256i yT0 = _mm256_unpacklo_epi64(yW0, yW1); // [s1_0, s1_1 | ss_0, ss_1]
+            const __m256i yT1 = _mm256_unpackhi_epi64(yW0, yW1); // [s2_0, s2_1 | s12_0, s12_1]
+            const __m256i yT2 = _mm256_unpacklo_epi64(yW2, yW3); // [s1_2, s1_3 | ss_2, ss_3]
+            const __m256i yT3 = _mm256_unpackhi_epi64(yW2, yW3); // [s2_2, s2_3 | s12_2, s12_3]
+            const __m256d yS1  = cvt_epu52_pd_avx2(_mm256_permute2x128_si256(yT0, yT2, 0x20));
+            const __m256d ySS  = cvt_epu52_pd_avx2(_mm256_permute2x128_si256(yT0, yT2, 0x31));
+            const __m256d yS2  = cvt_epu52_pd_avx2(_mm256_permute2x128_si256(yT1, yT3, 0x20));
+            const __m256d yS12 = cvt_epu52_pd_avx2(_mm256_permute2x128_si256(yT1, yT3, 0x31));
+            const __m256d yS1S2 = _mm256_mul_pd(yS1, yS2);
+            const __m256d yS1S1S2S2 = _mm256_add_pd(_mm256_mul_pd(yS1, yS1), _mm256_mul_pd(yS2, yS2));
+            const __m256d yVars = _mm256_sub_pd(_mm256_mul_pd(ySS, y64), yS1S1S2S2);
+            const __m256d yCovar = _mm256_sub_pd(_mm256_mul_pd(yS12, y64), yS1S2);
+            const __m128 xNum0 = _mm256_cvtpd_ps(_mm256_add_pd(_mm256_add_pd(yS1S2, yS1S2), yC1));
+            const __m128 xNum1 = _mm256_cvtpd_ps(_mm256_add_pd(_mm256_add_pd(yCovar, yCovar), yC2));
+            const __m128 xDen0 = _mm256_cvtpd_ps(_mm256_add_pd(yS1S1S2S2, yC1));
+            const __m128 xDen1 = _mm256_cvtpd_ps(_mm256_add_pd(yVars, yC2));
+            const __m128 xSsim = _mm_div_ps(_mm_mul_ps(xNum0, xNum1), _mm_mul_ps(xDen0, xDen1));
+            ySsim = _mm256_add_pd(ySsim, _mm256_cvtps_pd(xSsim));
+        }
+    }
+    alignas(32) double tmp[4];
+    _mm256_store_pd(tmp, ySsim);
+    return (tmp[0] + tmp[1]) + (tmp[2] + tmp[3]) + ssim_end_row_c(sum0 + x, sum1 + x, windows - x, ssim_c1, ssim_c2);
+}
+
+#endif //#if defined(_M_IX86) || defined(_M_X64) || defined(__x86_64)
+
+#endif //#if defined(RGY_FILTER_SSIM_CPU_AVX2) || defined(RGY_FILTER_SSIM_CPU_AVX512BW)
+
+#endif //__RGY_FILTER_SSIM_CPU_SIMD_H__
@@ -0,0 +1,197 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#include <cstdio>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include "rgy_osdep.h"
+#include "rgy_util.h"
+#include "rgy_frame_pos_check.h"
+#include "rgy_check.h"
+#include "rgy_input_avcodec.h"
+
+#if ENABLE_AVSW_READER
+static const int CHECK_FRAME_POS_COUNT = 10000000;
+static const int CHECK_FRAME_POS_DURATION = 1001;
+static const int CHECK_FRAME_POS_VERIFY_COUNT = 200;     // 先頭から順に探索した結果と比較する回数
+static const int CHECK_FRAME_POS_RANDOM_COUNT = 200000;  // ランダムな探索の時間を計測する回数
+static const int CHECK_FRAME_POS_SEQUENTIAL_COUNT = 1000000;
+
+// ptsの索引の区間数を参照するため、protectedのメンバを公開する
+class FramePosListCheck : public FramePosList {
+public:
+    size_t ptsRuns() const { return m_ptsRuns.size(); }
+};
+
+struct RGYFramePosCheckScenario {
+    const TCHAR *name;
+    int jumpInterval; // この間隔でptsを戻す (0なら戻さない)
+};
+
+// i番目(表示順)のフレームのpts
+static int64_t check_frame_pos_pts(const RGYFramePosCheckScenario& scenario, const int64_t i) {
+    int64_t base = i;
+    if (scenario.jumpInterval > 0) {
+        base = (i % scenario.jumpInterval) + (i / scenario.jumpInterval) * (scenario.jumpInterval / 3);
+    }
+    return base * CHECK_FRAME_POS_DURATION;
+}
+
+// 先頭から順に探索するfindpts (索引を使わない実装と同じ結果を返す)
+// 戻り値はフレームのインデックス (-1ならptsの前のフレームがない、-2なら見つからない)
+static int check_frame_pos_findpts_ref(const std::vector<int64_t>& ptsList, const int64_t pts, uint32_t *lastIndex) {
+    const uint32_t n = (uint32_t)ptsList.size();
+    for (uint32_t index = *lastIndex + 1; index < n; index++) {
+        if (ptsList[index] == pts) {
+            *lastIndex = index;
+            return (int)index;
+        }
+    }
+    for (uint32_t index = 0; index < n; index++) {
+        if (ptsList[index] == pts) {
+            *lastIndex = index;
+            return (int)index;
+        }
+        if (pts < ptsList[index]) {
+            *lastIndex = index - 1;
+            return (int)index - 1;
+        }
+    }
+    return -2;
+}
+
+// 先頭から順に探索するfindIndex (pts <= framePtsとなる最初のフレーム)
+static int check_frame_pos_find_index_ref(const std::vector<int64_t>& ptsList, const int64_t pts, const uint32_t start) {
+    for (uint32_t index = start; index < (uint32_t)ptsList.size(); index++) {
+        if (pts <= ptsList[index]) {
+            return (int)index;
+        }
+    }
+    return -1;
+}
+
+static bool check_frame_pos_run(const RGYFramePosCheckScenario& scenario) {
+    FramePosListCheck list;
+    RGYCheckTimer timer;
+    // IBBの順 (デコード順) に追加する
+    for (int g = 0; g < CHECK_FRAME_POS_COUNT; g += 3) {
+        const int order[3] = { 2, 0, 1 };
+        for (int k = 0; k < 3 && g + order[k] < CHECK_FRAME_POS_COUNT; k++) {
+            const int i = g + order[k];
+            const int64_t pts = check_frame_pos_pts(scenario, i);
+            list.add(framePos(pts, pts - 2 * CHECK_FRAME_POS_DURATION, CHECK_FRAME_POS_DURATION, 0, FRAMEPOS_POC_INVALID, (i % 300 == 0) ? AV_PKT_FLAG_KEY : 0));
+        }
+        if (g == 300) {
+            list.checkPtsStatus();
+        }
+    }
+    list.fin(framePos(check_frame_pos_pts(scenario, CHECK_FRAME_POS_COUNT), check_frame_pos_pts(scenario, CHECK_FRAME_POS_COUNT), 0), (int64_t)CHECK_FRAME_POS_COUNT * CHECK_FRAME_POS_DURATION);
+    const double buildSec = timer.sec();
+
+    std::vector<int64_t> ptsList(list.frameNum());
+    for (int i = 0; i < (int)ptsList.size(); i++) {
+        ptsList[i] = list.list(i).pts;
+    }
+    std::mt19937_64 mt(1);
+    auto randomPts = [&mt](int q) {
+        int64_t pts = (int64_t)(mt() % (uint64_t)CHECK_FRAME_POS_COUNT) * CHECK_FRAME_POS_DURATION;
+        if (q % 3 == 1) {
+            pts += 17; // 一致するフレームのないpts
+        }
+        return pts;
+    };
+
+    int mismatch = 0;
+    {
+        uint32_t lastRef = 0, last = 0;
+        for (int q = 0; q < CHECK_FRAME_POS_VERIFY_COUNT; q++) {
+            const int64_t pts = randomPts(q);
+            const int index = check_frame_pos_findpts_ref(ptsList, pts, &lastRef);
+            const FramePos expected = (index >= 0) ? list.list(index) : framePosInit();
+            const FramePos pos = list.findpts(pts, &last);
+            if (memcmp(&expected, &pos, sizeof(pos)) != 0 || lastRef != last) {
+                mismatch++;
+            }
+            const uint32_t start = (uint32_t)(mt() % (uint64_t)ptsList.size());
+            const int indexRef = check_frame_pos_find_index_ref(ptsList, pts, start);
+            if (list.findIndex(start, [pts](int64_t framePts) { return pts <= framePts; }) != indexRef) {
+                mismatch++;
+            }
+        }
+    }
+    // ランダムな探索
+    double randomSec = 0.0;
+    {
+        std::vector<int64_t> queries(CHECK_FRAME_POS_RANDOM_COUNT);
+        for (int q = 0; q < CHECK_FRAME_POS_RANDOM_COUNT; q++) {
+            queries[q] = randomPts(q);
+        }
+        uint32_t last = 0;
+        timer.restart();
+        for (const auto pts : queries) {
+            list.findpts(pts, &last);
+        }
+        randomSec = timer.sec();
+    }
+    // 先頭から順の探索 (通常のエンコード時)
+    double sequentialSec = 0.0;
+    {
+        uint32_t last = 0;
+        timer.restart();
+        for (int i = 0; i < CHECK_FRAME_POS_SEQUENTIAL_COUNT; i++) {
+            const int64_t pts = check_frame_pos_pts(scenario, i);
+            const FramePos pos = list.findpts(pts, &last);
+            if (pos.pts != pts) {
+                mismatch++;
+            }
+        }
+        sequentialSec = timer.sec();
+    }
+    return rgy_check_print(scenario.name, mismatch == 0,
+        strsprintf(_T("mismatch %d, %d frames, %d runs, build %.2f s, random %.3f us/query, sequential %.3f us/query"),
+            mismatch, list.frameNum(), (int)list.ptsRuns(), buildSec,
+            randomSec * 1e6 / CHECK_FRAME_POS_RANDOM_COUNT, sequentialSec * 1e6 / CHECK_FRAME_POS_SEQUENTIAL_COUNT));
+}
+
+bool check_frame_pos_list() {
+    const RGYFramePosCheckScenario scenarios[] = {
+        { _T("no pts jump"),   0 },
+        { _T("pts jump / 1M"), 1000000 },
+    };
+    bool ok = true;
+    for (const auto& scenario : scenarios) {
+        ok &= check_frame_pos_run(scenario);
+    }
+    return rgy_check_print_total(ok);
+}
+#else
+bool check_frame_pos_list() {
+    _ftprintf(stderr, _T("--check-frame-pos is not supported in this build.\n"));
+    return false;
+}
+#endif //#if ENABLE_AVSW_READER
@@ -36,7 +36,304 @@ const TCHAR *RGYHDR10Plus::HDR10PLUS_GEN_EXE_NAME =  _T("hdr10plus_gen.exe");
 const TCHAR *RGYHDR10Plus::HDR10PLUS_GEN_EXE_NAME =  _T("hdr10plus_gen");
 #endif
 
+//SMPTE ST 2094-40 (HDR10+) の1フレーム分のパラメータ
+struct RGYHDR10PlusFrameParam {
+    int numWindows;
+    uint32_t targetedSystemDisplayMaximumLuminance;
+    uint32_t maxscl[3];
+    uint32_t averageMaxRGB;
+    std::vector<uint32_t> distributionIndex;
+    std::vector<uint32_t> distributionValues;
+    uint32_t fractionBrightPixels;
+    bool toneMapping;
+    uint32_t kneePointX;
+    uint32_t kneePointY;
+    std::vector<uint32_t> bezierCurveAnchors;
+    bool unsupported; //内蔵のパーサで扱えないパラメータ (複数window等) が含まれる
+
+    RGYHDR10PlusFrameParam() :
+        numWindows(1), targetedSystemDisplayMaximumLuminance(0), maxscl(), averageMaxRGB(0),
+        distributionIndex(), distributionValues(), fractionBrightPixels(0),
+        toneMapping(false), kneePointX(0), kneePointY(0), bezierCurveAnchors(), unsupported(false) {};
+};
+
+//HDR10+のjsonを読むための最小限のjsonパーサ
+//必要なキーのみ取り出し、それ以外は読み飛ばす
+class RGYHDR10PlusJsonReader {
+public:
+    RGYHDR10PlusJsonReader(const char *ptr, size_t size) : m_ptr(ptr), m_fin(ptr + size) {};
+
+    bool skipBOM() {
+        if (m_fin - m_ptr >= 3 && (uint8_t)m_ptr[0] == 0xEF && (uint8_t)m_ptr[1] == 0xBB && (uint8_t)m_ptr[2] == 0xBF) {
+            m_ptr += 3;
+        }
+        return true;
+    }
+    char peek() {
+        skipSpace();
+        return (m_ptr < m_fin) ? *m_ptr : '\0';
+    }
+    bool expect(char c) {
+        if (peek() != c) {
+            return false;
+        }
+        m_ptr++;
+        return true;
+    }
+    bool readString(std::string& str) {
+        str.clear();
+        if (!expect('\"')) {
+            return false;
+        }
+        while (m_ptr < m_fin && *m_ptr != '\"') {
+            if (*m_ptr == '\\') {
+                if (++m_ptr >= m_fin) {
+                    return false;
+                }
+                switch (*m_ptr) {
+                case 'b': str += '\b'; break;
+                case 'f': str += '\f'; break;
+                case 'n': str += '\n'; break;
+                case 'r': str += '\r'; break;
+                case 't': str += '\t'; break;
+                case 'u':
+                    //キーの判定には使わないので中身は無視する
+                    if (m_fin - m_ptr < 5) {
+                        return false;
+                    }
+                    str += '?';
+                    m_ptr += 4;
+                    break;
+                default: str += *m_ptr; break;
+                }
+                m_ptr++;
+            } else {
+                str += *m_ptr++;
+            }
+        }
+        return expect('\"');
+    }
+    bool readNumber(double& value) {
+        skipSpace();
+        const char *start = m_ptr;
+        while (m_ptr < m_fin && (isdigit((uint8_t)*m_ptr) || *m_ptr == '-' || *m_ptr == '+' || *m_ptr == '.' || *m_ptr == 'e' || *m_ptr == 'E')) {
+            m_ptr++;
+        }
+        if (start == m_ptr || m_ptr - start >= 64) {
+            return false;
+        }
+        char buf[64] = { 0 };
+        memcpy(buf, start, m_ptr - start);
+        char *end = nullptr;
+        value = strtod(buf, &end);
+        return end == buf + (m_ptr - start);
+    }
+    bool readUInt(uint32_t& value) {
+        double d = 0.0;
+        if (!readNumber(d) || d < 0.0 || d > (double)UINT32_MAX) {
+            return false;
+        }
+        value = (uint32_t)(d + 0.5);
+        return true;
+    }
+    bool readUIntArray(std::vector<uint32_t>& values) {
+        values.clear();
+        return readArray([&]() {
+            uint32_t value = 0;
+            if (!readUInt(value)) {
+                return false;
+            }
+            values.push_back(value);
+            return true;
+        });
+    }
+    template<typename T>
+    bool readObject(T onKey) {
+        if (!expect('{')) {
+            return false;
+        }
+        if (expect('}')) {
+            return true;
+        }
+        std::string key;
+        do {
+            if (!readString(key) || !expect(':') || !onKey(key)) {
+                return false;
+            }
+        } while (expect(','));
+        return expect('}');
+    }
+    template<typename T>
+    bool readArray(T onElement) {
+        if (!expect('[')) {
+            return false;
+        }
+        if (expect(']')) {
+            return true;
+        }
+        do {
+            if (!onElement()) {
+                return false;
+            }
+        } while (expect(','));
+        return expect(']');
+    }
+    bool skipValue() {
+        switch (peek()) {
+        case '{': return readObject([this](const std::string&) { return skipValue(); });
+        case '[': return readArray([this]() { return skipValue(); });
+        case '\"': { std::string str; return readString(str); }
+        case 't': return skipLiteral("true");
+        case 'f': return skipLiteral("false");
+        case 'n': return skipLiteral("null");
+        default: { double d = 0.0; return readNumber(d); }
+        }
+    }
+protected:
+    void skipSpace() {
+        while (m_ptr < m_fin && (*m_ptr == ' ' || *m_ptr == '\t' || *m_ptr == '\r' || *m_ptr == '\n')) {
+            m_ptr++;
+        }
+    }
+    bool skipLiteral(const char *literal) {
+        const size_t len = strlen(literal);
+        if ((size_t)(m_fin - m_ptr) < len || memcmp(m_ptr, literal, len) != 0) {
+            return false;
+        }
+        m_ptr += len;
+        return true;
+    }
+    const char *m_ptr;
+    const char *m_fin;
+};
+
+//ST 2094-40のビット列の書き込み
+class RGYHDR10PlusBitWriter {
+public:
+    RGYHDR10PlusBitWriter(std::vector<uint8_t>& buf) : m_buf(buf), m_bitPos(0) {};
+    void put(uint32_t value, int bits) {
+        value = (bits < 32) ? std::min<uint32_t>(value, (1u << bits) - 1) : value; //範囲外の値は飽和させる
+        for (int i = bits - 1; i >= 0; i--) {
+            if (m_bitPos == 0) {
+                m_buf.push_back(0);
+            }
+            m_buf.back() |= (uint8_t)(((value >> i) & 1) << (7 - m_bitPos));
+            m_bitPos = (m_bitPos + 1) & 7;
+        }
+    }
+protected:
+    std::vector<uint8_t>& m_buf;
+    int m_bitPos;
+};
+
+static bool hdr10plus_read_luminance_param(RGYHDR10PlusJsonReader& reader, RGYHDR10PlusFrameParam& prm) {
+    return reader.readObject([&](const std::string& key) {
+        if (key == "AverageRGB") {
+            return reader.readUInt(prm.averageMaxRGB);
+        } else if (key == "MaxScl") {
+            std::vector<uint32_t> maxscl;
+            if (!reader.readUIntArray(maxscl) || maxscl.size() != _countof(prm.maxscl)) {
+                return false;
+            }
+            std::copy(maxscl.begin(), maxscl.end(), prm.maxscl);
+            return true;
+        } else if (key == "FractionBrightPixels") {
+            return reader.readUInt(prm.fractionBrightPixels);
+        } else if (key == "LuminanceDistributions") {
+            return reader.readObject([&](const std::string& keyDist) {
+                if (keyDist == "DistributionIndex") {
+                    return reader.readUIntArray(prm.distributionIndex);
+                } else if (keyDist == "DistributionValues") {
+                    return reader.readUIntArray(prm.distributionValues);
+                }
+                return reader.skipValue();
+            });
+        }
+        return reader.skipValue();
+    });
+}
+
+static bool hdr10plus_read_bezier_curve(RGYHDR10PlusJsonReader& reader, RGYHDR10PlusFrameParam& prm) {
+    prm.toneMapping = true;
+    return reader.readObject([&](const std::string& key) {
+        if (key == "Anchors") {
+            return reader.readUIntArray(prm.bezierCurveAnchors);
+        } else if (key == "KneePointX") {
+            return reader.readUInt(prm.kneePointX);
+        } else if (key == "KneePointY") {
+            return reader.readUInt(prm.kneePointY);
+        }
+        return reader.skipValue();
+    });
+}
+
+static bool hdr10plus_read_scene_info(RGYHDR10PlusJsonReader& reader, RGYHDR10PlusFrameParam& prm) {
+    return reader.readObject([&](const std::string& key) {
+        if (key == "NumberOfWindows") {
+            uint32_t numWindows = 0;
+            if (!reader.readUInt(numWindows)) {
+                return false;
+            }
+            prm.numWindows = (int)numWindows;
+            return true;
+        } else if (key == "TargetedSystemDisplayMaximumLuminance") {
+            return reader.readUInt(prm.targetedSystemDisplayMaximumLuminance);
+        } else if (key == "LuminanceParameters") {
+            return hdr10plus_read_luminance_param(reader, prm);
+        } else if (key == "BezierCurveData") {
+            return hdr10plus_read_bezier_curve(reader, prm);
+        } else if (key == "LocalParameters") {
+            //旧形式のjson
+            prm.unsupported = true;
+        }
+        return reader.skipValue();
+    });
+}
+
+//ITU-T T.35のヘッダを含むST 2094-40のpayloadを生成する
+static bool hdr10plus_gen_payload(std::vector<uint8_t>& buf, const RGYHDR10PlusFrameParam& prm) {
+    if (prm.unsupported
+        || prm.numWindows != 1 //複数windowには非対応
+        || prm.distributionIndex.size() != prm.distributionValues.size()
+        || prm.distributionIndex.size() > 15
+        || prm.bezierCurveAnchors.size() > 15) {
+        return false;
+    }
+    RGYHDR10PlusBitWriter writer(buf);
+    writer.put(0xB5, 8);   // itu_t_t35_country_code
+    writer.put(0x003C, 16); // itu_t_t35_terminal_provider_code
+    writer.put(0x0001, 16); // itu_t_t35_terminal_provider_oriented_code
+    writer.put(4, 8);      // application_identifier
+    writer.put(1, 8);      // application_version
+    writer.put(prm.numWindows, 2);
+    writer.put(prm.targetedSystemDisplayMaximumLuminance, 27);
+    writer.put(0, 1);      // targeted_system_display_actual_peak_luminance_flag
+    for (int i = 0; i < _countof(prm.maxscl); i++) {
+        writer.put(prm.maxscl[i], 17);
+    }
+    writer.put(prm.averageMaxRGB, 17);
+    writer.put((uint32_t)prm.distributionIndex.size(), 4);
+    for (size_t i = 0; i < prm.distributionIndex.size(); i++) {
+        writer.put(prm.distributionIndex[i], 7);
+        writer.put(prm.distributionValues[i], 17);
+    }
+    writer.put(prm.fractionBrightPixels, 10);
+    writer.put(0, 1);      // mastering_display_actual_peak_luminance_flag
+    writer.put(prm.toneMapping ? 1 : 0, 1);
+    if (prm.toneMapping) {
+        writer.put(prm.kneePointX, 12);
+        writer.put(prm.kneePointY, 12);
+        writer.put((uint32_t)prm.bezierCurveAnchors.size(), 4);
+        for (const auto anchor : prm.bezierCurveAnchors) {
+            writer.put(anchor, 10);
+        }
+    }
+    writer.put(0, 1);      // color_saturation_mapping_flag
+    return true;
+}
+
 RGYHDR10Plus::RGYHDR10Plus() :
+    m_inputJson(), m_payloads(), m_offsets(),
     m_proc(), m_pipes(),
     m_fpStdOut(std::unique_ptr<FILE, decltype(&fclose)>(nullptr, fclose)),
     m_buffer(std::make_pair(-1, vector<uint8_t>())){
@@ -52,6 +349,57 @@ RGY_ERR RGYHDR10Plus::init(const tstring &inputJson) {
         return RGY_ERR_NOT_FOUND;
     }
     m_inputJson = inputJson;
+    auto err = parseJson(inputJson);
+    if (err == RGY_ERR_UNSUPPORTED) {
+        //内蔵のパーサで扱えない形式の場合はhdr10plus_genを使用する
+        err = initExternalGen(inputJson);
+    }
+    return err;
+}
+
+RGY_ERR RGYHDR10Plus::parseJson(const tstring &inputJson) {
+    RGYFileMap fileMap;
+    if (!fileMap.open(inputJson)) {
+        return RGY_ERR_FILE_OPEN;
+    }
+    m_payloads.clear();
+    m_offsets.clear();
+    m_offsets.push_back(0);
+
+    bool unsupported = false;
+    bool sceneInfoFound = false;
+    RGYHDR10PlusJsonReader reader((const char *)fileMap.data(), fileMap.size());
+    reader.skipBOM();
+    const bool ret = reader.readObject([&](const std::string& key) {
+        if (key != "SceneInfo") {
+            return reader.skipValue();
+        }
+        sceneInfoFound = true;
+        // 1要素が1フレームに対応する
+        return reader.readArray([&]() {
+            RGYHDR10PlusFrameParam prm;
+            if (!hdr10plus_read_scene_info(reader, prm)) {
+                return false;
+            }
+            if (!hdr10plus_gen_payload(m_payloads, prm)) {
+                unsupported = true;
+                return false;
+            }
+            m_offsets.push_back((uint32_t)m_payloads.size());
+            return true;
+        });
+    });
+    if (unsupported || !ret || !sceneInfoFound) {
+        m_payloads.clear();
+        m_offsets.clear();
+        return RGY_ERR_UNSUPPORTED;
+    }
+    m_payloads.shrink_to_fit();
+    m_offsets.shrink_to_fit();
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR RGYHDR10Plus::initExternalGen(const tstring &inputJson) {
 #if defined(_WIN32) || defined(_WIN64)
     tstring HDR10PlusGenExePath = getExeDir() + _T("\\") + HDR10PLUS_GEN_EXE_NAME;
 #else
@@ -89,6 +437,17 @@ RGY_ERR RGYHDR10Plus::init(const tstring &inputJson) {
 }
 
 const vector<uint8_t> *RGYHDR10Plus::getData(int iframe) {
+    if (m_offsets.size() > 0) {
+        //内蔵のパーサで生成したデータは、フレーム番号から直接参照できる
+        if (iframe < 0 || iframe >= frameCount()) {
+            return nullptr;
+        }
+        if (m_buffer.first != iframe) {
+            m_buffer.second.assign(m_payloads.begin() + m_offsets[iframe], m_payloads.begin() + m_offsets[iframe + 1]);
+            m_buffer.first = iframe;
+        }
+        return &m_buffer.second;
+    }
     if (!m_fpStdOut) {
         return nullptr;
     }
@@ -44,8 +44,18 @@ public:
     RGY_ERR init(const tstring& inputJson);
     const vector<uint8_t> *getData(int iframe);
     const tstring &inputJson() const { return m_inputJson; };
+    //hdr10plus_genを使用しているか (内蔵のパーサで扱えない形式の場合)
+    bool useExternalGen() const { return (bool)m_proc; }
+    int frameCount() const { return (m_offsets.size() > 0) ? (int)m_offsets.size() - 1 : 0; }
 protected:
+    RGY_ERR parseJson(const tstring& inputJson);
+    RGY_ERR initExternalGen(const tstring& inputJson);
+
     tstring m_inputJson;
+    //内蔵のパーサで生成した各フレームのITU-T T.35 payload
+    //フレームiのデータは m_payloads[m_offsets[i]] - m_payloads[m_offsets[i+1]]
+    std::vector<uint8_t> m_payloads;
+    std::vector<uint32_t> m_offsets;
     std::unique_ptr<RGYPipeProcess> m_proc;
     ProcessPipe m_pipes;
     std::unique_ptr<FILE, decltype(&fclose)> m_fpStdOut;
@@ -29,6 +29,7 @@
 #include <iostream>
 #include <fstream>
 #include <set>
+#include <algorithm>
 #include "rgy_input.h"
 #include "rgy_filesystem.h"
 #include "cpu_info.h"
@@ -80,7 +81,6 @@ const char *csp_rgy_to_y4mheader(const RGY_CSP csp) {
 }
 
 RGYConvertCSPPrm::RGYConvertCSPPrm() :
-    abort(false),
     dst(nullptr),
     src(nullptr),
     interlaced(false),
@@ -94,6 +94,125 @@ RGYConvertCSPPrm::RGYConvertCSPPrm() :
 
 }
 
+std::shared_ptr<RGYConvertCSPThreadPool> RGYConvertCSPThreadPool::get(const RGYParamThread& threadParam) {
+    static std::mutex mtxPools;
+    static std::vector<std::pair<RGYParamThread, std::weak_ptr<RGYConvertCSPThreadPool>>> pools;
+    std::lock_guard<std::mutex> lock(mtxPools);
+    std::shared_ptr<RGYConvertCSPThreadPool> pool;
+    for (auto it = pools.begin(); it != pools.end();) {
+        auto p = it->second.lock();
+        if (!p) {
+            it = pools.erase(it);
+            continue;
+        }
+        if (it->first == threadParam) {
+            pool = p;
+        }
+        it++;
+    }
+    if (!pool) {
+        pool = std::make_shared<RGYConvertCSPThreadPool>(threadParam);
+        pools.push_back(std::make_pair(threadParam, pool));
+    }
+    return pool;
+}
+
+RGYConvertCSPThreadPool::RGYConvertCSPThreadPool(const RGYParamThread& threadParam) :
+    m_threadParam(threadParam),
+    m_th(),
+    m_mtx(),
+    m_cvJob(),
+    m_cvFin(),
+    m_jobs(),
+    m_abort(false) {
+}
+
+RGYConvertCSPThreadPool::~RGYConvertCSPThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_abort = true;
+    }
+    m_cvJob.notify_all();
+    for (auto& th : m_th) {
+        th.join();
+    }
+    m_th.clear();
+}
+
+void RGYConvertCSPThreadPool::reserve(int threads) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    while ((int)m_th.size() < threads - 1) {
+        m_th.push_back(std::thread(&RGYConvertCSPThreadPool::threadFunc, this));
+    }
+}
+
+static void run_convert_csp_stripe(const RGYConvertCSPThreadPool::Job *job, int stripe) {
+    const auto prm = job->prm;
+    job->csp->func[prm->interlaced](prm->dst, prm->src,
+        prm->width, prm->src_y_pitch_byte, prm->src_uv_pitch_byte, prm->dst_y_pitch_byte,
+        prm->height, prm->dst_height, stripe, job->threadN, prm->crop);
+}
+
+bool RGYConvertCSPThreadPool::takeStripe(Job **job, int *stripe) {
+    if (m_jobs.empty()) {
+        return false;
+    }
+    *job = m_jobs.front();
+    *stripe = (*job)->next++;
+    if ((*job)->next >= (*job)->threadN) {
+        m_jobs.pop_front();
+    }
+    return true;
+}
+
+void RGYConvertCSPThreadPool::finStripe(Job *job) {
+    //投入したスレッドはm_mtxを取得するまで戻らないので、ここでjobを参照しても問題ない
+    if (--job->remain == 0) {
+        m_cvFin.notify_all();
+    }
+}
+
+void RGYConvertCSPThreadPool::run(Job *job) {
+    job->next = 0;
+    job->remain = job->threadN;
+    std::unique_lock<std::mutex> lock(m_mtx);
+    m_jobs.push_back(job);
+    for (int i = 1; i < job->threadN; i++) {
+        m_cvJob.notify_one();
+    }
+    //投入したスレッドも、自分のジョブのストライプを処理する
+    while (job->next < job->threadN) {
+        const int stripe = job->next++;
+        if (job->next >= job->threadN) {
+            m_jobs.erase(std::find(m_jobs.begin(), m_jobs.end(), job));
+        }
+        lock.unlock();
+        run_convert_csp_stripe(job, stripe);
+        lock.lock();
+        finStripe(job);
+    }
+    m_cvFin.wait(lock, [job]() { return job->remain == 0; });
+}
+
+void RGYConvertCSPThreadPool::threadFunc() {
+    m_threadParam.apply(GetCurrentThread());
+    std::unique_lock<std::mutex> lock(m_mtx);
+    for (;;) {
+        m_cvJob.wait(lock, [this]() { return m_abort || !m_jobs.empty(); });
+        if (m_abort) {
+            break;
+        }
+        Job *job = nullptr;
+        int stripe = 0;
+        if (!takeStripe(&job, &stripe)) {
+            continue;
+        }
+        lock.unlock();
+        run_convert_csp_stripe(job, stripe);
+        lock.lock();
+        finStripe(job);
+    }
+}
 
 RGYConvertCSP::RGYConvertCSP() : RGYConvertCSP(0, RGYParamThread()) {
 }
@@ -104,22 +223,12 @@ RGYConvertCSP::RGYConvertCSP(int threads, RGYParamThread threadParam) :
     m_csp_to(RGY_CSP_NA),
     m_uv_only(false),
     m_threads(threads),
-    m_th(), m_heStart(), m_heFin(), m_heFinCopy(),
+    m_pool(),
     m_threadParam(threadParam), m_prm() {
 };
 
 RGYConvertCSP::~RGYConvertCSP() {
-    m_prm.abort = true;
-    for (size_t i = 0; i < m_heStart.size(); i++) {
-        SetEvent(m_heStart[i].get());
-    }
-    for (size_t i = 0; i < m_th.size(); i++) {
-        m_th[i].join();
-    }
-    m_heFinCopy.clear();
-    m_heStart.clear();
-    m_heFin.clear();
-    m_th.clear();
+    m_pool.reset();
 };
 const ConvertCSP *RGYConvertCSP::getFunc(RGY_CSP csp_from, RGY_CSP csp_to, bool uv_only, RGY_SIMD simd) {
     if (m_csp == nullptr
@@ -138,30 +247,16 @@ int RGYConvertCSP::run(int interlaced, void **dst, const void **src, int width,
         const int max = (m_csp->simd == RGY_SIMD::NONE) ? 8 : 4;
         m_threads = (dst_y_pitch_byte % 128 != 0) ? 1 : std::min(max, ((int)get_cpu_info().physical_cores + div) / div);
     }
-    if (m_threads > 1 && m_th.size() == 0) {
-        m_heFinCopy.clear();
-        m_heStart.clear();
-        m_heFin.clear();
-        for (int ith = 0; ith < m_threads; ith++) {
-            auto heStart = std::unique_ptr<void, handle_deleter>(CreateEvent(nullptr, false, false, nullptr), handle_deleter());
-            auto heFin = std::unique_ptr<void, handle_deleter>(CreateEvent(nullptr, false, false, nullptr), handle_deleter());
-            m_th.push_back(std::thread([heStart = heStart.get(), heFin = heFin.get(), ithId = ith, threadN = m_threads, threadParam = m_threadParam, prm = &m_prm, cspfunc = &m_csp]() {
-                threadParam.apply(GetCurrentThread());
-                WaitForSingleObject((HANDLE)heStart, INFINITE);
-                while (!prm->abort) {
-                    (*cspfunc)->func[prm->interlaced](prm->dst, prm->src,
-                        prm->width, prm->src_y_pitch_byte, prm->src_uv_pitch_byte, prm->dst_y_pitch_byte,
-                        prm->height, prm->dst_height, ithId, threadN, prm->crop);
-                    SetEvent((HANDLE)heFin);
-                    WaitForSingleObject((HANDLE)heStart, INFINITE);
-                }
-            }));
-            m_heFinCopy.push_back(heFin.get());
-            m_heStart.push_back(std::move(heStart));
-            m_heFin.push_back(std::move(heFin));
-        }
+    if (m_threads > 1 && !m_pool) {
+        m_pool = RGYConvertCSPThreadPool::get(m_threadParam);
+        m_pool->reserve(m_threads);
+    }
+    if (m_threads == 1) {
+        m_csp->func[interlaced](dst, src,
+            width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte,
+            height, dst_height, 0, 1, crop);
+        return 0;
     }
-    m_prm.abort = false;
     m_prm.interlaced = interlaced;
     m_prm.dst = dst;
     m_prm.src = src;
@@ -172,17 +267,8 @@ int RGYConvertCSP::run(int interlaced, void **dst, const void **src, int width,
     m_prm.height = height;
     m_prm.dst_height = dst_height;
     m_prm.crop = crop;
-    for (size_t i = 0; i < m_heStart.size(); i++) {
-        SetEvent(m_heStart[i].get());
-    }
-    if (m_threads == 1) {
-        m_csp->func[interlaced](dst, src,
-            width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte,
-            height, dst_height, 0, 1, crop);
-    }
-    if (m_th.size() > 0) {
-        WaitForMultipleObjects((uint32_t)m_heFinCopy.size(), m_heFinCopy.data(), TRUE, INFINITE);
-    }
+    RGYConvertCSPThreadPool::Job job = { m_csp, &m_prm, m_threads, 0, 0 };
+    m_pool->run(&job);
     return 0;
 }
 
@@ -629,6 +715,7 @@ RGY_ERR initReaders(
         inputInfoAVCuvid.qpTableListRef = qpTableListRef;
         inputInfoAVCuvid.inputOpt = common->inputOpt;
         inputInfoAVCuvid.lowLatency = ctrl->lowLatency;
+        inputInfoAVCuvid.readAheadMB = ctrl->inputReadAheadMB;
         inputInfoAVCuvid.hevcbsf = common->hevcbsf;
         pInputPrm = &inputInfoAVCuvid;
         log->write(RGY_LOG_DEBUG, RGY_LOGT_IN, _T("avhw reader selected.\n"));
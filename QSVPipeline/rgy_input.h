@@ -31,6 +31,9 @@
 
 #include <memory>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 #include "rgy_osdep.h"
 #include "rgy_tchar.h"
 #include "rgy_log.h"
@@ -121,7 +124,6 @@ static const char *trackMediaTypeStr(int trackID) {
 #endif //#if ENABLE_AVSW_READER
 
 struct RGYConvertCSPPrm {
-    bool abort;
     void **dst;
     const void **src;
     int interlaced;
@@ -136,6 +138,42 @@ struct RGYConvertCSPPrm {
     RGYConvertCSPPrm();
 };
 
+//色空間変換用のスレッドプール
+//RGYParamThreadごとにプロセス全体で共有し、各RGYConvertCSPはフレームをストライプ単位に分割して投入する
+//投入したスレッドもストライプの処理に参加し、空いているスレッドが残りのストライプを順に取り出して処理する
+class RGYConvertCSPThreadPool {
+public:
+    struct Job {
+        const ConvertCSP *csp;
+        const RGYConvertCSPPrm *prm;
+        int threadN;   //ストライプ数
+        int next;      //次に処理するストライプ
+        int remain;    //処理が終了していないストライプ数
+    };
+    //threadParamに対応するプールを取得する (なければ作成する)
+    static std::shared_ptr<RGYConvertCSPThreadPool> get(const RGYParamThread& threadParam);
+
+    RGYConvertCSPThreadPool(const RGYParamThread& threadParam);
+    ~RGYConvertCSPThreadPool();
+    //ワーカースレッドがthreads-1以上になるようにする (投入したスレッドも処理に参加するため)
+    void reserve(int threads);
+    //ジョブを投入し、すべてのストライプの処理が終わるまで待機する
+    void run(Job *job);
+protected:
+    //mutexを取得した状態で呼ぶこと
+    bool takeStripe(Job **job, int *stripe);
+    void finStripe(Job *job);
+    void threadFunc();
+
+    RGYParamThread m_threadParam;
+    std::vector<std::thread> m_th;
+    std::mutex m_mtx;
+    std::condition_variable m_cvJob; //ジョブが追加された
+    std::condition_variable m_cvFin; //ジョブが終了した
+    std::deque<Job *> m_jobs;
+    bool m_abort;
+};
+
 class RGYConvertCSP {
 private:
     const ConvertCSP *m_csp;
@@ -143,10 +181,7 @@ private:
     RGY_CSP m_csp_to;
     bool m_uv_only;
     int m_threads;
-    std::vector<std::thread> m_th;
-    std::vector<std::unique_ptr<void, handle_deleter>> m_heStart;
-    std::vector<std::unique_ptr<void, handle_deleter>> m_heFin;
-    std::vector<HANDLE> m_heFinCopy;
+    std::shared_ptr<RGYConvertCSPThreadPool> m_pool;
     RGYParamThread m_threadParam;
     RGYConvertCSPPrm m_prm;
 public:
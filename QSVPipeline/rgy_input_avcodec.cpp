@@ -42,6 +42,7 @@
 #include "rgy_avlog.h"
 #include "rgy_filesystem.h"
 #include "rgy_language.h"
+#include "rgy_trace.h"
 
 
 #if ENABLE_AVSW_READER
@@ -59,6 +60,19 @@ static int64_t funcSeek(void *opaque, int64_t offset, int whence) {
     return reader->seek(offset, whence);
 }
 #endif //USE_CUSTOM_INPUT
+static int funcReadAheadRead(void *opaque, uint8_t *buf, int buf_size) {
+    RGYReadAhead *readAhead = reinterpret_cast<RGYReadAhead *>(opaque);
+    const int ret = readAhead->read(buf, buf_size);
+    return (ret == 0) ? AVERROR_EOF : ((ret < 0) ? AVERROR(EIO) : ret);
+}
+static int64_t funcReadAheadSeek(void *opaque, int64_t offset, int whence) {
+    RGYReadAhead *readAhead = reinterpret_cast<RGYReadAhead *>(opaque);
+    whence &= ~AVSEEK_FORCE;
+    if (whence == AVSEEK_SIZE) {
+        return readAhead->size();
+    }
+    return readAhead->seek(offset, whence);
+}
 
 static inline void extend_array_size(VideoFrameData *dataset) {
     static int default_capacity = 8 * 1024;
@@ -114,7 +128,8 @@ RGYInputAvcodecPrm::RGYInputAvcodecPrm(RGYInputPrm base) :
     qpTableListRef(nullptr),
     lowLatency(false),
     inputOpt(),
-    hevcbsf(RGYHEVCBsf::INTERNAL) {
+    hevcbsf(RGYHEVCBsf::INTERNAL),
+    readAheadMB(0) {
 
 }
 
@@ -123,6 +138,8 @@ RGYInputAvcodec::RGYInputAvcodec() :
     m_logFramePosList(),
     m_fpPacketList(),
     m_hevcMp42AnnexbBuffer(),
+    m_nalList(),
+    m_readAhead(),
     m_cap2ass() {
     memset(&m_Demux.format, 0, sizeof(m_Demux.format));
     memset(&m_Demux.video,  0, sizeof(m_Demux.video));
@@ -164,6 +181,15 @@ void RGYInputAvcodec::CloseFormat(AVDemuxFormat *format) {
         fclose(format->fpInput);
         AddMessage(RGY_LOG_DEBUG, _T("Closed file pointer.\n"));
     }
+    if (m_readAhead) {
+        if (format->formatCtx && format->formatCtx->pb) {
+            av_freep(&format->formatCtx->pb->buffer);
+            avio_context_free(&format->formatCtx->pb);
+        }
+        AddMessage(RGY_LOG_DEBUG, _T("%s.\n"), m_readAhead->stats().c_str());
+        m_readAhead.reset();
+        AddMessage(RGY_LOG_DEBUG, _T("Closed read-ahead.\n"));
+    }
     if (format->formatCtx) {
         AddMessage(RGY_LOG_DEBUG, _T("Closing avformat context...\n"));
         avformat_close_input(&format->formatCtx);
@@ -1153,7 +1179,8 @@ RGY_ERR RGYInputAvcodec::parseHDR10plus(AVPacket *pkt) {
     if (m_Demux.video.stream->codecpar->codec_id != AV_CODEC_ID_HEVC) {
         return RGY_ERR_NONE;
     }
-    const auto nal_list = m_Demux.video.parse_nal_hevc(pkt->data, pkt->size);
+    auto& nal_list = m_nalList;
+    m_Demux.video.parse_nal_hevc(nal_list, pkt->data, pkt->size);
     for (const auto& nal_unit : nal_list) {
         if (nal_unit.type != NALU_HEVC_PREFIX_SEI) {
             continue;
@@ -1370,6 +1397,30 @@ RGY_ERR RGYInputAvcodec::initFormatCtx(const TCHAR *strFileName, const RGYInputA
             m_cap2ass.disable();
         }
     }
+    if (input_prm->readAheadMB > 0 && m_Demux.format.formatCtx->pb == nullptr) {
+        //専用スレッドで入力を先読みし、av_read_frameが読み込み待ちで止まらないようにする
+        const bool isStdin = 0 == _tcscmp(strFileName, _T("-"));
+        const bool isFile = !m_Demux.format.isPipe && !usingAVProtocols(filename_char, 0);
+        if ((isStdin || isFile) && input_prm->inputOpt.size() == 0 && (inFormat == nullptr || !(inFormat->flags & (AVFMT_NEEDNUMBER | AVFMT_NOFILE)))) {
+            m_readAhead = std::make_unique<RGYReadAhead>();
+            auto err = m_readAhead->open(strFileName, (size_t)input_prm->readAheadMB << 20, (input_prm->queueInfo) ? &input_prm->queueInfo->usage_read_ahead : nullptr);
+            if (err != RGY_ERR_NONE) {
+                AddMessage(RGY_LOG_ERROR, _T("failed to open input file \"%s\" for read-ahead: %s.\n"), strFileName, get_err_mes(err));
+                m_readAhead.reset();
+                return err;
+            }
+            m_Demux.format.inputBufferSize = 64 * 1024;
+            m_Demux.format.inputBuffer = (char *)av_malloc(m_Demux.format.inputBufferSize);
+            if (NULL == (m_Demux.format.formatCtx->pb = avio_alloc_context((unsigned char *)m_Demux.format.inputBuffer, m_Demux.format.inputBufferSize, 0,
+                m_readAhead.get(), funcReadAheadRead, nullptr, (m_readAhead->seekable()) ? funcReadAheadSeek : nullptr))) {
+                AddMessage(RGY_LOG_ERROR, _T("failed to alloc avio context.\n"));
+                return RGY_ERR_NULL_PTR;
+            }
+            AddMessage(RGY_LOG_DEBUG, _T("input read-ahead enabled: %d MB%s.\n"), input_prm->readAheadMB, (m_readAhead->seekable()) ? _T("") : _T(" (not seekable)"));
+        } else {
+            AddMessage(RGY_LOG_WARN, _T("--input-read-ahead only supported when input is file or stdin, disabled.\n"));
+        }
+    }
     //ファイルのオープン
     if ((ret = avformat_open_input(&(m_Demux.format.formatCtx), filename_char.c_str(), inFormat, &m_Demux.format.formatOptions)) != 0) {
         AddMessage(RGY_LOG_ERROR, _T("error opening file \"%s\": %s\n"), char_to_tstring(filename_char, CP_UTF8).c_str(), qsv_av_err2str(ret).c_str());
@@ -2278,31 +2329,30 @@ int RGYInputAvcodec::getVideoFrameIdx(int64_t pts, AVRational timebase, int iSta
     const int framePosCount = m_Demux.frames.frameNum();
     const AVRational vid_pkt_timebase = (m_Demux.video.stream) ? m_Demux.video.stream->time_base : av_inv_q(m_Demux.video.nAvgFramerate);
     if (av_cmp_q(timebase, vid_pkt_timebase) == 0) {
-        for (int i = (std::max)(0, iStart); i < framePosCount; i++) {
+        //pts <= demux.videoFramePts[i]となる最初のフレームを探す
+        int i = m_Demux.frames.findIndex((std::max)(0, iStart), [pts](int64_t framePts) { return pts <= framePts; });
+        if (i >= 0) {
             if (pts == m_Demux.frames.list(i).pts) {
                 return i;
             }
             //pts < demux.videoFramePts[i]であるなら、その前のフレームを返す
-            if (pts < m_Demux.frames.list(i).pts) {
-                //0フレーム目なら、仮想的に -1 フレーム目を考えて、それよりも前かどうかを判定する
-                //-2を返すことで、そのパケットは削除される
-                if (i == 0 && pts < m_Demux.frames.list(i).pts - m_Demux.frames.list(i).duration) {
-                    i--;
-                }
-                return i-1;
+            //0フレーム目なら、仮想的に -1 フレーム目を考えて、それよりも前かどうかを判定する
+            //-2を返すことで、そのパケットは削除される
+            if (i == 0 && pts < m_Demux.frames.list(i).pts - m_Demux.frames.list(i).duration) {
+                i--;
             }
+            return i-1;
         }
     } else {
-        for (int i = (std::max)(0, iStart); i < framePosCount; i++) {
-            //pts < demux.videoFramePts[i]であるなら、その前のフレームを返す
-            if (av_compare_ts(pts, timebase, m_Demux.frames.list(i).pts, vid_pkt_timebase) < 0) {
-                //0フレーム目なら、仮想的に -1 フレーム目を考えて、それよりも前かどうかを判定する
-                //-2を返すことで、そのパケットは削除される
-                if (i == 0 && av_compare_ts(pts, timebase, m_Demux.frames.list(i).pts - m_Demux.frames.list(i).duration, vid_pkt_timebase) < 0) {
-                    i--;
-                }
-                return i-1;
+        //pts < demux.videoFramePts[i]となる最初のフレームを探し、その前のフレームを返す
+        int i = m_Demux.frames.findIndex((std::max)(0, iStart), [pts, timebase, vid_pkt_timebase](int64_t framePts) { return av_compare_ts(pts, timebase, framePts, vid_pkt_timebase) < 0; });
+        if (i >= 0) {
+            //0フレーム目なら、仮想的に -1 フレーム目を考えて、それよりも前かどうかを判定する
+            //-2を返すことで、そのパケットは削除される
+            if (i == 0 && av_compare_ts(pts, timebase, m_Demux.frames.list(i).pts - m_Demux.frames.list(i).duration, vid_pkt_timebase) < 0) {
+                i--;
             }
+            return i-1;
         }
     }
     return framePosCount;
@@ -3092,7 +3142,9 @@ void RGYInputAvcodec::setOutputVideoInfo(int w, int h, int sar_x, int sar_y, boo
 RGY_ERR RGYInputAvcodec::ThreadFuncRead(RGYParamThread threadParam) {
     threadParam.apply(GetCurrentThread());
     AddMessage(RGY_LOG_DEBUG, _T("Set input thread param: %s.\n"), threadParam.desc().c_str());
+    RGYTrace::get().setThreadName(_T("input"));
     while (!m_Demux.thread.bAbortInput) {
+        RGYTraceScope trace(RGYTraceCat::INPUT, _T("demux"));
         auto [ret, pkt] = getSample();
         if (ret) {
             break;
@@ -37,10 +37,12 @@
 #include "rgy_queue.h"
 #include "rgy_perf_monitor.h"
 #include "rgy_bitstream.h"
+#include "rgy_read_ahead.h"
 #include "convert_csp.h"
 #include <deque>
 #include <atomic>
 #include <thread>
+#include <mutex>
 #include <cassert>
 
 #if (defined(_WIN32) || defined(_WIN64))
@@ -164,7 +166,10 @@ public:
         m_maxPts(0),
         m_PAFFRewind(0),
         m_ptsWrapArroundThreshold(0xFFFFFFFF),
-        m_fpDebugCopyFrameData() {
+        m_fpDebugCopyFrameData(),
+        m_ptsIndexMtx(),
+        m_ptsRuns(),
+        m_ptsIndexNum(0) {
         m_list.init();
         static_assert(sizeof(m_list.get()[0]) == sizeof(m_list.get()->data), "FramePos must not have padding.");
     };
@@ -232,6 +237,7 @@ public:
         m_ptsWrapArroundThreshold = 0xFFFFFFFF;
         m_fpDebugCopyFrameData.reset();
         m_list.init();
+        resetPtsIndex();
     }
     //ここまで計算したdurationを返す
     int64_t duration() const {
@@ -267,44 +273,58 @@ public:
         m_streamPtsStatus = RGY_PTS_UNKNOWN;
         m_PAFFRewind = 0;
         m_ptsWrapArroundThreshold = 0xFFFFFFFF;
+        resetPtsIndex();
     }
     RGYPtsStatus getStreamPtsStatus() const {
         return m_streamPtsStatus;
     }
+    //ptsの一致するフレームの情報のコピーを返す
+    //*lastIndexより後ろから探索し、見つからなければ最初から探索する
+    //最初からの探索で一致するものがなければ、ptsの直前のフレームを返す
     FramePos findpts(int64_t pts, uint32_t *lastIndex) {
-        FramePos pos_last = framePosInit();
-        for (uint32_t index = *lastIndex + 1; ; index++) {
-            FramePos pos = framePosInit();
-            if (!m_list.copy(&pos, index)) {
-                break;
-            }
-            if (pts == pos.pts) {
+        std::lock_guard<std::mutex> lock(m_ptsIndexMtx);
+        const auto ptsAtLeast = [pts](int64_t framePts) { return pts <= framePts; };
+        FramePos pos = framePosInit();
+        //通常は次のフレームが一致する
+        if (m_list.copy(&pos, *lastIndex + 1) && pos.pts == pts) {
+            *lastIndex = *lastIndex + 1;
+            return pos;
+        }
+        for (int index = findIndexNoLock(*lastIndex + 1, ptsAtLeast); index >= 0; ) {
+            if (m_list.copy(&pos, index) && pos.pts == pts) {
                 *lastIndex = index;
                 return pos;
             }
-            pos_last = pos;
+            //ptsが単調増加する区間内には、もう一致するものはないので次の区間から探索する
+            index = findIndexNoLock(nextPtsRunStart(index), ptsAtLeast);
         }
         //最初から探索
-        for (uint32_t index = 0; ; index++) {
-            FramePos pos = framePosInit();
-            if (!m_list.copy(&pos, index)) {
-                break;
-            }
+        const int index = findIndexNoLock(0, ptsAtLeast);
+        if (index >= 0) {
+            m_list.copy(&pos, index);
             if (pts == pos.pts) {
                 *lastIndex = index;
                 return pos;
             }
             //pts < demux.videoFramePts[i]であるなら、その前のフレームを返す
-            if (pts < pos.pts) {
-                *lastIndex = index-1;
-                return pos_last;
+            *lastIndex = index-1;
+            FramePos pos_last = framePosInit();
+            if (index > 0) {
+                m_list.copy(&pos_last, index-1);
             }
-            pos_last = pos;
+            return pos_last;
         }
         //エラー
         FramePos poserr = framePosInit();
         return poserr;
     }
+    //start以降で、pred(pts)を最初に満たすフレームのインデックスを返す (見つからなければ-1)
+    //pred(pts)はptsについて単調 (あるpts以上でtrue) であること
+    template<typename Pred>
+    int findIndex(uint32_t start, Pred pred) {
+        std::lock_guard<std::mutex> lock(m_ptsIndexMtx);
+        return findIndexNoLock(start, pred);
+    }
     //FramePosを追加し、内部状態を変更する
     void add(const FramePos& pos) {
         m_list.push(pos);
@@ -324,6 +344,7 @@ public:
             setPocAndFix(nListSize);
         }
         calcDuration();
+        updatePtsIndex();
     };
     //pocの一致するフレームの情報のコピーを返す
     FramePos copy(int poc, uint32_t *lastIndex) {
@@ -385,6 +406,7 @@ public:
         m_PAFFRewind = 0;
         m_duration = total_duration;
         m_durationNum = m_nextFixNumIndex;
+        updatePtsIndex();
     }
     bool isEof() const {
         return m_inputFin;
@@ -494,6 +516,7 @@ public:
         }
         sortPts(m_nextFixNumIndex, nInputPacketCount - m_nextFixNumIndex);
         setPocAndFix(nInputPacketCount);
+        updatePtsIndex();
         if (m_nextFixNumIndex > 1) {
             int64_t pts0 = m_list[0].data.pts;
             int64_t pts1 = m_list[1 + (m_list[0].data.poc == -1)].data.pts;
@@ -642,7 +665,11 @@ protected:
             if (m_list[m_nextFixNumIndex].data.pts < m_firstKeyframePts //ソートの先頭のptsが塚下キーフレームの先頭のptsよりも小さいことがある(opengop)
                 && m_nextFixNumIndex <= 16) { //wrap arroundの場合は除く
                 //これはフレームリストから取り除く
+                //インデックスがずれるので、ptsの索引も作り直す
+                std::lock_guard<std::mutex> lock(m_ptsIndexMtx);
                 m_list.pop();
+                m_ptsRuns.clear();
+                m_ptsIndexNum = 0;
                 m_nextFixNumIndex--;
                 nSortFixedSize--;
             } else {
@@ -661,6 +688,74 @@ protected:
             m_PAFFRewind = 1;
         }
     }
+    //ptsの確定した範囲 ([0, m_nextFixNumIndex)) を、ptsの索引に追加する
+    // !! push側のスレッドからのみ呼ぶこと !!
+    void updatePtsIndex() {
+        std::lock_guard<std::mutex> lock(m_ptsIndexMtx);
+        const uint32_t fixedNum = (uint32_t)(std::min)(m_nextFixNumIndex, (int)m_list.size());
+        if (fixedNum < m_ptsIndexNum) {
+            //確定した範囲が戻ることは通常ないが、念のため作り直す
+            m_ptsRuns.clear();
+            m_ptsIndexNum = 0;
+        }
+        for (; m_ptsIndexNum < fixedNum; m_ptsIndexNum++) {
+            const auto pts = m_list[m_ptsIndexNum].data.pts;
+            if (m_ptsRuns.size() == 0 || pts < m_ptsRuns.back().ptsLast) {
+                //ptsが戻ったら新しい区間とする (wrap arroundやptsの飛びなど)
+                m_ptsRuns.push_back({ m_ptsIndexNum, pts });
+            } else {
+                m_ptsRuns.back().ptsLast = pts;
+            }
+        }
+    }
+    void resetPtsIndex() {
+        std::lock_guard<std::mutex> lock(m_ptsIndexMtx);
+        m_ptsRuns.clear();
+        m_ptsIndexNum = 0;
+    }
+    //indexを含む区間の次の区間の先頭を返す (索引の範囲外ならindex+1)
+    //m_ptsIndexMtxをロックした状態で呼ぶこと
+    uint32_t nextPtsRunStart(uint32_t index) const {
+        if (index >= m_ptsIndexNum) {
+            return index + 1;
+        }
+        const auto it = std::upper_bound(m_ptsRuns.begin(), m_ptsRuns.end(), index, [](uint32_t idx, const PtsRun& run) { return idx < run.start; });
+        return (it != m_ptsRuns.end()) ? it->start : m_ptsIndexNum;
+    }
+    //m_ptsIndexMtxをロックした状態で呼ぶこと
+    template<typename Pred>
+    int findIndexNoLock(uint32_t start, Pred pred) {
+        FramePos pos = framePosInit();
+        //索引のある範囲は、区間ごとに二分探索する
+        if (start < m_ptsIndexNum) {
+            auto it = std::upper_bound(m_ptsRuns.begin(), m_ptsRuns.end(), start, [](uint32_t idx, const PtsRun& run) { return idx < run.start; }) - 1;
+            for (; it != m_ptsRuns.end(); it++) {
+                if (!pred(it->ptsLast)) {
+                    continue; //区間内に条件を満たすものはない
+                }
+                uint32_t lo = (std::max)(start, it->start);
+                uint32_t hi = ((it + 1) != m_ptsRuns.end()) ? (it + 1)->start - 1 : m_ptsIndexNum - 1; //pred(pts[hi])はtrue
+                while (lo < hi) {
+                    const uint32_t mid = lo + (hi - lo) / 2;
+                    m_list.copy(&pos, mid);
+                    if (pred(pos.pts)) {
+                        hi = mid;
+                    } else {
+                        lo = mid + 1;
+                    }
+                }
+                return (int)lo;
+            }
+            start = m_ptsIndexNum;
+        }
+        //ptsの確定していない範囲は順に探索する
+        for (uint32_t index = start; m_list.copy(&pos, index); index++) {
+            if (pred(pos.pts)) {
+                return (int)index;
+            }
+        }
+        return -1;
+    }
 protected:
     double m_frameDuration; //CFRを仮定する際のフレーム長 (RGY_PTS_ALL_INVALID, RGY_PTS_NONKEY_INVALID, RGY_PTS_NONKEY_INVALID時有効)
     RGYQueueMPMP<FramePos, 1> m_list; //内部データサイズとFramePosのデータサイズを一致させるため、alignを1に設定
@@ -675,6 +770,16 @@ protected:
     int m_PAFFRewind; //PAFFのdurationを確定させるため、戻した枚数
     uint32_t m_ptsWrapArroundThreshold; //wrap arroundを判定する閾値
     unique_ptr<FILE, fp_deleter> m_fpDebugCopyFrameData; //copyのデバッグ用
+
+    //ptsの索引
+    //ptsの確定した範囲を、ptsが単調増加する区間に分けて管理し、区間ごとに二分探索する
+    struct PtsRun {
+        uint32_t start;  //区間の先頭のインデックス
+        int64_t ptsLast; //区間の最後 (最大) のpts
+    };
+    std::mutex m_ptsIndexMtx;      //m_ptsRuns, m_ptsIndexNum操作用のロック
+    std::vector<PtsRun> m_ptsRuns; //ptsが単調増加する区間のリスト
+    uint32_t m_ptsIndexNum;        //索引に追加したフレーム数
 };
 
 
@@ -762,7 +867,7 @@ typedef struct AVDemuxer {
     vector<AVDemuxStream>    stream;
     vector<const AVChapter*> chapter;
     AVDemuxThread            thread;
-    RGYQueueMPMP<AVPacket*>  qVideoPkt;
+    RGYQueueRingSPSC<AVPacket*> qVideoPkt;
     deque<AVPacket*>         qStreamPktL1;
     RGYQueueMPMP<AVPacket*>  qStreamPktL2;
 } AVDemuxer;
@@ -988,6 +1093,7 @@ public:
     bool           lowLatency;
     RGYOptList     inputOpt;                //入力オプション
     RGYHEVCBsf     hevcbsf;
+    int            readAheadMB;             //入力ファイルの先読みバッファサイズ (0で使用しない)
 
     RGYInputAvcodecPrm(RGYInputPrm base);
     virtual ~RGYInputAvcodecPrm() {};
@@ -1165,6 +1271,8 @@ protected:
     tstring          m_logFramePosList;           //FramePosListの内容を入力終了時に出力する (デバッグ用)
     std::unique_ptr<FILE, fp_deleter> m_fpPacketList; // 読み取ったパケット情報を出力するファイル
     vector<uint8_t>  m_hevcMp42AnnexbBuffer;       //HEVCのmp4->AnnexB簡易変換用バッファ
+    vector<nal_info> m_nalList;                    //nal unit分解結果 (パケットごとに使いまわす)
+    std::unique_ptr<RGYReadAhead> m_readAhead;     //入力ファイルの先読み (--input-read-ahead)
     AVCaption2Ass    m_cap2ass;
 };
 
@@ -27,10 +27,18 @@
 
 #include <sstream>
 #include <fcntl.h>
+#if !(defined(_WIN32) || defined(_WIN64))
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include "rgy_input_raw.h"
 
 #if ENABLE_RAW_READER
 
+static const int RAW_MAP_READ_AHEAD_FRAMES = 4; //ファイルをマップして読み込む際に先読みするフレーム数
+static const int RAW_MAP_TAIL_MARGIN = 64;      //SIMDでの読み込みがマップ領域を超えないようにするための余白
+
 RGY_ERR RGYInputRaw::ParseY4MHeader(char *buf, VideoInfo *pInfo) {
     //どういうわけかCを指定しないy4mファイルが世の中にはあるようなので、
     //とりあえずデフォルトはYV12にしておく
@@ -115,7 +123,16 @@ RGY_ERR RGYInputRaw::ParseY4MHeader(char *buf, VideoInfo *pInfo) {
 RGYInputRaw::RGYInputRaw() :
     m_fSource(NULL),
     m_nBufSize(0),
-    m_pBuffer() {
+    m_pBuffer(),
+    m_mapPtr(nullptr),
+    m_mapSize(0),
+    m_mapPos(0),
+    m_mapReleased(0),
+    m_mapAhead(0),
+#if defined(_WIN32) || defined(_WIN64)
+    m_mapHandle(NULL),
+#endif
+    m_readBytes(0) {
     m_readerName = _T("raw");
 }
 
@@ -123,7 +140,102 @@ RGYInputRaw::~RGYInputRaw() {
     Close();
 }
 
+RGY_ERR RGYInputRaw::openInputMapping(uint32_t frameSize) {
+    //アドレス空間の足りない32bit環境では、ファイル全体をマップしない
+    if (sizeof(void *) < 8) {
+        return RGY_ERR_UNSUPPORTED;
+    }
+    const int64_t dataStart = _ftelli64(m_fSource);
+    if (dataStart < 0) {
+        return RGY_ERR_UNSUPPORTED;
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    HANDLE hFile = (HANDLE)_get_osfhandle(_fileno(m_fSource));
+    LARGE_INTEGER fileSize = { 0 };
+    if (hFile == INVALID_HANDLE_VALUE || !GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart <= dataStart) {
+        return RGY_ERR_UNSUPPORTED;
+    }
+    m_mapHandle = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m_mapHandle == NULL) {
+        return RGY_ERR_UNSUPPORTED;
+    }
+    m_mapPtr = (uint8_t *)MapViewOfFile(m_mapHandle, FILE_MAP_READ, 0, 0, 0);
+    if (m_mapPtr == nullptr) {
+        CloseHandle(m_mapHandle);
+        m_mapHandle = NULL;
+        return RGY_ERR_UNSUPPORTED;
+    }
+    m_mapSize = fileSize.QuadPart;
+#else
+    const int fd = fileno(m_fSource);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= dataStart) {
+        return RGY_ERR_UNSUPPORTED;
+    }
+    void *ptr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        return RGY_ERR_UNSUPPORTED;
+    }
+    madvise(ptr, (size_t)st.st_size, MADV_SEQUENTIAL);
+    m_mapPtr = (uint8_t *)ptr;
+    m_mapSize = st.st_size;
+#endif
+    m_mapPos = dataStart;
+    m_mapReleased = 0;
+    m_mapAhead = dataStart;
+    adviseInputMapping(frameSize);
+    return RGY_ERR_NONE;
+}
+
+void RGYInputRaw::closeInputMapping() {
+    if (m_mapPtr) {
+#if defined(_WIN32) || defined(_WIN64)
+        UnmapViewOfFile(m_mapPtr);
+#else
+        munmap(m_mapPtr, (size_t)m_mapSize);
+#endif
+        m_mapPtr = nullptr;
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    if (m_mapHandle) {
+        CloseHandle(m_mapHandle);
+        m_mapHandle = NULL;
+    }
+#endif
+    m_mapSize = 0;
+    m_mapPos = 0;
+    m_mapReleased = 0;
+    m_mapAhead = 0;
+}
+
+void RGYInputRaw::adviseInputMapping(uint32_t frameSize) {
+#if defined(_WIN32) || defined(_WIN64)
+    UNREFERENCED_PARAMETER(frameSize);
+#else
+    const uint64_t pageMask = ~((uint64_t)sysconf(_SC_PAGESIZE) - 1);
+    //読み終わった領域は、次のフレームの先頭を含むページの手前まで解放する
+    const uint64_t releaseEnd = m_mapPos & pageMask;
+    if (releaseEnd > m_mapReleased) {
+        madvise(m_mapPtr + m_mapReleased, (size_t)(releaseEnd - m_mapReleased), MADV_DONTNEED);
+        m_mapReleased = releaseEnd;
+    }
+    //次のRAW_MAP_READ_AHEAD_FRAMESフレーム分を先読みする
+    const uint64_t aheadEnd = std::min<uint64_t>(m_mapSize, m_mapPos + (uint64_t)frameSize * RAW_MAP_READ_AHEAD_FRAMES);
+    if (aheadEnd > m_mapAhead) {
+        const uint64_t aheadStart = m_mapAhead & pageMask;
+        madvise(m_mapPtr + aheadStart, (size_t)(aheadEnd - aheadStart), MADV_WILLNEED);
+        m_mapAhead = aheadEnd;
+    }
+#endif
+}
+
 void RGYInputRaw::Close() {
+    if (m_readBytes > 0) {
+        AddMessage(RGY_LOG_DEBUG, _T("read %.2f GB (%s).\n"),
+            m_readBytes / (double)(1024 * 1024 * 1024), (m_mapPtr) ? _T("mmap") : _T("fread"));
+    }
+    m_readBytes = 0;
+    closeInputMapping();
     if (m_fSource) {
         fclose(m_fSource);
         m_fSource = NULL;
@@ -272,6 +384,15 @@ RGY_ERR RGYInputRaw::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const
             RGY_CSP_NAMES[m_inputCsp], RGY_CSP_NAMES[m_inputVideoInfo.csp]);
         return RGY_ERR_INVALID_COLOR_FORMAT;
     }
+    //ファイルからの読み込みでは、ファイルをマップしてマップした領域から直接変換する
+    //標準入力の場合は、これまで通りfreadで読み込む
+    if (!use_stdin) {
+        if (openInputMapping(bufferSize) == RGY_ERR_NONE) {
+            AddMessage(RGY_LOG_DEBUG, _T("mapped input file: %lld bytes.\n"), (long long)m_mapSize);
+        } else {
+            AddMessage(RGY_LOG_DEBUG, _T("failed to map input file, use fread instead.\n"));
+        }
+    }
 
     CreateInputInfo(m_readerName.c_str(), RGY_CSP_NAMES[m_convert->getFunc()->csp_from], RGY_CSP_NAMES[m_convert->getFunc()->csp_to], get_simd_str(m_convert->getFunc()->simd), &m_inputVideoInfo);
     AddMessage(RGY_LOG_DEBUG, m_inputInfo);
@@ -288,7 +409,24 @@ RGY_ERR RGYInputRaw::LoadNextFrameInternal(RGYFrame *pSurface) {
         return RGY_ERR_MORE_DATA;
     }
 
-    if (m_inputVideoInfo.type == RGY_INPUT_FMT_Y4M) {
+    if (m_inputVideoInfo.type == RGY_INPUT_FMT_Y4M && m_mapPtr) {
+        if (m_mapSize - m_mapPos < strlen("FRAME")) {
+            AddMessage(RGY_LOG_DEBUG, _T("header1: finish.\n"));
+            return RGY_ERR_MORE_DATA;
+        }
+        if (memcmp(m_mapPtr + m_mapPos, "FRAME", strlen("FRAME")) != 0) {
+            AddMessage(RGY_LOG_DEBUG, _T("header2: finish.\n"));
+            return RGY_ERR_MORE_DATA;
+        }
+        m_mapPos += strlen("FRAME");
+        for (int i = 0; m_mapPos >= m_mapSize || m_mapPtr[m_mapPos] != '\n'; i++, m_mapPos++) {
+            if (i >= 64 || m_mapPos >= m_mapSize) { //終端に達した場合も終了
+                AddMessage(RGY_LOG_DEBUG, _T("header3: finish.\n"));
+                return RGY_ERR_MORE_DATA;
+            }
+        }
+        m_mapPos++;
+    } else if (m_inputVideoInfo.type == RGY_INPUT_FMT_Y4M) {
         uint8_t y4m_buf[8] = { 0 };
         if (_fread_nolock(y4m_buf, 1, strlen("FRAME"), m_fSource) != strlen("FRAME")) {
             AddMessage(RGY_LOG_DEBUG, _T("header1: finish.\n"));
@@ -340,7 +478,21 @@ RGY_ERR RGYInputRaw::LoadNextFrameInternal(RGYFrame *pSurface) {
         AddMessage(RGY_LOG_ERROR, _T("Unknown color foramt.\n"));
         return RGY_ERR_INVALID_COLOR_FORMAT;
     }
-    if (frameSize != _fread_nolock(m_pBuffer.get(), 1, frameSize, m_fSource)) {
+    const uint8_t *frameBuf = m_pBuffer.get();
+    if (m_mapPtr) {
+        if (m_mapSize - m_mapPos < frameSize) {
+            AddMessage(RGY_LOG_DEBUG, _T("mmap: finish: %d.\n"), frameSize);
+            return RGY_ERR_MORE_DATA;
+        }
+        frameBuf = m_mapPtr + m_mapPos;
+        if (m_mapPos + frameSize + RAW_MAP_TAIL_MARGIN > m_mapSize) {
+            //ファイル終端付近では、変換時にマップ領域の外を読まないよう、バッファにコピーしてから変換する
+            memcpy(m_pBuffer.get(), frameBuf, frameSize);
+            frameBuf = m_pBuffer.get();
+        }
+        m_mapPos += frameSize;
+        adviseInputMapping(frameSize);
+    } else if (frameSize != _fread_nolock(m_pBuffer.get(), 1, frameSize, m_fSource)) {
         AddMessage(RGY_LOG_DEBUG, _T("fread: finish: %d.\n"), frameSize);
         return RGY_ERR_MORE_DATA;
     }
@@ -349,7 +501,7 @@ RGY_ERR RGYInputRaw::LoadNextFrameInternal(RGYFrame *pSurface) {
     pSurface->ptrArray(dst_array, m_convert->getFunc()->csp_to == RGY_CSP_RGB24 || m_convert->getFunc()->csp_to == RGY_CSP_RGB32);
 
     const void *src_array[3];
-    src_array[0] = m_pBuffer.get();
+    src_array[0] = frameBuf;
     src_array[1] = (uint8_t *)src_array[0] + m_inputVideoInfo.srcPitch * m_inputVideoInfo.srcHeight;
     switch (m_convert->getFunc()->csp_from) {
     case RGY_CSP_YV12:
@@ -400,6 +552,7 @@ RGY_ERR RGYInputRaw::LoadNextFrameInternal(RGYFrame *pSurface) {
     m_convert->run((m_inputVideoInfo.picstruct & RGY_PICSTRUCT_INTERLACED) ? 1 : 0,
         dst_array, src_array, m_inputVideoInfo.srcWidth, m_inputVideoInfo.srcPitch,
         src_uv_pitch, pSurface->pitch(), m_inputVideoInfo.srcHeight, m_inputVideoInfo.srcHeight, m_inputVideoInfo.crop.c);
+    m_readBytes += frameSize;
 
     m_encSatusInfo->m_sData.frameIn++;
     return m_encSatusInfo->UpdateDisplay();
@@ -54,11 +54,24 @@ protected:
     virtual RGY_ERR Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const RGYInputPrm *prm) override;
     virtual RGY_ERR LoadNextFrameInternal(RGYFrame *pSurface) override;
     RGY_ERR ParseY4MHeader(char *buf, VideoInfo *pInfo);
+    RGY_ERR openInputMapping(uint32_t frameSize);
+    void closeInputMapping();
+    void adviseInputMapping(uint32_t frameSize);
 
     FILE *m_fSource;
 
     uint32_t m_nBufSize;
     shared_ptr<uint8_t> m_pBuffer;
+
+    uint8_t *m_mapPtr;       //ファイルをマップした先頭 (nullptrならfreadで読み込む)
+    uint64_t m_mapSize;      //マップしたサイズ
+    uint64_t m_mapPos;       //次に読み込む位置
+    uint64_t m_mapReleased;  //ここまでは読み込み済みで解放した
+    uint64_t m_mapAhead;     //ここまでは先読みを指示した
+#if defined(_WIN32) || defined(_WIN64)
+    HANDLE m_mapHandle;
+#endif
+    uint64_t m_readBytes;    //読み込んだデータ量
 };
 
 #endif //ENABLE_RAW_READER
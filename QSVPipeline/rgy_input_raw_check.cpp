@@ -0,0 +1,237 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#include <cstdio>
+#include <vector>
+#include <thread>
+#if !(defined(_WIN32) || defined(_WIN64))
+#include <unistd.h>
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
+#include "rgy_osdep.h"
+#include "rgy_util.h"
+#include "rgy_input_raw.h"
+#include "rgy_input_raw_check.h"
+#include "rgy_check.h"
+
+#if ENABLE_RAW_READER
+
+static const int CHECK_RAW_READ_WIDTH = 1920;
+static const int CHECK_RAW_READ_HEIGHT = 1080;
+static const int CHECK_RAW_READ_FRAMES = 96;
+static const size_t CHECK_RAW_READ_FRAME_SIZE = CHECK_RAW_READ_WIDTH * CHECK_RAW_READ_HEIGHT * 3 / 2; // yv12
+static const size_t CHECK_RAW_READ_PIPE_WRITE_SIZE = 1024 * 1024;
+
+// ファイルのマップに関する処理を直接呼ぶため、protectedのメンバを公開する
+class RGYInputRawCheck : public RGYInputRaw {
+public:
+    using RGYInputRaw::m_fSource;
+    using RGYInputRaw::m_mapPtr;
+    using RGYInputRaw::m_mapSize;
+    using RGYInputRaw::m_mapPos;
+    using RGYInputRaw::openInputMapping;
+    using RGYInputRaw::adviseInputMapping;
+};
+
+// フレームの内容 (フレーム番号と位置から決まる値)
+static inline uint8_t check_raw_read_byte(const int frame, const size_t pos) {
+    return (uint8_t)(pos * 7 + (pos >> 12) + frame * 13);
+}
+
+// 変換処理の代わりに、フレームの全体を読んで合計を計算する
+static uint64_t check_raw_read_sum(const uint8_t *ptr, const size_t size) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < size; i += sizeof(uint64_t)) {
+        uint64_t value;
+        memcpy(&value, ptr + i, sizeof(value));
+        sum += value;
+    }
+    return sum;
+}
+
+static bool check_raw_read_print(const TCHAR *name, const bool ok, const int frames, const double elapsedSec, const tstring& info) {
+    const double bytes = (double)frames * CHECK_RAW_READ_FRAME_SIZE;
+    return rgy_check_print(name, ok, strsprintf(_T("%6.2f GB/s %s"), bytes / (elapsedSec * 1024.0 * 1024.0 * 1024.0), info.c_str()));
+}
+
+// RGYInputRaw::LoadNextFrameInternalのmmapを使わない場合と同様に、y4mのフレームを順に読み込む
+//   readFunc     ... size_t(void *dst, size_t size)
+//   readByteFunc ... int()
+template<typename ReadFunc, typename ReadByteFunc>
+static int check_raw_read_frames(ReadFunc readFunc, ReadByteFunc readByteFunc, const std::vector<uint64_t>& sums, bool& ok) {
+    std::vector<uint8_t> buf(CHECK_RAW_READ_FRAME_SIZE);
+    int frames = 0;
+    for (;;) {
+        char y4m_buf[8] = { 0 };
+        if (readFunc(y4m_buf, strlen("FRAME")) != strlen("FRAME")) {
+            break;
+        }
+        int i = 0;
+        while (readByteFunc() != '\n' && i < 64) {
+            i++;
+        }
+        ok &= memcmp(y4m_buf, "FRAME", strlen("FRAME")) == 0 && i == 0;
+        if (readFunc(buf.data(), buf.size()) != buf.size()) {
+            ok = false;
+            break;
+        }
+        ok &= frames < (int)sums.size() && check_raw_read_sum(buf.data(), buf.size()) == sums[frames];
+        frames++;
+    }
+    ok &= frames == (int)sums.size();
+    return frames;
+}
+
+// ファイルをマップし、マップした領域から直接読み込む
+static bool check_raw_read_mmap(const tstring& path, const std::vector<uint64_t>& sums) {
+    RGYInputRawCheck reader;
+    char header[128] = { 0 };
+    if (_tfopen_s(&reader.m_fSource, path.c_str(), _T("rb")) != 0 || reader.m_fSource == nullptr
+        || !fgets(header, sizeof(header), reader.m_fSource)) {
+        return false;
+    }
+    RGYCheckTimer timer;
+    if (reader.openInputMapping((uint32_t)CHECK_RAW_READ_FRAME_SIZE) != RGY_ERR_NONE) {
+        // 32bit環境ではマップしない
+        rgy_check_print_info(_T("mmap, file"), _T("not supported"));
+        return true;
+    }
+    bool ok = true;
+    int frames = 0;
+    while (reader.m_mapSize - reader.m_mapPos >= strlen("FRAME\n") + CHECK_RAW_READ_FRAME_SIZE) {
+        ok &= memcmp(reader.m_mapPtr + reader.m_mapPos, "FRAME\n", strlen("FRAME\n")) == 0;
+        reader.m_mapPos += strlen("FRAME\n");
+        ok &= frames < (int)sums.size() && check_raw_read_sum(reader.m_mapPtr + reader.m_mapPos, CHECK_RAW_READ_FRAME_SIZE) == sums[frames];
+        reader.m_mapPos += CHECK_RAW_READ_FRAME_SIZE;
+        reader.adviseInputMapping((uint32_t)CHECK_RAW_READ_FRAME_SIZE);
+        frames++;
+    }
+    const double elapsed = timer.sec();
+    ok &= frames == (int)sums.size();
+    return check_raw_read_print(_T("mmap, file"), ok, frames, elapsed, _T(""));
+}
+
+// フレームごとにfreadで読み込む (マップできなかった場合)
+static bool check_raw_read_fread(const tstring& path, const std::vector<uint64_t>& sums) {
+    FILE *fp = nullptr;
+    char header[128] = { 0 };
+    if (_tfopen_s(&fp, path.c_str(), _T("rb")) != 0 || fp == nullptr) {
+        return false;
+    }
+    RGYCheckTimer timer;
+    bool ok = fgets(header, sizeof(header), fp) != nullptr;
+    const int frames = check_raw_read_frames(
+        [fp](void *dst, size_t size) { return _fread_nolock(dst, 1, size, fp); },
+        [fp]() { return _fgetc_nolock(fp); },
+        sums, ok);
+    const double elapsed = timer.sec();
+    fclose(fp);
+    return check_raw_read_print(_T("fread, file"), ok, frames, elapsed, _T(""));
+}
+
+#if !(defined(_WIN32) || defined(_WIN64))
+// 標準入力の代わりに、別スレッドでファイルの内容を書き込んだパイプから読み込む
+static bool check_raw_read_pipe(const tstring& path, const std::vector<uint64_t>& sums) {
+    int fds[2] = { -1, -1 };
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    FILE *fp = fdopen(fds[0], "rb");
+    if (fp == nullptr) {
+        ::close(fds[0]);
+        ::close(fds[1]);
+        return false;
+    }
+    std::thread writer([&path, fd = fds[1]]() {
+        FILE *src = nullptr;
+        if (_tfopen_s(&src, path.c_str(), _T("rb")) == 0 && src != nullptr) {
+            std::vector<uint8_t> buf(CHECK_RAW_READ_PIPE_WRITE_SIZE);
+            size_t size = 0;
+            while ((size = fread(buf.data(), 1, buf.size(), src)) > 0) {
+                for (size_t done = 0; done < size; ) {
+                    const ssize_t ret = write(fd, buf.data() + done, size - done);
+                    if (ret <= 0) {
+                        break;
+                    }
+                    done += ret;
+                }
+            }
+            fclose(src);
+        }
+        ::close(fd);
+    });
+    RGYCheckTimer timer;
+    char header[128] = { 0 };
+    bool ok = fgets(header, sizeof(header), fp) != nullptr;
+    const int frames = check_raw_read_frames(
+        [fp](void *dst, size_t size) { return _fread_nolock(dst, 1, size, fp); },
+        [fp]() { return _fgetc_nolock(fp); },
+        sums, ok);
+    const double elapsed = timer.sec();
+    writer.join();
+    fclose(fp);
+    return check_raw_read_print(_T("fread, pipe"), ok, frames, elapsed, _T(""));
+}
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
+
+bool check_raw_read() {
+    std::vector<uint64_t> sums(CHECK_RAW_READ_FRAMES);
+    RGYCheckTempFile tmpFile("raw_read_check");
+    const bool created = tmpFile.create([&sums](FILE *fp) {
+        const std::string header = strsprintf("YUV4MPEG2 W%d H%d F30000:1001 Ip A1:1 C420jpeg\n", CHECK_RAW_READ_WIDTH, CHECK_RAW_READ_HEIGHT);
+        if (fwrite(header.c_str(), 1, header.length(), fp) != header.length()) {
+            return false;
+        }
+        std::vector<uint8_t> buf(CHECK_RAW_READ_FRAME_SIZE);
+        for (int frame = 0; frame < CHECK_RAW_READ_FRAMES; frame++) {
+            for (size_t i = 0; i < buf.size(); i++) {
+                buf[i] = check_raw_read_byte(frame, i);
+            }
+            sums[frame] = check_raw_read_sum(buf.data(), buf.size());
+            if (fwrite("FRAME\n", 1, strlen("FRAME\n"), fp) != strlen("FRAME\n")
+                || fwrite(buf.data(), 1, buf.size(), fp) != buf.size()) {
+                return false;
+            }
+        }
+        return true;
+    });
+    if (!created) {
+        return false;
+    }
+    const tstring& path = tmpFile.path();
+    // 作成直後のファイルはOSのキャッシュに載っているので、ストレージの速度ではなく読み込み方法によるオーバーヘッドを計測することになる
+    _ftprintf(stdout, _T("%dx%d yv12 y4m, %d frames, %d MB file (cached)\n"),
+        CHECK_RAW_READ_WIDTH, CHECK_RAW_READ_HEIGHT, CHECK_RAW_READ_FRAMES, (int)((CHECK_RAW_READ_FRAME_SIZE * CHECK_RAW_READ_FRAMES) >> 20));
+    bool ok = true;
+    ok &= check_raw_read_mmap(path, sums);
+    ok &= check_raw_read_fread(path, sums);
+#if !(defined(_WIN32) || defined(_WIN64))
+    ok &= check_raw_read_pipe(path, sums);
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
+    return rgy_check_print_total(ok);
+}
+
+#endif //#if ENABLE_RAW_READER
@@ -0,0 +1,41 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __RGY_INPUT_RAW_CHECK_H__
+#define __RGY_INPUT_RAW_CHECK_H__
+
+#include "rgy_tchar.h"
+
+// raw/y4m読み込み (RGYInputRaw) の確認と速度計測
+// 一時フォルダに作成したy4mファイルを、ファイルのマップ (mmap) とフレームごとのfreadで読み込み、
+// 1秒あたりの読み込み量を表示する (変換処理の代わりに、各フレームの全体を読んで内容を確認する)
+// Linuxでは、標準入力の場合と同じく、パイプからフレームごとにfreadで読み込んだ場合も計測する
+//   戻り値  ... 読み込んだ内容がすべて一致すればtrue
+bool check_raw_read();
+
+#endif //__RGY_INPUT_RAW_CHECK_H__
@@ -31,6 +31,7 @@
 #include <sstream>
 #include <map>
 #include <fstream>
+#include <chrono>
 
 RGYInputVpy::RGYInputVpy() :
     m_pAsyncBuffer(),
@@ -38,6 +39,14 @@ RGYInputVpy::RGYInputVpy() :
     m_hAsyncEventFrameSetStart(),
     m_bAbortAsync(false),
     m_nCopyOfInputFrames(0),
+    m_asyncMtx(),
+    m_asyncDepth(1),
+    m_asyncDepthMin(1),
+    m_asyncDepthMax(1),
+    m_asyncNoWaitFrames(0),
+    m_asyncDone(0),
+    m_asyncWaitFrames(0),
+    m_asyncWaitTime(0.0),
     m_sVSapi(nullptr),
     m_sVSscript(nullptr),
     m_sVSnode(nullptr),
@@ -112,7 +121,11 @@ int RGYInputVpy::initAsyncEvents() {
 }
 
 void RGYInputVpy::closeAsyncEvents() {
-    m_bAbortAsync = true;
+    {
+        //以降は新たなフレームを要求しないので、m_nAsyncFramesは確定する
+        std::lock_guard<std::mutex> lock(m_asyncMtx);
+        m_bAbortAsync = true;
+    }
     for (int i_frame = m_nCopyOfInputFrames; i_frame < m_nAsyncFrames; i_frame++) {
         const VSFrameRef *src_frame = getFrameFromAsyncBuffer(i_frame);
         m_sVSapi->freeFrame(src_frame);
@@ -136,13 +149,68 @@ void __stdcall frameDoneCallback(void *userData, const VSFrameRef *f, int n, VSN
 #pragma warning(pop)
 
 void RGYInputVpy::setFrameToAsyncBuffer(int n, const VSFrameRef* f) {
+    //要求済みで未使用のフレームはASYNC_BUFFER_SIZE未満なので、通常ここで待機することはない
     WaitForSingleObject(m_hAsyncEventFrameSetStart[n & (ASYNC_BUFFER_SIZE-1)], INFINITE);
     m_pAsyncBuffer[n & (ASYNC_BUFFER_SIZE-1)] = f;
+    m_asyncDone++;
     SetEvent(m_hAsyncEventFrameSetFin[n & (ASYNC_BUFFER_SIZE-1)]);
 
-    if (m_nAsyncFrames < m_inputVideoInfo.frames && !m_bAbortAsync) {
-        m_sVSapi->getFrameAsync(m_nAsyncFrames, m_sVSnode, frameDoneCallback, this);
-        m_nAsyncFrames++;
+    requestAsyncFrames();
+}
+
+const VSFrameRef* RGYInputVpy::getFrameFromAsyncBuffer(int n, bool *waited) {
+    const int idx = n & (ASYNC_BUFFER_SIZE-1);
+    if (waited) {
+        *waited = false;
+        if (WaitForSingleObject(m_hAsyncEventFrameSetFin[idx], 0) != WAIT_OBJECT_0) {
+            const auto start = std::chrono::steady_clock::now();
+            WaitForSingleObject(m_hAsyncEventFrameSetFin[idx], INFINITE);
+            m_asyncWaitTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            m_asyncWaitFrames++;
+            *waited = true;
+        }
+    } else {
+        WaitForSingleObject(m_hAsyncEventFrameSetFin[idx], INFINITE);
+    }
+    const VSFrameRef *frame = m_pAsyncBuffer[idx];
+    SetEvent(m_hAsyncEventFrameSetStart[idx]);
+    return frame;
+}
+
+void RGYInputVpy::requestAsyncFrames() {
+    for (;;) {
+        int n = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_asyncMtx);
+            if (m_bAbortAsync
+                || m_nAsyncFrames >= m_inputVideoInfo.frames
+                || m_nAsyncFrames - (int)m_nCopyOfInputFrames >= m_asyncDepth) {
+                return;
+            }
+            //VapourSynthMTでない場合は、処理中のフレームを1つに限る (次の要求は到着時のコールバックから行う)
+            if (m_inputVideoInfo.type != RGY_INPUT_FMT_VPY_MT && m_nAsyncFrames > m_asyncDone) {
+                return;
+            }
+            n = m_nAsyncFrames++;
+        }
+        //コールバックが同じスレッドから呼ばれても問題ないよう、ロックの外で要求する
+        m_sVSapi->getFrameAsync(n, m_sVSnode, frameDoneCallback, this);
+    }
+}
+
+void RGYInputVpy::adjustAsyncDepth(bool waited) {
+    std::lock_guard<std::mutex> lock(m_asyncMtx);
+    if (waited) {
+        //スクリプトの処理がエンコードに追いついていないので、先読みを増やしてVapourSynthのスレッドが空かないようにする
+        m_asyncDepth = std::min(m_asyncDepth + 1, m_asyncDepthMax);
+        m_asyncNoWaitFrames = 0;
+    } else if (++m_asyncNoWaitFrames >= m_asyncDepth * 2) {
+        //しばらく待機が発生せず、取得済みのフレームが溜まっている場合は、先読みを減らしてメモリを節約する
+        const int ready = m_asyncDone - (int)m_nCopyOfInputFrames;
+        if (ready > m_asyncDepthMin) {
+            m_asyncDepth = std::max(m_asyncDepth - 1, m_asyncDepthMin);
+        }
+        m_asyncNoWaitFrames = 0;
     }
 }
 
@@ -172,7 +240,10 @@ RGY_ERR RGYInputVpy::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const
         return RGY_ERR_NULL_PTR;
     }
 
-    m_convert = std::make_unique<RGYConvertCSP>((m_inputVideoInfo.type == RGY_INPUT_FMT_VPY_MT) ? 1 : prm->threadCsp, prm->threadParamCsp);
+    //変換は読み込みスレッドで行うので、VapourSynthMTでも--thread-cspの指定に従う
+    //自動(0)の場合のみ、VapourSynthのスレッドとCPUを取り合わないよう1スレッドとする
+    const int threadCsp = (m_inputVideoInfo.type == RGY_INPUT_FMT_VPY_MT && prm->threadCsp <= 0) ? 1 : prm->threadCsp;
+    m_convert = std::make_unique<RGYConvertCSP>(threadCsp, prm->threadParamCsp);
 
     //ファイルデータ読み込み
     std::ifstream inputFile(strFileName);
@@ -345,16 +416,15 @@ RGY_ERR RGYInputVpy::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const
         m_inputVideoInfo.bitdepth = RGY_CSP_BIT_DEPTH[m_inputCsp];
     }
 
-    m_nAsyncFrames = vsvideoinfo->numFrames;
-    m_nAsyncFrames = (std::min)(m_nAsyncFrames, vscoreinfo.numThreads);
-    m_nAsyncFrames = (std::min)(m_nAsyncFrames, ASYNC_BUFFER_SIZE-1);
-    if (m_inputVideoInfo.type != RGY_INPUT_FMT_VPY_MT) {
-        m_nAsyncFrames = 1;
-    }
-
-    for (int i = 0; i < m_nAsyncFrames; i++) {
-        m_sVSapi->getFrameAsync(i, m_sVSnode, frameDoneCallback, this);
-    }
+    //先読みはVapourSynthのスレッド数から始め、フレームの到着を待つ場合は増やし、取得済みのフレームが溜まる場合は減らす
+    //VapourSynthMTでない場合は1フレームずつ処理するので、1スレッドとして扱う
+    const int vsThreads = (m_inputVideoInfo.type == RGY_INPUT_FMT_VPY_MT) ? vscoreinfo.numThreads : 1;
+    m_asyncDepthMin = clamp(vsThreads, 1, ASYNC_BUFFER_SIZE-1);
+    m_asyncDepthMax = clamp(vsThreads * ASYNC_DEPTH_MAX_MUL, m_asyncDepthMin, ASYNC_BUFFER_SIZE-1);
+    m_asyncDepth = m_asyncDepthMin;
+    m_nAsyncFrames = 0;
+    AddMessage(RGY_LOG_DEBUG, _T("async prefetch depth: %d (max %d), vs threads %d.\n"), m_asyncDepthMin, m_asyncDepthMax, vscoreinfo.numThreads);
+    requestAsyncFrames();
 
     tstring vs_ver = _T("VapourSynth");
     if (m_inputVideoInfo.type == RGY_INPUT_FMT_VPY_MT) {
@@ -374,6 +444,10 @@ RGY_ERR RGYInputVpy::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const
 
 void RGYInputVpy::Close() {
     AddMessage(RGY_LOG_DEBUG, _T("Closing...\n"));
+    if (m_nCopyOfInputFrames > 0) {
+        AddMessage(RGY_LOG_DEBUG, _T("async prefetch depth: %d (min %d, max %d), waited for %d/%d frames, %.1f ms.\n"),
+            m_asyncDepth, m_asyncDepthMin, m_asyncDepthMax, m_asyncWaitFrames, (int)m_nCopyOfInputFrames, m_asyncWaitTime);
+    }
     closeAsyncEvents();
     if (m_sVSapi && m_sVSnode)
         m_sVSapi->freeNode(m_sVSnode);
@@ -386,6 +460,13 @@ void RGYInputVpy::Close() {
 
     m_bAbortAsync = false;
     m_nCopyOfInputFrames = 0;
+    m_asyncDepth = 1;
+    m_asyncDepthMin = 1;
+    m_asyncDepthMax = 1;
+    m_asyncNoWaitFrames = 0;
+    m_asyncDone = 0;
+    m_asyncWaitFrames = 0;
+    m_asyncWaitTime = 0.0;
 
     m_sVSapi = nullptr;
     m_sVSscript = nullptr;
@@ -403,11 +484,19 @@ RGY_ERR RGYInputVpy::LoadNextFrameInternal(RGYFrame *pSurface) {
         return RGY_ERR_MORE_DATA;
     }
 
-    const VSFrameRef *src_frame = getFrameFromAsyncBuffer(m_encSatusInfo->m_sData.frameIn);
+    bool waited = false;
+    const VSFrameRef *src_frame = getFrameFromAsyncBuffer(m_encSatusInfo->m_sData.frameIn, &waited);
     if (src_frame == nullptr) {
         return RGY_ERR_MORE_DATA;
     }
+    if (m_asyncDepthMax > m_asyncDepthMin) {
+        adjustAsyncDepth(waited);
+    }
 
+    //VapourSynthのフレームはすべてplanarで、QSVの入力サーフェス(NV12/P010/YUY2/Y210/AYUV/Y410)とは並びが異なるため、
+    //変換元と変換先の色空間が一致するのは、対応する変換のないY416向けのyuv444(16bit)の場合のみとなる
+    //その場合も変換先はパイプライン側で確保したサーフェスで、VapourSynthのフレームをそのまま渡すことはできないため、同じく変換(コピー)する
+    //(コピーは1080pで約2ms/フレーム、--check-csp-conv "yuv444(16bit)"で計測できる)
     void *dst_array[3];
     pSurface->ptrArray(dst_array, m_convert->getFunc()->csp_to == RGY_CSP_RGB24 || m_convert->getFunc()->csp_to == RGY_CSP_RGB32);
     const void *src_array[3] = { m_sVSapi->getReadPtr(src_frame, 0), m_sVSapi->getReadPtr(src_frame, 1), m_sVSapi->getReadPtr(src_frame, 2) };
@@ -416,10 +505,16 @@ RGY_ERR RGYInputVpy::LoadNextFrameInternal(RGYFrame *pSurface) {
         m_inputVideoInfo.srcWidth, m_sVSapi->getStride(src_frame, 0), m_sVSapi->getStride(src_frame, 1),
         pSurface->pitch(), m_inputVideoInfo.srcHeight, m_inputVideoInfo.srcHeight, m_inputVideoInfo.crop.c);
 
+    //VapourSynthのフレームは変換先のサーフェスへ直接変換しており、参照はここまで保持すればよい
     m_sVSapi->freeFrame(src_frame);
 
     m_encSatusInfo->m_sData.frameIn++;
-    m_nCopyOfInputFrames = m_encSatusInfo->m_sData.frameIn;
+    {
+        std::lock_guard<std::mutex> lock(m_asyncMtx);
+        m_nCopyOfInputFrames = m_encSatusInfo->m_sData.frameIn;
+    }
+    //使用したフレームの分、次のフレームを要求する
+    requestAsyncFrames();
 
     return m_encSatusInfo->UpdateDisplay();
 }
@@ -31,6 +31,8 @@
 
 #include "rgy_version.h"
 #if ENABLE_VAPOURSYNTH_READER
+#include <mutex>
+#include <atomic>
 #include "rgy_osdep.h"
 #include "rgy_input.h"
 #include "VapourSynth.h"
@@ -38,6 +40,8 @@
 
 const int ASYNC_BUFFER_2N = 7;
 const int ASYNC_BUFFER_SIZE = 1<<ASYNC_BUFFER_2N;
+//先読みするフレーム数の上限 (VapourSynthのスレッド数に対する倍率)
+const int ASYNC_DEPTH_MAX_MUL = 4;
 
 #if _M_IX86
 #define VPY_X64 0
@@ -87,12 +91,12 @@ protected:
     int load_vapoursynth();
     int initAsyncEvents();
     void closeAsyncEvents();
-    const VSFrameRef* getFrameFromAsyncBuffer(int n) {
-        WaitForSingleObject(m_hAsyncEventFrameSetFin[n & (ASYNC_BUFFER_SIZE-1)], INFINITE);
-        const VSFrameRef *frame = m_pAsyncBuffer[n & (ASYNC_BUFFER_SIZE-1)];
-        SetEvent(m_hAsyncEventFrameSetStart[n & (ASYNC_BUFFER_SIZE-1)]);
-        return frame;
-    }
+    //waited ... フレームの到着を待機したかどうか
+    const VSFrameRef* getFrameFromAsyncBuffer(int n, bool *waited = nullptr);
+    //先読みするフレーム数に達するまで、VapourSynthにフレームを要求する
+    void requestAsyncFrames();
+    //フレームの到着を待機したかどうかから、先読みするフレーム数を調整する
+    void adjustAsyncDepth(bool waited);
     const VSFrameRef* m_pAsyncBuffer[ASYNC_BUFFER_SIZE];
     HANDLE m_hAsyncEventFrameSetFin[ASYNC_BUFFER_SIZE];
     HANDLE m_hAsyncEventFrameSetStart[ASYNC_BUFFER_SIZE];
@@ -102,10 +106,19 @@ protected:
     bool m_bAbortAsync;
     uint32_t m_nCopyOfInputFrames;
 
+    std::mutex m_asyncMtx;        //m_nAsyncFrames, m_asyncDepth, m_nCopyOfInputFrames, m_bAbortAsyncの保護用
+    int m_asyncDepth;             //先読みするフレーム数 (要求済みで未使用のフレーム数の上限)
+    int m_asyncDepthMin;
+    int m_asyncDepthMax;
+    int m_asyncNoWaitFrames;      //待機せずに取得できたフレームの連続数
+    std::atomic<int> m_asyncDone; //VapourSynthから受け取ったフレーム数
+    int m_asyncWaitFrames;        //到着を待機したフレーム数
+    double m_asyncWaitTime;       //到着を待機した時間の合計 (ms)
+
     const VSAPI *m_sVSapi;
     VSScript *m_sVSscript;
     VSNodeRef *m_sVSnode;
-    int m_nAsyncFrames;
+    int m_nAsyncFrames;           //次に要求するフレーム
 
     vsscript_t m_sVS;
 };
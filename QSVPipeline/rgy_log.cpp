@@ -26,8 +26,11 @@
 // ------------------------------------------------------------------------------------------
 
 #include <algorithm>
+#include <atomic>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <unordered_map>
 #include <chrono>
 #include "rgy_log.h"
 #include "rgy_version.h"
@@ -225,12 +228,344 @@ tstring RGYParamLogLevel::to_string() const {
     return tmp.str();
 }
 
+static const size_t RGY_LOG_ASYNC_RECORDS_PER_THREAD = 1024;
+static const int RGY_LOG_ASYNC_INTERVAL_MS = 100;
+
+static int64_t rgy_log_time_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+//非同期出力時のログ1件分
+struct RGYLogRecord {
+    uint64_t seq;        //全スレッド共通の通し番号 (出力順の決定に使用)
+    int64_t timeMs;      //ログ出力を要求した時刻 (system_clock, ms)
+    RGYLogLevel level;
+    RGYLogType type;
+    bool fileOnly;
+    int tid;             //出力元スレッドの番号 (バッファの登録順)
+    tstring mes;
+
+    RGYLogRecord() : seq(0), timeMs(0), level(RGY_LOG_INFO), type(RGY_LOGT_APP), fileOnly(false), tid(0), mes() {};
+};
+
+//スレッドごとのログのリングバッファ
+//書き込みは所有スレッドのみ、読み出しは書き出しスレッドのみが行う (single producer/single consumer)
+class RGYLogThreadBuffer {
+public:
+    RGYLogThreadBuffer(int tid, size_t size) :
+        m_records(),
+        m_mask(0),
+        m_writeIdx(0),
+        m_readIdx(0),
+        m_writtenIdx(0),
+        m_dropped(0),
+        m_tid(tid) {
+        // インデックス計算をマスクで済ませるため、2の累乗に切り上げる
+        size_t bufSize = 1;
+        while (bufSize < std::max<size_t>(size, 1)) {
+            bufSize <<= 1;
+        }
+        m_records.resize(bufSize);
+        m_mask = bufSize - 1;
+    }
+    int tid() const { return m_tid; }
+    //空きがなければfalseを返す (recはそのまま)
+    bool push(RGYLogRecord& rec, uint64_t *idx) {
+        const auto writeIdx = m_writeIdx.load(std::memory_order_relaxed);
+        if (writeIdx - m_readIdx.load(std::memory_order_acquire) >= m_records.size()) {
+            return false;
+        }
+        m_records[writeIdx & m_mask] = std::move(rec);
+        m_writeIdx.store(writeIdx + 1, std::memory_order_release);
+        if (idx) *idx = writeIdx;
+        return true;
+    }
+    bool pop(RGYLogRecord& rec) {
+        const auto readIdx = m_readIdx.load(std::memory_order_relaxed);
+        if (readIdx == m_writeIdx.load(std::memory_order_acquire)) {
+            return false;
+        }
+        rec = std::move(m_records[readIdx & m_mask]);
+        m_readIdx.store(readIdx + 1, std::memory_order_release);
+        return true;
+    }
+    size_t queued() const {
+        return (size_t)(m_writeIdx.load(std::memory_order_acquire) - m_readIdx.load(std::memory_order_acquire));
+    }
+    size_t capacity() const { return m_records.size(); }
+    bool full() const { return queued() >= m_records.size(); }
+    uint64_t pushed() const { return m_writeIdx.load(std::memory_order_acquire); }
+    uint64_t popped() const { return m_readIdx.load(std::memory_order_acquire); }
+    //書き出しの完了したインデックス (書き出しスレッドが更新)
+    uint64_t written() const { return m_writtenIdx.load(std::memory_order_acquire); }
+    void setWritten(uint64_t idx) { m_writtenIdx.store(idx, std::memory_order_release); }
+    void addDropped() { m_dropped.fetch_add(1, std::memory_order_relaxed); }
+    uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+protected:
+    std::vector<RGYLogRecord> m_records;
+    size_t m_mask;
+    std::atomic<uint64_t> m_writeIdx;
+    std::atomic<uint64_t> m_readIdx;
+    std::atomic<uint64_t> m_writtenIdx;
+    std::atomic<uint64_t> m_dropped;
+    int m_tid;
+};
+
+//ログの非同期出力
+//各スレッドはフォーマット済みのメッセージを自スレッドのバッファに積むだけで、
+//ファイル/コンソールへの書き出しはバックグラウンドスレッドがまとめて行う
+class RGYLogAsync {
+public:
+    RGYLogAsync(RGYLog *log, bool dropOnOverflow);
+    ~RGYLogAsync();
+    bool openJson(const tstring& jsonFile);
+    void start();
+    void push(RGYLogLevel level, RGYLogType type, const TCHAR *mes, bool fileOnly);
+    void flush();
+protected:
+    RGYLogThreadBuffer *threadBuffer();
+    void waitWritten(RGYLogThreadBuffer *buffer, uint64_t idx);
+    void wakeup();
+    void run();
+    void writeRecords(const std::vector<RGYLogRecord>& records);
+    void writeJson(const RGYLogRecord& rec);
+
+    RGYLog *m_log;
+    bool m_dropOnOverflow;
+    uint32_t m_instance;                     //thread_localのバッファの所属先の判定用
+    std::unique_ptr<FILE, fp_deleter> m_fpJson;
+    std::thread m_thread;
+    std::mutex m_mtx;
+    std::condition_variable m_cvPushed;      //書き出しスレッドの起床用
+    std::condition_variable m_cvWritten;     //書き出し完了待ちの起床用
+    std::atomic<bool> m_urgent;              //すぐに書き出しが必要なログがある
+    bool m_abort;
+    std::atomic<uint64_t> m_seq;
+    std::vector<std::unique_ptr<RGYLogThreadBuffer>> m_buffers;
+    std::unordered_map<std::thread::id, RGYLogThreadBuffer *> m_bufferMap;
+    uint64_t m_droppedReported;
+};
+
+static std::atomic<uint32_t> g_logAsyncInstance(0);
+
+RGYLogAsync::RGYLogAsync(RGYLog *log, bool dropOnOverflow) :
+    m_log(log),
+    m_dropOnOverflow(dropOnOverflow),
+    m_instance(++g_logAsyncInstance),
+    m_fpJson(),
+    m_thread(),
+    m_mtx(),
+    m_cvPushed(),
+    m_cvWritten(),
+    m_urgent(false),
+    m_abort(false),
+    m_seq(0),
+    m_buffers(),
+    m_bufferMap(),
+    m_droppedReported(0) {
+}
+
+RGYLogAsync::~RGYLogAsync() {
+    if (m_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_abort = true;
+        }
+        m_cvPushed.notify_all();
+        m_thread.join();
+    }
+    m_fpJson.reset();
+}
+
+bool RGYLogAsync::openJson(const tstring& jsonFile) {
+    CreateDirectoryRecursive(PathRemoveFileSpecFixed(jsonFile).second.c_str());
+    FILE *fp = nullptr;
+    if (_tfopen_s(&fp, jsonFile.c_str(), _T("ab")) || fp == nullptr) {
+        return false;
+    }
+    m_fpJson.reset(fp);
+    return true;
+}
+
+void RGYLogAsync::start() {
+    m_thread = std::thread(&RGYLogAsync::run, this);
+}
+
+RGYLogThreadBuffer *RGYLogAsync::threadBuffer() {
+    thread_local RGYLogThreadBuffer *buffer = nullptr;
+    thread_local uint32_t instance = 0;
+    if (buffer == nullptr || instance != m_instance) {
+        // スレッドごとに初回のみロックして登録する
+        std::lock_guard<std::mutex> lock(m_mtx);
+        auto& target = m_bufferMap[std::this_thread::get_id()];
+        if (target == nullptr) {
+            m_buffers.push_back(std::make_unique<RGYLogThreadBuffer>((int)m_buffers.size() + 1, RGY_LOG_ASYNC_RECORDS_PER_THREAD));
+            target = m_buffers.back().get();
+        }
+        buffer = target;
+        instance = m_instance;
+    }
+    return buffer;
+}
+
+void RGYLogAsync::wakeup() {
+    // ロックは取らない (取りこぼした場合もRGY_LOG_ASYNC_INTERVAL_MS以内には書き出される)
+    m_urgent = true;
+    m_cvPushed.notify_one();
+}
+
+void RGYLogAsync::waitWritten(RGYLogThreadBuffer *buffer, uint64_t idx) {
+    std::unique_lock<std::mutex> lock(m_mtx);
+    m_cvWritten.wait(lock, [&]() { return buffer->written() > idx || m_abort; });
+}
+
+void RGYLogAsync::push(RGYLogLevel level, RGYLogType type, const TCHAR *mes, bool fileOnly) {
+    auto buffer = threadBuffer();
+    RGYLogRecord rec;
+    rec.seq = m_seq++;
+    rec.timeMs = rgy_log_time_ms();
+    rec.level = level;
+    rec.type = type;
+    rec.fileOnly = fileOnly;
+    rec.tid = buffer->tid();
+    rec.mes = mes;
+    uint64_t idx = 0;
+    while (!buffer->push(rec, &idx)) {
+        if (m_dropOnOverflow && level <= RGY_LOG_MORE) {
+            // 詳細ログは書き出しを待たずに破棄し、件数のみ後で出力する
+            buffer->addDropped();
+            wakeup();
+            return;
+        }
+        // 書き出しスレッドがバッファを空けるまで待機する
+        wakeup();
+        std::unique_lock<std::mutex> lock(m_mtx);
+        m_cvWritten.wait_for(lock, std::chrono::milliseconds(RGY_LOG_ASYNC_INTERVAL_MS), [&]() { return !buffer->full() || m_abort; });
+        if (m_abort) {
+            return;
+        }
+    }
+    if (level >= RGY_LOG_WARN || buffer->queued() >= buffer->capacity() / 2) {
+        wakeup();
+    }
+    if (level >= RGY_LOG_ERROR) {
+        // エラーの直後に終了する場合に備え、書き出しの完了まで待つ
+        waitWritten(buffer, idx);
+    }
+}
+
+void RGYLogAsync::flush() {
+    std::vector<std::pair<RGYLogThreadBuffer *, uint64_t>> targets;
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        for (auto& buffer : m_buffers) {
+            const auto pushed = buffer->pushed();
+            if (pushed > 0) {
+                targets.push_back(std::make_pair(buffer.get(), pushed - 1));
+            }
+        }
+    }
+    wakeup();
+    for (auto& target : targets) {
+        waitWritten(target.first, target.second);
+    }
+}
+
+void RGYLogAsync::run() {
+    std::vector<RGYLogRecord> records;
+    std::vector<RGYLogThreadBuffer *> buffers;
+    for (;;) {
+        bool abort = false;
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            m_cvPushed.wait_for(lock, std::chrono::milliseconds(RGY_LOG_ASYNC_INTERVAL_MS), [this]() { return m_urgent.load() || m_abort; });
+            abort = m_abort;
+            buffers.clear();
+            for (auto& buffer : m_buffers) {
+                buffers.push_back(buffer.get());
+            }
+        }
+        m_urgent = false;
+
+        // 各スレッドのバッファから取り出し、通し番号順に並べて出力する
+        uint64_t dropped = 0;
+        for (auto buffer : buffers) {
+            RGYLogRecord rec;
+            while (buffer->pop(rec)) {
+                records.push_back(std::move(rec));
+            }
+            dropped += buffer->dropped();
+        }
+        std::sort(records.begin(), records.end(), [](const RGYLogRecord& a, const RGYLogRecord& b) { return a.seq < b.seq; });
+        if (dropped > m_droppedReported) {
+            RGYLogRecord rec;
+            rec.seq = m_seq++; //他の記録と重複しないよう、新たな通し番号を取得する
+            rec.timeMs = rgy_log_time_ms();
+            rec.level = RGY_LOG_WARN;
+            rec.type = RGY_LOGT_APP;
+            rec.fileOnly = true;
+            rec.mes = strsprintf(_T("log: %lld messages dropped due to log buffer overflow.\n"), (long long)(dropped - m_droppedReported));
+            records.push_back(std::move(rec));
+            m_droppedReported = dropped;
+        }
+        const bool empty = records.empty();
+        if (!empty) {
+            writeRecords(records);
+            records.clear();
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            for (auto buffer : buffers) {
+                buffer->setWritten(buffer->popped());
+            }
+        }
+        m_cvWritten.notify_all();
+        if (abort && empty) {
+            break;
+        }
+    }
+}
+
+void RGYLogAsync::writeRecords(const std::vector<RGYLogRecord>& records) {
+    // ログファイルはまとめて1回だけ開く
+    FILE *fpLog = m_log->openLogFile();
+    for (const auto& rec : records) {
+        m_log->write_log_record(rec.level, rec.mes.c_str(), rec.fileOnly, rec.timeMs, fpLog);
+        if (m_fpJson) {
+            writeJson(rec);
+        }
+    }
+    if (fpLog) {
+        fclose(fpLog);
+    }
+    if (m_fpJson) {
+        fflush(m_fpJson.get());
+    }
+}
+
+void RGYLogAsync::writeJson(const RGYLogRecord& rec) {
+    const auto sec = (time_t)(rec.timeMs / 1000);
+    char timeStr[64] = { 0 };
+    strftime(timeStr, _countof(timeStr), "%Y-%m-%dT%H:%M:%S", localtime(&sec));
+    auto mes = tchar_to_string(rec.mes, CP_UTF8);
+    while (mes.length() > 0 && (mes.back() == '\n' || mes.back() == '\r')) {
+        mes.pop_back();
+    }
+    const auto typeStr = rgy_log_type_to_str(rec.type);
+    fprintf(m_fpJson.get(), "{\"time\":\"%s.%03d\",\"seq\":%llu,\"thread\":%d,\"level\":\"%s\",\"type\":\"%s\",\"message\":\"%s\"}\n",
+        timeStr, (int)(rec.timeMs % 1000), (unsigned long long)rec.seq, rec.tid,
+        tchar_to_string(rgy_log_level_to_str(rec.level)).c_str(),
+        (typeStr) ? tchar_to_string(typeStr).c_str() : "",
+        str_escape_json(mes).c_str());
+}
+
 RGYLog::RGYLog(const TCHAR *pLogFile, const RGYLogLevel log_level, bool showTime) :
     m_nLogLevel(),
     m_pStrLog(nullptr),
     m_bHtml(false),
     m_showTime(showTime),
-    m_mtx() {
+    m_mtx(),
+    m_async() {
     init(pLogFile, RGYParamLogLevel(log_level));
 };
 
@@ -239,11 +574,34 @@ RGYLog::RGYLog(const TCHAR *pLogFile, const RGYParamLogLevel& log_level, bool sh
     m_pStrLog(nullptr),
     m_bHtml(false),
     m_showTime(showTime),
-    m_mtx() {
+    m_mtx(),
+    m_async() {
     init(pLogFile, log_level);
 }
 
 RGYLog::~RGYLog() {
+    //残っているログを書き出してから終了する
+    m_async.reset();
+}
+
+bool RGYLog::startAsync(bool dropOnOverflow, const tstring& jsonFile) {
+    if (m_async) {
+        return true;
+    }
+    auto async = std::make_unique<RGYLogAsync>(this, dropOnOverflow);
+    if (jsonFile.length() > 0 && !async->openJson(jsonFile)) {
+        write(RGY_LOG_ERROR, RGY_LOGT_APP, _T("Failed to open json log file \"%s\".\n"), jsonFile.c_str());
+        return false;
+    }
+    async->start();
+    m_async = std::move(async);
+    return true;
+}
+
+void RGYLog::flush() {
+    if (m_async) {
+        m_async->flush();
+    }
 }
 
 void RGYLog::init(const TCHAR *pLogFile, const RGYParamLogLevel& log_level) {
@@ -360,7 +718,26 @@ void RGYLog::write_log(RGYLogLevel log_level, const RGYLogType logtype, const TC
     if (log_level < m_nLogLevel.get(logtype)) {
         return;
     }
+    if (m_async) {
+        m_async->push(log_level, logtype, buffer, file_only);
+        return;
+    }
+    write_log_record(log_level, buffer, file_only, rgy_log_time_ms(), nullptr);
+}
+
+FILE *RGYLog::openLogFile() {
+    if (!m_pStrLog) {
+        return nullptr;
+    }
+    FILE *fp_log = NULL;
+    //logはANSI(まあようはShift-JIS)で保存する
+    if (_tfopen_s(&fp_log, m_pStrLog, (m_bHtml) ? _T("rb+") : _T("a")) || fp_log == NULL) {
+        return nullptr;
+    }
+    return fp_log;
+}
 
+void RGYLog::write_log_record(RGYLogLevel log_level, const TCHAR *buffer, bool file_only, int64_t timeMs, FILE *fpLog) {
     auto convert_to_html = [log_level](std::string str) {
         //str = str_replace(str, "<", "&lt;");
         //str = str_replace(str, ">", "&gt;");
@@ -377,11 +754,9 @@ void RGYLog::write_log(RGYLogLevel log_level, const RGYLogType logtype, const TC
         }
         return strHtml;
     };
-    auto add_time = [file_only](tstring str) {
-        const auto tp = std::chrono::system_clock::now();
-        const auto duration = tp.time_since_epoch();
-        const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
-        const auto sec1 = ms / 1000;
+    auto add_time = [file_only, timeMs](tstring str) {
+        const auto ms = timeMs;
+        const auto sec1 = (time_t)(ms / 1000);
         const auto timeinfo = localtime(&sec1);
         TCHAR buf[64] = { 0 };
         _tcsftime(buf, _countof(buf), _T("[%Y-%m-%d %H:%M:%S"), timeinfo);
@@ -439,9 +814,8 @@ void RGYLog::write_log(RGYLogLevel log_level, const RGYLogType logtype, const TC
 #endif
     std::lock_guard<std::mutex> lock(*m_mtx.get());
     if (m_pStrLog) {
-        FILE *fp_log = NULL;
-        //logはANSI(まあようはShift-JIS)で保存する
-        if (0 == _tfopen_s(&fp_log, m_pStrLog, (m_bHtml) ? _T("rb+") : _T("a")) && fp_log) {
+        FILE *fp_log = (fpLog) ? fpLog : openLogFile();
+        if (fp_log) {
             if (m_bHtml) {
                 _fseeki64(fp_log, 0, SEEK_END);
                 int64_t pos = _ftelli64(fp_log);
@@ -452,7 +826,9 @@ void RGYLog::write_log(RGYLogLevel log_level, const RGYLogType logtype, const TC
             if (m_bHtml) {
                 fwrite(HTML_FOOTER, 1, strlen(HTML_FOOTER), fp_log);
             }
-            fclose(fp_log);
+            if (fp_log != fpLog) {
+                fclose(fp_log);
+            }
         }
     }
     if (!file_only) {
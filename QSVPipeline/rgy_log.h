@@ -30,6 +30,7 @@
 #define __RGY_LOG_H__
 
 #include <cstdint>
+#include <cstdio>
 #include <string>
 #include <memory>
 #include <array>
@@ -40,6 +41,7 @@
 namespace std {
     class mutex;
 }
+class RGYLogAsync;
 
 enum RGYLogLevel {
     RGY_LOG_TRACE = -3,
@@ -157,7 +159,14 @@ protected:
     bool m_bHtml;
     bool m_showTime;
     std::unique_ptr<std::mutex> m_mtx;
+    std::unique_ptr<RGYLogAsync> m_async; //非同期出力用 (startAsync()で有効化)
     static const char *HTML_FOOTER;
+
+    friend class RGYLogAsync;
+    FILE *openLogFile();
+    //1件分のログをファイル/コンソールに書き出す
+    //fpLogがnullptrの場合は都度ログファイルを開く
+    void write_log_record(RGYLogLevel log_level, const TCHAR *buffer, bool file_only, int64_t timeMs, FILE *fpLog);
 public:
     RGYLog(const TCHAR *pLogFile, const RGYLogLevel log_level = RGY_LOG_INFO, bool showTime = false);
     RGYLog(const TCHAR *pLogFile, const RGYParamLogLevel& log_level, bool showTime = false);
@@ -186,6 +195,15 @@ public:
     void setLogFile(const TCHAR *pLogFile) {
         m_pStrLog = pLogFile;
     }
+    //ログの書き出しをバックグラウンドスレッドに移す
+    //dropOnOverflow: バッファがあふれた際、RGY_LOG_MORE以下のログを待たずに破棄する
+    //jsonFile: 指定された場合、JSON Lines形式でも出力する
+    bool startAsync(bool dropOnOverflow, const tstring& jsonFile);
+    //非同期出力時、これまでに出力されたログがすべて書き出されるまで待機する
+    void flush();
+    bool isAsync() const {
+        return (bool)m_async;
+    }
     virtual void write_log(RGYLogLevel log_level, const RGYLogType logtype, const TCHAR *buffer, bool file_only = false);
     virtual void write(RGYLogLevel log_level, const RGYLogType logtype, const TCHAR *format, ...);
     virtual void write(RGYLogLevel log_level, const RGYLogType logtype, const wchar_t *format, va_list args);
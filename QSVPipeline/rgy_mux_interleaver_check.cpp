@@ -0,0 +1,208 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#include <cstdio>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include "rgy_osdep.h"
+#include "rgy_util.h"
+#include "rgy_mux_interleaver_check.h"
+#include "rgy_check.h"
+#include "rgy_output_avcodec.h"
+
+#if ENABLE_AVSW_READER && ENABLE_AVCODEC_OUT_THREAD
+static const AVRational CHECK_MUX_TIMEBASE = { 1, 90000 }; // RGYOutputAvcodec::QUEUE_DTS_TIMEBASEと同じ
+static const int64_t CHECK_MUX_VIDEO_DURATION = 3000;      // 30fps
+static const int64_t CHECK_MUX_AUDIO_DURATION = 1920;      // 1024 samples @ 48kHz
+static const int CHECK_MUX_AUDIO_PACKETS_PER_SEC = 47;
+static const size_t CHECK_MUX_VIDEO_PENDING_LIMIT = 96;
+
+struct RGYMuxCheckPacket {
+    int64_t dts;     // パケットのdts
+    int64_t arrival; // 出力スレッドに届く時刻 (dtsと同じtimebase)
+};
+
+struct RGYMuxCheckStream {
+    tstring name;
+    bool video;
+    std::vector<RGYMuxCheckPacket> packets;
+};
+
+struct RGYMuxCheckScenario {
+    const TCHAR *name;
+    double videoDelaySec;  // 映像のエンコードの遅れ (秒)
+    double lengthSec;      // 長さ (秒)
+    double audioEndSec;    // 音声の終了 (秒, 0なら最後まで)
+    double audioGapStart;  // 音声の途切れの開始 (秒)
+    double audioGapEnd;    // 音声の途切れの終了 (秒)
+    double audioBurstSec;  // 音声をまとめて届ける間隔 (秒, 0ならdtsどおり)
+    int expectedStalls;    // 期待する途切れの検出回数
+};
+
+struct RGYMuxCheckResult {
+    bool ok;
+    int stalls;            // 途切れの検出回数
+    int violations;        // 他のストリームのより古いパケットを差し置いて書き出した回数
+    double videoDelay;     // 計測した映像の遅れ
+};
+
+static std::vector<RGYMuxCheckStream> check_mux_interleave_streams(const RGYMuxCheckScenario& sc) {
+    const int64_t sec = CHECK_MUX_TIMEBASE.den;
+    std::vector<RGYMuxCheckStream> streams(2);
+    streams[0].name = _T("video");
+    streams[0].video = true;
+    for (int64_t dts = 0; dts < (int64_t)(sc.lengthSec * sec); dts += CHECK_MUX_VIDEO_DURATION) {
+        streams[0].packets.push_back({ dts, dts + (int64_t)(sc.videoDelaySec * sec) });
+    }
+    streams[1].name = _T("audio");
+    streams[1].video = false;
+    const int64_t audioEnd = (int64_t)(((sc.audioEndSec > 0.0) ? sc.audioEndSec : sc.lengthSec) * sec);
+    for (int64_t dts = 0; dts < audioEnd; dts += CHECK_MUX_AUDIO_DURATION) {
+        if ((int64_t)(sc.audioGapStart * sec) <= dts && dts < (int64_t)(sc.audioGapEnd * sec)) {
+            continue;
+        }
+        int64_t arrival = dts;
+        if (sc.audioBurstSec > 0.0) {
+            const int64_t burst = (int64_t)(sc.audioBurstSec * sec);
+            arrival = (dts / burst + 1) * burst;
+        }
+        streams[1].packets.push_back({ dts, arrival });
+    }
+    return streams;
+}
+
+// RGYOutputAvcodec::WriteThreadFuncと同じ手順で、届いたパケットを振り分けてRGYMuxInterleaverで書き出す順番を決める
+static RGYMuxCheckResult check_mux_interleave_run(const RGYMuxCheckScenario& sc) {
+    const auto streams = check_mux_interleave_streams(sc);
+    const int64_t dtsThreshold = 4 * CHECK_MUX_VIDEO_DURATION;
+    const int64_t tolerance = dtsThreshold + (std::max)(CHECK_MUX_VIDEO_DURATION, CHECK_MUX_AUDIO_DURATION);
+    RGYMuxInterleaver interleaver(dtsThreshold, CHECK_MUX_TIMEBASE);
+    std::vector<std::deque<RGYMuxCheckPacket>> pending(streams.size());
+    std::vector<size_t> arrived(streams.size(), 0);
+    std::vector<size_t> written(streams.size(), 0);
+    std::vector<int64_t> lastWritten(streams.size(), 0);
+    for (const auto& stream : streams) {
+        const int id = interleaver.addStream(stream.name, (stream.video) ? CHECK_MUX_VIDEO_PENDING_LIMIT : 0, false);
+        if (stream.video) {
+            interleaver.setVideoStream(id);
+        } else {
+            interleaver.setAudioPacketsPerSec(id, RGYMuxInterleaver::AUDIO_PACKETS_PER_SEC_DEFAULT);
+        }
+    }
+    RGYMuxCheckResult result = { true, 0, 0, 0.0 };
+    auto writeStream = [&](const int id) {
+        const auto pkt = pending[id].front();
+        pending[id].pop_front();
+        interleaver.setPending(id, pending[id].size());
+        //他のストリームに、閾値を超えてより古いパケットが届いていれば順番の誤り
+        for (int i = 0; i < (int)streams.size(); i++) {
+            if (i != id && pending[i].size() > 0 && pending[i].front().dts + tolerance < pkt.dts) {
+                result.violations++;
+            }
+        }
+        //ストリーム内の順番が保たれていること
+        if (written[id] > 0 && pkt.dts <= lastWritten[id]) {
+            result.ok = false;
+        }
+        interleaver.written(id, pkt.dts);
+        lastWritten[id] = pkt.dts;
+        written[id]++;
+        //書き出し済みのdtsは、そのストリームで書き出したもの以外にならないこと
+        for (int i = 0; i < (int)streams.size(); i++) {
+            if (interleaver.lastDts(i) != lastWritten[i]) {
+                result.ok = false;
+            }
+        }
+    };
+    const int64_t tick = CHECK_MUX_TIMEBASE.den / 1000;
+    const int64_t end = (int64_t)((sc.lengthSec + sc.videoDelaySec + sc.audioBurstSec + 1.0) * CHECK_MUX_TIMEBASE.den);
+    for (int64_t now = 0; now < end; now += tick) {
+        //届いたパケットを振り分ける
+        for (int id = 0; id < (int)streams.size(); id++) {
+            const auto& packets = streams[id].packets;
+            while (arrived[id] < packets.size() && packets[arrived[id]].arrival <= now) {
+                pending[id].push_back(packets[arrived[id]++]);
+            }
+            if (!streams[id].video) {
+                if (pending[id].size() > 0) {
+                    interleaver.setAudioPacketsPerSec(id, CHECK_MUX_AUDIO_PACKETS_PER_SEC);
+                }
+                if (arrived[id] == packets.size() && pending[id].size() == 0) {
+                    interleaver.setEOS(id);
+                }
+            }
+            interleaver.setPending(id, pending[id].size());
+        }
+        for (;;) {
+            int stalled = -1;
+            const int id = interleaver.next(false, &stalled);
+            if (id < 0) {
+                break;
+            }
+            if (stalled >= 0) {
+                result.stalls++;
+            }
+            writeStream(id);
+        }
+    }
+    for (int id = -1; (id = interleaver.next(true, nullptr)) >= 0; ) {
+        writeStream(id);
+    }
+    for (int id = 0; id < (int)streams.size(); id++) {
+        if (written[id] != streams[id].packets.size()) {
+            result.ok = false;
+        }
+    }
+    result.videoDelay = interleaver.videoDelay();
+    result.ok &= result.violations == 0 && result.stalls == sc.expectedStalls;
+    return result;
+}
+#endif //#if ENABLE_AVSW_READER && ENABLE_AVCODEC_OUT_THREAD
+
+bool check_mux_interleave() {
+#if ENABLE_AVSW_READER && ENABLE_AVCODEC_OUT_THREAD
+    const RGYMuxCheckScenario scenarios[] = {
+        //name                 delay  length  audioEnd gapStart gapEnd burst stalls
+        { _T("video delay 1s"),  1.0,  20.0,   0.0,     0.0,    0.0,   0.0,  0 },
+        { _T("video delay 8s"),  8.0,  30.0,   0.0,     0.0,    0.0,   0.0,  1 },
+        { _T("audio burst 1s"),  2.0,  20.0,   0.0,     0.0,    0.0,   1.0,  0 },
+        { _T("audio gap"),       0.5,  40.0,   0.0,     5.0,   25.0,   0.0,  1 },
+        { _T("audio ends early"),0.5,  20.0,  10.0,     0.0,    0.0,   0.0,  0 },
+    };
+    bool ok = true;
+    for (const auto& sc : scenarios) {
+        const auto result = check_mux_interleave_run(sc);
+        ok &= rgy_check_print(sc.name, result.ok,
+            strsprintf(_T("stalls %d, out of order %d, measured video delay %5.2f s"), result.stalls, result.violations, result.videoDelay));
+    }
+    return rgy_check_print_total(ok);
+#else
+    _ftprintf(stderr, _T("--check-mux-interleave is not supported in this build.\n"));
+    return false;
+#endif
+}
@@ -0,0 +1,41 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __RGY_MUX_INTERLEAVER_CHECK_H__
+#define __RGY_MUX_INTERLEAVER_CHECK_H__
+
+#include "rgy_tchar.h"
+
+// RGYMuxInterleaverの動作確認
+// 映像のエンコードの遅れや音声の途切れ・まとめての到着など、映像と音声のdtsが前後して届く場合を模擬して書き出す順番を決め、
+// すべてのパケットが書き出されること、ストリーム内の順番、他のストリームのより古いパケットを差し置いて書き出していないこと、
+// 書き出し済みのdtsが他のストリームによって変更されないこと、途切れの検出回数を確認する
+//   戻り値  ... すべての場合で期待どおりならtrue
+bool check_mux_interleave();
+
+#endif //__RGY_MUX_INTERLEAVER_CHECK_H__
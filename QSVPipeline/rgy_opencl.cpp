@@ -35,6 +35,7 @@
 #include "rgy_opencl.h"
 #include "rgy_resource.h"
 #include "rgy_filesystem.h"
+#include "rgy_opencl_cache.h"
 
 #if ENABLE_OPENCL
 
@@ -301,6 +302,7 @@ int initOpenCLGlobal() {
     LOAD(clGetSupportedImageFormats);
 
     LOAD(clCreateProgramWithSource);
+    LOAD(clCreateProgramWithBinary);
     LOAD(clBuildProgram);
     LOAD(clGetProgramBuildInfo);
     LOAD(clGetProgramInfo);
@@ -1246,13 +1248,19 @@ RGYOpenCLContext::RGYOpenCLContext(shared_ptr<RGYOpenCLPlatform> platform, share
     m_queue(),
     m_log(pLog),
     m_copy(),
-    m_hmodule(NULL) {
+    m_hmodule(NULL),
+    m_programCache(),
+    m_programCacheDevice() {
 
 }
 
 RGYOpenCLContext::~RGYOpenCLContext() {
     CL_LOG(RGY_LOG_DEBUG, _T("Closing CL Context...\n"));
     m_copy.clear();     CL_LOG(RGY_LOG_DEBUG, _T("Closed CL m_copy program.\n"));
+    if (m_programCache) {
+        CL_LOG(RGY_LOG_DEBUG, _T("OpenCL program cache: %s.\n"), m_programCache->stats().c_str());
+        m_programCache.reset();
+    }
     m_queue.clear();    CL_LOG(RGY_LOG_DEBUG, _T("Closed CL Queue.\n"));
     m_context.reset();  CL_LOG(RGY_LOG_DEBUG, _T("Closed CL Context.\n"));
     m_platform.reset(); CL_LOG(RGY_LOG_DEBUG, _T("Closed CL Platform.\n"));
@@ -2435,6 +2443,15 @@ std::unique_ptr<RGYOpenCLProgram> RGYOpenCLContext::buildProgram(const std::stri
     }
     CL_LOG(RGY_LOG_DEBUG, _T("building OpenCL source: size %u.\n"), datalen);
 
+    std::string cacheKey;
+    if (m_programCache && m_platform->devs().size() == 1) {
+        cacheKey = RGYOpenCLProgramCache::key(std::string(data, datalen), options, m_programCacheDevice);
+        auto program = buildProgramFromCache(cacheKey, options);
+        if (program) {
+            return program;
+        }
+    }
+
     bool buildCrush = false;
     cl_int err = CL_SUCCESS;
     cl_program program = nullptr;
@@ -2479,9 +2496,59 @@ std::unique_ptr<RGYOpenCLProgram> RGYOpenCLContext::buildProgram(const std::stri
         }
     }
     CL_LOG(RGY_LOG_DEBUG, _T("clBuildProgram success!\n"));
+    auto clprogram = std::make_unique<RGYOpenCLProgram>(program, m_log);
+    if (cacheKey.length() > 0) {
+        const auto binary = clprogram->getBinary();
+        if (binary.size() > 0 && m_programCache->store(cacheKey, binary) == RGY_ERR_NONE) {
+            CL_LOG(RGY_LOG_DEBUG, _T("Saved OpenCL program binary to cache: size %u.\n"), binary.size());
+        }
+    }
+    return clprogram;
+}
+
+std::unique_ptr<RGYOpenCLProgram> RGYOpenCLContext::buildProgramFromCache(const std::string& cacheKey, const std::string& options) {
+    const auto binary = m_programCache->load(cacheKey);
+    if (binary.size() == 0) {
+        return nullptr;
+    }
+    const auto device = m_platform->devs()[0];
+    const unsigned char *binaryPtr = binary.data();
+    const size_t binaryLength = binary.size();
+    cl_int binaryStatus = CL_SUCCESS;
+    cl_int err = CL_SUCCESS;
+    cl_program program = clCreateProgramWithBinary(m_context.get(), 1, &device, &binaryLength, &binaryPtr, &binaryStatus, &err);
+    if (err == CL_SUCCESS && binaryStatus == CL_SUCCESS) {
+        // バイナリから作成した場合もclBuildProgramは必要
+        err = clBuildProgram(program, 1, &device, options.c_str(), NULL, NULL);
+    } else if (err == CL_SUCCESS) {
+        err = binaryStatus;
+    }
+    if (err != CL_SUCCESS) {
+        // ドライバが受け付けなかったバイナリは削除して、ソースからビルドしなおす
+        CL_LOG(RGY_LOG_DEBUG, _T("Failed to load OpenCL program binary from cache: %s, rebuild from source.\n"), cl_errmes(err));
+        if (program) {
+            clReleaseProgram(program);
+        }
+        m_programCache->invalidate(cacheKey);
+        return nullptr;
+    }
+    CL_LOG(RGY_LOG_DEBUG, _T("Loaded OpenCL program binary from cache: size %u.\n"), binaryLength);
     return std::make_unique<RGYOpenCLProgram>(program, m_log);
 }
 
+void RGYOpenCLContext::setProgramCache(std::shared_ptr<RGYOpenCLProgramCache> cache) {
+    m_programCache = cache;
+    m_programCacheDevice.clear();
+    if (m_programCache && m_platform->devs().size() == 1) {
+        // ドライバの更新などでバイナリが使用できなくなるので、バージョンをキーに含める
+        const auto platformInfo = m_platform->info();
+        const auto devInfo = RGYOpenCLDevice(m_platform->devs()[0]).info();
+        m_programCacheDevice = platformInfo.name + "|" + platformInfo.version + "|"
+            + devInfo.name + "|" + devInfo.version + "|" + devInfo.driver_version;
+        CL_LOG(RGY_LOG_DEBUG, _T("OpenCL program cache: %s.\n"), m_programCache->dir().c_str());
+    }
+}
+
 std::unique_ptr<RGYOpenCLProgram> RGYOpenCLContext::build(const std::string &source, const char *options) {
     return buildProgram(source, options);
 }
@@ -174,6 +174,7 @@ CL_EXTERN cl_int (CL_API_CALL* f_clReleaseCommandQueue) (cl_command_queue comman
 CL_EXTERN cl_int (CL_API_CALL* f_clGetSupportedImageFormats)(cl_context context, cl_mem_flags flags, cl_mem_object_type image_type, cl_uint num_entries, cl_image_format * image_formats, cl_uint * num_image_formats);
 
 CL_EXTERN cl_program(CL_API_CALL* f_clCreateProgramWithSource) (cl_context context, cl_uint count, const char **strings, const size_t *lengths, cl_int *errcode_ret);
+CL_EXTERN cl_program(CL_API_CALL* f_clCreateProgramWithBinary) (cl_context context, cl_uint num_devices, const cl_device_id *device_list, const size_t *lengths, const unsigned char **binaries, cl_int *binary_status, cl_int *errcode_ret);
 CL_EXTERN cl_int (CL_API_CALL* f_clBuildProgram) (cl_program program, cl_uint num_devices, const cl_device_id *device_list, const char *options, void (CL_CALLBACK *pfn_notify)(cl_program program, void *user_data), void* user_data);
 CL_EXTERN cl_int (CL_API_CALL* f_clGetProgramBuildInfo) (cl_program program, cl_device_id device, cl_program_build_info param_name, size_t param_value_size, void *param_value, size_t *param_value_size_ret);
 CL_EXTERN cl_int (CL_API_CALL* f_clGetProgramInfo)(cl_program program, cl_program_info param_name, size_t param_value_size, void *param_value, size_t *param_value_size_ret);
@@ -266,6 +267,7 @@ CL_EXTERN cl_int(CL_API_CALL* f_clEnqueueReleaseVA_APIMediaSurfacesINTEL)(cl_com
 #define clGetSupportedImageFormats f_clGetSupportedImageFormats
 
 #define clCreateProgramWithSource f_clCreateProgramWithSource
+#define clCreateProgramWithBinary f_clCreateProgramWithBinary
 #define clBuildProgram f_clBuildProgram
 #define clGetProgramBuildInfo f_clGetProgramBuildInfo
 #define clGetProgramInfo f_clGetProgramInfo
@@ -1067,6 +1069,7 @@ enum class RGYFrameCopyMode {
 };
 
 class RGYCLFramePool;
+class RGYOpenCLProgramCache;
 
 struct RGYCLImageFromBufferDeleter {
     RGYCLImageFromBufferDeleter();
@@ -1100,6 +1103,8 @@ public:
 
     void setModuleHandle(const HMODULE hmodule) { m_hmodule = hmodule; }
     HMODULE getModuleHandle() const { return m_hmodule; }
+    // 以降のビルドでプログラムバイナリのキャッシュを使用する (デバイスが1つの場合のみ)
+    void setProgramCache(std::shared_ptr<RGYOpenCLProgramCache> cache);
     std::unique_ptr<RGYOpenCLProgram> build(const std::string& source, const char *options);
     std::unique_ptr<RGYOpenCLProgram> buildFile(const tstring filename, const std::string options);
     std::unique_ptr<RGYOpenCLProgram> buildResource(const tstring name, const tstring type, const std::string options);
@@ -1151,6 +1156,7 @@ public:
     tstring getSupportedImageFormatsStr(const cl_mem_object_type image_type = CL_MEM_OBJECT_IMAGE2D) const;
 protected:
     std::unique_ptr<RGYOpenCLProgram> buildProgram(std::string datacopy, const std::string options);
+    std::unique_ptr<RGYOpenCLProgram> buildProgramFromCache(const std::string& cacheKey, const std::string& options);
 
     shared_ptr<RGYOpenCLPlatform> m_platform;
     unique_context m_context;
@@ -1158,6 +1164,8 @@ protected:
     std::shared_ptr<RGYLog> m_log;
     std::unordered_map<std::string, RGYOpenCLProgramAsync> m_copy;
     HMODULE m_hmodule;
+    std::shared_ptr<RGYOpenCLProgramCache> m_programCache;
+    std::string m_programCacheDevice; // キャッシュのキーに含める、プラットフォーム・デバイス・ドライバの情報
 };
 
 class RGYOpenCL {
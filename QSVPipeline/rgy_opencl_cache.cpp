@@ -0,0 +1,198 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include "rgy_opencl_cache.h"
+#include "rgy_osdep.h"
+#include "rgy_util.h"
+#include "rgy_filesystem.h"
+
+static const char RGY_CL_CACHE_MAGIC[8] = { 'R', 'G', 'Y', 'C', 'L', 'B', 'I', 'N' };
+static const uint32_t RGY_CL_CACHE_VERSION = 1;
+
+// ファイルの破損・キーの衝突の確認用のハッシュ
+static uint64_t cl_cache_hash(const void *data, size_t size, uint64_t hash) {
+    const uint8_t *ptr = (const uint8_t *)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= ptr[i];
+        hash *= 0x100000001b3ull; //FNV-1a
+    }
+    return hash;
+}
+static uint64_t cl_cache_hash(const std::string& str, uint64_t hash) {
+    return cl_cache_hash(str.data(), str.size(), hash);
+}
+static const uint64_t CL_CACHE_HASH_SEED0 = 0xcbf29ce484222325ull;
+static const uint64_t CL_CACHE_HASH_SEED1 = 0x84222325cbf29ce4ull;
+
+static tstring cl_cache_path_to_tstring(const std::filesystem::path& path) {
+#if defined(_WIN32) || defined(_WIN64)
+    return wstring_to_tstring(path.wstring());
+#else
+    return path.string();
+#endif
+}
+
+RGYOpenCLProgramCache::RGYOpenCLProgramCache(const tstring& dir) :
+    m_dir(dir),
+    m_dirCreated(false),
+    m_hit(0),
+    m_miss(0),
+    m_store(0),
+    m_invalid(0),
+    m_error(0) {
+}
+
+RGYOpenCLProgramCache::~RGYOpenCLProgramCache() {
+}
+
+tstring RGYOpenCLProgramCache::defaultDir() {
+    return getCacheDir(_T("clcache"));
+}
+
+std::string RGYOpenCLProgramCache::key(const std::string& source, const std::string& options, const std::string& device) {
+    // ソースはハッシュのみをキーに含める
+    return strsprintf("device=%s\noptions=%s\nsource=%016llx%016llx:%llu\n",
+        device.c_str(), options.c_str(),
+        (unsigned long long)cl_cache_hash(source, CL_CACHE_HASH_SEED0),
+        (unsigned long long)cl_cache_hash(source, CL_CACHE_HASH_SEED1),
+        (unsigned long long)source.size());
+}
+
+tstring RGYOpenCLProgramCache::filepath(const std::string& key) const {
+    const auto name = strsprintf("%016llx%016llx.bin",
+        (unsigned long long)cl_cache_hash(key, CL_CACHE_HASH_SEED0),
+        (unsigned long long)cl_cache_hash(key, CL_CACHE_HASH_SEED1));
+    return cl_cache_path_to_tstring(std::filesystem::path(m_dir) / name);
+}
+
+std::vector<uint8_t> RGYOpenCLProgramCache::load(const std::string& key) {
+    std::vector<uint8_t> binary;
+    const auto path = filepath(key);
+    FILE *fp = nullptr;
+    if (_tfopen_s(&fp, path.c_str(), _T("rb")) != 0 || fp == nullptr) {
+        m_miss++;
+        return binary;
+    }
+    std::unique_ptr<FILE, decltype(&fclose)> file(fp, fclose);
+    // magic, version, キーの長さ, キー, バイナリの長さ, バイナリのハッシュ, バイナリ
+    char magic[sizeof(RGY_CL_CACHE_MAGIC)] = { 0 };
+    uint32_t version = 0, keyLength = 0;
+    uint64_t binaryLength = 0, binaryHash = 0;
+    std::string fileKey;
+    bool ok = fread(magic, 1, sizeof(magic), fp) == sizeof(magic)
+        && memcmp(magic, RGY_CL_CACHE_MAGIC, sizeof(magic)) == 0
+        && fread(&version, sizeof(version), 1, fp) == 1
+        && version == RGY_CL_CACHE_VERSION
+        && fread(&keyLength, sizeof(keyLength), 1, fp) == 1
+        && keyLength == key.size();
+    if (ok) {
+        fileKey.resize(keyLength);
+        ok = fread(&fileKey[0], 1, keyLength, fp) == keyLength
+            && fileKey == key
+            && fread(&binaryLength, sizeof(binaryLength), 1, fp) == 1
+            && fread(&binaryHash, sizeof(binaryHash), 1, fp) == 1
+            && binaryLength > 0 && binaryLength < ((uint64_t)1 << 31);
+    }
+    if (ok) {
+        binary.resize((size_t)binaryLength);
+        ok = fread(binary.data(), 1, binary.size(), fp) == binary.size()
+            && cl_cache_hash(binary.data(), binary.size(), CL_CACHE_HASH_SEED0) == binaryHash;
+    }
+    if (!ok) {
+        // 別のキーとの衝突、あるいは破損したファイル
+        binary.clear();
+        m_miss++;
+        return binary;
+    }
+    m_hit++;
+    return binary;
+}
+
+RGY_ERR RGYOpenCLProgramCache::store(const std::string& key, const std::vector<uint8_t>& binary) {
+    if (binary.size() == 0 || m_dir.length() == 0) {
+        return RGY_ERR_INVALID_PARAM;
+    }
+    if (!m_dirCreated) {
+        if (!CreateDirectoryRecursive(m_dir.c_str())) {
+            m_error++;
+            return RGY_ERR_INVALID_CALL;
+        }
+        m_dirCreated = true;
+    }
+    const auto path = filepath(key);
+    // 同じファイルに複数のプロセス/スレッドが書き込んでも壊れないよう、一時ファイルに書き出してから置き換える
+    static std::atomic<uint32_t> tmpCount(0);
+    const auto tmppath = path + strsprintf(_T(".%u_%u.tmp"), GetCurrentProcessId(), tmpCount++);
+    {
+        FILE *fp = nullptr;
+        if (_tfopen_s(&fp, tmppath.c_str(), _T("wb")) != 0 || fp == nullptr) {
+            m_error++;
+            return RGY_ERR_FILE_OPEN;
+        }
+        const uint32_t version = RGY_CL_CACHE_VERSION;
+        const uint32_t keyLength = (uint32_t)key.size();
+        const uint64_t binaryLength = binary.size();
+        const uint64_t binaryHash = cl_cache_hash(binary.data(), binary.size(), CL_CACHE_HASH_SEED0);
+        bool ok = fwrite(RGY_CL_CACHE_MAGIC, 1, sizeof(RGY_CL_CACHE_MAGIC), fp) == sizeof(RGY_CL_CACHE_MAGIC)
+            && fwrite(&version, sizeof(version), 1, fp) == 1
+            && fwrite(&keyLength, sizeof(keyLength), 1, fp) == 1
+            && fwrite(key.data(), 1, key.size(), fp) == key.size()
+            && fwrite(&binaryLength, sizeof(binaryLength), 1, fp) == 1
+            && fwrite(&binaryHash, sizeof(binaryHash), 1, fp) == 1
+            && fwrite(binary.data(), 1, binary.size(), fp) == binary.size();
+        ok = (fclose(fp) == 0) && ok;
+        if (!ok) {
+            std::error_code ec;
+            std::filesystem::remove(tmppath, ec);
+            m_error++;
+            return RGY_ERR_UNDEFINED_BEHAVIOR;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmppath, path, ec);
+    if (ec) {
+        std::filesystem::remove(tmppath, ec);
+        m_error++;
+        return RGY_ERR_UNDEFINED_BEHAVIOR;
+    }
+    m_store++;
+    return RGY_ERR_NONE;
+}
+
+void RGYOpenCLProgramCache::invalidate(const std::string& key) {
+    std::error_code ec;
+    std::filesystem::remove(filepath(key), ec);
+    m_invalid++;
+}
+
+tstring RGYOpenCLProgramCache::stats() const {
+    return strsprintf(_T("hit %d, miss %d, stored %d, invalid %d, error %d"),
+        m_hit.load(), m_miss.load(), m_store.load(), m_invalid.load(), m_error.load());
+}
@@ -0,0 +1,77 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __RGY_OPENCL_CACHE_H__
+#define __RGY_OPENCL_CACHE_H__
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <memory>
+#include "rgy_tchar.h"
+#include "rgy_err.h"
+
+// OpenCLのプログラムバイナリのディスクキャッシュ
+// ソース・ビルドオプション・プラットフォーム・デバイス・ドライバのバージョンから求めたハッシュをファイル名とし、
+// ファイル内にもキーの全体を保存して読み込み時に照合する
+// 書き込みは一時ファイルに出力してからrenameで置き換えるので、複数のプロセスから同時に使用できる
+class RGYOpenCLProgramCache {
+public:
+    RGYOpenCLProgramCache(const tstring& dir);
+    ~RGYOpenCLProgramCache();
+
+    // 既定のキャッシュの保存先
+    //   Windows: %LOCALAPPDATA%\<ENCODER_NAME>\clcache
+    //   その他 : $XDG_CACHE_HOME/<ENCODER_NAME>/clcache (未設定なら ~/.cache/...)
+    static tstring defaultDir();
+    // キャッシュのキーを作成する
+    //   device ... プラットフォーム・デバイス・ドライバのバージョンなどを連結した文字列
+    static std::string key(const std::string& source, const std::string& options, const std::string& device);
+
+    // キャッシュからバイナリを読み込む (見つからない、あるいはキーが一致しなければ空)
+    std::vector<uint8_t> load(const std::string& key);
+    // バイナリをキャッシュに保存する
+    RGY_ERR store(const std::string& key, const std::vector<uint8_t>& binary);
+    // 読み込んだバイナリが使用できなかった場合に、キャッシュから削除する
+    void invalidate(const std::string& key);
+
+    const tstring& dir() const { return m_dir; }
+    tstring stats() const;
+protected:
+    tstring filepath(const std::string& key) const;
+
+    tstring m_dir;
+    std::atomic<bool> m_dirCreated;
+    std::atomic<int> m_hit;
+    std::atomic<int> m_miss;
+    std::atomic<int> m_store;
+    std::atomic<int> m_invalid;
+    std::atomic<int> m_error;
+};
+
+#endif //__RGY_OPENCL_CACHE_H__
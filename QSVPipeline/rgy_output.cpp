@@ -30,7 +30,13 @@
 #include "rgy_bitstream.h"
 #include "rgy_language.h"
 #include "convert_csp.h"
+#include "rgy_perf_monitor.h"
+#include "rgy_trace.h"
 #include <filesystem>
+#if !(defined(_WIN32) || defined(_WIN64))
+#include <sys/uio.h>
+#include <climits>
+#endif
 #if defined(_M_IX86) || defined(_M_X64) || defined(__x86_64)
 #include <smmintrin.h>
 #endif
@@ -157,7 +163,22 @@ RGY_ERR RGYOutput::readRawDebug(RGYBitstream *pBitstream) {
     return RGY_ERR_NONE;
 }
 
+static const size_t RAW_WRITE_QUEUE_MAX = 64; //書き込みスレッドに渡すフレーム数の上限
+static const size_t RAW_WRITE_BATCH_MAX = 64; //書き込みスレッドで一度に書き込むフレーム数の上限
+
 RGYOutputRaw::RGYOutputRaw() :
+    m_thWrite(),
+    m_mtxWrite(),
+    m_cvWritePush(),
+    m_cvWritePop(),
+    m_writeQueue(),
+    m_writeChunkFree(),
+    m_writeChunk(),
+    m_writeQueueMax(RAW_WRITE_QUEUE_MAX),
+    m_writeFin(false),
+    m_writeError(false),
+    m_queueInfo(nullptr),
+    m_bitstreamPool(RGYBitstreamPool::get()),
     m_outputBuf2(),
     m_hdrBitstream(),
     m_doviRpu(nullptr),
@@ -169,8 +190,7 @@ RGYOutputRaw::RGYOutputRaw() :
     m_pBsfc(),
     m_pkt(),
 #endif //#if ENABLE_AVSW_READER
-    bsfcBuffer(nullptr),
-    bsfcBufferLength(0),
+    bsfcBuffer(RGYBitstreamInit()),
     parse_nal_h264(get_parse_nal_unit_h264_func()),
     parse_nal_hevc(get_parse_nal_unit_hevc_func()) {
     m_strWriterName = _T("bitstream");
@@ -178,6 +198,7 @@ RGYOutputRaw::RGYOutputRaw() :
 }
 
 RGYOutputRaw::~RGYOutputRaw() {
+    closeWriteThread();
     if (m_fpDebug) {
         m_fpDebug.reset();
     }
@@ -185,9 +206,8 @@ RGYOutputRaw::~RGYOutputRaw() {
     m_pBsfc.reset();
     m_pkt.reset();
 #endif //#if ENABLE_AVSW_READER
-    if (bsfcBuffer) {
-        free(bsfcBuffer);
-    }
+    m_bitstreamPool->release(&bsfcBuffer);
+    m_bitstreamPool.reset();
 }
 
 #pragma warning (push)
@@ -397,11 +417,191 @@ RGY_ERR RGYOutputRaw::Init(const TCHAR *strFileName, const VideoInfo *pVideoOutp
             }
         }
     }
+    //書き込みスレッドは明示的に指定された場合のみ使用する
+    if (!m_noOutput && rawPrm->threadOutput > 0) {
+        m_queueInfo = rawPrm->queueInfo;
+        m_writeFin = false;
+        m_writeError = false;
+        m_writeChunk = std::make_unique<RGYOutputRawWriteChunk>();
+        fflush(m_fDest.get());
+        m_thWrite = std::thread(&RGYOutputRaw::WriteThreadFunc, this, rawPrm->threadParamOutput);
+        AddMessage(RGY_LOG_DEBUG, _T("Started output thread: %s.\n"), rawPrm->threadParamOutput.desc().c_str());
+    }
     m_inited = true;
     return RGY_ERR_NONE;
 }
 #pragma warning (pop)
 
+size_t RGYOutputRaw::writeData(const void *ptr, size_t size) {
+    if (!m_writeChunk) {
+        return _fwrite_nolock(ptr, 1, size, m_fDest.get());
+    }
+    auto& chunk = m_writeChunk->data;
+    if (chunk.bufsize() < chunk.size() + size) {
+        if (m_bitstreamPool->extend(&chunk, chunk.size() + size) != RGY_ERR_NONE) {
+            return 0;
+        }
+    }
+    memcpy(chunk.data() + chunk.size(), ptr, size);
+    chunk.setSize(chunk.size() + size);
+    return size;
+}
+
+RGY_ERR RGYOutputRaw::submitWriteChunk() {
+    if (!m_writeChunk || m_writeChunk->data.size() == 0) {
+        return RGY_ERR_NONE;
+    }
+    m_writeChunk->queued = std::chrono::high_resolution_clock::now();
+    {
+        std::unique_lock<std::mutex> lock(m_mtxWrite);
+        //書き込みが追いつかない場合は、キューに空きができるまで待機する
+        m_cvWritePop.wait(lock, [this]() { return m_writeQueue.size() < m_writeQueueMax || m_writeError; });
+        if (m_writeError) {
+            AddMessage(RGY_LOG_ERROR, _T("Error writing file.\nNot enough disk space!\n"));
+            return RGY_ERR_UNDEFINED_BEHAVIOR;
+        }
+        m_writeQueue.push_back(std::move(m_writeChunk));
+        if (m_queueInfo) {
+            m_queueInfo->usage_vid_out = m_writeQueue.size();
+        }
+        if (m_writeChunkFree.size() > 0) {
+            m_writeChunk = std::move(m_writeChunkFree.back());
+            m_writeChunkFree.pop_back();
+        }
+    }
+    m_cvWritePush.notify_one();
+    if (!m_writeChunk) {
+        m_writeChunk = std::make_unique<RGYOutputRawWriteChunk>();
+    }
+    m_writeChunk->data.setSize(0);
+    m_writeChunk->data.setOffset(0);
+    return RGY_ERR_NONE;
+}
+
+void RGYOutputRaw::WriteThreadFunc(RGYParamThread threadParam) {
+    threadParam.apply(GetCurrentThread());
+    RGYTrace::get().setThreadName(_T("output"));
+    std::vector<std::unique_ptr<RGYOutputRawWriteChunk>> chunks;
+#if !(defined(_WIN32) || defined(_WIN64))
+    const int fd = fileno(m_fDest.get());
+    std::vector<struct iovec> iov;
+#endif
+    std::unique_lock<std::mutex> lock(m_mtxWrite);
+    for (;;) {
+        m_cvWritePush.wait(lock, [this]() { return m_writeQueue.size() > 0 || m_writeFin; });
+        if (m_writeQueue.size() == 0) {
+            break;
+        }
+        //キューにたまっているデータをまとめて取り出して書き込む
+        while (m_writeQueue.size() > 0 && chunks.size() < RAW_WRITE_BATCH_MAX) {
+            chunks.push_back(std::move(m_writeQueue.front()));
+            m_writeQueue.pop_front();
+        }
+        lock.unlock();
+        m_cvWritePop.notify_all();
+
+        RGYTraceScope trace(RGYTraceCat::OUTPUT, _T("write"));
+        bool writeError = false;
+#if defined(_WIN32) || defined(_WIN64)
+        for (const auto& chunk : chunks) {
+            if (_fwrite_nolock(chunk->data.data(), 1, chunk->data.size(), m_fDest.get()) != chunk->data.size()) {
+                writeError = true;
+                break;
+            }
+        }
+#else
+        iov.clear();
+        for (const auto& chunk : chunks) {
+            struct iovec v;
+            v.iov_base = chunk->data.data();
+            v.iov_len = chunk->data.size();
+            iov.push_back(v);
+        }
+        for (size_t idx = 0; idx < iov.size();) {
+            auto ret = writev(fd, &iov[idx], (int)std::min<size_t>(iov.size() - idx, IOV_MAX));
+            if (ret < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                writeError = true;
+                break;
+            }
+            //書き込めなかった分は次のwritevで書き込む
+            size_t written = (size_t)ret;
+            while (idx < iov.size() && written >= iov[idx].iov_len) {
+                written -= iov[idx].iov_len;
+                idx++;
+            }
+            if (written > 0) {
+                iov[idx].iov_base = (uint8_t *)iov[idx].iov_base + written;
+                iov[idx].iov_len -= written;
+            }
+        }
+#endif
+        const auto latency = std::chrono::high_resolution_clock::now() - chunks.front()->queued;
+        trace.end();
+
+        lock.lock();
+        if (writeError) {
+            m_writeError = true;
+            m_cvWritePop.notify_all();
+        }
+        for (auto& chunk : chunks) {
+            m_writeChunkFree.push_back(std::move(chunk));
+        }
+        chunks.clear();
+        if (m_queueInfo) {
+            m_queueInfo->usage_vid_out = m_writeQueue.size();
+            m_queueInfo->vid_out_latency_us = (size_t)std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+        }
+    }
+}
+
+RGY_ERR RGYOutputRaw::closeWriteThread() {
+    RGY_ERR err = RGY_ERR_NONE;
+    if (m_thWrite.joinable()) {
+        err = submitWriteChunk();
+        {
+            std::lock_guard<std::mutex> lock(m_mtxWrite);
+            m_writeFin = true;
+        }
+        m_cvWritePush.notify_all();
+        m_thWrite.join();
+        AddMessage(RGY_LOG_DEBUG, _T("Closed output thread.\n"));
+        //最後の書き込みで発生したエラーはここでしか検出できない
+        if (err == RGY_ERR_NONE && m_writeError) {
+            AddMessage(RGY_LOG_ERROR, _T("Error writing file.\nNot enough disk space!\n"));
+            err = RGY_ERR_UNDEFINED_BEHAVIOR;
+        }
+    }
+    //バッファはプールに返却する
+    for (auto& chunk : m_writeQueue) {
+        m_bitstreamPool->release(&chunk->data);
+    }
+    for (auto& chunk : m_writeChunkFree) {
+        m_bitstreamPool->release(&chunk->data);
+    }
+    if (m_writeChunk) {
+        m_bitstreamPool->release(&m_writeChunk->data);
+    }
+    m_writeQueue.clear();
+    m_writeChunkFree.clear();
+    m_writeChunk.reset();
+    m_queueInfo = nullptr;
+    return err;
+}
+
+RGY_ERR RGYOutputRaw::WaitFin() {
+    return closeWriteThread();
+}
+
+void RGYOutputRaw::Close() {
+    closeWriteThread();
+    m_bitstreamPool->release(&bsfcBuffer);
+    AddMessage(RGY_LOG_DEBUG, _T("bitstream pool: %s.\n"), m_bitstreamPool->stats().c_str());
+    RGYOutput::Close();
+}
+
 RGY_ERR RGYOutputRaw::WriteNextFrame(RGYBitstream *pBitstream) {
     if (pBitstream == nullptr) {
         AddMessage(RGY_LOG_ERROR, _T("Invalid call: WriteNextFrame\n"));
@@ -415,15 +615,16 @@ RGY_ERR RGYOutputRaw::WriteNextFrame(RGYBitstream *pBitstream) {
 #if ENABLE_AVSW_READER
         if (m_pBsfc) {
             uint8_t nal_type = 0;
-            std::vector<nal_info> nal_list;
+            auto& nal_list = m_nalList;
+            nal_list.clear();
             if (m_VideoOutputInfo.codec == RGY_CODEC_HEVC) {
                 nal_type = NALU_HEVC_SPS;
-                nal_list = parse_nal_hevc(pBitstream->data(), pBitstream->size());
+                parse_nal_hevc(nal_list, pBitstream->data(), pBitstream->size());
             } else if (m_VideoOutputInfo.codec == RGY_CODEC_H264) {
                 nal_type = NALU_H264_SPS;
-                nal_list = parse_nal_h264(pBitstream->data(), pBitstream->size());
+                parse_nal_h264(nal_list, pBitstream->data(), pBitstream->size());
             }
-            auto sps_nal = std::find_if(nal_list.begin(), nal_list.end(), [nal_type](nal_info info) { return info.type == nal_type; });
+            auto sps_nal = std::find_if(nal_list.begin(), nal_list.end(), [nal_type](const nal_info& info) { return info.type == nal_type; });
             if (sps_nal != nal_list.end()) {
                 AVPacket *pkt = m_pkt.get();
                 av_new_packet(pkt, (int)sps_nal->size);
@@ -448,17 +649,20 @@ RGY_ERR RGYOutputRaw::WriteNextFrame(RGYBitstream *pBitstream) {
                 const auto next_nal_orig_offset = sps_nal_offset + sps_nal->size;
                 const auto next_nal_new_offset = sps_nal_offset + pkt->size;
                 const auto stream_orig_length = pBitstream->size();
-                if (bsfcBufferLength < new_data_size) {
-                    free(bsfcBuffer);
-                    bsfcBufferLength = new_data_size * 2;
-                    bsfcBuffer = (uint8_t *)malloc(bsfcBufferLength);
+                if (bsfcBuffer.bufsize() < new_data_size) {
+                    if (m_bitstreamPool->alloc(&bsfcBuffer, new_data_size) != RGY_ERR_NONE) {
+                        av_packet_unref(pkt);
+                        AddMessage(RGY_LOG_ERROR, _T("Failed to allocate memory for bitstream filter buffer.\n"));
+                        return RGY_ERR_MEMORY_ALLOC;
+                    }
                 }
+                uint8_t *bsfcBuf = bsfcBuffer.bufptr();
                 if (sps_nal_offset > 0) {
-                    memcpy(bsfcBuffer, pBitstream->data(), sps_nal_offset);
+                    memcpy(bsfcBuf, pBitstream->data(), sps_nal_offset);
                 }
-                memcpy(bsfcBuffer + sps_nal_offset, pkt->data, pkt->size);
-                memcpy(bsfcBuffer + next_nal_new_offset, pBitstream->data() + next_nal_orig_offset, stream_orig_length - next_nal_orig_offset);
-                pBitstream->copy(bsfcBuffer, new_data_size);
+                memcpy(bsfcBuf + sps_nal_offset, pkt->data, pkt->size);
+                memcpy(bsfcBuf + next_nal_new_offset, pBitstream->data() + next_nal_orig_offset, stream_orig_length - next_nal_orig_offset);
+                pBitstream->copy(bsfcBuf, new_data_size);
                 av_packet_unref(pkt);
             }
         }
@@ -467,15 +671,16 @@ RGY_ERR RGYOutputRaw::WriteNextFrame(RGYBitstream *pBitstream) {
         writeRawDebug(pBitstream);
         if (m_VideoOutputInfo.codec == RGY_CODEC_AV1) {
             if (m_debugDirectAV1Out) {
-                nBytesWritten = _fwrite_nolock(pBitstream->data(), 1, pBitstream->size(), m_fDest.get());
+                nBytesWritten = writeData(pBitstream->data(), pBitstream->size());
                 WRITE_CHECK(nBytesWritten, pBitstream->size());
             } else {
                 RGYTimestampMapVal bs_framedata;
                 bool hdr10plus_metadata_written = false;
 
-                const auto av1_units = parse_unit_av1(pBitstream->data(), pBitstream->size());
+                auto& av1_units = m_nalList;
+                parse_unit_av1(av1_units, pBitstream->data(), pBitstream->size());
                 for (size_t i = 0; i < av1_units.size(); i++) {
-                    nBytesWritten += _fwrite_nolock(av1_units[i]->unit_data.data(), 1, av1_units[i]->unit_data.size(), m_fDest.get());
+                    nBytesWritten += writeData(av1_units[i].ptr, av1_units[i].size);
 
                     auto writeHdr10PlusMetadata = [&]() {
                         if (hdr10plus_metadata_written) {
@@ -493,14 +698,14 @@ RGY_ERR RGYOutputRaw::WriteNextFrame(RGYBitstream *pBitstream) {
                             }
                             const auto hdr10plusMetadata = frameDataPtr->gen_obu();
                             if (hdr10plusMetadata.size() > 0) {
-                                nBytesWritten += _fwrite_nolock(hdr10plusMetadata.data(), 1, hdr10plusMetadata.size(), m_fDest.get());
+                                nBytesWritten += writeData(hdr10plusMetadata.data(), hdr10plusMetadata.size());
                             }
                         }
                         hdr10plus_metadata_written = true;
                         return RGY_ERR_NONE;
                     };
 
-                    if (av1_units[i]->type == OBU_TEMPORAL_DELIMITER) {
+                    if (av1_units[i].type == OBU_TEMPORAL_DELIMITER) {
                         //次のフレームの時刻情報を取得
                         bs_framedata = m_timestamp->getByEncodeFrameID(m_prevEncodeFrameId + 1);
                         if (bs_framedata.inputFrameId < 0) {
@@ -512,14 +717,14 @@ RGY_ERR RGYOutputRaw::WriteNextFrame(RGYBitstream *pBitstream) {
                         }
                         hdr10plus_metadata_written = false;
 
-                        if (i + 1 >= av1_units.size() || av1_units[i + 1]->type != OBU_SEQUENCE_HEADER) {
+                        if (i + 1 >= av1_units.size() || av1_units[i + 1].type != OBU_SEQUENCE_HEADER) {
                             if (auto err = writeHdr10PlusMetadata(); err != RGY_ERR_NONE) {
                                 return err;
                             }
                         }
-                    } else if (av1_units[i]->type == OBU_SEQUENCE_HEADER) {
-                        if (m_hdrBitstream.size() > 0 && (isIDR || av1_units[i]->type == OBU_SEQUENCE_HEADER)) {
-                            nBytesWritten += _fwrite_nolock(m_hdrBitstream.data(), 1, m_hdrBitstream.size(), m_fDest.get());
+                    } else if (av1_units[i].type == OBU_SEQUENCE_HEADER) {
+                        if (m_hdrBitstream.size() > 0 && (isIDR || av1_units[i].type == OBU_SEQUENCE_HEADER)) {
+                            nBytesWritten += writeData(m_hdrBitstream.data(), m_hdrBitstream.size());
                         }
                         if (auto err = writeHdr10PlusMetadata(); err != RGY_ERR_NONE) {
                             return err;
@@ -567,34 +772,35 @@ RGY_ERR RGYOutputRaw::WriteNextFrame(RGYBitstream *pBitstream) {
             const bool insertSEI = m_hdrBitstream.size() > 0 && isIDR;
             if (insertSEI || hdr10plusMetadata.size() > 0) {
                 if (m_VideoOutputInfo.codec == RGY_CODEC_HEVC) {
-                    const auto nal_list = parse_nal_hevc(pBitstream->data(), pBitstream->size());
-                    const auto hevc_vps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_VPS; });
-                    const auto hevc_sps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_SPS; });
-                    const auto hevc_pps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_PPS; });
+                    auto& nal_list = m_nalList;
+                    parse_nal_hevc(nal_list, pBitstream->data(), pBitstream->size());
+                    const auto hevc_vps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](const nal_info& info) { return info.type == NALU_HEVC_VPS; });
+                    const auto hevc_sps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](const nal_info& info) { return info.type == NALU_HEVC_SPS; });
+                    const auto hevc_pps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](const nal_info& info) { return info.type == NALU_HEVC_PPS; });
                     const bool header_check = (nal_list.end() != hevc_vps_nal) || (nal_list.end() != hevc_sps_nal) || (nal_list.end() != hevc_pps_nal);
                     bool seiWritten = false;
                     bool hdr10plus_metadata_written = false;
                     if (!header_check) {
                         if (m_hdrBitstream.size() > 0) {
-                            nBytesWritten += _fwrite_nolock(m_hdrBitstream.data(), 1, m_hdrBitstream.size(), m_fDest.get());
+                            nBytesWritten += writeData(m_hdrBitstream.data(), m_hdrBitstream.size());
                             seiWritten = true;
                         }
                         if (hdr10plusMetadata.size() > 0) {
-                            nBytesWritten += _fwrite_nolock(hdr10plusMetadata.data(), 1, hdr10plusMetadata.size(), m_fDest.get());
+                            nBytesWritten += writeData(hdr10plusMetadata.data(), hdr10plusMetadata.size());
                             hdr10plus_metadata_written = true;
                         }
                     }
                     for (size_t i = 0; i < nal_list.size(); i++) {
-                        nBytesWritten += _fwrite_nolock(nal_list[i].ptr, 1, nal_list[i].size, m_fDest.get());
+                        nBytesWritten += writeData(nal_list[i].ptr, nal_list[i].size);
                         if (nal_list[i].type == NALU_HEVC_VPS || nal_list[i].type == NALU_HEVC_SPS || nal_list[i].type == NALU_HEVC_PPS) {
                             if (i + 1 < nal_list.size()
                                 && (nal_list[i + 1].type != NALU_HEVC_VPS && nal_list[i + 1].type != NALU_HEVC_SPS && nal_list[i + 1].type != NALU_HEVC_PPS)) {
                                 if (!seiWritten && insertSEI) {
-                                    nBytesWritten += _fwrite_nolock(m_hdrBitstream.data(), 1, m_hdrBitstream.size(), m_fDest.get());
+                                    nBytesWritten += writeData(m_hdrBitstream.data(), m_hdrBitstream.size());
                                     seiWritten = true;
                                 }
                                 if (!hdr10plus_metadata_written && hdr10plusMetadata.size() > 0) {
-                                    nBytesWritten += _fwrite_nolock(hdr10plusMetadata.data(), 1, hdr10plusMetadata.size(), m_fDest.get());
+                                    nBytesWritten += writeData(hdr10plusMetadata.data(), hdr10plusMetadata.size());
                                     hdr10plus_metadata_written = true;
                                 }
                             }
@@ -613,17 +819,18 @@ RGY_ERR RGYOutputRaw::WriteNextFrame(RGYBitstream *pBitstream) {
                     return RGY_ERR_UNSUPPORTED;
                 }
             } else {
-                nBytesWritten = _fwrite_nolock(pBitstream->data(), 1, pBitstream->size(), m_fDest.get());
+                nBytesWritten = writeData(pBitstream->data(), pBitstream->size());
                 WRITE_CHECK(nBytesWritten, pBitstream->size());
             }
             if (m_doviRpu) {
                 if (m_VideoOutputInfo.codec == RGY_CODEC_HEVC) {
-                    std::vector<uint8_t> dovi_nal;
+                    auto& dovi_nal = m_doviNal;
+                    dovi_nal.clear();
                     if (m_doviRpu->get_next_rpu_nal(dovi_nal, bs_framedata.inputFrameId) != 0) {
                         AddMessage(RGY_LOG_ERROR, _T("Failed to get dovi rpu for %lld.\n"), bs_framedata.inputFrameId);
                     }
                     if (dovi_nal.size() > 0) {
-                        nBytesWritten += _fwrite_nolock(dovi_nal.data(), 1, dovi_nal.size(), m_fDest.get());
+                        nBytesWritten += writeData(dovi_nal.data(), dovi_nal.size());
                     }
                 } else {
                     AddMessage(RGY_LOG_ERROR, _T("Adding dovi rpu not supported in %s encoding.\n"), CodecToStr(m_VideoOutputInfo.codec).c_str());
@@ -633,6 +840,10 @@ RGY_ERR RGYOutputRaw::WriteNextFrame(RGYBitstream *pBitstream) {
         }
     }
 
+    if (auto err = submitWriteChunk(); err != RGY_ERR_NONE) {
+        return err;
+    }
+
     m_encSatusInfo->SetOutputData(pBitstream->frametype(), nBytesWritten, 0);
     pBitstream->setSize(0);
 
@@ -1325,6 +1536,9 @@ RGY_ERR initWriters(
             rawPrm.debugRawOut = common->debugRawOut;
             rawPrm.outReplayFile = common->outReplayFile;
             rawPrm.outReplayCodec = common->outReplayCodec;
+            rawPrm.threadOutput = ctrl->threadOutput;
+            rawPrm.threadParamOutput = ctrl->threadParams.get(RGYThreadType::OUTUT);
+            rawPrm.queueInfo = (pPerfMonitor) ? pPerfMonitor->GetQueueInfoPtr() : nullptr;
             auto sts = pFileWriter->Init(common->outputFilename.c_str(), &outputVideoInfo, &rawPrm, log, pStatus);
             if (sts != RGY_ERR_NONE) {
                 log->write(RGY_LOG_ERROR, RGY_LOGT_OUT, pFileWriter->GetOutputMessage());
@@ -32,7 +32,11 @@
 #include <memory>
 #include <vector>
 #include <unordered_map>
+#include <deque>
+#include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <chrono>
 #include "rgy_osdep.h"
 #include "rgy_tchar.h"
 #include "rgy_log.h"
@@ -40,6 +44,7 @@
 #include "rgy_avutil.h"
 #include "rgy_bitstream.h"
 #include "rgy_input.h"
+#include "rgy_bitstream_pool.h"
 #if ENCODER_NVENC
 #include "NVEncUtil.h"
 #include "NVEncParam.h"
@@ -54,6 +59,8 @@
 using std::unique_ptr;
 using std::shared_ptr;
 
+struct PerfQueueInfo;
+
 enum OutputType {
     OUT_TYPE_NONE = 0,
     OUT_TYPE_BITSTREAM,
@@ -185,8 +192,8 @@ public:
     virtual OutputType getOutType() {
         return m_OutType;
     }
-    virtual void WaitFin() {
-        return;
+    virtual RGY_ERR WaitFin() {
+        return RGY_ERR_NONE;
     }
 
     const TCHAR *GetOutputMessage() {
@@ -257,6 +264,17 @@ struct RGYOutputRawPrm {
     const RGYHDRMetadata *hdrMetadata;
     DOVIRpu *doviRpu;
     RGYTimestamp *vidTimestamp;
+    int threadOutput;
+    RGYParamThread threadParamOutput;
+    PerfQueueInfo *queueInfo;
+};
+
+//RGYOutputRawで書き込みスレッドに渡す1フレーム分のデータ
+struct RGYOutputRawWriteChunk {
+    RGYBitstream data; //RGYBitstreamPoolから取得したバッファ
+    std::chrono::high_resolution_clock::time_point queued; //キューに追加した時刻
+
+    RGYOutputRawWriteChunk() : data(RGYBitstreamInit()), queued() {};
 };
 
 class RGYOutputRaw : public RGYOutput {
@@ -267,9 +285,31 @@ public:
 
     virtual RGY_ERR WriteNextFrame(RGYBitstream *pBitstream) override;
     virtual RGY_ERR WriteNextFrame(RGYFrame *pSurface) override;
+    virtual RGY_ERR WaitFin() override;
+    virtual void Close() override;
 protected:
     virtual RGY_ERR Init(const TCHAR *strFileName, const VideoInfo *pOutputInfo, const void *prm) override;
 
+    //書き込みスレッドを使用する場合は、m_writeChunkにためる
+    size_t writeData(const void *ptr, size_t size);
+    //m_writeChunkにためたデータを書き込みスレッドに渡す
+    RGY_ERR submitWriteChunk();
+    RGY_ERR closeWriteThread();
+    void WriteThreadFunc(RGYParamThread threadParam);
+
+    std::thread m_thWrite;                      //書き込みスレッド
+    std::mutex m_mtxWrite;                      //m_writeQueue, m_writeChunkFree用のロック
+    std::condition_variable m_cvWritePush;      //書き込みキューにデータが追加された
+    std::condition_variable m_cvWritePop;       //書き込みキューからデータが取り出された
+    std::deque<std::unique_ptr<RGYOutputRawWriteChunk>> m_writeQueue;      //書き込み待ちのデータ
+    std::vector<std::unique_ptr<RGYOutputRawWriteChunk>> m_writeChunkFree; //再利用するバッファ
+    std::unique_ptr<RGYOutputRawWriteChunk> m_writeChunk; //現在のフレームのデータをためるバッファ
+    size_t m_writeQueueMax;                     //書き込みキューに積めるフレーム数の上限
+    bool m_writeFin;                            //書き込みスレッドを終了する
+    bool m_writeError;                          //書き込みスレッドでエラーが発生した
+    PerfQueueInfo *m_queueInfo;
+    std::shared_ptr<RGYBitstreamPool> m_bitstreamPool; //書き込みスレッド・bitstreamfilter用のバッファのプール
+
     vector<uint8_t> m_outputBuf2;
     vector<uint8_t> m_hdrBitstream;
     DOVIRpu *m_doviRpu;
@@ -281,10 +321,11 @@ protected:
     std::unique_ptr<AVBSFContext, RGYAVDeleter<AVBSFContext>> m_pBsfc;
     std::unique_ptr<AVPacket, RGYAVDeleter<AVPacket>> m_pkt;
 #endif //#if ENABLE_AVSW_READER
-    uint8_t *bsfcBuffer;           //bitstreamfilter用のバッファ
-    size_t   bsfcBufferLength;     //bitstreamfilter用のバッファの長さ
+    RGYBitstream bsfcBuffer;       //bitstreamfilter用のバッファ
     decltype(parse_nal_unit_h264_c) *parse_nal_h264; // H.264用のnal unit分解関数へのポインタ
     decltype(parse_nal_unit_hevc_c) *parse_nal_hevc; // HEVC用のnal unit分解関数へのポインタ
+    std::vector<nal_info> m_nalList; // nal unit分解結果 (フレームごとに使いまわす)
+    std::vector<uint8_t> m_doviNal;  // dovi rpu用のバッファ (フレームごとに使いまわす)
 };
 
 std::unique_ptr<RGYHDRMetadata> createHEVCHDRSei(const std::string &maxCll, const std::string &masterDisplay, CspTransfer atcSei, const RGYInput *reader);
@@ -39,6 +39,7 @@
 #include "rgy_avlog.h"
 #include "rgy_bitstream.h"
 #include "rgy_codepage.h"
+#include "rgy_trace.h"
 
 #define WRITE_PTS_DEBUG (0)
 
@@ -95,8 +96,9 @@ AVMuxVideo::AVMuxVideo() :
     hdrBitstream(),
     doviRpu(nullptr),
     bsfc(nullptr),
-    bsfcBuffer(nullptr),
-    bsfcBufferLength(0),
+    bsfcBuffer(),
+    seiBuffer(),
+    bitstreamPool(),
     timestamp(nullptr),
     pktOut(nullptr),
     pktParse(nullptr),
@@ -107,7 +109,9 @@ AVMuxVideo::AVMuxVideo() :
     afs(false),
     debugDirectAV1Out(false),
     parse_nal_h264(get_parse_nal_unit_h264_func()),
-    parse_nal_hevc(get_parse_nal_unit_hevc_func()) {
+    parse_nal_hevc(get_parse_nal_unit_hevc_func()),
+    nalList(),
+    doviNal() {
 }
 
 AVMuxAudio::AVMuxAudio() :
@@ -171,7 +175,11 @@ AVMuxThreadWorker::AVMuxThreadWorker() :
     sentEOS(false),
     heEventPktAdded(nullptr),
     heEventClosing(nullptr),
-    qPackets() {}
+    qPackets(),
+    mtxPktAdded(),
+    cvPktAdded(),
+    pktAddedCount(0),
+    pktAddedWaiting(0) {}
 
 AVMuxThreadWorker::~AVMuxThreadWorker() {
     if (heEventPktAdded) {
@@ -195,7 +203,7 @@ void AVMuxThreadWorker::close() {
         //これを回避するため、thread.heEventClosingOutputがセットされるまで、
         //SetEvent(thread.heEventPktAddedOutput)を実行し続ける必要がある。
         while (WAIT_TIMEOUT == WaitForSingleObject(heEventClosing, 100)) {
-            SetEvent(heEventPktAdded);
+            notifyPktAdded();
         }
         thread.join();
         if (heEventPktAdded) {
@@ -210,24 +218,120 @@ void AVMuxThreadWorker::close() {
     }
 }
 
-AVMuxThreadAudio::AVMuxThreadAudio() : encode(), process() {};
+void AVMuxThreadWorker::notifyPktAdded() {
+    pktAddedCount++;
+    if (heEventPktAdded) {
+        SetEvent(heEventPktAdded);
+    }
+    //待機中のスレッドがある場合のみロックを取る
+    if (pktAddedWaiting > 0) {
+        std::lock_guard<std::mutex> lock(mtxPktAdded);
+        cvPktAdded.notify_all();
+    }
+}
+
+void AVMuxThreadWorker::waitPktAdded(uint64_t count, int timeout_ms) {
+    std::unique_lock<std::mutex> lock(mtxPktAdded);
+    pktAddedWaiting++;
+    const auto pred = [this, count]() { return pktAddedCount != count || thAbort; };
+    if (timeout_ms < 0) {
+        cvPktAdded.wait(lock, pred);
+    } else {
+        cvPktAdded.wait_for(lock, std::chrono::milliseconds(timeout_ms), pred);
+    }
+    pktAddedWaiting--;
+}
+
+AVMuxAudioTask::AVMuxAudioTask(const AVMuxAudio *muxAudio_, int type_) :
+    muxAudio(muxAudio_),
+    type(type_),
+    perfIndex(-1),
+    scheduled(false),
+    qPackets() {}
+
+AVMuxAudioTask::~AVMuxAudioTask() {
+    qPackets.close();
+}
 
-AVMuxThreadAudio::~AVMuxThreadAudio() {}
+AVMuxAudioThreadPool::AVMuxAudioThreadPool() :
+    threads(),
+    tasks(),
+    taskProcess(),
+    taskEncode(),
+    taskOther(nullptr),
+    mtx(),
+    cvReady(),
+    ready(),
+    running(0),
+    started(false),
+    abort(false),
+    queueCapacity(SIZE_MAX),
+    batchSize(1) {}
+
+AVMuxAudioThreadPool::~AVMuxAudioThreadPool() {
+    close();
+}
 
-void AVMuxThreadAudio::closeEncode() {
-    encode.close();
+AVMuxAudioTask *AVMuxAudioThreadPool::getTask(const AVMuxAudio *muxAudio, int type) {
+    if (muxAudio == nullptr) {
+        return (type == AUD_QUEUE_PROCESS) ? taskOther : nullptr;
+    }
+    if (type == AUD_QUEUE_PROCESS) {
+        //音声処理はサブストリームに分配する前なので、入力トラックごと
+        auto task = taskProcess.find(muxAudio->inTrackId);
+        return (task != taskProcess.end()) ? task->second : nullptr;
+    }
+    auto task = taskEncode.find(muxAudio);
+    return (task != taskEncode.end()) ? task->second : nullptr;
 }
 
-void AVMuxThreadAudio::closeProcess() {
-    process.close();
+void AVMuxAudioThreadPool::schedule(AVMuxAudioTask *task) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!task->scheduled) {
+        task->scheduled = true;
+        ready.push_back(task);
+        cvReady.notify_one();
+    }
 }
 
-bool AVMuxThreadAudio::threadActiveEncode() {
-    return encode.thread.joinable();
+void AVMuxAudioThreadPool::start() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (started) {
+            return;
+        }
+        started = true;
+    }
+    //ファイルヘッダの書き込み前はタスクを実行できないので、キューの上限を設けていない
+    //タスクの実行を開始したら、上限を設定する
+    //ただし、エンコードタスクのキューにはプールのスレッド自身(音声処理タスク)が追加するため、上限を設けない
+    //上限を設けると、すべてのスレッドがエンコードキューの空きを待ってブロックし、エンコードタスクを実行するスレッドがなくなる
+    for (auto& task : tasks) {
+        if (task->type == AUD_QUEUE_PROCESS) {
+            task->qPackets.set_capacity(queueCapacity);
+        }
+    }
+    cvReady.notify_all();
 }
 
-bool AVMuxThreadAudio::threadActiveProcess() {
-    return process.thread.joinable();
+void AVMuxAudioThreadPool::close() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        abort = true;
+        started = true;
+    }
+    cvReady.notify_all();
+    for (auto& th : threads) {
+        if (th.joinable()) {
+            th.join();
+        }
+    }
+    threads.clear();
+    ready.clear();
+    taskProcess.clear();
+    taskEncode.clear();
+    taskOther = nullptr;
+    tasks.clear();
 }
 
 #if ENABLE_AVCODEC_OUT_THREAD
@@ -237,10 +341,7 @@ AVMuxThread::AVMuxThread() :
     enableAudEncodeThread(false),
     thOutput(),
     qVideobitstream(),
-    qVideobitstreamFreeI(),
-    qVideobitstreamFreePB(),
-    thAud(),
-    streamOutMaxDts(0),
+    audPool(),
     queueInfo(nullptr) {
 }
 #endif
@@ -364,10 +465,11 @@ void RGYOutputAvcodec::CloseVideo(AVMuxVideo *muxVideo) {
         av_packet_unref(m_Mux.video.pktParse);
         av_packet_free(&m_Mux.video.pktParse);
     }
-    if (m_Mux.video.bsfcBuffer) {
-        free(m_Mux.video.bsfcBuffer);
-        m_Mux.video.bsfcBuffer = nullptr;
-        m_Mux.video.bsfcBufferLength = 0;
+    if (m_Mux.video.bitstreamPool) {
+        m_Mux.video.bitstreamPool->release(&m_Mux.video.bsfcBuffer);
+        m_Mux.video.bitstreamPool->release(&m_Mux.video.seiBuffer);
+        AddMessage(RGY_LOG_DEBUG, _T("bitstream pool: %s.\n"), m_Mux.video.bitstreamPool->stats().c_str());
+        m_Mux.video.bitstreamPool.reset();
     }
     m_Mux.video.doviRpu = nullptr;
     m_Mux.video.timestamp = nullptr;
@@ -415,9 +517,13 @@ void RGYOutputAvcodec::CloseFormat(AVMuxFormat *muxFormat) {
 
 void RGYOutputAvcodec::CloseQueues() {
 #if ENABLE_AVCODEC_OUT_THREAD
-    m_Mux.thread.qVideobitstream.close();
-    m_Mux.thread.qVideobitstreamFreeI.close([](RGYBitstream *pBitstream) { pBitstream->clear(); });
-    m_Mux.thread.qVideobitstreamFreePB.close([](RGYBitstream *pBitstream) { pBitstream->clear(); });
+    m_Mux.thread.qVideobitstream.close([pool = m_Mux.video.bitstreamPool](RGYBitstream *pBitstream) {
+        if (pool) {
+            pool->release(pBitstream);
+        } else {
+            pBitstream->clear();
+        }
+    });
     AddMessage(RGY_LOG_DEBUG, _T("closed queues...\n"));
 #endif
 }
@@ -425,19 +531,10 @@ void RGYOutputAvcodec::CloseQueues() {
 void RGYOutputAvcodec::CloseThread() {
 #if ENABLE_AVCODEC_OUT_THREAD
     // process -> encode -> output の順に終了させる
-    for (auto& [mux, thread] : m_Mux.thread.thAud) {
-        if (thread->process.thread.joinable()) {
-            thread->closeProcess();
-            const auto target = (mux) ? strsprintf(_T("%d.%d"), trackID(mux->inTrackId), mux->inSubStream) : tstring(_T("default"));
-            AddMessage(RGY_LOG_DEBUG, _T("closed audio process thread %s.\n"), target.c_str());
-        }
-    }
-    for (auto& [mux, thread] : m_Mux.thread.thAud) {
-        if (thread->encode.thread.joinable()) {
-            thread->closeEncode();
-            const auto target = (mux) ? strsprintf(_T("%d.%d"), trackID(mux->inTrackId), mux->inSubStream) : tstring(_T("default"));
-            AddMessage(RGY_LOG_DEBUG, _T("closed audio encode thread %s.\n"), target.c_str());
-        }
+    // 音声処理スレッドは、process・encodeの残りのタスクをすべて実行してから終了する
+    if (m_Mux.thread.audPool.active()) {
+        m_Mux.thread.audPool.close();
+        AddMessage(RGY_LOG_DEBUG, _T("closed audio threads.\n"));
     }
     if (m_Mux.thread.thOutput) {
         m_Mux.thread.thOutput->close();
@@ -819,8 +916,9 @@ RGY_ERR RGYOutputAvcodec::InitVideo(const VideoInfo *videoOutputInfo, const Avco
     m_Mux.video.afs               = prm->afs;
     m_Mux.video.debugDirectAV1Out = prm->debugDirectAV1Out;
     m_Mux.video.doviRpu           = prm->doviRpu;
-    m_Mux.video.bsfcBuffer        = nullptr;
-    m_Mux.video.bsfcBufferLength  = 0;
+    m_Mux.video.bsfcBuffer        = RGYBitstreamInit();
+    m_Mux.video.seiBuffer         = RGYBitstreamInit();
+    m_Mux.video.bitstreamPool     = RGYBitstreamPool::get();
 
     auto retm = SetMetadata(&m_Mux.video.streamOut->metadata, (prm->videoInputStream) ? prm->videoInputStream->metadata : nullptr, prm->videoMetadata, RGY_METADATA_DEFAULT_COPY_LANG_ONLY, _T("Video"));
     if (retm != RGY_ERR_NONE) {
@@ -2206,7 +2304,6 @@ RGY_ERR RGYOutputAvcodec::Init(const TCHAR *strFileName, const VideoInfo *videoO
     m_Mux.format.streamError = false;
 
 #if ENABLE_AVCODEC_OUT_THREAD
-    m_Mux.thread.streamOutMaxDts = 0;
     m_Mux.thread.queueInfo = prm->queueInfo;
     //スレッドの使用数を設定
     if (prm->threadOutput == RGY_OUTPUT_THREAD_AUTO) {
@@ -2224,8 +2321,6 @@ RGY_ERR RGYOutputAvcodec::Init(const TCHAR *strFileName, const VideoInfo *videoO
         AddMessage(RGY_LOG_DEBUG, _T("starting output thread...\n"));
         const int audioQueueCapacity = 4096;
         m_Mux.thread.qVideobitstream.init(4096, (std::max)(256, (m_Mux.video.outputFps.den) ? m_Mux.video.outputFps.num * 4 / m_Mux.video.outputFps.den : 0));
-        m_Mux.thread.qVideobitstreamFreeI.init(256);
-        m_Mux.thread.qVideobitstreamFreePB.init(3840);
         m_Mux.thread.thOutput = std::make_unique<AVMuxThreadWorker>();
         m_Mux.thread.thOutput->thAbort = false;
         m_Mux.thread.thOutput->qPackets.init(16384, audioQueueCapacity * std::max(1, (int)m_Mux.audio.size())); //字幕のみコピーするときのため、最低でもある程度は確保する
@@ -2235,33 +2330,47 @@ RGY_ERR RGYOutputAvcodec::Init(const TCHAR *strFileName, const VideoInfo *videoO
         AddMessage(RGY_LOG_DEBUG, _T("Set output thread param: %s.\n"), prm->threadParamOutput.desc().c_str());
 #if ENABLE_AVCODEC_AUDPROCESS_THREAD
         if (m_Mux.thread.enableAudProcessThread) {
-            auto muxAudioPtr = std::vector<const AVMuxAudio*>{ nullptr };
-            if (prm->threadAudio > 2) {
-                for (auto& aud : m_Mux.audio) {
-                    muxAudioPtr.push_back(&aud);
+            //トラックごと・処理の種類ごとにタスクを作成し、固定数のスレッドで実行する
+            auto& pool = m_Mux.thread.audPool;
+            for (auto& aud : m_Mux.audio) {
+                if (pool.taskProcess.count(aud.inTrackId) == 0) {
+                    pool.tasks.push_back(std::make_unique<AVMuxAudioTask>(&aud, AUD_QUEUE_PROCESS));
+                    pool.taskProcess[aud.inTrackId] = pool.tasks.back().get();
                 }
-            }
-            const auto audioQueueMultiplizer = (prm->threadAudio > 2) ? 2 : std::max(2, (int)m_Mux.audio.size());
-            for (auto mux : muxAudioPtr) {
-                const auto target = (mux) ? strsprintf(_T("%d.%d"), trackID(mux->inTrackId), mux->inSubStream) : tstring(_T("default"));
-                AddMessage(RGY_LOG_DEBUG, _T("starting audio process thread %s...\n"), target.c_str());
-                m_Mux.thread.thAud[mux] = std::make_unique<AVMuxThreadAudio>();
-                m_Mux.thread.thAud[mux]->process.thAbort = false;
-                m_Mux.thread.thAud[mux]->process.qPackets.init(16384, audioQueueCapacity * audioQueueMultiplizer, 4);
-                m_Mux.thread.thAud[mux]->process.heEventPktAdded = CreateEvent(NULL, TRUE, FALSE, NULL);
-                m_Mux.thread.thAud[mux]->process.heEventClosing = CreateEvent(NULL, TRUE, FALSE, NULL);
-                m_Mux.thread.thAud[mux]->process.thread = std::thread(&RGYOutputAvcodec::ThreadFuncAudThread, this, mux, prm->threadParamAudio);
-                AddMessage(RGY_LOG_DEBUG, _T("Set audio process thread param %s: %s.\n"), target.c_str(), prm->threadParamAudio.desc().c_str());
                 if (m_Mux.thread.enableAudEncodeThread) {
-                    AddMessage(RGY_LOG_DEBUG, _T("starting audio encode thread %s...\n"), target.c_str());
-                    m_Mux.thread.thAud[mux]->encode.thAbort = false;
-                    m_Mux.thread.thAud[mux]->encode.qPackets.init(16384, audioQueueCapacity * audioQueueMultiplizer, 4);
-                    m_Mux.thread.thAud[mux]->encode.heEventPktAdded = CreateEvent(NULL, TRUE, FALSE, NULL);
-                    m_Mux.thread.thAud[mux]->encode.heEventClosing = CreateEvent(NULL, TRUE, FALSE, NULL);
-                    m_Mux.thread.thAud[mux]->encode.thread = std::thread(&RGYOutputAvcodec::ThreadFuncAudEncodeThread, this, mux, prm->threadParamAudio);
-                    AddMessage(RGY_LOG_DEBUG, _T("Set audio encode thread param %s: %s.\n"), target.c_str(), prm->threadParamAudio.desc().c_str());
+                    pool.tasks.push_back(std::make_unique<AVMuxAudioTask>(&aud, AUD_QUEUE_ENCODE));
+                    pool.taskEncode[&aud] = pool.tasks.back().get();
                 }
             }
+            if (m_Mux.other.size() > 0) {
+                pool.tasks.push_back(std::make_unique<AVMuxAudioTask>(nullptr, AUD_QUEUE_PROCESS));
+                pool.taskOther = pool.tasks.back().get();
+            }
+            pool.queueCapacity = audioQueueCapacity * 2;
+            pool.batchSize = (m_Mux.format.lowlatency) ? 1 : AUDIO_TASK_BATCH_SIZE;
+            if (m_Mux.thread.queueInfo) {
+                m_Mux.thread.queueInfo->aud_track_count = 0;
+            }
+            for (auto& task : pool.tasks) {
+                //ファイルヘッダの書き込みまではタスクを実行しないので、キューの上限はstart()で設定する
+                task->qPackets.init(16384, SIZE_MAX, 4);
+                const auto target = (task->muxAudio == nullptr) ? tstring(_T("other")) : strsprintf(_T("%d.%d-%s"),
+                    trackID(task->muxAudio->inTrackId), (task->type == AUD_QUEUE_PROCESS) ? 0 : task->muxAudio->inSubStream, (task->type == AUD_QUEUE_PROCESS) ? _T("proc") : _T("enc"));
+                if (m_Mux.thread.queueInfo && m_Mux.thread.queueInfo->aud_track_count < PERF_AUD_TRACK_MAX) {
+                    task->perfIndex = m_Mux.thread.queueInfo->aud_track_count++;
+                    strcpy_s(m_Mux.thread.queueInfo->aud_track_name[task->perfIndex], _countof(m_Mux.thread.queueInfo->aud_track_name[task->perfIndex]), tchar_to_string(target).c_str());
+                    m_Mux.thread.queueInfo->aud_track_proc_us[task->perfIndex] = 0;
+                }
+                AddMessage(RGY_LOG_DEBUG, _T("created audio task %s.\n"), target.c_str());
+            }
+            //--thread-audio 1, 2 は全トラック合計のワーカースレッド数 (トラックごとのスレッド数ではない)
+            //--thread-audio 3 (auto) の場合は、タスク数に応じてスレッド数を決める
+            const int poolThreads = (prm->threadAudio > 2) ? clamp((int)pool.tasks.size(), 2, AUDIO_THREAD_POOL_MAX) : prm->threadAudio;
+            for (int i = 0; i < poolThreads; i++) {
+                pool.threads.push_back(std::thread(&RGYOutputAvcodec::ThreadFuncAudPool, this, prm->threadParamAudio));
+            }
+            AddMessage(RGY_LOG_DEBUG, _T("started %d audio threads for %d tasks, batch %d.\n"), poolThreads, (int)pool.tasks.size(), pool.batchSize);
+            AddMessage(RGY_LOG_DEBUG, _T("Set audio thread param: %s.\n"), prm->threadParamAudio.desc().c_str());
         }
 #endif //#if ENABLE_AVCODEC_AUDPROCESS_THREAD
     }
@@ -2272,6 +2381,10 @@ RGY_ERR RGYOutputAvcodec::Init(const TCHAR *strFileName, const VideoInfo *videoO
             return sts;
         }
         m_Mux.format.fileHeaderWritten = true;
+#if ENABLE_AVCODEC_OUT_THREAD
+        //ファイルヘッダが書き込まれたので、音声処理を開始する
+        m_Mux.thread.audPool.start();
+#endif //#if ENABLE_AVCODEC_OUT_THREAD
     }
     m_inited = true;
     return RGY_ERR_NONE;
@@ -2312,9 +2425,10 @@ RGY_ERR RGYOutputAvcodec::applyBsfToHeader(std::vector<uint8_t>& result, const u
 }
 
 RGY_ERR RGYOutputAvcodec::AddHeaderToExtraDataH264(const RGYBitstream *bitstream) {
-    std::vector<nal_info> nal_list = m_Mux.video.parse_nal_h264(bitstream->data(), bitstream->size());
-    const auto h264_sps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_H264_SPS; });
-    const auto h264_pps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_H264_PPS; });
+    auto& nal_list = m_Mux.video.nalList;
+    m_Mux.video.parse_nal_h264(nal_list, bitstream->data(), bitstream->size());
+    const auto h264_sps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](const nal_info& info) { return info.type == NALU_H264_SPS; });
+    const auto h264_pps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](const nal_info& info) { return info.type == NALU_H264_PPS; });
     const bool header_check = (nal_list.end() != h264_sps_nal) && (nal_list.end() != h264_pps_nal);
     if (header_check) {
         std::vector<uint8_t> buf_sps;
@@ -2336,10 +2450,11 @@ RGY_ERR RGYOutputAvcodec::AddHeaderToExtraDataH264(const RGYBitstream *bitstream
 
 //extradataにHEVCのヘッダーを追加する
 RGY_ERR RGYOutputAvcodec::AddHeaderToExtraDataHEVC(const RGYBitstream *bitstream) {
-    std::vector<nal_info> nal_list = m_Mux.video.parse_nal_hevc(bitstream->data(), bitstream->size());
-    const auto hevc_vps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_VPS; });
-    const auto hevc_sps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_SPS; });
-    const auto hevc_pps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_PPS; });
+    auto& nal_list = m_Mux.video.nalList;
+    m_Mux.video.parse_nal_hevc(nal_list, bitstream->data(), bitstream->size());
+    const auto hevc_vps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](const nal_info& info) { return info.type == NALU_HEVC_VPS; });
+    const auto hevc_sps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](const nal_info& info) { return info.type == NALU_HEVC_SPS; });
+    const auto hevc_pps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](const nal_info& info) { return info.type == NALU_HEVC_PPS; });
     const bool header_check = (nal_list.end() != hevc_vps_nal) && (nal_list.end() != hevc_sps_nal) && (nal_list.end() != hevc_pps_nal);
     if (header_check) {
         std::vector<uint8_t> buf_sps;
@@ -2362,15 +2477,15 @@ RGY_ERR RGYOutputAvcodec::AddHeaderToExtraDataHEVC(const RGYBitstream *bitstream
 
 //extradataにAV1のヘッダーを追加する
 RGY_ERR RGYOutputAvcodec::AddHeaderToExtraDataAV1(const RGYBitstream *bitstream) {
-    const auto unit_list = parse_unit_av1(bitstream->data(), bitstream->size());
-    auto it_seq_header = std::find_if(unit_list.begin(), unit_list.end(), [](const std::unique_ptr<unit_info>& unit) {
-        return unit->type == OBU_SEQUENCE_HEADER;
+    auto& unit_list = m_Mux.video.nalList;
+    parse_unit_av1(unit_list, bitstream->data(), bitstream->size());
+    auto it_seq_header = std::find_if(unit_list.begin(), unit_list.end(), [](const nal_info& unit) {
+        return unit.type == OBU_SEQUENCE_HEADER;
     });
     if (it_seq_header != unit_list.end()) {
-        const auto& seq_header = (it_seq_header->get())->unit_data;
-        m_Mux.video.streamOut->codecpar->extradata_size = (int)seq_header.size();
+        m_Mux.video.streamOut->codecpar->extradata_size = (int)it_seq_header->size;
         uint8_t *new_ptr = (uint8_t *)av_malloc(m_Mux.video.streamOut->codecpar->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
-        memcpy(new_ptr, seq_header.data(), m_Mux.video.streamOut->codecpar->extradata_size);
+        memcpy(new_ptr, it_seq_header->ptr, m_Mux.video.streamOut->codecpar->extradata_size);
         if (m_Mux.video.streamOut->codecpar->extradata) {
             av_free(m_Mux.video.streamOut->codecpar->extradata);
         }
@@ -2587,19 +2702,11 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrame(RGYBitstream *bitstream) {
 #if ENABLE_AVCODEC_OUT_THREAD
     if (m_Mux.thread.thOutput) {
         RGYBitstream copyStream = RGYBitstreamInit();
-        bool bFrameI = (bitstream->frametype() & RGY_FRAMETYPE_I) != 0;
-        bool bFrameP = (bitstream->frametype() & RGY_FRAMETYPE_P) != 0;
-        //IフレームかPBフレームかでサイズが大きく違うため、空きのmfxBistreamは異なるキューで管理する
-        auto& qVideoQueueFree = (bFrameI) ? m_Mux.thread.qVideobitstreamFreeI : m_Mux.thread.qVideobitstreamFreePB;
-        //空いているmfxBistreamを取り出す
-        if (!qVideoQueueFree.front_copy_and_pop_no_lock(&copyStream) || copyStream.bufsize() < bitstream->size()) {
-            //空いているmfxBistreamがない、あるいはそのバッファサイズが小さい場合は、領域を取り直す
-            const auto allocate_bytes = bitstream->size() * ((bFrameI | bFrameP) ? 2 : 8);
-            if (RGY_ERR_NONE != copyStream.init(allocate_bytes)) {
-                AddMessage(RGY_LOG_ERROR, _T("Failed to allocate memory for video bitstream output buffer, %sB.\n"), allocate_bytes);
-                m_Mux.format.streamError = true;
-                return RGY_ERR_MEMORY_ALLOC;
-            }
+        //データ領域はサイズクラスごとに管理されたプールから取り出し、書き込み後にプールに返却する
+        if (RGY_ERR_NONE != m_Mux.video.bitstreamPool->alloc(&copyStream, bitstream->size())) {
+            AddMessage(RGY_LOG_ERROR, _T("Failed to allocate memory for video bitstream output buffer, %lluB.\n"), (unsigned long long)bitstream->size());
+            m_Mux.format.streamError = true;
+            return RGY_ERR_MEMORY_ALLOC;
         }
         //必要な情報をコピー
         copyStream.setDataflag(bitstream->dataflag());
@@ -2618,7 +2725,7 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrame(RGYBitstream *bitstream) {
         }
         bitstream->setSize(0);
         bitstream->setOffset(0);
-        SetEvent(m_Mux.thread.thOutput->heEventPktAdded);
+        m_Mux.thread.thOutput->notifyPktAdded();
         return (m_Mux.format.streamError) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
     }
 #endif
@@ -2664,16 +2771,8 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameFinish(RGYBitstream *bitstream, const RG
 #if ENABLE_AVCODEC_OUT_THREAD
     //最初のヘッダーを書いたパケットはコピーではないので、キューに入れない
     if (m_Mux.thread.thOutput) {
-        //確保したメモリ領域を使いまわすためにキューに格納
-        const auto frameI = (frameType & (RGY_FRAMETYPE_IDR | RGY_FRAMETYPE_I)) != 0;
-        auto& qVideoQueueFree = (frameI) ? m_Mux.thread.qVideobitstreamFreeI : m_Mux.thread.qVideobitstreamFreePB;
-        auto queueFavoredSize = (frameI) ? VID_BITSTREAM_QUEUE_SIZE_I : VID_BITSTREAM_QUEUE_SIZE_PB;
-        if ((int64_t)qVideoQueueFree.size() > queueFavoredSize) {
-            //あまり多すぎると無駄にメモリを使用するので減らす
-            bitstream->clear();
-        } else {
-            qVideoQueueFree.push(*bitstream);
-        }
+        //確保したメモリ領域を使いまわすためにプールに返却
+        m_Mux.video.bitstreamPool->release(bitstream);
     } else {
 #endif
         bitstream->setSize(0);
@@ -2682,6 +2781,10 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameFinish(RGYBitstream *bitstream, const RG
     }
 #endif
     m_Mux.format.fileHeaderWritten = true;
+#if ENABLE_AVCODEC_OUT_THREAD
+    //ファイルヘッダが書き込まれたので、音声処理を開始する
+    m_Mux.thread.audPool.start();
+#endif //#if ENABLE_AVCODEC_OUT_THREAD
     return (m_Mux.format.streamError) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
 }
 
@@ -2693,15 +2796,16 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameInternalOneFrame(RGYBitstream *bitstream
 
     if (m_Mux.video.bsfc && m_VideoOutputInfo.codec != RGY_CODEC_AV1) {
         int target_nal = 0;
-        std::vector<nal_info> nal_list;
+        auto& nal_list = m_Mux.video.nalList;
+        nal_list.clear();
         if (m_VideoOutputInfo.codec == RGY_CODEC_HEVC) {
             target_nal = NALU_HEVC_SPS;
-            nal_list = m_Mux.video.parse_nal_hevc(bitstream->data(), bitstream->size());
+            m_Mux.video.parse_nal_hevc(nal_list, bitstream->data(), bitstream->size());
         } else if (m_VideoOutputInfo.codec == RGY_CODEC_H264) {
             target_nal = NALU_H264_SPS;
-            nal_list = m_Mux.video.parse_nal_h264(bitstream->data(), bitstream->size());
+            m_Mux.video.parse_nal_h264(nal_list, bitstream->data(), bitstream->size());
         }
-        auto sps_nal = std::find_if(nal_list.begin(), nal_list.end(), [target_nal](nal_info info) { return info.type == target_nal; });
+        auto sps_nal = std::find_if(nal_list.begin(), nal_list.end(), [target_nal](const nal_info& info) { return info.type == target_nal; });
         if (sps_nal != nal_list.end()) {
             AVPacket *pkt = m_Mux.video.pktOut;
             av_new_packet(pkt, (int)sps_nal->size);
@@ -2726,17 +2830,20 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameInternalOneFrame(RGYBitstream *bitstream
             const auto next_nal_orig_offset = sps_nal_offset + sps_nal->size;
             const auto next_nal_new_offset = sps_nal_offset + pkt->size;
             const auto stream_orig_length = bitstream->size();
-            if (m_Mux.video.bsfcBufferLength < new_data_size) {
-                free(m_Mux.video.bsfcBuffer);
-                m_Mux.video.bsfcBufferLength = new_data_size * 2;
-                m_Mux.video.bsfcBuffer = (uint8_t *)malloc(m_Mux.video.bsfcBufferLength);
+            if (m_Mux.video.bsfcBuffer.bufsize() < new_data_size) {
+                if (RGY_ERR_NONE != m_Mux.video.bitstreamPool->alloc(&m_Mux.video.bsfcBuffer, new_data_size)) {
+                    av_packet_unref(pkt);
+                    AddMessage(RGY_LOG_ERROR, _T("Failed to allocate memory for bitstream filter buffer.\n"));
+                    return RGY_ERR_MEMORY_ALLOC;
+                }
             }
+            uint8_t *bsfcBuffer = m_Mux.video.bsfcBuffer.bufptr();
             if (sps_nal_offset > 0) {
-                memcpy(m_Mux.video.bsfcBuffer, bitstream->data(), sps_nal_offset);
+                memcpy(bsfcBuffer, bitstream->data(), sps_nal_offset);
             }
-            memcpy(m_Mux.video.bsfcBuffer + sps_nal_offset, pkt->data, pkt->size);
-            memcpy(m_Mux.video.bsfcBuffer + next_nal_new_offset, bitstream->data() + next_nal_orig_offset, stream_orig_length - next_nal_orig_offset);
-            bitstream->copy(m_Mux.video.bsfcBuffer, new_data_size);
+            memcpy(bsfcBuffer + sps_nal_offset, pkt->data, pkt->size);
+            memcpy(bsfcBuffer + next_nal_new_offset, bitstream->data() + next_nal_orig_offset, stream_orig_length - next_nal_orig_offset);
+            bitstream->copy(bsfcBuffer, new_data_size);
             av_packet_unref(pkt);
 
             av_bsf_flush(m_Mux.video.bsfc);
@@ -2747,10 +2854,11 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameInternalOneFrame(RGYBitstream *bitstream
     bool isKey = (bitstream->frametype() & (RGY_FRAMETYPE_IDR | RGY_FRAMETYPE_xIDR | RGY_FRAMETYPE_I | RGY_FRAMETYPE_xI)) != 0; //Keyフレームかどうかのフラグ
     if (m_Mux.video.streamOut->codecpar->field_order != AV_FIELD_PROGRESSIVE) {
         if (m_VideoOutputInfo.codec == RGY_CODEC_H264) {
-            const auto nal_list = m_Mux.video.parse_nal_h264(bitstream->data(), bitstream->size());
+            auto& nal_list = m_Mux.video.nalList;
+            m_Mux.video.parse_nal_h264(nal_list, bitstream->data(), bitstream->size());
             //インタレ保持の際、IDRかどうかのフラグが正しく設定されていないことがある
             //どちらかのフィールドがIDRならIDRのフラグを立てる
-            isIDR = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_H264_IDR; }) != nal_list.end();
+            isIDR = std::find_if(nal_list.begin(), nal_list.end(), [](const nal_info& info) { return info.type == NALU_H264_IDR; }) != nal_list.end();
             isKey |= isIDR;
         } else if (m_VideoOutputInfo.codec == RGY_CODEC_HEVC) {
             AddMessage(RGY_LOG_ERROR, _T("Interlaced HEVC encoding not supported!\n"));
@@ -2780,13 +2888,21 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameInternalOneFrame(RGYBitstream *bitstream
 
     const bool insertSEI = (m_Mux.video.hdrBitstream.size() > 0 && isIDR);
     if (insertSEI || hdr10plusMetadata.size() > 0) {
+        //bitstreamをその場で組み立てなおすため、元のデータは使いまわしのバッファに退避してから分解する
+        const auto bsSize = bitstream->size();
+        if (RGY_ERR_NONE != m_Mux.video.bitstreamPool->alloc(&m_Mux.video.seiBuffer, bsSize)
+            || RGY_ERR_NONE != m_Mux.video.bitstreamPool->extend(bitstream, bsSize + m_Mux.video.hdrBitstream.size() + hdr10plusMetadata.size())) {
+            AddMessage(RGY_LOG_ERROR, _T("Failed to allocate memory for sei buffer.\n"));
+            return RGY_ERR_MEMORY_ALLOC;
+        }
+        RGYBitstream *bsCopy = &m_Mux.video.seiBuffer;
+        bsCopy->copy(bitstream->data(), bsSize);
         if (m_VideoOutputInfo.codec == RGY_CODEC_HEVC) {
-            RGYBitstream bsCopy = RGYBitstreamInit();
-            bsCopy.copy(bitstream);
-            const auto nal_list = m_Mux.video.parse_nal_hevc(bsCopy.data(), bsCopy.size());
-            const auto hevc_vps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_VPS; });
-            const auto hevc_sps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_SPS; });
-            const auto hevc_pps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_PPS; });
+            auto& nal_list = m_Mux.video.nalList;
+            m_Mux.video.parse_nal_hevc(nal_list, bsCopy->data(), bsCopy->size());
+            const auto hevc_vps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](const nal_info& info) { return info.type == NALU_HEVC_VPS; });
+            const auto hevc_sps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](const nal_info& info) { return info.type == NALU_HEVC_SPS; });
+            const auto hevc_pps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](const nal_info& info) { return info.type == NALU_HEVC_PPS; });
             const bool header_check = (nal_list.end() != hevc_vps_nal) || (nal_list.end() != hevc_sps_nal) || (nal_list.end() != hevc_pps_nal);
 
             bitstream->setSize(0);
@@ -2819,7 +2935,6 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameInternalOneFrame(RGYBitstream *bitstream
                     }
                 }
             }
-            bsCopy.clear();
             if (insertSEI && !seiWritten) {
                 AddMessage(RGY_LOG_ERROR, _T("Unexpected HEVC header.\n"));
                 return RGY_ERR_UNDEFINED_BEHAVIOR;
@@ -2829,11 +2944,12 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameInternalOneFrame(RGYBitstream *bitstream
                 return RGY_ERR_UNDEFINED_BEHAVIOR;
             }
         } else if (m_VideoOutputInfo.codec == RGY_CODEC_AV1) {
-            const auto av1_units = parse_unit_av1(bitstream->data(), bitstream->size());
+            auto& av1_units = m_Mux.video.nalList;
+            parse_unit_av1(av1_units, bsCopy->data(), bsCopy->size());
             bitstream->setSize(0);
             bitstream->setOffset(0);
 
-            const auto has_seq_header = std::find_if(av1_units.begin(), av1_units.end(), [](const std::unique_ptr<unit_info>& info) { return info->type == OBU_SEQUENCE_HEADER; }) != av1_units.end();
+            const auto has_seq_header = std::find_if(av1_units.begin(), av1_units.end(), [](const nal_info& info) { return info.type == OBU_SEQUENCE_HEADER; }) != av1_units.end();
             bool hdr10plus_metadata_written = false;
             if (!has_seq_header) {
                 bitstream->append(hdr10plusMetadata.data(), hdr10plusMetadata.size());
@@ -2842,15 +2958,15 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameInternalOneFrame(RGYBitstream *bitstream
 
             bool hdr_metadata_written = false;
             for (size_t i = 0; i < av1_units.size(); i++) {
-                bitstream->append(av1_units[i]->unit_data.data(), av1_units[i]->unit_data.size());
-                if (av1_units[i]->type == OBU_TEMPORAL_DELIMITER) {
-                    if (i + 1 >= av1_units.size() || av1_units[i+1]->type != OBU_SEQUENCE_HEADER) {
+                bitstream->append(av1_units[i].ptr, av1_units[i].size);
+                if (av1_units[i].type == OBU_TEMPORAL_DELIMITER) {
+                    if (i + 1 >= av1_units.size() || av1_units[i+1].type != OBU_SEQUENCE_HEADER) {
                         if (!hdr10plus_metadata_written) {
                             bitstream->append(hdr10plusMetadata.data(), hdr10plusMetadata.size());
                             hdr10plus_metadata_written = true;
                         }
                     }
-                } else if (av1_units[i]->type == OBU_SEQUENCE_HEADER) {
+                } else if (av1_units[i].type == OBU_SEQUENCE_HEADER) {
                     if (!hdr_metadata_written) {
                         bitstream->append(&m_Mux.video.hdrBitstream);
                         hdr_metadata_written = true;
@@ -2877,7 +2993,8 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameInternalOneFrame(RGYBitstream *bitstream
                 AddMessage(RGY_LOG_ERROR, _T("Failed to get frame ID for pts %lld (%lld).\n"), bitstream->pts(), bs_framedata.inputFrameId);
                 return RGY_ERR_UNDEFINED_BEHAVIOR;
             }
-            std::vector<uint8_t> dovi_nal;
+            auto& dovi_nal = m_Mux.video.doviNal;
+            dovi_nal.clear();
             if (m_Mux.video.doviRpu->get_next_rpu_nal(dovi_nal, bs_framedata.inputFrameId) != 0) {
                 AddMessage(RGY_LOG_ERROR, _T("Failed to get dovi rpu for %lld.\n"), bs_framedata.inputFrameId);
             }
@@ -3275,9 +3392,6 @@ void RGYOutputAvcodec::WriteNextPacketProcessed(AVMuxAudio *muxAudio, AVPacket *
         muxAudio->outputSampleOffset = 0;
     }
     *writtenDts = av_rescale_q(pkt->dts, muxAudio->streamOut->time_base, QUEUE_DTS_TIMEBASE);
-    if (*writtenDts != AV_NOPTS_VALUE) {
-        atomic_max(m_Mux.thread.streamOutMaxDts, *writtenDts);
-    }
     if (WRITE_PTS_DEBUG) {
         AddMessage(RGY_LOG_WARN, _T("audio %3d [%3d.%3d], %12s, pts, %lld (%d/%d) [%s]\n"),
             pkt->stream_index,trackID(muxAudio->inTrackId), muxAudio->inSubStream, char_to_tstring(avcodec_get_name(m_Mux.format.formatCtx->streams[pkt->stream_index]->codecpar->codec_id)).c_str(),
@@ -3653,9 +3767,6 @@ RGY_ERR RGYOutputAvcodec::WriteOtherPacket(AVPacket *pkt) {
     pkt->duration = (int)av_rescale_q(pkt->duration, pMuxOther->streamInTimebase, pMuxOther->streamOut->time_base);
     pkt->stream_index = pMuxOther->streamOut->index;
     pkt->pos = -1;
-    if (pkt->dts != AV_NOPTS_VALUE) {
-        atomic_max(m_Mux.thread.streamOutMaxDts, av_rescale_q(pkt->dts, timebase_conv, QUEUE_DTS_TIMEBASE));
-    }
     const auto ret_write = av_interleaved_write_frame(m_Mux.format.formatCtx, pkt);
     if (ret_write != 0) {
         AddMessage(RGY_LOG_ERROR, _T("Error: Failed to write %s stream %d frame: %s.\n"),
@@ -3684,52 +3795,24 @@ AVPktMuxData RGYOutputAvcodec::pktMuxData(AVFrame *pFrame) {
     return data;
 }
 
-//対象パケットの担当スレッドを探す
-AVMuxThreadWorker *RGYOutputAvcodec::getPacketWorker(const AVMuxAudio *muxAudio, const int type) {
-    if (type == AUD_QUEUE_OUT) {
-        return m_Mux.thread.thOutput.get();
-    }
-    auto worker = m_Mux.thread.thAud.find(muxAudio);
-    if (worker == m_Mux.thread.thAud.end()) {
-        worker = m_Mux.thread.thAud.find(nullptr);
-    }
-    return (type == AUD_QUEUE_PROCESS) ? &worker->second->process : &worker->second->encode;
-}
-
 RGY_ERR RGYOutputAvcodec::WriteNextPacket(AVPacket *pkt) {
     AVPktMuxData pktData = pktMuxData(pkt);
 #if ENABLE_AVCODEC_OUT_THREAD
     if (m_Mux.thread.thOutput) {
+        const int type = (m_Mux.thread.threadActiveAudioProcess()) ? AUD_QUEUE_PROCESS : AUD_QUEUE_OUT;
         if (pkt == nullptr) {
             //音声の全トラックにnullパケット送信
             for (uint32_t i = 0; i < m_Mux.audio.size(); i++) {
                 auto mux = &m_Mux.audio[i];
-                if (m_Mux.thread.threadActiveAudioEncode()) {
-                    getPacketWorker(mux, AUD_QUEUE_ENCODE)->qPackets.set_keep_length(0);
-                }
-                if (m_Mux.thread.threadActiveAudioProcess()) {
-                    getPacketWorker(mux, AUD_QUEUE_PROCESS)->qPackets.set_keep_length(0);
-                }
                 if (mux->inSubStream == 0) { // サブトラックには送信しない
-                    const auto worker = getPacketWorker(mux, (m_Mux.thread.threadActiveAudioProcess()) ? AUD_QUEUE_PROCESS : AUD_QUEUE_OUT);
                     AddMessage(RGY_LOG_DEBUG, _T("Send null packet to worker %d.\n"), trackID(mux->inTrackId));
                     AVPktMuxData zeroFilled = { 0 };
                     zeroFilled.muxAudio = mux;
-                    if (!worker->qPackets.push(zeroFilled)) {
-                        AddMessage(RGY_LOG_ERROR, _T("Failed to allocate memory for audio packet queue.\n"));
-                        m_Mux.format.streamError = true;
-                    }
+                    AddAudQueue(&zeroFilled, type);
                 }
             }
         } else {
-            AVMuxThreadWorker *worker = (m_Mux.thread.threadActiveAudioProcess()) ? getPacketWorker(pktData.muxAudio, AUD_QUEUE_PROCESS) : m_Mux.thread.thOutput.get();
-            auto& audioQueue = worker->qPackets;
-            auto heEventPktAdd = worker->heEventPktAdded;
-            if (!audioQueue.push(pktData)) {
-                AddMessage(RGY_LOG_ERROR, _T("Failed to allocate memory for audio packet queue.\n"));
-                m_Mux.format.streamError = true;
-            }
-            SetEvent(heEventPktAdd);
+            AddAudQueue(&pktData, type);
         }
         return (m_Mux.format.streamError) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
     }
@@ -3749,26 +3832,34 @@ RGY_ERR RGYOutputAvcodec::WriteNextPacket(AVPacket *pkt) {
 
 //指定された音声キューに追加する
 RGY_ERR RGYOutputAvcodec::AddAudQueue(AVPktMuxData *pktData, int type) {
-#if ENABLE_AVCODEC_AUDPROCESS_THREAD
-    if (m_Mux.thread.threadActiveAudioProcess()) {
-        // もともとはこうだった
-        // (type == AUD_QUEUE_OUT) ? m_Mux.thread.thOutput.get() : ((type == AUD_QUEUE_PROCESS) ? m_Mux.thread.qAudioPacketProcess : m_Mux.thread.qAudioFrameEncode;
-        AVMuxThreadWorker *worker = getPacketWorker(pktData->muxAudio, type);
-
-        //出力キューに追加する
-        auto& qAudio       = worker->qPackets;
-        auto& heEventAdded = worker->heEventPktAdded;
-        if (!qAudio.push(*pktData)) {
+#if ENABLE_AVCODEC_OUT_THREAD
+    if (type == AUD_QUEUE_OUT) {
+        if (m_Mux.thread.thOutput) {
+            //出力キューに追加する
+            auto worker = m_Mux.thread.thOutput.get();
+            if (!worker->qPackets.push(*pktData)) {
+                AddMessage(RGY_LOG_ERROR, _T("Failed to allocate memory for audio queue.\n"));
+                m_Mux.format.streamError = true;
+            }
+            worker->notifyPktAdded();
+            return (m_Mux.format.streamError) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
+        }
+    } else if (m_Mux.thread.audPool.active()) {
+        //担当のタスクのキューに追加し、実行待ちにする
+        auto task = m_Mux.thread.audPool.getTask(pktData->muxAudio, type);
+        if (task == nullptr) {
+            AddMessage(RGY_LOG_ERROR, _T("Failed to find audio task for track %d.\n"), (pktData->muxAudio) ? trackID(pktData->muxAudio->inTrackId) : -1);
+            return RGY_ERR_UNKNOWN;
+        }
+        if (!task->qPackets.push(*pktData)) {
             AddMessage(RGY_LOG_ERROR, _T("Failed to allocate memory for audio queue.\n"));
             m_Mux.format.streamError = true;
         }
-        SetEvent(heEventAdded);
+        m_Mux.thread.audPool.schedule(task);
         return (m_Mux.format.streamError) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
-    } else
-#endif //#if ENABLE_AVCODEC_AUDPROCESS_THREAD
-    {
-        return RGY_ERR_NOT_INITIALIZED;
     }
+#endif //#if ENABLE_AVCODEC_OUT_THREAD
+    return RGY_ERR_NOT_INITIALIZED;
 }
 
 //音声処理スレッドが存在する場合、この関数は音声処理スレッドによって処理される
@@ -4101,89 +4192,248 @@ RGY_ERR RGYOutputAvcodec::WriteNextAudioFrame(AVPktMuxData *pktData) {
     return (m_Mux.format.streamError) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
 }
 
-RGY_ERR RGYOutputAvcodec::ThreadFuncAudEncodeThread(const AVMuxAudio *const muxAudio, RGYParamThread threadParam) {
+RGY_ERR RGYOutputAvcodec::ThreadFuncAudPool(RGYParamThread threadParam) {
 #if ENABLE_AVCODEC_AUDPROCESS_THREAD
     threadParam.apply(GetCurrentThread());
-    auto worker = getPacketWorker(muxAudio, AUD_QUEUE_ENCODE);
-    WaitForSingleObject(worker->heEventPktAdded, INFINITE);
-    while (!worker->thAbort) {
-        if (!m_Mux.format.fileHeaderWritten) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
-        } else {
-            AVPktMuxData pktData = { 0 };
-            while (worker->qPackets.front_copy_and_pop_no_lock(&pktData, (m_Mux.thread.queueInfo) ? &m_Mux.thread.queueInfo->usage_aud_enc : nullptr)) {
-                //音声エンコードを実行、出力キューに追加する
-                WriteNextAudioFrame(&pktData);
+    RGYTrace::get().setThreadName(_T("audio"));
+    auto& pool = m_Mux.thread.audPool;
+    for (;;) {
+        AVMuxAudioTask *task = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(pool.mtx);
+            //実行待ちのタスクが来るか、停止要求の後にすべてのタスクが終了するまで待機する
+            pool.cvReady.wait(lock, [&pool]() {
+                return (pool.started && !pool.ready.empty()) || (pool.abort && pool.ready.empty() && pool.running == 0);
+            });
+            if (pool.ready.empty()) {
+                break;
+            }
+            task = pool.ready.front();
+            pool.ready.pop_front();
+            pool.running++;
+        }
+        RunAudioTask(task);
+        {
+            std::lock_guard<std::mutex> lock(pool.mtx);
+            pool.running--;
+            if (!task->qPackets.empty()) {
+                //まだパケットが残っていれば、他のタスクを先に実行できるよう末尾に戻す
+                pool.ready.push_back(task);
+                pool.cvReady.notify_one();
+            } else {
+                task->scheduled = false;
+            }
+            if (pool.abort && pool.ready.empty() && pool.running == 0) {
+                pool.cvReady.notify_all();
             }
-        }
-        if (m_Mux.format.lowlatency) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
-        } else {
-            ResetEvent(worker->heEventPktAdded);
-            WaitForSingleObject(worker->heEventPktAdded, 16);
-        }
-    }
-    {   //音声をすべてエンコード
-        AVPktMuxData pktData = { 0 };
-        while (worker->qPackets.front_copy_and_pop_no_lock(&pktData, (m_Mux.thread.queueInfo) ? &m_Mux.thread.queueInfo->usage_aud_enc : nullptr)) {
-            WriteNextAudioFrame(&pktData);
         }
     }
-    SetEvent(worker->heEventClosing);
 #endif //#if ENABLE_AVCODEC_AUDPROCESS_THREAD
     return (m_Mux.format.streamError) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
 }
 
-RGY_ERR RGYOutputAvcodec::ThreadFuncAudThread(const AVMuxAudio *const muxAudio, RGYParamThread threadParam) {
+void RGYOutputAvcodec::RunAudioTask(AVMuxAudioTask *task) {
 #if ENABLE_AVCODEC_AUDPROCESS_THREAD
-    threadParam.apply(GetCurrentThread());
-    auto worker = getPacketWorker(muxAudio, AUD_QUEUE_PROCESS);
-    WaitForSingleObject(worker->heEventPktAdded, INFINITE);
-    while (!worker->thAbort) {
-        if (!m_Mux.format.fileHeaderWritten) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    const auto timeStart = std::chrono::steady_clock::now();
+    auto queueInfo = m_Mux.thread.queueInfo;
+    size_t *queueUsage = (queueInfo) ? ((task->type == AUD_QUEUE_PROCESS) ? &queueInfo->usage_aud_proc : &queueInfo->usage_aud_enc) : nullptr;
+    AVPktMuxData pktData = { 0 };
+    for (int i = 0; i < m_Mux.thread.audPool.batchSize && task->qPackets.front_copy_and_pop_no_lock(&pktData, queueUsage); i++) {
+        if (task->type == AUD_QUEUE_PROCESS) {
+            //音声処理を実行、エンコードキューまたは出力キューに追加する
+            RGYTraceScope trace(RGYTraceCat::OUTPUT, _T("audio"), _T("process"));
+            WriteNextPacketInternal(&pktData, INT64_MAX);
         } else {
-            AVPktMuxData pktData = { 0 };
-            while (worker->qPackets.front_copy_and_pop_no_lock(&pktData, (m_Mux.thread.queueInfo) ? &m_Mux.thread.queueInfo->usage_aud_proc : nullptr)) {
-                //音声処理を実行、出力キューに追加する
-                WriteNextPacketInternal(&pktData, INT64_MAX);
+            //音声エンコードを実行、出力キューに追加する
+            RGYTraceScope trace(RGYTraceCat::OUTPUT, _T("audio"), _T("encode"));
+            WriteNextAudioFrame(&pktData);
+        }
+    }
+    //同じタスクは同時に実行されないので、タスクごとの処理時間はロックなしで加算できる
+    if (queueInfo && task->perfIndex >= 0) {
+        queueInfo->aud_track_proc_us[task->perfIndex] += (size_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - timeStart).count();
+    }
+#endif //#if ENABLE_AVCODEC_AUDPROCESS_THREAD
+}
+
+#if ENABLE_AVCODEC_OUT_THREAD
+RGYMuxInterleaver::RGYMuxInterleaver(int64_t dtsThreshold, AVRational timebase) :
+    m_dtsThreshold(dtsThreshold),
+    m_timebase(timebase),
+    m_videoId(-1),
+    m_videoDelay(0.0),
+    m_streams() {
+}
+
+RGYMuxInterleaver::~RGYMuxInterleaver() {
+}
+
+int RGYMuxInterleaver::addStream(const tstring& name, size_t pendingLimit, bool sparse) {
+    Stream stream;
+    stream.name = name;
+    stream.lastDts = 0;
+    stream.pending = 0;
+    stream.limit = (std::max<size_t>)(pendingLimit, 1);
+    stream.packetsPerSec = 0;
+    stream.sparse = sparse;
+    stream.eos = false;
+    stream.stalled = false;
+    m_streams.push_back(stream);
+    return (int)m_streams.size() - 1;
+}
+
+void RGYMuxInterleaver::setVideoStream(int id) {
+    m_videoId = id;
+}
+
+void RGYMuxInterleaver::setAudioPacketsPerSec(int id, int packetsPerSec) {
+    if (packetsPerSec > m_streams[id].packetsPerSec) {
+        m_streams[id].packetsPerSec = packetsPerSec;
+        updateAudioPendingLimit(id);
+    }
+}
+
+void RGYMuxInterleaver::updateAudioPendingLimit(int id) {
+    auto& stream = m_streams[id];
+    if (stream.packetsPerSec > 0) {
+        const auto limit = (size_t)(stream.packetsPerSec * (std::max)(AUDIO_PENDING_LIMIT_SEC, m_videoDelay * 1.5) + 0.5);
+        stream.limit = (std::max)(limit, AUDIO_PENDING_LIMIT_MIN);
+    }
+}
+
+void RGYMuxInterleaver::measureVideoDelay() {
+    //映像が途切れている間は計測せず、映像のパケットが再び来た時点での遅れを計測する
+    if (m_videoId < 0 || m_streams[m_videoId].stalled) {
+        return;
+    }
+    double delay = m_videoDelay;
+    for (const auto& stream : m_streams) {
+        if (stream.packetsPerSec > 0) {
+            delay = (std::max)(delay, (stream.lastDts - m_streams[m_videoId].lastDts) * av_q2d(m_timebase));
+        }
+    }
+    if (delay > m_videoDelay) {
+        m_videoDelay = delay;
+        for (int id = 0; id < (int)m_streams.size(); id++) {
+            updateAudioPendingLimit(id);
+        }
+    }
+}
+
+void RGYMuxInterleaver::setPending(int id, size_t pending) {
+    m_streams[id].pending = pending;
+    if (pending > 0 && m_streams[id].stalled) {
+        //パケットが来たので、途切れた状態を解除する
+        m_streams[id].stalled = false;
+        if (id == m_videoId) {
+            measureVideoDelay();
+        }
+    }
+}
+
+void RGYMuxInterleaver::setPendingLimit(int id, size_t pendingLimit) {
+    m_streams[id].limit = (std::max<size_t>)(pendingLimit, 1);
+}
+
+void RGYMuxInterleaver::written(int id, int64_t dts) {
+    m_streams[id].lastDts = (std::max)(m_streams[id].lastDts, dts);
+    if (m_streams[id].packetsPerSec > 0) {
+        measureVideoDelay();
+    }
+}
+
+void RGYMuxInterleaver::setEOS(int id) {
+    m_streams[id].eos = true;
+}
+
+int RGYMuxInterleaver::next(bool flush, int *stalled) {
+    if (stalled) {
+        *stalled = -1;
+    }
+    //出力待ちのパケットのあるストリームのうち最も遅れているものと、
+    //出力待ちのパケットのないストリームのうち、待つ必要のあるものの最小のdtsを求める
+    int candidate = -1;
+    int64_t blockDts = INT64_MAX;
+    for (int id = 0; id < (int)m_streams.size(); id++) {
+        const auto& stream = m_streams[id];
+        if (stream.pending > 0) {
+            if (candidate < 0 || stream.lastDts < m_streams[candidate].lastDts) {
+                candidate = id;
             }
+        } else if (!stream.sparse && !stream.eos && !stream.stalled) {
+            blockDts = (std::min)(blockDts, stream.lastDts);
         }
-        if (m_Mux.format.lowlatency) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
-        } else {
-            ResetEvent(worker->heEventPktAdded);
-            WaitForSingleObject(worker->heEventPktAdded, 16);
+    }
+    if (candidate < 0) {
+        return -1;
+    }
+    if (flush || blockDts == INT64_MAX || m_streams[candidate].lastDts <= blockDts + m_dtsThreshold) {
+        return candidate;
+    }
+    //出力待ちのパケット数が上限に達したストリームがあれば、そのうち最もdtsの小さいものを書き出す
+    int overflow = -1;
+    for (int id = 0; id < (int)m_streams.size(); id++) {
+        const auto& stream = m_streams[id];
+        if (stream.pending > 0 && stream.pending >= stream.limit
+            && (overflow < 0 || stream.lastDts < m_streams[overflow].lastDts)) {
+            overflow = id;
         }
     }
-    {   //音声をすべて書き出す
-        AVPktMuxData pktData = { 0 };
-        while (worker->qPackets.front_copy_and_pop_no_lock(&pktData, (m_Mux.thread.queueInfo) ? &m_Mux.thread.queueInfo->usage_aud_proc : nullptr)) {
-            //音声処理を実行、出力キューに追加する
-            WriteNextPacketInternal(&pktData, INT64_MAX);
+    if (overflow < 0) {
+        return -1;
+    }
+    //待たせていたストリームは途切れたものとみなし、次のパケットが来るまで待たないようにする
+    //書き出し済みのdtsは変更しないので、パケットが来たら遅れている分から書き出される
+    for (int ib = 0; ib < (int)m_streams.size(); ib++) {
+        auto& blocker = m_streams[ib];
+        if (blocker.pending == 0 && !blocker.sparse && !blocker.eos && !blocker.stalled
+            && m_streams[overflow].lastDts > blocker.lastDts + m_dtsThreshold) {
+            blocker.stalled = true;
+            if (stalled && *stalled < 0) {
+                *stalled = ib;
+            }
         }
     }
-    SetEvent(worker->heEventClosing);
-#endif //#if ENABLE_AVCODEC_AUDPROCESS_THREAD
-    return (m_Mux.format.streamError) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
+    return overflow;
 }
+#endif //#if ENABLE_AVCODEC_OUT_THREAD
 
 RGY_ERR RGYOutputAvcodec::WriteThreadFunc(RGYParamThread threadParam) {
 #if ENABLE_AVCODEC_OUT_THREAD
     threadParam.apply(GetCurrentThread());
-    //映像と音声の同期をとる際に、それをあきらめるまでの閾値
-    const int nWaitThreshold = 32;
-    //キューにデータが存在するか
-    bool bAudioExists = false;
-    bool bVideoExists = false;
+    RGYTrace::get().setThreadName(_T("output"));
+    auto worker = m_Mux.thread.thOutput.get();
     const auto fpsTimebase = av_inv_q(m_Mux.video.outputFps);
     const int VideoAudioPickSwitchThresholdFrames = m_Mux.format.lowlatency ? 1 : 4; // 映像-音声の切り替え間隔(フレーム数)
     const auto dtsThreshold = std::max<int64_t>(av_rescale_q(VideoAudioPickSwitchThresholdFrames, fpsTimebase, QUEUE_DTS_TIMEBASE), 4);
-    //syncIgnoreDtsは映像と音声の同期を行う必要がないことを意味する
-    //dtsThresholdを加算したときにオーバーフローしないよう、dtsThresholdを引いておく
-    const int64_t syncIgnoreDts = INT64_MAX - dtsThreshold;
-    int64_t audioDts = (m_Mux.audio.size() + m_Mux.other.size()) ? 0 : syncIgnoreDts;
-    int64_t videoDts = (m_Mux.video.streamOut) ? 0 : syncIgnoreDts;
+    //出力待ちのパケット数の上限
+    //これを超えた場合は、他のストリームを待たずに書き出す (音声が途中までしかなかったり、途中からしかなかったりする場合)
+    //映像はキューがあふれて(エンコードが止まって)しまう前に書き出すようにする
+    //音声は映像の遅れに合わせて決める (RGYMuxInterleaver::setAudioPacketsPerSec)
+    const size_t videoPendingLimit = m_Mux.thread.qVideobitstream.capacity() * 3 / 4;
+    const size_t OTHER_PENDING_LIMIT = 1024;
+    RGYMuxInterleaver interleaver(dtsThreshold, QUEUE_DTS_TIMEBASE);
+    //各ストリームの出力待ちのパケット (映像はqVideobitstreamから直接取り出す)
+    std::vector<std::deque<AVPktMuxData>> pending;
+    std::unordered_map<const void *, int> streamIndex;
+    auto addStream = [&](const void *key, const tstring& name, size_t pendingLimit, bool sparse) {
+        const int id = interleaver.addStream(name, pendingLimit, sparse);
+        streamIndex[key] = id;
+        pending.push_back(std::deque<AVPktMuxData>());
+        return id;
+    };
+    const int videoId = (m_Mux.video.streamOut) ? addStream(&m_Mux.video, _T("video"), videoPendingLimit, false) : -1;
+    if (videoId >= 0) {
+        interleaver.setVideoStream(videoId);
+    }
+    for (auto& aud : m_Mux.audio) {
+        const int id = addStream(&aud, strsprintf(_T("audio #%d.%d"), trackID(aud.inTrackId), aud.inSubStream), 0, false);
+        interleaver.setAudioPacketsPerSec(id, RGYMuxInterleaver::AUDIO_PACKETS_PER_SEC_DEFAULT);
+    }
+    for (auto& other : m_Mux.other) {
+        //字幕などは疎なので、他のストリームを待たせない
+        addStream(&other, strsprintf(_T("other #%d"), trackID(other.inTrackId)), OTHER_PENDING_LIMIT, true);
+    }
     auto writeProcessedPacket = [this](AVPktMuxData *pktData) {
         //音声処理スレッドが別にあるなら、出力スレッドがすべきことは単に出力するだけ
         auto sts = RGY_ERR_NONE;
@@ -4198,177 +4448,111 @@ RGY_ERR RGYOutputAvcodec::WriteThreadFunc(RGYParamThread threadParam) {
         }
         return sts;
     };
-    bool bThAudProcess = false;
-    int audPacketsPerSec = 64;
-    int nWaitAudio = 0;
-    int nWaitVideo = 0;
-    while (!m_Mux.thread.thOutput->thAbort) {
-        // 起動遅れの場合がありえるのでここでチェック
-        if (!bThAudProcess && m_Mux.thread.threadActiveAudioProcess()) {
-            bThAudProcess = true;
-        }
-        do {
-            if (!m_Mux.format.fileHeaderWritten) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
-                //ヘッダー取得前に音声キューのサイズが足りず、エンコードが進まなくなってしまうことがある
-                //キューのcapcityを増やすことでこれを回避する
-                if (!m_Mux.thread.threadActiveAudioProcess()) {
-                    auto worker = m_Mux.thread.thOutput.get();
-                    auto& qAudio = worker->qPackets;
-                    const auto nQueueCapacity = qAudio.capacity();
-                    if (qAudio.size() >= nQueueCapacity) {
-                        qAudio.set_capacity(nQueueCapacity * 3 / 2);
-                    }
-                } else {
-                    for (auto& [mux, thAud] : m_Mux.thread.thAud) {
-                        auto worker = getPacketWorker(mux, AUD_QUEUE_PROCESS);
-                        auto& qAudio = worker->qPackets;
-                        const auto nQueueCapacity = qAudio.capacity();
-                        if (qAudio.size() >= nQueueCapacity) {
-                            qAudio.set_capacity(nQueueCapacity * 3 / 2);
-                        }
-                    }
-                }
-                //動画キューになにもなかったら再度待機する
-                if (m_Mux.thread.qVideobitstream.size() == 0) {
-                    break;
-                }
+    //出力キューのパケットをすべて取り出し、ストリームごとに振り分ける
+    auto drainPackets = [&]() {
+        AVPktMuxData pktData = { 0 };
+        while (worker->qPackets.front_copy_and_pop_no_lock(&pktData, (m_Mux.thread.queueInfo) ? &m_Mux.thread.queueInfo->usage_aud_out : nullptr)) {
+            const void *key = (pktData.muxAudio) ? (const void *)pktData.muxAudio : ((pktData.pkt) ? (const void *)getOtherPacketStreamData(pktData.pkt) : nullptr);
+            auto it = streamIndex.find(key);
+            const int id = (it != streamIndex.end()) ? it->second : addStream(key, _T("unknown"), OTHER_PENDING_LIMIT, true);
+            if (pktData.muxAudio && pktData.muxAudio->streamIn && pktData.pkt && pktData.pkt->duration > 0) {
+                const int packetsPerSec = (int)(1.0 / (av_q2d(pktData.muxAudio->streamIn->time_base) * pktData.pkt->duration) + 0.5);
+                interleaver.setAudioPacketsPerSec(id, packetsPerSec);
             }
-            //映像・音声の同期待ちが必要な場合、falseとなってループから抜けるよう、ここでfalseに設定する
-            bAudioExists = false;
-            bVideoExists = false;
+            pending[id].push_back(pktData);
+            interleaver.setPending(id, pending[id].size());
+        }
+        if (videoId >= 0) {
+            interleaver.setPending(videoId, m_Mux.thread.qVideobitstream.size());
+        }
+    };
+    //指定したストリームのパケットを1つ書き出す
+    auto writeStream = [&](const int id, const bool flush) {
+        if (id == videoId) {
             RGYBitstream bitstream = RGYBitstreamInit();
-            while ((audioDts < 0 || videoDts <= audioDts + dtsThreshold)
-                && false != (bVideoExists = m_Mux.thread.qVideobitstream.front_copy_and_pop_no_lock(&bitstream, (m_Mux.thread.queueInfo) ? &m_Mux.thread.queueInfo->usage_vid_out : nullptr))) {
+            if (m_Mux.thread.qVideobitstream.front_copy_and_pop_no_lock(&bitstream, (m_Mux.thread.queueInfo) ? &m_Mux.thread.queueInfo->usage_vid_out : nullptr)) {
+                RGYTraceScope trace(RGYTraceCat::OUTPUT, _T("mux"), _T("video"));
+                int64_t videoDts = interleaver.lastDts(id);
                 WriteNextFrameInternal(&bitstream, &videoDts);
-                nWaitVideo = 0;
+                interleaver.written(id, videoDts);
                 const auto log_level = RGY_LOG_TRACE;
                 if (m_printMes && log_level >= m_printMes->getLogLevel(RGY_LOGT_OUT)) {
                     AddMessage(log_level, _T("videoDts=%8lld: %s.\n"), videoDts, getTimestampString(videoDts, QUEUE_DTS_TIMEBASE).c_str());
                 }
             }
-            AVPktMuxData pktData = { 0 };
-            while ((videoDts < 0 || audioDts <= videoDts + dtsThreshold)
-                && false != (bAudioExists = m_Mux.thread.thOutput->qPackets.front_copy_and_pop_no_lock(&pktData, (m_Mux.thread.queueInfo) ? &m_Mux.thread.queueInfo->usage_aud_out : nullptr))) {
-                if (pktData.muxAudio && pktData.muxAudio->streamIn && pktData.pkt) {
-                    audPacketsPerSec = std::max(audPacketsPerSec, (int)(1.0 / (av_q2d(pktData.muxAudio->streamIn->time_base) * pktData.pkt->duration) + 0.5));
-                    const auto videoDelay = (audioDts - videoDts) * av_q2d(QUEUE_DTS_TIMEBASE);
-                    const auto streamQueueCapacity = (int)(audPacketsPerSec * std::max(5.0, videoDelay * 1.5) * std::max((int)m_Mux.audio.size(), 1) + 0.5);
-                    if ((int)m_Mux.thread.thOutput->qPackets.capacity() < streamQueueCapacity) {
-                        m_Mux.thread.thOutput->qPackets.set_capacity(streamQueueCapacity);
-                    }
-                }
-                const int64_t maxDts = (videoDts >= 0) ? videoDts + dtsThreshold : syncIgnoreDts;
-                //音声処理スレッドが別にあるなら、出力スレッドがすべきことは単に出力するだけ
-                (m_Mux.thread.threadActiveAudioProcess()) ? writeProcessedPacket(&pktData) : WriteNextPacketInternal(&pktData, maxDts);
-                //複数のstreamがあり得るので最大値をとる
-                if (pktData.dts != AV_NOPTS_VALUE && pktData.dts != (int64_t)((uint64_t)AV_NOPTS_VALUE - 1)) {
-                    audioDts = (std::max)(audioDts, (std::max)(pktData.dts, m_Mux.thread.streamOutMaxDts.load()));
-                }
-                nWaitAudio = 0;
-                const auto log_level = RGY_LOG_TRACE;
-                if (m_printMes && log_level >= m_printMes->getLogLevel(RGY_LOGT_OUT)) {
-                    AddMessage(log_level, _T("audioDts=%8lld: %s, maxDst=%8lld.\n"), audioDts, getTimestampString(audioDts, QUEUE_DTS_TIMEBASE).c_str(), maxDts);
+            interleaver.setPending(id, m_Mux.thread.qVideobitstream.size());
+            return;
+        }
+        AVPktMuxData pktData = pending[id].front();
+        pending[id].pop_front();
+        interleaver.setPending(id, pending[id].size());
+        const int64_t maxDts = (videoId >= 0 && !flush && !interleaver.stalled(videoId)) ? interleaver.lastDts(videoId) + dtsThreshold : INT64_MAX;
+        RGYTraceScope trace(RGYTraceCat::OUTPUT, _T("mux"), _T("audio"));
+        //音声処理スレッドが別にあるなら、出力スレッドがすべきことは単に出力するだけ
+        (m_Mux.thread.threadActiveAudioProcess()) ? writeProcessedPacket(&pktData) : WriteNextPacketInternal(&pktData, maxDts);
+        if (pktData.dts != AV_NOPTS_VALUE && pktData.dts != (int64_t)((uint64_t)AV_NOPTS_VALUE - 1)) {
+            interleaver.written(id, pktData.dts);
+        }
+        if (pktData.pkt == nullptr && pktData.muxAudio) {
+            //nullパケットはトラック全体のフラッシュなので、同じトラックのサブストリームも終了とする
+            for (auto& aud : m_Mux.audio) {
+                if (aud.inTrackId == pktData.muxAudio->inTrackId) {
+                    interleaver.setEOS(streamIndex[&aud]);
                 }
             }
-            //一定以上の動画フレームがキューにたまっており、音声キューになにもなければ、
-            //音声を無視して動画フレームの処理を開始させる
-            //音声が途中までしかなかったり、途中からしかなかったりする場合にこうした処理が必要
-            const size_t videoPacketThreshold = std::min<size_t>(3072, m_Mux.thread.qVideobitstream.capacity()) - nWaitThreshold;
-            if (m_Mux.thread.thOutput->qPackets.size() == 0 && m_Mux.thread.qVideobitstream.size() > videoPacketThreshold) {
-                nWaitAudio++;
-                if (nWaitAudio <= nWaitThreshold) {
-                    //時折まだパケットが来ているのにタイミングによってsize() == 0が成立することがある
-                    //なのである程度連続でパケットが来ていないときのみ無視するようにする
-                    //このようにすることで適切に同期がとれる
-                    //また、映像キューのサイズが足りないことが考えられるので、拡大する
-                    m_Mux.thread.qVideobitstream.set_capacity(m_Mux.thread.qVideobitstream.capacity() + 50);
-                    break;
-                }
-                audioDts = videoDts;
-                AddMessage(RGY_LOG_TRACE, _T("audio not coming.\n"));
+        }
+        const auto log_level = RGY_LOG_TRACE;
+        if (m_printMes && log_level >= m_printMes->getLogLevel(RGY_LOGT_OUT)) {
+            const auto audioDts = interleaver.lastDts(id);
+            AddMessage(log_level, _T("%s: dts=%8lld: %s, maxDst=%8lld.\n"), interleaver.name(id).c_str(), audioDts, getTimestampString(audioDts, QUEUE_DTS_TIMEBASE).c_str(), maxDts);
+        }
+    };
+    while (!worker->thAbort) {
+        //追加の通知を取りこぼさないよう、キューを確認する前にカウンタを取得しておく
+        const auto pktAddedCount = worker->pktAddedCount.load();
+        drainPackets();
+        for (;;) {
+            int id = -1;
+            int stalled = -1;
+            if (m_Mux.format.fileHeaderWritten) {
+                id = interleaver.next(false, &stalled);
+            } else if (videoId >= 0 && interleaver.pending(videoId) > 0) {
+                //ファイルヘッダは最初の映像フレームの書き出し時に書き込まれるので、それまでは映像のみ書き出す
+                id = videoId;
             }
-            //一定以上の音声フレームがキューにたまっており、動画キューになにもなければ、
-            //動画を無視して音声フレームの処理を開始させる
-            const size_t audioPacketThreshold = std::min<size_t>(6144, m_Mux.thread.thOutput->qPackets.capacity()) - nWaitThreshold;
-            if (m_Mux.thread.qVideobitstream.size() == 0 && m_Mux.thread.thOutput->qPackets.size() > audioPacketThreshold) {
-                nWaitVideo++;
-                if (nWaitVideo <= nWaitThreshold) {
-                    //時折まだパケットが来ているのにタイミングによってsize() == 0が成立することがある
-                    //なのである程度連続でパケットが来ていないときのみ無視するようにする
-                    //このようにすることで適切に同期がとれる
-                    //また、音声キューのサイズが足りないことが考えられるので、拡大する
-                    m_Mux.thread.thOutput->qPackets.set_capacity(m_Mux.thread.thOutput->qPackets.capacity() * 3 / 2);
-                    break;
-                }
-                videoDts = audioDts;
-                AddMessage(RGY_LOG_TRACE, _T("video not coming.\n"));
+            if (id < 0) {
+                break;
             }
-        } while (bAudioExists || bVideoExists); //両方のキューがひとまず空になるか、映像・音声の同期待ちが必要になるまで回す
-                                                //次のフレーム・パケットが送られてくるまで待機する
-        //キューの容量が両方とも半分以下なら、すこし待ってみる
-        //一方、どちらかのキューが半分以上使われていれば、なるべく早く処理する必要がある
-        if (   m_Mux.thread.qVideobitstream.size() / (double)m_Mux.thread.qVideobitstream.capacity() < 0.5
-            && m_Mux.thread.thOutput->qPackets.size() / (double)m_Mux.thread.thOutput->qPackets.capacity() < 0.5) {
-            if (m_Mux.format.lowlatency) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
-            } else {
-                ResetEvent(m_Mux.thread.thOutput->heEventPktAdded);
-                WaitForSingleObject(m_Mux.thread.thOutput->heEventPktAdded, 16);
+            if (stalled >= 0) {
+                AddMessage(RGY_LOG_TRACE, _T("%s not coming.\n"), interleaver.name(stalled).c_str());
             }
-        } else {
-            std::this_thread::yield();
+            writeStream(id, false);
         }
+        //書き出せるパケットがなくなったら、次のパケットが追加されるまで待機する
+        //映像のないファイルではファイルヘッダが別スレッドで書き込まれるので、それまでは短い間隔で確認する
+        worker->waitPktAdded(pktAddedCount, (m_Mux.format.fileHeaderWritten) ? -1 : 1);
     }
     //メインループを抜けたことを通知する
-    SetEvent(m_Mux.thread.thOutput->heEventClosing);
-    m_Mux.thread.thOutput->qPackets.set_keep_length(0);
+    SetEvent(worker->heEventClosing);
+    worker->qPackets.set_keep_length(0);
     m_Mux.thread.qVideobitstream.set_keep_length(0);
-    bAudioExists = !m_Mux.thread.thOutput->qPackets.empty();
-    bVideoExists = !m_Mux.thread.qVideobitstream.empty();
-    //まずは映像と音声の同期をとって出力するためのループ
-    while (bAudioExists && bVideoExists) {
-        AVPktMuxData pktData = { 0 };
-        while (audioDts <= videoDts + dtsThreshold
-            && false != (bAudioExists = m_Mux.thread.thOutput->qPackets.front_copy_and_pop_no_lock(&pktData, (m_Mux.thread.queueInfo) ? &m_Mux.thread.queueInfo->usage_aud_out : nullptr))) {
-            //音声処理スレッドが別にあるなら、出力スレッドがすべきことは単に出力するだけ
-            const int64_t maxDts = (videoDts >= 0) ? videoDts + dtsThreshold : INT64_MAX;
-            (bThAudProcess) ? writeProcessedPacket(&pktData) : WriteNextPacketInternal(&pktData, maxDts);
-            //複数のstreamがあり得るので最大値をとる
-            if (pktData.dts != AV_NOPTS_VALUE && pktData.dts != (int64_t)((uint64_t)AV_NOPTS_VALUE - 1)) {
-                audioDts = (std::max)(audioDts, pktData.dts);
-            }
-        }
-        RGYBitstream bitstream = RGYBitstreamInit();
-        while (videoDts <= audioDts + dtsThreshold
-            && false != (bVideoExists = m_Mux.thread.qVideobitstream.front_copy_and_pop_no_lock(&bitstream, (m_Mux.thread.queueInfo) ? &m_Mux.thread.queueInfo->usage_vid_out : nullptr))) {
-            WriteNextFrameInternal(&bitstream, &videoDts);
-        }
-        bAudioExists = !m_Mux.thread.thOutput->qPackets.empty();
-        bVideoExists = !m_Mux.thread.qVideobitstream.empty();
-    }
-    { //音声を書き出す
-        AVPktMuxData pktData = { 0 };
-        while (m_Mux.thread.thOutput->qPackets.front_copy_and_pop_no_lock(&pktData, (m_Mux.thread.queueInfo) ? &m_Mux.thread.queueInfo->usage_aud_out : nullptr)) {
-            //音声処理スレッドが別にあるなら、出力スレッドがすべきことは単に出力するだけ
-            (bThAudProcess) ? writeProcessedPacket(&pktData) : WriteNextPacketInternal(&pktData, INT64_MAX);
-        }
+    //残りのパケットを、他のストリームを待たずにdts順に書き出す
+    drainPackets();
+    for (int id = -1; (id = interleaver.next(true, nullptr)) >= 0; ) {
+        writeStream(id, true);
     }
-    { //動画を書き出す
+    {   //空のbitstreamを送って終了を通知する
         RGYBitstream bitstream = RGYBitstreamInit();
-        while (m_Mux.thread.qVideobitstream.front_copy_and_pop_no_lock(&bitstream, (m_Mux.thread.queueInfo) ? &m_Mux.thread.queueInfo->usage_vid_out : nullptr)) {
-            WriteNextFrameInternal(&bitstream, &videoDts);
-        }
-        //空のbitstreamを送って終了を通知する
-        bitstream = RGYBitstreamInit();
+        int64_t videoDts = (videoId >= 0) ? interleaver.lastDts(videoId) : 0;
         WriteNextFrameInternal(&bitstream, &videoDts);
     }
 #endif
     return (m_Mux.format.streamError) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
 }
 
-void RGYOutputAvcodec::WaitFin() {
+RGY_ERR RGYOutputAvcodec::WaitFin() {
     CloseThread();
+    return (m_Mux.format.streamError) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
 }
 
 HANDLE RGYOutputAvcodec::getThreadHandleOutput() {
@@ -4379,22 +4563,6 @@ HANDLE RGYOutputAvcodec::getThreadHandleOutput() {
 #endif
 }
 
-HANDLE RGYOutputAvcodec::getThreadHandleAudProcess() {
-#if ENABLE_AVCODEC_OUT_THREAD && ENABLE_AVCODEC_AUDPROCESS_THREAD
-    return (m_Mux.thread.threadActiveAudioProcess()) ? (HANDLE)m_Mux.thread.thAud[nullptr]->process.thread.native_handle() : nullptr;
-#else
-    return NULL;
-#endif
-}
-
-HANDLE RGYOutputAvcodec::getThreadHandleAudEncode() {
-#if ENABLE_AVCODEC_OUT_THREAD && ENABLE_AVCODEC_AUDPROCESS_THREAD
-    return (m_Mux.thread.threadActiveAudioEncode()) ? (HANDLE)m_Mux.thread.thAud[nullptr]->encode.thread.native_handle() : nullptr;
-#else
-    return NULL;
-#endif
-}
-
 #if USE_CUSTOM_IO
 int RGYOutputAvcodec::readPacket(uint8_t *buf, int buf_size) {
     return (int)_fread_nolock(buf, 1, buf_size, m_Mux.format.fpOutput);
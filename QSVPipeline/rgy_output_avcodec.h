@@ -36,12 +36,15 @@
 #include <thread>
 #include <deque>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
 #include <unordered_map>
 #include <cstdint>
 #include "rgy_avutil.h"
 #include "rgy_bitstream.h"
 #include "rgy_input_avcodec.h"
 #include "rgy_output.h"
+#include "rgy_bitstream_pool.h"
 #include "rgy_perf_monitor.h"
 #include "rgy_util.h"
 #if ENCODER_NVENC
@@ -59,9 +62,8 @@ using std::vector;
 #define USE_CUSTOM_IO 1
 
 static const int SUB_ENC_BUF_MAX_SIZE = 1024 * 1024;
-
-static const int VID_BITSTREAM_QUEUE_SIZE_I  = 4;
-static const int VID_BITSTREAM_QUEUE_SIZE_PB = 64;
+static const int AUDIO_TASK_BATCH_SIZE = 16; //音声処理タスクの1回の実行で処理するパケット数の上限
+static const int AUDIO_THREAD_POOL_MAX = 4;  //音声処理スレッドの最大数 (--thread-audio 3 の場合)
 
 enum RGYMetadataCopyDefault {
     RGY_METADATA_DEFAULT_CLEAR,
@@ -145,8 +147,9 @@ struct AVMuxVideo {
     RGYBitstream          hdrBitstream;         //追加のsei nal
     DOVIRpu              *doviRpu;              //dovi rpu 追加用
     AVBSFContext         *bsfc;                 //必要なら使用するbitstreamfilter
-    uint8_t              *bsfcBuffer;           //bitstreamfilter用のバッファ
-    size_t                bsfcBufferLength;     //bitstreamfilter用のバッファの長さ
+    RGYBitstream          bsfcBuffer;           //bitstreamfilter用のバッファ
+    RGYBitstream          seiBuffer;            //sei挿入時に元のbitstreamを退避するバッファ
+    std::shared_ptr<RGYBitstreamPool> bitstreamPool; //映像のビットストリームのバッファを使いまわすためのプール
     RGYTimestamp         *timestamp;            //timestampの情報
     AVPacket             *pktOut;               //出力用のAVPacket
     AVPacket             *pktParse;             //parser用のAVPacket
@@ -158,6 +161,8 @@ struct AVMuxVideo {
     bool                  debugDirectAV1Out;    //AV1出力のデバッグ用
     decltype(parse_nal_unit_h264_c) *parse_nal_h264; // H.264用のnal unit分解関数へのポインタ
     decltype(parse_nal_unit_hevc_c) *parse_nal_hevc; // HEVC用のnal unit分解関数へのポインタ
+    std::vector<nal_info> nalList;              //nal unit分解結果 (フレームごとに使いまわす)
+    std::vector<uint8_t>  doviNal;              //dovi rpu用のバッファ (フレームごとに使いまわす)
 
     AVMuxVideo();
 };
@@ -260,37 +265,143 @@ struct AVMuxThreadWorker {
     bool                           sentEOS;         //EOSパケットを送信側からこのworkerに送ったことを示す
     HANDLE                         heEventPktAdded; //キューのいずれかにデータが追加されたことを通知する
     HANDLE                         heEventClosing;  //音声処理スレッドが停止処理を開始したことを通知する
-    RGYQueueMPMP<AVPktMuxData, 64> qPackets;        //音声パケットをスレッドに渡すためのキュー
+    RGYQueueRing<AVPktMuxData, 64> qPackets;        //音声パケットをスレッドに渡すためのキュー
+    std::mutex                     mtxPktAdded;     //cvPktAddedの待機用
+    std::condition_variable        cvPktAdded;      //キューへの追加・停止要求をスレッドに通知する
+    std::atomic<uint64_t>          pktAddedCount;   //キューへの追加・停止要求の回数
+    std::atomic<int>               pktAddedWaiting; //cvPktAddedで待機中のスレッド数
 
     AVMuxThreadWorker();
     ~AVMuxThreadWorker();
     void close();
+    //キューへの追加をスレッドに通知する
+    void notifyPktAdded();
+    //pktAddedCountがcountから変化するか停止要求があるまで待機する (timeout_ms < 0 なら無制限)
+    void waitPktAdded(uint64_t count, int timeout_ms);
 };
 
 
-struct AVMuxThreadAudio {
-    AVMuxThreadWorker encode;   //音声エンコードスレッド
-    AVMuxThreadWorker process;  //音声処理スレッド
+//音声処理のタスク (トラックごと・処理の種類ごとに1つ)
+//同じタスクは同時に1つのスレッドでしか実行されないので、トラック内の処理順は保たれる
+struct AVMuxAudioTask {
+    const AVMuxAudio              *muxAudio;    //担当するトラック
+    int                            type;        //AUD_QUEUE_PROCESS / AUD_QUEUE_ENCODE
+    int                            perfIndex;   //PerfQueueInfo::aud_track_*のindex (-1なら記録しない)
+    bool                           scheduled;   //実行待ちまたは実行中 (AVMuxAudioThreadPool::mtxで保護)
+    RGYQueueRing<AVPktMuxData, 64> qPackets;    //処理待ちのパケット
 
-    AVMuxThreadAudio();
-    ~AVMuxThreadAudio();
-    bool threadActiveEncode();
-    bool threadActiveProcess();
-    void closeEncode();
-    void closeProcess();
+    AVMuxAudioTask(const AVMuxAudio *muxAudio, int type);
+    ~AVMuxAudioTask();
+};
+
+//音声処理 (デコード→フィルタ→エンコード) を行う固定数のスレッドプール
+//トラックごとにスレッドを立てる代わりに、処理待ちのパケットのあるタスクを空いているスレッドで実行する
+struct AVMuxAudioThreadPool {
+    std::vector<std::thread>                     threads;     //ワーカースレッド
+    std::vector<std::unique_ptr<AVMuxAudioTask>> tasks;       //すべてのタスク
+    std::unordered_map<int, AVMuxAudioTask *>    taskProcess; //音声処理タスク (入力トラックごと)
+    std::unordered_map<const AVMuxAudio *, AVMuxAudioTask *> taskEncode; //音声エンコードタスク (サブストリームごと)
+    AVMuxAudioTask                              *taskOther;   //字幕などの音声以外のパケットの処理タスク
+    std::mutex                                   mtx;
+    std::condition_variable                      cvReady;     //実行待ちのタスクの追加・停止要求を通知する
+    std::deque<AVMuxAudioTask *>                 ready;       //実行待ちのタスク
+    int                                          running;     //実行中のタスク数
+    bool                                         started;     //ファイルヘッダが書き込まれ、タスクを実行できる
+    bool                                         abort;       //残りのタスクを実行したら終了する
+    size_t                                       queueCapacity; //タスクの実行開始後の音声処理タスクのキューの上限 (エンコードタスクは上限なし)
+    int                                          batchSize;   //1回のタスクの実行で処理するパケット数の上限
+
+    AVMuxAudioThreadPool();
+    ~AVMuxAudioThreadPool();
+    bool active() const { return !threads.empty(); }
+    //対象のタスクを探す
+    AVMuxAudioTask *getTask(const AVMuxAudio *muxAudio, int type);
+    //パケットを追加したタスクを実行待ちにする
+    void schedule(AVMuxAudioTask *task);
+    //タスクの実行を開始する (ファイルヘッダの書き込み後)
+    void start();
+    //残りのタスクをすべて実行してから、スレッドを終了する
+    void close();
 };
 
 #if ENABLE_AVCODEC_OUT_THREAD
+//出力スレッドで、映像・音声・字幕の各ストリームを書き出す順番を決める
+//キーは各ストリームの書き出し済みのdts (timebase = QUEUE_DTS_TIMEBASE)
+//(映像のdtsは書き出し時に決まるため、未出力のパケットのdtsではなく、書き出し済みのdtsを用いる)
+// - 出力待ちのパケットのあるストリームのうち、最も遅れているものを選ぶ
+//   (ストリーム数は多くないので、ヒープは使わず毎回走査する)
+// - 出力待ちのパケットがないストリームより閾値以上先行してしまう場合は、そのストリームを待つ
+//   ただし、字幕などの疎なストリームと終了したストリームは待たない
+// - 出力待ちのパケット数が上限に達したストリームは待たずに書き出し、待たせていたストリームは途切れたものとみなす
+//   途切れたストリームは、次のパケットが来るまで待たない (書き出し済みのdtsはそのまま)
+// - 音声の出力待ちの上限は、5秒分と計測した映像の遅れの1.5倍分の大きいほうとする
+class RGYMuxInterleaver {
+public:
+    static constexpr int AUDIO_PACKETS_PER_SEC_DEFAULT = 64; //音声の1秒あたりのパケット数の初期値
+    static constexpr double AUDIO_PENDING_LIMIT_SEC = 5.0; //音声の出力待ちの上限 (秒)
+    static constexpr size_t AUDIO_PENDING_LIMIT_MIN = 64;     //音声の出力待ちのパケット数の上限の最小値
+
+    //dtsThreshold ... ストリーム間で許容するdtsの差
+    //timebase     ... dtsのtimebase
+    RGYMuxInterleaver(int64_t dtsThreshold, AVRational timebase);
+    ~RGYMuxInterleaver();
+
+    //ストリームを追加し、そのidを返す
+    int addStream(const tstring& name, size_t pendingLimit, bool sparse);
+    //映像の遅れの計測に用いる映像のストリームを設定する
+    void setVideoStream(int id);
+    //音声のストリームの1秒あたりのパケット数を設定し、出力待ちの上限を映像の遅れに合わせて決めるようにする
+    //(これまでに設定した値より小さい場合は無視する)
+    void setAudioPacketsPerSec(int id, int packetsPerSec);
+    //出力待ちのパケット数を設定する
+    void setPending(int id, size_t pending);
+    //出力待ちのパケット数の上限を設定する
+    void setPendingLimit(int id, size_t pendingLimit);
+    //書き出し済みのdtsを更新する
+    void written(int id, int64_t dts);
+    //ストリームの終了を設定する
+    void setEOS(int id);
+    //次に書き出すストリームを返す (書き出せるストリームがなければ-1)
+    //flush時は他のストリームを待たずに、dts順に返す
+    //他のストリームを待たずに書き出すことにした場合、待っていたストリームをstalledに返す
+    int next(bool flush, int *stalled);
+
+    size_t pending(int id) const { return m_streams[id].pending; }
+    size_t pendingLimit(int id) const { return m_streams[id].limit; }
+    int64_t lastDts(int id) const { return m_streams[id].lastDts; }
+    bool stalled(int id) const { return m_streams[id].stalled; }
+    double videoDelay() const { return m_videoDelay; }
+    const tstring& name(int id) const { return m_streams[id].name; }
+    int streamCount() const { return (int)m_streams.size(); }
+protected:
+    //映像の遅れ (書き出し済みの音声のdtsに対する映像のdtsの遅れ) を計測し、音声の出力待ちの上限に反映する
+    void measureVideoDelay();
+    void updateAudioPendingLimit(int id);
+
+    struct Stream {
+        tstring name;    //ログ用の名前
+        int64_t lastDts; //書き出し済みのdts
+        size_t pending;  //出力待ちのパケット数
+        size_t limit;    //出力待ちのパケット数の上限
+        int packetsPerSec; //音声の1秒あたりのパケット数 (音声以外は0)
+        bool sparse;     //疎なストリーム (他のストリームを待たせない)
+        bool eos;        //終了したストリーム
+        bool stalled;    //途切れたストリーム (次のパケットが来るまで他のストリームを待たせない)
+    };
+    int64_t m_dtsThreshold;
+    AVRational m_timebase;
+    int m_videoId;
+    double m_videoDelay; //計測した映像の遅れ (秒)
+    std::vector<Stream> m_streams;
+};
+
 struct AVMuxThread {
     bool                           enableOutputThread;        //出力スレッドを使用する
     bool                           enableAudProcessThread;    //音声処理スレッドを使用する
     bool                           enableAudEncodeThread;     //音声エンコードスレッドを使用する
     std::unique_ptr<AVMuxThreadWorker> thOutput;              //出力スレッド
-    RGYQueueMPMP<RGYBitstream, 64> qVideobitstreamFreeI;      //映像 Iフレーム用に空いているデータ領域を格納する
-    RGYQueueMPMP<RGYBitstream, 64> qVideobitstreamFreePB;     //映像 P/Bフレーム用に空いているデータ領域を格納する
-    RGYQueueMPMP<RGYBitstream, 64> qVideobitstream;           //映像パケットを出力スレッドに渡すためのキュー
-    std::unordered_map<const AVMuxAudio *, std::unique_ptr<AVMuxThreadAudio>> thAud; //音声スレッド
-    std::atomic<int64_t>           streamOutMaxDts;           //音声・字幕キューの最後のdts (timebase = QUEUE_DTS_TIMEBASE) (キューの同期に使用)
+    RGYQueueRingSPSC<RGYBitstream, 64> qVideobitstream;         //映像パケットを出力スレッドに渡すためのキュー
+    AVMuxAudioThreadPool           audPool;                   //音声処理スレッド
     PerfQueueInfo                 *queueInfo;                 //キューの情報を格納する構造体
 
     AVMuxThread();
@@ -435,7 +546,7 @@ public:
 
     virtual vector<int> GetStreamTrackIdList();
 
-    virtual void WaitFin() override;
+    virtual RGY_ERR WaitFin() override;
 
     virtual void Close() override;
 
@@ -446,22 +557,17 @@ public:
 #endif //USE_CUSTOM_IO
     //出力スレッドのハンドルを取得する
     HANDLE getThreadHandleOutput();
-    HANDLE getThreadHandleAudProcess();
-    HANDLE getThreadHandleAudEncode();
 protected:
     virtual RGY_ERR Init(const TCHAR *strFileName, const VideoInfo *videoOutputInfo, const void *option) override;
 
     //別のスレッドで実行する場合のスレッド関数 (出力)
     RGY_ERR WriteThreadFunc(RGYParamThread threadParam);
 
-    //別のスレッドで実行する場合のスレッド関数 (音声処理)
-    RGY_ERR ThreadFuncAudThread(const AVMuxAudio *const muxAudio, RGYParamThread threadParam);
-
-    //別のスレッドで実行する場合のスレッド関数 (音声エンコード処理)
-    RGY_ERR ThreadFuncAudEncodeThread(const AVMuxAudio *const muxAudio, RGYParamThread threadParam);
+    //別のスレッドで実行する場合のスレッド関数 (音声処理・音声エンコード処理)
+    RGY_ERR ThreadFuncAudPool(RGYParamThread threadParam);
 
-    //対象パケットの担当スレッドを探す
-    AVMuxThreadWorker *getPacketWorker(const AVMuxAudio *muxAudio, const int type);
+    //音声処理タスクを実行する
+    void RunAudioTask(AVMuxAudioTask *task);
 
     //音声出力キューに追加 (音声処理スレッドが有効な場合のみ有効)
     RGY_ERR AddAudQueue(AVPktMuxData *pktData, int type);
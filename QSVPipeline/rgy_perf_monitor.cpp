@@ -651,6 +651,15 @@ void CPerfMonitor::write_header(FILE *fp, int nSelect) {
     if (nSelect & PERF_MONITOR_QUEUE_AUD_OUT) {
         str += ",queue aud out";
     }
+    if (nSelect & PERF_MONITOR_WRITE_LATENCY) {
+        str += ",write latency (ms)";
+    }
+    if (nSelect & PERF_MONITOR_AUD_TRACK) {
+        str += ",aud track proc (%)";
+    }
+    if (nSelect & PERF_MONITOR_READ_AHEAD) {
+        str += ",read ahead (%)";
+    }
     if (nSelect & PERF_MONITOR_MEM_PRIVATE) {
         str += ",mem private (MB)";
     }
@@ -1103,6 +1112,12 @@ void CPerfMonitor::check() {
         pInfoNew->cpu_percent        = (pInfoNew->cpu_total_us        - pInfoOld->cpu_total_us) * 100.0 * logical_cpu_inv * time_diff_inv;
         pInfoNew->cpu_kernel_percent = (pInfoNew->cpu_total_kernel_us - pInfoOld->cpu_total_kernel_us) * 100.0 * logical_cpu_inv * time_diff_inv;
 
+        //音声処理タスクごとの処理時間 (1スレッドを占有した場合に100%)
+        for (int i = 0; i < std::min(m_QueueInfo.aud_track_count, PERF_AUD_TRACK_MAX); i++) {
+            pInfoNew->aud_track_total_proc_us[i] = (int64_t)m_QueueInfo.aud_track_proc_us[i];
+            pInfoNew->aud_track_percent[i] = (pInfoNew->aud_track_total_proc_us[i] - pInfoOld->aud_track_total_proc_us[i]) * 100.0 * time_diff_inv;
+        }
+
         //IO情報
         pInfoNew->io_read_per_sec = (pInfoNew->io_total_read - pInfoOld->io_total_read) * time_diff_inv * 1e6;
         pInfoNew->io_write_per_sec = (pInfoNew->io_total_write - pInfoOld->io_total_write) * time_diff_inv * 1e6;
@@ -1273,6 +1288,19 @@ void CPerfMonitor::write(FILE *fp, int nSelect) {
     if (nSelect & PERF_MONITOR_QUEUE_AUD_OUT) {
         str += strsprintf(",%d", (int)m_QueueInfo.usage_aud_out);
     }
+    if (nSelect & PERF_MONITOR_WRITE_LATENCY) {
+        str += strsprintf(",%.3f", m_QueueInfo.vid_out_latency_us * 0.001);
+    }
+    if (nSelect & PERF_MONITOR_AUD_TRACK) {
+        //トラック数が可変なので、"名前=値"を空白区切りで1列に出力する
+        str += ",";
+        for (int i = 0; i < std::min(m_QueueInfo.aud_track_count, PERF_AUD_TRACK_MAX); i++) {
+            str += strsprintf("%s%s=%.1lf", (i) ? " " : "", m_QueueInfo.aud_track_name[i], pInfo->aud_track_percent[i]);
+        }
+    }
+    if (nSelect & PERF_MONITOR_READ_AHEAD) {
+        str += strsprintf(",%d", (int)m_QueueInfo.usage_read_ahead);
+    }
     if (nSelect & PERF_MONITOR_MEM_PRIVATE) {
         str += strsprintf(",%.2lf", pInfo->mem_private / (double)(1024 * 1024));
     }
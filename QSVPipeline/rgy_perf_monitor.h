@@ -101,6 +101,9 @@ enum : int {
     PERF_MONITOR_VEE_LOAD      = 0x04000000,
     PERF_MONITOR_VED_LOAD      = 0x08000000,
     PERF_MONITOR_PCIE_LOAD     = 0x10000000,
+    PERF_MONITOR_WRITE_LATENCY = 0x20000000,
+    PERF_MONITOR_AUD_TRACK     = 0x40000000,
+    PERF_MONITOR_READ_AHEAD    = (int)0x80000000,
     PERF_MONITOR_ALL         = (int)UINT_MAX,
 };
 
@@ -138,9 +141,14 @@ static const CX_DESC list_pref_monitor[] = {
     { _T("pcie_load"),   PERF_MONITOR_PCIE_LOAD },
     { _T("ve_clock"),    PERF_MONITOR_VE_CLOCK },
     { _T("queue"),       PERF_MONITOR_QUEUE_VID_IN | PERF_MONITOR_QUEUE_VID_OUT | PERF_MONITOR_QUEUE_AUD_IN | PERF_MONITOR_QUEUE_AUD_OUT },
+    { _T("write_latency"), PERF_MONITOR_WRITE_LATENCY },
+    { _T("aud_track"),   PERF_MONITOR_AUD_TRACK },
+    { _T("read_ahead"),  PERF_MONITOR_READ_AHEAD },
     { nullptr, 0 }
 };
 
+static const int PERF_AUD_TRACK_MAX = 32;
+
 struct PerfInfo {
     int64_t time_us;
     int64_t cpu_total_us;
@@ -152,6 +160,7 @@ struct PerfInfo {
     int64_t aud_enc_thread_total_active_us;
     int64_t out_thread_total_active_us;
     int64_t in_thread_total_active_us;
+    int64_t aud_track_total_proc_us[PERF_AUD_TRACK_MAX];
 
     int64_t mem_private;
     int64_t mem_virtual;
@@ -181,6 +190,7 @@ struct PerfInfo {
     double  aud_enc_thread_percent;
     double  out_thread_percent;
     double  in_thread_percent;
+    double  aud_track_percent[PERF_AUD_TRACK_MAX];
 
     BOOL    gpu_info_valid;
     double  gpu_load_percent;
@@ -211,6 +221,11 @@ struct PerfQueueInfo {
     size_t usage_aud_out;
     size_t usage_aud_enc;
     size_t usage_aud_proc;
+    size_t vid_out_latency_us; //映像の書き込みにかかった時間 (キューに追加されてから書き込み終了まで)
+    size_t usage_read_ahead;   //入力の先読みバッファの使用率(%)
+    int    aud_track_count;                               //aud_track_*の有効な数
+    char   aud_track_name[PERF_AUD_TRACK_MAX][16];        //音声処理タスクの名前 (トラック番号と処理の種類)
+    size_t aud_track_proc_us[PERF_AUD_TRACK_MAX];         //音声処理タスクの処理時間の合計
 };
 
 #if ENABLE_METRIC_FRAMEWORK
@@ -173,6 +173,7 @@ VppColorspace::VppColorspace() :
     enable(false),
     hdr2sdr(),
     lut3d(),
+    fuse_lut(0),
     convs() {
 
 }
@@ -181,6 +182,7 @@ bool VppColorspace::operator==(const VppColorspace &x) const {
     if (enable != x.enable
         || x.hdr2sdr != this->hdr2sdr
         || x.lut3d != this->lut3d
+        || x.fuse_lut != this->fuse_lut
         || x.convs.size() != this->convs.size()) {
         return false;
     }
@@ -1334,7 +1336,9 @@ tstring VMAFParam::print() const {
 RGYVideoQualityMetric::RGYVideoQualityMetric() :
     ssim(false),
     psnr(false),
-    vmaf() {
+    vmaf(),
+    device(RGYMetricDevice::GPU),
+    cpuThreads(0) {
 
 }
 bool RGYVideoQualityMetric::enabled() const {
@@ -1439,6 +1443,9 @@ RGYParamControl::RGYParamControl() :
     logfile(),              //ログ出力先
     loglevel(RGY_LOG_INFO),                 //ログ出力レベル
     logAddTime(false),
+    logAsync(false),
+    logAsyncDrop(false),
+    logJsonFile(),
     logFramePosList(false),     //framePosList出力
     logPacketsList(false),
     logMuxVidTsFile(nullptr),
@@ -1450,6 +1457,7 @@ RGYParamControl::RGYParamControl() :
     perfMonitorSelect(0),
     perfMonitorSelectMatplot(0),
     perfMonitorInterval(RGY_DEFAULT_PERF_MONITOR_INTERVAL),
+    traceFile(),
     parentProcessID(0),
     lowLatency(false),
     gpuSelect(),
@@ -1457,7 +1465,9 @@ RGYParamControl::RGYParamControl() :
     skipHWDecodeCheck(false),
     avsdll(),
     enableOpenCL(true),
-    outputBufSizeMB(RGY_OUTPUT_BUF_MB_DEFAULT) {
+    clProgramCache(),
+    outputBufSizeMB(RGY_OUTPUT_BUF_MB_DEFAULT),
+    inputReadAheadMB(0) {
 
 }
 RGYParamControl::~RGYParamControl() {};
@@ -1545,7 +1555,13 @@ unique_ptr<RGYHDR10Plus> initDynamicHDR10Plus(const tstring &dynamicHdr10plusJso
             log->write(RGY_LOG_ERROR, RGY_LOGT_HDR10PLUS, _T("Failed to initialize hdr10plus reader: %s.\n"), get_err_mes((RGY_ERR)ret));
             hdr10plus.reset();
         }
-        log->write(RGY_LOG_DEBUG, RGY_LOGT_HDR10PLUS, _T("initialized hdr10plus reader: %s\n"), dynamicHdr10plusJson.c_str());
+        if (hdr10plus) {
+            if (hdr10plus->useExternalGen()) {
+                log->write(RGY_LOG_DEBUG, RGY_LOGT_HDR10PLUS, _T("initialized hdr10plus reader (%s): %s\n"), RGYHDR10Plus::HDR10PLUS_GEN_EXE_NAME, dynamicHdr10plusJson.c_str());
+            } else {
+                log->write(RGY_LOG_DEBUG, RGY_LOGT_HDR10PLUS, _T("initialized hdr10plus reader (%d frames): %s\n"), hdr10plus->frameCount(), dynamicHdr10plusJson.c_str());
+            }
+        }
     }
     return hdr10plus;
 }
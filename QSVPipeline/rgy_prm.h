@@ -42,6 +42,7 @@ static const int OUTPUT_BUF_SIZE       = 16 * 1024 * 1024;
 static const int RGY_DEFAULT_PERF_MONITOR_INTERVAL = 500;
 static const int DEFAULT_IGNORE_DECODE_ERROR = 10;
 static const int DEFAULT_VIDEO_IGNORE_TIMESTAMP_ERROR = 10;
+static const TCHAR* RGY_CL_PROGRAM_CACHE_OFF = _T("off");
 
 #if ENCODER_NVENC
 #define ENABLE_VPP_FILTER_COLORSPACE   (ENABLE_NVRTC)
@@ -73,6 +74,8 @@ static const TCHAR* VMAF_DEFAULT_MODEL_VERSION = _T("vmaf_v0.6.1");
 static const double FILTER_DEFAULT_COLORSPACE_LDRNITS = 100.0;
 static const double FILTER_DEFAULT_COLORSPACE_NOMINAL_SOURCE_PEAK = 100.0;
 static const double FILTER_DEFAULT_COLORSPACE_HDR_SOURCE_PEAK = 1000.0;
+static const int    FILTER_DEFAULT_COLORSPACE_FUSE_LUT_SIZE = 65;
+static const int    FILTER_COLORSPACE_FUSE_LUT_SIZE_MAX = 129;
 
 static const double FILTER_DEFAULT_HDR2SDR_DESAT_BASE = 0.18;
 static const double FILTER_DEFAULT_HDR2SDR_DESAT_STRENGTH = 0.75;
@@ -765,6 +768,7 @@ struct VppColorspace {
     bool enable;
     HDR2SDRParams hdr2sdr;
     LUT3DParams lut3d;
+    int fuse_lut; //変換全体をまとめた3D LUTのサイズ (0で無効)
     vector<ColorspaceConv> convs;
 
     VppColorspace();
@@ -1399,10 +1403,23 @@ struct VMAFParam {
     tstring print() const;
 };
 
+enum class RGYMetricDevice {
+    GPU,
+    CPU
+};
+
+const CX_DESC list_metric_device[] = {
+    { _T("gpu"), (int)RGYMetricDevice::GPU },
+    { _T("cpu"), (int)RGYMetricDevice::CPU },
+    { NULL, 0 }
+};
+
 struct RGYVideoQualityMetric {
     bool ssim;
     bool psnr;
     VMAFParam vmaf;
+    RGYMetricDevice device; //ssim/psnrの計算に使用するデバイス
+    int cpuThreads;         //device=cpuの場合のスレッド数 (0で自動)
 
     RGYVideoQualityMetric();
     ~RGYVideoQualityMetric() {};
@@ -1505,6 +1522,9 @@ struct RGYParamControl {
     tstring logfile;              //ログ出力先
     RGYParamLogLevel loglevel; //ログ出力レベル
     bool logAddTime;
+    bool logAsync;            //ログをバックグラウンドスレッドで書き出す
+    bool logAsyncDrop;        //非同期出力時、バッファがあふれたら詳細ログを破棄する
+    tstring logJsonFile;      //JSON Lines形式のログ出力先 (非同期出力時のみ)
     bool logFramePosList;     //framePosList出力
     bool logPacketsList;
     TCHAR *logMuxVidTsFile;
@@ -1516,6 +1536,7 @@ struct RGYParamControl {
     int64_t perfMonitorSelect;
     int64_t perfMonitorSelectMatplot;
     int     perfMonitorInterval;
+    tstring traceFile;           //パイプラインのトレース出力先 (Chrome trace形式)
     uint32_t parentProcessID;
     bool lowLatency;
     GPUAutoSelectMul gpuSelect;
@@ -1523,8 +1544,10 @@ struct RGYParamControl {
     bool skipHWDecodeCheck;
     tstring avsdll;
     bool enableOpenCL;
+    tstring clProgramCache;      //OpenCLのプログラムバイナリのキャッシュの保存先 (空なら既定の場所、RGY_CL_PROGRAM_CACHE_OFFなら使用しない)
 
     int outputBufSizeMB;         //出力バッファサイズ
+    int inputReadAheadMB;        //入力の先読みバッファサイズ (0で使用しない)
 
     RGYParamControl();
     ~RGYParamControl();
@@ -1546,6 +1569,7 @@ const FEATURE_DESC list_simd[] = {
     { _T("sse41"),    (uint64_t)(RGY_SIMD::SSE41| RGY_SIMD::SSSE3| RGY_SIMD::SSE3| RGY_SIMD::SSE2) },
     { _T("avx"),      (uint64_t)(RGY_SIMD::AVX  | RGY_SIMD::SSE42| RGY_SIMD::SSE41| RGY_SIMD::SSSE3| RGY_SIMD::SSE3| RGY_SIMD::SSE2) },
     { _T("avx2"),     (uint64_t)(RGY_SIMD::AVX2 | RGY_SIMD::AVX| RGY_SIMD::SSE42| RGY_SIMD::SSE41| RGY_SIMD::SSSE3| RGY_SIMD::SSE3| RGY_SIMD::SSE2) },
+    { _T("avx512bw"), (uint64_t)(RGY_SIMD::AVX512BW | RGY_SIMD::AVX512F | RGY_SIMD::AVX2 | RGY_SIMD::AVX| RGY_SIMD::SSE42| RGY_SIMD::SSE41| RGY_SIMD::SSSE3| RGY_SIMD::SSE3| RGY_SIMD::SSE2) },
     { nullptr,        (uint64_t)RGY_SIMD::NONE }
 };
 
@@ -34,6 +34,9 @@
 #include <atomic>
 #include <climits>
 #include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 #include "rgy_arch.h"
 #include "rgy_osdep.h"
 #include "rgy_event.h"
@@ -365,6 +368,394 @@ protected:
     alignas(64) std::atomic<bool> m_bUsingData; //キューから読み出し中のスレッドの数
     alignas(64) std::atomic<bool> m_bPush; //push用のロックの数
 };
+
+//固定長のリングバッファによるキュー
+//RGYQueueMPMPと同じインターフェースを持ち、置き換えて使用できる
+// - 内部バッファはinit時に確保し、以降の再確保・コピーは行わない
+// - spsc=trueの場合、押し込み・取り出しともにCASを使わない (押し込み・取り出しはそれぞれ単一スレッドからのみ)
+// - spsc=falseの場合、各要素のシーケンス番号を用いたbounded MPMCキューとして動作する
+// - 待機はcondition_variableで行い、待機中のスレッドがいる場合のみ通知する
+// - maxCapacityが内部バッファより大きい場合、内部バッファからあふれたデータは
+//   mutexで保護された領域に格納し、順序を保ったまま取り出す
+template<typename Type, size_t align_byte = sizeof(Type), bool spsc = false>
+class RGYQueueRing {
+public:
+    struct queueData {
+        Type data;
+    };
+private:
+    struct queueCell {
+        std::atomic<size_t> seq; //このセルに格納可能/取り出し可能な位置
+        queueData item;
+    };
+    static constexpr size_t CELL_ALIGN = (align_byte > alignof(queueCell)) ? align_byte : alignof(queueCell);
+    static constexpr size_t CELL_SIZE = (sizeof(queueCell) + (CELL_ALIGN - 1)) / CELL_ALIGN * CELL_ALIGN;
+public:
+    RGYQueueRing() :
+        m_nMallocAlign(32),
+        m_nMask(0),
+        m_pBuf(),
+        m_nMaxCapacity(SIZE_MAX),
+        m_nKeepLength(0),
+        m_nPushPos(0),
+        m_nPopPos(0),
+        m_bOverflow(false),
+        m_nOverflowSize(0),
+        m_mtxOverflow(),
+        m_overflow(),
+        m_nPushGen(0),
+        m_nPushGenChecked(0),
+        m_nWaitPush(0),
+        m_nWaitPop(0),
+        m_mtxWait(),
+        m_cvPushed(),
+        m_cvPoped() {
+        for (uint32_t i = 4; i < sizeof(i) * 8; i++) {
+            size_t test = (size_t)1 << i;
+            if (test == CELL_ALIGN) {
+                m_nMallocAlign = (int)test;
+                break;
+            }
+        }
+    }
+    ~RGYQueueRing() {
+        close();
+    }
+    //indexの位置へのポインタを返す
+    // !! 取り出し側のスレッドからのみ有効 !!
+    queueData *get(uint32_t index) {
+        const size_t popPos = m_nPopPos.load(std::memory_order_acquire);
+        const size_t ringSize = m_nPushPos.load(std::memory_order_acquire) - popPos;
+        if (index < ringSize) {
+            auto ptr = cell(popPos + index);
+            return (ptr->seq.load(std::memory_order_acquire) == popPos + index + 1) ? &ptr->item : nullptr;
+        }
+        std::lock_guard<std::mutex> lock(m_mtxOverflow);
+        const size_t overflowIndex = index - ringSize;
+        return (overflowIndex < m_overflow.size()) ? &m_overflow[overflowIndex] : nullptr;
+    }
+    queueData& operator[](uint32_t index) {
+        return *get(index);
+    }
+    //キューが一定の長さに達しないとfront_copy/popできないように設定する
+    void set_keep_length(size_t keepLength) {
+        m_nKeepLength = keepLength;
+        //keep_lengthの変更で取り出し可能になる場合があるので、待機中のスレッドを起こす
+        m_nPushGen++;
+        notifyPushed();
+    }
+    size_t get_keep_length() {
+        return m_nKeepLength;
+    }
+    //キューを初期化する
+    //bufSizeは内部のリングバッファのサイズ (2の累乗に切り上げる)
+    //maxCapacityはキューに格納できる最大のデータ数 bufSizeを超えてもかまわない
+    //nPushRestartはRGYQueueMPMPとの互換のためのもので、使用しない
+    void init(size_t bufSize = 1024, size_t maxCapacity = SIZE_MAX, int /*nPushRestart*/ = 1) {
+        close();
+        size_t ringSize = 2;
+        while (ringSize < bufSize) {
+            ringSize <<= 1;
+        }
+        m_pBuf = std::unique_ptr<char, aligned_malloc_deleter>(
+            (char *)_aligned_malloc(CELL_SIZE * ringSize, (std::max)(16, m_nMallocAlign)), aligned_malloc_deleter());
+        if (!m_pBuf) {
+            return;
+        }
+        m_nMask = ringSize - 1;
+        //_aligned_mallocで確保した領域なので、各セルのオブジェクトはここで構築し、close()で破棄する
+        for (size_t i = 0; i < ringSize; i++) {
+            new (&cell(i)->seq) std::atomic<size_t>(i);
+            new (&cell(i)->item) queueData();
+        }
+        m_nPushPos = 0;
+        m_nPopPos = 0;
+        m_nMaxCapacity = maxCapacity;
+        m_nKeepLength = 0;
+    }
+    //キューのデータをクリアする
+    // !! 押し込み側・取り出し側のスレッドが動作していない状態でのみ有効 !!
+    void clear() {
+        clear([](Type *) {});
+    }
+    //キューのデータをクリアする際に、指定した関数で内部データを開放してから、データをクリアする
+    template<typename Func>
+    void clear(Func deleter) {
+        if (!m_pBuf) {
+            return;
+        }
+        const auto keepLength = m_nKeepLength.load();
+        m_nKeepLength = 0;
+        Type data;
+        while (popFront(&data, true)) {
+            deleter(&data);
+        }
+        m_nKeepLength = keepLength;
+        notifyPoped();
+    }
+    //キューのデータをクリアし、リソースを破棄する
+    void close() {
+        clear();
+        if (m_pBuf) {
+            for (size_t i = 0; i <= m_nMask; i++) {
+                cell(i)->item.~queueData();
+            }
+        }
+        m_pBuf.reset();
+        m_nMask = 0;
+        m_nPushPos = 0;
+        m_nPopPos = 0;
+    }
+    //キューのデータをクリアする際に、指定した関数で内部データを開放してから、リソースを破棄する
+    template<typename Func>
+    void close(Func deleter) {
+        clear(deleter);
+        close();
+    }
+    //データをキューにコピーし押し込む
+    //キューのデータ量があらかじめ設定した上限に達した場合は、キューに空きができるまで待機する
+    bool push(const Type& in) {
+        if (!m_pBuf) {
+            return false;
+        }
+        if (size() >= m_nMaxCapacity) {
+            std::unique_lock<std::mutex> lock(m_mtxWait);
+            m_nWaitPop++;
+            //m_nWaitPopの加算を、取り出し側がnotifyPoped()で確認する前に見えるようにする
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            m_cvPoped.wait(lock, [this]() { return size() < m_nMaxCapacity; });
+            m_nWaitPop--;
+        }
+        //あふれたデータがない場合は、リングバッファに直接格納する
+        if (m_bOverflow.load(std::memory_order_acquire) || !pushRing(in)) {
+            std::lock_guard<std::mutex> lock(m_mtxOverflow);
+            //あふれたデータがある間は、順序を保つためすべてあふれ領域に格納する
+            if (m_bOverflow.load(std::memory_order_relaxed) || !pushRing(in)) {
+                m_overflow.push_back(queueData{ in });
+                m_nOverflowSize++;
+                m_bOverflow.store(true, std::memory_order_release);
+            }
+        }
+        m_nPushGen++;
+        notifyPushed();
+        return true;
+    }
+    //キューのsizeを取得する
+    size_t size() const {
+        const size_t popPos = m_nPopPos.load();
+        const size_t pushPos = m_nPushPos.load();
+        return ((pushPos > popPos) ? pushPos - popPos : 0) + m_nOverflowSize.load();
+    }
+    //キューが空ならtrueを返す
+    bool empty() const {
+        return size() == 0;
+    }
+    //キューの最大サイズを取得する
+    size_t capacity() const {
+        return m_nMaxCapacity;
+    }
+    //キューの最大サイズを設定する
+    //内部のリングバッファのサイズを超えてもかまわない (超えた分はあふれ領域に格納される)
+    void set_capacity(size_t capacity) {
+        m_nMaxCapacity = capacity;
+        notifyPoped();
+    }
+    //indexの位置のコピーを取得する
+    // !! 取り出し側のスレッドからのみ有効 !!
+    bool copy(Type *out, uint32_t index, size_t *pnSize = nullptr) {
+        const uint64_t gen = m_nPushGen.load();
+        const auto nSize = size();
+        auto ptr = (index < nSize) ? get(index) : nullptr;
+        if (ptr) {
+            *out = ptr->data;
+        } else {
+            m_nPushGenChecked = gen;
+        }
+        if (pnSize) {
+            *pnSize = nSize;
+        }
+        return ptr != nullptr;
+    }
+    //キューの先頭のデータを取り出す (outにコピーする)
+    //キューが空ならなにもせずfalseを返す
+    // !! 取り出し側のスレッドからのみ有効 !!
+    bool front_copy_no_lock(Type *out, size_t *pnSize = nullptr) {
+        return front(out, false, pnSize);
+    }
+    //キューの先頭のデータを取り出しながら(outにコピーする)、キューから取り除く
+    //キューが空ならなにもせずfalseを返す
+    bool front_copy_and_pop_no_lock(Type *out, size_t *pnSize = nullptr) {
+        return front(out, true, pnSize);
+    }
+    //キューの先頭のデータを取り除く
+    //キューが空ならfalseを返す
+    bool pop() {
+        return front(nullptr, true, nullptr);
+    }
+    //要素が追加されるまで待機する
+    //前回の取り出しに失敗して以降に追加されていれば、すぐに戻る
+    void wait_for_push() {
+        std::unique_lock<std::mutex> lock(m_mtxWait);
+        m_nWaitPush++;
+        //m_nWaitPushの加算を、押し込み側がnotifyPushed()で確認する前に見えるようにする
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        m_cvPushed.wait(lock, [this]() { return m_nPushGen.load() != m_nPushGenChecked; });
+        m_nWaitPush--;
+    }
+protected:
+    queueCell *cell(size_t pos) const {
+        return (queueCell *)(m_pBuf.get() + (pos & m_nMask) * CELL_SIZE);
+    }
+    bool pushRing(const Type& in) {
+        size_t pos = m_nPushPos.load(std::memory_order_relaxed);
+        queueCell *ptr = nullptr;
+        if (spsc) {
+            ptr = cell(pos);
+            if (ptr->seq.load(std::memory_order_acquire) != pos) {
+                return false; //いっぱい
+            }
+            m_nPushPos.store(pos + 1, std::memory_order_relaxed);
+        } else {
+            for (;;) {
+                ptr = cell(pos);
+                const size_t seq = ptr->seq.load(std::memory_order_acquire);
+                const intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+                if (diff == 0) {
+                    if (m_nPushPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        break;
+                    }
+                } else if (diff < 0) {
+                    return false; //いっぱい
+                } else {
+                    pos = m_nPushPos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+        ptr->item.data = in;
+        ptr->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+    bool popRing(Type *out, bool remove) {
+        size_t pos = m_nPopPos.load(std::memory_order_relaxed);
+        queueCell *ptr = nullptr;
+        if (spsc || !remove) {
+            ptr = cell(pos);
+            if (ptr->seq.load(std::memory_order_acquire) != pos + 1) {
+                return false; //空
+            }
+            if (out) {
+                *out = ptr->item.data;
+            }
+            if (remove) {
+                ptr->seq.store(pos + m_nMask + 1, std::memory_order_release);
+                m_nPopPos.store(pos + 1, std::memory_order_release);
+            }
+            return true;
+        }
+        for (;;) {
+            ptr = cell(pos);
+            const size_t seq = ptr->seq.load(std::memory_order_acquire);
+            const intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (m_nPopPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false; //空
+            } else {
+                pos = m_nPopPos.load(std::memory_order_relaxed);
+            }
+        }
+        if (out) {
+            *out = ptr->item.data;
+        }
+        ptr->seq.store(pos + m_nMask + 1, std::memory_order_release);
+        return true;
+    }
+    bool popFront(Type *out, bool remove) {
+        if (popRing(out, remove)) {
+            return true;
+        }
+        if (!m_bOverflow.load(std::memory_order_acquire)) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(m_mtxOverflow);
+        //あふれ領域に格納された後に、リングバッファに残っていたデータが見えるようになった場合
+        if (popRing(out, remove)) {
+            return true;
+        }
+        if (m_overflow.empty()) {
+            return false;
+        }
+        if (out) {
+            *out = m_overflow.front().data;
+        }
+        if (remove) {
+            m_overflow.pop_front();
+            m_nOverflowSize--;
+            if (m_overflow.empty()) {
+                //あふれ領域が空になったので、以降はリングバッファに格納する
+                m_bOverflow.store(false, std::memory_order_release);
+            }
+        }
+        return true;
+    }
+    bool front(Type *out, bool remove, size_t *pnSize) {
+        const uint64_t gen = m_nPushGen.load();
+        const auto nSize = size();
+        const bool bCopy = m_pBuf && nSize > m_nKeepLength && popFront(out, remove);
+        if (bCopy) {
+            if (remove) {
+                notifyPoped();
+            }
+        } else {
+            m_nPushGenChecked = gen;
+        }
+        if (pnSize) {
+            *pnSize = nSize;
+        }
+        return bCopy;
+    }
+    //待機側はm_nWaitXxxを加算してから条件を確認し、こちらは条件を更新してからm_nWaitXxxを確認する
+    //更新(releaseのstore)と確認(load)の順序が入れ替わると通知を取りこぼすので、seq_cstのfenceで順序を保証する
+    void notifyPushed() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_nWaitPush.load() > 0) {
+            std::lock_guard<std::mutex> lock(m_mtxWait);
+            m_cvPushed.notify_all();
+        }
+    }
+    void notifyPoped() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_nWaitPop.load() > 0) {
+            std::lock_guard<std::mutex> lock(m_mtxWait);
+            m_cvPoped.notify_all();
+        }
+    }
+
+    int m_nMallocAlign; //メモリのアライメント
+    size_t m_nMask; //リングバッファのサイズ - 1
+    std::unique_ptr<char, aligned_malloc_deleter> m_pBuf; //リングバッファ
+    std::atomic<size_t> m_nMaxCapacity; //キューに詰められる有効なデータの最大数
+    std::atomic<size_t> m_nKeepLength; //ある一定の長さを常にキュー内に保持するようにする
+    alignas(64) std::atomic<size_t> m_nPushPos; //次に格納する位置
+    alignas(64) std::atomic<size_t> m_nPopPos; //次に取り出す位置
+    alignas(64) std::atomic<bool> m_bOverflow; //あふれ領域にデータがあるか
+                std::atomic<size_t> m_nOverflowSize; //あふれ領域のデータ数
+                std::mutex m_mtxOverflow; //あふれ領域のロック
+                std::deque<queueData> m_overflow; //リングバッファからあふれたデータ
+    alignas(64) std::atomic<uint64_t> m_nPushGen; //押し込み(とkeep_lengthの変更)のたびに加算する
+                uint64_t m_nPushGenChecked; //取り出しに失敗した時点のm_nPushGen
+                std::atomic<int> m_nWaitPush; //push待ちのスレッド数
+                std::atomic<int> m_nWaitPop; //pop待ちのスレッド数
+                std::mutex m_mtxWait;
+                std::condition_variable m_cvPushed;
+                std::condition_variable m_cvPoped;
+};
+
+//押し込み・取り出しがそれぞれ単一のスレッドから行われる場合のキュー
+template<typename Type, size_t align_byte = sizeof(Type)>
+using RGYQueueRingSPSC = RGYQueueRing<Type, align_byte, true>;
 #pragma warning (pop)
 
 #endif //__RGY_QUEUE_H__
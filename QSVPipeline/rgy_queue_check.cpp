@@ -0,0 +1,155 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#include <cstdio>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include "rgy_queue_check.h"
+#include "rgy_check.h"
+#include "rgy_osdep.h"
+#include "rgy_util.h"
+#include "rgy_queue.h"
+
+// 受け渡すデータの件数
+static const uint64_t CHECK_QUEUE_ITEMS = 1 << 20;
+// 押し込むたびに他のスレッドに譲る場合 (キューに滞留しない場合) の受け渡すデータの件数
+static const uint64_t CHECK_QUEUE_PACED_ITEMS = 1 << 16;
+
+// 受け渡すデータ (AVPktMuxDataと同程度の大きさにする)
+struct RGYQueueCheckItem {
+    uint64_t seq;       //押し込み側ごとの通し番号
+    int64_t  pushTime;  //押し込んだ時刻 (ns)
+    int      producer;  //押し込み側の番号
+    int      pad[11];
+};
+
+struct RGYQueueCheckResult {
+    bool ok;
+    double itemsPerSec;
+    double latencyP99;  //押し込んでから取り出すまでの時間の99パーセンタイル (秒)
+    double latencyMax;  //押し込んでから取り出すまでの時間の最大値 (秒)
+};
+
+static inline int64_t check_queue_time_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// producers個のスレッドから押し込み、1つのスレッドで取り出す
+// 取り出し側では、押し込み側ごとに通し番号が連続していること(FIFOであること)と件数を確認する
+// pacedの場合は押し込むたびに他のスレッドに譲り、キューに滞留していない状態での受け渡しの遅延を計測する
+template<typename Queue>
+static RGYQueueCheckResult check_queue_run(const int producers, const size_t capacity, const bool paced) {
+    Queue queue;
+    queue.init(1024, capacity);
+    const uint64_t itemsPerProducer = ((paced) ? CHECK_QUEUE_PACED_ITEMS : CHECK_QUEUE_ITEMS) / producers;
+    std::atomic<bool> start(false);
+    std::vector<std::thread> threads;
+    for (int ip = 0; ip < producers; ip++) {
+        threads.push_back(std::thread([&queue, &start, ip, itemsPerProducer, paced]() {
+            while (!start) {
+                std::this_thread::yield();
+            }
+            RGYQueueCheckItem item = { 0 };
+            item.producer = ip;
+            for (uint64_t i = 0; i < itemsPerProducer; i++) {
+                item.seq = i;
+                item.pushTime = check_queue_time_ns();
+                queue.push(item);
+                if (paced) {
+                    std::this_thread::yield();
+                }
+            }
+        }));
+    }
+    std::vector<uint64_t> nextSeq(producers, 0);
+    bool ok = true;
+    const uint64_t itemsTotal = itemsPerProducer * producers;
+    std::vector<int64_t> latency(itemsTotal);
+    RGYCheckTimer timer;
+    start = true;
+    for (uint64_t received = 0; received < itemsTotal; ) {
+        RGYQueueCheckItem item;
+        if (!queue.front_copy_and_pop_no_lock(&item)) {
+            std::this_thread::yield();
+            continue;
+        }
+        latency[received] = check_queue_time_ns() - item.pushTime;
+        if (item.producer < 0 || item.producer >= producers || item.seq != nextSeq[item.producer]) {
+            ok = false;
+        } else {
+            nextSeq[item.producer]++;
+        }
+        received++;
+    }
+    const double elapsed = timer.sec();
+    for (auto& th : threads) {
+        th.join();
+    }
+    RGYQueueCheckItem item;
+    if (queue.size() != 0 || queue.front_copy_and_pop_no_lock(&item)) {
+        ok = false; //余計なデータが残っている
+    }
+    queue.close();
+    const auto p99 = latency.begin() + (latency.size() * 99) / 100;
+    std::nth_element(latency.begin(), p99, latency.end());
+    RGYQueueCheckResult result;
+    result.ok = ok;
+    result.itemsPerSec = itemsTotal / elapsed;
+    result.latencyP99 = *p99 * 1e-9;
+    result.latencyMax = *std::max_element(p99, latency.end()) * 1e-9;
+    return result;
+}
+
+template<typename Queue>
+static bool check_queue_print(const TCHAR *name, const int producers, const size_t capacity, const bool paced) {
+    const auto result = check_queue_run<Queue>(producers, capacity, paced);
+    tstring capacityStr = (capacity == SIZE_MAX) ? tstring(_T("unlimited")) : strsprintf(_T("%d"), (int)capacity);
+    return rgy_check_print(strsprintf(_T("%-16s %d -> 1 capacity %-9s"), name, producers, capacityStr.c_str()).c_str(), result.ok,
+        strsprintf(_T("%8.2f Mitems/s, latency p99 %9.1f us, max %9.1f us"), result.itemsPerSec * 1e-6, result.latencyP99 * 1e6, result.latencyMax * 1e6));
+}
+
+bool check_queue() {
+    bool ok = true;
+    //連続して押し込む場合 (スループットの比較、遅延にはキューに滞留している時間が含まれる)
+    //押し込むたびに他のスレッドに譲る場合 (キューに滞留していない状態での遅延の比較)
+    for (const bool paced : { false, true }) {
+        _ftprintf(stdout, _T("%s\n"), (paced) ? _T("push + yield:") : _T("push continuously:"));
+        const size_t capacityList[] = { SIZE_MAX, 64 };
+        for (const auto capacity : capacityList) {
+            //SPSCは押し込み側が1スレッドの場合のみ
+            ok &= check_queue_print<RGYQueueMPMP<RGYQueueCheckItem, 64>>     (_T("RGYQueueMPMP"),      1, capacity, paced);
+            ok &= check_queue_print<RGYQueueRing<RGYQueueCheckItem, 64>>     (_T("RGYQueueRing"),      1, capacity, paced);
+            ok &= check_queue_print<RGYQueueRingSPSC<RGYQueueCheckItem, 64>> (_T("RGYQueueRingSPSC"),  1, capacity, paced);
+            ok &= check_queue_print<RGYQueueMPMP<RGYQueueCheckItem, 64>>     (_T("RGYQueueMPMP"),      4, capacity, paced);
+            ok &= check_queue_print<RGYQueueRing<RGYQueueCheckItem, 64>>     (_T("RGYQueueRing"),      4, capacity, paced);
+        }
+    }
+    return rgy_check_print_total(ok);
+}
@@ -0,0 +1,42 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __RGY_QUEUE_CHECK_H__
+#define __RGY_QUEUE_CHECK_H__
+
+#include "rgy_tchar.h"
+
+// キューの動作確認と速度計測
+// RGYQueueMPMP/RGYQueueRing/RGYQueueRingSPSCについて、
+// 押し込み・取り出しスレッドの組み合わせと容量の上限を変えて受け渡しを行い、
+// 取り出した順序と件数を確認したうえで、1秒あたりの受け渡し件数と、
+// 押し込んでから取り出すまでの時間の99パーセンタイル・最大値を表示する
+//   戻り値  ... すべてのキューで順序と件数が正しければtrue
+bool check_queue();
+
+#endif //__RGY_QUEUE_CHECK_H__
@@ -0,0 +1,392 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#if !(defined(_WIN32) || defined(_WIN64))
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
+#include "rgy_read_ahead.h"
+#include "rgy_util.h"
+
+RGYReadAhead::RGYReadAhead() :
+#if defined(_WIN32) || defined(_WIN64)
+    m_handle(INVALID_HANDLE_VALUE),
+#else
+    m_fd(-1),
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    m_isPipe(false),
+    m_fileSize(-1),
+    m_buffer(),
+    m_blockDataSize(),
+    m_blockSize(0),
+    m_blockCount(0),
+    m_blockFirst(0),
+    m_blockFilled(0),
+    m_windowStart(0),
+    m_fillPos(0),
+    m_readPos(0),
+    m_restartPos(-1),
+    m_eof(false),
+    m_error(false),
+    m_abort(false),
+    m_occupancy(nullptr),
+    m_mtx(),
+    m_cvFilled(),
+    m_cvConsumed(),
+    m_thread(),
+    m_statBytesRead(0),
+    m_statStallCount(0),
+    m_statStallSec(0.0),
+    m_statRestartCount(0) {
+}
+
+RGYReadAhead::~RGYReadAhead() {
+    close();
+}
+
+RGY_ERR RGYReadAhead::open(const tstring& filename, size_t bufferSize, size_t *occupancy, size_t blockSize) {
+    close();
+    m_isPipe = filename == _T("-");
+    m_fileSize = -1;
+#if defined(_WIN32) || defined(_WIN64)
+    if (m_isPipe) {
+        m_handle = GetStdHandle(STD_INPUT_HANDLE);
+    } else {
+        //先読みスレッドが順に読むので、OS側のキャッシュにも順次読み込みであることを伝える
+        m_handle = CreateFile(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    }
+    if (m_handle == INVALID_HANDLE_VALUE || m_handle == NULL) {
+        m_handle = INVALID_HANDLE_VALUE;
+        return RGY_ERR_FILE_OPEN;
+    }
+    LARGE_INTEGER fileSize = { 0 };
+    if (GetFileType(m_handle) == FILE_TYPE_DISK && GetFileSizeEx(m_handle, &fileSize)) {
+        m_fileSize = fileSize.QuadPart;
+    } else {
+        m_isPipe = true;
+    }
+#else
+    m_fd = (m_isPipe) ? fileno(stdin) : ::open(filename.c_str(), O_RDONLY);
+    if (m_fd < 0) {
+        return RGY_ERR_FILE_OPEN;
+    }
+    struct stat st;
+    if (fstat(m_fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        m_fileSize = st.st_size;
+        //先読みスレッドが順に読むので、OS側の先読みも大きくしてもらう
+        posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    } else {
+        m_isPipe = true;
+    }
+#endif //#if defined(_WIN32) || defined(_WIN64)
+
+    m_blockSize = std::max<size_t>(blockSize, 4096);
+    m_blockCount = std::max<size_t>(2, (bufferSize + m_blockSize - 1) / m_blockSize);
+    try {
+        m_buffer.resize(m_blockSize * m_blockCount);
+        m_blockDataSize.assign(m_blockCount, 0);
+    } catch (...) {
+        close();
+        return RGY_ERR_NULL_PTR;
+    }
+    m_blockFirst = 0;
+    m_blockFilled = 0;
+    m_windowStart = 0;
+    m_fillPos = 0;
+    m_readPos = 0;
+    m_restartPos = -1;
+    m_eof = false;
+    m_error = false;
+    m_abort = false;
+    m_occupancy = occupancy;
+    m_thread = std::thread(&RGYReadAhead::threadFunc, this);
+    return RGY_ERR_NONE;
+}
+
+void RGYReadAhead::close() {
+    if (m_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_abort = true;
+        }
+        m_cvConsumed.notify_all();
+#if defined(_WIN32) || defined(_WIN64)
+        if (m_isPipe) {
+            //パイプからのReadFileはデータが来るまで戻らないので、先読みスレッドが終了するまで同期I/Oを取り消す
+            //(ReadFileに入る前に取り消した場合に備え、終了を確認しながら繰り返す)
+            while (WaitForSingleObject(m_thread.native_handle(), READ_AHEAD_PIPE_POLL_MS) == WAIT_TIMEOUT) {
+                CancelSynchronousIo(m_thread.native_handle());
+            }
+        }
+#endif //#if defined(_WIN32) || defined(_WIN64)
+        m_thread.join();
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    if (m_handle != INVALID_HANDLE_VALUE && m_handle != GetStdHandle(STD_INPUT_HANDLE)) {
+        CloseHandle(m_handle);
+    }
+    m_handle = INVALID_HANDLE_VALUE;
+#else
+    if (m_fd >= 0 && m_fd != fileno(stdin)) {
+        ::close(m_fd);
+    }
+    m_fd = -1;
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    if (m_occupancy) {
+        *m_occupancy = 0;
+        m_occupancy = nullptr;
+    }
+    m_buffer.clear();
+    m_buffer.shrink_to_fit();
+    m_blockDataSize.clear();
+    m_blockFilled = 0;
+}
+
+int64_t RGYReadAhead::readAt(uint8_t *buf, size_t size, int64_t pos) {
+    //パイプやネットワーク上のファイルでは要求より少ないサイズが返ることがあるので、
+    //終端に達するまでブロックを埋める (ブロックは末尾以外常に満杯になる)
+    size_t total = 0;
+    while (total < size) {
+        if (m_isPipe && m_abort) {
+            return -1;
+        }
+#if defined(_WIN32) || defined(_WIN64)
+        DWORD readBytes = 0;
+        BOOL ret = FALSE;
+        if (m_isPipe) {
+            ret = ReadFile(m_handle, buf + total, (DWORD)(size - total), &readBytes, NULL);
+        } else {
+            const uint64_t offset = (uint64_t)pos + total;
+            OVERLAPPED ov = { 0 };
+            ov.Offset = (DWORD)offset;
+            ov.OffsetHigh = (DWORD)(offset >> 32);
+            ret = ReadFile(m_handle, buf + total, (DWORD)(size - total), &readBytes, &ov);
+        }
+        if (!ret) {
+            const auto err = GetLastError();
+            if (err == ERROR_HANDLE_EOF || err == ERROR_BROKEN_PIPE) {
+                break;
+            }
+            return -1; //close()での取り消し (ERROR_OPERATION_ABORTED) を含む
+        }
+#else
+        if (m_isPipe) {
+            //パイプからのreadはデータが来るまで戻らず、close()で中断できないので、
+            //pollでデータ(または終端)を待ち、その間に一定間隔でclose()されていないか確認する
+            struct pollfd pfd = { m_fd, POLLIN, 0 };
+            const int ret = poll(&pfd, 1, READ_AHEAD_PIPE_POLL_MS);
+            if (ret < 0 && errno != EINTR) {
+                return -1;
+            }
+            if (ret <= 0) {
+                continue;
+            }
+        }
+        const ssize_t readBytes = (m_isPipe)
+            ? ::read(m_fd, buf + total, size - total)
+            : pread(m_fd, buf + total, size - total, (off_t)(pos + total));
+        if (readBytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+#endif //#if defined(_WIN32) || defined(_WIN64)
+        if (readBytes == 0) {
+            break;
+        }
+        total += readBytes;
+    }
+    return (int64_t)total;
+}
+
+void RGYReadAhead::updateOccupancy() {
+    if (m_occupancy) {
+        const int64_t ahead = std::max<int64_t>(m_fillPos - m_readPos, 0);
+        *m_occupancy = (size_t)(ahead * 100 / (int64_t)(m_blockSize * m_blockCount));
+    }
+}
+
+void RGYReadAhead::requestRestart(int64_t pos) {
+    m_restartPos = pos;
+    m_cvConsumed.notify_one();
+}
+
+void RGYReadAhead::threadFunc() {
+    std::unique_lock<std::mutex> lock(m_mtx);
+    while (!m_abort) {
+        if (m_restartPos >= 0) {
+            //先読みした範囲の外にseekされたので、その位置から読み直す
+            m_blockFirst = 0;
+            m_blockFilled = 0;
+            m_windowStart = m_restartPos;
+            m_fillPos = m_restartPos;
+            m_restartPos = -1;
+            m_eof = false;
+            m_error = false;
+            m_statRestartCount++;
+#if !(defined(_WIN32) || defined(_WIN64))
+            posix_fadvise(m_fd, m_fillPos, (off_t)(m_blockSize * m_blockCount), POSIX_FADV_WILLNEED);
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
+            updateOccupancy();
+        }
+        //空きブロックがなければ、最も古いブロックがすべて読み出されるまで待つ
+        //読み出し済みのブロックも上書きされるまではseekで戻れるように残しておく
+        const bool full = m_blockFilled == m_blockCount;
+        if (m_eof || m_error || (full && m_windowStart + (int64_t)m_blockDataSize[m_blockFirst] > m_readPos)) {
+            m_cvConsumed.wait(lock);
+            continue;
+        }
+        if (full) {
+            m_windowStart += m_blockDataSize[m_blockFirst];
+            m_blockFirst = (m_blockFirst + 1) % m_blockCount;
+            m_blockFilled--;
+        }
+        //読み込み中のブロックはread()からは見えないので、ロックを外して読み込む
+        const size_t idx = (m_blockFirst + m_blockFilled) % m_blockCount;
+        const int64_t pos = m_fillPos;
+        lock.unlock();
+        const auto readBytes = readAt(m_buffer.data() + idx * m_blockSize, m_blockSize, pos);
+        lock.lock();
+        if (m_restartPos >= 0) {
+            continue; //読み込み中に範囲外へseekされたので破棄
+        }
+        if (readBytes < 0) {
+            m_error = true;
+        } else {
+            if (readBytes > 0) {
+                m_blockDataSize[idx] = (size_t)readBytes;
+                m_blockFilled++;
+                m_fillPos += readBytes;
+                m_statBytesRead += readBytes;
+            }
+            if ((size_t)readBytes < m_blockSize) {
+                m_eof = true;
+            }
+        }
+        updateOccupancy();
+        m_cvFilled.notify_all();
+    }
+}
+
+int RGYReadAhead::read(uint8_t *buf, int size) {
+    if (size <= 0) {
+        return 0;
+    }
+    std::unique_lock<std::mutex> lock(m_mtx);
+    std::chrono::steady_clock::time_point stallStart;
+    bool stalled = false;
+    while (m_restartPos >= 0 || m_readPos < m_windowStart || m_readPos >= m_fillPos) {
+        if (m_restartPos < 0) {
+            if (m_error) {
+                return -1;
+            }
+            if (m_eof && m_readPos >= m_fillPos) {
+                return 0;
+            }
+            if (m_readPos < m_windowStart || m_readPos > m_fillPos) {
+                if (m_isPipe) {
+                    return -1;
+                }
+                requestRestart(m_readPos);
+            }
+        }
+        if (!stalled) {
+            stalled = true;
+            stallStart = std::chrono::steady_clock::now();
+            m_statStallCount++;
+        }
+        m_cvFilled.wait(lock);
+    }
+    if (stalled) {
+        m_statStallSec += std::chrono::duration<double>(std::chrono::steady_clock::now() - stallStart).count();
+    }
+    //先読み済みの範囲で、要求されたサイズまでコピーする
+    int copied = 0;
+    while (copied < size && m_readPos < m_fillPos) {
+        const int64_t offset = m_readPos - m_windowStart;
+        const size_t blockIdx = (m_blockFirst + (size_t)(offset / (int64_t)m_blockSize)) % m_blockCount;
+        const size_t blockOffset = (size_t)(offset % (int64_t)m_blockSize);
+        const size_t copySize = std::min((size_t)(size - copied), m_blockDataSize[blockIdx] - blockOffset);
+        memcpy(buf + copied, m_buffer.data() + blockIdx * m_blockSize + blockOffset, copySize);
+        copied += (int)copySize;
+        m_readPos += copySize;
+    }
+    updateOccupancy();
+    if (m_blockFilled == m_blockCount) {
+        m_cvConsumed.notify_one();
+    }
+    return copied;
+}
+
+int64_t RGYReadAhead::seek(int64_t offset, int whence) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    int64_t pos = 0;
+    switch (whence) {
+    case SEEK_SET: pos = offset; break;
+    case SEEK_CUR: pos = m_readPos + offset; break;
+    case SEEK_END:
+        if (m_fileSize < 0) {
+            return -1;
+        }
+        pos = m_fileSize + offset;
+        break;
+    default:
+        return -1;
+    }
+    if (pos < 0) {
+        return -1;
+    }
+    if (pos == m_readPos) {
+        return pos;
+    }
+    if (m_isPipe) {
+        return -1;
+    }
+    m_readPos = pos;
+    //先読み済みの範囲外なら、すぐに先読みをやり直す
+    if (m_restartPos >= 0 || pos < m_windowStart || pos > m_fillPos) {
+        requestRestart(pos);
+    } else if (m_blockFilled == m_blockCount) {
+        m_cvConsumed.notify_one();
+    }
+    updateOccupancy();
+    return pos;
+}
+
+tstring RGYReadAhead::stats() {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return strsprintf(_T("read-ahead: %d x %d KB blocks, read %.1f MB, stalled %lld times (%.3f s), restarted %lld times"),
+        (int)m_blockCount, (int)(m_blockSize >> 10), m_statBytesRead / (double)(1024 * 1024),
+        (long long)m_statStallCount, m_statStallSec, (long long)m_statRestartCount);
+}
@@ -0,0 +1,111 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __RGY_READ_AHEAD_H__
+#define __RGY_READ_AHEAD_H__
+
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include "rgy_osdep.h"
+#include "rgy_tchar.h"
+#include "rgy_err.h"
+
+// 入力ファイルを専用スレッドで先読みするリーダー
+// 先読みしたデータはblockSize単位のリングバッファに格納し、read()ではそこからコピーする
+// 先読み済みの範囲内 (まだ上書きされていない読み込み済みの部分を含む) のseekはバッファ内で処理し、
+// 範囲外へのseekでは先読みをその位置からやり直す
+class RGYReadAhead {
+public:
+    static const size_t READ_AHEAD_BLOCK_SIZE = 1024 * 1024;
+    static const int READ_AHEAD_PIPE_POLL_MS = 50; //パイプからの読み込みを待つ間、close()を確認する間隔
+
+    RGYReadAhead();
+    ~RGYReadAhead();
+    RGYReadAhead(const RGYReadAhead&) = delete;
+    RGYReadAhead &operator=(const RGYReadAhead&) = delete;
+
+    //filenameを開いて先読みを開始する ("-"なら標準入力)
+    //bufferSize ... 先読みバッファの合計サイズ
+    //occupancy  ... 先読みバッファの使用率(%)の書き込み先 (nullptrなら使用しない)
+    RGY_ERR open(const tstring& filename, size_t bufferSize, size_t *occupancy = nullptr, size_t blockSize = READ_AHEAD_BLOCK_SIZE);
+    void close();
+
+    //読み込んだバイト数を返す (終端なら0、エラーなら負の値)
+    int read(uint8_t *buf, int size);
+    //新しい読み込み位置を返す (失敗したら負の値)
+    int64_t seek(int64_t offset, int whence);
+    //ファイルサイズ (不明なら-1)
+    int64_t size() const { return m_fileSize; }
+    bool seekable() const { return !m_isPipe; }
+    //統計情報 (デバッグログ用)
+    tstring stats();
+protected:
+    void threadFunc();
+    int64_t readAt(uint8_t *buf, size_t size, int64_t pos);
+    void requestRestart(int64_t pos);
+    void updateOccupancy();
+
+#if defined(_WIN32) || defined(_WIN64)
+    HANDLE m_handle;
+#else
+    int m_fd;
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    bool m_isPipe;
+    int64_t m_fileSize;
+
+    std::vector<uint8_t> m_buffer;     //先読みバッファ (blockSize x m_blockCount)
+    std::vector<size_t> m_blockDataSize; //各ブロックに格納されたデータ量
+    size_t m_blockSize;
+    size_t m_blockCount;
+    size_t m_blockFirst;               //最も古いブロックのインデックス
+    size_t m_blockFilled;              //データの入っているブロック数
+    int64_t m_windowStart;             //m_blockFirstのファイル上の位置
+    int64_t m_fillPos;                 //次に先読みするファイル上の位置
+    int64_t m_readPos;                 //read()で次に読み出すファイル上の位置
+    int64_t m_restartPos;              //先読みをやり直す位置 (やり直さない場合は-1)
+    bool m_eof;
+    bool m_error;
+    std::atomic<bool> m_abort;         //変更はm_mtxのロック中に行う (readAt()ではロックせずに参照する)
+    size_t *m_occupancy;
+
+    std::mutex m_mtx;
+    std::condition_variable m_cvFilled;   //先読みスレッド -> read()
+    std::condition_variable m_cvConsumed; //read()/seek() -> 先読みスレッド
+    std::thread m_thread;
+
+    uint64_t m_statBytesRead;          //ファイルから読み込んだバイト数
+    uint64_t m_statStallCount;         //read()がデータを待った回数
+    double m_statStallSec;             //read()がデータを待った時間の合計
+    uint64_t m_statRestartCount;       //先読みをやり直した回数
+};
+
+#endif //__RGY_READ_AHEAD_H__
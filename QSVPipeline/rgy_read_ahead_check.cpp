@@ -0,0 +1,278 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// ------------------------------------------------------------------------------------------
+
+#include <cstdio>
+#include <vector>
+#include <random>
+#include <algorithm>
+#if !(defined(_WIN32) || defined(_WIN64))
+#include <unistd.h>
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
+#include "rgy_osdep.h"
+#include "rgy_util.h"
+#include "rgy_read_ahead.h"
+#include "rgy_read_ahead_check.h"
+#include "rgy_check.h"
+
+static const int64_t CHECK_READ_AHEAD_FILE_SIZE = 192 << 20;
+static const size_t CHECK_READ_AHEAD_BUFFER_SIZE = 32 << 20;
+static const int CHECK_READ_AHEAD_READ_SIZE = 64 * 1024; // RGYInputAvcodecのAVIOContextのバッファサイズと同じ
+static const int CHECK_READ_AHEAD_SEEK_COUNT = 4000;
+
+// 先読みの統計情報を参照するため、protectedのメンバを公開する
+class RGYReadAheadCheck : public RGYReadAhead {
+public:
+    using RGYReadAhead::m_statRestartCount;
+};
+
+// ファイルの内容 (位置から決まる値)
+static inline uint8_t check_read_ahead_byte(const int64_t pos) {
+    return (uint8_t)((pos >> ((pos & 3) << 3)) ^ (pos >> 24));
+}
+
+static bool check_read_ahead_match(const uint8_t *buf, const int size, const int64_t pos) {
+    for (int i = 0; i < size; i++) {
+        if (buf[i] != check_read_ahead_byte(pos + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// demuxの処理の代わりに、読み込んだデータに対して一定時間の処理を行う
+static uint32_t check_read_ahead_work(const uint8_t *buf, const int size, const double workSec) {
+    RGYCheckTimer timer;
+    uint32_t sum = 0;
+    do {
+        for (int i = 0; i < size; i += 64) {
+            sum = sum * 31 + buf[i];
+        }
+    } while (timer.sec() < workSec);
+    return sum;
+}
+
+static bool check_read_ahead_print(const TCHAR *name, const bool ok, const int64_t bytes, const double elapsedSec, const tstring& info) {
+    return rgy_check_print(name, ok, strsprintf(_T("%8.1f MB/s %s"), bytes / (elapsedSec * 1024.0 * 1024.0), info.c_str()));
+}
+
+// 先読みなしで順に読み込む
+static bool check_read_ahead_inline(const tstring& path, const double workSec) {
+    FILE *fp = nullptr;
+    if (_tfopen_s(&fp, path.c_str(), _T("rb")) != 0 || fp == nullptr) {
+        return false;
+    }
+    std::vector<uint8_t> buf(CHECK_READ_AHEAD_READ_SIZE);
+    bool ok = true;
+    int64_t pos = 0;
+    RGYCheckTimer timer;
+    for (;;) {
+        const int ret = (int)fread(buf.data(), 1, buf.size(), fp);
+        if (ret <= 0) {
+            break;
+        }
+        ok &= check_read_ahead_match(buf.data(), ret, pos);
+        check_read_ahead_work(buf.data(), ret, workSec);
+        pos += ret;
+    }
+    const double elapsed = timer.sec();
+    fclose(fp);
+    ok &= pos == CHECK_READ_AHEAD_FILE_SIZE;
+    return check_read_ahead_print(strsprintf(_T("inline, %3d us/read"), (int)(workSec * 1e6 + 0.5)).c_str(), ok, pos, elapsed, _T(""));
+}
+
+// 先読みありで順に読み込む
+static bool check_read_ahead_sequential(const tstring& path, const double workSec) {
+    RGYReadAheadCheck readAhead;
+    if (readAhead.open(path, CHECK_READ_AHEAD_BUFFER_SIZE) != RGY_ERR_NONE) {
+        return false;
+    }
+    std::vector<uint8_t> buf(CHECK_READ_AHEAD_READ_SIZE);
+    bool ok = true;
+    int64_t pos = 0;
+    RGYCheckTimer timer;
+    for (;;) {
+        const int ret = readAhead.read(buf.data(), (int)buf.size());
+        if (ret <= 0) {
+            ok &= ret == 0;
+            break;
+        }
+        ok &= check_read_ahead_match(buf.data(), ret, pos);
+        check_read_ahead_work(buf.data(), ret, workSec);
+        pos += ret;
+    }
+    const double elapsed = timer.sec();
+    // 順に読むだけなら先読みをやり直すことはない
+    ok &= pos == CHECK_READ_AHEAD_FILE_SIZE && readAhead.m_statRestartCount == 0;
+    return check_read_ahead_print(strsprintf(_T("read-ahead, %3d us/read"), (int)(workSec * 1e6 + 0.5)).c_str(), ok, pos, elapsed, readAhead.stats());
+}
+
+// 先読みバッファの内外へのseekを交えて読み込む
+static bool check_read_ahead_seek(const tstring& path) {
+    RGYReadAheadCheck readAhead;
+    if (readAhead.open(path, CHECK_READ_AHEAD_BUFFER_SIZE) != RGY_ERR_NONE) {
+        return false;
+    }
+    std::mt19937 mt(6789);
+    std::uniform_int_distribution<int> kindDist(0, 5);
+    std::uniform_int_distribution<int> sizeDist(1, 256 * 1024);
+    std::uniform_int_distribution<int64_t> nearDist(-(int64_t)(4 << 20), 4 << 20);
+    std::uniform_int_distribution<int64_t> farDist(0, CHECK_READ_AHEAD_FILE_SIZE + 1024);
+    std::vector<uint8_t> buf(256 * 1024);
+    bool ok = true;
+    int64_t bytes = 0;
+    int64_t pos = 0;
+    RGYCheckTimer timer;
+    {
+        // 読み込み済みでまだ上書きされていない部分へ戻るseekは、先読みをやり直さずにバッファから読み込む
+        const int64_t backPos = 4 << 20;
+        while (pos < 2 * backPos) {
+            const int read = readAhead.read(buf.data(), (int)buf.size());
+            if (read <= 0) {
+                ok = false;
+                break;
+            }
+            pos += read;
+            bytes += read;
+        }
+        const int read = (readAhead.seek(backPos, SEEK_SET) == backPos) ? readAhead.read(buf.data(), (int)buf.size()) : -1;
+        ok &= read > 0 && check_read_ahead_match(buf.data(), read, backPos) && readAhead.m_statRestartCount == 0;
+        pos = backPos + std::max(read, 0);
+        bytes += std::max(read, 0);
+    }
+    for (int i = 0; ok && i < CHECK_READ_AHEAD_SEEK_COUNT; i++) {
+        int64_t target = pos;
+        int64_t ret = 0;
+        switch (kindDist(mt)) {
+        case 0: // 先読みバッファの外 (ファイルの終端の先を含む)
+            target = farDist(mt);
+            ret = readAhead.seek(target, SEEK_SET);
+            break;
+        case 1: // 近く (読み込み済みの部分を含む)
+            target = std::max<int64_t>(0, pos + nearDist(mt));
+            ret = readAhead.seek(target - pos, SEEK_CUR);
+            break;
+        case 2: // 終端から
+            target = std::max<int64_t>(0, CHECK_READ_AHEAD_FILE_SIZE - sizeDist(mt));
+            ret = readAhead.seek(target - CHECK_READ_AHEAD_FILE_SIZE, SEEK_END);
+            break;
+        default: // seekしない
+            ret = pos;
+            break;
+        }
+        if (ret != target) {
+            ok = false;
+            break;
+        }
+        pos = target;
+        const int size = sizeDist(mt);
+        int done = 0;
+        while (done < size) {
+            const int read = readAhead.read(buf.data() + done, size - done);
+            if (read < 0) {
+                ok = false;
+            }
+            if (read <= 0) {
+                break;
+            }
+            done += read;
+        }
+        const int expected = (int)std::min<int64_t>(std::max<int64_t>(CHECK_READ_AHEAD_FILE_SIZE - pos, 0), size);
+        ok &= done == expected && check_read_ahead_match(buf.data(), done, pos);
+        pos += done;
+        bytes += done;
+    }
+    const double elapsed = timer.sec();
+    return check_read_ahead_print(_T("read-ahead, random seek"), ok, bytes, elapsed, readAhead.stats());
+}
+
+#if !(defined(_WIN32) || defined(_WIN64))
+// 標準入力(パイプ)から先読みし、先読みスレッドがデータを待っている間にclose()しても待たされないことを確認する
+static bool check_read_ahead_stdin_close() {
+    int fds[2] = { -1, -1 };
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    const int stdinOrg = dup(fileno(stdin));
+    dup2(fds[0], fileno(stdin));
+    ::close(fds[0]);
+    bool ok = true;
+    double closeSec = 0.0;
+    {
+        RGYReadAhead readAhead;
+        ok &= readAhead.open(_T("-"), CHECK_READ_AHEAD_BUFFER_SIZE) == RGY_ERR_NONE && !readAhead.seekable();
+        // ブロックの途中までだけ書き込み、先読みスレッドが残りのデータを待っている状態にする
+        std::vector<uint8_t> buf(CHECK_READ_AHEAD_READ_SIZE);
+        for (size_t i = 0; i < buf.size(); i++) {
+            buf[i] = check_read_ahead_byte(i);
+        }
+        ok &= write(fds[1], buf.data(), buf.size()) == (ssize_t)buf.size();
+        check_read_ahead_work(buf.data(), (int)buf.size(), 0.1);
+        RGYCheckTimer timer;
+        readAhead.close();
+        closeSec = timer.sec();
+    }
+    dup2(stdinOrg, fileno(stdin));
+    ::close(stdinOrg);
+    ::close(fds[1]);
+    ok &= closeSec < 1.0;
+    return rgy_check_print(_T("read-ahead, stdin close"), ok, strsprintf(_T("close %.3f s"), closeSec));
+}
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
+
+bool check_read_ahead() {
+    RGYCheckTempFile tmpFile("read_ahead_check");
+    const bool created = tmpFile.create([](FILE *fp) {
+        std::vector<uint8_t> buf(1 << 20);
+        for (int64_t pos = 0; pos < CHECK_READ_AHEAD_FILE_SIZE; pos += buf.size()) {
+            for (size_t i = 0; i < buf.size(); i++) {
+                buf[i] = check_read_ahead_byte(pos + i);
+            }
+            if (fwrite(buf.data(), 1, buf.size(), fp) != buf.size()) {
+                return false;
+            }
+        }
+        return true;
+    });
+    if (!created) {
+        return false;
+    }
+    const tstring& path = tmpFile.path();
+    // 作成直後のファイルはOSのキャッシュに載っているので、ストレージの速度ではなく先読みのオーバーヘッドを計測することになる
+    _ftprintf(stdout, _T("%d MB file (cached), %d KB reads, read-ahead buffer %d MB\n"),
+        (int)(CHECK_READ_AHEAD_FILE_SIZE >> 20), CHECK_READ_AHEAD_READ_SIZE >> 10, (int)(CHECK_READ_AHEAD_BUFFER_SIZE >> 20));
+    bool ok = true;
+    const double workSecList[] = { 0.0, 60e-6 };
+    for (const auto workSec : workSecList) {
+        ok &= check_read_ahead_inline(path, workSec);
+        ok &= check_read_ahead_sequential(path, workSec);
+    }
+    ok &= check_read_ahead_seek(path);
+#if !(defined(_WIN32) || defined(_WIN64))
+    ok &= check_read_ahead_stdin_close();
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
+    return rgy_check_print_total(ok);
+}
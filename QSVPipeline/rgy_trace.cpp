@@ -0,0 +1,194 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc/VCEEnc/rkmppenc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#include <cstdio>
+#include <algorithm>
+#include "rgy_trace.h"
+#include "rgy_osdep.h"
+#include "rgy_util.h"
+
+std::atomic<bool> RGYTrace::s_enabled(false);
+
+static const char *rgy_trace_cat_str(RGYTraceCat cat) {
+    switch (cat) {
+    case RGYTraceCat::TASK:   return "task";
+    case RGYTraceCat::WAIT:   return "wait";
+    case RGYTraceCat::INPUT:  return "input";
+    case RGYTraceCat::OUTPUT: return "output";
+    default:                  return "unknown";
+    }
+}
+
+RGYTraceThreadBuffer::RGYTraceThreadBuffer(int tid, size_t size) :
+    m_events(),
+    m_mask(0),
+    m_writeIdx(0),
+    m_tid(tid),
+    m_threadName() {
+    // インデックス計算をマスクで済ませるため、2の累乗に切り上げる
+    size_t bufSize = 1;
+    while (bufSize < std::max<size_t>(size, 1)) {
+        bufSize <<= 1;
+    }
+    m_events.resize(bufSize);
+    m_mask = bufSize - 1;
+}
+
+RGYTraceThreadBuffer::~RGYTraceThreadBuffer() {
+}
+
+std::vector<RGYTraceEvent> RGYTraceThreadBuffer::events() const {
+    const auto writeIdx = m_writeIdx.load(std::memory_order_acquire);
+    const auto count = std::min<uint64_t>(writeIdx, m_events.size());
+    std::vector<RGYTraceEvent> ret;
+    ret.reserve((size_t)count);
+    for (uint64_t idx = writeIdx - count; idx < writeIdx; idx++) {
+        ret.push_back(m_events[idx & m_mask]);
+    }
+    return ret;
+}
+
+uint64_t RGYTraceThreadBuffer::dropped() const {
+    const auto writeIdx = m_writeIdx.load(std::memory_order_acquire);
+    return (writeIdx > m_events.size()) ? writeIdx - m_events.size() : 0;
+}
+
+RGYTrace::RGYTrace() :
+    m_mtx(),
+    m_buffers(),
+    m_start(std::chrono::steady_clock::now()),
+    m_filename(),
+    m_eventsPerThread(RGY_TRACE_EVENTS_PER_THREAD),
+    m_generation(0) {
+}
+
+RGYTrace::~RGYTrace() {
+    close();
+}
+
+RGYTrace& RGYTrace::get() {
+    static RGYTrace trace;
+    return trace;
+}
+
+RGY_ERR RGYTrace::init(const tstring& filename, size_t eventsPerThread) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    s_enabled = false;
+    m_buffers.clear();
+    m_filename = filename;
+    m_eventsPerThread = eventsPerThread;
+    m_generation++;
+    m_start = std::chrono::steady_clock::now();
+    s_enabled = m_filename.length() > 0;
+    return RGY_ERR_NONE;
+}
+
+RGYTraceThreadBuffer *RGYTrace::threadBuffer() {
+    thread_local RGYTraceThreadBuffer *buffer = nullptr;
+    thread_local uint32_t generation = 0;
+    if (buffer == nullptr || generation != m_generation) {
+        // スレッドごとに初回のみロックして登録する
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_buffers.push_back(std::make_unique<RGYTraceThreadBuffer>((int)m_buffers.size() + 1, m_eventsPerThread));
+        buffer = m_buffers.back().get();
+        generation = m_generation;
+    }
+    return buffer;
+}
+
+void RGYTrace::add(const RGYTraceEvent& event) {
+    if (!enabled()) {
+        return;
+    }
+    threadBuffer()->add(event);
+}
+
+void RGYTrace::setThreadName(const TCHAR *name) {
+    if (!enabled() || name == nullptr) {
+        return;
+    }
+    threadBuffer()->setThreadName(name);
+}
+
+RGY_ERR RGYTrace::close() {
+    if (!enabled()) {
+        return RGY_ERR_NONE;
+    }
+    s_enabled = false;
+    auto err = write();
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_filename.clear();
+    return err;
+}
+
+RGY_ERR RGYTrace::write() {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (m_filename.length() == 0) {
+        return RGY_ERR_NONE;
+    }
+    FILE *fp = nullptr;
+    if (_tfopen_s(&fp, m_filename.c_str(), _T("w")) || fp == nullptr) {
+        return RGY_ERR_FILE_OPEN;
+    }
+    const auto pid = (int)GetCurrentProcessId();
+    bool first = true;
+    auto printSeparator = [&]() {
+        fprintf(fp, (first) ? "\n" : ",\n");
+        first = false;
+    };
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (const auto& buffer : m_buffers) {
+        const auto threadName = (buffer->threadName().length() > 0) ? tchar_to_string(buffer->threadName()) : strsprintf("thread %d", buffer->tid());
+        printSeparator();
+        fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            pid, buffer->tid(), str_escape_json(threadName).c_str());
+        if (buffer->dropped() > 0) {
+            printSeparator();
+            fprintf(fp, "{\"name\":\"trace buffer overflow\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%d,\"ts\":0,\"args\":{\"dropped\":%lld}}",
+                pid, buffer->tid(), (long long)buffer->dropped());
+        }
+        for (const auto& event : buffer->events()) {
+            auto name = tchar_to_string(event.name ? event.name : _T(""));
+            if (event.op) {
+                name += " " + tchar_to_string(event.op);
+            }
+            printSeparator();
+            // Chrome trace形式の時刻はus単位
+            fprintf(fp, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                str_escape_json(name).c_str(), rgy_trace_cat_str(event.cat), pid, buffer->tid(),
+                event.start * 1e-3, event.duration * 1e-3);
+            if (event.frame >= 0) {
+                fprintf(fp, ",\"args\":{\"frame\":%lld}", (long long)event.frame);
+            }
+            fprintf(fp, "}");
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    const bool writeError = ferror(fp) != 0;
+    fclose(fp);
+    return (writeError) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
+}
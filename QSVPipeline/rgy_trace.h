@@ -0,0 +1,150 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc/VCEEnc/rkmppenc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// --------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __RGY_TRACE_H__
+#define __RGY_TRACE_H__
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include "rgy_tchar.h"
+#include "rgy_err.h"
+
+// トレースの1スレッドあたりの最大イベント数 (リングバッファのため、あふれたら古いものから上書き)
+static const size_t RGY_TRACE_EVENTS_PER_THREAD = 1 << 16;
+
+enum class RGYTraceCat : uint8_t {
+    TASK,   // PipelineTaskのsendFrame/getOutput
+    WAIT,   // 空きサーフェスの待機、同期待ち
+    INPUT,  // 読み込みスレッド
+    OUTPUT, // 書き出しスレッド
+};
+
+struct RGYTraceEvent {
+    const TCHAR *name;  // 静的な文字列のみ (出力時まで参照する)
+    const TCHAR *op;    // 静的な文字列のみ (nullptr可)
+    int64_t frame;      // フレーム番号 (-1で無効)
+    int64_t start;      // 開始時刻 (ns, トレース開始時点からの相対)
+    int64_t duration;   // 処理時間 (ns)
+    RGYTraceCat cat;
+};
+
+// スレッドごとのリングバッファ
+// 書き込みは所有スレッドのみが行うのでロック不要、出力時は書き込み位置をacquireで読み取る
+class RGYTraceThreadBuffer {
+public:
+    RGYTraceThreadBuffer(int tid, size_t size);
+    ~RGYTraceThreadBuffer();
+    void add(const RGYTraceEvent& event) {
+        const auto idx = m_writeIdx.load(std::memory_order_relaxed);
+        m_events[idx & m_mask] = event;
+        m_writeIdx.store(idx + 1, std::memory_order_release);
+    }
+    std::vector<RGYTraceEvent> events() const;
+    uint64_t dropped() const;
+    int tid() const { return m_tid; }
+    const tstring& threadName() const { return m_threadName; }
+    void setThreadName(const tstring& name) { m_threadName = name; }
+protected:
+    std::vector<RGYTraceEvent> m_events;
+    size_t m_mask;
+    std::atomic<uint64_t> m_writeIdx;
+    int m_tid;
+    tstring m_threadName;
+};
+
+// パイプラインの各処理の開始/終了を記録し、Chrome trace形式(json)で出力する
+// 出力したファイルはPerfetto (ui.perfetto.dev) やchrome://tracingで開くことができる
+class RGYTrace {
+public:
+    static RGYTrace& get();
+    static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    RGY_ERR init(const tstring& filename, size_t eventsPerThread = RGY_TRACE_EVENTS_PER_THREAD);
+    // 記録を停止し、ファイルに出力する
+    RGY_ERR close();
+    // 現在のスレッドの名前を設定する (トレース上のスレッド名になる)
+    void setThreadName(const TCHAR *name);
+    void add(const RGYTraceEvent& event);
+    int64_t now() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+    }
+    const tstring& filename() const { return m_filename; }
+protected:
+    RGYTrace();
+    ~RGYTrace();
+    RGYTraceThreadBuffer *threadBuffer();
+    RGY_ERR write();
+
+    static std::atomic<bool> s_enabled;
+    std::mutex m_mtx;
+    std::vector<std::unique_ptr<RGYTraceThreadBuffer>> m_buffers; // 各スレッドのバッファ (スレッド終了後も保持する)
+    std::chrono::steady_clock::time_point m_start;
+    tstring m_filename;
+    size_t m_eventsPerThread;
+    std::atomic<uint32_t> m_generation; // init()ごとに更新し、thread_localのバッファを再登録させる
+};
+
+// スコープの開始から終了までをひとつのイベントとして記録する
+class RGYTraceScope {
+public:
+    RGYTraceScope(RGYTraceCat cat, const TCHAR *name, const TCHAR *op = nullptr, int64_t frame = -1) : m_active(RGYTrace::enabled()), m_event() {
+        if (m_active) {
+            m_event.name = name;
+            m_event.op = op;
+            m_event.frame = frame;
+            m_event.cat = cat;
+            m_event.start = RGYTrace::get().now();
+        }
+    }
+    ~RGYTraceScope() {
+        end();
+    }
+    // スコープの終了を待たずに記録する
+    void end() {
+        if (m_active) {
+            auto& trace = RGYTrace::get();
+            m_event.duration = trace.now() - m_event.start;
+            trace.add(m_event);
+            m_active = false;
+        }
+    }
+    void setFrame(int64_t frame) { m_event.frame = frame; }
+    // 記録する必要がなかった場合(待機が発生しなかった場合など)に記録を取り消す
+    void cancel() { m_active = false; }
+protected:
+    RGYTraceScope(const RGYTraceScope&) = delete;
+    RGYTraceScope& operator=(const RGYTraceScope&) = delete;
+    bool m_active;
+    RGYTraceEvent m_event;
+};
+
+#endif //__RGY_TRACE_H__
@@ -320,6 +320,30 @@ std::string str_replace(std::string str, const std::string& from, const std::str
     return str;
 }
 
+std::string str_escape_json(const std::string& str) {
+    std::string ret;
+    ret.reserve(str.length());
+    for (const auto c : str) {
+        switch (c) {
+        case '\"': ret += "\\\""; break;
+        case '\\': ret += "\\\\"; break;
+        case '\n': ret += "\\n"; break;
+        case '\r': ret += "\\r"; break;
+        case '\t': ret += "\\t"; break;
+        default:
+            if ((uint8_t)c < 0x20) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", (uint8_t)c);
+                ret += buf;
+            } else {
+                ret += c;
+            }
+            break;
+        }
+    }
+    return ret;
+}
+
 #if defined(_WIN32) || defined(_WIN64)
 std::wstring str_replace(std::wstring str, const std::wstring& from, const std::wstring& to) {
     std::wstring::size_type pos = 0;
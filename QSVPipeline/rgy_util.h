@@ -640,6 +640,8 @@ std::vector<std::string> sep_cmd(const std::string &cmd);
 #endif //#if defined(_WIN32) || defined(_WIN64)
 
 std::string str_replace(std::string str, const std::string& from, const std::string& to);
+//JSONの文字列として出力できるようエスケープする (UTF-8を想定)
+std::string str_escape_json(const std::string& str);
 
 tstring print_time(double time);
 